@@ -64,6 +64,8 @@ extern cipher_type_t aes_icm;
 extern cipher_type_t aes_icm_192;
 extern cipher_type_t aes_icm_256;
 
+err_status_t aes_icm_openssl_dealloc(cipher_t *c);
+
 /*
  * integer counter mode works as follows:
  *
@@ -158,7 +160,13 @@ err_status_t aes_icm_openssl_alloc (cipher_t **c, int key_len, int tlen)
 
     /* set key size        */
     (*c)->key_len = key_len;
-    EVP_CIPHER_CTX_init(&icm->ctx);
+    icm->key_loaded = 0;
+    icm->ctx = EVP_CIPHER_CTX_new();
+    if (icm->ctx == NULL) {
+        aes_icm_openssl_dealloc(*c);
+        *c = NULL;
+        return err_status_alloc_fail;
+    }
 
     return err_status_ok;
 }
@@ -180,7 +188,9 @@ err_status_t aes_icm_openssl_dealloc (cipher_t *c)
      */
     ctx = (aes_icm_ctx_t*)c->state;
     if (ctx != NULL) {
-        EVP_CIPHER_CTX_cleanup(&ctx->ctx);
+        if (ctx->ctx != NULL) {
+            EVP_CIPHER_CTX_free(ctx->ctx);
+        }
         /* decrement ref_count for the appropriate engine */
         switch (ctx->key_size) {
         case AES_256_KEYSIZE:
@@ -250,7 +260,8 @@ err_status_t aes_icm_openssl_context_init (aes_icm_ctx_t *c, const uint8_t *key)
     debug_print(mod_aes_icm, "key:  %s", v128_hex_string((v128_t*)&c->key));
     debug_print(mod_aes_icm, "offset: %s", v128_hex_string(&c->offset));
 
-    EVP_CIPHER_CTX_cleanup(&c->ctx);
+    /* the key schedule is expanded into ctx on the next set_iv */
+    c->key_loaded = 0;
 
     return err_status_ok;
 }
@@ -286,10 +297,17 @@ err_status_t aes_icm_openssl_set_iv (aes_icm_ctx_t *c, void *iv, int dir)
         break;
     }
 
-    if (!EVP_EncryptInit_ex(&c->ctx, evp,
-                            NULL, c->key.v8, c->counter.v8)) {
+    /* once the key is in place only the counter changes per packet */
+    if (c->key_loaded) {
+        evp = NULL;
+    }
+
+    if (!EVP_EncryptInit_ex(c->ctx, evp,
+                            NULL, c->key_loaded ? NULL : c->key.v8, c->counter.v8)) {
+        c->key_loaded = 0;
         return err_status_fail;
     } else {
+        c->key_loaded = 1;
         return err_status_ok;
     }
 }
@@ -308,12 +326,12 @@ err_status_t aes_icm_openssl_encrypt (aes_icm_ctx_t *c, unsigned char *buf, unsi
 
     debug_print(mod_aes_icm, "rs0: %s", v128_hex_string(&c->counter));
 
-    if (!EVP_EncryptUpdate(&c->ctx, buf, &len, buf, *enc_len)) {
+    if (!EVP_EncryptUpdate(c->ctx, buf, &len, buf, *enc_len)) {
         return err_status_cipher_fail;
     }
     *enc_len = len;
 
-    if (!EVP_EncryptFinal_ex(&c->ctx, buf, (int*)&len)) {
+    if (!EVP_EncryptFinal_ex(c->ctx, buf, (int*)&len)) {
         return err_status_cipher_fail;
     }
     *enc_len += len;
@@ -54,6 +54,20 @@ debug_module_t mod_hmac = {
 };
 
 
+static void
+hmac_free_ctx (hmac_ctx_t *state)
+{
+    if (state->ctx) {
+        EVP_MD_CTX_destroy(state->ctx);
+    }
+    if (state->init_ctx) {
+        EVP_MD_CTX_destroy(state->init_ctx);
+    }
+    if (state->opad_ctx) {
+        EVP_MD_CTX_destroy(state->opad_ctx);
+    }
+}
+
 err_status_t
 hmac_alloc (auth_t **a, int key_len, int out_len)
 {
@@ -93,6 +107,15 @@ hmac_alloc (auth_t **a, int key_len, int out_len)
     new_hmac_ctx = (hmac_ctx_t*)((*a)->state);
     memset(new_hmac_ctx, 0, sizeof(hmac_ctx_t));
 
+    new_hmac_ctx->ctx = EVP_MD_CTX_create();
+    new_hmac_ctx->init_ctx = EVP_MD_CTX_create();
+    new_hmac_ctx->opad_ctx = EVP_MD_CTX_create();
+    if (!new_hmac_ctx->ctx || !new_hmac_ctx->init_ctx || !new_hmac_ctx->opad_ctx) {
+        hmac_free_ctx(new_hmac_ctx);
+        crypto_free(pointer);
+        return err_status_alloc_fail;
+    }
+
     /* increment global count of all hmac uses */
     hmac.ref_count++;
 
@@ -106,12 +129,7 @@ hmac_dealloc (auth_t *a)
     hmac_ctx_t *hmac_ctx;
 
     hmac_ctx = (hmac_ctx_t*)a->state;
-    if (hmac_ctx->ctx_initialized) {
-        EVP_MD_CTX_cleanup(&hmac_ctx->ctx);
-    }
-    if (hmac_ctx->init_ctx_initialized) {
-        EVP_MD_CTX_cleanup(&hmac_ctx->init_ctx);
-    }
+    hmac_free_ctx(hmac_ctx);
 
     /* zeroize entire state*/
     octet_string_set_to_zero((uint8_t*)a,
@@ -156,27 +174,25 @@ hmac_init (hmac_ctx_t *state, const uint8_t *key, int key_len)
 
     debug_print(mod_hmac, "ipad: %s", octet_string_hex_string(ipad, 64));
 
-    /* initialize sha1 context */
-    sha1_init(&state->init_ctx);
-    state->init_ctx_initialized = 1;
+    /* hash ipad ^ key into the inner context and opad ^ key into the outer one */
+    if (!EVP_DigestInit_ex(state->init_ctx, EVP_sha1(), NULL) ||
+        !EVP_DigestUpdate(state->init_ctx, ipad, 64) ||
+        !EVP_DigestInit_ex(state->opad_ctx, EVP_sha1(), NULL) ||
+        !EVP_DigestUpdate(state->opad_ctx, state->opad, 64)) {
+        return err_status_init_fail;
+    }
 
-    /* hash ipad ^ key */
-    sha1_update(&state->init_ctx, ipad, 64);
     return (hmac_start(state));
 }
 
 err_status_t
 hmac_start (hmac_ctx_t *state)
 {
-    if (state->ctx_initialized) {
-        EVP_MD_CTX_cleanup(&state->ctx);
-    }
-    if (!EVP_MD_CTX_copy(&state->ctx, &state->init_ctx)) {
+    if (!EVP_MD_CTX_copy_ex(state->ctx, state->init_ctx)) {
         return err_status_auth_fail;
-    } else {
-        state->ctx_initialized = 1;
-        return err_status_ok;
     }
+
+    return err_status_ok;
 }
 
 err_status_t
@@ -187,7 +203,7 @@ hmac_update (hmac_ctx_t *state, const uint8_t *message, int msg_octets)
                 octet_string_hex_string(message, msg_octets));
 
     /* hash message into sha1 context */
-    sha1_update(&state->ctx, message, msg_octets);
+    sha1_update(state->ctx, message, msg_octets);
 
     return err_status_ok;
 }
@@ -198,6 +214,7 @@ hmac_compute (hmac_ctx_t *state, const void *message,
 {
     uint32_t hash_value[5];
     uint32_t H[5];
+    unsigned int len = 0;
     int i;
 
     /* check tag length, return error if we can't provide the value expected */
@@ -206,8 +223,8 @@ hmac_compute (hmac_ctx_t *state, const void *message,
     }
 
     /* hash message, copy output into H */
-    sha1_update(&state->ctx, message, msg_octets);
-    sha1_final(&state->ctx, H);
+    sha1_update(state->ctx, message, msg_octets);
+    EVP_DigestFinal_ex(state->ctx, (unsigned char*)H, &len);
 
     /*
      * note that we don't need to debug_print() the input, since the
@@ -216,17 +233,16 @@ hmac_compute (hmac_ctx_t *state, const void *message,
     debug_print(mod_hmac, "intermediate state: %s",
                 octet_string_hex_string((uint8_t*)H, 20));
 
-    /* re-initialize hash context */
-    sha1_init(&state->ctx);
-
-    /* hash opad ^ key  */
-    sha1_update(&state->ctx, (uint8_t*)state->opad, 64);
+    /* start the outer hash from the cached opad ^ key state */
+    if (!EVP_MD_CTX_copy_ex(state->ctx, state->opad_ctx)) {
+        return err_status_auth_fail;
+    }
 
     /* hash the result of the inner hash */
-    sha1_update(&state->ctx, (uint8_t*)H, 20);
+    sha1_update(state->ctx, (uint8_t*)H, 20);
 
     /* the result is returned in the array hash_value[] */
-    sha1_final(&state->ctx, hash_value);
+    EVP_DigestFinal_ex(state->ctx, (unsigned char*)hash_value, &len);
 
     /* copy hash_value to *result */
     for (i = 0; i < tag_len; i++) {
@@ -51,11 +51,15 @@
 
 typedef struct {
   uint8_t    opad[64];
+#ifdef OPENSSL
+  /* EVP contexts are opaque from OpenSSL 1.1 on; init_ctx and opad_ctx hold
+     the keyed inner and outer states so each packet only copies them */
+  sha1_ctx_t *ctx;
+  sha1_ctx_t *init_ctx;
+  sha1_ctx_t *opad_ctx;
+#else
   sha1_ctx_t ctx;
   sha1_ctx_t init_ctx;
-#ifdef OPENSSL
-  int ctx_initialized;
-  int init_ctx_initialized;
 #endif
 } hmac_ctx_t;
 
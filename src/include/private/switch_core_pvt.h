@@ -302,9 +302,17 @@ struct switch_runtime {
 extern struct switch_runtime runtime;
 
 
+/* The session table is split into this many shards by uuid hash, must be a power of two */
+#define SWITCH_SESSION_TABLE_SHARDS 64
+
+struct switch_session_shard {
+	switch_thread_rwlock_t *rwlock;
+	switch_hash_t *session_table;
+};
+
 struct switch_session_manager {
 	switch_memory_pool_t *memory_pool;
-	switch_hash_t *session_table;
+	struct switch_session_shard shards[SWITCH_SESSION_TABLE_SHARDS];
 	uint32_t session_count;
 	uint32_t session_limit;
 	switch_size_t session_id;
@@ -410,6 +410,16 @@ SWITCH_DECLARE(void) switch_atomic_set(volatile switch_atomic_t *mem, uint32_t v
  */
 SWITCH_DECLARE(void) switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val);
 
+/**
+ * Uses an atomic operation to add the uint32 value to the value at the
+ * specified location of memory and hands back what was there before, so
+ * racing callers each see a different value.
+ * @param mem The location of the value to add to.
+ * @param val The uint32 value to add to the value at the memory location.
+ * @return The value that was at mem before the operation.
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_fetch_add(volatile switch_atomic_t *mem, uint32_t val);
+
 /**
  * Uses an atomic operation to increment the value at the specified memroy
  * location.
@@ -424,6 +434,16 @@ SWITCH_DECLARE(void) switch_atomic_inc(volatile switch_atomic_t *mem);
  */
 SWITCH_DECLARE(int)  switch_atomic_dec(volatile switch_atomic_t *mem);
 
+/**
+ * Uses an atomic operation to compare the value at the specified memory
+ * location with cmp and, if they are equal, replace it with with.
+ * @param mem The location of the value to swap.
+ * @param with The value to store if the comparison succeeds.
+ * @param cmp The value to compare against.
+ * @return The value that was at mem before the operation.
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp);
+
 /** @} */
 
 /**
@@ -971,6 +991,31 @@ SWITCH_DECLARE(switch_status_t) switch_threadattr_detach_set(switch_threadattr_t
 SWITCH_DECLARE(switch_status_t) switch_thread_create(switch_thread_t ** new_thread, switch_threadattr_t *attr,
 													 switch_thread_start_t func, void *data, switch_memory_pool_t *cont);
 
+/** Opaque thread private address space. */
+	 typedef struct apr_threadkey_t switch_threadkey_t;
+
+/**
+ * Create and initialize a new thread private address space
+ * @param key The thread private handle.
+ * @param dest The destructor to use when freeing the private memory.
+ * @param pool The pool to use
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_create(switch_threadkey_t ** key, void (*dest) (void *), switch_memory_pool_t *pool);
+
+/**
+ * Get a pointer to the thread private memory
+ * @param new_mem The data stored in private memory
+ * @param key The handle for the desired thread private memory
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_get(void **new_mem, switch_threadkey_t *key);
+
+/**
+ * Set the data to be stored in thread private memory
+ * @param priv The data to be stored in private memory
+ * @param key The handle for the desired thread private memory
+ */
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_set(void *priv, switch_threadkey_t *key);
+
 /** @} */
 
 /**
@@ -1170,6 +1215,26 @@ SWITCH_DECLARE(switch_status_t) switch_socket_sendto(switch_socket_t *sock, swit
 													
 SWITCH_DECLARE(switch_status_t) switch_socket_send_nonblock(switch_socket_t *sock, const char *buf, switch_size_t *len);
 
+/** One buffer of a gathered write, see switch_socket_sendv_nonblock */
+typedef struct switch_iovec {
+	const char *base;
+	switch_size_t len;
+} switch_iovec_t;
+
+/** The most buffers switch_socket_sendv_nonblock will gather into one call */
+#define SWITCH_IOVEC_MAX 64
+
+/**
+ * Send several buffers over a network in one call without waiting for the socket to drain.
+ * @param sock The socket to send the data over.
+ * @param vec The buffers to send, in order; only the first SWITCH_IOVEC_MAX are used.
+ * @param nvec The number of buffers in vec.
+ * @param len On exit, the number of bytes sent across all buffers.
+ * @remark A short write is not an error; the caller resumes from *len.  SWITCH_STATUS_IS_BREAK(status)
+ * means the socket would block.
+ */
+SWITCH_DECLARE(switch_status_t) switch_socket_sendv_nonblock(switch_socket_t *sock, const switch_iovec_t *vec, int32_t nvec, switch_size_t *len);
+
 /**
  * @param from The apr_sockaddr_t to fill in the recipient info
  * @param sock The socket to use
@@ -511,6 +511,15 @@ SWITCH_DECLARE(const switch_state_handler_table_t *) switch_channel_get_state_ha
 */
 SWITCH_DECLARE(switch_status_t) switch_channel_set_private(switch_channel_t *channel, const char *key, const void *private_info);
 
+/*!
+  \brief Set private data on channel unless the key already has some
+  \param channel channel on which to set data
+  \param key unique keyname to associate your private data to
+  \param private_info void pointer to private data
+  \return the private data now set for key, which is not private_info if another caller got there first
+*/
+SWITCH_DECLARE(void *) switch_channel_set_private_if_absent(switch_channel_t *channel, const char *key, const void *private_info);
+
 /*!
   \brief Retrieve private from a given channel
   \param channel channel to retrieve data from
@@ -2644,6 +2644,19 @@ SWITCH_DECLARE(void) switch_core_recovery_untrack(switch_core_session_t *session
 SWITCH_DECLARE(void) switch_core_recovery_track(switch_core_session_t *session);
 SWITCH_DECLARE(void) switch_core_recovery_flush(const char *technology, const char *profile_name);
 
+/*!
+  \brief Walk the in-memory channel index in creation order, handing each row to callback laid out like the matching SQL table or view
+  \param view channels, basic_calls or detailed_calls
+  \param match optional filter on uuid, name, cid_name, cid_num and presence_data; a LIKE pattern when it holds a %, a substring otherwise
+  \param bridged_only only return calls with a b leg
+  \param callback row callback, a non-zero return stops the walk
+  \param pArg user data for the callback
+  \return the number of rows handed to callback
+*/
+SWITCH_DECLARE(uint32_t) switch_core_channel_index_walk(switch_channel_index_view_t view, const char *match, switch_bool_t bridged_only,
+														switch_core_db_callback_func_t callback, void *pArg);
+SWITCH_DECLARE(uint32_t) switch_core_channel_index_count(switch_channel_index_view_t view);
+
 SWITCH_DECLARE(void) switch_sql_queue_manager_pause(switch_sql_queue_manager_t *qm, switch_bool_t flush);
 SWITCH_DECLARE(void) switch_sql_queue_manager_resume(switch_sql_queue_manager_t *qm);
 
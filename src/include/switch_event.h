@@ -61,6 +61,7 @@
 #include <switch.h>
 
 SWITCH_BEGIN_EXTERN_C
+#define SWITCH_EVENT_HEADER_INLINE_LEN 48
 /*! \brief An event Header */
 	struct switch_event_header {
 	/*! the header name */
@@ -74,6 +75,10 @@ SWITCH_BEGIN_EXTERN_C
 	/*! hash of the header name */
 	unsigned long hash;
 	struct switch_event_header *next;
+	/*! storage for short header names (name points here when used) */
+	char name_buf[SWITCH_EVENT_HEADER_INLINE_LEN];
+	/*! storage for short header values (value points here when used) */
+	char value_buf[SWITCH_EVENT_HEADER_INLINE_LEN];
 };
 
 /*! \brief Representation of an event */
@@ -100,6 +105,14 @@ struct switch_event {
 	unsigned long key;
 	struct switch_event *next;
 	int flags;
+	/*! open addressing index of the headers by name hash (built once the event is large) */
+	switch_event_header_t **header_index;
+	/*! number of slots in the header index (always a power of 2) */
+	uint32_t header_index_size;
+	/*! number of headers linked in the event */
+	uint32_t header_count;
+	/*! when the event was put on a dispatch shard */
+	switch_time_t queued;
 };
 
 typedef struct switch_serial_event_s {
@@ -116,6 +129,24 @@ typedef struct switch_serial_event_header_s {
 	char *value;
 } switch_serial_event_header_t;
 
+/*! \brief Counters from the event and header allocator */
+typedef struct switch_event_alloc_stats_s {
+	/*! events allocated from the system since startup */
+	uint64_t events_allocated;
+	/*! events given back to the system since startup */
+	uint64_t events_freed;
+	/*! events idle in the shared cache */
+	uint32_t events_cached;
+	/*! headers allocated from the system since startup */
+	uint64_t headers_allocated;
+	/*! headers given back to the system since startup */
+	uint64_t headers_freed;
+	/*! headers idle in the shared cache */
+	uint32_t headers_cached;
+	/*! threads holding a private cache */
+	uint32_t thread_caches;
+} switch_event_alloc_stats_t;
+
 typedef enum {
 	EF_UNIQ_HEADERS = (1 << 0),
 	EF_NO_CHAT_EXEC = (1 << 1),
@@ -175,6 +206,13 @@ _Ret_opt_z_ SWITCH_DECLARE(char *) switch_event_get_header_idx(switch_event_t *e
 
 SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event, const char *header_name, const char *new_header_name);
 
+/*!
+  \brief Set the number of headers an event must carry before its headers are indexed by name
+  \param threshold the header count at which the index is built (0 disables the index)
+  \return the previous threshold
+*/
+SWITCH_DECLARE(uint32_t) switch_event_set_header_index_threshold(uint32_t threshold);
+
 /*!
   \brief Retrieve the body value from an event
   \param event the event to read the body from
@@ -235,6 +273,9 @@ SWITCH_DECLARE(switch_status_t) switch_event_dup_reply(switch_event_t **event, s
   \param event the event to send (will be nulled on success)
   \param user_data optional private data to pass to the event handlers
   \return
+  \note Handlers only see the events of one call (Unique-ID) in the order they were fired once
+        switch_event_launch_dispatch_shards has run.  The shared dispatch queue hands events to
+        as many threads as the load calls for, and those may deliver them out of order.
 */
 SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, const char *func, int line, switch_event_t **event, void *user_data);
 
@@ -274,6 +315,13 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node);
 SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callback_t callback);
 
+/*!
+  \brief Report every event binding with its delivery count and the time spent in its callback
+  \param stream the stream to write the report to
+  \param reset clear the counters once they are reported
+*/
+SWITCH_DECLARE(void) switch_event_binding_status(switch_stream_handle_t *stream, switch_bool_t reset);
+
 /*!
   \brief Render the name of an event id enumeration
   \param event the event id to render the name of
@@ -329,6 +377,12 @@ SWITCH_DECLARE(switch_status_t) switch_event_create_array_pair(switch_event_t **
 SWITCH_DECLARE(switch_xml_t) switch_event_xmlize(switch_event_t *event, const char *fmt, ...) PRINTF_FUNCTION(2, 3);
 #endif
 
+/*!
+  \brief Read the counters of the event allocator
+  \param stats the structure to fill in
+*/
+SWITCH_DECLARE(void) switch_event_get_alloc_stats(switch_event_alloc_stats_t *stats);
+
 /*!
   \brief Determine if the event system has been initialized
   \return SWITCH_STATUS_SUCCESS if the system is running
@@ -425,6 +479,20 @@ SWITCH_DECLARE(void) switch_json_add_presence_data_cols(switch_event_t *event, c
 
 SWITCH_DECLARE(void) switch_event_launch_dispatch_threads(uint32_t max);
 
+/*!
+  \brief Switch event dispatch to one queue and thread per shard, events of the same call (Unique-ID) stay on one shard
+  \param count the number of shards to create (can only be done once)
+  \note This is what guarantees handlers see each call's events in the order they were fired; it is off
+        unless event-dispatch-shards is set in switch.conf.  Events without a Unique-ID have no order.
+*/
+SWITCH_DECLARE(void) switch_event_launch_dispatch_shards(uint32_t count);
+
+/*!
+  \brief Report the depth and queueing latency of the event dispatch queues
+  \param stream the stream to write the report to
+*/
+SWITCH_DECLARE(void) switch_event_dispatch_status(switch_stream_handle_t *stream);
+
 SWITCH_DECLARE(uint32_t) switch_event_channel_broadcast(const char *event_channel, cJSON **json, const char *key, switch_event_channel_id_t id);
 SWITCH_DECLARE(uint32_t) switch_event_channel_unbind(const char *event_channel, switch_event_channel_func_t func);
 SWITCH_DECLARE(switch_status_t) switch_event_channel_bind(const char *event_channel, switch_event_channel_func_t func, switch_event_channel_id_t *id);
@@ -42,6 +42,41 @@ SWITCH_BEGIN_EXTERN_C
  */
 	typedef struct real_pcre switch_regex_t;
 
+/*! \brief Counters from the compiled expression cache */
+typedef struct switch_regex_cache_stats_s {
+	/*! compiled expressions currently held */
+	uint32_t entries;
+	/*! the most expressions the cache will hold (0 when disabled) */
+	uint32_t size;
+	/*! lookups answered from the cache */
+	uint64_t hits;
+	/*! lookups that had to compile the expression */
+	uint64_t misses;
+	/*! expressions dropped to make room */
+	uint64_t evictions;
+} switch_regex_cache_stats_t;
+
+SWITCH_DECLARE(void) switch_regex_init(switch_memory_pool_t *pool);
+SWITCH_DECLARE(void) switch_regex_shutdown(void);
+
+/*!
+ \brief Set how many compiled expressions switch_regex_perform and switch_regex_match keep around
+ \param size the number of expressions to keep (0 disables the cache)
+ \return the previous size
+*/
+SWITCH_DECLARE(uint32_t) switch_regex_cache_set_size(uint32_t size);
+
+/*!
+ \brief Drop every compiled expression from the cache
+*/
+SWITCH_DECLARE(void) switch_regex_cache_flush(void);
+
+/*!
+ \brief Read the counters of the compiled expression cache
+ \param stats the structure to fill in
+*/
+SWITCH_DECLARE(void) switch_regex_cache_get_stats(switch_regex_cache_stats_t *stats);
+
 SWITCH_DECLARE(switch_regex_t *) switch_regex_compile(const char *pattern, int options, const char **errorptr, int *erroroffset,
 													  const unsigned char *tables);
 
@@ -171,6 +171,35 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
 SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t samples, int32_t vol);
 ///\}
 
+/*!
+  \brief Add signed linear samples into a 32 bit mix, the way a conference sums its members
+  \param mix the running sum
+  \param data the samples to add
+  \param samples the number of samples
+*/
+SWITCH_DECLARE(void) switch_mix_accumulate_sln(int32_t *mix, const int16_t *data, uint32_t samples);
+
+/*!
+  \brief Take a contribution back out of a 32 bit mix and clamp the result to signed linear
+  \param out where to write the clamped samples
+  \param mix the running sum
+  \param self the samples to remove from the sum, NULL to only clamp
+  \param samples the number of samples
+*/
+SWITCH_DECLARE(void) switch_mix_minus_sln(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples);
+
+/*!
+  \brief Get the name of the mixing kernel in use (scalar, sse2 or avx2)
+*/
+SWITCH_DECLARE(const char *) switch_mix_get_kernel(void);
+
+/*!
+  \brief Force a mixing kernel, mostly for benchmarks
+  \param name the kernel to use, NULL or "auto" to pick the best one the cpu supports
+  \return SWITCH_STATUS_SUCCESS if the kernel is available
+*/
+SWITCH_DECLARE(switch_status_t) switch_mix_set_kernel(const char *name);
+
 SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples, int channels);
 SWITCH_DECLARE(uint32_t) switch_unmerge_sln(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples, int channels);
 SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, uint32_t orig_channels, uint32_t channels);
@@ -204,6 +204,118 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_ssrc(switch_rtp_t *rtp_ses
 */
 SWITCH_DECLARE(switch_port_t) switch_rtp_set_end_port(switch_port_t port);
 
+/*! 
+  \brief Set the number of epoll reactor threads that read RTP/RTCP sockets on behalf of proxy media sessions (takes effect at switch_rtp_init)
+  \param threads new value (0, the default, polls every socket from its own session thread)
+  \return the current number of reactor threads
+*/
+SWITCH_DECLARE(uint32_t) switch_rtp_set_reactor_threads(uint32_t threads);
+
+/*! 
+  \brief Give every session the same local port, read by the reactor and routed by SSRC, source address or ICE username (takes effect at switch_rtp_init)
+  \param port new value (0 allocates a port per session from the rtp port range)
+  \return the current shared port
+*/
+SWITCH_DECLARE(switch_port_t) switch_rtp_set_shared_port(switch_port_t port);
+
+/*! 
+  \brief Set how many packets of a video frame are collected and written with a single sendmmsg
+  \param packets new value (0 or 1 writes every packet on its own)
+  \return the current batch size
+*/
+SWITCH_DECLARE(uint32_t) switch_rtp_set_send_batch(uint32_t packets);
+
+/*! 
+  \brief Set the largest packet a send batch keeps room for, larger ones are written on their own
+  \param mtu new value in bytes (0 leaves it alone)
+  \return the current size
+*/
+SWITCH_DECLARE(uint32_t) switch_rtp_set_send_batch_mtu(uint32_t mtu);
+
+/*! \brief Counters from the batched RTP socket I/O */
+typedef struct switch_rtp_io_stats_s {
+	/*! reactor threads reading RTP/RTCP sockets */
+	uint32_t reactor_threads;
+	/*! sockets currently registered with a reactor */
+	uint32_t reactor_sockets;
+	/*! receive calls made by the reactors */
+	uint64_t recv_calls;
+	/*! packets returned by those calls */
+	uint64_t recv_packets;
+	/*! packets dropped because the session was not keeping up */
+	uint64_t recv_dropped;
+	/*! sockets bound to the shared port */
+	uint32_t shared_sockets;
+	/*! packets on the shared port that matched no session */
+	uint64_t shared_unrouted;
+	/*! the most video packets written by one send call */
+	uint32_t send_batch;
+	/*! bytes a send batch keeps for each packet */
+	uint32_t send_batch_mtu;
+	/*! batched send calls */
+	uint64_t send_calls;
+	/*! packets written by those calls */
+	uint64_t send_packets;
+	/*! session pairs currently relayed by the reactors */
+	uint32_t relays;
+	/*! packets the reactors forwarded between relayed sessions */
+	uint64_t relay_packets;
+	/*! batched video sends that were SRTP protected in one pass */
+	uint64_t srtp_batches;
+	/*! packets protected by those passes */
+	uint64_t srtp_batch_packets;
+} switch_rtp_io_stats_t;
+
+/*!
+  \brief Read the counters of the batched RTP socket I/O
+  \param stats the structure to fill in
+*/
+SWITCH_DECLARE(void) switch_rtp_get_io_stats(switch_rtp_io_stats_t *stats);
+
+typedef enum {
+	/*! send relayed packets with the ssrc of the session they leave from */
+	SWITCH_RTP_RELAY_REWRITE_SSRC = (1 << 0),
+	/*! number relayed packets from the sequence of the session they leave from */
+	SWITCH_RTP_RELAY_REWRITE_SEQ = (1 << 1)
+} switch_rtp_relay_flag_t;
+
+/*! \brief Counters for the packets read on one relayed session */
+typedef struct switch_rtp_relay_stats_s {
+	/*! packets written to the peer */
+	uint64_t packets;
+	/*! bytes written to the peer */
+	uint64_t bytes;
+	/*! packets the peer socket would not take */
+	uint64_t dropped;
+	/*! packets left for the session to read itself (stun, rtcp) */
+	uint64_t passed;
+} switch_rtp_relay_stats_t;
+
+/*!
+  \brief Forward rtp between two proxy media sessions from the reactor threads
+  \param rtp_session one session
+  \param peer_session the other session
+  \param flags what to rewrite on the way through
+  \return SWITCH_STATUS_SUCCESS if the reactors are now carrying the media
+  \note Only possible when both sessions are read by a reactor and neither terminates srtp or zrtp.  Anything
+  that is not rtp still reaches the session, which goes on running ice and rtcp.
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_start(switch_rtp_t *rtp_session, switch_rtp_t *peer_session, switch_rtp_relay_flag_t flags);
+
+/*!
+  \brief Hand both sessions of a relay back to the normal read and write path
+  \param rtp_session either session of the relay
+*/
+SWITCH_DECLARE(void) switch_rtp_relay_stop(switch_rtp_t *rtp_session);
+
+/*!
+  \brief Read the relay counters of a session
+  \param rtp_session the session
+  \param stats the structure to fill in
+  \return SWITCH_STATUS_FALSE if the session is not relayed
+*/
+SWITCH_DECLARE(switch_status_t) switch_rtp_get_relay_stats(switch_rtp_t *rtp_session, switch_rtp_relay_stats_t *stats);
+
 /*! 
   \brief Request a new port to be used for media
   \param ip the ip to request a port from
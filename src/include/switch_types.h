@@ -369,7 +369,8 @@ typedef enum {
 	SCF_DEBUG_SQL = (1 << 21),
 	SCF_API_EXPANSION = (1 << 22),
 	SCF_SESSION_THREAD_POOL = (1 << 23),
-	SCF_DIALPLAN_TIMESTAMPS = (1 << 24)
+	SCF_DIALPLAN_TIMESTAMPS = (1 << 24),
+	SCF_CORE_DB_CHANNELS = (1 << 25)
 } switch_core_flag_enum_t;
 typedef uint32_t switch_core_flag_t;
 
@@ -2583,6 +2584,12 @@ typedef enum {
 	SPY_DUAL_CROP
 } switch_vid_spy_fmt_t;
 
+typedef enum {
+	SCI_VIEW_CHANNELS,
+	SCI_VIEW_BASIC_CALLS,
+	SCI_VIEW_DETAILED_CALLS
+} switch_channel_index_view_t;
+
 SWITCH_END_EXTERN_C
 #endif
 /* For Emacs:
@@ -0,0 +1,1007 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2015, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Marc Olivier Chouinard <mochouinard@moctel.com>
+ *
+ *
+ * cc_acd.c -- In-memory agent selection for mod_callcenter
+ *
+ * Queues keep their tiers in level buckets.  Each bucket holds a heap of the tiers whose agent can take a
+ * call right now, ordered the way the queue strategy wants them, so picking an agent is a look at the top
+ * of the first level the tier rules allow.  Agents that are only held back by wrap-up or ready time wait in
+ * a separate heap keyed on the time they become free, and rejoin their tier heaps when the dispatcher
+ * passes that time.
+ *
+ */
+#include "cc_acd.h"
+
+static uint32_t acd_random(cc_acd_t *acd)
+{
+	acd->seed = acd->seed * 1103515245 + 12345;
+	return acd->seed >> 8;
+}
+
+void cc_acd_set_string(char **field, const char *value)
+{
+	switch_safe_free(*field);
+	*field = strdup(switch_str_nil(value));
+}
+
+cc_strategy_t cc_acd_str2strategy(const char *str)
+{
+	if (!strcasecmp(str, "longest-idle-agent")) {
+		return CC_STRATEGY_LONGEST_IDLE_AGENT;
+	} else if (!strcasecmp(str, "agent-with-least-talk-time")) {
+		return CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME;
+	} else if (!strcasecmp(str, "agent-with-fewest-calls")) {
+		return CC_STRATEGY_AGENT_WITH_FEWEST_CALLS;
+	} else if (!strcasecmp(str, "ring-all")) {
+		return CC_STRATEGY_RING_ALL;
+	} else if (!strcasecmp(str, "top-down")) {
+		return CC_STRATEGY_TOP_DOWN;
+	} else if (!strcasecmp(str, "round-robin")) {
+		return CC_STRATEGY_ROUND_ROBIN;
+	} else if (!strcasecmp(str, "random")) {
+		return CC_STRATEGY_RANDOM;
+	}
+
+	/* If the strategy doesn't exist, just fallback to the sequential order */
+	return CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER;
+}
+
+/* Returns true when tier a should be offered a call before tier b within the same level */
+static int tier_before(cc_strategy_t strategy, const cc_acd_tier_t *a, const cc_acd_tier_t *b)
+{
+	switch (strategy) {
+	case CC_STRATEGY_LONGEST_IDLE_AGENT:
+		if (a->agent->last_bridge_end != b->agent->last_bridge_end) {
+			return a->agent->last_bridge_end < b->agent->last_bridge_end;
+		}
+		break;
+	case CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME:
+		if (a->agent->talk_time != b->agent->talk_time) {
+			return a->agent->talk_time < b->agent->talk_time;
+		}
+		break;
+	case CC_STRATEGY_AGENT_WITH_FEWEST_CALLS:
+		if (a->agent->calls_answered != b->agent->calls_answered) {
+			return a->agent->calls_answered < b->agent->calls_answered;
+		}
+		break;
+	case CC_STRATEGY_RANDOM:
+		return a->random_key < b->random_key;
+	default:
+		if (a->position != b->position) {
+			return a->position < b->position;
+		}
+		return a->agent->last_offered_call < b->agent->last_offered_call;
+	}
+
+	return a->position < b->position;
+}
+
+static void ready_swap(cc_acd_level_t *level, uint32_t i, uint32_t j)
+{
+	cc_acd_tier_t *tmp = level->ready[i];
+
+	level->ready[i] = level->ready[j];
+	level->ready[j] = tmp;
+	level->ready[i]->heap_index = i;
+	level->ready[j]->heap_index = j;
+}
+
+static void ready_up(cc_strategy_t strategy, cc_acd_level_t *level, uint32_t i)
+{
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (!tier_before(strategy, level->ready[i], level->ready[parent])) {
+			break;
+		}
+		ready_swap(level, i, parent);
+		i = parent;
+	}
+}
+
+static void ready_down(cc_strategy_t strategy, cc_acd_level_t *level, uint32_t i)
+{
+	for (;;) {
+		uint32_t best = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < level->nready && tier_before(strategy, level->ready[left], level->ready[best])) {
+			best = left;
+		}
+		if (right < level->nready && tier_before(strategy, level->ready[right], level->ready[best])) {
+			best = right;
+		}
+		if (best == i) {
+			break;
+		}
+		ready_swap(level, i, best);
+		i = best;
+	}
+}
+
+static void ready_push(cc_acd_t *acd, cc_acd_tier_t *tier)
+{
+	cc_acd_level_t *level = tier->bucket;
+
+	if (level->nready == level->ready_size) {
+		level->ready_size = level->ready_size ? level->ready_size * 2 : 8;
+		level->ready = realloc(level->ready, level->ready_size * sizeof(*level->ready));
+		switch_assert(level->ready);
+	}
+
+	tier->random_key = acd_random(acd);
+	tier->heap_index = level->nready;
+	level->ready[level->nready++] = tier;
+	ready_up(tier->queue->strategy, level, tier->heap_index);
+}
+
+static void ready_remove(cc_acd_tier_t *tier)
+{
+	cc_acd_level_t *level = tier->bucket;
+	uint32_t i = tier->heap_index, last;
+
+	if (tier->heap_index < 0) {
+		return;
+	}
+
+	last = --level->nready;
+	if (i != last) {
+		level->ready[i] = level->ready[last];
+		level->ready[i]->heap_index = i;
+		ready_down(tier->queue->strategy, level, i);
+		ready_up(tier->queue->strategy, level, i);
+	}
+	tier->heap_index = -1;
+}
+
+static void gate_swap(cc_acd_t *acd, uint32_t i, uint32_t j)
+{
+	cc_acd_agent_t *tmp = acd->gated[i];
+
+	acd->gated[i] = acd->gated[j];
+	acd->gated[j] = tmp;
+	acd->gated[i]->gate_index = i;
+	acd->gated[j]->gate_index = j;
+}
+
+static void gate_up(cc_acd_t *acd, uint32_t i)
+{
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (acd->gated[i]->gate >= acd->gated[parent]->gate) {
+			break;
+		}
+		gate_swap(acd, i, parent);
+		i = parent;
+	}
+}
+
+static void gate_down(cc_acd_t *acd, uint32_t i)
+{
+	for (;;) {
+		uint32_t best = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < acd->ngated && acd->gated[left]->gate < acd->gated[best]->gate) {
+			best = left;
+		}
+		if (right < acd->ngated && acd->gated[right]->gate < acd->gated[best]->gate) {
+			best = right;
+		}
+		if (best == i) {
+			break;
+		}
+		gate_swap(acd, i, best);
+		i = best;
+	}
+}
+
+static void gate_set(cc_acd_t *acd, cc_acd_agent_t *agent)
+{
+	if (agent->gate_index < 0) {
+		if (acd->ngated == acd->gated_size) {
+			acd->gated_size = acd->gated_size ? acd->gated_size * 2 : 64;
+			acd->gated = realloc(acd->gated, acd->gated_size * sizeof(*acd->gated));
+			switch_assert(acd->gated);
+		}
+		agent->gate_index = acd->ngated;
+		acd->gated[acd->ngated++] = agent;
+	}
+
+	gate_down(acd, agent->gate_index);
+	gate_up(acd, agent->gate_index);
+}
+
+static void gate_remove(cc_acd_t *acd, cc_acd_agent_t *agent)
+{
+	uint32_t i = agent->gate_index, last;
+
+	if (agent->gate_index < 0) {
+		return;
+	}
+
+	last = --acd->ngated;
+	if (i != last) {
+		acd->gated[i] = acd->gated[last];
+		acd->gated[i]->gate_index = i;
+		gate_down(acd, i);
+		gate_up(acd, i);
+	}
+	agent->gate_index = -1;
+}
+
+static switch_bool_t agent_logged_in(const cc_acd_agent_t *agent)
+{
+	return (agent->status == CC_AGENT_STATUS_AVAILABLE || agent->status == CC_AGENT_STATUS_ON_BREAK ||
+			agent->status == CC_AGENT_STATUS_AVAILABLE_ON_DEMAND) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* Everything but the clock that keeps an agent from being offered a call */
+static switch_bool_t agent_can_take(const cc_acd_agent_t *agent)
+{
+	return (agent->status == CC_AGENT_STATUS_AVAILABLE || agent->status == CC_AGENT_STATUS_AVAILABLE_ON_DEMAND) &&
+		agent->state == CC_AGENT_STATE_WAITING && !strcasecmp(agent->system, CC_SYSTEM_SELF) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static switch_bool_t tier_can_take(const cc_acd_tier_t *tier)
+{
+	return (tier->state == CC_TIER_STATE_READY || tier->state == CC_TIER_STATE_NO_ANSWER) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static void tier_update(cc_acd_t *acd, cc_acd_tier_t *tier)
+{
+	ready_remove(tier);
+
+	if (tier->agent->ready && tier_can_take(tier)) {
+		ready_push(acd, tier);
+	}
+}
+
+static cc_acd_level_t *level_get(cc_acd_queue_t *queue, int level_num)
+{
+	cc_acd_level_t *level;
+	uint32_t i;
+
+	for (i = 0; i < queue->nlevels && queue->levels[i]->level <= level_num; i++) {
+		if (queue->levels[i]->level == level_num) {
+			return queue->levels[i];
+		}
+	}
+
+	level = calloc(1, sizeof(*level));
+	switch_assert(level);
+	level->level = level_num;
+
+	queue->levels = realloc(queue->levels, (queue->nlevels + 1) * sizeof(*queue->levels));
+	switch_assert(queue->levels);
+	memmove(&queue->levels[i + 1], &queue->levels[i], (queue->nlevels - i) * sizeof(*queue->levels));
+	queue->levels[i] = level;
+	queue->nlevels++;
+
+	return level;
+}
+
+static void level_release(cc_acd_queue_t *queue, cc_acd_level_t *level)
+{
+	uint32_t i;
+
+	if (level->tiers) {
+		return;
+	}
+
+	for (i = 0; i < queue->nlevels; i++) {
+		if (queue->levels[i] == level) {
+			memmove(&queue->levels[i], &queue->levels[i + 1], (queue->nlevels - i - 1) * sizeof(*queue->levels));
+			queue->nlevels--;
+			break;
+		}
+	}
+
+	switch_safe_free(level->ready);
+	free(level);
+}
+
+static void tier_attach(cc_acd_t *acd, cc_acd_tier_t *tier)
+{
+	tier->bucket = level_get(tier->queue, tier->level);
+	tier->bucket->tiers++;
+	if (tier->agent->logged_in) {
+		tier->bucket->logged_in++;
+	}
+	tier_update(acd, tier);
+}
+
+static void tier_detach(cc_acd_tier_t *tier)
+{
+	ready_remove(tier);
+	tier->bucket->tiers--;
+	if (tier->agent->logged_in) {
+		tier->bucket->logged_in--;
+	}
+	level_release(tier->queue, tier->bucket);
+	tier->bucket = NULL;
+}
+
+static void queue_free(cc_acd_queue_t *queue)
+{
+	switch_safe_free(queue->name);
+	switch_safe_free(queue->strategy_name);
+	switch_safe_free(queue->record_template);
+	switch_safe_free(queue->levels);
+	free(queue);
+}
+
+static void agent_free(cc_acd_agent_t *agent)
+{
+	switch_safe_free(agent->name);
+	switch_safe_free(agent->system);
+	switch_safe_free(agent->uuid);
+	switch_safe_free(agent->type);
+	switch_safe_free(agent->contact);
+	free(agent);
+}
+
+static void member_free(cc_acd_member_t *member)
+{
+	switch_safe_free(member->queue);
+	switch_safe_free(member->system);
+	switch_safe_free(member->uuid);
+	switch_safe_free(member->session_uuid);
+	switch_safe_free(member->cid_number);
+	switch_safe_free(member->cid_name);
+	switch_safe_free(member->serving_agent);
+	switch_safe_free(member->serving_system);
+	free(member);
+}
+
+switch_status_t cc_acd_create(cc_acd_t **acd)
+{
+	switch_memory_pool_t *pool = NULL;
+	cc_acd_t *new_acd;
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	new_acd = switch_core_alloc(pool, sizeof(*new_acd));
+	new_acd->pool = pool;
+	new_acd->seed = (uint32_t) switch_micro_time_now();
+	switch_mutex_init(&new_acd->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&new_acd->queue_hash);
+	switch_core_hash_init(&new_acd->agent_hash);
+	switch_core_hash_init(&new_acd->member_hash);
+
+	*acd = new_acd;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void cc_acd_destroy(cc_acd_t **acd)
+{
+	cc_acd_t *old = *acd;
+	switch_hash_index_t *hi = NULL;
+	switch_memory_pool_t *pool;
+
+	if (!old) {
+		return;
+	}
+	*acd = NULL;
+
+	while (old->members) {
+		cc_acd_member_del(old, old->members);
+	}
+
+	while (old->agents) {
+		cc_acd_agent_del(old, old->agents);
+	}
+
+	for (hi = switch_core_hash_first(old->queue_hash); hi; hi = switch_core_hash_next(&hi)) {
+		void *val = NULL;
+		const void *key;
+		switch_ssize_t keylen;
+
+		switch_core_hash_this(hi, &key, &keylen, &val);
+		queue_free((cc_acd_queue_t *) val);
+	}
+
+	switch_safe_free(old->gated);
+	switch_core_hash_destroy(&old->queue_hash);
+	switch_core_hash_destroy(&old->agent_hash);
+	switch_core_hash_destroy(&old->member_hash);
+
+	pool = old->pool;
+	switch_core_destroy_memory_pool(&pool);
+}
+
+void cc_acd_lock(cc_acd_t *acd)
+{
+	switch_mutex_lock(acd->mutex);
+}
+
+void cc_acd_unlock(cc_acd_t *acd)
+{
+	switch_mutex_unlock(acd->mutex);
+}
+
+cc_acd_queue_t *cc_acd_queue_find(cc_acd_t *acd, const char *name, switch_bool_t create)
+{
+	cc_acd_queue_t *queue = switch_core_hash_find(acd->queue_hash, name);
+
+	if (!queue && create) {
+		queue = calloc(1, sizeof(*queue));
+		switch_assert(queue);
+		queue->name = strdup(name);
+		queue->strategy_name = strdup("");
+		queue->record_template = strdup("");
+		queue->strategy = CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER;
+		switch_core_hash_insert(acd->queue_hash, name, queue);
+	}
+
+	return queue;
+}
+
+void cc_acd_queue_set_strategy(cc_acd_t *acd, cc_acd_queue_t *queue, const char *strategy)
+{
+	cc_strategy_t new_strategy = cc_acd_str2strategy(strategy);
+	uint32_t i;
+
+	cc_acd_set_string(&queue->strategy_name, strategy);
+
+	if (new_strategy == queue->strategy) {
+		return;
+	}
+	queue->strategy = new_strategy;
+
+	for (i = 0; i < queue->nlevels; i++) {
+		cc_acd_level_t *level = queue->levels[i];
+		uint32_t x;
+
+		for (x = level->nready / 2; x > 0; x--) {
+			ready_down(new_strategy, level, x - 1);
+		}
+	}
+}
+
+cc_acd_agent_t *cc_acd_agent_find(cc_acd_t *acd, const char *name)
+{
+	return switch_core_hash_find(acd->agent_hash, name);
+}
+
+cc_acd_agent_t *cc_acd_agent_add(cc_acd_t *acd, const char *name, const char *system, const char *type)
+{
+	cc_acd_agent_t *agent;
+
+	if (switch_core_hash_find(acd->agent_hash, name)) {
+		return NULL;
+	}
+
+	agent = calloc(1, sizeof(*agent));
+	switch_assert(agent);
+	agent->name = strdup(name);
+	agent->system = strdup(switch_str_nil(system));
+	agent->type = strdup(switch_str_nil(type));
+	agent->uuid = strdup("");
+	agent->contact = strdup("");
+	agent->status = CC_AGENT_STATUS_LOGGED_OUT;
+	agent->state = CC_AGENT_STATE_WAITING;
+	agent->gate_index = -1;
+
+	agent->prev = acd->agents_tail;
+	if (acd->agents_tail) {
+		acd->agents_tail->next = agent;
+	} else {
+		acd->agents = agent;
+	}
+	acd->agents_tail = agent;
+
+	switch_core_hash_insert(acd->agent_hash, name, agent);
+
+	return agent;
+}
+
+void cc_acd_agent_del(cc_acd_t *acd, cc_acd_agent_t *agent)
+{
+	while (agent->tiers) {
+		cc_acd_tier_del(acd, agent->tiers);
+	}
+
+	gate_remove(acd, agent);
+	switch_core_hash_delete(acd->agent_hash, agent->name);
+
+	if (agent->prev) {
+		agent->prev->next = agent->next;
+	} else {
+		acd->agents = agent->next;
+	}
+	if (agent->next) {
+		agent->next->prev = agent->prev;
+	} else {
+		acd->agents_tail = agent->prev;
+	}
+
+	agent_free(agent);
+}
+
+void cc_acd_agent_changed(cc_acd_t *acd, cc_acd_agent_t *agent, switch_time_t now)
+{
+	switch_bool_t logged_in = agent_logged_in(agent);
+	cc_acd_tier_t *tier;
+
+	if (logged_in != agent->logged_in) {
+		for (tier = agent->tiers; tier; tier = tier->agent_next) {
+			if (logged_in) {
+				tier->bucket->logged_in++;
+			} else {
+				tier->bucket->logged_in--;
+			}
+		}
+		agent->logged_in = logged_in;
+	}
+
+	agent->ready = SWITCH_FALSE;
+	if (agent_can_take(agent)) {
+		/* Wrap up is over once last_bridge_end < now - wrap_up_time */
+		agent->gate = agent->last_bridge_end + agent->wrap_up_time + 1;
+		if (agent->ready_time > agent->gate) {
+			agent->gate = agent->ready_time;
+		}
+
+		if (agent->gate > now) {
+			gate_set(acd, agent);
+		} else {
+			gate_remove(acd, agent);
+			agent->ready = SWITCH_TRUE;
+		}
+	} else {
+		gate_remove(acd, agent);
+	}
+
+	for (tier = agent->tiers; tier; tier = tier->agent_next) {
+		cc_acd_queue_t *queue = tier->queue;
+
+		tier_update(acd, tier);
+
+		/* round-robin carries on after the tier of the agent last offered a call */
+		if (agent->last_offered_call > 0 && (!queue->last_offered || queue->last_offered->agent->last_offered_call < agent->last_offered_call)) {
+			queue->last_offered = tier;
+		}
+	}
+}
+
+cc_acd_tier_t *cc_acd_tier_find(cc_acd_t *acd, const char *queue_name, const char *agent_name)
+{
+	cc_acd_agent_t *agent = switch_core_hash_find(acd->agent_hash, agent_name);
+	cc_acd_tier_t *tier;
+
+	for (tier = agent ? agent->tiers : NULL; tier; tier = tier->agent_next) {
+		if (!strcmp(tier->queue->name, queue_name)) {
+			return tier;
+		}
+	}
+
+	return NULL;
+}
+
+cc_acd_tier_t *cc_acd_tier_add(cc_acd_t *acd, const char *queue_name, cc_acd_agent_t *agent, cc_tier_state_t state, int level, int position, switch_time_t now)
+{
+	cc_acd_queue_t *queue;
+	cc_acd_tier_t *tier;
+
+	if (cc_acd_tier_find(acd, queue_name, agent->name)) {
+		return NULL;
+	}
+
+	queue = cc_acd_queue_find(acd, queue_name, SWITCH_TRUE);
+
+	tier = calloc(1, sizeof(*tier));
+	switch_assert(tier);
+	tier->queue = queue;
+	tier->agent = agent;
+	tier->state = state;
+	tier->level = level;
+	tier->position = position;
+	tier->heap_index = -1;
+
+	tier->agent_next = agent->tiers;
+	agent->tiers = tier;
+
+	tier->queue_next = queue->tiers;
+	if (queue->tiers) {
+		queue->tiers->queue_prev = tier;
+	}
+	queue->tiers = tier;
+
+	tier_attach(acd, tier);
+
+	if (agent->last_offered_call > 0 && (!queue->last_offered || queue->last_offered->agent->last_offered_call < agent->last_offered_call)) {
+		queue->last_offered = tier;
+	}
+
+	return tier;
+}
+
+void cc_acd_tier_del(cc_acd_t *acd, cc_acd_tier_t *tier)
+{
+	cc_acd_agent_t *agent = tier->agent;
+	cc_acd_queue_t *queue = tier->queue;
+	cc_acd_tier_t **tp;
+
+	tier_detach(tier);
+
+	for (tp = &agent->tiers; *tp; tp = &(*tp)->agent_next) {
+		if (*tp == tier) {
+			*tp = tier->agent_next;
+			break;
+		}
+	}
+
+	if (tier->queue_prev) {
+		tier->queue_prev->queue_next = tier->queue_next;
+	} else {
+		queue->tiers = tier->queue_next;
+	}
+	if (tier->queue_next) {
+		tier->queue_next->queue_prev = tier->queue_prev;
+	}
+
+	if (queue->last_offered == tier) {
+		queue->last_offered = NULL;
+	}
+
+	free(tier);
+}
+
+void cc_acd_tier_move(cc_acd_t *acd, cc_acd_tier_t *tier, int level, int position, switch_time_t now)
+{
+	tier_detach(tier);
+	tier->level = level;
+	tier->position = position;
+	tier_attach(acd, tier);
+}
+
+void cc_acd_tier_changed(cc_acd_t *acd, cc_acd_tier_t *tier, switch_time_t now)
+{
+	tier_update(acd, tier);
+}
+
+cc_acd_member_t *cc_acd_member_find(cc_acd_t *acd, const char *uuid)
+{
+	return switch_core_hash_find(acd->member_hash, uuid);
+}
+
+static int64_t member_priority(const cc_acd_member_t *member)
+{
+	return (int64_t) member->base_score + member->skill_score - member->joined_epoch;
+}
+
+cc_acd_member_t *cc_acd_member_add(cc_acd_t *acd, const char *queue_name, const char *uuid, switch_time_t joined_epoch, int base_score, int skill_score)
+{
+	cc_acd_member_t *member, *after;
+
+	if (switch_core_hash_find(acd->member_hash, uuid)) {
+		return NULL;
+	}
+
+	member = calloc(1, sizeof(*member));
+	switch_assert(member);
+	member->queue = strdup(queue_name);
+	member->system = strdup(CC_SYSTEM_SELF);
+	member->uuid = strdup(uuid);
+	member->session_uuid = strdup("");
+	member->cid_number = strdup("");
+	member->cid_name = strdup("");
+	member->serving_agent = strdup("");
+	member->serving_system = strdup("");
+	member->joined_epoch = joined_epoch;
+	member->base_score = base_score;
+	member->skill_score = skill_score;
+	member->state = CC_MEMBER_STATE_WAITING;
+
+	/* Newcomers usually have the lowest score, so look for their place from the tail */
+	for (after = acd->members_tail; after && member_priority(after) < member_priority(member); after = after->prev);
+
+	member->prev = after;
+	member->next = after ? after->next : acd->members;
+	if (member->next) {
+		member->next->prev = member;
+	} else {
+		acd->members_tail = member;
+	}
+	if (after) {
+		after->next = member;
+	} else {
+		acd->members = member;
+	}
+
+	switch_core_hash_insert(acd->member_hash, uuid, member);
+
+	return member;
+}
+
+void cc_acd_member_del(cc_acd_t *acd, cc_acd_member_t *member)
+{
+	switch_core_hash_delete(acd->member_hash, member->uuid);
+
+	if (member->prev) {
+		member->prev->next = member->next;
+	} else {
+		acd->members = member->next;
+	}
+	if (member->next) {
+		member->next->prev = member->prev;
+	} else {
+		acd->members_tail = member->prev;
+	}
+
+	member_free(member);
+}
+
+/* Check if we switch to a different tier, if so, check if we should continue further for that member */
+static switch_bool_t tier_rules_allow(const cc_acd_queue_t *queue, const cc_acd_member_t *member, const cc_acd_level_t *level,
+									  int *tier, uint32_t *available, switch_time_t now)
+{
+	switch_time_t waited = now - member->joined_epoch;
+
+	if (!queue->tier_rules_apply || level->level <= *tier) {
+		return SWITCH_TRUE;
+	}
+
+	/* Continue if no agent was logged in in the previous tier and noagent = true */
+	if (queue->tier_rule_no_agent_no_wait && *available == 0) {
+		*tier = level->level;
+		return SWITCH_TRUE;
+	}
+
+	if ((queue->tier_rule_wait_multiply_level && waited >= (switch_time_t) level->level * queue->tier_rule_wait_second) ||
+		(!queue->tier_rule_wait_multiply_level && waited >= (switch_time_t) queue->tier_rule_wait_second)) {
+		*tier = level->level;
+		*available = 0;
+		return SWITCH_TRUE;
+	}
+
+	return SWITCH_FALSE;
+}
+
+static uint32_t make_offer(cc_acd_t *acd, cc_acd_queue_t *queue, cc_acd_member_t *member, cc_acd_tier_t *tier, switch_time_t now,
+						   const cc_acd_events_t *events)
+{
+	cc_acd_agent_t *agent = tier->agent;
+	cc_acd_tier_t *t;
+	cc_acd_offer_t offer;
+
+	if (queue->strategy != CC_STRATEGY_RING_ALL) {
+		/* Map the Agent to the member */
+		if (member->state != CC_MEMBER_STATE_WAITING) {
+			return 0;
+		}
+		cc_acd_set_string(&member->serving_agent, agent->name);
+		cc_acd_set_string(&member->serving_system, CC_SYSTEM_SELF);
+		member->state = CC_MEMBER_STATE_TRYING;
+	}
+	member->last_tier_level = tier->level;
+	member->last_tier_position = tier->position;
+
+	agent->state = CC_AGENT_STATE_RECEIVING;
+	agent->last_offered_call = now;
+	for (t = agent->tiers; t; t = t->agent_next) {
+		if (t == tier) {
+			t->state = CC_TIER_STATE_OFFERING;
+		} else if (t->state == CC_TIER_STATE_READY) {
+			t->state = CC_TIER_STATE_STANDBY;
+		}
+	}
+	cc_acd_agent_changed(acd, agent, now);
+
+	if (events && events->offer) {
+		offer.queue = queue;
+		offer.member = member;
+		offer.agent = agent;
+		offer.tier = tier;
+		events->offer(acd, &offer, events->pdata);
+	}
+
+	return 1;
+}
+
+/* The next ready tier of a level after the given position, used by top-down and round-robin */
+static cc_acd_tier_t *ready_after(const cc_acd_level_t *level, int position)
+{
+	cc_acd_tier_t *best = NULL;
+	uint32_t i;
+
+	for (i = 0; i < level->nready; i++) {
+		cc_acd_tier_t *tier = level->ready[i];
+
+		if (tier->position > position && (!best || tier_before(CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER, tier, best))) {
+			best = tier;
+		}
+	}
+
+	return best;
+}
+
+static uint32_t offer_member(cc_acd_t *acd, cc_acd_queue_t *queue, cc_acd_member_t *member, switch_time_t now,
+							 const cc_acd_events_t *events)
+{
+	cc_acd_tier_t *pick = NULL;
+	uint32_t available = 0, offers = 0, i;
+	int tier = 0, resume_level = 0, resume_position = 0;
+	switch_bool_t resume = SWITCH_FALSE;
+
+	if (queue->strategy == CC_STRATEGY_TOP_DOWN) {
+		resume = SWITCH_TRUE;
+		resume_level = member->last_tier_level;
+		resume_position = member->last_tier_position;
+	} else if (queue->strategy == CC_STRATEGY_ROUND_ROBIN && queue->last_offered) {
+		resume = SWITCH_TRUE;
+		resume_level = queue->last_offered->level;
+		resume_position = queue->last_offered->position;
+	}
+
+	/* Try the tiers after the last one offered first, if the tier rules let the member reach that level */
+	for (i = 0; resume && i < queue->nlevels; i++) {
+		cc_acd_level_t *level = queue->levels[i];
+
+		if (level->level > resume_level) {
+			break;
+		}
+		if (!level->logged_in) {
+			continue;
+		}
+		if (!tier_rules_allow(queue, member, level, &tier, &available, now)) {
+			break;
+		}
+		available += level->logged_in;
+
+		if (level->level == resume_level) {
+			pick = ready_after(level, resume_position);
+		}
+	}
+
+	if (pick) {
+		return make_offer(acd, queue, member, pick, now, events);
+	}
+
+	tier = 0;
+	available = 0;
+	for (i = 0; i < queue->nlevels; i++) {
+		cc_acd_level_t *level = queue->levels[i];
+
+		if (!level->logged_in) {
+			continue;
+		}
+		if (!tier_rules_allow(queue, member, level, &tier, &available, now)) {
+			/* We are not allowed to continue to the next tier of agent */
+			break;
+		}
+		available += level->logged_in;
+
+		if (queue->strategy == CC_STRATEGY_RING_ALL) {
+			/* Every offer takes the agent out of the heap */
+			while (level->nready) {
+				offers += make_offer(acd, queue, member, level->ready[0], now, events);
+			}
+			continue;
+		}
+
+		if (level->nready) {
+			return make_offer(acd, queue, member, level->ready[0], now, events);
+		}
+	}
+
+	return offers;
+}
+
+uint32_t cc_acd_dispatch(cc_acd_t *acd, switch_time_t now, const cc_acd_events_t *events)
+{
+	cc_acd_member_t *member, *next;
+	uint32_t offers = 0, i;
+
+	cc_acd_lock(acd);
+
+	/* Agents done with wrap up or past their ready time go back in their tier heaps */
+	while (acd->ngated && acd->gated[0]->gate <= now) {
+		cc_acd_agent_t *agent = acd->gated[0];
+
+		gate_remove(acd, agent);
+		cc_acd_agent_changed(acd, agent, now);
+	}
+
+	for (member = acd->members; member; member = next) {
+		cc_acd_queue_t *queue;
+		switch_bool_t ring_all;
+
+		next = member->next;
+
+		if (!(queue = switch_core_hash_find(acd->queue_hash, member->queue)) || !queue->configured) {
+			continue;
+		}
+
+		if (member->state == CC_MEMBER_STATE_ABANDONED) {
+			switch_time_t abandoned_epoch = member->abandoned_epoch ? member->abandoned_epoch : member->joined_epoch;
+
+			/* Once we pass a certain point, we want to get rid of the abandoned call */
+			if (abandoned_epoch + queue->discard_abandoned_after < now) {
+				if (events && events->discard) {
+					events->discard(acd, member, events->pdata);
+				}
+				cc_acd_member_del(acd, member);
+			}
+			continue;
+		}
+
+		ring_all = !strcasecmp(member->serving_agent, CC_SERVING_RING_ALL) ? SWITCH_TRUE : SWITCH_FALSE;
+
+		if (!(member->state == CC_MEMBER_STATE_WAITING || (ring_all && member->state == CC_MEMBER_STATE_TRYING))) {
+			continue;
+		}
+
+		/* Tracking queue strategy changes */
+		if (ring_all && queue->strategy != CC_STRATEGY_RING_ALL) {
+			/* member is ring-all but not the queue */
+			cc_acd_set_string(&member->serving_agent, "");
+			member->state = CC_MEMBER_STATE_WAITING;
+			if (events && events->member) {
+				events->member(acd, member, events->pdata);
+			}
+		} else if (queue->strategy == CC_STRATEGY_RING_ALL && (!ring_all || member->state == CC_MEMBER_STATE_WAITING)) {
+			/* Queue is now ring-all and not the member */
+			cc_acd_set_string(&member->serving_agent, CC_SERVING_RING_ALL);
+			member->state = CC_MEMBER_STATE_TRYING;
+			if (events && events->member) {
+				events->member(acd, member, events->pdata);
+			}
+		}
+
+		offers += offer_member(acd, queue, member, now, events);
+
+		/* We update a field in the queue so we can kick caller out if waiting for too long with no agent */
+		queue->last_agent_exist_check = now;
+		for (i = 0; i < queue->nlevels; i++) {
+			if (queue->levels[i]->logged_in) {
+				queue->last_agent_exist = now;
+				break;
+			}
+		}
+	}
+
+	cc_acd_unlock(acd);
+
+	return offers;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet
+ */
@@ -0,0 +1,276 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2015, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Marc Olivier Chouinard <mochouinard@moctel.com>
+ *
+ *
+ * cc_acd.h -- In-memory agent selection for mod_callcenter
+ *
+ */
+#ifndef CC_ACD_H
+#define CC_ACD_H
+
+#include <switch.h>
+
+SWITCH_BEGIN_EXTERN_C
+
+#define CC_SYSTEM_SELF "single_box"
+#define CC_SERVING_RING_ALL "ring-all"
+
+typedef enum {
+	CC_TIER_STATE_UNKNOWN = 0,
+	CC_TIER_STATE_NO_ANSWER = 1,
+	CC_TIER_STATE_READY = 2,
+	CC_TIER_STATE_OFFERING = 3,
+	CC_TIER_STATE_ACTIVE_INBOUND = 4,
+	CC_TIER_STATE_STANDBY = 5
+} cc_tier_state_t;
+
+typedef enum {
+	CC_AGENT_STATUS_UNKNOWN = 0,
+	CC_AGENT_STATUS_LOGGED_OUT = 1,
+	CC_AGENT_STATUS_AVAILABLE = 2,
+	CC_AGENT_STATUS_AVAILABLE_ON_DEMAND = 3,
+	CC_AGENT_STATUS_ON_BREAK = 4
+} cc_agent_status_t;
+
+typedef enum {
+	CC_AGENT_STATE_UNKNOWN = 0,
+	CC_AGENT_STATE_WAITING = 1,
+	CC_AGENT_STATE_RECEIVING = 2,
+	CC_AGENT_STATE_IN_A_QUEUE_CALL = 3,
+	CC_AGENT_STATE_IDLE = 4,
+	CC_AGENT_STATE_RESERVED = 5
+} cc_agent_state_t;
+
+typedef enum {
+	CC_MEMBER_STATE_UNKNOWN = 0,
+	CC_MEMBER_STATE_WAITING = 1,
+	CC_MEMBER_STATE_TRYING = 2,
+	CC_MEMBER_STATE_ANSWERED = 3,
+	CC_MEMBER_STATE_ABANDONED = 4
+} cc_member_state_t;
+
+typedef enum {
+	CC_STRATEGY_LONGEST_IDLE_AGENT,
+	CC_STRATEGY_AGENT_WITH_LEAST_TALK_TIME,
+	CC_STRATEGY_AGENT_WITH_FEWEST_CALLS,
+	CC_STRATEGY_RING_ALL,
+	CC_STRATEGY_TOP_DOWN,
+	CC_STRATEGY_ROUND_ROBIN,
+	CC_STRATEGY_RANDOM,
+	CC_STRATEGY_SEQUENTIALLY_BY_AGENT_ORDER
+} cc_strategy_t;
+
+typedef struct cc_acd cc_acd_t;
+typedef struct cc_acd_queue cc_acd_queue_t;
+typedef struct cc_acd_level cc_acd_level_t;
+typedef struct cc_acd_agent cc_acd_agent_t;
+typedef struct cc_acd_tier cc_acd_tier_t;
+typedef struct cc_acd_member cc_acd_member_t;
+
+/* Plain fields may be read and written with the engine locked.  After changing anything that decides whether
+   an agent or tier can take a call, or where it sorts, call cc_acd_agent_changed() or cc_acd_tier_changed(). */
+struct cc_acd_agent {
+	char *name;
+	char *system;
+	char *uuid;
+	char *type;
+	char *contact;
+	cc_agent_status_t status;
+	cc_agent_state_t state;
+	int max_no_answer;
+	int wrap_up_time;
+	int reject_delay_time;
+	int busy_delay_time;
+	int no_answer_delay_time;
+	switch_time_t last_bridge_start;
+	switch_time_t last_bridge_end;
+	switch_time_t last_offered_call;
+	switch_time_t last_status_change;
+	int no_answer_count;
+	int calls_answered;
+	switch_time_t talk_time;
+	switch_time_t ready_time;
+
+	/* engine private */
+	cc_acd_tier_t *tiers;
+	switch_bool_t logged_in;
+	switch_bool_t ready;
+	switch_time_t gate;
+	int gate_index;
+	cc_acd_agent_t *prev;
+	cc_acd_agent_t *next;
+};
+
+struct cc_acd_tier {
+	cc_acd_queue_t *queue;
+	cc_acd_agent_t *agent;
+	cc_tier_state_t state;
+	int level;
+	int position;
+
+	/* engine private */
+	cc_acd_level_t *bucket;
+	int heap_index;
+	uint32_t random_key;
+	cc_acd_tier_t *agent_next;
+	cc_acd_tier_t *queue_prev;
+	cc_acd_tier_t *queue_next;
+};
+
+/* The tiers of one queue that share a level.  ready is a heap of the tiers that can be offered a call right
+   now, best first by the queue strategy. */
+struct cc_acd_level {
+	int level;
+	uint32_t tiers;
+	uint32_t logged_in;
+	cc_acd_tier_t **ready;
+	uint32_t nready;
+	uint32_t ready_size;
+};
+
+struct cc_acd_queue {
+	char *name;
+	switch_bool_t configured;
+	cc_strategy_t strategy;
+	char *strategy_name;
+	char *record_template;
+	switch_bool_t tier_rules_apply;
+	uint32_t tier_rule_wait_second;
+	switch_bool_t tier_rule_wait_multiply_level;
+	switch_bool_t tier_rule_no_agent_no_wait;
+	uint32_t discard_abandoned_after;
+	switch_time_t last_agent_exist;
+	switch_time_t last_agent_exist_check;
+
+	/* engine private */
+	cc_acd_level_t **levels;
+	uint32_t nlevels;
+	cc_acd_tier_t *tiers;
+	cc_acd_tier_t *last_offered;
+};
+
+struct cc_acd_member {
+	char *queue;
+	char *system;
+	char *uuid;
+	char *session_uuid;
+	char *cid_number;
+	char *cid_name;
+	char *serving_agent;
+	char *serving_system;
+	switch_time_t system_epoch;
+	switch_time_t joined_epoch;
+	switch_time_t rejoined_epoch;
+	switch_time_t bridge_epoch;
+	switch_time_t abandoned_epoch;
+	int base_score;
+	int skill_score;
+	cc_member_state_t state;
+	/* where top-down picks up again for this member */
+	int last_tier_level;
+	int last_tier_position;
+
+	/* engine private, members are kept best score first */
+	cc_acd_member_t *prev;
+	cc_acd_member_t *next;
+};
+
+struct cc_acd {
+	switch_mutex_t *mutex;
+	switch_memory_pool_t *pool;
+	switch_hash_t *queue_hash;
+	switch_hash_t *agent_hash;
+	switch_hash_t *member_hash;
+	cc_acd_agent_t *agents;
+	cc_acd_agent_t *agents_tail;
+	cc_acd_member_t *members;
+	cc_acd_member_t *members_tail;
+	cc_acd_agent_t **gated;
+	uint32_t ngated;
+	uint32_t gated_size;
+	uint32_t seed;
+};
+
+typedef struct cc_acd_offer {
+	cc_acd_queue_t *queue;
+	cc_acd_member_t *member;
+	cc_acd_agent_t *agent;
+	cc_acd_tier_t *tier;
+} cc_acd_offer_t;
+
+/* Hooks run by cc_acd_dispatch(), all with the engine locked.
+   offer:   an agent was picked for a member; the member, agent and tiers are already marked as offering so the
+            hook only has to start the call.
+   member:  a member changed state outside an offer, e.g. after its queue switched to or from ring-all.
+   discard: an abandoned member outlived its queue's discard-abandoned-after and is about to be dropped. */
+typedef struct cc_acd_events {
+	void (*offer) (cc_acd_t *acd, const cc_acd_offer_t *offer, void *pdata);
+	void (*member) (cc_acd_t *acd, cc_acd_member_t *member, void *pdata);
+	void (*discard) (cc_acd_t *acd, cc_acd_member_t *member, void *pdata);
+	void *pdata;
+} cc_acd_events_t;
+
+switch_status_t cc_acd_create(cc_acd_t **acd);
+void cc_acd_destroy(cc_acd_t **acd);
+void cc_acd_lock(cc_acd_t *acd);
+void cc_acd_unlock(cc_acd_t *acd);
+
+void cc_acd_set_string(char **field, const char *value);
+cc_strategy_t cc_acd_str2strategy(const char *str);
+
+cc_acd_queue_t *cc_acd_queue_find(cc_acd_t *acd, const char *name, switch_bool_t create);
+void cc_acd_queue_set_strategy(cc_acd_t *acd, cc_acd_queue_t *queue, const char *strategy);
+
+cc_acd_agent_t *cc_acd_agent_find(cc_acd_t *acd, const char *name);
+cc_acd_agent_t *cc_acd_agent_add(cc_acd_t *acd, const char *name, const char *system, const char *type);
+void cc_acd_agent_del(cc_acd_t *acd, cc_acd_agent_t *agent);
+void cc_acd_agent_changed(cc_acd_t *acd, cc_acd_agent_t *agent, switch_time_t now);
+
+cc_acd_tier_t *cc_acd_tier_find(cc_acd_t *acd, const char *queue_name, const char *agent_name);
+cc_acd_tier_t *cc_acd_tier_add(cc_acd_t *acd, const char *queue_name, cc_acd_agent_t *agent, cc_tier_state_t state, int level, int position, switch_time_t now);
+void cc_acd_tier_del(cc_acd_t *acd, cc_acd_tier_t *tier);
+void cc_acd_tier_move(cc_acd_t *acd, cc_acd_tier_t *tier, int level, int position, switch_time_t now);
+void cc_acd_tier_changed(cc_acd_t *acd, cc_acd_tier_t *tier, switch_time_t now);
+
+cc_acd_member_t *cc_acd_member_find(cc_acd_t *acd, const char *uuid);
+cc_acd_member_t *cc_acd_member_add(cc_acd_t *acd, const char *queue_name, const char *uuid, switch_time_t joined_epoch, int base_score, int skill_score);
+void cc_acd_member_del(cc_acd_t *acd, cc_acd_member_t *member);
+
+uint32_t cc_acd_dispatch(cc_acd_t *acd, switch_time_t now, const cc_acd_events_t *events);
+
+SWITCH_END_EXTERN_C
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet
+ */
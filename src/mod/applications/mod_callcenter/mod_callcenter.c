@@ -31,6 +31,7 @@
  *
  */
 #include <switch.h>
+#include "cc_acd.h"
 
 #define CALLCENTER_EVENT "callcenter::info"
 
@@ -76,15 +77,6 @@ typedef enum {
 	CC_STATUS_INVALID_KEY
 } cc_status_t;
 
-typedef enum {
-	CC_TIER_STATE_UNKNOWN = 0,
-	CC_TIER_STATE_NO_ANSWER = 1,
-	CC_TIER_STATE_READY = 2,
-	CC_TIER_STATE_OFFERING = 3,
-	CC_TIER_STATE_ACTIVE_INBOUND = 4,
-	CC_TIER_STATE_STANDBY = 5
-} cc_tier_state_t;
-
 static struct cc_state_table STATE_CHART[] = {
 	{"Unknown", CC_TIER_STATE_UNKNOWN},
 	{"No Answer", CC_TIER_STATE_NO_ANSWER},
@@ -96,14 +88,6 @@ static struct cc_state_table STATE_CHART[] = {
 
 };
 
-typedef enum {
-	CC_AGENT_STATUS_UNKNOWN = 0,
-	CC_AGENT_STATUS_LOGGED_OUT = 1,
-	CC_AGENT_STATUS_AVAILABLE = 2,
-	CC_AGENT_STATUS_AVAILABLE_ON_DEMAND = 3,
-	CC_AGENT_STATUS_ON_BREAK = 4
-} cc_agent_status_t;
-
 static struct cc_status_table AGENT_STATUS_CHART[] = {
 	{"Unknown", CC_AGENT_STATUS_UNKNOWN},
 	{"Logged Out", CC_AGENT_STATUS_LOGGED_OUT},
@@ -114,15 +98,6 @@ static struct cc_status_table AGENT_STATUS_CHART[] = {
 
 };
 
-typedef enum {
-	CC_AGENT_STATE_UNKNOWN = 0,
-	CC_AGENT_STATE_WAITING = 1,
-	CC_AGENT_STATE_RECEIVING = 2,
-	CC_AGENT_STATE_IN_A_QUEUE_CALL = 3,
-	CC_AGENT_STATE_IDLE = 4,
-	CC_AGENT_STATE_RESERVED = 5
-} cc_agent_state_t;
-
 static struct cc_state_table AGENT_STATE_CHART[] = {
 	{"Unknown", CC_AGENT_STATE_UNKNOWN},
 	{"Waiting", CC_AGENT_STATE_WAITING},
@@ -134,14 +109,6 @@ static struct cc_state_table AGENT_STATE_CHART[] = {
 
 };
 
-typedef enum {
-	CC_MEMBER_STATE_UNKNOWN = 0,
-	CC_MEMBER_STATE_WAITING = 1,
-	CC_MEMBER_STATE_TRYING = 2,
-	CC_MEMBER_STATE_ANSWERED = 3,
-	CC_MEMBER_STATE_ABANDONED = 4
-} cc_member_state_t;
-
 static struct cc_state_table MEMBER_STATE_CHART[] = {
 	{"Unknown", CC_MEMBER_STATE_UNKNOWN},
 	{"Waiting", CC_MEMBER_STATE_WAITING},
@@ -414,7 +381,10 @@ static struct {
 	int debug;
 	char *odbc_dsn;
 	char *dbname;
-	switch_bool_t reserve_agents;
+	switch_bool_t persist;
+	switch_queue_t *sql_queue;
+	switch_atomic_t sql_dropped;
+	cc_acd_t *acd;
 	int32_t threads;
 	int32_t running;
 	switch_mutex_t *mutex;
@@ -451,9 +421,6 @@ struct cc_queue {
 	switch_memory_pool_t *pool;
 	uint32_t flags;
 
-	switch_time_t last_agent_exist;
-	switch_time_t last_agent_exist_check;
-
 	switch_xml_config_item_t config[CC_QUEUE_CONFIGITEM_COUNT];
 	switch_xml_config_string_options_t config_str_pool;
 
@@ -480,10 +447,17 @@ static void queue_rwunlock(cc_queue_t *queue)
 static void destroy_queue(const char *queue_name)
 {
 	cc_queue_t *queue = NULL;
+	cc_acd_queue_t *acd_queue;
 	switch_mutex_lock(globals.mutex);
 	if ((queue = switch_core_hash_find(globals.queue_hash, queue_name))) {
 		switch_core_hash_delete(globals.queue_hash, queue_name);
 	}
+	/* Members of a queue that is not loaded locally are skipped by the dispatcher */
+	cc_acd_lock(globals.acd);
+	if ((acd_queue = cc_acd_queue_find(globals.acd, queue_name, SWITCH_FALSE))) {
+		acd_queue->configured = SWITCH_FALSE;
+	}
+	cc_acd_unlock(globals.acd);
 	switch_mutex_unlock(globals.mutex);
 
 	if (!queue) {
@@ -558,16 +532,6 @@ cc_queue_t *queue_set_config(cc_queue_t *queue)
 
 }
 
-static int cc_execute_sql_affected_rows(char *sql) {
-	switch_cache_db_handle_t *dbh = NULL;
-	if (!(dbh = cc_get_db_handle())) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening DB\n");
-		return -1;
-	}
-	switch_cache_db_execute_sql(dbh, sql, NULL);
-	return switch_cache_db_affected_rows(dbh);
-}
-
 char *cc_execute_sql2str(cc_queue_t *queue, switch_mutex_t *mutex, char *sql, char *resbuf, size_t len)
 {
 	char *ret = NULL;
@@ -667,9 +631,123 @@ end:
 	return ret;
 }
 
+#define CC_SQL_QUEUE_LEN 100000
+#define CC_SQL_BATCH 250
+
+/* Agent selection runs from memory and the db only mirrors it.  Statements are queued here and written in
+   batches by the db writer thread so no call path waits on the db.  Callers may hold the acd lock, so a full
+   queue drops the statement instead of blocking.  Takes ownership of sql. */
+static void cc_persist(char *sql)
+{
+	if (!globals.persist) {
+		switch_safe_free(sql);
+		return;
+	}
+
+	if (switch_queue_trypush(globals.sql_queue, sql) != SWITCH_STATUS_SUCCESS) {
+		uint32_t dropped = switch_atomic_read(&globals.sql_dropped);
+
+		switch_atomic_inc(&globals.sql_dropped);
+		if (!(dropped % 1000)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "DB write queue full, %u statements dropped so far; the db no longer mirrors memory\n",
+							  dropped + 1);
+		}
+		free(sql);
+	}
+}
+
+static void cc_persist_batch(switch_stream_handle_t *stream, char *sql)
+{
+	size_t len = strlen(sql);
+
+	while (len && (sql[len - 1] == ';' || sql[len - 1] == ' ')) {
+		len--;
+	}
+	stream->write_function(stream, "%.*s;\n", (int) len, sql);
+}
+
+/* Writes the batch in one transaction.  If that fails the statements are run one at a time so a single bad
+   one does not lose the rest of the batch. */
+static void cc_persist_flush(switch_stream_handle_t *stream, char **batch, int count)
+{
+	switch_cache_db_handle_t *dbh = NULL;
+	int i;
+
+	if (!count) {
+		return;
+	}
+
+	if (!(dbh = cc_get_db_handle())) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening DB\n");
+	} else {
+		if (switch_cache_db_persistant_execute_trans(dbh, (char *) stream->data, 1) != SWITCH_STATUS_SUCCESS && count > 1) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Batch of %d statements failed, retrying them one at a time\n", count);
+
+			for (i = 0; i < count; i++) {
+				char *errmsg = NULL;
+
+				switch_cache_db_execute_sql(dbh, batch[i], &errmsg);
+				if (errmsg) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR: [%s] %s\n", batch[i], errmsg);
+					free(errmsg);
+				}
+			}
+		}
+		switch_cache_db_release_db_handle(&dbh);
+	}
+
+	for (i = 0; i < count; i++) {
+		free(batch[i]);
+	}
+
+	*(char *) stream->data = '\0';
+	stream->data_len = 0;
+	stream->end = stream->data;
+}
+
+static void *SWITCH_THREAD_FUNC cc_db_writer_thread_run(switch_thread_t *thread, void *obj)
+{
+	switch_stream_handle_t stream = { 0 };
+	char *batch[CC_SQL_BATCH];
+
+	switch_mutex_lock(globals.mutex);
+	globals.threads++;
+	switch_mutex_unlock(globals.mutex);
+
+	SWITCH_STANDARD_STREAM(stream);
+
+	for (;;) {
+		void *pop = NULL;
+		int count = 0;
+
+		if (switch_queue_pop_timeout(globals.sql_queue, &pop, 500000) != SWITCH_STATUS_SUCCESS) {
+			if (!globals.running) {
+				break;
+			}
+			continue;
+		}
+
+		do {
+			cc_persist_batch(&stream, (char *) pop);
+			batch[count] = (char *) pop;
+		} while (++count < CC_SQL_BATCH && switch_queue_trypop(globals.sql_queue, &pop) == SWITCH_STATUS_SUCCESS);
+
+		cc_persist_flush(&stream, batch, count);
+	}
+
+	switch_safe_free(stream.data);
+
+	switch_mutex_lock(globals.mutex);
+	globals.threads--;
+	switch_mutex_unlock(globals.mutex);
+
+	return NULL;
+}
+
 static cc_queue_t *load_queue(const char *queue_name)
 {
 	cc_queue_t *queue = NULL;
+	cc_acd_queue_t *acd_queue = NULL;
 	switch_xml_t x_queues, x_queue, cfg, xml;
 	switch_event_t *event = NULL;
 	switch_event_t *params = NULL;
@@ -717,10 +795,21 @@ static cc_queue_t *load_queue(const char *queue_name)
 		switch_thread_rwlock_create(&queue->rwlock, pool);
 		queue->name = switch_core_strdup(pool, queue_name);
 
-		queue->last_agent_exist = 0;
-		queue->last_agent_exist_check = 0;
-
 		switch_mutex_init(&queue->mutex, SWITCH_MUTEX_NESTED, queue->pool);
+
+		/* Hand the settings agent selection needs to the ACD engine */
+		cc_acd_lock(globals.acd);
+		acd_queue = cc_acd_queue_find(globals.acd, queue->name, SWITCH_TRUE);
+		cc_acd_queue_set_strategy(globals.acd, acd_queue, queue->strategy);
+		cc_acd_set_string(&acd_queue->record_template, queue->record_template);
+		acd_queue->tier_rules_apply = queue->tier_rules_apply;
+		acd_queue->tier_rule_wait_second = queue->tier_rule_wait_second;
+		acd_queue->tier_rule_wait_multiply_level = queue->tier_rule_wait_multiply_level;
+		acd_queue->tier_rule_no_agent_no_wait = queue->tier_rule_no_agent_no_wait;
+		acd_queue->discard_abandoned_after = queue->discard_abandoned_after;
+		acd_queue->configured = SWITCH_TRUE;
+		cc_acd_unlock(globals.acd);
+
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Added queue %s\n", queue->name);
 		switch_core_hash_insert(globals.queue_hash, queue->name, queue);
 
@@ -784,7 +873,7 @@ struct call_helper {
 
 int cc_queue_count(const char *queue)
 {
-	char *sql;
+	cc_acd_member_t *member;
 	int count = 0;
 	char res[256] = "0";
 	const char *event_name = "Single-Queue";
@@ -793,15 +882,16 @@ int cc_queue_count(const char *queue)
 	if (!switch_strlen_zero(queue)) {
 		if (queue[0] == '*') {
 			event_name = "All-Queues";
-			sql = switch_mprintf("SELECT count(*) FROM members WHERE state = '%q' OR state = '%q'",
-					cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_TRYING));
-		} else {
-			sql = switch_mprintf("SELECT count(*) FROM members WHERE queue = '%q' AND (state = '%q' OR state = '%q')",
-					queue, cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_TRYING));
 		}
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		count = atoi(res);
+
+		cc_acd_lock(globals.acd);
+		for (member = globals.acd->members; member; member = member->next) {
+			if ((member->state == CC_MEMBER_STATE_WAITING || member->state == CC_MEMBER_STATE_TRYING) && (queue[0] == '*' || !strcmp(member->queue, queue))) {
+				count++;
+			}
+		}
+		cc_acd_unlock(globals.acd);
+		switch_snprintf(res, sizeof(res), "%d", count);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Queue", queue);
@@ -810,7 +900,7 @@ int cc_queue_count(const char *queue)
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Selection", event_name);
 			switch_event_fire(&event);
 		}
-	}	
+	}
 
 	return count;
 }
@@ -819,27 +909,27 @@ cc_status_t cc_agent_add(const char *agent, const char *type)
 {
 	switch_event_t *event;
 	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_acd_agent_t *acd_agent;
 	char *sql;
 
 	if (!strcasecmp(type, CC_AGENT_TYPE_CALLBACK) || !strcasecmp(type, CC_AGENT_TYPE_UUID_STANDBY)) {
-		char res[256] = "";
 		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		cc_acd_lock(globals.acd);
+		if (!(acd_agent = cc_acd_agent_add(globals.acd, agent, CC_SYSTEM_SELF, type))) {
+			cc_acd_unlock(globals.acd);
 			result = CC_STATUS_AGENT_ALREADY_EXIST;
 			goto done;
 		}
+		cc_acd_agent_changed(globals.acd, acd_agent, local_epoch_time_now(NULL));
+		cc_acd_unlock(globals.acd);
+
 		/* Add Agent */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding Agent %s with type %s with default status %s\n", 
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding Agent %s with type %s with default status %s\n",
 				agent, type, cc_agent_status2str(CC_AGENT_STATUS_LOGGED_OUT));
-		sql = switch_mprintf("INSERT INTO agents (name, system, type, status, state) VALUES('%q', 'single_box', '%q', '%q', '%q');", 
+		sql = switch_mprintf("INSERT INTO agents (name, system, type, status, state) VALUES('%q', 'single_box', '%q', '%q', '%q');",
 				agent, type, cc_agent_status2str(CC_AGENT_STATUS_LOGGED_OUT), cc_agent_state2str(CC_AGENT_STATE_WAITING));
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-		
+		cc_persist(sql);
+
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-Type", type);
@@ -851,54 +941,62 @@ cc_status_t cc_agent_add(const char *agent, const char *type)
 		result = CC_STATUS_AGENT_INVALID_TYPE;
 		goto done;
 	}
-done:		
+done:
 	return result;
 }
 
 cc_status_t cc_agent_del(const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_acd_agent_t *acd_agent;
 
 	char *sql;
 
+	cc_acd_lock(globals.acd);
+	if ((acd_agent = cc_acd_agent_find(globals.acd, agent))) {
+		cc_acd_agent_del(globals.acd, acd_agent);
+	}
+	cc_acd_unlock(globals.acd);
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted Agent %s\n", agent);
 	sql = switch_mprintf("DELETE FROM agents WHERE name = '%q';"
 			"DELETE FROM tiers WHERE agent = '%q';",
 			agent, agent);
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_persist(sql);
 	return result;
 }
 
 cc_status_t cc_agent_get(const char *key, const char *agent, char *ret_result, size_t ret_result_size)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
+	cc_acd_agent_t *acd_agent;
 	switch_event_t *event;
-	char res[256];
+	char res[256] = "";
 
-	/* Check to see if agent already exists */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
-		result = CC_STATUS_AGENT_NOT_FOUND;
-		goto done;
-	}
-
-	if (!strcasecmp(key, "status") || !strcasecmp(key, "state") || !strcasecmp(key, "uuid") ) { 
+	if (!strcasecmp(key, "status") || !strcasecmp(key, "state") || !strcasecmp(key, "uuid") ) {
 		/* Check to see if agent already exists */
-		sql = switch_mprintf("SELECT %q FROM agents WHERE name = '%q'", key, agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+		cc_acd_lock(globals.acd);
+		if (!(acd_agent = cc_acd_agent_find(globals.acd, agent))) {
+			cc_acd_unlock(globals.acd);
+			result = CC_STATUS_AGENT_NOT_FOUND;
+			goto done;
+		}
+		if (!strcasecmp(key, "status")) {
+			switch_copy_string(res, cc_agent_status2str(acd_agent->status), sizeof(res));
+		} else if (!strcasecmp(key, "state")) {
+			switch_copy_string(res, cc_agent_state2str(acd_agent->state), sizeof(res));
+		} else {
+			switch_copy_string(res, acd_agent->uuid, sizeof(res));
+		}
+		cc_acd_unlock(globals.acd);
+
 		switch_snprintf(ret_result, ret_result_size, "%s", res);
 		result = CC_STATUS_SUCCESS;
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
 			char tmpname[256];
 			if (!strcasecmp(key, "uuid")) {
-				switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-UUID");	
+				switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-UUID");
 			} else {
 				switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-%c%s", (char) switch_toupper(key[0]), key+1);
 			}
@@ -909,12 +1007,14 @@ cc_status_t cc_agent_get(const char *key, const char *agent, char *ret_result, s
 		}
 
 	} else {
-		result = CC_STATUS_INVALID_KEY;
+		cc_acd_lock(globals.acd);
+		result = cc_acd_agent_find(globals.acd, agent) ? CC_STATUS_INVALID_KEY : CC_STATUS_AGENT_NOT_FOUND;
+		cc_acd_unlock(globals.acd);
 		goto done;
 
 	}
 
-done:   
+done:
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Get Info Agent %s %s = %s\n", agent, key, res);
 	}
@@ -925,43 +1025,56 @@ done:
 cc_status_t cc_agent_update(const char *key, const char *value, const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
-	char res[256];
+	char *sql = NULL;
+	char res[256] = "";
 	switch_event_t *event;
+	cc_acd_agent_t *acd_agent;
+	switch_time_t now = local_epoch_time_now(NULL);
 
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
+	cc_acd_lock(globals.acd);
 
-	if (atoi(res) == 0) {
+	/* Check to see if agent already exist */
+	if (!(acd_agent = cc_acd_agent_find(globals.acd, agent))) {
 		result = CC_STATUS_AGENT_NOT_FOUND;
 		goto done;
 	}
 
 	if (!strcasecmp(key, "status")) {
-		if (cc_agent_str2status(value) != CC_AGENT_STATUS_UNKNOWN) {
+		cc_agent_status_t status = cc_agent_str2status(value);
+
+		if (status != CC_AGENT_STATUS_UNKNOWN) {
 			/* Reset values on available only */
-			if (cc_agent_str2status(value) == CC_AGENT_STATUS_AVAILABLE) {
+			if (status == CC_AGENT_STATUS_AVAILABLE) {
+				if (acd_agent->status != status) {
+					acd_agent->status = status;
+					acd_agent->last_status_change = now;
+					acd_agent->talk_time = 0;
+					acd_agent->calls_answered = 0;
+					acd_agent->no_answer_count = 0;
+				}
 				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "', talk_time = 0, calls_answered = 0, no_answer_count = 0"
 						" WHERE name = '%q' AND NOT status = '%q'",
-						value, local_epoch_time_now(NULL),
+						value, now,
 						agent, value);
 			} else {
+				acd_agent->status = status;
+				acd_agent->last_status_change = now;
 				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
-						value, local_epoch_time_now(NULL), agent);
+						value, now, agent);
 			}
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_acd_agent_changed(globals.acd, acd_agent, now);
+			cc_persist(sql);
 
 
 			/* Used to stop any active callback */
-			if (cc_agent_str2status(value) != CC_AGENT_STATUS_AVAILABLE) {
-				sql = switch_mprintf("SELECT uuid FROM members WHERE serving_agent = '%q' AND serving_system = 'single_box' AND NOT state = 'Answered'", agent);
-				cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-				switch_safe_free(sql);
-				if (!switch_strlen_zero(res)) {
-					switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", res, SWITCH_CAUSE_ORIGINATOR_CANCEL);
+			if (status != CC_AGENT_STATUS_AVAILABLE) {
+				cc_acd_member_t *member;
+
+				for (member = globals.acd->members; member; member = member->next) {
+					if (!strcmp(member->serving_agent, agent) && !strcmp(member->serving_system, CC_SYSTEM_SELF) && member->state != CC_MEMBER_STATE_ANSWERED) {
+						switch_copy_string(res, member->uuid, sizeof(res));
+						break;
+					}
 				}
 			}
 
@@ -980,15 +1093,19 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 			goto done;
 		}
 	} else if (!strcasecmp(key, "state")) {
-		if (cc_agent_str2state(value) != CC_AGENT_STATE_UNKNOWN) {
-			if (cc_agent_str2state(value) != CC_AGENT_STATE_RECEIVING) {
+		cc_agent_state_t state = cc_agent_str2state(value);
+
+		if (state != CC_AGENT_STATE_UNKNOWN) {
+			acd_agent->state = state;
+			if (state != CC_AGENT_STATE_RECEIVING) {
 				sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q'", value, agent);
 			} else {
+				acd_agent->last_offered_call = now;
 				sql = switch_mprintf("UPDATE agents SET state = '%q', last_offered_call = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
-						value, local_epoch_time_now(NULL), agent);
+						value, now, agent);
 			}
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_acd_agent_changed(globals.acd, acd_agent, now);
+			cc_persist(sql);
 
 			result = CC_STATUS_SUCCESS;
 
@@ -1004,15 +1121,19 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 			goto done;
 		}
 	} else if (!strcasecmp(key, "uuid")) {
+		cc_acd_set_string(&acd_agent->uuid, value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET uuid = '%q', system = 'single_box' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "contact")) {
+		cc_acd_set_string(&acd_agent->contact, value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET contact = '%q', system = 'single_box' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 
@@ -1023,27 +1144,35 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 			switch_event_fire(&event);
 		}
 	} else if (!strcasecmp(key, "ready_time")) {
+		acd_agent->ready_time = atol(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET ready_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "busy_delay_time")) {
+		acd_agent->busy_delay_time = atoi(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET busy_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "reject_delay_time")) {
+		acd_agent->reject_delay_time = atoi(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET reject_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "no_answer_delay_time")) {
+		acd_agent->no_answer_delay_time = atoi(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET no_answer_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "type")) {
@@ -1052,49 +1181,52 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 			goto done;
 		}
 
+		cc_acd_set_string(&acd_agent->type, value);
 		sql = switch_mprintf("UPDATE agents SET type = '%q' WHERE name = '%q'", value, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 
 	} else if (!strcasecmp(key, "max_no_answer")) {
+		acd_agent->max_no_answer = atoi(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET max_no_answer = '%d', system = 'single_box' WHERE name = '%q'", atoi(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 
 	} else if (!strcasecmp(key, "wrap_up_time")) {
+		acd_agent->wrap_up_time = atoi(value);
+		cc_acd_set_string(&acd_agent->system, CC_SYSTEM_SELF);
+		cc_acd_agent_changed(globals.acd, acd_agent, now);
 		sql = switch_mprintf("UPDATE agents SET wrap_up_time = '%d', system = 'single_box' WHERE name = '%q'", atoi(value), agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 
 	} else if (!strcasecmp(key, "state_if_waiting")) {
-		if (cc_agent_str2state(value) == CC_AGENT_STATE_UNKNOWN) {
+		cc_agent_state_t state = cc_agent_str2state(value);
+
+		if (state == CC_AGENT_STATE_UNKNOWN) {
 			result = CC_STATUS_AGENT_INVALID_STATE;
 			goto done;
-		} else {
-			sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q' AND state = '%q' AND status IN ('%q', '%q')",
-					value, agent,
-					cc_agent_state2str(CC_AGENT_STATE_WAITING),
-					cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE),
-					cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND));
-
-			if (cc_execute_sql_affected_rows(sql) > 0) {
-				result = CC_STATUS_SUCCESS;
-				if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-state-change");
-					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-State", value);
-					switch_event_fire(&event);
-				}
-			} else {
-				result = CC_STATUS_AGENT_NOT_FOUND;
+		} else if (acd_agent->state == CC_AGENT_STATE_WAITING &&
+				   (acd_agent->status == CC_AGENT_STATUS_AVAILABLE || acd_agent->status == CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)) {
+			acd_agent->state = state;
+			cc_acd_agent_changed(globals.acd, acd_agent, now);
+			sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q'", value, agent);
+			cc_persist(sql);
+
+			result = CC_STATUS_SUCCESS;
+			if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
+				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
+				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-state-change");
+				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-State", value);
+				switch_event_fire(&event);
 			}
-			switch_safe_free(sql);
+		} else {
+			result = CC_STATUS_AGENT_NOT_FOUND;
 		}
 
 	} else {
@@ -1104,6 +1236,12 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 	}
 
 done:
+	cc_acd_unlock(globals.acd);
+
+	if (!switch_strlen_zero(res)) {
+		switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", res, SWITCH_CAUSE_ORIGINATOR_CANCEL);
+	}
+
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated Agent %s set %s = %s\n", agent, key, value);
 	}
@@ -1116,6 +1254,7 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
 	cc_queue_t *queue = NULL;
+	cc_acd_agent_t *acd_agent;
 	if (!(queue = get_queue(queue_name))) {
 		result = CC_STATUS_QUEUE_NOT_FOUND;
 		goto done;
@@ -1124,33 +1263,27 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 	}
 
 	if (cc_tier_str2state(state) != CC_TIER_STATE_UNKNOWN) {
-		char res[256] = "";
+		cc_acd_lock(globals.acd);
 		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) == 0) {
+		if (!(acd_agent = cc_acd_agent_find(globals.acd, agent))) {
+			cc_acd_unlock(globals.acd);
 			result = CC_STATUS_AGENT_NOT_FOUND;
 			goto done;
 		}
 
 		/* Check to see if tier already exist */
-		sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		if (!cc_acd_tier_add(globals.acd, queue_name, acd_agent, cc_tier_str2state(state), level, position, local_epoch_time_now(NULL))) {
+			cc_acd_unlock(globals.acd);
 			result = CC_STATUS_TIER_ALREADY_EXIST;
 			goto done;
 		}
+		cc_acd_unlock(globals.acd);
 
 		/* Add Agent in tier */
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding Tier on Queue %s for Agent %s, level %d, position %d\n", queue_name, agent, level, position);
 		sql = switch_mprintf("INSERT INTO tiers (queue, agent, state, level, position) VALUES('%q', '%q', '%q', '%d', '%d');",
 				queue_name, agent, state, level, position);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else {
@@ -1159,7 +1292,7 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 
 	}
 
-done:		
+done:
 	return result;
 }
 
@@ -1167,29 +1300,19 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
-	char res[256];
 	cc_queue_t *queue = NULL;
+	cc_acd_tier_t *tier;
 
 	/* Check to see if tier already exist */
-	sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
+	cc_acd_lock(globals.acd);
+	tier = cc_acd_tier_find(globals.acd, queue_name, agent);
+	cc_acd_unlock(globals.acd);
 
-	if (atoi(res) == 0) {
+	if (!tier) {
 		result = CC_STATUS_TIER_NOT_FOUND;
 		goto done;
 	}
 
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
-		result = CC_STATUS_AGENT_NOT_FOUND;
-		goto done;
-	}
-
 	if (!(queue = get_queue(queue_name))) {
 		result = CC_STATUS_QUEUE_NOT_FOUND;
 		goto done;
@@ -1197,33 +1320,40 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 		queue_rwunlock(queue);
 	}
 
+	cc_acd_lock(globals.acd);
+	if (!(tier = cc_acd_tier_find(globals.acd, queue_name, agent))) {
+		cc_acd_unlock(globals.acd);
+		result = CC_STATUS_TIER_NOT_FOUND;
+		goto done;
+	}
+
 	if (!strcasecmp(key, "state")) {
 		if (cc_tier_str2state(value) != CC_TIER_STATE_UNKNOWN) {
+			tier->state = cc_tier_str2state(value);
+			cc_acd_tier_changed(globals.acd, tier, local_epoch_time_now(NULL));
 			sql = switch_mprintf("UPDATE tiers SET state = '%q' WHERE queue = '%q' AND agent = '%q'", value, queue_name, agent);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
+			cc_persist(sql);
 			result = CC_STATUS_SUCCESS;
 		} else {
 			result = CC_STATUS_TIER_INVALID_STATE;
-			goto done;
 		}
 	} else if (!strcasecmp(key, "level")) {
+		cc_acd_tier_move(globals.acd, tier, atoi(value), tier->position, local_epoch_time_now(NULL));
 		sql = switch_mprintf("UPDATE tiers SET level = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 
 	} else if (!strcasecmp(key, "position")) {
+		cc_acd_tier_move(globals.acd, tier, tier->level, atoi(value), local_epoch_time_now(NULL));
 		sql = switch_mprintf("UPDATE tiers SET position = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		result = CC_STATUS_SUCCESS;
 	} else {
 		result = CC_STATUS_INVALID_KEY;
-		goto done;
-	}	
+	}
+	cc_acd_unlock(globals.acd);
 done:
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated tier: Agent %s in Queue %s set %s = %s\n", agent, queue_name, key, value);
@@ -1234,12 +1364,18 @@ done:
 cc_status_t cc_tier_del(const char *queue_name, const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_acd_tier_t *tier;
 	char *sql;
 
+	cc_acd_lock(globals.acd);
+	if ((tier = cc_acd_tier_find(globals.acd, queue_name, agent))) {
+		cc_acd_tier_del(globals.acd, tier);
+	}
+	cc_acd_unlock(globals.acd);
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted tier Agent %s in Queue %s\n", agent, queue_name);
 	sql = switch_mprintf("DELETE FROM tiers WHERE queue = '%q' AND agent = '%q';", queue_name, agent);
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_persist(sql);
 
 	result = CC_STATUS_SUCCESS;
 
@@ -1379,6 +1515,88 @@ end:
 	return result;
 }
 
+static int load_agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_acd_agent_t *agent;
+
+	if (argc < 20 || !(agent = cc_acd_agent_add(globals.acd, switch_str_nil(argv[0]), switch_str_nil(argv[1]), switch_str_nil(argv[3])))) {
+		return 0;
+	}
+
+	cc_acd_set_string(&agent->uuid, argv[2]);
+	cc_acd_set_string(&agent->contact, argv[4]);
+	agent->status = cc_agent_str2status(switch_str_nil(argv[5]));
+	agent->state = cc_agent_str2state(switch_str_nil(argv[6]));
+	agent->max_no_answer = atoi(switch_str_nil(argv[7]));
+	agent->wrap_up_time = atoi(switch_str_nil(argv[8]));
+	agent->reject_delay_time = atoi(switch_str_nil(argv[9]));
+	agent->busy_delay_time = atoi(switch_str_nil(argv[10]));
+	agent->no_answer_delay_time = atoi(switch_str_nil(argv[11]));
+	agent->last_bridge_start = atol(switch_str_nil(argv[12]));
+	agent->last_bridge_end = atol(switch_str_nil(argv[13]));
+	agent->last_offered_call = atol(switch_str_nil(argv[14]));
+	agent->last_status_change = atol(switch_str_nil(argv[15]));
+	agent->no_answer_count = atoi(switch_str_nil(argv[16]));
+	agent->calls_answered = atoi(switch_str_nil(argv[17]));
+	agent->talk_time = atol(switch_str_nil(argv[18]));
+	agent->ready_time = atol(switch_str_nil(argv[19]));
+	cc_acd_agent_changed(globals.acd, agent, local_epoch_time_now(NULL));
+
+	return 0;
+}
+
+static int load_tiers_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_acd_agent_t *agent;
+
+	if (argc < 5 || !(agent = cc_acd_agent_find(globals.acd, switch_str_nil(argv[1])))) {
+		return 0;
+	}
+
+	cc_acd_tier_add(globals.acd, switch_str_nil(argv[0]), agent, cc_tier_str2state(switch_str_nil(argv[2])),
+					atoi(switch_str_nil(argv[3])), atoi(switch_str_nil(argv[4])), local_epoch_time_now(NULL));
+
+	return 0;
+}
+
+static int load_members_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_acd_member_t *member;
+
+	if (argc < 16 || !(member = cc_acd_member_add(globals.acd, switch_str_nil(argv[0]), switch_str_nil(argv[2]), atol(switch_str_nil(argv[7])),
+					atoi(switch_str_nil(argv[11])), atoi(switch_str_nil(argv[12]))))) {
+		return 0;
+	}
+
+	cc_acd_set_string(&member->system, argv[1]);
+	cc_acd_set_string(&member->session_uuid, argv[3]);
+	cc_acd_set_string(&member->cid_number, argv[4]);
+	cc_acd_set_string(&member->cid_name, argv[5]);
+	member->system_epoch = atol(switch_str_nil(argv[6]));
+	member->rejoined_epoch = atol(switch_str_nil(argv[8]));
+	member->bridge_epoch = atol(switch_str_nil(argv[9]));
+	member->abandoned_epoch = atol(switch_str_nil(argv[10]));
+	cc_acd_set_string(&member->serving_agent, argv[13]);
+	cc_acd_set_string(&member->serving_system, argv[14]);
+	member->state = cc_member_str2state(switch_str_nil(argv[15]));
+
+	return 0;
+}
+
+/* Seed the in-memory engine from whatever the db kept across a restart, called with globals.mutex held */
+static void load_persisted(void)
+{
+	cc_acd_lock(globals.acd);
+	cc_execute_sql_callback(NULL, NULL, "SELECT name, system, uuid, type, contact, status, state, max_no_answer, wrap_up_time, reject_delay_time, busy_delay_time, no_answer_delay_time, "
+							"last_bridge_start, last_bridge_end, last_offered_call, last_status_change, no_answer_count, calls_answered, talk_time, ready_time FROM agents",
+							load_agents_callback, NULL);
+	cc_execute_sql_callback(NULL, NULL, "SELECT queue, agent, state, level, position FROM tiers", load_tiers_callback, NULL);
+	cc_execute_sql_callback(NULL, NULL, "SELECT queue, system, uuid, session_uuid, cid_number, cid_name, system_epoch, joined_epoch, rejoined_epoch, bridge_epoch, "
+							"abandoned_epoch, base_score, skill_score, serving_agent, serving_system, state FROM members",
+							load_members_callback, NULL);
+	cc_acd_unlock(globals.acd);
+}
+
 static switch_status_t load_config(void)
 {
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
@@ -1393,6 +1611,7 @@ static switch_status_t load_config(void)
 	}
 
 	switch_mutex_lock(globals.mutex);
+	globals.persist = SWITCH_TRUE;
 	if ((settings = switch_xml_child(cfg, "settings"))) {
 		for (param = switch_xml_child(settings, "param"); param; param = param->next) {
 			char *var = (char *) switch_xml_attr_soft(param, "name");
@@ -1404,18 +1623,17 @@ static switch_status_t load_config(void)
 				globals.dbname = strdup(val);
 			} else if (!strcasecmp(var, "odbc-dsn")) {
 				globals.odbc_dsn = strdup(val);
-			} else if(!strcasecmp(var, "reserve-agents")) {
-				globals.reserve_agents = switch_true(val);
+			} else if (!strcasecmp(var, "persist")) {
+				globals.persist = switch_true(val);
 			}
 		}
 	}
 	if (!globals.dbname) {
 		globals.dbname = strdup(CC_SQLITE_DB_NAME);
 	}
-	if (!globals.reserve_agents) {
-		globals.reserve_agents = SWITCH_FALSE;
-	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Reserving Agents before offering calls.\n");
+	if (!globals.persist) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Agents, tiers and members are kept in memory only.\n");
+		goto load;
 	}
 	/* Initialize database */
 	if (!(dbh = cc_get_db_handle())) {
@@ -1441,6 +1659,9 @@ static switch_status_t load_config(void)
 	cc_execute_sql(NULL, sql, NULL);
 	switch_safe_free(sql);
 
+	load_persisted();
+
+load:
 	/* Loading queue into memory struct */
 	if ((x_queues = switch_xml_child(cfg, "queues"))) {
 		for (x_queue = switch_xml_child(x_queues, "queue"); x_queue; x_queue = x_queue->next) {
@@ -1497,6 +1718,71 @@ static switch_status_t playback_array(switch_core_session_t *session, const char
 	return status;
 }
 
+/* Hand a member back to the waiting list after an offer to agent_name fell through.  With only_trying set a
+   member that callcenter_function() already marked abandoned keeps that state. */
+static void cc_member_release(const char *member_uuid, const char *agent_name, const char *agent_system, switch_bool_t only_trying)
+{
+	cc_acd_member_t *member;
+	char *sql;
+
+	cc_acd_lock(globals.acd);
+	if ((member = cc_acd_member_find(globals.acd, member_uuid)) &&
+		!strcmp(member->serving_agent, agent_name) && !strcmp(member->serving_system, agent_system)) {
+		if (!only_trying || member->state == CC_MEMBER_STATE_TRYING) {
+			member->state = CC_MEMBER_STATE_WAITING;
+		}
+		cc_acd_set_string(&member->serving_agent, "");
+		cc_acd_set_string(&member->serving_system, "");
+	}
+	cc_acd_unlock(globals.acd);
+
+	if (only_trying) {
+		sql = switch_mprintf("UPDATE members SET state = case state when '%q' then '%q' else state end, serving_agent = '', serving_system = ''"
+				" WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND system = 'single_box'",
+				cc_member_state2str(CC_MEMBER_STATE_TRYING),	/* Only switch to Waiting from Trying (state may be set to Abandoned in callcenter_function()) */
+				cc_member_state2str(CC_MEMBER_STATE_WAITING),
+				agent_name, agent_system, member_uuid);
+	} else {
+		sql = switch_mprintf("UPDATE members SET state = '%q', serving_agent = '', serving_system = ''"
+				" WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND system = 'single_box'",
+				cc_member_state2str(CC_MEMBER_STATE_WAITING), agent_name, agent_system, member_uuid);
+	}
+	cc_persist(sql);
+}
+
+/* Put the agent's tiers back once an offer is over: the tier of this queue takes tiers_state and the tiers
+   the offer parked on standby in other queues become ready again. */
+static void cc_agent_release_tiers(const char *agent_name, const char *queue_name, cc_tier_state_t tiers_state)
+{
+	cc_acd_agent_t *agent;
+	cc_acd_tier_t *tier;
+	switch_time_t now = local_epoch_time_now(NULL);
+	char *sql;
+
+	cc_acd_lock(globals.acd);
+	if ((agent = cc_acd_agent_find(globals.acd, agent_name))) {
+		for (tier = agent->tiers; tier; tier = tier->agent_next) {
+			if (!strcmp(tier->queue->name, queue_name)) {
+				if (tier->state == CC_TIER_STATE_ACTIVE_INBOUND || tier->state == CC_TIER_STATE_STANDBY || tier->state == CC_TIER_STATE_OFFERING) {
+					tier->state = tiers_state;
+					cc_acd_tier_changed(globals.acd, tier, now);
+				}
+			} else if (tier->state == CC_TIER_STATE_STANDBY) {
+				tier->state = CC_TIER_STATE_READY;
+				cc_acd_tier_changed(globals.acd, tier, now);
+			}
+		}
+	}
+	cc_acd_unlock(globals.acd);
+
+	sql = switch_mprintf(
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
+			, cc_tier_state2str(tiers_state), agent_name, queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
+			cc_tier_state2str(CC_TIER_STATE_READY), agent_name, queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
+	cc_persist(sql);
+}
+
 static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *thread, void *obj)
 {
 	struct call_helper *h = (struct call_helper *) obj;
@@ -1512,6 +1798,8 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 	switch_time_t t_agent_answered = 0;
 	switch_time_t t_member_called = atoi(h->member_joined_epoch);
 	switch_event_t *event = NULL;
+	cc_acd_member_t *member;
+	cc_acd_agent_t *agent;
 
 	switch_mutex_lock(globals.mutex);
 	globals.threads++;
@@ -1520,13 +1808,17 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 	/* member is gone before we could process it */
 	if (!member_session) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Member %s <%s> with uuid %s in queue %s is gone just before we assigned an agent\n", h->member_cid_name, h->member_cid_number, h->member_session_uuid, h->queue_name);
-	
-	
-		 sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE system = 'single_box' AND uuid = '%q' AND state != '%q'",
-				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), h->member_uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
+		cc_acd_lock(globals.acd);
+		if ((member = cc_acd_member_find(globals.acd, h->member_uuid)) && member->state != CC_MEMBER_STATE_ABANDONED) {
+			member->state = CC_MEMBER_STATE_ABANDONED;
+			member->abandoned_epoch = local_epoch_time_now(NULL);
+			cc_acd_set_string(&member->session_uuid, "");
+		}
+		cc_acd_unlock(globals.acd);
 
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE system = 'single_box' AND uuid = '%q' AND state != '%q'",
+				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), h->member_uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
+		cc_persist(sql);
 		goto done;
 	}
 
@@ -1662,11 +1954,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 					switch_core_session_rwunlock(agent_session);
 					if (!(agent_session = switch_core_session_locate(real_uuid))) {
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Real session is already gone (agent '%s')\n", h->agent_name);
-						sql = switch_mprintf("UPDATE members SET state = '%q', serving_agent = '', serving_system = ''"
-											 " WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND system = 'single_box'",
-											 cc_member_state2str(CC_MEMBER_STATE_WAITING), h->agent_name, h->agent_system, h->member_uuid);
-						cc_execute_sql(NULL, sql, NULL);
-						switch_safe_free(sql);
+						cc_member_release(h->member_uuid, h->agent_name, h->agent_system, SWITCH_FALSE);
 						goto done;
 					}
 					agent_uuid = switch_core_session_get_uuid(agent_session);
@@ -1695,26 +1983,27 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 
 		if (!strcasecmp(h->queue_strategy,"ring-all")) {
-			char res[256];
-			/* Map the Agent to the member */
+			switch_bool_t won = SWITCH_FALSE;
+
+			/* Map the Agent to the member, the first agent to answer wins the race */
+			cc_acd_lock(globals.acd);
+			if ((member = cc_acd_member_find(globals.acd, h->member_uuid)) && member->state == CC_MEMBER_STATE_TRYING &&
+				!strcmp(member->serving_agent, CC_SERVING_RING_ALL)) {
+				cc_acd_set_string(&member->serving_agent, h->agent_name);
+				cc_acd_set_string(&member->serving_system, CC_SYSTEM_SELF);
+				won = SWITCH_TRUE;
+			}
+			cc_acd_unlock(globals.acd);
+
+			if (!won) {
+				goto done;
+			}
+
 			sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = 'single_box', state = '%q'"
 					" WHERE state = '%q' AND uuid = '%q' AND system = 'single_box' AND serving_agent = 'ring-all'",
 					h->agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
 					cc_member_state2str(CC_MEMBER_STATE_TRYING), h->member_uuid);
-			cc_execute_sql(NULL, sql, NULL);
-
-			switch_safe_free(sql);
-
-			/* Check if we won the race to get the member to our selected agent (Used for Multi system purposes) */
-			sql = switch_mprintf("SELECT count(*) FROM members"
-					" WHERE serving_agent = '%q' AND serving_system = 'single_box' AND uuid = '%q' AND system = 'single_box'",
-					h->agent_name, h->member_uuid);
-			cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-			switch_safe_free(sql);
-
-			if (atoi(res) == 0) {
-				goto done;
-			}
+			cc_persist(sql);
 			switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", h->member_uuid, SWITCH_CAUSE_LOSE_RACE);
 
 		}
@@ -1745,12 +2034,21 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		switch_channel_set_variable_printf(member_channel, "cc_queue_answered_epoch", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL)); 
 
 		/* Set UUID of the Agent channel */
+		cc_acd_lock(globals.acd);
+		if ((agent = cc_acd_agent_find(globals.acd, h->agent_name)) && !strcmp(agent->system, h->agent_system)) {
+			cc_acd_set_string(&agent->uuid, agent_uuid);
+			agent->last_bridge_start = local_epoch_time_now(NULL);
+			agent->calls_answered++;
+			agent->no_answer_count = 0;
+			cc_acd_agent_changed(globals.acd, agent, local_epoch_time_now(NULL));
+		}
+		cc_acd_unlock(globals.acd);
+
 		sql = switch_mprintf("UPDATE agents SET uuid = '%q', last_bridge_start = '%" SWITCH_TIME_T_FMT "', calls_answered = calls_answered + 1, no_answer_count = 0"
 				" WHERE name = '%q' AND system = '%q'",
 				agent_uuid, local_epoch_time_now(NULL),
 				h->agent_name, h->agent_system);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		/* Change the agents Status in the tiers */
 		cc_tier_update("state", cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), h->queue_name, h->agent_name);
@@ -1813,15 +2111,28 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 		/* Update Agents Items */
 		/* Do not remove uuid of the agent if we are a standby agent */
+		cc_acd_lock(globals.acd);
+		if ((agent = cc_acd_agent_find(globals.acd, h->agent_name)) && !strcmp(agent->system, h->agent_system)) {
+			if (strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY)) {
+				cc_acd_set_string(&agent->uuid, "");
+			}
+			agent->last_bridge_end = local_epoch_time_now(NULL);
+			agent->talk_time += agent->last_bridge_end - agent->last_bridge_start;
+			cc_acd_agent_changed(globals.acd, agent, local_epoch_time_now(NULL));
+		}
+
+		/* Remove the member entry (Could become optional to support latter processing) */
+		if ((member = cc_acd_member_find(globals.acd, h->member_uuid))) {
+			cc_acd_member_del(globals.acd, member);
+		}
+		cc_acd_unlock(globals.acd);
+
 		sql = switch_mprintf("UPDATE agents SET %s last_bridge_end = %" SWITCH_TIME_T_FMT ", talk_time = talk_time + (%" SWITCH_TIME_T_FMT "-last_bridge_start) WHERE name = '%q' AND system = '%q';"
 				, (strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY)?"uuid = '',":""), local_epoch_time_now(NULL), local_epoch_time_now(NULL), h->agent_name, h->agent_system);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
-		/* Remove the member entry from the db (Could become optional to support latter processing) */
 		sql = switch_mprintf("DELETE FROM members WHERE system = 'single_box' AND uuid = '%q'", h->member_uuid);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		/* Caller off event */
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -1848,13 +2159,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 	} else {
 		/* Agent didn't answer or originate failed */
 		int delay_next_agent_call = 0;
-		sql = switch_mprintf("UPDATE members SET state = case state when '%q' then '%q' else state end, serving_agent = '', serving_system = ''"
-				" WHERE serving_agent = '%q' AND serving_system = '%q' AND uuid = '%q' AND system = 'single_box'",
-				cc_member_state2str(CC_MEMBER_STATE_TRYING),	/* Only switch to Waiting from Trying (state may be set to Abandoned in callcenter_function()) */
-				cc_member_state2str(CC_MEMBER_STATE_WAITING),
-				h->agent_name, h->agent_system, h->member_uuid);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_member_release(h->member_uuid, h->agent_name, h->agent_system, SWITCH_TRUE);
 
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Agent %s Origination Canceled : %s\n", h->agent_name, switch_channel_cause2str(cause));
 
@@ -1882,10 +2187,15 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 				tiers_state = CC_TIER_STATE_NO_ANSWER;
 
 				/* Update Agent NO Answer count */
+				cc_acd_lock(globals.acd);
+				if ((agent = cc_acd_agent_find(globals.acd, h->agent_name)) && !strcmp(agent->system, h->agent_system)) {
+					agent->no_answer_count++;
+				}
+				cc_acd_unlock(globals.acd);
+
 				sql = switch_mprintf("UPDATE agents SET no_answer_count = no_answer_count + 1 WHERE name = '%q' AND system = '%q';",
 						h->agent_name, h->agent_system);
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
+				cc_persist(sql);
 
 				/* Put Agent on break because he didn't answer often */
 				if (h->max_no_answer > 0 && (h->no_answer_count + 1) >= h->max_no_answer) {
@@ -1925,13 +2235,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 done:
 	/* Make Agent Available Again */
-	sql = switch_mprintf(
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
-			, cc_tier_state2str(tiers_state), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
-			cc_tier_state2str(CC_TIER_STATE_READY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_agent_release_tiers(h->agent_name, h->queue_name, tiers_state);
 
 	/* If we are in Status Available On Demand, set state to Idle so we do not receive another call until state manually changed to Waiting */
 	if (!strcasecmp(cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND), h->agent_status)) {
@@ -1956,415 +2260,101 @@ done:
 	return NULL;
 }
 
-struct agent_callback {
-	const char *queue_name;
-	const char *system;
-	const char *member_uuid;
-	const char *member_session_uuid;
-	const char *member_cid_number;
-	const char *member_cid_name;
-	const char *member_joined_epoch;
-	const char *member_score;
-	const char *strategy;
-	const char *record_template;
-	switch_bool_t tier_rules_apply;
-	uint32_t tier_rule_wait_second;
-	switch_bool_t tier_rule_wait_multiply_level;
-	switch_bool_t tier_rule_no_agent_no_wait;
-	switch_bool_t agent_found;
-
-	int tier;
-	int tier_agent_available;
-};
-typedef struct agent_callback agent_callback_t;
-
-static int agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+/* cc_acd_dispatch() picked agent for member and already marked both as offering, mirror that into the db and
+   start the call to the agent.  Runs with the engine locked. */
+static void cc_offer_agent(cc_acd_t *acd, const cc_acd_offer_t *offer, void *pdata)
 {
-	agent_callback_t *cbt = (agent_callback_t *) pArg;
-	char *sql = NULL;
-	char res[256];
-	const char *agent_system = argv[0];
-	const char *agent_name = argv[1];
-	const char *agent_status = argv[2];
-	const char *agent_originate_string = argv[3];
-	const char *agent_no_answer_count = argv[4];
-	const char *agent_max_no_answer = argv[5];
-	const char *agent_reject_delay_time = argv[6];
-	const char *agent_busy_delay_time = argv[7];
-	const char *agent_no_answer_delay_time = argv[8];
-	const char *agent_tier_state = argv[9];
-	const char *agent_last_bridge_end = argv[10];
-	const char *agent_wrap_up_time = argv[11];
-	const char *agent_state = argv[12];
-	const char *agent_ready_time = argv[13];
-	const char *agent_tier_position = argv[14];
-	const char *agent_tier_level = argv[15];
-	const char *agent_type = argv[16];
-	const char *agent_uuid = argv[17];
-
-	switch_bool_t contact_agent = SWITCH_TRUE;
-
-	cbt->agent_found = SWITCH_TRUE;
-
-	/* Check if we switch to a different tier, if so, check if we should continue further for that member */
-
-	if (cbt->tier_rules_apply == SWITCH_TRUE && atoi(agent_tier_level) > cbt->tier) {
-		/* Continue if no agent was logged in in the previous tier and noagent = true */
-		if (cbt->tier_rule_no_agent_no_wait == SWITCH_TRUE && cbt->tier_agent_available == 0) {
-			cbt->tier = atoi(agent_tier_level);
-			/* Multiple the tier level by the tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_TRUE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= atoi(agent_tier_level) * (int)cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
-			cbt->tier_agent_available = 0;
-			/* Just check if joined is bigger than next tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_FALSE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= (int)cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
-			cbt->tier_agent_available = 0;
-		} else {
-			/* We are not allowed to continue to the next tier of agent */
-			return 1;
-		}
-	}
-	cbt->tier_agent_available++;
-
-	/* If Agent is not in a acceptable tier state, continue */
-	if (! (!strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_NO_ANSWER)) || !strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_READY)))) {
-		contact_agent = SWITCH_FALSE;
-	}
-	if (! (!strcasecmp(agent_state, cc_agent_state2str(CC_AGENT_STATE_WAITING)))) {
-		contact_agent = SWITCH_FALSE;
-	}
-	if (! (atol(agent_last_bridge_end) < ((long) local_epoch_time_now(NULL) - atol(agent_wrap_up_time)))) {
-		contact_agent = SWITCH_FALSE;
-	}
-	if (! (atol(agent_ready_time) <= (long) local_epoch_time_now(NULL))) {
-		contact_agent = SWITCH_FALSE;
-	}
-	if (! (strcasecmp(agent_status, cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK)))) {
-		contact_agent = SWITCH_FALSE;
-	}
-
-	if (contact_agent == SWITCH_FALSE) {
-		return 0; /* Continue to next Agent */
-	}
-
-	/* If agent isn't on this box */
-	if (strcasecmp(agent_system,"single_box" /* SELF */)) {
-		if (!strcasecmp(cbt->strategy, "ring-all")) {
-			return 1; /* Abort finding agent for member if we found a match but for a different Server */
-		} else {
-			return 0; /* Skip this Agents only, so we can ring the other one */
-		}
-	}
+	cc_acd_queue_t *queue = offer->queue;
+	cc_acd_member_t *member = offer->member;
+	cc_acd_agent_t *agent = offer->agent;
+	switch_thread_t *thread;
+	switch_threadattr_t *thd_attr = NULL;
+	switch_memory_pool_t *pool;
+	struct call_helper *h;
+	switch_event_t *event;
+	char *sql;
 
-	if (globals.reserve_agents) {
-		/* Updating agent state to Reserved only if it was Waiting previously, this is done to avoid race conditions
-		   when updating agents table with external applications */
-		if (cc_agent_update("state_if_waiting", cc_agent_state2str(CC_AGENT_STATE_RESERVED), agent_name) == CC_STATUS_SUCCESS) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Reserved Agent %s\n", agent_name);
-		} else {
-			/* Agent changed state just before we tried to update his state to Reserved. */
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Failed to Reserve Agent: %s. Skipping...\n", agent_name);
-			return 0;
+	switch_core_new_memory_pool(&pool);
+	h = switch_core_alloc(pool, sizeof(*h));
+	h->pool = pool;
+	h->member_uuid = switch_core_strdup(h->pool, member->uuid);
+	h->member_session_uuid = switch_core_strdup(h->pool, member->session_uuid);
+	h->queue_strategy = switch_core_strdup(h->pool, queue->strategy_name);
+	h->originate_string = switch_core_strdup(h->pool, agent->contact);
+	h->agent_name = switch_core_strdup(h->pool, agent->name);
+	h->agent_system = switch_core_strdup(h->pool, CC_SYSTEM_SELF);
+	h->agent_status = switch_core_strdup(h->pool, cc_agent_status2str(agent->status));
+	h->agent_type = switch_core_strdup(h->pool, agent->type);
+	h->agent_uuid = switch_core_strdup(h->pool, agent->uuid);
+	h->member_joined_epoch = switch_core_sprintf(h->pool, "%" SWITCH_TIME_T_FMT, member->joined_epoch);
+	h->member_cid_name = switch_core_strdup(h->pool, member->cid_name);
+	h->member_cid_number = switch_core_strdup(h->pool, member->cid_number);
+	h->queue_name = switch_core_strdup(h->pool, queue->name);
+	h->record_template = zstr(queue->record_template) ? NULL : switch_core_strdup(h->pool, queue->record_template);
+	h->no_answer_count = agent->no_answer_count;
+	h->max_no_answer = agent->max_no_answer;
+	h->reject_delay_time = agent->reject_delay_time;
+	h->busy_delay_time = agent->busy_delay_time;
+	h->no_answer_delay_time = agent->no_answer_delay_time;
+
+	if (queue->strategy == CC_STRATEGY_TOP_DOWN) {
+		switch_core_session_t *member_session = switch_core_session_locate(member->session_uuid);
+		if (member_session) {
+			switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
+			switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_position", "%d", offer->tier->position);
+			switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_level", "%d", offer->tier->level);
+			switch_core_session_rwunlock(member_session);
 		}
 	}
 
-	if (!strcasecmp(cbt->strategy,"ring-all")) {
-		/* Check if member is a ring-all mode */
-		sql = switch_mprintf("SELECT count(*) FROM members WHERE serving_agent = 'ring-all' AND uuid = '%q' AND system = 'single_box'", cbt->member_uuid);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-
-		switch_safe_free(sql);
-	} else {
+	if (queue->strategy != CC_STRATEGY_RING_ALL) {
 		/* Map the Agent to the member */
 		sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = 'single_box', state = '%q'"
-				" WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'", 
-				agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
-				cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt->member_uuid);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-
-		/* Check if we won the race to get the member to our selected agent (Used for Multi system purposes) */
-		sql = switch_mprintf("SELECT count(*) FROM members WHERE serving_agent = '%q' AND serving_system = 'single_box' AND uuid = '%q' AND system = 'single_box'",
-				agent_name, cbt->member_uuid);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+				" WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'",
+				agent->name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
+				cc_member_state2str(CC_MEMBER_STATE_WAITING), member->uuid);
+		cc_persist(sql);
 	}
 
-	switch (atoi(res)) {
-		case 0: /* Ok, someone else took it, or user hanged up already */
-			return 1;
-			/* We default to default even if more entry is returned... Should never happen	anyway */
-		default: /* Go ahead, start thread to try to bridge these 2 caller */
-			{
-				switch_thread_t *thread;
-				switch_threadattr_t *thd_attr = NULL;
-				switch_memory_pool_t *pool;
-				struct call_helper *h;
-
-				switch_core_new_memory_pool(&pool);
-				h = switch_core_alloc(pool, sizeof(*h));
-				h->pool = pool;
-				h->member_uuid = switch_core_strdup(h->pool, cbt->member_uuid);
-				h->member_session_uuid = switch_core_strdup(h->pool, cbt->member_session_uuid);
-				h->queue_strategy = switch_core_strdup(h->pool, cbt->strategy);
-				h->originate_string = switch_core_strdup(h->pool, agent_originate_string);
-				h->agent_name = switch_core_strdup(h->pool, agent_name);
-				h->agent_system = switch_core_strdup(h->pool, "single_box");
-				h->agent_status = switch_core_strdup(h->pool, agent_status);
-				h->agent_type = switch_core_strdup(h->pool, agent_type);
-				h->agent_uuid = switch_core_strdup(h->pool, agent_uuid);
-				h->member_joined_epoch = switch_core_strdup(h->pool, cbt->member_joined_epoch); 
-				h->member_cid_name = switch_core_strdup(h->pool, cbt->member_cid_name);
-				h->member_cid_number = switch_core_strdup(h->pool, cbt->member_cid_number);
-				h->queue_name = switch_core_strdup(h->pool, cbt->queue_name);
-				h->record_template = switch_core_strdup(h->pool, cbt->record_template);
-				h->no_answer_count = atoi(agent_no_answer_count);
-				h->max_no_answer = atoi(agent_max_no_answer);
-				h->reject_delay_time = atoi(agent_reject_delay_time);
-				h->busy_delay_time = atoi(agent_busy_delay_time);
-				h->no_answer_delay_time = atoi(agent_no_answer_delay_time);
-
-				if (!strcasecmp(cbt->strategy, "top-down")) {
-					switch_core_session_t *member_session = switch_core_session_locate(cbt->member_session_uuid);
-					if (member_session) {
-						switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_position", agent_tier_position);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_level", agent_tier_level);
-						switch_core_session_rwunlock(member_session);
-					}
-				}
-				cc_agent_update("state", cc_agent_state2str(CC_AGENT_STATE_RECEIVING), h->agent_name);
-
-				sql = switch_mprintf(
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
-						cc_tier_state2str(CC_TIER_STATE_OFFERING), h->agent_name, h->queue_name,
-						cc_tier_state2str(CC_TIER_STATE_STANDBY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_READY));
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
-
-				switch_threadattr_create(&thd_attr, h->pool);
-				switch_threadattr_detach_set(thd_attr, 1);
-				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				switch_thread_create(&thread, thd_attr, outbound_agent_thread_run, h, h->pool);
-			}
+	sql = switch_mprintf("UPDATE agents SET state = '%q', last_offered_call = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q';"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
+			cc_agent_state2str(CC_AGENT_STATE_RECEIVING), agent->last_offered_call, agent->name,
+			cc_tier_state2str(CC_TIER_STATE_OFFERING), agent->name, queue->name,
+			cc_tier_state2str(CC_TIER_STATE_STANDBY), agent->name, queue->name, cc_tier_state2str(CC_TIER_STATE_READY));
+	cc_persist(sql);
 
-			if (!strcasecmp(cbt->strategy,"ring-all")) {
-				return 0;
-			} else {
-				return 1;
-			}
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent->name);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-state-change");
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent-State", cc_agent_state2str(CC_AGENT_STATE_RECEIVING));
+		switch_event_fire(&event);
 	}
+
+	switch_threadattr_create(&thd_attr, h->pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&thread, thd_attr, outbound_agent_thread_run, h, h->pool);
 }
 
-static int members_callback(void *pArg, int argc, char **argv, char **columnNames)
+/* Tracking queue strategy changes */
+static void cc_member_changed(cc_acd_t *acd, cc_acd_member_t *member, void *pdata)
 {
-	cc_queue_t *queue = NULL;
-	char *sql = NULL;
-	char *sql_order_by = NULL;
-	char *queue_name = NULL;
-	char *queue_strategy = NULL;
-	char *queue_record_template = NULL;
-	switch_bool_t tier_rules_apply;
-	uint32_t tier_rule_wait_second;
-	switch_bool_t tier_rule_wait_multiply_level;
-	switch_bool_t tier_rule_no_agent_no_wait;
-	uint32_t discard_abandoned_after;
-	agent_callback_t cbt;
-	const char *member_state = NULL;
-	const char *member_abandoned_epoch = NULL;
-	const char *serving_agent = NULL;
-	memset(&cbt, 0, sizeof(cbt));
-
-	cbt.queue_name = argv[0];
-	cbt.member_uuid = argv[1];
-	cbt.member_session_uuid = argv[2];
-	cbt.member_cid_number = argv[3];
-	cbt.member_cid_name = argv[4];
-	cbt.member_joined_epoch = argv[5];
-	cbt.member_score = argv[6];
-	member_state = argv[7];
-	member_abandoned_epoch = argv[8];
-	serving_agent = argv[9];
-
-	if (!cbt.queue_name || !(queue = get_queue(cbt.queue_name))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Queue %s not found locally, skip this member\n", cbt.queue_name);
-		goto end;
-	} else {
-		queue_name = strdup(queue->name);
-		queue_strategy = strdup(queue->strategy);
-		tier_rules_apply = queue->tier_rules_apply;
-		tier_rule_wait_second = queue->tier_rule_wait_second;
-		tier_rule_wait_multiply_level = queue->tier_rule_wait_multiply_level;
-		tier_rule_no_agent_no_wait = queue->tier_rule_no_agent_no_wait;
-		discard_abandoned_after = queue->discard_abandoned_after;
-
-		if (queue->record_template) {
-			queue_record_template = strdup(queue->record_template);
-		}
-
-		queue_rwunlock(queue);
-	}
-
-	/* Checking for cleanup Abandonded calls from the db */
-	if (!strcasecmp(member_state, cc_member_state2str(CC_MEMBER_STATE_ABANDONED))) {
-		switch_time_t abandoned_epoch = atoll(member_abandoned_epoch);
-		if (abandoned_epoch == 0) {
-			abandoned_epoch = atoll(cbt.member_joined_epoch);
-		}
-		/* Once we pass a certain point, we want to get rid of the abandoned call */
-		if (abandoned_epoch + discard_abandoned_after < local_epoch_time_now(NULL)) {
-			sql = switch_mprintf("DELETE FROM members WHERE system = 'single_box' AND uuid = '%q' AND (abandoned_epoch = '%" SWITCH_TIME_T_FMT "' OR joined_epoch = '%q')", cbt.member_uuid, abandoned_epoch, cbt.member_joined_epoch);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
-		}
-		/* Skip this member */
-		goto end;
-	}
-
-	/* Tracking queue strategy changes */
-	/* member is ring-all but not the queue */
-	if (!strcasecmp(serving_agent, "ring-all") && (strcasecmp(queue_strategy, "ring-all") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
-		sql = switch_mprintf("UPDATE members SET serving_agent = '', state = '%s' WHERE uuid = '%s' AND state = '%s' AND serving_agent = 'ring-all'", cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_TRYING));
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-	}
-	/* Queue is now ring-all and not the member */
-	else if (!strcasecmp(queue_strategy, "ring-all") && (strcasecmp(serving_agent, "ring-all") != 0)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters", queue_name);
-		sql = switch_mprintf("UPDATE members SET serving_agent = 'ring-all', state = '%s' WHERE uuid = '%s' AND state = '%s' AND serving_agent = ''", cc_member_state2str(CC_MEMBER_STATE_TRYING), cbt.member_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING));
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
-	}
-
-	/* Check if member is in the queue waiting */
-	if (zstr(cbt.member_session_uuid)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Member %s <%s> in Queue %s have no session uuid, skip this member\n", cbt.member_cid_name, cbt.member_cid_number, cbt.queue_name);
-	}
-
-	cbt.tier = 0;
-	cbt.tier_agent_available = 0;
-
-	cbt.tier_rules_apply = tier_rules_apply;
-	cbt.tier_rule_wait_second = tier_rule_wait_second;
-	cbt.tier_rule_wait_multiply_level = tier_rule_wait_multiply_level;
-	cbt.tier_rule_no_agent_no_wait = tier_rule_no_agent_no_wait;
-
-	cbt.strategy = queue_strategy;
-	cbt.record_template = queue_record_template;
-	cbt.agent_found = SWITCH_FALSE;
-
-	if (!strcasecmp(queue->strategy, "top-down")) {
-		/* WARNING this use channel variable to help dispatch... might need to be reviewed to save it in DB to make this multi server prooft in the future */
-		switch_core_session_t *member_session = switch_core_session_locate(cbt.member_session_uuid);
-		int position = 0, level = 0;
-		const char *last_agent_tier_position, *last_agent_tier_level;
-		if (member_session) {
-			switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-
-			if ((last_agent_tier_position = switch_channel_get_variable(member_channel, "cc_last_agent_tier_position"))) {
-				position = atoi(last_agent_tier_position);
-			}
-			if ((last_agent_tier_level = switch_channel_get_variable(member_channel, "cc_last_agent_tier_level"))) {
-				level = atoi(last_agent_tier_level);
-			}
-			switch_core_session_rwunlock(member_session);
-		}
-
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > %d"
-				" AND tiers.level = %d"
-				" UNION "
-				"SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				position,
-				level,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)
-				);
-	} else if (!strcasecmp(queue->strategy, "round-robin")) {
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > (SELECT tiers.position FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" AND tiers.level = (SELECT tiers.level FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" UNION "
-				"SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				queue_name,
-				queue_name,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)
-				);
-
-	} else {
-
-		if (!strcasecmp(queue->strategy, "longest-idle-agent")) {
-			sql_order_by = switch_mprintf("level, agents.last_bridge_end, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-least-talk-time")) {
-			sql_order_by = switch_mprintf("level, agents.talk_time, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-fewest-calls")) {
-			sql_order_by = switch_mprintf("level, agents.calls_answered, position");
-		} else if (!strcasecmp(queue_strategy, "ring-all")) {
-			sql = switch_mprintf("UPDATE members SET state = '%q' WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'",
-					cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
-			sql_order_by = switch_mprintf("level, position");
-		} else if(!strcasecmp(queue_strategy, "random")) {
-			sql_order_by = switch_mprintf("level, random()");
-		} else if(!strcasecmp(queue_strategy, "sequentially-by-agent-order")) {
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call"); /* Default to last_offered_call, let add new strategy if needing it differently */
-		} else {
-			/* If the strategy doesn't exist, just fallback to the following */
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call");
-		}
-
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position, tiers.level, agents.type, agents.uuid FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY %q",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				sql_order_by);
-		switch_safe_free(sql_order_by);
-
-	}
-
-	cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, agents_callback, &cbt /* Call back variables */);
-
-	switch_safe_free(sql);
+	char *sql;
 
-	/* We update a field in the queue struct so we can kick caller out if waiting for too long with no agent */
-	if (!cbt.queue_name || !(queue = get_queue(cbt.queue_name))) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Queue %s not found locally, skip this member\n", cbt.queue_name);
-		goto end;
-	} else {
-		queue->last_agent_exist_check = local_epoch_time_now(NULL);
-		if (cbt.agent_found) {
-			queue->last_agent_exist = queue->last_agent_exist_check;
-		}
-		queue_rwunlock(queue);
-	}
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Queue '%s' changed strategy, adjusting member parameters\n", member->queue);
+	sql = switch_mprintf("UPDATE members SET serving_agent = '%q', state = '%q' WHERE uuid = '%q' AND system = 'single_box'",
+			member->serving_agent, cc_member_state2str(member->state), member->uuid);
+	cc_persist(sql);
+}
 
-end:
-	switch_safe_free(queue_name);
-	switch_safe_free(queue_strategy);
-	switch_safe_free(queue_record_template);
+/* Once we pass a certain point, we want to get rid of the abandoned call */
+static void cc_member_discard(cc_acd_t *acd, cc_acd_member_t *member, void *pdata)
+{
+	char *sql;
 
-	return 0;
+	sql = switch_mprintf("DELETE FROM members WHERE system = 'single_box' AND uuid = '%q'", member->uuid);
+	cc_persist(sql);
 }
 
 static int AGENT_DISPATCH_THREAD_RUNNING = 0;
@@ -2373,6 +2363,7 @@ static int AGENT_DISPATCH_THREAD_STARTED = 0;
 void *SWITCH_THREAD_FUNC cc_agent_dispatch_thread_run(switch_thread_t *thread, void *obj)
 {
 	int done = 0;
+	cc_acd_events_t events = { cc_offer_agent, cc_member_changed, cc_member_discard, NULL };
 
 	switch_mutex_lock(globals.mutex);
 	if (!AGENT_DISPATCH_THREAD_RUNNING) {
@@ -2390,14 +2381,7 @@ void *SWITCH_THREAD_FUNC cc_agent_dispatch_thread_run(switch_thread_t *thread, v
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Agent Dispatch Thread Started\n");
 
 	while (globals.running == 1) {
-		char *sql = NULL;
-		sql = switch_mprintf("SELECT queue,uuid,session_uuid,cid_number,cid_name,joined_epoch,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score, state, abandoned_epoch, serving_agent FROM members"
-				" WHERE state = '%q' OR state = '%q' OR (serving_agent = 'ring-all' AND state = '%q') ORDER BY score DESC",
-				local_epoch_time_now(NULL),
-				cc_member_state2str(CC_MEMBER_STATE_WAITING), cc_member_state2str(CC_MEMBER_STATE_ABANDONED), cc_member_state2str(CC_MEMBER_STATE_TRYING));
-
-		cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, members_callback, NULL /* Call back variables */);
-		switch_safe_free(sql);
+		cc_acd_dispatch(globals.acd, local_epoch_time_now(NULL), &events);
 		switch_yield(100000);
 	}
 
@@ -2472,12 +2456,21 @@ void *SWITCH_THREAD_FUNC cc_member_thread_run(switch_thread_t *thread, void *obj
 
 	while(switch_channel_ready(member_channel) && m->running && globals.running) {
 		cc_queue_t *queue = NULL;
+		cc_acd_queue_t *acd_queue;
 		switch_time_t time_now = local_epoch_time_now(NULL);
+		switch_time_t last_agent_exist = 0, last_agent_exist_check = 0;
 
 		if (!m->queue_name || !(queue = get_queue(m->queue_name))) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_WARNING, "Queue %s not found\n", m->queue_name);
 			break;
 		}
+
+		cc_acd_lock(globals.acd);
+		if ((acd_queue = cc_acd_queue_find(globals.acd, m->queue_name, SWITCH_FALSE))) {
+			last_agent_exist = acd_queue->last_agent_exist;
+			last_agent_exist_check = acd_queue->last_agent_exist_check;
+		}
+		cc_acd_unlock(globals.acd);
 		/* Make the Caller Leave if he went over his max wait time */
 		if (queue->max_wait_time > 0 && queue->max_wait_time <=  time_now - m->t_member_called) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> in queue '%s' reached max wait time\n", m->member_cid_name, m->member_cid_number, m->queue_name);
@@ -2486,13 +2479,13 @@ void *SWITCH_THREAD_FUNC cc_member_thread_run(switch_thread_t *thread, void *obj
 		}
 
 		/* Check if max wait time no agent is Active AND if there is no Agent AND if the last agent check was after the member join */
-		if (queue->max_wait_time_with_no_agent > 0 && queue->last_agent_exist_check > queue->last_agent_exist && m->t_member_called <= queue->last_agent_exist_check) {
+		if (queue->max_wait_time_with_no_agent > 0 && last_agent_exist_check > last_agent_exist && m->t_member_called <= last_agent_exist_check) {
 			/* Check if the time without agent is bigger or equal than out threshold */
-			if (queue->last_agent_exist_check - queue->last_agent_exist >= queue->max_wait_time_with_no_agent) {
+			if (last_agent_exist_check - last_agent_exist >= queue->max_wait_time_with_no_agent) {
 				/* Check for grace period with no agent when member join */
 				if (queue->max_wait_time_with_no_agent_time_reached > 0) {
 					/* Check if the last agent check was after the member join, and we waited atless the extra time  */
-					if (queue->last_agent_exist_check - m->t_member_called >= queue->max_wait_time_with_no_agent_time_reached + queue->max_wait_time_with_no_agent) {
+					if (last_agent_exist_check - m->t_member_called >= queue->max_wait_time_with_no_agent_time_reached + queue->max_wait_time_with_no_agent) {
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> in queue '%s' reached max wait of %d sec. with no agent plus join grace period of %d sec.\n", m->member_cid_name, m->member_cid_number, m->queue_name, queue->max_wait_time_with_no_agent, queue->max_wait_time_with_no_agent_time_reached);
 						m->member_cancel_reason = CC_MEMBER_CANCEL_REASON_NO_AGENT_TIMEOUT;
 						switch_channel_set_flag_value(member_channel, CF_BREAK, 2);
@@ -2612,6 +2605,7 @@ SWITCH_STANDARD_APP(callcenter_function)
 	switch_bool_t agent_found = SWITCH_FALSE;
 	switch_bool_t moh_valid = SWITCH_TRUE;
 	const char *p;
+	cc_acd_member_t *member;
 
 	if (!zstr(data)) {
 		mydata = switch_core_session_strdup(member_session, data);
@@ -2639,21 +2633,22 @@ SWITCH_STANDARD_APP(callcenter_function)
 
 	/* Check if we support and have a queued abandoned member we can resume from */
 	if (queue->abandoned_resume_allowed == SWITCH_TRUE) {
-		char res[256];
-
-		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT uuid FROM members WHERE queue = '%q' AND cid_number = '%q' AND state = '%q' ORDER BY abandoned_epoch DESC",
-				queue_name, switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		strncpy(member_uuid, res, sizeof(member_uuid));
-		
-		if (!zstr(member_uuid)) {
-			sql = switch_mprintf("SELECT abandoned_epoch FROM members WHERE uuid = '%q'", member_uuid);
-			cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-			switch_safe_free(sql);
-			abandoned_epoch = atol(res);
+		const char *cid_number = switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number"));
+		cc_acd_member_t *abandoned = NULL;
+
+		/* Pick the most recently abandoned member of this caller */
+		cc_acd_lock(globals.acd);
+		for (member = globals.acd->members; member; member = member->next) {
+			if (member->state == CC_MEMBER_STATE_ABANDONED && !strcmp(member->queue, queue_name) && !strcmp(member->cid_number, cid_number) &&
+				(!abandoned || member->abandoned_epoch > abandoned->abandoned_epoch)) {
+				abandoned = member;
+			}
+		}
+		if (abandoned) {
+			switch_copy_string(member_uuid, abandoned->uuid, sizeof(member_uuid));
+			abandoned_epoch = (long) abandoned->abandoned_epoch;
 		}
+		cc_acd_unlock(globals.acd);
 	}
 
 	/* If no existing uuid is restored, let create a new one */
@@ -2707,25 +2702,38 @@ SWITCH_STANDARD_APP(callcenter_function)
 				switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")),
 				(!strcasecmp(queue->strategy,"ring-all")?"ring-all":""),
 				cc_member_state2str(CC_MEMBER_STATE_WAITING));
-		cc_execute_sql(queue, sql, NULL);
-		switch_safe_free(sql);
+
+		cc_acd_lock(globals.acd);
+		if ((member = cc_acd_member_add(globals.acd, queue_name, member_uuid, local_epoch_time_now(NULL), cc_base_score_int, 0 /*TODO SKILL score*/))) {
+			cc_acd_set_string(&member->system, CC_SYSTEM_SELF);
+			cc_acd_set_string(&member->session_uuid, member_session_uuid);
+			cc_acd_set_string(&member->cid_number, switch_channel_get_variable(member_channel, "caller_id_number"));
+			cc_acd_set_string(&member->cid_name, switch_channel_get_variable(member_channel, "caller_id_name"));
+			cc_acd_set_string(&member->serving_agent, !strcasecmp(queue->strategy, "ring-all") ? CC_SERVING_RING_ALL : "");
+			member->system_epoch = atol(start_epoch);
+		}
+		cc_acd_unlock(globals.acd);
+		cc_persist(sql);
 	} else {
-		char res[256];
+		switch_bool_t restored = SWITCH_FALSE;
 
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> restoring it previous position in queue %s\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
 
-		/* Update abandoned member */
-		sql = switch_mprintf("UPDATE members SET session_uuid = '%q', state = '%q', rejoined_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND state = '%q'",
-				member_session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), local_epoch_time_now(NULL), member_uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED)); 
-		cc_execute_sql(queue, sql, NULL);
-		switch_safe_free(sql);
-
-		/* Confirm we took that member in */
-		sql = switch_mprintf("SELECT abandoned_epoch FROM members WHERE uuid = '%q' AND session_uuid = '%q' AND state = '%q' AND queue = '%q'", member_uuid, member_session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), queue_name);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
+		/* Update abandoned member, only if nobody took it in the meantime */
+		cc_acd_lock(globals.acd);
+		if ((member = cc_acd_member_find(globals.acd, member_uuid)) && member->state == CC_MEMBER_STATE_ABANDONED && !strcmp(member->queue, queue_name)) {
+			cc_acd_set_string(&member->session_uuid, member_session_uuid);
+			member->state = CC_MEMBER_STATE_WAITING;
+			member->rejoined_epoch = local_epoch_time_now(NULL);
+			restored = SWITCH_TRUE;
+		}
+		cc_acd_unlock(globals.acd);
 
-		if (atol(res) == 0) {
+		if (restored) {
+			sql = switch_mprintf("UPDATE members SET session_uuid = '%q', state = '%q', rejoined_epoch = '%" SWITCH_TIME_T_FMT "' WHERE uuid = '%q' AND state = '%q'",
+					member_session_uuid, cc_member_state2str(CC_MEMBER_STATE_WAITING), local_epoch_time_now(NULL), member_uuid, cc_member_state2str(CC_MEMBER_STATE_ABANDONED));
+			cc_persist(sql);
+		} else {
 			/* Failed to get the member !!! */
 			/* TODO Loop back to just create a uuid and add the member as a new member */
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_ERROR, "Member %s <%s> restoring action failed in queue %s, exiting\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
@@ -2834,10 +2842,17 @@ SWITCH_STANDARD_APP(callcenter_function)
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> abandoned waiting in queue %s\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
 
 		/* Update member state */
+		cc_acd_lock(globals.acd);
+		if ((member = cc_acd_member_find(globals.acd, member_uuid))) {
+			member->state = CC_MEMBER_STATE_ABANDONED;
+			member->abandoned_epoch = local_epoch_time_now(NULL);
+			cc_acd_set_string(&member->session_uuid, "");
+		}
+		cc_acd_unlock(globals.acd);
+
 		sql = switch_mprintf("UPDATE members SET state = '%q', session_uuid = '', abandoned_epoch = '%" SWITCH_TIME_T_FMT "' WHERE system = 'single_box' AND uuid = '%q'",
 				cc_member_state2str(CC_MEMBER_STATE_ABANDONED), local_epoch_time_now(NULL), member_uuid);
-				cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		/* Hangup any callback agents  */
 		switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", member_uuid, SWITCH_CAUSE_ORIGINATOR_CANCEL);
@@ -2873,10 +2888,16 @@ SWITCH_STANDARD_APP(callcenter_function)
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member_session), SWITCH_LOG_DEBUG, "Member %s <%s> is answered by an agent in queue %s\n", switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_name")), switch_str_nil(switch_channel_get_variable(member_channel, "caller_id_number")), queue_name);
 
 		/* Update member state */
+		cc_acd_lock(globals.acd);
+		if ((member = cc_acd_member_find(globals.acd, member_uuid))) {
+			member->state = CC_MEMBER_STATE_ANSWERED;
+			member->bridge_epoch = local_epoch_time_now(NULL);
+		}
+		cc_acd_unlock(globals.acd);
+
 		sql = switch_mprintf("UPDATE members SET state = '%q', bridge_epoch = '%" SWITCH_TIME_T_FMT "' WHERE system = 'single_box' AND uuid = '%q'",
 				cc_member_state2str(CC_MEMBER_STATE_ANSWERED), local_epoch_time_now(NULL), member_uuid);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_persist(sql);
 
 		/* Update some channel variables for xml_cdr needs */
 		switch_channel_set_variable_printf(member_channel, "cc_cause", "%s", "answered");
@@ -2898,31 +2919,65 @@ struct list_result {
 	switch_stream_handle_t *stream;
 
 };
-static int list_result_callback(void *pArg, int argc, char **argv, char **columnNames)
+
+/* Listings are rendered straight from the engine, in the same layout the db rows used to have */
+static void list_agent(struct list_result *cbt, cc_acd_agent_t *agent)
 {
-	struct list_result *cbt = (struct list_result *) pArg;
-	int i = 0;
+	if (++cbt->row_process == 1) {
+		cbt->stream->write_function(cbt->stream, "name|system|uuid|type|contact|status|state|max_no_answer|wrap_up_time|reject_delay_time|busy_delay_time|"
+									"no_answer_delay_time|last_bridge_start|last_bridge_end|last_offered_call|last_status_change|no_answer_count|calls_answered|talk_time|ready_time\n");
+	}
+	cbt->stream->write_function(cbt->stream, "%s|%s|%s|%s|%s|%s|%s|%d|%d|%d|%d|%d|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT
+								"|%d|%d|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "\n",
+								agent->name, agent->system, agent->uuid, agent->type, agent->contact,
+								cc_agent_status2str(agent->status), cc_agent_state2str(agent->state),
+								agent->max_no_answer, agent->wrap_up_time, agent->reject_delay_time, agent->busy_delay_time, agent->no_answer_delay_time,
+								agent->last_bridge_start, agent->last_bridge_end, agent->last_offered_call, agent->last_status_change,
+								agent->no_answer_count, agent->calls_answered, agent->talk_time, agent->ready_time);
+}
 
-	cbt->row_process++;
+static void list_tier(struct list_result *cbt, cc_acd_tier_t *tier)
+{
+	if (++cbt->row_process == 1) {
+		cbt->stream->write_function(cbt->stream, "queue|agent|state|level|position\n");
+	}
+	cbt->stream->write_function(cbt->stream, "%s|%s|%s|%d|%d\n", tier->queue->name, tier->agent->name, cc_tier_state2str(tier->state), tier->level, tier->position);
+}
 
-	if (cbt->row_process == 1) {
-		for ( i = 0; i < argc; i++) {
-			cbt->stream->write_function(cbt->stream,"%s", columnNames[i]);
-			if (i < argc - 1) {
-				cbt->stream->write_function(cbt->stream,"|");
-			}
-		}  
-		cbt->stream->write_function(cbt->stream,"\n");
+static void list_member(struct list_result *cbt, cc_acd_member_t *member, switch_time_t now)
+{
+	if (++cbt->row_process == 1) {
+		cbt->stream->write_function(cbt->stream, "queue|system|uuid|session_uuid|cid_number|cid_name|system_epoch|joined_epoch|rejoined_epoch|bridge_epoch|"
+									"abandoned_epoch|base_score|skill_score|serving_agent|serving_system|state|score\n");
+	}
+	cbt->stream->write_function(cbt->stream, "%s|%s|%s|%s|%s|%s|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT "|%" SWITCH_TIME_T_FMT
+								"|%d|%d|%s|%s|%s|%" SWITCH_TIME_T_FMT "\n",
+								member->queue, member->system, member->uuid, member->session_uuid, member->cid_number, member->cid_name,
+								member->system_epoch, member->joined_epoch, member->rejoined_epoch, member->bridge_epoch, member->abandoned_epoch,
+								member->base_score, member->skill_score, member->serving_agent, member->serving_system, cc_member_state2str(member->state),
+								(now - member->joined_epoch) + member->base_score + member->skill_score);
+}
+
+static int list_tier_cmp(const void *a, const void *b)
+{
+	const cc_acd_tier_t *ta = *(const cc_acd_tier_t * const *) a;
+	const cc_acd_tier_t *tb = *(const cc_acd_tier_t * const *) b;
 
+	if (ta->level != tb->level) {
+		return ta->level < tb->level ? -1 : 1;
 	}
-	for ( i = 0; i < argc; i++) {
-		cbt->stream->write_function(cbt->stream,"%s", argv[i]);
-		if (i < argc - 1) {
-			cbt->stream->write_function(cbt->stream,"|");
-		}
+	return ta->position < tb->position ? -1 : (ta->position > tb->position);
+}
+
+static switch_bool_t queue_agent_match(cc_acd_agent_t *agent, const char *status, const char *state)
+{
+	if (status && strcasecmp(cc_agent_status2str(agent->status), status)) {
+		return SWITCH_FALSE;
 	}
-	cbt->stream->write_function(cbt->stream,"\n");
-	return 0;
+	if (state && strcasecmp(cc_agent_state2str(agent->state), state)) {
+		return SWITCH_FALSE;
+	}
+	return SWITCH_TRUE;
 }
 
 #define CC_CONFIG_API_SYNTAX "callcenter_config <target> <args>,\n"\
@@ -2964,7 +3019,6 @@ SWITCH_STANDARD_API(cc_config_api_function)
 	char *mydata = NULL, *argv[8] = { 0 };
 	const char *section = NULL;
 	const char *action = NULL;
-	char *sql;
 	int initial_argc = 2;
 
 	int argc;
@@ -3115,13 +3169,20 @@ SWITCH_STANDARD_API(cc_config_api_function)
 			if ( argc-initial_argc > 1 ) {
 				stream->write_function(stream, "%s", "-ERR Invalid!\n");
 				goto done;
-			} else if ( argc-initial_argc == 1 ) {
-				sql = switch_mprintf("SELECT * FROM agents WHERE name='%q'", argv[0 + initial_argc]);
+			}
+			cc_acd_lock(globals.acd);
+			if ( argc-initial_argc == 1 ) {
+				cc_acd_agent_t *agent = cc_acd_agent_find(globals.acd, argv[0 + initial_argc]);
+				if (agent) {
+					list_agent(&cbt, agent);
+				}
 			} else {
-				sql = switch_mprintf("SELECT * FROM agents");
+				cc_acd_agent_t *agent;
+				for (agent = globals.acd->agents; agent; agent = agent->next) {
+					list_agent(&cbt, agent);
+				}
 			}
-			cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-			switch_safe_free(sql);
+			cc_acd_unlock(globals.acd);
 			stream->write_function(stream, "%s", "+OK\n");
 		}
 
@@ -3243,11 +3304,29 @@ SWITCH_STANDARD_API(cc_config_api_function)
 
 		} else if (action && !strcasecmp(action, "list")) {
 			struct list_result cbt;
+			cc_acd_agent_t *agent;
+			cc_acd_tier_t *tier, **tiers = NULL;
+			int i, ntiers = 0, size = 0;
 			cbt.row_process = 0;
 			cbt.stream = stream;
-			sql = switch_mprintf("SELECT * FROM tiers ORDER BY level, position");
-			cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-			switch_safe_free(sql);
+			cc_acd_lock(globals.acd);
+			for (agent = globals.acd->agents; agent; agent = agent->next) {
+				for (tier = agent->tiers; tier; tier = tier->agent_next) {
+					if (ntiers == size) {
+						size = size ? size * 2 : 64;
+						switch_assert((tiers = realloc(tiers, size * sizeof(*tiers))));
+					}
+					tiers[ntiers++] = tier;
+				}
+			}
+			if (ntiers) {
+				qsort(tiers, ntiers, sizeof(*tiers), list_tier_cmp);
+			}
+			for (i = 0; i < ntiers; i++) {
+				list_tier(&cbt, tiers[i]);
+			}
+			cc_acd_unlock(globals.acd);
+			switch_safe_free(tiers);
 			stream->write_function(stream, "%s", "+OK\n");
 		}
 	} else if (section && !strcasecmp(section, "queue")) {
@@ -3318,38 +3397,47 @@ SWITCH_STANDARD_API(cc_config_api_function)
 				const char *status = NULL;
 				const char *state = NULL;
 				struct list_result cbt;
+				cc_acd_queue_t *acd_queue;
+				cc_acd_member_t *member;
+				cc_acd_tier_t *tier;
+				switch_time_t now = local_epoch_time_now(NULL);
 
-				/* queue list agents */
-				if (sub_action && !strcasecmp(sub_action, "agents")) {
-					if (argc-initial_argc > 2) {
-						status = argv[2 + initial_argc];
-					}
-					if (argc-initial_argc > 3) {
-						state = argv[3 + initial_argc];
-					}
-					if (state)	{
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q' AND agents.state = '%q'", queue_name, status, state);
-					}
-					else if (status)	{
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q'", queue_name, status);
-					} else {
-						sql = switch_mprintf("SELECT agents.* FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q'", queue_name);
-					}
-				/* queue list members */
-				} else if (sub_action && !strcasecmp(sub_action, "members")) {
-					sql = switch_mprintf("SELECT  *,(%" SWITCH_TIME_T_FMT "-joined_epoch)+base_score+skill_score AS score FROM members WHERE queue = '%q' ORDER BY score DESC;", local_epoch_time_now(NULL), queue_name);
-				/* queue list tiers */
-				} else if (sub_action && !strcasecmp(sub_action, "tiers")) {
-					sql = switch_mprintf("SELECT * FROM tiers WHERE queue = '%q';", queue_name);
-				} else {
+				if (argc-initial_argc > 2) {
+					status = argv[2 + initial_argc];
+				}
+				if (argc-initial_argc > 3) {
+					state = argv[3 + initial_argc];
+				}
+				if (!sub_action || (strcasecmp(sub_action, "agents") && strcasecmp(sub_action, "members") && strcasecmp(sub_action, "tiers"))) {
 					stream->write_function(stream, "%s", "-ERR Invalid!\n");
 					goto done;
 				}
 
 				cbt.row_process = 0;
 				cbt.stream = stream;
-				cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, list_result_callback, &cbt /* Call back variables */);
-				switch_safe_free(sql);
+				cc_acd_lock(globals.acd);
+				acd_queue = queue_name ? cc_acd_queue_find(globals.acd, queue_name, SWITCH_FALSE) : NULL;
+				/* queue list agents */
+				if (!strcasecmp(sub_action, "agents")) {
+					for (tier = acd_queue ? acd_queue->tiers : NULL; tier; tier = tier->queue_next) {
+						if (queue_agent_match(tier->agent, status, state)) {
+							list_agent(&cbt, tier->agent);
+						}
+					}
+				/* queue list members */
+				} else if (!strcasecmp(sub_action, "members")) {
+					for (member = acd_queue ? globals.acd->members : NULL; member; member = member->next) {
+						if (!strcmp(member->queue, queue_name)) {
+							list_member(&cbt, member, now);
+						}
+					}
+				/* queue list tiers */
+				} else {
+					for (tier = acd_queue ? acd_queue->tiers : NULL; tier; tier = tier->queue_next) {
+						list_tier(&cbt, tier);
+					}
+				}
+				cc_acd_unlock(globals.acd);
 				stream->write_function(stream, "%s", "+OK\n");
 			}
 
@@ -3370,38 +3458,42 @@ SWITCH_STANDARD_API(cc_config_api_function)
 				const char *queue_name = argv[1 + initial_argc];
 				const char *status = NULL;
 				const char *state = NULL;
-				char res[256] = "";
+				cc_acd_queue_t *acd_queue;
+				cc_acd_member_t *member;
+				cc_acd_tier_t *tier;
+				int count = 0;
 
+				if (argc-initial_argc > 2) {
+					status = argv[2 + initial_argc];
+				}
+				if (argc-initial_argc > 3) {
+					state = argv[3 + initial_argc];
+				}
+				if (!sub_action || (strcasecmp(sub_action, "agents") && strcasecmp(sub_action, "members") && strcasecmp(sub_action, "tiers"))) {
+					stream->write_function(stream, "%s", "-ERR Invalid!\n");
+					goto done;
+				}
+
+				cc_acd_lock(globals.acd);
+				acd_queue = queue_name ? cc_acd_queue_find(globals.acd, queue_name, SWITCH_FALSE) : NULL;
 				/* queue count agents */
-				if (sub_action && !strcasecmp(sub_action, "agents")) {
-					if (argc-initial_argc > 2) {
-						status = argv[2 + initial_argc];
-					}
-					if (argc-initial_argc > 3) {
-						state = argv[3 + initial_argc];
-					}
-					if (state)	{
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q' AND agents.state = '%q'", queue_name, status, state);
-					}
-					else if (status)	{
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q' AND agents.status = '%q'", queue_name, status);
-					} else {
-						sql = switch_mprintf("SELECT count(*) FROM agents,tiers WHERE tiers.agent = agents.name AND tiers.queue = '%q'", queue_name);
+				if (!strcasecmp(sub_action, "agents")) {
+					for (tier = acd_queue ? acd_queue->tiers : NULL; tier; tier = tier->queue_next) {
+						count += queue_agent_match(tier->agent, status, state) ? 1 : 0;
 					}
 				/* queue count members */
-				} else if (sub_action && !strcasecmp(sub_action, "members")) {
-					sql = switch_mprintf("SELECT count(*) FROM members WHERE queue = '%q';", queue_name);
+				} else if (!strcasecmp(sub_action, "members")) {
+					for (member = acd_queue ? globals.acd->members : NULL; member; member = member->next) {
+						count += strcmp(member->queue, queue_name) ? 0 : 1;
+					}
 				/* queue count tiers */
-				} else if (sub_action && !strcasecmp(sub_action, "tiers")) {
-					sql = switch_mprintf("SELECT count(*) FROM tiers WHERE queue = '%q';", queue_name);
 				} else {
-					stream->write_function(stream, "%s", "-ERR Invalid!\n");
-					goto done;
+					for (tier = acd_queue ? acd_queue->tiers : NULL; tier; tier = tier->queue_next) {
+						count++;
+					}
 				}
-
-				cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-				switch_safe_free(sql);
-				stream->write_function(stream, "%d\n", atoi(res));
+				cc_acd_unlock(globals.acd);
+				stream->write_function(stream, "%d\n", count);
 			}
 		}
 	}
@@ -3426,8 +3518,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_callcenter_load)
 
 	switch_core_hash_init(&globals.queue_hash);
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
+	switch_queue_create(&globals.sql_queue, CC_SQL_QUEUE_LEN, globals.pool);
+
+	if ((status = cc_acd_create(&globals.acd)) != SWITCH_STATUS_SUCCESS) {
+		return status;
+	}
 
 	if ((status = load_config()) != SWITCH_STATUS_SUCCESS) {
+		cc_acd_destroy(&globals.acd);
 		return status;
 	}
 
@@ -3435,6 +3533,16 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_callcenter_load)
 	globals.running = 1;
 	switch_mutex_unlock(globals.mutex);
 
+	if (globals.persist) {
+		switch_thread_t *thread;
+		switch_threadattr_t *thd_attr = NULL;
+
+		switch_threadattr_create(&thd_attr, globals.pool);
+		switch_threadattr_detach_set(thd_attr, 1);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_thread_create(&thread, thd_attr, cc_db_writer_thread_run, NULL, globals.pool);
+	}
+
 	/* connect my internal structure to the blank pointer passed to me */
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 
@@ -3494,6 +3602,10 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown)
 	const void *key;
 	switch_ssize_t keylen;
 	int sanity = 0;
+	void *pop = NULL;
+	switch_stream_handle_t stream = { 0 };
+	char *batch[CC_SQL_BATCH];
+	int count = 0;
 
 	switch_mutex_lock(globals.mutex);
 	if (globals.running == 1) {
@@ -3508,6 +3620,21 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown)
 		}
 	}
 
+	/* Whatever the db writer did not get to yet */
+	SWITCH_STANDARD_STREAM(stream);
+	while (switch_queue_trypop(globals.sql_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		cc_persist_batch(&stream, (char *) pop);
+		batch[count++] = (char *) pop;
+		if (count == CC_SQL_BATCH) {
+			cc_persist_flush(&stream, batch, count);
+			count = 0;
+		}
+	}
+	cc_persist_flush(&stream, batch, count);
+	switch_safe_free(stream.data);
+
+	cc_acd_destroy(&globals.acd);
+
 	switch_mutex_lock(globals.mutex);
 	while ((hi = switch_core_hash_first_iter( globals.queue_hash, hi))) {
 		switch_core_hash_this(hi, &key, &keylen, &val);
@@ -2101,6 +2101,9 @@ SWITCH_STANDARD_API(status_function)
 	char * nl = "\n";					/* shortcut to format.nl	*/
 	stream_format format = { 0 };
 	switch_size_t cur = 0, max = 0;
+	switch_event_alloc_stats_t event_stats = { 0 };
+	switch_regex_cache_stats_t regex_stats = { 0 };
+	switch_rtp_io_stats_t rtp_io_stats = { 0 };
 
 	set_format(&format, stream);
 
@@ -2151,6 +2154,38 @@ SWITCH_STANDARD_API(status_function)
 	stream->write_function(stream, "%d session(s) max%s", switch_core_session_limit(0), nl);
 	stream->write_function(stream, "min idle cpu %0.2f/%0.2f%s", switch_core_min_idle_cpu(-1.0), switch_core_idle_cpu(), nl);
 
+	switch_event_get_alloc_stats(&event_stats);
+	stream->write_function(stream, "Event allocator: %" SWITCH_UINT64_T_FMT " event(s) / %" SWITCH_UINT64_T_FMT " header(s) allocated, "
+						   "%u / %u idle in shared cache, %u thread cache(s)%s",
+						   event_stats.events_allocated - event_stats.events_freed, event_stats.headers_allocated - event_stats.headers_freed,
+						   event_stats.events_cached, event_stats.headers_cached, event_stats.thread_caches, nl);
+
+	switch_regex_cache_get_stats(&regex_stats);
+	stream->write_function(stream, "Regex cache: %u/%u expression(s), %" SWITCH_UINT64_T_FMT " hit(s), %" SWITCH_UINT64_T_FMT " miss(es), %"
+						   SWITCH_UINT64_T_FMT " eviction(s)%s", regex_stats.entries, regex_stats.size, regex_stats.hits, regex_stats.misses,
+						   regex_stats.evictions, nl);
+
+	switch_rtp_get_io_stats(&rtp_io_stats);
+	stream->write_function(stream, "RTP I/O: %u reactor thread(s) on %u socket(s), %" SWITCH_UINT64_T_FMT " packet(s) in %" SWITCH_UINT64_T_FMT
+						   " read(s) (%.1f avg), %" SWITCH_UINT64_T_FMT " dropped, %" SWITCH_UINT64_T_FMT " packet(s) in %" SWITCH_UINT64_T_FMT
+						   " batched write(s) (%.1f avg)%s", rtp_io_stats.reactor_threads, rtp_io_stats.reactor_sockets, rtp_io_stats.recv_packets,
+						   rtp_io_stats.recv_calls, rtp_io_stats.recv_calls ? (double) rtp_io_stats.recv_packets / rtp_io_stats.recv_calls : 0.0,
+						   rtp_io_stats.recv_dropped, rtp_io_stats.send_packets, rtp_io_stats.send_calls,
+						   rtp_io_stats.send_calls ? (double) rtp_io_stats.send_packets / rtp_io_stats.send_calls : 0.0, nl);
+	if (rtp_io_stats.shared_sockets) {
+		stream->write_function(stream, "RTP shared port: %u socket(s), %" SWITCH_UINT64_T_FMT " unrouted packet(s)%s",
+							   rtp_io_stats.shared_sockets, rtp_io_stats.shared_unrouted, nl);
+	}
+	if (rtp_io_stats.relays || rtp_io_stats.relay_packets) {
+		stream->write_function(stream, "RTP relay: %u session pair(s), %" SWITCH_UINT64_T_FMT " packet(s) forwarded%s",
+							   rtp_io_stats.relays, rtp_io_stats.relay_packets, nl);
+	}
+	if (rtp_io_stats.srtp_batches) {
+		stream->write_function(stream, "RTP SRTP batches: %" SWITCH_UINT64_T_FMT " packet(s) protected in %" SWITCH_UINT64_T_FMT " pass(es) (%.1f avg)%s",
+							   rtp_io_stats.srtp_batch_packets, rtp_io_stats.srtp_batches,
+							   (double) rtp_io_stats.srtp_batch_packets / rtp_io_stats.srtp_batches, nl);
+	}
+
 	if (switch_core_get_stacksizes(&cur, &max) == SWITCH_STATUS_SUCCESS) {		stream->write_function(stream, "Current Stack Size/Max %ldK/%ldK\n", cur / 1024, max / 1024);
 	}
 	return SWITCH_STATUS_SUCCESS;
@@ -2192,7 +2227,7 @@ SWITCH_STANDARD_API(uptime_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define CTL_SYNTAX "[recover|send_sighup|hupall|pause [inbound|outbound]|resume [inbound|outbound]|shutdown [cancel|elegant|asap|now|restart]|sps|sps_peak_reset|sync_clock|sync_clock_when_idle|reclaim_mem|max_sessions|min_dtmf_duration [num]|max_dtmf_duration [num]|default_dtmf_duration [num]|min_idle_cpu|loglevel [level]|debug_level [level]]"
+#define CTL_SYNTAX "[recover|send_sighup|hupall|pause [inbound|outbound]|resume [inbound|outbound]|shutdown [cancel|elegant|asap|now|restart]|sps|sps_peak_reset|sync_clock|sync_clock_when_idle|reclaim_mem|max_sessions|min_dtmf_duration [num]|max_dtmf_duration [num]|default_dtmf_duration [num]|min_idle_cpu|loglevel [level]|debug_level [level]|event_bindings [reset]|event_dispatch]"
 SWITCH_STANDARD_API(ctl_function)
 {
 	int argc;
@@ -2336,6 +2371,12 @@ SWITCH_STANDARD_API(ctl_function)
 		} else if (!strcasecmp(argv[0], "debug_pool")) {
 			switch_core_session_debug_pool(stream);
 
+		} else if (!strcasecmp(argv[0], "event_bindings")) {
+			switch_event_binding_status(stream, (argv[1] && !strcasecmp(argv[1], "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+
+		} else if (!strcasecmp(argv[0], "event_dispatch")) {
+			switch_event_dispatch_status(stream);
+
 		} else if (!strcasecmp(argv[0], "debug_sql")) {
 			int x = 0;
 			switch_core_session_ctl(SCSC_DEBUG_SQL, &x);
@@ -4978,6 +5019,10 @@ struct holder {
 	int rows;
 	int justcount;
 	stream_format *format;
+	int indexed;
+	switch_channel_index_view_t view;
+	const char *match;
+	switch_bool_t bridged_only;
 };
 
 static int show_as_json_callback(void *pArg, int argc, char **argv, char **columnNames)
@@ -5130,6 +5175,23 @@ static int show_callback(void *pArg, int argc, char **argv, char **columnNames)
 	return 0;
 }
 
+/* The channel and call listings are served from the core channel index, everything else from the core db */
+static void show_execute_sql_callback(switch_cache_db_handle_t *db, const char *sql, switch_core_db_callback_func_t callback, struct holder *holder, char **errmsg)
+{
+	if (!holder->indexed) {
+		switch_cache_db_execute_sql_callback(db, sql, callback, holder, errmsg);
+	} else if (holder->justcount) {
+		char count[32];
+		char *argv[1] = { count };
+		char *names[1] = { "count" };
+
+		switch_snprintf(count, sizeof(count), "%u", switch_core_channel_index_count(holder->view));
+		callback(holder, 1, argv, names);
+	} else {
+		switch_core_channel_index_walk(holder->view, holder->match, holder->bridged_only, callback, holder);
+	}
+}
+
 #define COMPLETE_SYNTAX "add <word>|del [<word>|*]"
 SWITCH_STANDARD_API(complete_function)
 {
@@ -5190,9 +5252,9 @@ SWITCH_STANDARD_API(coalesce_function)
 #define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|calls|detailed_calls|bridged_calls|detailed_bridged_calls|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits|status"
 SWITCH_STANDARD_API(show_function)
 {
-	char sql[1024];
-	char *errmsg;
-	switch_cache_db_handle_t *db;
+	char sql[1024] = "";
+	char *errmsg = NULL;
+	switch_cache_db_handle_t *db = NULL;
 	struct holder holder = { 0 };
 	int help = 0;
 	char *mydata = NULL, *argv[6] = { 0 };
@@ -5207,16 +5269,6 @@ SWITCH_STANDARD_API(show_function)
 	set_format(holder.format, stream);
 	html = holder.format->html; /* html is just a shortcut */
 
-	if (!(cflags & SCF_USE_SQL)) {
-		stream->write_function(stream, "-ERR SQL disabled, no data available!\n");
-		return SWITCH_STATUS_SUCCESS;
-	}
-
-	if (switch_core_db_handle(&db) != SWITCH_STATUS_SUCCESS) {
-		stream->write_function(stream, "%s", "-ERR Database error!\n");
-		return SWITCH_STATUS_SUCCESS;
-	}
-
 	holder.justcount = 0;
 
 	if (cmd && *cmd && (mydata = strdup(cmd))) {
@@ -5316,9 +5368,9 @@ SWITCH_STANDARD_API(show_function)
 		}
 
 		if (!strcasecmp(command, "calls")) {
-			sprintf(sql, "select * from basic_calls where hostname='%s' order by call_created_epoch", switch_core_get_switchname());
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_BASIC_CALLS;
 			if (argv[1] && !strcasecmp(argv[1], "count")) {
-				sprintf(sql, "select count(*) from basic_calls where hostname='%s'", switch_core_get_switchname());
 				holder.justcount = 1;
 				if (argv[3] && !strcasecmp(argv[2], "as")) {
 					as = argv[3];
@@ -5334,49 +5386,40 @@ SWITCH_STANDARD_API(show_function)
 				}
 			}
 		} else if (!strcasecmp(command, "channels") && argv[1] && !strcasecmp(argv[1], "like")) {
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_CHANNELS;
 			if (argv[2]) {
-				char *p;
-				for (p = argv[2]; p && *p; p++) {
-					if (*p == '\'' || *p == ';') {
-						*p = ' ';
-					}
-				}
-				if (strchr(argv[2], '%')) {
-					sprintf(sql,
-						"select * from channels where hostname='%s' and uuid like '%s' or name like '%s' or cid_name like '%s' or cid_num like '%s' or presence_data like '%s' order by created_epoch",
-						switch_core_get_switchname(), argv[2], argv[2], argv[2], argv[2], argv[2]);
-				} else {
-					sprintf(sql,
-						"select * from channels where hostname='%s' and uuid like '%%%s%%' or name like '%%%s%%' or cid_name like '%%%s%%' or cid_num like '%%%s%%' or presence_data like '%%%s%%' order by created_epoch",
-						switch_core_get_switchname(), argv[2], argv[2], argv[2], argv[2], argv[2]);
-				}
+				holder.match = argv[2];
 				if (argv[4] && !strcasecmp(argv[3], "as")) {
 					as = argv[4];
 				}
-			} else {
-				sprintf(sql, "select * from channels where hostname='%s' order by created_epoch", switch_core_get_switchname());
 			}
 		} else if (!strcasecmp(command, "channels")) {
-			sprintf(sql, "select * from channels where hostname='%s' order by created_epoch", switch_core_get_switchname());
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_CHANNELS;
 			if (argv[1] && !strcasecmp(argv[1], "count")) {
-				sprintf(sql, "select count(*) from channels where hostname='%s'", switch_core_get_switchname());
 				holder.justcount = 1;
 				if (argv[3] && !strcasecmp(argv[2], "as")) {
 					as = argv[3];
 				}
 			}
 		} else if (!strcasecmp(command, "detailed_calls")) {
-			sprintf(sql, "select * from detailed_calls where hostname='%s' order by created_epoch", switch_core_get_switchname());
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_DETAILED_CALLS;
 			if (argv[2] && !strcasecmp(argv[1], "as")) {
 				as = argv[2];
 			}
 		} else if (!strcasecmp(command, "bridged_calls")) {
-			sprintf(sql, "select * from basic_calls where b_uuid is not null and hostname='%s' order by created_epoch", switch_core_get_switchname());
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_BASIC_CALLS;
+			holder.bridged_only = SWITCH_TRUE;
 			if (argv[2] && !strcasecmp(argv[1], "as")) {
 				as = argv[2];
 			}
 		} else if (!strcasecmp(command, "detailed_bridged_calls")) {
-			sprintf(sql, "select * from detailed_calls where b_uuid is not null and hostname='%s' order by created_epoch", switch_core_get_switchname());
+			holder.indexed = 1;
+			holder.view = SCI_VIEW_DETAILED_CALLS;
+			holder.bridged_only = SWITCH_TRUE;
 			if (argv[2] && !strcasecmp(argv[1], "as")) {
 				as = argv[2];
 			}
@@ -5387,6 +5430,18 @@ SWITCH_STANDARD_API(show_function)
 		}
 	}
 
+	if (!holder.indexed) {
+		if (!(cflags & SCF_USE_SQL)) {
+			stream->write_function(stream, "-ERR SQL disabled, no data available!\n");
+			goto end;
+		}
+
+		if (switch_core_db_handle(&db) != SWITCH_STATUS_SUCCESS) {
+			stream->write_function(stream, "%s", "-ERR Database error!\n");
+			goto end;
+		}
+	}
+
 	holder.stream = stream;
 	holder.count = 0;
 
@@ -5413,7 +5468,7 @@ SWITCH_STANDARD_API(show_function)
 				holder.delim = ",";
 			}
 		}
-		switch_cache_db_execute_sql_callback(db, sql, show_callback, &holder, &errmsg);
+		show_execute_sql_callback(db, sql, show_callback, &holder, &errmsg);
 		if (html) {
 			holder.stream->write_function(holder.stream, "</table>");
 		}
@@ -5429,7 +5484,7 @@ SWITCH_STANDARD_API(show_function)
 			stream->write_function(stream, "%s%u total.%s", nl, holder.count, nl);
 		}
 	} else if (!strcasecmp(as, "xml")) {
-		switch_cache_db_execute_sql_callback(db, sql, show_as_xml_callback, &holder, &errmsg);
+		show_execute_sql_callback(db, sql, show_as_xml_callback, &holder, &errmsg);
 
 		if (errmsg) {
 			stream->write_function(stream, "-ERR SQL error [%s]\n", errmsg);
@@ -5457,7 +5512,7 @@ SWITCH_STANDARD_API(show_function)
 		}
 	} else if (!strcasecmp(as, "json")) {
 
-		switch_cache_db_execute_sql_callback(db, sql, show_as_json_callback, &holder, &errmsg);
+		show_execute_sql_callback(db, sql, show_as_json_callback, &holder, &errmsg);
 
 		if (errmsg) {
 			stream->write_function(stream, "-ERR SQL Error [%s]\n", errmsg);
@@ -7132,6 +7187,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	switch_console_set_complete("add db_cache status");
 	switch_console_set_complete("add fsctl debug_level");
 	switch_console_set_complete("add fsctl debug_pool");
+	switch_console_set_complete("add fsctl event_bindings");
+	switch_console_set_complete("add fsctl event_bindings reset");
+	switch_console_set_complete("add fsctl event_dispatch");
 	switch_console_set_complete("add fsctl debug_sql");
 	switch_console_set_complete("add fsctl last_sps");
 	switch_console_set_complete("add fsctl default_dtmf_duration");
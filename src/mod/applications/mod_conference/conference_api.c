@@ -103,7 +103,8 @@ api_command_t conference_api_sub_commands[] = {
 	{"vid-write-png", (void_fn_t) & conference_api_sub_write_png, CONF_API_SUB_ARGS_SPLIT, "vid-write-png", "<path>"},
 	{"vid-fps", (void_fn_t) & conference_api_sub_vid_fps, CONF_API_SUB_ARGS_SPLIT, "vid-fps", "<fps>"},
 	{"vid-bgimg", (void_fn_t) & conference_api_sub_canvas_bgimg, CONF_API_SUB_ARGS_SPLIT, "vid-bgimg", "<file> | clear [<canvas-id>]"},
-	{"vid-bandwidth", (void_fn_t) & conference_api_sub_vid_bandwidth, CONF_API_SUB_ARGS_SPLIT, "vid-bandwidth", "<BW>"}
+	{"vid-bandwidth", (void_fn_t) & conference_api_sub_vid_bandwidth, CONF_API_SUB_ARGS_SPLIT, "vid-bandwidth", "<BW>"},
+	{"vid-stats", (void_fn_t) & conference_api_sub_vid_stats, CONF_API_SUB_ARGS_SPLIT, "vid-stats", "[reset]"}
 };
 
 switch_status_t conference_api_sub_pause_play(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
@@ -1101,6 +1102,37 @@ switch_status_t conference_api_sub_vid_fps(conference_obj_t *conference, switch_
 
 }
 
+switch_status_t conference_api_sub_vid_stats(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	int i;
+	switch_bool_t reset = argv[2] && !strcasecmp(argv[2], "reset");
+
+	if (!conference->canvas_count) {
+		stream->write_function(stream, "Conference is not in mixing mode\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	for (i = 0; i < conference->canvas_count; i++) {
+		mcu_canvas_t *canvas = conference->canvases[i];
+
+		if (!canvas) continue;
+
+		stream->write_function(stream, "Canvas %d: %d layers, %u frames, compose last %" SWITCH_TIME_T_FMT "us avg %" SWITCH_TIME_T_FMT
+							   "us max %" SWITCH_TIME_T_FMT "us, frame budget %dus\n",
+							   i + 1, canvas->layers_used, canvas->composite_frames, canvas->composite_usec,
+							   canvas->composite_frames ? canvas->composite_usec_total / canvas->composite_frames : 0,
+							   canvas->composite_usec_max, conference->video_fps.ms * 1000);
+
+		if (reset) {
+			canvas->composite_frames = 0;
+			canvas->composite_usec_total = 0;
+			canvas->composite_usec_max = 0;
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 switch_status_t conference_api_sub_write_png(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
 {
 	switch_status_t status = SWITCH_STATUS_FALSE;
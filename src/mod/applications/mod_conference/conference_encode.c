@@ -0,0 +1,259 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Neal Horman <neal at wanlink dot com>
+ * Bret McDanel <trixter at 0xdecafbad dot com>
+ * Dale Thatcher <freeswitch at dalethatcher dot com>
+ * Chris Danielson <chris at maxpowersoft dot com>
+ * Rupa Schomaker <rupa@rupa.com>
+ * David Weekly <david@weekly.org>
+ * Joao Mesquita <jmesquita@gmail.com>
+ * Raymond Chandler <intralanman@freeswitch.org>
+ * Seven Du <dujinfang@gmail.com>
+ * Emmanuel Schmidbauer <e.schmidbauer@gmail.com>
+ * William King <william.king@quentustech.com>
+ *
+ * mod_conference.c -- Software Conference Bridge
+ *
+ */
+#include <mod_conference.h>
+
+/* Any audio codec with an encoder of its own can be shared. Stateful ones (Opus, G.722) are safe because a member stays
+   pinned to its group encoder until it talks or changes state, and the group encoder is fed every interval it has
+   members and starts over when it has sat one out */
+switch_bool_t conference_encode_shareable(const switch_codec_implementation_t *impl)
+{
+	if (!impl || zstr(impl->iananame) || impl->codec_type != SWITCH_CODEC_TYPE_AUDIO || !impl->encode) {
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+/* Find or set up the group for a write codec, index is the group it was in last interval or -1; returns -1 if it cannot share */
+int conference_encode_find_group(conference_obj_t *conference, conference_audio_codec_groups_t *groups, switch_codec_t *check_codec, int index)
+{
+	const switch_codec_implementation_t *impl = check_codec->implementation;
+	int i;
+
+	if (index > -1 && groups->write_codecs[index] && groups->write_codecs[index]->codec.implementation == impl) {
+		return index;
+	}
+
+	if (!conference_encode_shareable(impl) ||
+		impl->actual_samples_per_second != conference->rate || impl->microseconds_per_packet != conference->interval * 1000 ||
+		impl->number_of_channels != conference->channels || switch_test_flag(check_codec, SWITCH_CODEC_FLAG_PASSTHROUGH)) {
+		return -1;
+	}
+
+	for (i = 0; i < MAX_MUX_CODECS && groups->write_codecs[i] && switch_core_codec_ready(&groups->write_codecs[i]->codec); i++) {
+		if (groups->write_codecs[i]->codec.implementation == impl &&
+			!strcmp(switch_str_nil(groups->write_codecs[i]->codec.fmtp_in), switch_str_nil(check_codec->fmtp_in))) {
+			return i;
+		}
+	}
+
+	if (i == MAX_MUX_CODECS) {
+		return -1;
+	}
+
+	if (!groups->write_codecs[i]) {
+		groups->write_codecs[i] = switch_core_alloc(conference->pool, sizeof(codec_set_t));
+		groups->write_codecs[i]->packet = switch_core_alloc(conference->pool, SWITCH_RECOMMENDED_BUFFER_SIZE);
+	}
+
+	if (switch_core_codec_copy(check_codec, &groups->write_codecs[i]->codec, NULL, conference->pool) != SWITCH_STATUS_SUCCESS) {
+		return -1;
+	}
+
+	groups->stale[i] = 0;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Setting up audio write codec %s at slot %d\n", impl->iananame, i);
+
+	return i;
+}
+
+/* Pin a member that will hear the plain mix this interval to its codec group, once it has been a plain listener for
+   CONF_ENCODE_JOIN_INTERVALS in a row so a pause in its speech does not bounce it between encoders; returns the group or -1 */
+int conference_encode_join_group(conference_member_t *member, conference_audio_codec_groups_t *groups, switch_codec_t *check_codec)
+{
+	if (member->audio_codec_index < 0 && member->audio_codec_wait < CONF_ENCODE_JOIN_INTERVALS) {
+		member->audio_codec_wait++;
+		return -1;
+	}
+
+	if ((member->audio_codec_index = conference_encode_find_group(member->conference, groups, check_codec, member->audio_codec_index)) < 0) {
+		member->audio_codec_wait = 0;
+	}
+
+	return member->audio_codec_index;
+}
+
+/* The member talks or changed state and needs its own encode from this interval on */
+void conference_encode_leave_group(conference_member_t *member)
+{
+	member->audio_codec_index = -1;
+	member->audio_codec_wait = 0;
+}
+
+/* Start an interval; a group nobody was pinned to last interval did not encode it, so its encoder is stale */
+void conference_encode_next_interval(conference_audio_codec_groups_t *groups)
+{
+	int i;
+
+	for (i = 0; i < MAX_MUX_CODECS; i++) {
+		if (groups->write_codecs[i] && !groups->encoded[i]) {
+			groups->stale[i] = 1;
+		}
+	}
+
+	memset(groups->members, 0, sizeof(groups->members));
+	memset(groups->encoded, 0, sizeof(groups->encoded));
+}
+
+/* Encoded frame of the plain mix for a member pinned to a group, encoding it once per interval for the whole group */
+codec_set_t *conference_encode_shared(conference_member_t *member, conference_audio_codec_groups_t *groups, int16_t *data, uint32_t bytes)
+{
+	conference_obj_t *conference = member->conference;
+	codec_set_t *codec_set;
+	uint32_t rate = conference->rate, flag = 0;
+	int i = member->audio_codec_index;
+
+	if (!conference_utils_test_flag(conference, CFLAG_MINIMIZE_AUDIO_ENCODING) || conference->relationship_total ||
+		i < 0 || !groups->write_codecs[i] || conference_utils_member_test_flag(member, MFLAG_HAS_AUDIO)) {
+		return NULL;
+	}
+
+	codec_set = groups->write_codecs[i];
+
+	if (!groups->encoded[i]) {
+		groups->encoded[i] = 1;
+
+		if (groups->stale[i]) {
+			switch_core_codec_reset(&codec_set->codec);
+			groups->stale[i] = 0;
+		}
+
+		codec_set->frame.data = codec_set->packet;
+		codec_set->frame.datalen = SWITCH_RECOMMENDED_BUFFER_SIZE;
+
+		if (switch_core_codec_encode(&codec_set->codec, NULL, data, bytes, conference->rate,
+									 codec_set->frame.data, &codec_set->frame.datalen, &rate, &flag) != SWITCH_STATUS_SUCCESS) {
+			codec_set->frame.datalen = 0;
+		}
+	}
+
+	return codec_set->frame.datalen ? codec_set : NULL;
+}
+
+/* Queue a frame of the mix to a member for conference_loop_output: its group's encoding when it has one, the PCM otherwise */
+switch_size_t conference_encode_write_mux(conference_member_t *member, int16_t *data, uint32_t bytes, codec_set_t *codec_set)
+{
+	conference_encoded_frame_t hdr = { 0 };
+	switch_size_t ok;
+
+	switch_mutex_lock(member->audio_out_mutex);
+
+	if (codec_set && member->encoded_buffer) {
+		hdr.implementation = codec_set->codec.implementation;
+		hdr.datalen = codec_set->frame.datalen;
+
+		if (switch_buffer_write(member->encoded_buffer, &hdr, sizeof(hdr)) && switch_buffer_write(member->encoded_buffer, codec_set->frame.data, hdr.datalen)) {
+			member->encoded_frames++;
+		} else {
+			/* a torn record would misalign every one after it, start over */
+			conference_utils_member_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+		}
+
+		member->encoded_last = SWITCH_TRUE;
+		ok = bytes;
+	} else {
+		ok = switch_buffer_write(member->mux_buffer, data, bytes);
+		member->encoded_last = SWITCH_FALSE;
+	}
+
+	switch_mutex_unlock(member->audio_out_mutex);
+
+	return ok;
+}
+
+/* Read the next encoded frame if it is the member's next frame, returns its length or 0 when the PCM in mux_buffer goes
+   first; frames queued before the conference moved the member between buffers are older than the ones after, so the
+   buffer it is not using now is drained first. Must be called with audio_out_mutex held */
+uint32_t conference_encode_read(conference_member_t *member, const switch_codec_implementation_t **implementation, void *data, uint32_t datalen, uint32_t bytes)
+{
+	conference_encoded_frame_t hdr = { 0 };
+
+	if (!member->encoded_buffer || !member->encoded_frames || (member->encoded_last && switch_buffer_inuse(member->mux_buffer) >= bytes)) {
+		return 0;
+	}
+
+	member->encoded_frames--;
+
+	if (switch_buffer_read(member->encoded_buffer, &hdr, sizeof(hdr)) != sizeof(hdr) || !hdr.datalen ||
+		hdr.datalen > datalen || switch_buffer_read(member->encoded_buffer, data, hdr.datalen) != hdr.datalen) {
+		conference_utils_member_set_flag_locked(member, MFLAG_FLUSH_BUFFER);
+		return 0;
+	}
+
+	*implementation = hdr.implementation;
+
+	return hdr.datalen;
+}
+
+/* Drop everything queued to a member, must be called with audio_out_mutex held */
+void conference_encode_flush(conference_member_t *member)
+{
+	switch_buffer_zero(member->mux_buffer);
+
+	if (member->encoded_buffer) {
+		switch_buffer_zero(member->encoded_buffer);
+	}
+
+	member->encoded_frames = 0;
+}
+
+void conference_encode_destroy_groups(conference_audio_codec_groups_t *groups)
+{
+	int i;
+
+	for (i = 0; i < MAX_MUX_CODECS; i++) {
+		if (groups->write_codecs[i] && switch_core_codec_ready(&groups->write_codecs[i]->codec)) {
+			switch_core_codec_destroy(&groups->write_codecs[i]->codec);
+		}
+	}
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -1051,8 +1051,8 @@ void conference_loop_launch_input(conference_member_t *member, switch_memory_poo
 void conference_loop_output(conference_member_t *member)
 {
 	switch_channel_t *channel;
-	switch_frame_t write_frame = { 0 };
-	uint8_t *data = NULL;
+	switch_frame_t write_frame = { 0 }, encoded_frame = { 0 };
+	uint8_t *data = NULL, *encoded_data = NULL;
 	switch_timer_t timer = { 0 };
 	uint32_t interval;
 	uint32_t samples;
@@ -1062,6 +1062,8 @@ void conference_loop_output(conference_member_t *member)
 	uint32_t low_count, bytes;
 	call_list_t *call_list, *cp;
 	switch_codec_implementation_t read_impl = { 0 };
+	const switch_codec_implementation_t *encoded_impl = NULL;
+	switch_bool_t sent_encoded = SWITCH_FALSE;
 	int sanity;
 	switch_status_t st;
 
@@ -1096,6 +1098,8 @@ void conference_loop_output(conference_member_t *member)
 	write_frame.data = data = switch_core_session_alloc(member->session, SWITCH_RECOMMENDED_BUFFER_SIZE);
 	write_frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
 
+	encoded_frame.data = encoded_data = switch_core_session_alloc(member->session, SWITCH_RECOMMENDED_BUFFER_SIZE);
+	encoded_frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
 
 	write_frame.codec = &member->write_codec;
 
@@ -1251,7 +1255,8 @@ void conference_loop_output(conference_member_t *member)
 		}
 
 		use_buffer = NULL;
-		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer);
+		/* frames the conference encoded for us stand in for a frame of PCM each */
+		mux_used = (uint32_t) switch_buffer_inuse(member->mux_buffer) + member->encoded_frames * bytes;
 
 		use_timer = 1;
 
@@ -1276,28 +1281,67 @@ void conference_loop_output(conference_member_t *member)
 			use_buffer = member->mux_buffer;
 			low_count = 0;
 
-			if ((write_frame.datalen = (uint32_t) switch_buffer_read(use_buffer, write_frame.data, bytes))) {
-				if (write_frame.datalen) {
-					write_frame.samples = write_frame.datalen / 2 / member->conference->channels;
-
-					if( !conference_utils_member_test_flag(member, MFLAG_CAN_HEAR)) {
-						memset(write_frame.data, 255, write_frame.datalen);
-					} else if (member->volume_out_level) { /* Check for output volume adjustments */
-						switch_change_sln_volume(write_frame.data, write_frame.samples * member->conference->channels, member->volume_out_level);
+			if ((encoded_frame.datalen = conference_encode_read(member, &encoded_impl, encoded_data, SWITCH_RECOMMENDED_BUFFER_SIZE, bytes))) {
+				switch_codec_t *write_codec;
+
+				/* our codec group's encoder made this frame, send it unless something changed on our side that the
+				   conference has not caught up with yet, in which case silence keeps the stream going until it does */
+				if ((write_codec = switch_core_session_get_write_codec(member->session)) &&
+					write_codec->implementation == encoded_impl && conference_utils_member_test_flag(member, MFLAG_CAN_HEAR) &&
+					!member->volume_out_level && !member->fnode && !switch_core_media_bug_count(member->session, NULL)) {
+					encoded_frame.codec = write_codec;
+					encoded_frame.samples = bytes / 2 / member->conference->channels;
+					encoded_frame.rate = encoded_impl->samples_per_second;
+					encoded_frame.channels = encoded_impl->number_of_channels;
+					encoded_frame.timestamp = timer.samplecount;
+					sent_encoded = SWITCH_TRUE;
+
+					if (switch_core_session_write_frame(member->session, &encoded_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+						switch_mutex_unlock(member->audio_out_mutex);
+						break;
 					}
 
-					write_frame.timestamp = timer.samplecount;
+					write_frame.datalen = 0;
+				} else {
+					memset(write_frame.data, 255, bytes);
+					write_frame.datalen = bytes;
+				}
+			} else {
+				write_frame.datalen = (uint32_t) switch_buffer_read(use_buffer, write_frame.data, bytes);
+			}
+
+			if (write_frame.datalen) {
+				if (sent_encoded) {
+					switch_codec_t *write_codec;
 
-					if (member->fnode) {
-						conference_member_add_file_data(member, write_frame.data, write_frame.datalen);
+					/* our own encoder sat idle while the group's ran, start it over rather than carry on from stale state */
+					switch_core_session_lock_codec_write(member->session);
+					if ((write_codec = switch_core_session_get_write_codec(member->session)) && switch_core_codec_ready(write_codec)) {
+						switch_core_codec_reset(write_codec);
 					}
+					switch_core_session_unlock_codec_write(member->session);
+					sent_encoded = SWITCH_FALSE;
+				}
 
-					conference_member_check_channels(&write_frame, member, SWITCH_FALSE);
+				write_frame.samples = write_frame.datalen / 2 / member->conference->channels;
 
-					if (switch_core_session_write_frame(member->session, &write_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
-						switch_mutex_unlock(member->audio_out_mutex);
-						break;
-					}
+				if( !conference_utils_member_test_flag(member, MFLAG_CAN_HEAR)) {
+					memset(write_frame.data, 255, write_frame.datalen);
+				} else if (member->volume_out_level) { /* Check for output volume adjustments */
+					switch_change_sln_volume(write_frame.data, write_frame.samples * member->conference->channels, member->volume_out_level);
+				}
+
+				write_frame.timestamp = timer.samplecount;
+
+				if (member->fnode) {
+					conference_member_add_file_data(member, write_frame.data, write_frame.datalen);
+				}
+
+				conference_member_check_channels(&write_frame, member, SWITCH_FALSE);
+
+				if (switch_core_session_write_frame(member->session, &write_frame, SWITCH_IO_FLAG_NONE, 0) != SWITCH_STATUS_SUCCESS) {
+					switch_mutex_unlock(member->audio_out_mutex);
+					break;
 				}
 			}
 
@@ -1305,9 +1349,9 @@ void conference_loop_output(conference_member_t *member)
 		}
 
 		if (conference_utils_member_test_flag(member, MFLAG_FLUSH_BUFFER)) {
-			if (switch_buffer_inuse(member->mux_buffer)) {
+			if (switch_buffer_inuse(member->mux_buffer) || member->encoded_frames) {
 				switch_mutex_lock(member->audio_out_mutex);
-				switch_buffer_zero(member->mux_buffer);
+				conference_encode_flush(member);
 				switch_mutex_unlock(member->audio_out_mutex);
 			}
 			conference_utils_member_clear_flag_locked(member, MFLAG_FLUSH_BUFFER);
@@ -465,6 +465,34 @@ void conference_member_check_agc_levels(conference_member_t *member)
 	}
 }
 
+/* Find the codec group of a member that will hear the plain conference mix this interval, or -1 if it needs its own encode */
+int conference_member_audio_codec_group(conference_member_t *member, conference_audio_codec_groups_t *groups)
+{
+	conference_obj_t *conference = member->conference;
+	switch_codec_t *check_codec;
+
+	if (!member->encoded_buffer || !member->session || member->volume_out_level || member->fnode ||
+		!conference_utils_member_test_flag(member, MFLAG_RUNNING) || !conference_utils_member_test_flag(member, MFLAG_CAN_HEAR) ||
+		conference_utils_member_test_flag(member, MFLAG_HAS_AUDIO) || conference_utils_member_test_flag(member, MFLAG_POSITIONAL) ||
+		conference_utils_member_test_flag(member, MFLAG_NO_MINIMIZE_ENCODING) || member->read_impl.number_of_channels != conference->channels) {
+		conference_encode_leave_group(member);
+		return -1;
+	}
+
+	/* media bugs tap or replace the member's own frames, keep anyone with a bug on its own encoder */
+	if (switch_core_media_bug_count(member->session, NULL)) {
+		conference_encode_leave_group(member);
+		return -1;
+	}
+
+	if (!(check_codec = switch_core_session_get_write_codec(member->session)) || !switch_core_codec_ready(check_codec)) {
+		conference_encode_leave_group(member);
+		return -1;
+	}
+
+	return conference_encode_join_group(member, groups, check_codec);
+}
+
 void conference_member_check_channels(switch_frame_t *frame, conference_member_t *member, switch_bool_t in)
 {
 	if (member->conference->channels != member->read_impl.number_of_channels || conference_utils_member_test_flag(member, MFLAG_POSITIONAL)) {
@@ -1689,6 +1717,18 @@ int conference_member_setup_media(conference_member_t *member, conference_obj_t
 		goto codec_done1;
 	}
 
+	/* Shared encodes line up with the mux buffer frame for frame, only possible when our ptime matches the conference */
+	if (conference_utils_test_flag(conference, CFLAG_MINIMIZE_AUDIO_ENCODING) && read_impl.microseconds_per_packet / 1000 == conference->interval) {
+		if (!member->encoded_buffer && switch_buffer_create_dynamic(&member->encoded_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
+			goto codec_done1;
+		}
+		conference_encode_flush(member);
+	} else if (member->encoded_buffer) {
+		conference_encode_flush(member);
+		switch_buffer_destroy(&member->encoded_buffer);
+	}
+
 	switch_mutex_unlock(member->audio_out_mutex);
 
 	return 0;
@@ -2553,6 +2553,14 @@ void *SWITCH_THREAD_FUNC conference_video_muxing_thread_run(switch_thread_t *thr
 			}
 
 			wait_for_canvas(canvas);
+
+			/* time from the tick to a finished canvas, has to stay inside the frame interval */
+			canvas->composite_usec = switch_micro_time_now() - now;
+			canvas->composite_usec_total += canvas->composite_usec;
+			if (canvas->composite_usec > canvas->composite_usec_max) {
+				canvas->composite_usec_max = canvas->composite_usec;
+			}
+			canvas->composite_frames++;
 			
 			if (conference->canvas_count > 1) {
 				switch_image_t *img_copy = NULL;
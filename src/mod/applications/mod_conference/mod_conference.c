@@ -208,6 +208,9 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 	int member_score_sum = 0;
 	int divisor = 0;
 	conference_cdr_node_t *np;
+	conference_audio_codec_groups_t audio_codec_groups = { { 0 } };
+	codec_set_t *codec_set;
+	int i;
 
 	if (!(divisor = conference->rate / 8000)) {
 		divisor = 1;
@@ -338,6 +341,17 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 		conference->members_with_video = members_with_video;
 		conference->members_with_avatar = members_with_avatar;
 
+		/* Group the members that will only hear the mix by write codec so each group is encoded once */
+		conference_encode_next_interval(&audio_codec_groups);
+
+		if (conference_utils_test_flag(conference, CFLAG_MINIMIZE_AUDIO_ENCODING) && !conference->relationship_total) {
+			for (imember = conference->members; imember; imember = imember->next) {
+				if ((i = conference_member_audio_codec_group(imember, &audio_codec_groups)) > -1) {
+					audio_codec_groups.members[i]++;
+				}
+			}
+		}
+
 		if (floor_holder != conference->floor_holder) {
 			conference_member_set_floor_holder(conference, floor_holder);
 		}
@@ -517,10 +531,7 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 					}
 				}
 
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < omember->read / 2; x++) {
-					main_frame[x] += (int32_t) bptr[x];
-				}
+				switch_mix_accumulate_sln(main_frame, (int16_t *) omember->frame, omember->read / 2);
 			}
 
 			if (conference->agc_level && conference->member_loop_count) {
@@ -551,60 +562,72 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 				}
 
 				if (!conference_utils_member_test_flag(omember, MFLAG_CAN_HEAR)) {
-					switch_mutex_lock(omember->audio_out_mutex);
 					memset(write_frame, 255, bytes);
-					ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-					switch_mutex_unlock(omember->audio_out_mutex);
+					ok = conference_encode_write_mux(omember, write_frame, bytes, NULL);
 					continue;
 				}
 
 				bptr = (int16_t *) omember->frame;
 
-				for (x = 0; x < bytes / 2 ; x++) {
-					z = main_frame[x];
+				/* without relationships every member hears the whole mix minus itself, let the vector kernels do it */
+				if (!conference->relationship_total) {
+					uint32_t self_samples = 0;
 
-					/* bptr[x] represents my own contribution to this audio sample */
-					if (conference_utils_member_test_flag(omember, MFLAG_HAS_AUDIO) && x <= omember->read / 2) {
-						z -= (int32_t) bptr[x];
+					if (conference_utils_member_test_flag(omember, MFLAG_HAS_AUDIO)) {
+						self_samples = omember->read / 2 + 1;
+						if (self_samples > bytes / 2) {
+							self_samples = bytes / 2;
+						}
 					}
 
-					/* when there are relationships, we have to do more work by scouring all the members to see if there are any
-					   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
-					*/
-					if (conference->relationship_total) {
-						for (imember = conference->members; imember; imember = imember->next) {
-							if (imember != omember && conference_utils_member_test_flag(imember, MFLAG_HAS_AUDIO)) {
-								conference_relationship_t *rel;
-								switch_size_t found = 0;
-								int16_t *rptr = (int16_t *) imember->frame;
-								for (rel = imember->relationships; rel; rel = rel->next) {
-									if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
-										z -= (int32_t) rptr[x];
-										found = 1;
-										break;
-									}
-								}
-								if (!found) {
-									for (rel = omember->relationships; rel; rel = rel->next) {
-										if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+					switch_mix_minus_sln(write_frame, main_frame, bptr, self_samples);
+					switch_mix_minus_sln(write_frame + self_samples, main_frame + self_samples, NULL, bytes / 2 - self_samples);
+				} else {
+					for (x = 0; x < bytes / 2 ; x++) {
+						z = main_frame[x];
+
+						/* bptr[x] represents my own contribution to this audio sample */
+						if (conference_utils_member_test_flag(omember, MFLAG_HAS_AUDIO) && x <= omember->read / 2) {
+							z -= (int32_t) bptr[x];
+						}
+
+						/* when there are relationships, we have to do more work by scouring all the members to see if there are any
+						   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
+						*/
+						if (conference->relationship_total) {
+							for (imember = conference->members; imember; imember = imember->next) {
+								if (imember != omember && conference_utils_member_test_flag(imember, MFLAG_HAS_AUDIO)) {
+									conference_relationship_t *rel;
+									switch_size_t found = 0;
+									int16_t *rptr = (int16_t *) imember->frame;
+									for (rel = imember->relationships; rel; rel = rel->next) {
+										if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
 											z -= (int32_t) rptr[x];
+											found = 1;
 											break;
 										}
 									}
-								}
+									if (!found) {
+										for (rel = omember->relationships; rel; rel = rel->next) {
+											if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+												z -= (int32_t) rptr[x];
+												break;
+											}
+										}
+									}
 
+								}
 							}
 						}
-					}
 
-					/* Now we can convert to 16 bit. */
-					switch_normalize_to_16bit(z);
-					write_frame[x] = (int16_t) z;
+						/* Now we can convert to 16 bit. */
+						switch_normalize_to_16bit(z);
+						write_frame[x] = (int16_t) z;
+					}
 				}
 
-				switch_mutex_lock(omember->audio_out_mutex);
-				ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-				switch_mutex_unlock(omember->audio_out_mutex);
+				codec_set = conference_encode_shared(omember, &audio_codec_groups, write_frame, bytes);
+				ok = conference_encode_write_mux(omember, write_frame, bytes, codec_set);
 
 				if (!ok) {
 					switch_mutex_unlock(conference->mutex);
@@ -627,9 +650,8 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 					continue;
 				}
 
-				switch_mutex_lock(omember->audio_out_mutex);
-				ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-				switch_mutex_unlock(omember->audio_out_mutex);
+				codec_set = conference_encode_shared(omember, &audio_codec_groups, write_frame, bytes);
+				ok = conference_encode_write_mux(omember, write_frame, bytes, codec_set);
 
 				if (!ok) {
 					switch_mutex_unlock(conference->mutex);
@@ -780,6 +802,7 @@ void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *ob
 	switch_event_fire(&event);
 
 	switch_core_timer_destroy(&timer);
+	conference_encode_destroy_groups(&audio_codec_groups);
 	switch_mutex_lock(conference_globals.hash_mutex);
 	if (conference_utils_test_flag(conference, CFLAG_INHASH)) {
 		switch_core_hash_delete(conference_globals.conference_hash, conference->name);
@@ -2119,6 +2142,7 @@ SWITCH_STANDARD_APP(conference_function)
 	member.session = session;
 	member.channel = switch_core_session_get_channel(session);
 	member.pool = switch_core_session_get_pool(session);
+	member.audio_codec_index = -1;
 
 	/* Prepare MUTEXS */
 	switch_mutex_init(&member.flag_mutex, SWITCH_MUTEX_NESTED, member.pool);
@@ -2251,6 +2275,7 @@ SWITCH_STANDARD_APP(conference_function)
 	switch_buffer_destroy(&member.resample_buffer);
 	switch_buffer_destroy(&member.audio_buffer);
 	switch_buffer_destroy(&member.mux_buffer);
+	switch_buffer_destroy(&member.encoded_buffer);
 
 	if (member.fb) {
 		switch_frame_buffer_destroy(&member.fb);
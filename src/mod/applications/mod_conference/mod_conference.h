@@ -106,6 +106,8 @@
 #define CONFFUNCAPISIZE (sizeof(conference_api_sub_commands)/sizeof(conference_api_sub_commands[0]))
 
 #define MAX_MUX_CODECS 10
+/* how many intervals a member has to stay a plain listener before it is pinned to its codec group */
+#define CONF_ENCODE_JOIN_INTERVALS 25
 
 #define ALC_HRTF_SOFT  0x1992
 
@@ -246,6 +248,7 @@ typedef enum {
 	CFLAG_VIDEO_REQUIRED_FOR_CANVAS,
 	CFLAG_PERSONAL_CANVAS,
 	CFLAG_REFRESH_LAYOUT,
+	CFLAG_MINIMIZE_AUDIO_ENCODING,
 	/////////////////////////////////
 	CFLAG_MAX
 } conference_flag_t;
@@ -500,6 +503,10 @@ typedef struct mcu_canvas_s {
 	int recording;
 	switch_image_t *bgimg;
 	switch_thread_rwlock_t *video_rwlock;
+	uint32_t composite_frames;
+	switch_time_t composite_usec;
+	switch_time_t composite_usec_max;
+	switch_time_t composite_usec_total;
 } mcu_canvas_t;
 
 /* Record Node */
@@ -675,6 +682,7 @@ struct conference_member {
 	switch_memory_pool_t *pool;
 	switch_buffer_t *audio_buffer;
 	switch_buffer_t *mux_buffer;
+	switch_buffer_t *encoded_buffer;
 	switch_buffer_t *resample_buffer;
 	member_flag_t flags[MFLAG_MAX];
 	uint32_t score;
@@ -740,6 +748,12 @@ struct conference_member {
 	int layer_timeout;
 	int video_codec_index;
 	int video_codec_id;
+	int audio_codec_index;
+	/* intervals spent as a plain listener while waiting to join a codec group */
+	uint32_t audio_codec_wait;
+	/* records in encoded_buffer, and whether the conference queued the last frame there rather than in mux_buffer */
+	uint32_t encoded_frames;
+	switch_bool_t encoded_last;
 	char *video_banner_text;
 	char *video_logo;
 	char *video_mute_png;
@@ -782,6 +796,23 @@ typedef struct codec_set_s {
 	uint8_t *packet;
 } codec_set_t;
 
+/* Members with the same write codec that hear the plain mix are pinned to one persistent encoder per group,
+   fed every interval the group has members so it never falls out of step */
+typedef struct conference_audio_codec_groups_s {
+	codec_set_t *write_codecs[MAX_MUX_CODECS];
+	uint32_t members[MAX_MUX_CODECS];
+	uint8_t encoded[MAX_MUX_CODECS];
+	/* the encoder skipped an interval and starts over on its next frame */
+	uint8_t stale[MAX_MUX_CODECS];
+} conference_audio_codec_groups_t;
+
+/* Header of each record in member->encoded_buffer, one per frame the conference encoded for the member instead of
+   queueing it to member->mux_buffer; datalen bytes of payload follow */
+typedef struct conference_encoded_frame_s {
+	const switch_codec_implementation_t *implementation;
+	uint32_t datalen;
+} conference_encoded_frame_t;
+
 typedef void (*conference_key_callback_t) (conference_member_t *, struct caller_control_actions *);
 
 typedef struct {
@@ -938,6 +969,18 @@ void conference_member_check_agc_levels(conference_member_t *member);
 void conference_member_clear_avg(conference_member_t *member);
 int conference_member_noise_gate_check(conference_member_t *member);
 void conference_member_check_channels(switch_frame_t *frame, conference_member_t *member, switch_bool_t in);
+int conference_member_audio_codec_group(conference_member_t *member, conference_audio_codec_groups_t *groups);
+
+switch_bool_t conference_encode_shareable(const switch_codec_implementation_t *impl);
+int conference_encode_find_group(conference_obj_t *conference, conference_audio_codec_groups_t *groups, switch_codec_t *check_codec, int index);
+int conference_encode_join_group(conference_member_t *member, conference_audio_codec_groups_t *groups, switch_codec_t *check_codec);
+void conference_encode_leave_group(conference_member_t *member);
+void conference_encode_next_interval(conference_audio_codec_groups_t *groups);
+codec_set_t *conference_encode_shared(conference_member_t *member, conference_audio_codec_groups_t *groups, int16_t *data, uint32_t bytes);
+switch_size_t conference_encode_write_mux(conference_member_t *member, int16_t *data, uint32_t bytes, codec_set_t *codec_set);
+uint32_t conference_encode_read(conference_member_t *member, const switch_codec_implementation_t **implementation, void *data, uint32_t datalen, uint32_t bytes);
+void conference_encode_flush(conference_member_t *member);
+void conference_encode_destroy_groups(conference_audio_codec_groups_t *groups);
 
 void conference_fnode_toggle_pause(conference_file_node_t *fnode, switch_stream_handle_t *stream);
 
@@ -1080,6 +1123,7 @@ switch_status_t conference_api_sub_transfer(conference_obj_t *conference, switch
 switch_status_t conference_api_sub_record(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv);
 switch_status_t conference_api_sub_norecord(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv);
 switch_status_t conference_api_sub_vid_bandwidth(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv);
+switch_status_t conference_api_sub_vid_stats(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv);
 switch_status_t conference_api_dispatch(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv, const char *cmdline, int argn);
 switch_status_t conference_api_sub_syntax(char **syntax);
 switch_status_t conference_api_main_real(const char *cmd, switch_core_session_t *session, switch_stream_handle_t *stream);
@@ -415,13 +415,6 @@ typedef struct fifo_node fifo_node_t;
 static void fifo_caller_add(fifo_node_t *node, switch_core_session_t *session);
 static void fifo_caller_del(const char *uuid);
 
-struct callback {
-	char *buf;
-	size_t len;
-	int matches;
-};
-typedef struct callback callback_t;
-
 static const char *print_strategy(outbound_strategy_t s)
 {
 	switch (s) {
@@ -449,15 +442,6 @@ static outbound_strategy_t parse_strategy(const char *name)
 	return NODE_STRATEGY_INVALID;
 }
 
-static int sql2str_callback(void *pArg, int argc, char **argv, char **columnNames)
-{
-	callback_t *cbt = (callback_t *) pArg;
-
-	switch_copy_string(cbt->buf, argv[0], cbt->len);
-	cbt->matches++;
-	return 0;
-}
-
 /*!\brief Handler for consumer DTMF
  *
  * When `fifo_consumer_exit_key` is pressed by the consumer we hangup
@@ -696,6 +680,8 @@ static struct {
 	switch_hash_t *consumer_orig_hash;
 	switch_hash_t *bridge_hash;
 	switch_hash_t *use_hash;
+	switch_hash_t *member_hash;
+	switch_hash_t *member_uuid_hash;
 	switch_mutex_t *use_mutex;
 	switch_mutex_t *caller_orig_mutex;
 	switch_mutex_t *consumer_orig_mutex;
@@ -713,6 +699,7 @@ static struct {
 	switch_odbc_handle_t *master_odbc;
 	int threads;
 	switch_thread_t *node_thread;
+	switch_queue_t *node_wake_queue;
 	int debug;
 	struct fifo_node *nodes;
 	char *pre_trans_execute;
@@ -780,6 +767,409 @@ static void fifo_init_use_count(void)
 	switch_mutex_unlock(globals.use_mutex);
 }
 
+/*!\brief An outbound member as seen by one fifo
+ *
+ * Mirrors a row of the fifo_outbound table.  The table is still kept
+ * up to date so members survive a restart and show up in `fifo
+ * list`, but callers are matched to members from this index alone.
+ *
+ * Each fifo keeps its members on a list ordered the same way the old
+ * consumer query was: soonest next_avail first, then fewest failed
+ * calls, then fewest answered calls.  An outbound uuid can serve
+ * several fifos and its usage is shared between them, so the copies
+ * are chained through `uuid_next` and updated together.
+ *
+ * The index is protected by globals.use_mutex, which already guards
+ * the per-uuid use counts it is matched against.
+ */
+typedef struct fifo_member {
+	char *uuid;
+	char *fifo_name;
+	char *originate_string;
+	char *hostname;
+	int simo_count;
+	int timeout;
+	int lag;
+	long next_avail;
+	int is_static;
+	int taking_calls;
+	int outbound_call_count;
+	int outbound_fail_count;
+	int ring_count;
+	struct fifo_member_list *list;
+	struct fifo_member *prev;
+	struct fifo_member *next;
+	struct fifo_member *uuid_next;
+} fifo_member_t;
+
+typedef struct fifo_member_list {
+	fifo_member_t *head;
+	fifo_member_t *tail;
+	int count;
+} fifo_member_list_t;
+
+typedef enum {
+	MEMBER_RING_STOP,
+	MEMBER_RING_FAIL,
+	MEMBER_CALL_START,
+	MEMBER_CALL_STOP,
+	MEMBER_CALL_DONE
+} fifo_member_op_t;
+
+typedef int (*fifo_member_callback_t) (void *pArg, fifo_member_t *member);
+
+static int fifo_member_cmp(fifo_member_t *a, fifo_member_t *b)
+{
+	if (a->next_avail != b->next_avail) {
+		return a->next_avail < b->next_avail ? -1 : 1;
+	}
+
+	if (a->outbound_fail_count != b->outbound_fail_count) {
+		return a->outbound_fail_count - b->outbound_fail_count;
+	}
+
+	return a->outbound_call_count - b->outbound_call_count;
+}
+
+static void fifo_member_unlink(fifo_member_t *member)
+{
+	fifo_member_list_t *list = member->list;
+
+	if (member->prev) {
+		member->prev->next = member->next;
+	} else {
+		list->head = member->next;
+	}
+
+	if (member->next) {
+		member->next->prev = member->prev;
+	} else {
+		list->tail = member->prev;
+	}
+
+	member->prev = member->next = NULL;
+}
+
+/* Members usually move back after a call, so look for their place from the tail */
+static void fifo_member_link(fifo_member_t *member)
+{
+	fifo_member_list_t *list = member->list;
+	fifo_member_t *pos = list->tail;
+
+	while (pos && fifo_member_cmp(pos, member) > 0) {
+		pos = pos->prev;
+	}
+
+	member->prev = pos;
+
+	if (pos) {
+		member->next = pos->next;
+		pos->next = member;
+	} else {
+		member->next = list->head;
+		list->head = member;
+	}
+
+	if (member->next) {
+		member->next->prev = member;
+	} else {
+		list->tail = member;
+	}
+}
+
+static void fifo_member_remove(fifo_member_t *member)
+{
+	fifo_member_t *first, *p;
+
+	fifo_member_unlink(member);
+	member->list->count--;
+
+	first = (fifo_member_t *) switch_core_hash_find(globals.member_uuid_hash, member->uuid);
+
+	if (first == member) {
+		if (member->uuid_next) {
+			switch_core_hash_insert(globals.member_uuid_hash, member->uuid, member->uuid_next);
+		} else {
+			switch_core_hash_delete(globals.member_uuid_hash, member->uuid);
+		}
+	} else {
+		for (p = first; p && p->uuid_next != member; p = p->uuid_next);
+
+		if (p) {
+			p->uuid_next = member->uuid_next;
+		}
+	}
+
+	switch_safe_free(member->uuid);
+	switch_safe_free(member->fifo_name);
+	switch_safe_free(member->originate_string);
+	switch_safe_free(member->hostname);
+	free(member);
+}
+
+static fifo_member_t *fifo_member_find(fifo_member_list_t *list, const char *uuid)
+{
+	fifo_member_t *member;
+
+	for (member = list->head; member; member = member->next) {
+		if (!strcmp(member->uuid, uuid)) {
+			return member;
+		}
+	}
+
+	return NULL;
+}
+
+/*!\brief Add a member to the index, replacing the fifo's previous copy of it
+ *
+ * Returns the number of members the fifo has afterward.
+ */
+static int fifo_member_index_add(const fifo_member_t *tmpl)
+{
+	fifo_member_list_t *list;
+	fifo_member_t *member, *first;
+	int r;
+
+	switch_mutex_lock(globals.use_mutex);
+
+	if (!(list = (fifo_member_list_t *) switch_core_hash_find(globals.member_hash, tmpl->fifo_name))) {
+		switch_zmalloc(list, sizeof(*list));
+		switch_core_hash_insert(globals.member_hash, tmpl->fifo_name, list);
+	}
+
+	if ((member = fifo_member_find(list, tmpl->uuid))) {
+		fifo_member_remove(member);
+	}
+
+	switch_zmalloc(member, sizeof(*member));
+	*member = *tmpl;
+	member->uuid = strdup(tmpl->uuid);
+	member->fifo_name = strdup(tmpl->fifo_name);
+	member->originate_string = strdup(switch_str_nil(tmpl->originate_string));
+	member->hostname = strdup(switch_str_nil(tmpl->hostname));
+	member->list = list;
+	member->prev = member->next = NULL;
+
+	first = (fifo_member_t *) switch_core_hash_find(globals.member_uuid_hash, member->uuid);
+	member->uuid_next = first;
+	switch_core_hash_insert(globals.member_uuid_hash, member->uuid, member);
+
+	fifo_member_link(member);
+	r = ++list->count;
+
+	switch_mutex_unlock(globals.use_mutex);
+
+	return r;
+}
+
+/*!\brief Remove a member from a fifo, only if it was added by `hostname` when that is set
+ *
+ * Returns the number of members the fifo has afterward.
+ */
+static int fifo_member_index_del(const char *fifo_name, const char *uuid, const char *hostname)
+{
+	fifo_member_list_t *list;
+	fifo_member_t *member;
+	int r = 0;
+
+	switch_mutex_lock(globals.use_mutex);
+	if ((list = (fifo_member_list_t *) switch_core_hash_find(globals.member_hash, fifo_name))) {
+		if ((member = fifo_member_find(list, uuid)) && (!hostname || !strcmp(member->hostname, hostname))) {
+			fifo_member_remove(member);
+		}
+		r = list->count;
+	}
+	switch_mutex_unlock(globals.use_mutex);
+
+	return r;
+}
+
+static int fifo_member_index_count(const char *fifo_name)
+{
+	fifo_member_list_t *list;
+	int r = 0;
+
+	switch_mutex_lock(globals.use_mutex);
+	if ((list = (fifo_member_list_t *) switch_core_hash_find(globals.member_hash, fifo_name))) {
+		r = list->count;
+	}
+	switch_mutex_unlock(globals.use_mutex);
+
+	return r;
+}
+
+/*!\brief Drop the members this host added, or only the static ones
+ *
+ * Follows the deletes load_config() runs against fifo_outbound.  The
+ * lists themselves stay around, empty, until shutdown.
+ */
+static void fifo_member_index_purge(switch_bool_t all)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	fifo_member_list_t *list;
+	fifo_member_t *member, *next;
+
+	switch_mutex_lock(globals.use_mutex);
+	for (hi = switch_core_hash_first(globals.member_hash); hi; hi = switch_core_hash_next(&hi)) {
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		list = (fifo_member_list_t *) val;
+
+		for (member = list->head; member; member = next) {
+			next = member->next;
+
+			if ((all || member->is_static) && !strcmp(member->hostname, globals.hostname)) {
+				fifo_member_remove(member);
+			}
+		}
+	}
+	switch_mutex_unlock(globals.use_mutex);
+}
+
+static void fifo_member_index_destroy(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	fifo_member_list_t *list;
+
+	switch_mutex_lock(globals.use_mutex);
+	for (hi = switch_core_hash_first(globals.member_hash); hi; hi = switch_core_hash_next(&hi)) {
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		list = (fifo_member_list_t *) val;
+
+		while (list->head) {
+			fifo_member_remove(list->head);
+		}
+
+		free(list);
+	}
+	switch_core_hash_destroy(&globals.member_hash);
+	switch_core_hash_destroy(&globals.member_uuid_hash);
+	switch_mutex_unlock(globals.use_mutex);
+}
+
+/*!\brief Apply the bookkeeping of an outbound call to every fifo the member serves
+ *
+ * This is the in-memory side of the `update fifo_outbound` statements;
+ * `avail_from` is the time the member's lag starts counting from.
+ */
+static void fifo_member_update(const char *uuid, fifo_member_op_t op, long avail_from)
+{
+	fifo_member_t *member;
+
+	switch_mutex_lock(globals.use_mutex);
+	for (member = switch_core_hash_find(globals.member_uuid_hash, uuid); member; member = member->uuid_next) {
+		switch (op) {
+		case MEMBER_RING_STOP:
+			if (member->ring_count > 0) {
+				member->ring_count--;
+			}
+			continue;
+		case MEMBER_RING_FAIL:
+			if (member->ring_count > 0) {
+				member->ring_count--;
+			}
+			member->outbound_fail_count++;
+			member->next_avail = avail_from + member->lag + 1;
+			break;
+		case MEMBER_CALL_START:
+			member->outbound_fail_count = 0;
+			break;
+		case MEMBER_CALL_DONE:
+			member->outbound_call_count++;
+			member->next_avail = avail_from + member->lag + 1;
+			break;
+		case MEMBER_CALL_STOP:
+			member->next_avail = avail_from + member->lag + 1;
+			break;
+		}
+
+		fifo_member_unlink(member);
+		fifo_member_link(member);
+	}
+	switch_mutex_unlock(globals.use_mutex);
+}
+
+/*!\brief Hand the members of a fifo that can take a call right now to `callback`
+ *
+ * The list is ordered by next_avail, so the walk ends at the first
+ * member still waiting out its lag.  Every member passed to the
+ * callback gets a ring reserved on it, which the outbound strategy
+ * thread gives back with MEMBER_RING_STOP or MEMBER_RING_FAIL; until
+ * then it cannot be picked again.  The callback returns non-zero to
+ * stop the walk.
+ */
+static void fifo_member_index_match(const char *fifo_name, long now, fifo_member_callback_t callback, void *pArg)
+{
+	fifo_member_list_t *list;
+	fifo_member_t *member, *p;
+	int *use_count;
+
+	switch_mutex_lock(globals.use_mutex);
+	if ((list = (fifo_member_list_t *) switch_core_hash_find(globals.member_hash, fifo_name))) {
+		for (member = list->head; member; member = member->next) {
+			if (member->next_avail && member->next_avail > now) {
+				break;
+			}
+
+			if (member->taking_calls != 1) {
+				continue;
+			}
+
+			use_count = (int *) switch_core_hash_find(globals.use_hash, member->uuid);
+
+			if ((use_count ? *use_count : 0) + member->ring_count >= member->simo_count) {
+				continue;
+			}
+
+			for (p = switch_core_hash_find(globals.member_uuid_hash, member->uuid); p; p = p->uuid_next) {
+				p->ring_count++;
+			}
+
+			if (callback(pArg, member)) {
+				break;
+			}
+		}
+	}
+	switch_mutex_unlock(globals.use_mutex);
+}
+
+static int fifo_member_seed_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	fifo_member_t member = { 0 };
+
+	if (zstr(argv[0]) || zstr(argv[1])) {
+		return 0;
+	}
+
+	member.uuid = argv[0];
+	member.fifo_name = argv[1];
+	member.originate_string = argv[2];
+	member.simo_count = argv[3] ? atoi(argv[3]) : 0;
+	member.timeout = argv[4] ? atoi(argv[4]) : 0;
+	member.lag = argv[5] ? atoi(argv[5]) : 0;
+	member.next_avail = argv[6] ? atol(argv[6]) : 0;
+	member.is_static = argv[7] ? atoi(argv[7]) : 0;
+	member.outbound_call_count = argv[8] ? atoi(argv[8]) : 0;
+	member.outbound_fail_count = argv[9] ? atoi(argv[9]) : 0;
+	member.hostname = argv[10];
+	member.taking_calls = argv[11] ? atoi(argv[11]) : 0;
+	member.ring_count = argv[12] ? atoi(argv[12]) : 0;
+
+	fifo_member_index_add(&member);
+
+	return 0;
+}
+
+/*!\brief Let the node thread know a caller or an outbound member became available
+ */
+static void fifo_wake_node_thread(void)
+{
+	if (globals.node_wake_queue) {
+		switch_queue_trypush(globals.node_wake_queue, NULL);
+	}
+}
+
 static int check_caller_outbound_call(const char *key)
 {
 	int x = 0;
@@ -1003,14 +1393,12 @@ static switch_bool_t fifo_execute_sql_callback(switch_mutex_t *mutex, char *sql,
 	return ret;
 }
 
-static fifo_node_t *create_node(const char *name, uint32_t importance, switch_mutex_t *mutex)
+static fifo_node_t *create_node(const char *name, uint32_t importance)
 {
 	fifo_node_t *node;
 	int x = 0;
 	switch_memory_pool_t *pool;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
-	char *sql = NULL;
+
 	if (!globals.running) {
 		return NULL;
 	}
@@ -1035,13 +1423,8 @@ static fifo_node_t *create_node(const char *name, uint32_t importance, switch_mu
 	switch_thread_rwlock_create(&node->rwlock, node->pool);
 	switch_mutex_init(&node->mutex, SWITCH_MUTEX_NESTED, node->pool);
 	switch_mutex_init(&node->update_mutex, SWITCH_MUTEX_NESTED, node->pool);
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", name);
-	fifo_execute_sql_callback(mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	node->member_count = fifo_member_index_count(name);
 	node->has_outbound = (node->member_count > 0) ? 1 : 0;
-	switch_safe_free(sql);
 
 	node->importance = importance;
 
@@ -1083,9 +1466,20 @@ struct call_helper {
 	char *node_name;
 	char *originate_string;
 	int timeout;
+	int reserved;
 	switch_memory_pool_t *pool;
 };
 
+/*!\brief Give back the ring fifo_member_index_match() reserved on a member
+ */
+static void call_helper_release(struct call_helper *h, fifo_member_op_t op, long avail_from)
+{
+	if (h->reserved) {
+		h->reserved = 0;
+		fifo_member_update(h->uuid, op, avail_from);
+	}
+}
+
 #define MAX_ROWS 250
 struct callback_helper {
 	int need;
@@ -1448,6 +1842,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 		struct call_helper *h = cbh->rows[i];
 
 		if (check_consumer_outbound_call(h->uuid) || check_bridge_call(h->uuid)) {
+			call_helper_release(h, MEMBER_RING_STOP, 0);
 			continue;
 		}
 
@@ -1661,19 +2056,23 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 					char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 "
 											   "where uuid='%q' and ring_count > 0", h->uuid);
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					call_helper_release(h, MEMBER_RING_STOP, 0);
 				}
 			}
 			break;
 		default:
 			{
+				long avail_from = (long) switch_epoch_time_now(NULL) + node->retry_delay;
+
 				for (i = 0; i < cbh->rowcount; i++) {
 					struct call_helper *h = cbh->rows[i];
 					char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1, "
 											   "outbound_fail_count=outbound_fail_count+1, "
 											   "outbound_fail_total_count = outbound_fail_total_count+1, "
 											   "next_avail=%ld + lag + 1 where uuid='%q' and ring_count > 0",
-											   (long) switch_epoch_time_now(NULL) + node->retry_delay, h->uuid);
+											   avail_from, h->uuid);
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					call_helper_release(h, MEMBER_RING_FAIL, avail_from);
 				}
 			}
 		}
@@ -1726,6 +2125,7 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 		struct call_helper *h = cbh->rows[i];
 		char *sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 where uuid='%q' and ring_count > 0",  h->uuid);
 		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		call_helper_release(h, MEMBER_RING_STOP, 0);
 	}
 
   end:
@@ -1758,9 +2158,15 @@ static void *SWITCH_THREAD_FUNC outbound_ringall_thread_run(switch_thread_t *thr
 
  dpool:
 
+	for (i = 0; i < cbh->rowcount; i++) {
+		call_helper_release(cbh->rows[i], MEMBER_RING_STOP, 0);
+	}
+
 	pool = cbh->pool;
 	switch_core_destroy_memory_pool(&pool);
 
+	fifo_wake_node_thread();
+
 	switch_mutex_lock(globals.mutex);
 	globals.threads--;
 	switch_mutex_unlock(globals.mutex);
@@ -1794,7 +2200,11 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	char *sql = NULL;
 	char *expanded_originate_string = NULL;
 
-	if (!globals.running) return NULL;
+	if (!globals.running) {
+		call_helper_release(h, MEMBER_RING_STOP, 0);
+		switch_core_destroy_memory_pool(&h->pool);
+		return NULL;
+	}
 
 	switch_mutex_lock(globals.mutex);
 	globals.threads++;
@@ -1807,7 +2217,6 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 
 	if (node) {
 		switch_mutex_lock(node->update_mutex);
-		node->ring_consumer_count++;
 		node->busy = 0;
 		switch_mutex_unlock(node->update_mutex);
 	}
@@ -1848,10 +2257,13 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	status = switch_ivr_originate(NULL, &session, &cause, originate_string, h->timeout, NULL, NULL, NULL, NULL, ovars, SOF_NONE, NULL);
 
 	if (status != SWITCH_STATUS_SUCCESS) {
+		long avail_from = (long) switch_epoch_time_now(NULL) + (node ? node->retry_delay : 0);
+
 		sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1, "
 							 "outbound_fail_count=outbound_fail_count+1, next_avail=%ld + lag + 1 where uuid='%q'",
-							 (long) switch_epoch_time_now(NULL) + (node ? node->retry_delay : 0), h->uuid);
+							 avail_from, h->uuid);
 		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		call_helper_release(h, MEMBER_RING_FAIL, avail_from);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FIFO-Name", node ? node->name : "");
@@ -1897,6 +2309,7 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 
 	sql = switch_mprintf("update fifo_outbound set ring_count=ring_count-1 where uuid='%q' and ring_count > 0", h->uuid);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	call_helper_release(h, MEMBER_RING_STOP, 0);
 
   end:
 
@@ -1918,8 +2331,11 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 		switch_mutex_unlock(node->update_mutex);
 		switch_thread_rwlock_unlock(node->rwlock);
 	}
+	call_helper_release(h, MEMBER_RING_STOP, 0);
 	switch_core_destroy_memory_pool(&h->pool);
 
+	fifo_wake_node_thread();
+
 	switch_mutex_lock(globals.mutex);
 	globals.threads--;
 	switch_mutex_unlock(globals.mutex);
@@ -1927,20 +2343,20 @@ static void *SWITCH_THREAD_FUNC outbound_enterprise_thread_run(switch_thread_t *
 	return NULL;
 }
 
-/*!\brief Extract the outbound member results and accumulate them for
- * the ringall strategy handler
+/*!\brief Collect the outbound members for the ringall strategy handler
  */
-static int place_call_ringall_callback(void *pArg, int argc, char **argv, char **columnNames)
+static int place_call_ringall_callback(void *pArg, fifo_member_t *member)
 {
 	struct callback_helper *cbh = (struct callback_helper *) pArg;
 	struct call_helper *h;
 
 	h = switch_core_alloc(cbh->pool, sizeof(*h));
 	h->pool = cbh->pool;
-	h->uuid = switch_core_strdup(h->pool, argv[0]);
-	h->node_name = switch_core_strdup(h->pool, argv[1]);
-	h->originate_string = switch_core_strdup(h->pool, argv[2]);
-	h->timeout = atoi(argv[5]);
+	h->uuid = switch_core_strdup(h->pool, member->uuid);
+	h->node_name = switch_core_strdup(h->pool, member->fifo_name);
+	h->originate_string = switch_core_strdup(h->pool, member->originate_string);
+	h->timeout = member->timeout;
+	h->reserved = 1;
 
 	cbh->rows[cbh->rowcount++] = h;
 
@@ -1954,10 +2370,9 @@ static int place_call_ringall_callback(void *pArg, int argc, char **argv, char *
 	return 0;
 }
 
-/*!\brief Extract the outbound member results and invoke the
- * enterprise strategy handler
+/*!\brief Invoke the enterprise strategy handler for an outbound member
  */
-static int place_call_enterprise_callback(void *pArg, int argc, char **argv, char **columnNames)
+static int place_call_enterprise_callback(void *pArg, fifo_member_t *member)
 {
 	int *need = (int *) pArg;
 
@@ -1969,15 +2384,22 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
 	switch_core_new_memory_pool(&pool);
 	h = switch_core_alloc(pool, sizeof(*h));
 	h->pool = pool;
-	h->uuid = switch_core_strdup(h->pool, argv[0]);
-	h->node_name = switch_core_strdup(h->pool, argv[1]);
-	h->originate_string = switch_core_strdup(h->pool, argv[2]);
-	h->timeout = atoi(argv[5]);
+	h->uuid = switch_core_strdup(h->pool, member->uuid);
+	h->node_name = switch_core_strdup(h->pool, member->fifo_name);
+	h->originate_string = switch_core_strdup(h->pool, member->originate_string);
+	h->timeout = member->timeout;
+	h->reserved = 1;
 
 	switch_threadattr_create(&thd_attr, h->pool);
 	switch_threadattr_detach_set(thd_attr, 1);
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_thread_create(&thread, thd_attr, outbound_enterprise_thread_run, h, h->pool);
+
+	if (switch_thread_create(&thread, thd_attr, outbound_enterprise_thread_run, h, h->pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: cannot start a thread to call outbound member %s\n", h->node_name, h->uuid);
+		call_helper_release(h, MEMBER_RING_STOP, 0);
+		switch_core_destroy_memory_pool(&pool);
+		return -1;
+	}
 
 	(*need)--;
 
@@ -1987,8 +2409,8 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
 /*!\brief Find outbound members to call for a given fifo node
  *
  * We're given a fifo node that has callers to be delivered to agents.
- * Our job is to find available outbound members and pass them to the
- * appropriate outbound strategy handler.
+ * Our job is to find available outbound members in the member index
+ * and pass them to the appropriate outbound strategy handler.
  *
  * The ringall strategy handler needs the full list of members to do
  * its job, so we first let `place_call_ringall_callback` accumulate
@@ -1996,6 +2418,11 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
  * member one at a time, so the `place_call_enterprise_callback` takes
  * care of invoking the handler.
  *
+ * The members handed out have a ring reserved on them and the calls
+ * are counted in ring_consumer_count before we return, so the node
+ * thread can run again right away without dialing twice for the same
+ * callers.
+ *
  * Within the ringall call strategy outbound_per_cycle is used to define
  * how many agents exactly are assigned to the caller. With ringall if 
  * multiple callers are calling in and one is answered, because the call
@@ -2013,20 +2440,13 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
  */
 static void find_consumers(fifo_node_t *node)
 {
-	char *sql;
-
-	sql = switch_mprintf("select uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
-						 "next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname "
-						 "from fifo_outbound "
-						 "where taking_calls = 1 and (fifo_name = '%q') and ((use_count+ring_count) < simo_count) and (next_avail = 0 or next_avail <= %ld) "
-						 "order by next_avail, outbound_fail_count, outbound_call_count",
-						 node->name, (long) switch_epoch_time_now(NULL)
-						 );
+	long now = (long) switch_epoch_time_now(NULL);
 
 	switch(node->outbound_strategy) {
 	case NODE_STRATEGY_ENTERPRISE:
 		{
 			int need = node_caller_count(node);
+			int wanted;
 
 			if (node->outbound_per_cycle && node->outbound_per_cycle < need) {
 				need = node->outbound_per_cycle;
@@ -2034,7 +2454,14 @@ static void find_consumers(fifo_node_t *node)
 				need = node->outbound_per_cycle_min;
 			}
 
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_enterprise_callback, &need);
+			wanted = need;
+			fifo_member_index_match(node->name, now, place_call_enterprise_callback, &need);
+
+			if (wanted != need) {
+				switch_mutex_lock(node->update_mutex);
+				node->ring_consumer_count += wanted - need;
+				switch_mutex_unlock(node->update_mutex);
+			}
 		}
 		break;
 	case NODE_STRATEGY_RINGALL:
@@ -2053,13 +2480,32 @@ static void find_consumers(fifo_node_t *node)
 				cbh->need = node->outbound_per_cycle;
 			}
 
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_ringall_callback, cbh);
+			fifo_member_index_match(node->name, now, place_call_ringall_callback, cbh);
 
 			if (cbh->rowcount) {
+				switch_mutex_lock(node->update_mutex);
+				node->ring_consumer_count = 1;
+				switch_mutex_unlock(node->update_mutex);
+
 				switch_threadattr_create(&thd_attr, cbh->pool);
 				switch_threadattr_detach_set(thd_attr, 1);
 				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				switch_thread_create(&thread, thd_attr, outbound_ringall_thread_run, cbh, cbh->pool);
+
+				if (switch_thread_create(&thread, thd_attr, outbound_ringall_thread_run, cbh, cbh->pool) != SWITCH_STATUS_SUCCESS) {
+					int i;
+
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s: cannot start a thread to ring the outbound members\n", node->name);
+
+					for (i = 0; i < cbh->rowcount; i++) {
+						call_helper_release(cbh->rows[i], MEMBER_RING_STOP, 0);
+					}
+
+					switch_mutex_lock(node->update_mutex);
+					node->ring_consumer_count = 0;
+					switch_mutex_unlock(node->update_mutex);
+
+					switch_core_destroy_memory_pool(&pool);
+				}
 			} else {
 				switch_core_destroy_memory_pool(&pool);
 			}
@@ -2068,38 +2514,34 @@ static void find_consumers(fifo_node_t *node)
 	default:
 		break;
 	}
-
-	switch_safe_free(sql);
 }
 
-/*\brief Continuously attempt to deliver calls to outbound members
+/*\brief Deliver calls to outbound members as they become possible
  *
- * For each outbound priority level 1-10, find fifo nodes with a
- * matching priority.  For each of those nodes with outbound members,
- * run `find_consumers()` if the fifo node has calls needing to be
- * delivered and not enough ready and waiting inbound consumers.
+ * Each pass first cleans up after nodes queued for deletion.  Then,
+ * for each outbound priority level 1-10, it finds fifo nodes with a
+ * matching priority and runs `find_consumers()` on those with outbound
+ * members if they have calls needing to be delivered and not enough
+ * ready and waiting inbound consumers.
  *
- * In the event of nothing needing to be done, each cycle starts at
- * priority 1 and ends at priority 10, yielding for one second
- * afterward.  We also yield after initiating outbound calls, starting
- * again where we left off on the next node.
- *
- * We also take care of cleaning up after nodes queued for deletion.
+ * Between passes we sleep until a caller arrives or an outbound call
+ * to a member ends.  Members coming out of their lag, consumers going
+ * idle and nodes being removed are not signalled, so we also run a
+ * pass at least once a second; it only looks at the member index.
  */
 static void *SWITCH_THREAD_FUNC node_thread_run(switch_thread_t *thread, void *obj)
 {
 	fifo_node_t *node, *last, *this_node;
-	int cur_priority = 1;
+	int cur_priority;
+	void *pop_wake;
 
 	globals.node_thread_running = 1;
 
 	while (globals.node_thread_running == 1) {
-		int ppl_waiting, consumer_total, idle_consumers, found = 0;
+		int ppl_waiting, consumer_total, idle_consumers;
 
 		switch_mutex_lock(globals.mutex);
 
-		if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trying priority: %d\n", cur_priority);
-
 		last = NULL;
 		node = globals.nodes;
 
@@ -2146,34 +2588,34 @@ static void *SWITCH_THREAD_FUNC node_thread_run(switch_thread_t *thread, void *o
 			last = this_node;
 
 			if (this_node->outbound_priority == 0) this_node->outbound_priority = 5;
+		}
 
-			if (this_node->has_outbound && !this_node->busy && this_node->outbound_priority == cur_priority) {
-				ppl_waiting = node_caller_count(this_node);
-				consumer_total = this_node->consumer_count;
-				idle_consumers = node_idle_consumers(this_node);
+		for (cur_priority = 1; cur_priority <= 10; cur_priority++) {
+			if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trying priority: %d\n", cur_priority);
 
-				if (globals.debug) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-									  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
-									  this_node->name, ppl_waiting, consumer_total, idle_consumers, this_node->ring_consumer_count, this_node->outbound_priority);
-				}
+			for (this_node = globals.nodes; this_node; this_node = this_node->next) {
+				if (this_node->has_outbound && !this_node->busy && this_node->outbound_priority == cur_priority) {
+					ppl_waiting = node_caller_count(this_node);
+					consumer_total = this_node->consumer_count;
+					idle_consumers = node_idle_consumers(this_node);
+
+					if (globals.debug) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+										  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
+										  this_node->name, ppl_waiting, consumer_total, idle_consumers, this_node->ring_consumer_count, this_node->outbound_priority);
+					}
 
-				if ((ppl_waiting - this_node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers)) {
-					found++;
-					find_consumers(this_node);
-					switch_yield(1000000);
+					if ((ppl_waiting - this_node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers)) {
+						find_consumers(this_node);
+					}
 				}
 			}
 		}
 
-		if (++cur_priority > 10) {
-			cur_priority = 1;
-		}
-
 		switch_mutex_unlock(globals.mutex);
 
-		if (cur_priority == 1) {
-			switch_yield(1000000);
+		if (switch_queue_pop_timeout(globals.node_wake_queue, &pop_wake, 1000000) == SWITCH_STATUS_SUCCESS) {
+			while (switch_queue_trypop(globals.node_wake_queue, &pop_wake) == SWITCH_STATUS_SUCCESS);
 		}
 	}
 
@@ -2197,6 +2639,7 @@ static int stop_node_thread(void)
 	switch_status_t st = SWITCH_STATUS_SUCCESS;
 
 	globals.node_thread_running = -1;
+	fifo_wake_node_thread();
 	switch_thread_join(&st, globals.node_thread);
 
 	return 0;
@@ -2286,7 +2729,7 @@ static void pres_event_handler(switch_event_t *event)
 
 	switch_mutex_lock(globals.mutex);
 	if (!(node = switch_core_hash_find(globals.fifo_hash, node_name)) && !(node = switch_core_hash_find(globals.fifo_hash, dup_node_name))) {
-		node = create_node(node_name, 0, globals.sql_mutex);
+		node = create_node(node_name, 0);
 		node->domain_name = switch_core_strdup(node->pool, domain_name);
 		node->ready = 1;
 	}
@@ -2316,7 +2759,7 @@ static uint32_t fifo_add_outbound(const char *node_name, const char *url, uint32
 	switch_mutex_lock(globals.mutex);
 
 	if (!(node = switch_core_hash_find(globals.fifo_hash, node_name))) {
-		node = create_node(node_name, 0, globals.sql_mutex);
+		node = create_node(node_name, 0);
 	}
 
 	switch_thread_rwlock_rdlock(node->rwlock);
@@ -2396,6 +2839,7 @@ static void dec_use_count(switch_core_session_t *session, const char *type)
 		sql = switch_mprintf("update fifo_outbound set use_count=use_count-1, stop_time=%ld, next_avail=%ld + lag + 1 where use_count > 0 and uuid='%q'",
 							 now, now, outbound_id);
 		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		fifo_member_update(outbound_id, MEMBER_CALL_STOP, now);
 		fifo_dec_use_count(outbound_id);
 	}
 
@@ -2486,6 +2930,7 @@ SWITCH_STANDARD_APP(fifo_track_call_function)
 	sql = switch_mprintf("update fifo_outbound set stop_time=0,start_time=%ld,outbound_fail_count=0,use_count=use_count+1,%s=%s+1,%s=%s+1 where uuid='%q'",
 						 (long) switch_epoch_time_now(NULL), col1, col1, col2, col2, data);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	fifo_member_update(data, MEMBER_CALL_START, 0);
 	fifo_inc_use_count(data);
 
 	if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_INBOUND) {
@@ -2523,6 +2968,8 @@ static void fifo_caller_add(fifo_node_t *node, switch_core_session_t *session)
 						 switch_epoch_time_now(NULL));
 
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+
+	fifo_wake_node_thread();
 }
 
 static void fifo_caller_del(const char *uuid)
@@ -2624,7 +3071,7 @@ SWITCH_STANDARD_APP(fifo_function)
 		}
 
 		if (!(node = switch_core_hash_find(globals.fifo_hash, nlist[i]))) {
-			node = create_node(nlist[i], importance, globals.sql_mutex);
+			node = create_node(nlist[i], importance);
 			node->ready = 1;
 		}
 
@@ -3352,6 +3799,7 @@ SWITCH_STANDARD_APP(fifo_function)
 										 switch_epoch_time_now(NULL), outbound_id);
 
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_member_update(outbound_id, MEMBER_CALL_START, 0);
 					fifo_inc_use_count(outbound_id);
 				}
 
@@ -3433,6 +3881,7 @@ SWITCH_STANDARD_APP(fifo_function)
 										 now, now, outbound_id);
 
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					fifo_member_update(outbound_id, MEMBER_CALL_DONE, now);
 
 					del_bridge_call(outbound_id);
 					fifo_dec_use_count(outbound_id);
@@ -4481,14 +4930,23 @@ static switch_status_t load_config(int reload, int del_all)
 
 	if ((reload && del_all) || (!reload && globals.delete_all_members_on_startup)) {
 		sql = switch_mprintf("delete from fifo_outbound where hostname='%q'", globals.hostname);
+		fifo_member_index_purge(SWITCH_TRUE);
 	} else {
 		sql = switch_mprintf("delete from fifo_outbound where static=1 and hostname='%q'", globals.hostname);
+		fifo_member_index_purge(SWITCH_FALSE);
 	}
 
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
 
+	if (!reload) {
+		sql = switch_mprintf("select uuid, fifo_name, originate_string, simo_count, timeout, lag, next_avail, static, "
+							 "outbound_call_count, outbound_fail_count, hostname, taking_calls, ring_count from fifo_outbound");
+		fifo_execute_sql_callback(globals.sql_mutex, sql, fifo_member_seed_callback, NULL);
+		switch_safe_free(sql);
+	}
+
 	if (!switch_core_hash_find(globals.fifo_hash, MANUAL_QUEUE_NAME)) {
-		node = create_node(MANUAL_QUEUE_NAME, 0, globals.sql_mutex);
+		node = create_node(MANUAL_QUEUE_NAME, 0);
 		node->ready = 2;
 		node->is_static = 0;
 	}
@@ -4515,7 +4973,7 @@ static switch_status_t load_config(int reload, int del_all)
 
 			switch_mutex_lock(globals.mutex);
 			if (!(node = switch_core_hash_find(globals.fifo_hash, name))) {
-				node = create_node(name, importance, globals.sql_mutex);
+				node = create_node(name, importance);
 			}
 
 			if ((val = switch_xml_attr(fifo, "outbound_name"))) {
@@ -4582,6 +5040,7 @@ static switch_status_t load_config(int reload, int del_all)
 				const char *simo, *taking_calls, *timeout, *lag;
 				int simo_i = 1, taking_calls_i = 1, timeout_i = 60, lag_i = 10;
 				char digest[SWITCH_MD5_DIGEST_STRING_SIZE] = { 0 };
+				fifo_member_t index_member = { 0 };
 
 				if (switch_stristr("fifo_outbound_uuid=", member->txt)) {
 					extract_fifo_outbound_uuid(member->txt, digest, sizeof(digest));
@@ -4617,8 +5076,18 @@ static switch_status_t load_config(int reload, int del_all)
 									 (long) switch_epoch_time_now(NULL));
 				switch_assert(sql);
 				fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
+
+				index_member.uuid = digest;
+				index_member.fifo_name = node->name;
+				index_member.originate_string = member->txt;
+				index_member.hostname = globals.hostname;
+				index_member.simo_count = simo_i;
+				index_member.timeout = timeout_i;
+				index_member.lag = lag_i;
+				index_member.is_static = 1;
+				index_member.taking_calls = taking_calls_i;
+				node->member_count = fifo_member_index_add(&index_member);
 				node->has_outbound = 1;
-				node->member_count++;
 			}
 			node->ready = 1;
 			node->is_static = 1;
@@ -4650,8 +5119,7 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 {
 	char digest[SWITCH_MD5_DIGEST_STRING_SIZE] = { 0 };
 	char *sql, *name_dup, *p;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
+	fifo_member_t index_member = { 0 };
 	fifo_node_t *node = NULL;
 
 	if (!fifo_name) return;
@@ -4668,7 +5136,7 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 
 	switch_mutex_lock(globals.mutex);
 	if (!(node = switch_core_hash_find(globals.fifo_hash, fifo_name))) {
-		node = create_node(fifo_name, 0, globals.sql_mutex);
+		node = create_node(fifo_name, 0);
 		node->ready = 1;
 	}
 	switch_mutex_unlock(globals.mutex);
@@ -4688,25 +5156,28 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
 	free(name_dup);
 
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", fifo_name);
-	fifo_execute_sql_callback(globals.sql_mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	index_member.uuid = digest;
+	index_member.fifo_name = fifo_name;
+	index_member.originate_string = originate_string;
+	index_member.hostname = globals.hostname;
+	index_member.simo_count = simo_count;
+	index_member.timeout = timeout;
+	index_member.lag = lag;
+	index_member.taking_calls = taking_calls;
+	node->member_count = fifo_member_index_add(&index_member);
 	if (node->member_count > 0) {
 		node->has_outbound = 1;
 	} else {
 		node->has_outbound = 0;
 	}
-	switch_safe_free(sql);
+
+	fifo_wake_node_thread();
 }
 
 static void fifo_member_del(char *fifo_name, char *originate_string)
 {
 	char digest[SWITCH_MD5_DIGEST_STRING_SIZE] = { 0 };
 	char *sql;
-	char outbound_count[80] = "";
-	callback_t cbt = { 0 };
 	fifo_node_t *node = NULL;
 
 	if (!fifo_name) return;
@@ -4723,22 +5194,17 @@ static void fifo_member_del(char *fifo_name, char *originate_string)
 
 	switch_mutex_lock(globals.mutex);
 	if (!(node = switch_core_hash_find(globals.fifo_hash, fifo_name))) {
-		node = create_node(fifo_name, 0, globals.sql_mutex);
+		node = create_node(fifo_name, 0);
 		node->ready = 1;
 	}
 	switch_mutex_unlock(globals.mutex);
 
-	cbt.buf = outbound_count;
-	cbt.len = sizeof(outbound_count);
-	sql = switch_mprintf("select count(*) from fifo_outbound where fifo_name = '%q'", node->name);
-	fifo_execute_sql_callback(globals.sql_mutex, sql, sql2str_callback, &cbt);
-	node->member_count = atoi(outbound_count);
+	node->member_count = fifo_member_index_del(node->name, digest, globals.hostname);
 	if (node->member_count > 0) {
 		node->has_outbound = 1;
 	} else {
 		node->has_outbound = 0;
 	}
-	switch_safe_free(sql);
 }
 
 #define FIFO_MEMBER_API_SYNTAX "[add <fifo_name> <originate_string> [<simo_count>] [<timeout>] [<lag>] [<expires>] [<taking_calls>] | del <fifo_name> <originate_string>]"
@@ -4850,6 +5316,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_fifo_load)
 	switch_core_hash_init(&globals.consumer_orig_hash);
 	switch_core_hash_init(&globals.bridge_hash);
 	switch_core_hash_init(&globals.use_hash);
+	switch_core_hash_init(&globals.member_hash);
+	switch_core_hash_init(&globals.member_uuid_hash);
+	switch_queue_create(&globals.node_wake_queue, 1, globals.pool);
 	switch_mutex_init(&globals.caller_orig_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 	switch_mutex_init(&globals.consumer_orig_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 	switch_mutex_init(&globals.bridge_mutex, SWITCH_MUTEX_NESTED, globals.pool);
@@ -4943,6 +5412,7 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_fifo_shutdown)
 	switch_core_hash_destroy(&globals.consumer_orig_hash);
 	switch_core_hash_destroy(&globals.bridge_hash);
 	switch_core_hash_destroy(&globals.use_hash);
+	fifo_member_index_destroy();
 	memset(&globals, 0, sizeof(globals));
 	switch_mutex_unlock(mutex);
 
@@ -38,26 +38,36 @@
 
 #define LIMIT_HASH_CLEANUP_INTERVAL 900
 
+/* The limit hash is split into this many shards by key hash, must be a power of two */
+#define LIMIT_HASH_SHARDS 64
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown);
 SWITCH_MODULE_DEFINITION(mod_hash, mod_hash_load, mod_hash_shutdown, NULL);
 
 /* CORE STUFF */
+typedef struct {
+	switch_thread_rwlock_t *rwlock;
+	switch_hash_t *hash;
+} limit_hash_shard_t;
+
 static struct {
 	switch_memory_pool_t *pool;
-	switch_thread_rwlock_t *limit_hash_rwlock;
-	switch_hash_t *limit_hash;
+	limit_hash_shard_t limit_shards[LIMIT_HASH_SHARDS];
+	uint32_t limit_cleanup_shard;
 	switch_thread_rwlock_t *db_hash_rwlock;
 	switch_hash_t *db_hash;
 	switch_thread_rwlock_t *remote_hash_rwlock;
 	switch_hash_t *remote_hash;
 } globals;
 
+/* Counters are only changed with atomic operations so any number of
+   calls can update an item while holding its shard's read lock */
 typedef struct {
-	uint32_t total_usage;	/* < Total */
-	uint32_t rate_usage;	/* < Current rate usage */
-	time_t last_check;		/* < Last rate check */
-	uint32_t interval;		/* < Interval used on last rate check */
+	switch_atomic_t total_usage;	/* < Total */
+	switch_atomic_t rate_usage;	/* < Current rate usage */
+	switch_atomic_t last_check;	/* < Last rate check */
+	switch_atomic_t interval;	/* < Interval used on last rate check */
 	switch_time_t last_update;	/* < Last updated timestamp (rate or total) */
 } limit_hash_item_t;
 
@@ -72,6 +82,7 @@ typedef struct callback callback_t;
 /* HASH STUFF */
 typedef struct {
 	switch_hash_t *hash;
+	switch_mutex_t *mutex;
 } limit_hash_private_t;
 
 typedef enum {
@@ -118,6 +129,67 @@ void limit_remote_destroy(limit_remote_t **r);
 static void do_config(switch_bool_t reload);
 
 
+static inline limit_hash_shard_t *limit_hash_shard(const char *hashkey)
+{
+	switch_ssize_t hlen = -1;
+
+	return &globals.limit_shards[switch_hashfunc_default(hashkey, &hlen) & (LIMIT_HASH_SHARDS - 1)];
+}
+
+/* Adds delta to an atomic counter without taking it below 0 and returns the new value */
+static uint32_t limit_atomic_add(switch_atomic_t *mem, int delta)
+{
+	uint32_t cur, val;
+
+	do {
+		cur = switch_atomic_read(mem);
+		if (delta < 0 && cur < (uint32_t) -delta) {
+			val = 0;
+		} else {
+			val = cur + delta;
+		}
+	} while (switch_atomic_cas(mem, val, cur) != cur);
+
+	return val;
+}
+
+/* Takes one more unit of total usage unless that would go over max, returns SWITCH_FALSE if it would */
+static switch_bool_t limit_total_take(limit_hash_item_t *item, int max, uint32_t remote_usage, uint32_t *usage)
+{
+	uint32_t cur;
+
+	do {
+		cur = switch_atomic_read(&item->total_usage);
+		if (max >= 0 && cur + 1 + remote_usage > (uint32_t) max) {
+			*usage = cur;
+			return SWITCH_FALSE;
+		}
+	} while (switch_atomic_cas(&item->total_usage, cur + 1, cur) != cur);
+
+	*usage = cur + 1;
+
+	return SWITCH_TRUE;
+}
+
+/* Counts one more call in the item's rate window, starting a new window if the last one is over */
+static uint32_t limit_rate_take(limit_hash_item_t *item, int interval, time_t now)
+{
+	uint32_t last_check;
+
+	switch_atomic_set(&item->interval, interval);
+
+	last_check = switch_atomic_read(&item->last_check);
+
+	/* Only the call that moves last_check starts the new window; calls counted
+	   by others between that and the reset below are lost, as the window just began */
+	if ((time_t) last_check <= (now - interval) && switch_atomic_cas(&item->last_check, (uint32_t) now, last_check) == last_check) {
+		switch_atomic_set(&item->rate_usage, 1);
+		return 0;
+	}
+
+	return limit_atomic_add(&item->rate_usage, 1);
+}
+
 /* \brief Enforces limit_hash restrictions
  * \param session current session
  * \param realm limit realm
@@ -125,6 +197,10 @@ static void do_config(switch_bool_t reload);
  * \param max maximum count
  * \param interval interval for rate limiting
  * \return SWITCH_TRUE if the access is allowed, SWITCH_FALSE if it isnt
+ *
+ * Only the shard the key falls in is locked, and only for reading unless
+ * the key has to be created, so calls on different keys never wait on
+ * each other.
  */
 SWITCH_LIMIT_INCR(limit_incr_hash)
 {
@@ -134,78 +210,96 @@ SWITCH_LIMIT_INCR(limit_incr_hash)
 	limit_hash_item_t *item = NULL;
 	time_t now = switch_epoch_time_now(NULL);
 	limit_hash_private_t *pvt = NULL;
+	limit_hash_shard_t *shard;
 	uint8_t increment = 1;
 	limit_hash_item_t remote_usage;
+	uint32_t total_usage, rate_usage;
 
 	hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
-
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	/* Check if that realm+resource has ever been checked */
-	if (!(item = (limit_hash_item_t *) switch_core_hash_find(globals.limit_hash, hashkey))) {
-		/* No, create an empty structure and add it, then continue like as if it existed */
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG10, "Creating new limit structure: key: %s\n", hashkey);
-		item = (limit_hash_item_t *) malloc(sizeof(limit_hash_item_t));
-		switch_assert(item);
-		memset(item, 0, sizeof(limit_hash_item_t));
-		switch_core_hash_insert(globals.limit_hash, hashkey, item);
-	}
+	shard = limit_hash_shard(hashkey);
 
 	if (!(pvt = switch_channel_get_private(channel, "limit_hash"))) {
 		pvt = (limit_hash_private_t *) switch_core_session_alloc(session, sizeof(limit_hash_private_t));
 		memset(pvt, 0, sizeof(limit_hash_private_t));
-		switch_channel_set_private(channel, "limit_hash", pvt);
+		switch_mutex_init(&pvt->mutex, SWITCH_MUTEX_NESTED, switch_core_session_get_pool(session));
+		/* a racing call on the same channel may have set its own, so use whichever the channel kept */
+		pvt = switch_channel_set_private_if_absent(channel, "limit_hash", pvt);
 	}
+
+	switch_mutex_lock(pvt->mutex);
 	if (!(pvt->hash)) {
 		switch_core_hash_init(&pvt->hash);
 	}
 	increment = !switch_core_hash_find(pvt->hash, hashkey);
- 	remote_usage = get_remote_usage(hashkey);
+	remote_usage = get_remote_usage(hashkey);
+
+	switch_thread_rwlock_rdlock(shard->rwlock);
+	/* Check if that realm+resource has ever been checked */
+	if (!(item = (limit_hash_item_t *) switch_core_hash_find(shard->hash, hashkey))) {
+		switch_thread_rwlock_unlock(shard->rwlock);
+		switch_thread_rwlock_wrlock(shard->rwlock);
+
+		if (!(item = (limit_hash_item_t *) switch_core_hash_find(shard->hash, hashkey))) {
+			/* No, create an empty structure and add it, then continue like as if it existed */
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG10, "Creating new limit structure: key: %s\n", hashkey);
+			item = (limit_hash_item_t *) malloc(sizeof(limit_hash_item_t));
+			switch_assert(item);
+			memset(item, 0, sizeof(limit_hash_item_t));
+			switch_core_hash_insert(shard->hash, hashkey, item);
+		}
+	}
 
 	if (interval > 0) {
-		item->interval = interval;
-		if (item->last_check <= (now - interval)) {
-			item->rate_usage = 1;
-			item->last_check = now;
+		/* Always increment rate when its checked as it doesnt depend on the channel */
+		if (!(rate_usage = limit_rate_take(item, interval, now))) {
+			rate_usage = 1;
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG10, "Usage for %s reset to 1\n",
 							  hashkey);
-		} else {
-			/* Always increment rate when its checked as it doesnt depend on the channel */
-			item->rate_usage++;
+		} else if ((max >= 0) && (rate_usage > (uint32_t) max)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s exceeds maximum rate of %d/%ds, now at %d\n",
+							  hashkey, max, interval, rate_usage);
+			status = SWITCH_STATUS_GENERR;
+			goto end;
+		}
 
-			if ((max >= 0) && (item->rate_usage > (uint32_t) max)) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s exceeds maximum rate of %d/%ds, now at %d\n",
-								  hashkey, max, interval, item->rate_usage);
+		total_usage = increment ? limit_atomic_add(&item->total_usage, 1) : switch_atomic_read(&item->total_usage);
+	} else {
+		rate_usage = switch_atomic_read(&item->rate_usage);
+
+		if (increment) {
+			if (!limit_total_take(item, max, remote_usage.total_usage, &total_usage)) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, total_usage);
 				status = SWITCH_STATUS_GENERR;
 				goto end;
 			}
+		} else if ((max >= 0) && ((total_usage = switch_atomic_read(&item->total_usage)) + remote_usage.total_usage > (uint32_t) max)) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, total_usage);
+			status = SWITCH_STATUS_GENERR;
+			goto end;
+		} else {
+			total_usage = switch_atomic_read(&item->total_usage);
 		}
-	} else if ((max >= 0) && (item->total_usage + increment + remote_usage.total_usage > (uint32_t) max)) {
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_INFO, "Usage for %s is already at max value (%d)\n", hashkey, item->total_usage);
-		status = SWITCH_STATUS_GENERR;
-		goto end;
 	}
 
 	if (increment) {
-		item->total_usage++;
-
 		switch_core_hash_insert(pvt->hash, hashkey, item);
 
 		if (max == -1) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, item->total_usage + remote_usage.total_usage);
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, total_usage + remote_usage.total_usage);
 		} else if (interval == 0) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d\n", hashkey, item->total_usage + remote_usage.total_usage, max);
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d\n", hashkey, total_usage + remote_usage.total_usage, max);
 		} else {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d/%d for the last %d seconds\n", hashkey,
-							  item->rate_usage, max, interval);
+							  rate_usage, max, interval);
 		}
 
-		switch_limit_fire_event("hash", realm, resource, item->total_usage, item->rate_usage, max, max >= 0 ? (uint32_t) max : 0);
+		switch_limit_fire_event("hash", realm, resource, total_usage, rate_usage, max, max >= 0 ? (uint32_t) max : 0);
 	}
 
 	/* Save current usage & rate into channel variables so it can be used later in the dialplan, or added to CDR records */
 	{
-		const char *susage = switch_core_session_sprintf(session, "%d", item->total_usage);
-		const char *srate = switch_core_session_sprintf(session, "%d", item->rate_usage);
+		const char *susage = switch_core_session_sprintf(session, "%d", total_usage);
+		const char *srate = switch_core_session_sprintf(session, "%d", rate_usage);
 
 		switch_channel_set_variable(channel, "limit_usage", susage);
 		switch_channel_set_variable(channel, switch_core_session_sprintf(session, "limit_usage_%s", hashkey), susage);
@@ -215,7 +309,8 @@ SWITCH_LIMIT_INCR(limit_incr_hash)
 	}
 
   end:
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
+	switch_thread_rwlock_unlock(shard->rwlock);
+	switch_mutex_unlock(pvt->mutex);
 	return status;
 }
 
@@ -225,7 +320,7 @@ SWITCH_HASH_DELETE_FUNC(limit_hash_cleanup_delete_callback) {
 	time_t now = switch_epoch_time_now(NULL);
 
 	/* reset to 0 if window has passed so we can clean it up */
-	if (item->rate_usage > 0 && (item->last_check <= (now - item->interval))) {
+	if (item->rate_usage > 0 && ((time_t) item->last_check <= (now - item->interval))) {
 		item->rate_usage = 0;
 	}
 
@@ -253,17 +348,47 @@ SWITCH_HASH_DELETE_FUNC(limit_hash_remote_cleanup_callback)
 	return SWITCH_FALSE;
 }
 
-/* !\brief Periodically checks for unused limit entries and frees them */
+/* !\brief Periodically checks for unused limit entries and frees them
+ *
+ * Each run only cleans up one shard so the others are never held up;
+ * every shard still gets visited once per LIMIT_HASH_CLEANUP_INTERVAL.
+ */
 SWITCH_STANDARD_SCHED_FUNC(limit_hash_cleanup_callback)
 {
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	if (globals.limit_hash) {
-		switch_core_hash_delete_multi(globals.limit_hash, limit_hash_cleanup_delete_callback, NULL);
+	limit_hash_shard_t *shard = &globals.limit_shards[globals.limit_cleanup_shard++ & (LIMIT_HASH_SHARDS - 1)];
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	if (shard->hash) {
+		switch_core_hash_delete_multi(shard->hash, limit_hash_cleanup_delete_callback, NULL);
 	}
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
+	switch_thread_rwlock_unlock(shard->rwlock);
 
-	if (globals.limit_hash) {	
-		task->runtime = switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL;
+	if (shard->hash) {
+		task->runtime = switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL / LIMIT_HASH_SHARDS;
+	}
+}
+
+/* Drops one unit of total usage, freeing the item once nothing uses it anymore */
+static void limit_hash_item_release(switch_core_session_t *session, const char *hashkey, limit_hash_item_t *item)
+{
+	limit_hash_shard_t *shard = limit_hash_shard(hashkey);
+	uint32_t total_usage;
+
+	switch_thread_rwlock_rdlock(shard->rwlock);
+	total_usage = limit_atomic_add(&item->total_usage, -1);
+	switch_thread_rwlock_unlock(shard->rwlock);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", hashkey, total_usage);
+
+	if (total_usage == 0) {
+		/* Another call may have picked the item up again while we were not holding the lock */
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		if ((item = (limit_hash_item_t *) switch_core_hash_find(shard->hash, hashkey)) && item->total_usage == 0 && item->rate_usage == 0) {
+			/* Noone is using this item anymore */
+			switch_core_hash_delete(shard->hash, hashkey);
+			free(item);
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 }
 
@@ -274,10 +399,14 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 	limit_hash_private_t *pvt = switch_channel_get_private(channel, "limit_hash");
 	limit_hash_item_t *item = NULL;
 
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
+	if (!pvt) {
+		return SWITCH_STATUS_SUCCESS;
+	}
 
-	if (!pvt || !pvt->hash) {
-		switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
+	switch_mutex_lock(pvt->mutex);
+
+	if (!pvt->hash) {
+		switch_mutex_unlock(pvt->mutex);
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -293,14 +422,7 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 			switch_core_hash_this(hi, &key, &keylen, &val);
 
 			item = (limit_hash_item_t *) val;
-			item->total_usage--;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", (const char *) key, item->total_usage);
-
-			if (item->total_usage == 0 && item->rate_usage == 0) {
-				/* Noone is using this item anymore */
-				switch_core_hash_delete(globals.limit_hash, (const char *) key);
-				free(item);
-			}
+			limit_hash_item_release(session, (const char *) key, item);
 
 			switch_core_hash_delete(pvt->hash, (const char *) key);
 		}
@@ -309,20 +431,12 @@ SWITCH_LIMIT_RELEASE(limit_release_hash)
 		char *hashkey = switch_core_session_sprintf(session, "%s_%s", realm, resource);
 
 		if ((item = (limit_hash_item_t *) switch_core_hash_find(pvt->hash, hashkey))) {
-			item->total_usage--;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Usage for %s is now %d\n", (const char *) hashkey, item->total_usage);
-
 			switch_core_hash_delete(pvt->hash, hashkey);
-
-			if (item->total_usage == 0 && item->rate_usage == 0) {
-				/* Noone is using this item anymore */
-				switch_core_hash_delete(globals.limit_hash, (const char *) hashkey);
-				free(item);
-			}
+			limit_hash_item_release(session, hashkey, item);
 		}
 	}
 
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
+	switch_mutex_unlock(pvt->mutex);
 	
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -331,24 +445,26 @@ SWITCH_LIMIT_USAGE(limit_usage_hash)
 {
 	char *hash_key = NULL;
 	limit_hash_item_t *item = NULL;
+	limit_hash_shard_t *shard;
 	int count = 0;
 	limit_hash_item_t remote_usage;
 
-	switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
-
 	hash_key = switch_mprintf("%s_%s", realm, resource);
 	remote_usage = get_remote_usage(hash_key);
 	
 	count = remote_usage.total_usage;
 	*rcount = remote_usage.rate_usage;
 
-	if ((item = switch_core_hash_find(globals.limit_hash, hash_key))) {
-		count += item->total_usage;
-		*rcount += item->rate_usage;
+	shard = limit_hash_shard(hash_key);
+	switch_thread_rwlock_rdlock(shard->rwlock);
+
+	if ((item = switch_core_hash_find(shard->hash, hash_key))) {
+		count += switch_atomic_read(&item->total_usage);
+		*rcount += switch_atomic_read(&item->rate_usage);
 	}
 
+	switch_thread_rwlock_unlock(shard->rwlock);
  	switch_safe_free(hash_key);
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 
 	return count;
 }
@@ -362,17 +478,19 @@ SWITCH_LIMIT_INTERVAL_RESET(limit_interval_reset_hash)
 {
 	char *hash_key = NULL;
 	limit_hash_item_t *item = NULL;
-
-	switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
+	limit_hash_shard_t *shard;
 
 	hash_key = switch_mprintf("%s_%s", realm, resource);
-	if ((item = switch_core_hash_find(globals.limit_hash, hash_key))) {
-		item->rate_usage = 0;
-		item->last_check = switch_epoch_time_now(NULL);
+	shard = limit_hash_shard(hash_key);
+
+	switch_thread_rwlock_rdlock(shard->rwlock);
+	if ((item = switch_core_hash_find(shard->hash, hash_key))) {
+		switch_atomic_set(&item->rate_usage, 0);
+		switch_atomic_set(&item->last_check, (uint32_t) switch_epoch_time_now(NULL));
 	}
+	switch_thread_rwlock_unlock(shard->rwlock);
 
  	switch_safe_free(hash_key);
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -614,19 +732,26 @@ SWITCH_STANDARD_API(hash_dump_function)
 	}
 	
 	if (mode & 1) {
-		switch_thread_rwlock_rdlock(globals.limit_hash_rwlock);
-		for (hi = switch_core_hash_first(globals.limit_hash); hi; hi = switch_core_hash_next(&hi)) {
-			void *val = NULL;
-			const void *key;
-			switch_ssize_t keylen;
-			limit_hash_item_t *item;
-			switch_core_hash_this(hi, &key, &keylen, &val);
-						
-			item = (limit_hash_item_t *)val;
+		int i;
+
+		for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+			limit_hash_shard_t *shard = &globals.limit_shards[i];
 
-			stream->write_function(stream, "L/%s/%d/%d/%d/%d\n", key, item->total_usage, item->rate_usage, item->interval, item->last_check);
+			switch_thread_rwlock_rdlock(shard->rwlock);
+			for (hi = switch_core_hash_first(shard->hash); hi; hi = switch_core_hash_next(&hi)) {
+				void *val = NULL;
+				const void *key;
+				switch_ssize_t keylen;
+				limit_hash_item_t *item;
+				switch_core_hash_this(hi, &key, &keylen, &val);
+
+				item = (limit_hash_item_t *)val;
+
+				stream->write_function(stream, "L/%s/%d/%d/%d/%d\n", key, switch_atomic_read(&item->total_usage), switch_atomic_read(&item->rate_usage),
+									   switch_atomic_read(&item->interval), switch_atomic_read(&item->last_check));
+			}
+			switch_thread_rwlock_unlock(shard->rwlock);
 		}
-		switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	}
 	
 	if (mode & 2) {
@@ -965,6 +1090,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load)
 	switch_api_interface_t *commands_api_interface;
 	switch_limit_interface_t *limit_interface;
 	switch_status_t status;
+	int i;
 
 	memset(&globals, 0, sizeof(globals));
 	globals.pool = pool;
@@ -975,10 +1101,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load)
 		return SWITCH_STATUS_FALSE;
 	}
 
-	switch_thread_rwlock_create(&globals.limit_hash_rwlock, globals.pool);
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		switch_thread_rwlock_create(&globals.limit_shards[i].rwlock, globals.pool);
+		switch_core_hash_init(&globals.limit_shards[i].hash);
+	}
 	switch_thread_rwlock_create(&globals.db_hash_rwlock, globals.pool);
 	switch_thread_rwlock_create(&globals.remote_hash_rwlock, globals.pool);
-	switch_core_hash_init(&globals.limit_hash);
 	switch_core_hash_init(&globals.db_hash);
 	switch_core_hash_init(&globals.remote_hash);
 
@@ -988,7 +1116,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_hash_load)
 	/* register limit interfaces */
 	SWITCH_ADD_LIMIT(limit_interface, "hash", limit_incr_hash, limit_release_hash, limit_usage_hash, limit_reset_hash, limit_status_hash, limit_interval_reset_hash);
 
-	switch_scheduler_add_task(switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL, limit_hash_cleanup_callback, "limit_hash_cleanup", "mod_hash", 0, NULL,
+	switch_scheduler_add_task(switch_epoch_time_now(NULL) + LIMIT_HASH_CLEANUP_INTERVAL / LIMIT_HASH_SHARDS, limit_hash_cleanup_callback, "limit_hash_cleanup", "mod_hash", 0, NULL,
 						  SSHF_NONE);
 	
 	SWITCH_ADD_APP(app_interface, "hash", "Insert into the hashtable", HASH_DESC, hash_function, HASH_USAGE, SAF_SUPPORT_NOMEDIA | SAF_ZOMBIE_EXEC)
@@ -1015,6 +1143,7 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 {
 	switch_hash_index_t *hi = NULL;
 	switch_bool_t remote_clean = SWITCH_TRUE;
+	int i;
 	
 	switch_scheduler_del_task_group("mod_hash");
 
@@ -1042,17 +1171,24 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 		}
 	}
 
-	switch_thread_rwlock_wrlock(globals.limit_hash_rwlock);
-	switch_thread_rwlock_wrlock(globals.db_hash_rwlock);
-	
-	while ((hi = switch_core_hash_first_iter( globals.limit_hash, hi))) {
-		void *val = NULL;
-		const void *key;
-		switch_ssize_t keylen;
-		switch_core_hash_this(hi, &key, &keylen, &val);
-		free(val);
-		switch_core_hash_delete(globals.limit_hash, key);
+	for (i = 0; i < LIMIT_HASH_SHARDS; i++) {
+		limit_hash_shard_t *shard = &globals.limit_shards[i];
+
+		switch_thread_rwlock_wrlock(shard->rwlock);
+		while ((hi = switch_core_hash_first_iter( shard->hash, hi))) {
+			void *val = NULL;
+			const void *key;
+			switch_ssize_t keylen;
+			switch_core_hash_this(hi, &key, &keylen, &val);
+			free(val);
+			switch_core_hash_delete(shard->hash, key);
+		}
+		switch_core_hash_destroy(&shard->hash);
+		switch_thread_rwlock_unlock(shard->rwlock);
+		switch_thread_rwlock_destroy(shard->rwlock);
 	}
+
+	switch_thread_rwlock_wrlock(globals.db_hash_rwlock);
 	
 	while ((hi = switch_core_hash_first_iter( globals.db_hash, hi))) {
 		void *val = NULL;
@@ -1063,15 +1199,12 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_hash_shutdown)
 		switch_core_hash_delete(globals.db_hash, key);
 	}
 
-	switch_core_hash_destroy(&globals.limit_hash);
 	switch_core_hash_destroy(&globals.db_hash);	
 	switch_core_hash_destroy(&globals.remote_hash);
 
-	switch_thread_rwlock_unlock(globals.limit_hash_rwlock);
 	switch_thread_rwlock_unlock(globals.db_hash_rwlock);
 
 	switch_thread_rwlock_destroy(globals.db_hash_rwlock);
-	switch_thread_rwlock_destroy(globals.limit_hash_rwlock);
 	switch_thread_rwlock_destroy(globals.remote_hash_rwlock);
 
 
@@ -0,0 +1,295 @@
+/* 
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * 
+ * Anthony Minessale II <anthm@freeswitch.org>
+ *
+ *
+ * dp_index.c -- destination_number index over the static XML dialplan
+ *
+ * Most extensions start with a destination_number condition anchored on a literal prefix.  Filing each
+ * extension under that prefix lets a call skip every extension whose prefix its destination_number does
+ * not start with, while the ones the index cannot reason about are always tried.
+ *
+ */
+#include "dp_index.h"
+
+static const char *DP_INDEX_TIME_ATTRS[] = {
+	"date-time", "year", "yday", "mon", "mday", "week", "mweek", "wday", "hour", "minute",
+	"minute-of-day", "time-of-day", "tz-offset", "dst", NULL
+};
+
+/* Works out the literal text destination_number must start with for the first condition of
+   the extension to match. Returns SWITCH_FALSE when failing that condition could still do
+   something (anti-actions, a different break, variables, times...), then we always try it. */
+switch_bool_t dp_index_exten_prefix(switch_xml_t xexten, char *prefix, switch_size_t len)
+{
+	switch_xml_t xcond, xexpression;
+	const char *field, *do_break, *expression, *p;
+	switch_size_t x = 0;
+	int depth = 0, klass = 0;
+	int i;
+
+	*prefix = '\0';
+
+	if (!(xcond = switch_xml_child(xexten, "condition"))) {
+		return SWITCH_FALSE;
+	}
+
+	if (!(field = switch_xml_attr(xcond, "field")) || strcasecmp(field, "destination_number")) {
+		return SWITCH_FALSE;
+	}
+
+	if (switch_xml_attr(xcond, "regex") || switch_xml_child(xcond, "anti-action")) {
+		return SWITCH_FALSE;
+	}
+
+	if ((do_break = switch_xml_attr(xcond, "break")) && strcasecmp(do_break, "on-false")) {
+		return SWITCH_FALSE;
+	}
+
+	for (i = 0; DP_INDEX_TIME_ATTRS[i]; i++) {
+		if (switch_xml_attr(xcond, DP_INDEX_TIME_ATTRS[i])) {
+			return SWITCH_FALSE;
+		}
+	}
+
+	if ((xexpression = switch_xml_child(xcond, "expression"))) {
+		expression = switch_str_nil(xexpression->txt);
+	} else {
+		expression = switch_xml_attr_soft(xcond, "expression");
+	}
+
+	if (*expression != '^' || strstr(expression, "${")) {
+		return SWITCH_FALSE;
+	}
+
+	/* an alternative at the top level can match without our prefix */
+	for (p = expression; *p; p++) {
+		if (*p == '\\') {
+			if (!*++p) {
+				break;
+			}
+		} else if (klass) {
+			klass = *p != ']';
+		} else if (*p == '[') {
+			klass = 1;
+		} else if (*p == '(') {
+			depth++;
+		} else if (*p == ')') {
+			depth--;
+		} else if (*p == '|' && !depth) {
+			return SWITCH_FALSE;
+		}
+	}
+
+	for (p = expression + 1; *p && x < len - 1; p++) {
+		char c = *p;
+
+		if (c == '\\') {
+			if (!p[1] || isalnum((unsigned char) p[1])) {
+				break;
+			}
+			c = *++p;
+		} else if (strchr(".[]()|*+?{}^$", c)) {
+			break;
+		}
+
+		/* a character that may be repeated zero times is not required */
+		if (p[1] == '?' || p[1] == '*' || p[1] == '{') {
+			break;
+		}
+
+		prefix[x++] = c;
+
+		if (p[1] == '+') {
+			break;
+		}
+	}
+
+	prefix[x] = '\0';
+
+	return SWITCH_TRUE;
+}
+
+static dp_context_index_t *dp_index_context(dp_index_t *index, switch_xml_t xcontext)
+{
+	dp_context_index_t *cindex;
+	switch_xml_t xexten;
+	char prefix[DP_INDEX_MAX_PREFIX];
+	uint32_t pos = 0, indexed = 0;
+
+	cindex = switch_core_alloc(index->pool, sizeof(*cindex));
+	cindex->xcontext = xcontext;
+	switch_core_hash_init(&cindex->prefixes);
+
+	for (xexten = switch_xml_child(xcontext, "extension"); xexten; xexten = xexten->next) {
+		cindex->count++;
+	}
+
+	cindex->extensions = switch_core_alloc(index->pool, sizeof(switch_xml_t) * (cindex->count + 1));
+
+	for (xexten = switch_xml_child(xcontext, "extension"); xexten; xexten = xexten->next, pos++) {
+		dp_index_list_t *list;
+		dp_index_slot_t *slot;
+
+		cindex->extensions[pos] = xexten;
+
+		if (dp_index_exten_prefix(xexten, prefix, sizeof(prefix))) {
+			indexed++;
+		}
+
+		if (!(list = switch_core_hash_find(cindex->prefixes, prefix))) {
+			list = switch_core_alloc(index->pool, sizeof(*list));
+			switch_core_hash_insert(cindex->prefixes, prefix, list);
+		}
+
+		slot = switch_core_alloc(index->pool, sizeof(*slot));
+		slot->pos = pos;
+
+		if (list->tail) {
+			list->tail->next = slot;
+		} else {
+			list->head = slot;
+		}
+		list->tail = slot;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Indexed %u of %u extension(s) in context %s by destination_number\n",
+					  indexed, cindex->count, switch_xml_attr_soft(xcontext, "name"));
+
+	return cindex;
+}
+
+void dp_index_free(dp_index_t *index)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	for (hi = switch_core_hash_first(index->contexts); hi; hi = switch_core_hash_next(&hi)) {
+		dp_context_index_t *cindex;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		cindex = (dp_context_index_t *) val;
+		switch_core_hash_destroy(&cindex->prefixes);
+	}
+
+	switch_core_hash_destroy(&index->contexts);
+	switch_xml_free(index->root);
+	switch_core_destroy_memory_pool(&index->pool);
+}
+
+/* Index every context of the dialplan section in an xml root */
+dp_index_t *dp_index_build(switch_xml_t root)
+{
+	switch_memory_pool_t *pool = NULL;
+	dp_index_t *index;
+	switch_xml_t section, cfg, xcontext;
+
+	switch_core_new_memory_pool(&pool);
+	index = switch_core_alloc(pool, sizeof(*index));
+	index->pool = pool;
+	index->refs = 1;
+	index->root = root;
+	switch_core_hash_init(&index->contexts);
+
+	if ((section = switch_xml_find_child(index->root, "section", "name", "dialplan")) && (cfg = switch_xml_find_child(section, "dialplan", NULL, NULL))) {
+		for (xcontext = switch_xml_child(cfg, "context"); xcontext; xcontext = xcontext->next) {
+			const char *name = switch_xml_attr(xcontext, "name");
+
+			/* lookups by name only ever see the first context of that name */
+			if (!zstr(name) && !switch_core_hash_find(index->contexts, name)) {
+				switch_core_hash_insert(index->contexts, name, dp_index_context(index, xcontext));
+			}
+		}
+	}
+
+	return index;
+}
+
+dp_context_index_t *dp_index_find_context(dp_index_t *index, switch_xml_t xcontext)
+{
+	dp_context_index_t *cindex = switch_core_hash_find(index->contexts, switch_xml_attr_soft(xcontext, "name"));
+
+	return cindex && cindex->xcontext == xcontext ? cindex : NULL;
+}
+
+void dp_index_walk_init(dp_index_walk_t *walk, dp_context_index_t *cindex, const char *dest)
+{
+	char prefix[DP_INDEX_MAX_PREFIX];
+	int x;
+
+	memset(walk, 0, sizeof(*walk));
+	walk->cindex = cindex;
+	dest = switch_str_nil(dest);
+
+	/* gather every list whose prefix destination_number starts with, the rest cannot match */
+	for (x = 0; x < DP_INDEX_MAX_PREFIX; x++) {
+		dp_index_list_t *list;
+
+		memcpy(prefix, dest, x);
+		prefix[x] = '\0';
+
+		if ((list = switch_core_hash_find(cindex->prefixes, prefix))) {
+			walk->slots[walk->count++] = list->head;
+		}
+
+		if (!dest[x]) {
+			break;
+		}
+	}
+}
+
+/* Walks the gathered lists merged back into document order */
+switch_xml_t dp_index_walk_next(dp_index_walk_t *walk)
+{
+	int x, low = -1;
+	uint32_t pos;
+
+	for (x = 0; x < walk->count; x++) {
+		if (walk->slots[x] && (low < 0 || walk->slots[x]->pos < walk->slots[low]->pos)) {
+			low = x;
+		}
+	}
+
+	if (low < 0) {
+		return NULL;
+	}
+
+	pos = walk->slots[low]->pos;
+	walk->slots[low] = walk->slots[low]->next;
+
+	return walk->cindex->extensions[pos];
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
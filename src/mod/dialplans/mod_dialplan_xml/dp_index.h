@@ -0,0 +1,116 @@
+/* 
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * 
+ * Anthony Minessale II <anthm@freeswitch.org>
+ *
+ *
+ * dp_index.h -- destination_number index over the static XML dialplan
+ *
+ */
+#ifndef DP_INDEX_H
+#define DP_INDEX_H
+
+#include <switch.h>
+
+SWITCH_BEGIN_EXTERN_C
+
+#define DP_INDEX_MAX_PREFIX 128
+
+/*! \brief Extensions sharing the same required destination_number prefix, in document order */
+typedef struct dp_index_slot {
+	uint32_t pos;
+	struct dp_index_slot *next;
+} dp_index_slot_t;
+
+typedef struct {
+	dp_index_slot_t *head;
+	dp_index_slot_t *tail;
+} dp_index_list_t;
+
+/*! \brief One context of the static dialplan, with its extensions filed by the prefix a call needs to reach them */
+typedef struct {
+	switch_xml_t xcontext;
+	switch_xml_t *extensions;
+	uint32_t count;
+	/*! extensions that can only match when destination_number starts with the key, "" for the ones we must always try */
+	switch_hash_t *prefixes;
+} dp_context_index_t;
+
+typedef struct {
+	/*! the xml root the index points into, we hold a reference on it */
+	switch_xml_t root;
+	switch_hash_t *contexts;
+	switch_memory_pool_t *pool;
+	uint32_t refs;
+} dp_index_t;
+
+/*! \brief A walk over the extensions of one context that may match a destination_number, in document order */
+typedef struct {
+	dp_context_index_t *cindex;
+	dp_index_slot_t *slots[DP_INDEX_MAX_PREFIX];
+	int count;
+} dp_index_walk_t;
+
+/*!
+  \brief Work out the literal text destination_number must start with for an extension to match
+  \param xexten the extension
+  \param prefix buffer for the prefix, empty when there is none
+  \param len the size of the buffer
+  \return SWITCH_FALSE when the extension has to be tried whatever the destination_number is
+*/
+switch_bool_t dp_index_exten_prefix(switch_xml_t xexten, char *prefix, switch_size_t len);
+
+/*!
+  \brief Index every context of the dialplan section of an xml root
+  \param root the root, the index takes over the caller's reference on it
+  \return the index with one reference held by the caller
+*/
+dp_index_t *dp_index_build(switch_xml_t root);
+
+void dp_index_free(dp_index_t *index);
+
+/*!
+  \brief Find the index of a context
+  \return NULL when the context is not the one the index was built from
+*/
+dp_context_index_t *dp_index_find_context(dp_index_t *index, switch_xml_t xcontext);
+
+void dp_index_walk_init(dp_index_walk_t *walk, dp_context_index_t *cindex, const char *dest);
+
+/*! \brief The next extension of the walk, NULL when there are no more */
+switch_xml_t dp_index_walk_next(dp_index_walk_t *walk);
+
+SWITCH_END_EXTERN_C
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet
+ */
@@ -33,9 +33,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include "dp_index.h"
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_dialplan_xml_load);
-SWITCH_MODULE_DEFINITION(mod_dialplan_xml, mod_dialplan_xml_load, NULL, NULL);
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialplan_xml_shutdown);
+SWITCH_MODULE_DEFINITION(mod_dialplan_xml, mod_dialplan_xml_load, mod_dialplan_xml_shutdown, NULL);
 
 typedef enum {
 	BREAK_ON_TRUE,
@@ -44,6 +46,14 @@ typedef enum {
 	BREAK_NEVER
 } break_t;
 
+static struct {
+	switch_mutex_t *mutex;
+	/*! held by whoever is building a new index, only one of them at a time */
+	switch_mutex_t *build_mutex;
+	dp_index_t *index;
+	switch_event_node_t *reload_node;
+} globals;
+
 
 static switch_status_t exec_app(switch_core_session_t *session, const char *app, const char *arg)
 {
@@ -598,6 +608,86 @@ static int parse_exten(switch_core_session_t *session, switch_caller_profile_t *
 	return proceed;
 }
 
+static void dp_index_release(dp_index_t *index)
+{
+	int last;
+
+	switch_mutex_lock(globals.mutex);
+	last = !--index->refs;
+	switch_mutex_unlock(globals.mutex);
+
+	if (last) {
+		dp_index_free(index);
+	}
+}
+
+static void dp_index_install(dp_index_t *index)
+{
+	dp_index_t *old;
+
+	switch_mutex_lock(globals.mutex);
+	old = globals.index;
+	globals.index = index;
+	switch_mutex_unlock(globals.mutex);
+
+	if (old) {
+		dp_index_release(old);
+	}
+}
+
+static dp_index_t *dp_index_get(switch_xml_t xml)
+{
+	dp_index_t *index;
+
+	switch_mutex_lock(globals.mutex);
+	if ((index = globals.index) && index->root == xml) {
+		index->refs++;
+	} else {
+		index = NULL;
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	return index;
+}
+
+/* Build an index of the current static root and install it, callers hold globals.build_mutex */
+static void dp_index_rebuild(void)
+{
+	dp_index_install(dp_index_build(switch_xml_root()));
+}
+
+/* Find the index for the xml a call is being routed with, only the static root ever has one */
+static dp_index_t *dp_index_acquire(switch_xml_t xml)
+{
+	dp_index_t *index;
+
+	if (!switch_test_flag(xml, SWITCH_XML_ROOT)) {
+		return NULL;
+	}
+
+	if ((index = dp_index_get(xml))) {
+		return index;
+	}
+
+	/* the root moved on without us hearing about it, one call rebuilds while the others walk the dialplan */
+	if (switch_mutex_trylock(globals.build_mutex) == SWITCH_STATUS_SUCCESS) {
+		if (!(index = dp_index_get(xml))) {
+			dp_index_rebuild();
+			index = dp_index_get(xml);
+		}
+		switch_mutex_unlock(globals.build_mutex);
+	}
+
+	return index;
+}
+
+static void dp_index_reload_event_handler(switch_event_t *event)
+{
+	switch_mutex_lock(globals.build_mutex);
+	dp_index_rebuild();
+	switch_mutex_unlock(globals.build_mutex);
+}
+
 static switch_status_t dialplan_xml_locate(switch_core_session_t *session, switch_caller_profile_t *caller_profile, switch_xml_t *root,
 										   switch_xml_t *node)
 {
@@ -615,6 +705,33 @@ static switch_status_t dialplan_xml_locate(switch_core_session_t *session, switc
 	return status;
 }
 
+/* Runs one extension, returns true when the hunt should stop here */
+static int hunt_exten(switch_core_session_t *session, switch_caller_profile_t *caller_profile, switch_xml_t xexten, switch_caller_extension_t **extension)
+{
+	switch_channel_t *channel = switch_core_session_get_channel(session);
+	int proceed = 0;
+	const char *cont = switch_xml_attr(xexten, "continue");
+	const char *exten_name = switch_xml_attr(xexten, "name");
+
+	if (!exten_name) {
+		exten_name = "UNKNOWN";
+	}
+
+	if ( switch_core_test_flag(SCF_DIALPLAN_TIMESTAMPS) ) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+					  "Dialplan: %s parsing [%s->%s] continue=%s\n",
+					  switch_channel_get_name(channel), caller_profile->context, exten_name, cont ? cont : "false");
+	} else {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG_CLEAN(session), SWITCH_LOG_DEBUG,
+					  "Dialplan: %s parsing [%s->%s] continue=%s\n",
+					  switch_channel_get_name(channel), caller_profile->context, exten_name, cont ? cont : "false");
+	}
+
+	proceed = parse_exten(session, caller_profile, xexten, extension, exten_name, 0);
+
+	return proceed && !switch_true(cont);
+}
+
 SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 {
 	switch_caller_extension_t *extension = NULL;
@@ -622,6 +739,7 @@ SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 	switch_xml_t alt_root = NULL, cfg, xml = NULL, xcontext, xexten = NULL;
 	char *alt_path = (char *) arg;
 	const char *hunt = NULL;
+	dp_index_t *index = NULL;
 
 	if (!caller_profile) {
 		if (!(caller_profile = switch_channel_get_caller_profile(channel))) {
@@ -673,38 +791,54 @@ SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 		xexten = switch_xml_find_child(xcontext, "extension", "name", caller_profile->destination_number);
 	}
 
-	if (!xexten) {
-		xexten = switch_xml_child(xcontext, "extension");
-	}
+	if (!xexten && !alt_root && (index = dp_index_acquire(xml))) {
+		dp_context_index_t *cindex = dp_index_find_context(index, xcontext);
 
-	while (xexten) {
-		int proceed = 0;
-		const char *cont = switch_xml_attr(xexten, "continue");
-		const char *exten_name = switch_xml_attr(xexten, "name");
+		if (cindex) {
+			dp_index_walk_t walk;
+			const char *dest = switch_core_session_strdup(session, switch_str_nil(caller_profile->destination_number));
 
-		if (!exten_name) {
-			exten_name = "UNKNOWN";
-		}
+			dp_index_walk_init(&walk, cindex, dest);
 
-		if ( switch_core_test_flag(SCF_DIALPLAN_TIMESTAMPS) ) {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
-						  "Dialplan: %s parsing [%s->%s] continue=%s\n",
-						  switch_channel_get_name(channel), caller_profile->context, exten_name, cont ? cont : "false");
+			while ((xexten = dp_index_walk_next(&walk))) {
+				if (hunt_exten(session, caller_profile, xexten, &extension)) {
+					xexten = NULL;
+					break;
+				}
+
+				/* an inline action changed destination_number, what the index skips from here on could match now */
+				if (strcmp(switch_str_nil(caller_profile->destination_number), dest)) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
+									  "destination_number changed to %s, walking the rest of context %s in full\n",
+									  switch_str_nil(caller_profile->destination_number), caller_profile->context);
+					xexten = xexten->next;
+					break;
+				}
+			}
+
+			dp_index_release(index);
+
+			if (!xexten) {
+				goto end;
+			}
 		} else {
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG_CLEAN(session), SWITCH_LOG_DEBUG,
-						  "Dialplan: %s parsing [%s->%s] continue=%s\n",
-						  switch_channel_get_name(channel), caller_profile->context, exten_name, cont ? cont : "false");
+			dp_index_release(index);
 		}
+	}
 
-		proceed = parse_exten(session, caller_profile, xexten, &extension, exten_name, 0);
+	if (!xexten) {
+		xexten = switch_xml_child(xcontext, "extension");
+	}
 
-		if (proceed && !switch_true(cont)) {
+	while (xexten) {
+		if (hunt_exten(session, caller_profile, xexten, &extension)) {
 			break;
 		}
 
 		xexten = xexten->next;
 	}
 
+  end:
 	switch_xml_free(xml);
 	xml = NULL;
 
@@ -721,10 +855,30 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_dialplan_xml_load)
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 	SWITCH_ADD_DIALPLAN(dp_interface, "XML", dialplan_hunt);
 
+	memset(&globals, 0, sizeof(globals));
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&globals.build_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	if (switch_event_bind_removable(modname, SWITCH_EVENT_RELOADXML, NULL, dp_index_reload_event_handler, NULL, &globals.reload_node) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind our reloadxml handler!\n");
+	}
+
+	switch_mutex_lock(globals.build_mutex);
+	dp_index_rebuild();
+	switch_mutex_unlock(globals.build_mutex);
+
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialplan_xml_shutdown)
+{
+	switch_event_unbind(&globals.reload_node);
+	dp_index_install(NULL);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -2448,12 +2448,6 @@ const char *sofia_state_string(int state)
 	return sofia_state_names[state];
 }
 
-struct cb_helper_sql2str {
-	char *buf;
-	size_t len;
-	int matches;
-};
-
 struct cb_helper {
 	uint32_t row_process;
 	sofia_profile_t *profile;
@@ -2502,6 +2496,43 @@ static int show_reg_callback(void *pArg, int argc, char **argv, char **columnNam
 	return 0;
 }
 
+/* Lays a stored registration out in the column order of the old status queries. */
+static void show_reg_entry_row(sofia_reg_entry_t *entry, sofia_profile_t *profile, char *expires, switch_size_t len, char **argv)
+{
+	switch_snprintf(expires, len, "%ld", entry->expires);
+
+	argv[0] = entry->call_id;
+	argv[1] = entry->sip_user;
+	argv[2] = entry->sip_host;
+	argv[3] = entry->contact;
+	argv[4] = entry->status;
+	argv[5] = entry->rpid;
+	argv[6] = expires;
+	argv[7] = entry->user_agent;
+	argv[8] = entry->server_user;
+	argv[9] = entry->server_host;
+	argv[10] = profile->name;
+	argv[11] = entry->hostname;
+	argv[12] = entry->network_ip;
+	argv[13] = entry->network_port;
+	argv[14] = entry->sip_username;
+	argv[15] = entry->sip_realm;
+	argv[16] = entry->mwi_user;
+	argv[17] = entry->mwi_host;
+	argv[18] = (char *) entry->ping_status;
+}
+
+static int show_reg_entry_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	struct cb_helper *cb = (struct cb_helper *) pArg;
+	char expires[32];
+	char *argv[19];
+
+	show_reg_entry_row(entry, cb->profile, expires, sizeof(expires), argv);
+
+	return show_reg_callback(pArg, 19, argv, NULL);
+}
+
 static int show_reg_callback_xml(void *pArg, int argc, char **argv, char **columnNames)
 {
 	struct cb_helper *cb = (struct cb_helper *) pArg;
@@ -2543,26 +2574,20 @@ static int show_reg_callback_xml(void *pArg, int argc, char **argv, char **colum
 	return 0;
 }
 
-static int sql2str_callback(void *pArg, int argc, char **argv, char **columnNames)
+static int show_reg_entry_callback_xml(sofia_reg_entry_t *entry, void *pArg)
 {
-	struct cb_helper_sql2str *cbt = (struct cb_helper_sql2str *) pArg;
+	struct cb_helper *cb = (struct cb_helper *) pArg;
+	char expires[32];
+	char *argv[19];
 
-	switch_copy_string(cbt->buf, argv[0], cbt->len);
-	cbt->matches++;
-	return 0;
+	show_reg_entry_row(entry, cb->profile, expires, sizeof(expires), argv);
+
+	return show_reg_callback_xml(pArg, 19, argv, NULL);
 }
 
 static uint32_t sofia_profile_reg_count(sofia_profile_t *profile)
 {
-	struct cb_helper_sql2str cb;
-	char reg_count[80] = "";
-	char *sql;
-	cb.buf = reg_count;
-	cb.len = sizeof(reg_count);
-	sql = switch_mprintf("select count(*) from sip_registrations where profile_name = '%q'", profile->name);
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sql2str_callback, &cb);
-	free(sql);
-	return strtoul(reg_count, NULL, 10);
+	return sofia_reg_store_count(profile, NULL);
 }
 
 static const char *status_names[] = { "DOWN", "UP", NULL };
@@ -2669,7 +2694,9 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 			}
 		} else if (!strcasecmp(argv[0], "profile")) {
 			struct cb_helper cb;
-			char *sql = NULL;
+			sofia_reg_filter_t filter = { 0 };
+			char *dup = NULL;
+			int show_reg = 0;
 			uint32_t x = 0;
 
 			cb.row_process = 0;
@@ -2758,29 +2785,16 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 				cb.profile = profile;
 				cb.stream = stream;
 
-				if (!sql && argv[2] && !strcasecmp(argv[2], "pres") && argv[3]) {
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q' and presence_hosts like '%%%q%%'", profile->name, argv[3]);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "reg") && argv[3]) {
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host, ping_status"
-										 " from sip_registrations where profile_name='%q' and contact like '%%%q%%'", profile->name, argv[3]);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "reg")) {
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q'", profile->name);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "user") && argv[3]) {
-					char *dup = strdup(argv[3]);
+				if (argv[2] && !strcasecmp(argv[2], "pres") && argv[3]) {
+					filter.presence_like = argv[3];
+					show_reg = 1;
+				} else if (argv[2] && !strcasecmp(argv[2], "reg")) {
+					filter.contact_like = argv[3];
+					show_reg = 1;
+				} else if (argv[2] && !strcasecmp(argv[2], "user") && argv[3]) {
 					char *host = NULL, *user = NULL;
-					char *sqlextra = NULL;
 
+					dup = strdup(argv[3]);
 					switch_assert(dup);
 
 					if ((host = strchr(dup, '@'))) {
@@ -2790,27 +2804,17 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 						host = dup;
 					}
 
-					if (zstr(user)) {
-						sqlextra = switch_mprintf("(sip_host='%q')", host);
-					} else if (zstr(host)) {
-						sqlextra = switch_mprintf("(sip_user='%q')", user);
-					} else {
-						sqlextra = switch_mprintf("(sip_user='%q' and sip_host='%q')", user, host);
-					}
-
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q' and %s", profile->name, sqlextra);
-					switch_safe_free(dup);
-					switch_safe_free(sqlextra);
+					filter.user = zstr(user) ? NULL : user;
+					filter.host = zstr(host) ? NULL : host;
+					filter.strict_host = SWITCH_TRUE;
+					show_reg = 1;
 				}
 
-				if (sql) {
+				if (show_reg) {
 					stream->write_function(stream, "\nRegistrations:\n%s\n", line);
 
-					sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, show_reg_callback, &cb);
-					switch_safe_free(sql);
+					sofia_reg_store_walk(profile, &filter, show_reg_entry_callback, &cb);
+					switch_safe_free(dup);
 
 					stream->write_function(stream, "Total items returned: %d\n", cb.row_process);
 					stream->write_function(stream, "%s\n", line);
@@ -2876,6 +2880,20 @@ static switch_status_t cmd_status(char **argv, int argc, switch_stream_handle_t
 	switch_mutex_unlock(mod_sofia_globals.hash_mutex);
 	stream->write_function(stream, "%s\n", line);
 	stream->write_function(stream, "%d profile%s %d alias%s\n", c, c == 1 ? "" : "s", ac, ac == 1 ? "" : "es");
+
+	stream->write_function(stream, "\n%25s\t%8s\t%12s\t%12s\t%12s\t%12s\n", "Message Queue", "Depth", "Processed", "Avg Wait(us)", "Max Wait(us)",
+						   "Avg Run(us)");
+	stream->write_function(stream, "%s\n", line);
+	for (c = 0; c < mod_sofia_globals.msg_queue_len; c++) {
+		sofia_msg_queue_t *mq = &mod_sofia_globals.msg_queues[c];
+		uint64_t processed = mq->processed;
+
+		stream->write_function(stream, "%25d\t%8u\t%12" SWITCH_UINT64_T_FMT "\t%12.1f\t%12" SWITCH_TIME_T_FMT "\t%12.1f\n", c,
+							   switch_queue_size(mq->queue), processed, processed ? (double) mq->wait_usec / processed : 0.0,
+							   mq->max_wait_usec, processed ? (double) mq->run_usec / processed : 0.0);
+	}
+	stream->write_function(stream, "%s\n", line);
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -2974,7 +2992,9 @@ static switch_status_t cmd_xml_status(char **argv, int argc, switch_stream_handl
 			}
 		} else if (!strcasecmp(argv[0], "profile")) {
 			struct cb_helper cb;
-			char *sql = NULL;
+			sofia_reg_filter_t filter = { 0 };
+			char *dup = NULL;
+			int show_reg = 0;
 			uint32_t x = 0;
 
 			cb.row_process = 0;
@@ -3064,32 +3084,16 @@ static switch_status_t cmd_xml_status(char **argv, int argc, switch_stream_handl
 				cb.profile = profile;
 				cb.stream = stream;
 
-				if (!sql && argv[2] && !strcasecmp(argv[2], "pres") && argv[3]) {
-
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q' and presence_hosts like '%%%q%%'", profile->name, argv[3]);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "reg") && argv[3]) {
-
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q' and contact like '%%%q%%'", profile->name, argv[3]);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "reg")) {
-
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q'", profile->name);
-				}
-				if (!sql && argv[2] && !strcasecmp(argv[2], "user") && argv[3]) {
-					char *dup = strdup(argv[3]);
+				if (argv[2] && !strcasecmp(argv[2], "pres") && argv[3]) {
+					filter.presence_like = argv[3];
+					show_reg = 1;
+				} else if (argv[2] && !strcasecmp(argv[2], "reg")) {
+					filter.contact_like = argv[3];
+					show_reg = 1;
+				} else if (argv[2] && !strcasecmp(argv[2], "user") && argv[3]) {
 					char *host = NULL, *user = NULL;
-					char *sqlextra = NULL;
 
+					dup = strdup(argv[3]);
 					switch_assert(dup);
 
 					if ((host = strchr(dup, '@'))) {
@@ -3099,27 +3103,17 @@ static switch_status_t cmd_xml_status(char **argv, int argc, switch_stream_handl
 						host = dup;
 					}
 
-					if (zstr(user)) {
-						sqlextra = switch_mprintf("(sip_host='%q')", host);
-					} else if (zstr(host)) {
-						sqlextra = switch_mprintf("(sip_user='%q')", user);
-					} else {
-						sqlextra = switch_mprintf("(sip_user='%q' and sip_host='%q')", user, host);
-					}
-
-					sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,"
-										 "rpid,expires,user_agent,server_user,server_host,profile_name,hostname,"
-										 "network_ip,network_port,sip_username,sip_realm,mwi_user,mwi_host,ping_status"
-										 " from sip_registrations where profile_name='%q' and %s", profile->name, sqlextra);
-					switch_safe_free(dup);
-					switch_safe_free(sqlextra);
+					filter.user = zstr(user) ? NULL : user;
+					filter.host = zstr(host) ? NULL : host;
+					filter.strict_host = SWITCH_TRUE;
+					show_reg = 1;
 				}
 
-				if (sql) {
+				if (show_reg) {
 					stream->write_function(stream, "  <registrations>\n");
 
-					sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, show_reg_callback_xml, &cb);
-					switch_safe_free(sql);
+					sofia_reg_store_walk(profile, &filter, show_reg_entry_callback_xml, &cb);
+					switch_safe_free(dup);
 
 					stream->write_function(stream, "  </registrations>\n");
 				}
@@ -3493,6 +3487,19 @@ static int contact_callback(void *pArg, int argc, char **argv, char **columnName
 	return 0;
 }
 
+struct contact_entry_helper {
+	struct cb_helper cb;
+	const char *concat;
+};
+
+static int contact_entry_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	struct contact_entry_helper *helper = (struct contact_entry_helper *) pArg;
+	char *argv[3] = { entry->contact, helper->cb.profile->name, (char *) (helper->concat ? helper->concat : "") };
+
+	return contact_callback(&helper->cb, 3, argv, NULL);
+}
+
 SWITCH_STANDARD_API(sofia_count_reg_function)
 {
 	char *data;
@@ -3536,8 +3543,6 @@ SWITCH_STANDARD_API(sofia_count_reg_function)
 	}
 
 	if (user && profile_name) {
-		char *sql;
-
 		if (!(profile = sofia_glue_find_profile(profile_name))) {
 			profile_name = domain;
 			domain = NULL;
@@ -3548,33 +3553,33 @@ SWITCH_STANDARD_API(sofia_count_reg_function)
 		}
 
 		if (profile) {
-			struct cb_helper_sql2str cb;
-			char reg_count[80] = "";
-
-			cb.buf = reg_count;
-			cb.len = sizeof(reg_count);
+			sofia_reg_filter_t filter = { 0 };
 
 			if (!domain || !strchr(domain, '.')) {
 				domain = profile->name;
 			}
 
-			if (zstr(user)) {
-				sql = switch_mprintf("select count(*) "
-									 "from sip_registrations where (sip_host='%q' or presence_hosts like '%%%q%%')",
-									 domain, domain);
-
-			} else {
-				sql = switch_mprintf("select count(*) "
-									 "from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
-									 user, domain, domain);
-			}
-			switch_assert(sql);
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sql2str_callback, &cb);
-			switch_safe_free(sql);
-			if (!zstr(reg_count)) {
-				stream->write_function(stream, "%s", reg_count);
+			if (sofia_reg_store_authoritative(profile)) {
+				filter.user = zstr(user) ? NULL : user;
+				filter.host = domain;
+				stream->write_function(stream, "%u", sofia_reg_store_count(profile, &filter));
 			} else {
-				stream->write_function(stream, "0");
+				char reg_count[80] = "";
+				char *sql;
+
+				if (zstr(user)) {
+					sql = switch_mprintf("select count(*) "
+										 "from sip_registrations where (sip_host='%q' or presence_hosts like '%%%q%%')",
+										 domain, domain);
+				} else {
+					sql = switch_mprintf("select count(*) "
+										 "from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
+										 user, domain, domain);
+				}
+				switch_assert(sql);
+				sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, reg_count, sizeof(reg_count));
+				switch_safe_free(sql);
+				stream->write_function(stream, "%s", zstr(reg_count) ? "0" : reg_count);
 			}
 			reply = NULL;
 
@@ -3594,6 +3599,15 @@ SWITCH_STANDARD_API(sofia_count_reg_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static int username_of_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	char *username = (char *) pArg;
+
+	switch_copy_string(username, entry->sip_username, 256);
+
+	return 0;
+}
+
 SWITCH_STANDARD_API(sofia_username_of_function)
 {
 	char *data;
@@ -3629,8 +3643,6 @@ SWITCH_STANDARD_API(sofia_username_of_function)
 	}
 
 	if (user && profile_name) {
-		char *sql;
-
 		if (!(profile = sofia_glue_find_profile(profile_name))) {
 			profile_name = domain;
 			domain = NULL;
@@ -3641,26 +3653,29 @@ SWITCH_STANDARD_API(sofia_username_of_function)
 		}
 
 		if (profile) {
-			struct cb_helper_sql2str cb;
+			sofia_reg_filter_t filter = { 0 };
 			char username[256] = "";
 
-			cb.buf = username;
-			cb.len = sizeof(username);
-
 			if (!domain || !strchr(domain, '.')) {
 				domain = profile->name;
 			}
 
 			switch_assert(!zstr(user));
 
-			sql = switch_mprintf("select sip_username "
-									"from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
-									user, domain, domain);
+			if (sofia_reg_store_authoritative(profile)) {
+				filter.user = user;
+				filter.host = domain;
+				sofia_reg_store_walk(profile, &filter, username_of_callback, username);
+			} else {
+				char *sql = switch_mprintf("select sip_username "
+										   "from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
+										   user, domain, domain);
 
-			switch_assert(sql);
+				switch_assert(sql);
+				sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, username, sizeof(username));
+				switch_safe_free(sql);
+			}
 
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sql2str_callback, &cb);
-			switch_safe_free(sql);
 			if (!zstr(username)) {
 				stream->write_function(stream, "%s", username);
 			} else {
@@ -3692,32 +3707,45 @@ static void select_from_profile(sofia_profile_t *profile,
 								switch_stream_handle_t *stream,
 								switch_bool_t dedup)
 {
-	struct cb_helper cb;
-	char *sql;
+	struct contact_entry_helper helper = { { 0 } };
+	sofia_reg_filter_t filter = { 0 };
 
-	cb.row_process = 0;
+	helper.cb.row_process = 0;
 
-	cb.profile = profile;
-	cb.stream = stream;
-	cb.dedup = dedup;
-
-	if (exclude_contact) {
-		sql = switch_mprintf("select contact, profile_name, '%q' "
-							 "from sip_registrations where profile_name='%q' "
-							 "and upper(sip_user)=upper('%q') " 
-							 "and (sip_host='%q' or presence_hosts like '%%%q%%') "
-							 "and contact not like '%%%s%%'", (concat != NULL) ? concat : "", profile->name, user, domain, domain, exclude_contact);
-	} else {
-		sql = switch_mprintf("select contact, profile_name, '%q' "
-							 "from sip_registrations where profile_name='%q' "
-							 "and upper(sip_user)=upper('%q') "
-							 "and (sip_host='%q' or presence_hosts like '%%%q%%')",
-							 (concat != NULL) ? concat : "", profile->name, user, domain, domain);
+	helper.cb.profile = profile;
+	helper.cb.stream = stream;
+	helper.cb.dedup = dedup;
+	helper.concat = concat;
+
+	if (!sofia_reg_store_authoritative(profile)) {
+		char *sql;
+
+		if (exclude_contact) {
+			sql = switch_mprintf("select contact, profile_name, '%q' "
+								 "from sip_registrations where profile_name='%q' "
+								 "and upper(sip_user)=upper('%q') "
+								 "and (sip_host='%q' or presence_hosts like '%%%q%%') "
+								 "and contact not like '%%%s%%'", (concat != NULL) ? concat : "", profile->name, user, domain, domain, exclude_contact);
+		} else {
+			sql = switch_mprintf("select contact, profile_name, '%q' "
+								 "from sip_registrations where profile_name='%q' "
+								 "and upper(sip_user)=upper('%q') "
+								 "and (sip_host='%q' or presence_hosts like '%%%q%%')",
+								 (concat != NULL) ? concat : "", profile->name, user, domain, domain);
+		}
+
+		switch_assert(sql);
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, contact_callback, &helper.cb);
+		switch_safe_free(sql);
+		return;
 	}
 
-	switch_assert(sql);
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, contact_callback, &cb);
-	switch_safe_free(sql);
+	filter.user = user;
+	filter.nocase = SWITCH_TRUE;
+	filter.host = domain;
+	filter.exclude_contact = exclude_contact;
+
+	sofia_reg_store_walk(profile, &filter, contact_entry_callback, &helper);
 }
 
 SWITCH_STANDARD_API(sofia_contact_function)
@@ -4078,7 +4106,8 @@ SWITCH_STANDARD_API(sofia_function)
 		"--------------------------------------------------------------------------------\n"
 		"sofia global siptrace <on|off>\n"
 		"sofia        capture  <on|off>\n"
-		"             watchdog <on|off>\n\n"
+		"             watchdog <on|off>\n"
+		"             msgq-bench <events> [<dialogs>] [<usec per event>]\n\n"
 		"sofia profile <name> [start | stop | restart | rescan] [wait]\n"
 		"                     flush_inbound_reg [<call_id> | <[user]@domain>] [reboot]\n"
 		"                     check_sync [<call_id> | <[user]@domain>]\n"
@@ -4151,6 +4180,20 @@ SWITCH_STANDARD_API(sofia_function)
 		int stbyon = -1;
 
 		if (argc > 1) {
+			if (!strcasecmp(argv[1], "msgq-bench")) {
+				uint32_t events = argc > 2 ? atoi(argv[2]) : 0;
+				uint32_t dialogs = argc > 3 ? atoi(argv[3]) : 1000;
+				uint32_t work_usec = argc > 4 ? atoi(argv[4]) : 0;
+
+				if (!events) {
+					stream->write_function(stream, "-ERR Usage: msgq-bench <events> [<dialogs>] [<usec per event>]\n");
+				} else {
+					sofia_msg_queue_bench(events, dialogs, work_usec, stream);
+				}
+
+				goto done;
+			}
+
 			if (!strcasecmp(argv[1], "debug")) {
 
 				if (argc > 2) {
@@ -5736,6 +5779,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 	switch_management_interface_t *management_interface;
 	switch_application_interface_t *app_interface;
 	struct in_addr in;
+	int i;
 
 	memset(&mod_sofia_globals, 0, sizeof(mod_sofia_globals));
 	mod_sofia_globals.destroy_private.destroy_nh = 1;
@@ -5773,11 +5817,11 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sofia_load)
 		mod_sofia_globals.max_msg_queues = SOFIA_MAX_MSG_QUEUE;
 	}
 
-	switch_queue_create(&mod_sofia_globals.msg_queue, SOFIA_MSG_QUEUE_SIZE * mod_sofia_globals.max_msg_queues, mod_sofia_globals.pool);
-
-	/* start one message thread */
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Starting initial message thread.\n");
-	sofia_msg_thread_start(0);
+	/* start every message thread up front, the Call-ID to queue mapping must not change while dialogs are up */
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Starting %d message threads.\n", mod_sofia_globals.max_msg_queues);
+	for (i = 0; i < mod_sofia_globals.max_msg_queues; i++) {
+		sofia_msg_thread_start(i);
+	}
 
 
 	if (sofia_init() != SWITCH_STATUS_SUCCESS) {
@@ -5970,14 +6014,14 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_sofia_shutdown)
 	}
 
 
-	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
-		switch_queue_push(mod_sofia_globals.msg_queue, NULL);
-		switch_queue_interrupt_all(mod_sofia_globals.msg_queue);
+	for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+		switch_queue_push(mod_sofia_globals.msg_queues[i].queue, NULL);
+		switch_queue_interrupt_all(mod_sofia_globals.msg_queues[i].queue);
 	}
 
 
-	for (i = 0; mod_sofia_globals.msg_queue_thread[i]; i++) {
-		switch_thread_join(&st, mod_sofia_globals.msg_queue_thread[i]);
+	for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
+		switch_thread_join(&st, mod_sofia_globals.msg_queues[i].thread);
 	}
 
 	if (mod_sofia_globals.presence_thread) {
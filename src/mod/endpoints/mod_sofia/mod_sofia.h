@@ -164,6 +164,8 @@ typedef struct sofia_dispatch_event_s {
 	switch_core_session_t *session;
 	switch_core_session_t *init_session;
 	switch_memory_pool_t *pool;
+	switch_time_t queued;
+	struct sofia_msg_bench_s *bench;
 	struct sofia_dispatch_event_s *next;
 } sofia_dispatch_event_t;
 
@@ -181,6 +183,8 @@ struct sofia_private {
 	int destroy_me;
 	int is_call;
 	int is_static;
+	/* message queue the handle's events go to, plus one, set by the first one queued */
+	int msg_queue;
 };
 
 #define set_param(ptr,val) if (ptr) {free(ptr) ; ptr = NULL;} if (val) {ptr = strdup(val);}
@@ -290,6 +294,7 @@ typedef enum {
 	PFLAG_PROXY_REFER,
 	PFLAG_CHANNEL_XML_FETCH_ON_NIGHTMARE_TRANSFER,
 	PFLAG_FIRE_TRANFER_EVENTS,
+	PFLAG_REG_DB_WRITE_BEHIND,
 
 	/* No new flags below this line */
 	PFLAG_MAX
@@ -348,6 +353,95 @@ typedef enum {
 #define SOFIA_MAX_MSG_QUEUE 64
 #define SOFIA_MSG_QUEUE_SIZE 1000
 
+/* One queue per message thread.  Events are routed by Call-ID so every message of a dialog is handled
+   by the same thread, in order.  The counters are only written by the owning thread. */
+typedef struct sofia_msg_queue_s {
+	switch_queue_t *queue;
+	switch_thread_t *thread;
+	uint64_t processed;
+	switch_time_t wait_usec;
+	switch_time_t run_usec;
+	switch_time_t max_wait_usec;
+} sofia_msg_queue_t;
+
+#define SOFIA_REG_STORE_SHARDS 32
+
+/* One registered contact.  Entries live in the profile registration store and are only touched with
+   their shard locked; the strings are owned by the entry, ping_status always points at a literal. */
+typedef struct sofia_reg_entry_s {
+	char *call_id;
+	char *sip_user;
+	char *sip_host;
+	char *presence_hosts;
+	char *contact;
+	char *status;
+	char *rpid;
+	char *user_agent;
+	char *server_user;
+	char *server_host;
+	char *hostname;
+	char *orig_hostname;
+	char *network_ip;
+	char *network_port;
+	char *sip_username;
+	char *sip_realm;
+	char *mwi_user;
+	char *mwi_host;
+	char *sub_host;
+	const char *ping_status;
+	long expires;
+	long ping_expires;
+	int ping_count;
+	uint32_t shard;
+	int32_t expire_idx;
+	int32_t ping_idx;
+	struct sofia_reg_entry_s *next;
+	struct sofia_reg_entry_s *call_next;
+	struct sofia_reg_entry_s *match_next;
+} sofia_reg_entry_t;
+
+typedef struct sofia_reg_heap_s {
+	sofia_reg_entry_t **items;
+	uint32_t len;
+	uint32_t size;
+	int ping;
+} sofia_reg_heap_t;
+
+/* Registrations are sharded by sip_user so every contact of a user sits behind one lock.  Each shard
+   keeps its own expiry heap and NAT ping heap so the worker thread never walks the whole store. */
+typedef struct sofia_reg_shard_s {
+	switch_mutex_t *mutex;
+	switch_hash_t *users;
+	switch_hash_t *call_ids;
+	sofia_reg_heap_t expire_heap;
+	sofia_reg_heap_t ping_heap;
+	uint32_t count;
+} sofia_reg_shard_t;
+
+typedef struct sofia_reg_store_s {
+	sofia_reg_shard_t shards[SOFIA_REG_STORE_SHARDS];
+} sofia_reg_store_t;
+
+/* Selects entries the way the old sip_registrations where clauses did.  Unset members match anything;
+   host matches sip_host or any of presence_hosts unless strict_host is set. */
+typedef struct sofia_reg_filter_s {
+	const char *user;
+	const char *host;
+	switch_bool_t strict_host;
+	switch_bool_t nocase;
+	const char *username;
+	const char *call_id;
+	const char *contact;
+	const char *contact_like;
+	const char *exclude_contact;
+	const char *presence_like;
+	const char *network_ip;
+	const char *network_port;
+	long expires_not;
+} sofia_reg_filter_t;
+
+typedef int (*sofia_reg_store_callback_t) (sofia_reg_entry_t *entry, void *pArg);
+
 struct mod_sofia_globals {
 	switch_memory_pool_t *pool;
 	switch_hash_t *profile_hash;
@@ -362,8 +456,7 @@ struct mod_sofia_globals {
 	char guess_ip[80];
 	char hostname[512];
 	switch_queue_t *presence_queue;
-	switch_queue_t *msg_queue;
-	switch_thread_t *msg_queue_thread[SOFIA_MAX_MSG_QUEUE];
+	sofia_msg_queue_t msg_queues[SOFIA_MAX_MSG_QUEUE];
 	int msg_queue_len;
 	struct sofia_private destroy_private;
 	struct sofia_private keep_private;
@@ -665,6 +758,7 @@ struct sofia_profile {
 	//su_home_t *home;
 	switch_hash_t *chat_hash;
 	switch_hash_t *reg_nh_hash;
+	sofia_reg_store_t *reg_store;
 	switch_hash_t *mwi_debounce_hash;
 	//switch_core_db_t *master_db;
 	switch_thread_rwlock_t *rwlock;
@@ -1163,10 +1257,21 @@ const char *sofia_sip_user_status_name(sofia_sip_user_status_t status);
 void sofia_reg_fire_custom_sip_user_state_event(sofia_profile_t *profile, const char *sip_user, const char *contact,
 							const char* from_user, const char* from_host, const char *call_id, sofia_sip_user_status_t status, int options_res, const char *phrase);
 uint32_t sofia_reg_reg_count(sofia_profile_t *profile, const char *user, const char *host);
+long sofia_reg_uniform_distribution(int max);
 char *sofia_media_get_multipart(switch_core_session_t *session, const char *prefix, const char *sdp, char **mp_type);
 int sofia_glue_tech_simplify(private_object_t *tech_pvt);
 switch_console_callback_match_t *sofia_reg_find_reg_url_multi(sofia_profile_t *profile, const char *user, const char *host);
 switch_console_callback_match_t *sofia_reg_find_reg_url_with_positive_expires_multi(sofia_profile_t *profile, const char *user, const char *host, time_t reg_time, const char *contact_str, long exptime);
+void sofia_reg_store_create(sofia_profile_t *profile);
+void sofia_reg_store_destroy(sofia_profile_t *profile);
+void sofia_reg_store_load(sofia_profile_t *profile);
+switch_bool_t sofia_reg_store_update(sofia_profile_t *profile, const sofia_reg_entry_t *row);
+uint32_t sofia_reg_store_walk(sofia_profile_t *profile, const sofia_reg_filter_t *filter, sofia_reg_store_callback_t callback, void *pArg);
+uint32_t sofia_reg_store_delete(sofia_profile_t *profile, const sofia_reg_filter_t *filter, sofia_reg_store_callback_t callback, void *pArg);
+uint32_t sofia_reg_store_count(sofia_profile_t *profile, const sofia_reg_filter_t *filter);
+switch_bool_t sofia_reg_store_authoritative(sofia_profile_t *profile);
+void sofia_reg_store_set_expires(sofia_profile_t *profile, sofia_reg_entry_t *entry, long expires);
+void sofia_reg_store_write_behind(sofia_profile_t *profile, char **sqlp);
 switch_bool_t sofia_glue_profile_exists(const char *key);
 void sofia_glue_global_siptrace(switch_bool_t on);
 void sofia_glue_global_capture(switch_bool_t on);
@@ -1181,6 +1286,7 @@ void sofia_process_dispatch_event_in_thread(sofia_dispatch_event_t **dep);
 char *sofia_glue_get_host(const char *str, switch_memory_pool_t *pool);
 void sofia_presence_check_subscriptions(sofia_profile_t *profile, time_t now);
 void sofia_msg_thread_start(int idx);
+switch_status_t sofia_msg_queue_bench(uint32_t events, uint32_t dialogs, uint32_t work_usec, switch_stream_handle_t *stream);
 void crtp_init(switch_loadable_module_interface_t *module_interface);
 int sofia_recover_callback(switch_core_session_t *session);
 void sofia_glue_set_name(private_object_t *tech_pvt, const char *channame);
@@ -1781,12 +1781,18 @@ static void our_sofia_event_callback(nua_event_t event,
 			if (sofia_private && sofia_private->call_id && sofia_private->network_ip && sofia_private->network_port) {
 				char *sql;
 				switch_event_t *event = NULL;
+				sofia_reg_filter_t filter = { 0 };
+
+				filter.call_id = sofia_private->call_id;
+				filter.network_ip = sofia_private->network_ip;
+				filter.network_port = sofia_private->network_port;
+				sofia_reg_store_delete(profile, &filter, NULL, NULL);
 
 				sql = switch_mprintf("delete from sip_registrations where call_id='%q' and network_ip='%q' and network_port='%q'",
 										   sofia_private->call_id, sofia_private->network_ip, sofia_private->network_port);
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG1, "SOCKET DISCONNECT: %s %s:%s\n",
 								  sofia_private->call_id, sofia_private->network_ip, sofia_private->network_port);
-				sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+				sofia_reg_store_write_behind(profile, &sql);
 
 				switch_core_del_registration(sofia_private->user, sofia_private->realm, sofia_private->call_id);
 
@@ -1996,92 +2002,176 @@ void sofia_process_dispatch_event(sofia_dispatch_event_t **dep)
 
 
 
-static int msg_queue_threads = 0;
 //static int count = 0;
 
-void *SWITCH_THREAD_FUNC sofia_msg_thread_run(switch_thread_t *thread, void *obj)
+struct sofia_msg_bench_s {
+	sofia_dispatch_event_t *events;
+	uint32_t dialogs;
+	uint32_t *next_seq;
+	int *worker;
+	uint32_t out_of_order;
+	uint32_t moved;
+	uint32_t work_usec;
+	switch_atomic_t pending;
+	int finished;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+};
+
+/* A synthetic event from sofia_msg_queue_bench().  Each dialog is owned by one thread, so the per dialog
+   bookkeeping needs no lock; an event seen out of order or on a second thread means the affinity broke. */
+static void sofia_msg_bench_event(sofia_dispatch_event_t *de, int my_id)
 {
-	void *pop;
-	switch_queue_t *q = (switch_queue_t *) obj;
-	int my_id;
+	struct sofia_msg_bench_s *bench = de->bench;
+	uint32_t i = (uint32_t) (de - bench->events);
+	uint32_t dialog = i % bench->dialogs, seq = i / bench->dialogs;
 
+	if (bench->work_usec) {
+		switch_time_t until = switch_time_ref() + bench->work_usec;
 
-	for (my_id = 0; my_id < mod_sofia_globals.msg_queue_len; my_id++) {
-		if (mod_sofia_globals.msg_queue_thread[my_id] == thread) {
-			break;
-		}
+		while (switch_time_ref() < until);
 	}
 
-	switch_mutex_lock(mod_sofia_globals.mutex);
-	msg_queue_threads++;
-	switch_mutex_unlock(mod_sofia_globals.mutex);
+	if (bench->next_seq[dialog] != seq) {
+		bench->out_of_order++;
+	}
+	bench->next_seq[dialog] = seq + 1;
+
+	if (bench->worker[dialog] < 0) {
+		bench->worker[dialog] = my_id;
+	} else if (bench->worker[dialog] != my_id) {
+		bench->moved++;
+	}
+
+	if (!switch_atomic_dec(&bench->pending)) {
+		switch_mutex_lock(bench->mutex);
+		bench->finished = 1;
+		switch_thread_cond_signal(bench->cond);
+		switch_mutex_unlock(bench->mutex);
+	}
+}
+
+void *SWITCH_THREAD_FUNC sofia_msg_thread_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+	sofia_msg_queue_t *mq = (sofia_msg_queue_t *) obj;
+	int my_id = (int) (mq - mod_sofia_globals.msg_queues);
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG Thread %d Started\n", my_id);
 
 
 	for(;;) {
 
-		if (switch_queue_pop(q, &pop) != SWITCH_STATUS_SUCCESS) {
+		if (switch_queue_pop(mq->queue, &pop) != SWITCH_STATUS_SUCCESS) {
 			switch_cond_next();
 			continue;
 		}
 
 		if (pop) {
 			sofia_dispatch_event_t *de = (sofia_dispatch_event_t *) pop;
-			sofia_process_dispatch_event(&de);
+			switch_time_t start = switch_time_ref(), wait = start - de->queued;
+
+			if (de->bench) {
+				sofia_msg_bench_event(de, my_id);
+			} else {
+				sofia_process_dispatch_event(&de);
+			}
+
+			mq->processed++;
+			mq->wait_usec += wait;
+			mq->run_usec += switch_time_ref() - start;
+			if (wait > mq->max_wait_usec) {
+				mq->max_wait_usec = wait;
+			}
 		} else {
 			break;
 		}
 	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG Thread Ended\n");
-
-	switch_mutex_lock(mod_sofia_globals.mutex);
-	msg_queue_threads--;
-	switch_mutex_unlock(mod_sofia_globals.mutex);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MSG Thread %d Ended\n", my_id);
 
 	return NULL;
 }
 
 void sofia_msg_thread_start(int idx)
 {
+	sofia_msg_queue_t *mq;
+	switch_threadattr_t *thd_attr = NULL;
 
-	if (idx >= mod_sofia_globals.max_msg_queues ||
-		idx >= SOFIA_MAX_MSG_QUEUE || (idx < mod_sofia_globals.msg_queue_len && mod_sofia_globals.msg_queue_thread[idx])) {
+	if (idx >= mod_sofia_globals.max_msg_queues || idx >= SOFIA_MAX_MSG_QUEUE) {
 		return;
 	}
 
 	switch_mutex_lock(mod_sofia_globals.mutex);
 
-	if (idx >= mod_sofia_globals.msg_queue_len) {
-		int i;
-		mod_sofia_globals.msg_queue_len = idx + 1;
+	mq = &mod_sofia_globals.msg_queues[idx];
 
-		for (i = 0; i < mod_sofia_globals.msg_queue_len; i++) {
-			if (!mod_sofia_globals.msg_queue_thread[i]) {
-				switch_threadattr_t *thd_attr = NULL;
+	if (!mq->thread) {
+		switch_queue_create(&mq->queue, SOFIA_MSG_QUEUE_SIZE, mod_sofia_globals.pool);
 
-				switch_threadattr_create(&thd_attr, mod_sofia_globals.pool);
-				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-				//switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
-				switch_thread_create(&mod_sofia_globals.msg_queue_thread[i],
-									 thd_attr,
-									 sofia_msg_thread_run,
-									 mod_sofia_globals.msg_queue,
-									 mod_sofia_globals.pool);
-			}
+		switch_threadattr_create(&thd_attr, mod_sofia_globals.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		//switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+		switch_thread_create(&mq->thread, thd_attr, sofia_msg_thread_run, mq, mod_sofia_globals.pool);
+
+		if (idx >= mod_sofia_globals.msg_queue_len) {
+			mod_sofia_globals.msg_queue_len = idx + 1;
 		}
 	}
 
 	switch_mutex_unlock(mod_sofia_globals.mutex);
 }
 
+/* Messages of one dialog always land on the same queue so they are processed in order and never by two
+   threads at once.  The queue is picked by Call-ID and remembered on the handle's private data, so the events
+   that carry no message (timeouts, transport errors, state changes) follow the rest of their dialog.  Handles
+   with no private data of their own and no Call-ID are spread by handle. */
+static sofia_msg_queue_t *sofia_msg_queue_pick(nua_handle_t *nh, sip_t const *sip)
+{
+	sofia_private_t *sofia_private = nh ? nua_handle_magic(nh) : NULL;
+	uint32_t index;
+
+	if (sofia_private == &mod_sofia_globals.destroy_private || sofia_private == &mod_sofia_globals.keep_private) {
+		sofia_private = NULL;
+	}
+
+	if (sofia_private && sofia_private->msg_queue) {
+		return &mod_sofia_globals.msg_queues[sofia_private->msg_queue - 1];
+	}
+
+	if (sip && sip->sip_call_id && sip->sip_call_id->i_id) {
+		switch_ssize_t hlen = -1;
+
+		index = switch_hashfunc_default(sip->sip_call_id->i_id, &hlen);
+	} else {
+		index = (uint32_t) (((uintptr_t) nh) >> 4);
+	}
+
+	index %= mod_sofia_globals.msg_queue_len;
+
+	if (sofia_private) {
+		sofia_private->msg_queue = index + 1;
+	}
+
+	return &mod_sofia_globals.msg_queues[index];
+}
+
+/* new requests the profile may turn away with a 503 rather than wait for room on a full queue */
+static int sofia_msg_queue_refusable(nua_event_t event, sofia_private_t *sofia_private)
+{
+	if (sofia_private) {
+		return 0;
+	}
+
+	return event == nua_i_register || event == nua_i_options || event == nua_i_notify || event == nua_i_info;
+}
+
 //static int foo = 0;
 void sofia_queue_message(sofia_dispatch_event_t *de)
 {
-	int launch = 0;
+	sofia_msg_queue_t *mq;
 
-	if (mod_sofia_globals.running == 0 || !mod_sofia_globals.msg_queue) {
+	if (mod_sofia_globals.running == 0 || !mod_sofia_globals.msg_queue_len) {
 		sofia_process_dispatch_event(&de);
 		return;
 	}
@@ -2093,19 +2183,105 @@ void sofia_queue_message(sofia_dispatch_event_t *de)
 		return;
 	}
 
+	de->queued = switch_time_ref();
+	mq = sofia_msg_queue_pick(de->nh, de->sip);
+
+	if (switch_queue_trypush(mq->queue, de) == SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	/* the queue is full, anything already in a dialog has to wait for room */
+	if (!de->bench && sofia_msg_queue_refusable(de->data->e_event, nua_handle_magic(de->nh))) {
+		nua_handle_t *nh = de->nh;
+		nua_t *nua = de->nua;
+		sofia_profile_t *profile = de->profile;
 
-	if ((switch_queue_size(mod_sofia_globals.msg_queue) > (SOFIA_MSG_QUEUE_SIZE * (unsigned int)msg_queue_threads))) {
-		launch++;
+		nua_respond(nh, 503, "System Busy", SIPTAG_RETRY_AFTER_STR("300"), NUTAG_WITH_THIS_MSG(de->data->e_msg), TAG_END());
+		nua_destroy_event(de->event);
+		su_free(nh->nh_home, de);
+
+		switch_mutex_lock(profile->flag_mutex);
+		profile->queued_events--;
+		switch_mutex_unlock(profile->flag_mutex);
+
+		nua_handle_unref(nh);
+		nua_stack_unref(nua);
+		return;
+	}
+
+	switch_queue_push(mq->queue, de);
+}
+
+/* Feeds synthetic events for the given number of dialogs through the message queues the way
+   sofia_event_callback() does, without a SIP stack on either end, and reports throughput and whether every
+   dialog kept its order and its thread. */
+switch_status_t sofia_msg_queue_bench(uint32_t events, uint32_t dialogs, uint32_t work_usec, switch_stream_handle_t *stream)
+{
+	struct sofia_msg_bench_s *bench;
+	switch_memory_pool_t *pool = NULL;
+	sip_t *sips;
+	sip_call_id_t *call_ids;
+	switch_time_t start, usec;
+	uint32_t i;
+	int q;
+
+	if (!mod_sofia_globals.msg_queue_len || !events || !dialogs) {
+		stream->write_function(stream, "-ERR no message threads running\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_core_new_memory_pool(&pool);
+	bench = switch_core_alloc(pool, sizeof(*bench));
+	bench->events = switch_core_alloc(pool, sizeof(*bench->events) * events);
+	bench->next_seq = switch_core_alloc(pool, sizeof(*bench->next_seq) * dialogs);
+	bench->worker = switch_core_alloc(pool, sizeof(*bench->worker) * dialogs);
+	bench->dialogs = dialogs;
+	bench->work_usec = work_usec;
+	switch_atomic_set(&bench->pending, events);
+	switch_mutex_init(&bench->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&bench->cond, pool);
+
+	sips = switch_core_alloc(pool, sizeof(*sips) * dialogs);
+	call_ids = switch_core_alloc(pool, sizeof(*call_ids) * dialogs);
+
+	for (i = 0; i < dialogs; i++) {
+		call_ids[i].i_id = switch_core_sprintf(pool, "%08x-bench@%s", i * 2654435761U, mod_sofia_globals.hostname);
+		sips[i].sip_call_id = &call_ids[i];
+		bench->worker[i] = -1;
 	}
 
+	start = switch_time_ref();
+	for (i = 0; i < events; i++) {
+		sofia_dispatch_event_t *de = &bench->events[i];
 
-	if (launch) {
-		if (mod_sofia_globals.msg_queue_len < mod_sofia_globals.max_msg_queues) {
-			sofia_msg_thread_start(mod_sofia_globals.msg_queue_len + 1);
+		de->sip = &sips[i % dialogs];
+		de->bench = bench;
+		sofia_queue_message(de);
+	}
+
+	switch_mutex_lock(bench->mutex);
+	while (!bench->finished) {
+		switch_thread_cond_timedwait(bench->cond, bench->mutex, 1000000);
+	}
+	switch_mutex_unlock(bench->mutex);
+	usec = switch_time_ref() - start;
+
+	stream->write_function(stream, "%u event(s) over %u dialog(s) on %d queue(s) in %" SWITCH_TIME_T_FMT "us (%.0f events/s), "
+						   "%u out of order, %u on a second thread\n", events, dialogs, mod_sofia_globals.msg_queue_len, usec,
+						   usec ? events * 1000000.0 / usec : 0.0, bench->out_of_order, bench->moved);
+
+	for (q = 0; q < mod_sofia_globals.msg_queue_len; q++) {
+		uint32_t owned = 0;
+
+		for (i = 0; i < dialogs; i++) {
+			owned += bench->worker[i] == q;
 		}
+		stream->write_function(stream, "  queue %d: %u dialog(s)\n", q, owned);
 	}
 
-	switch_queue_push(mod_sofia_globals.msg_queue, de);
+	switch_core_destroy_memory_pool(&pool);
+
+	return SWITCH_STATUS_SUCCESS;
 }
 
 static void set_call_id(private_object_t *tech_pvt, sip_t const *sip)
@@ -2124,7 +2300,7 @@ void sofia_event_callback(nua_event_t event,
 						  tagi_t tags[])
 {
 	sofia_dispatch_event_t *de;
-	int critical = (((SOFIA_MSG_QUEUE_SIZE * mod_sofia_globals.max_msg_queues) * 900) / 1000);
+	int critical = ((SOFIA_MSG_QUEUE_SIZE * 900) / 1000);
 	uint32_t sess_count = switch_core_session_count();
 	uint32_t sess_max = switch_core_session_limit(0);
 
@@ -2194,7 +2370,8 @@ void sofia_event_callback(nua_event_t event,
 			}
 
 
-			if (switch_queue_size(mod_sofia_globals.msg_queue) > (unsigned int)critical) {
+			/* the queue this request would wait on, the others may have room but cannot take it */
+			if (mod_sofia_globals.msg_queue_len && switch_queue_size(sofia_msg_queue_pick(nh, sip)->queue) > (unsigned int)critical) {
 				nua_respond(nh, 503, "System Busy", SIPTAG_RETRY_AFTER_STR("300"), NUTAG_WITH_THIS(nua), TAG_END());
 				goto end;
 			}
@@ -2371,6 +2548,48 @@ void sofia_event_callback(nua_event_t event,
 }
 
 
+struct cb_helper_sip_user_ping {
+	sofia_profile_t *profile;
+	int count;
+	const char *status;
+	long expires;
+};
+
+static int sofia_sip_user_ping_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	struct cb_helper_sip_user_ping *cbt = (struct cb_helper_sip_user_ping *) pArg;
+
+	if (cbt->count >= 0) {
+		entry->ping_count = cbt->count;
+	}
+
+	if (cbt->status) {
+		entry->ping_status = cbt->status;
+	}
+
+	if (cbt->expires) {
+		sofia_reg_store_set_expires(cbt->profile, entry, cbt->expires);
+	}
+
+	return 0;
+}
+
+/* Applies an OPTIONS result to the stored registration; a negative count, NULL status or 0 expires
+   leave that field alone. */
+static void sofia_update_sip_user_ping(sofia_profile_t *profile, const char *user, const char *host, const char *call_id,
+									   int count, const char *status, long expires)
+{
+	struct cb_helper_sip_user_ping cbt = { profile, count, status, expires };
+	sofia_reg_filter_t filter = { 0 };
+
+	filter.user = user;
+	filter.host = host;
+	filter.strict_host = SWITCH_TRUE;
+	filter.call_id = call_id;
+
+	sofia_reg_store_walk(profile, &filter, sofia_sip_user_ping_callback, &cbt);
+}
+
 void event_handler(switch_event_t *event)
 {
 	char *subclass, *sql;
@@ -2436,6 +2655,7 @@ void event_handler(switch_event_t *event)
 		char *from_host = switch_event_get_header_nil(event, "orig-from-host");
 		char *call_id = switch_event_get_header_nil(event, "orig-call-id");
 		char *contact_str = switch_event_get_header_nil(event, "orig-contact");
+		sofia_reg_filter_t filter = { 0 };
 
 		sofia_profile_t *profile = NULL;
 
@@ -2445,12 +2665,17 @@ void event_handler(switch_event_t *event)
 		}
 
 		if (sofia_test_pflag(profile, PFLAG_MULTIREG)) {
+			filter.call_id = call_id;
 			sql = switch_mprintf("delete from sip_registrations where call_id='%q'", call_id);
 		} else {
+			filter.user = from_user;
+			filter.host = from_host;
+			filter.strict_host = SWITCH_TRUE;
 			sql = switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q'", from_user, from_host);
 		}
 
-		sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+		sofia_reg_store_delete(profile, &filter, NULL, NULL);
+		sofia_reg_store_write_behind(profile, &sql);
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Expired propagated registration for %s@%s->%s\n", from_user, from_host, contact_str);
 
 		if (profile) {
@@ -2476,6 +2701,8 @@ void event_handler(switch_event_t *event)
 		char *orig_server_host = switch_event_get_header_nil(event, "orig-FreeSWITCH-IPv4");
 		char *orig_hostname = switch_event_get_header_nil(event, "orig-FreeSWITCH-Hostname");
 		char *fixed_contact_str = NULL;
+		sofia_reg_filter_t filter = { 0 };
+		sofia_reg_entry_t row = { 0 };
 
 		sofia_profile_t *profile = NULL;
 		char guess_ip4[256];
@@ -2511,8 +2738,12 @@ void event_handler(switch_event_t *event)
 			goto end;
 		}
 		if (sofia_test_pflag(profile, PFLAG_MULTIREG)) {
+			filter.call_id = call_id;
 			sql = switch_mprintf("delete from sip_registrations where call_id='%q'", call_id);
 		} else {
+			filter.user = from_user;
+			filter.host = from_host;
+			filter.strict_host = SWITCH_TRUE;
 			sql = switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q'", from_user, from_host);
 		}
 
@@ -2552,9 +2783,33 @@ void event_handler(switch_event_t *event)
 		}
 
 
-		sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+		sofia_reg_store_delete(profile, &filter, NULL, NULL);
+		sofia_reg_store_write_behind(profile, &sql);
 
 		switch_find_local_ip(guess_ip4, sizeof(guess_ip4), NULL, AF_INET);
+
+		row.call_id = call_id;
+		row.sip_user = from_user;
+		row.sip_host = from_host;
+		row.presence_hosts = presence_hosts;
+		row.contact = contact_str;
+		row.status = "Registered";
+		row.rpid = rpid;
+		row.expires = expires;
+		row.user_agent = user_agent;
+		row.server_user = to_user;
+		row.server_host = guess_ip4;
+		row.hostname = mod_sofia_globals.hostname;
+		row.orig_hostname = orig_hostname;
+		row.network_ip = network_ip;
+		row.network_port = network_port;
+		row.sip_username = username;
+		row.sip_realm = realm;
+		row.mwi_user = mwi_user;
+		row.mwi_host = mwi_host;
+		row.ping_status = "Reachable";
+		sofia_reg_store_update(profile, &row);
+
 		sql = switch_mprintf("insert into sip_registrations "
 							 "(call_id, sip_user, sip_host, presence_hosts, contact, status, rpid, expires,"
 							 "user_agent, server_user, server_host, profile_name, hostname, network_ip, network_port, sip_username, sip_realm,"
@@ -2565,7 +2820,7 @@ void event_handler(switch_event_t *event)
 							 orig_server_host, orig_hostname, "Reachable", 0);
 
 		if (sql) {
-			sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+			sofia_reg_store_write_behind(profile, &sql);
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Propagating registration for %s@%s->%s\n", from_user, from_host, contact_str);
 		}
 
@@ -2588,14 +2843,16 @@ void event_handler(switch_event_t *event)
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Invalid Profile\n");
 		} else {
 			if (!strcmp(ping_status, "REACHABLE")) {
+				sofia_update_sip_user_ping(profile, from_user, from_host, call_id, -1, "Reachable", 0);
 				sql = switch_mprintf("update sip_registrations set ping_status='%s' where sip_user='%s' and sip_host='%s' and call_id='%q'",
 								 	"Reachable", from_user, from_host, call_id);
 			} else {
+				sofia_update_sip_user_ping(profile, from_user, from_host, call_id, -1, "Unreachable", 0);
 				sql = switch_mprintf("update sip_registrations set ping_status='%s' where sip_user='%s' and sip_host='%s' and call_id='%q'",
 								 	"Unreachable", from_user, from_host, call_id);
 			}
 			if (sql) {
-				sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+				sofia_reg_store_write_behind(profile, &sql);
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Propagating sip_user_state for %s@%s. Ping-Status: %s\n", from_user, from_host, ping_status);
 			}
 
@@ -3065,6 +3322,8 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 									   profile->inner_post_trans_execute);
 	switch_sql_queue_manager_start(profile->qm);
 
+	sofia_reg_store_load(profile);
+
 	if (switch_event_create(&s_event, SWITCH_EVENT_PUBLISH) == SWITCH_STATUS_SUCCESS) {
 		switch_event_add_header(s_event, SWITCH_STACK_BOTTOM, "service", "_sip._udp,_sip._tcp,_sip._sctp%s",
 								(sofia_test_pflag(profile, PFLAG_TLS)) ? ",_sips._tcp" : "");
@@ -3192,6 +3451,7 @@ void *SWITCH_THREAD_FUNC sofia_profile_thread_run(switch_thread_t *thread, void
 	sofia_glue_del_profile(profile);
 	switch_core_hash_destroy(&profile->chat_hash);
 	switch_core_hash_destroy(&profile->reg_nh_hash);
+	sofia_reg_store_destroy(profile);
 	switch_core_hash_destroy(&profile->mwi_debounce_hash);
 
 	switch_thread_rwlock_unlock(profile->rwlock);
@@ -4157,6 +4417,7 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 					profile->dbname = switch_core_strdup(profile->pool, url);
 					switch_core_hash_init(&profile->chat_hash);
 					switch_core_hash_init(&profile->reg_nh_hash);
+					sofia_reg_store_create(profile);
 					switch_core_hash_init(&profile->mwi_debounce_hash);
 					switch_thread_rwlock_create(&profile->rwlock, profile->pool);
 					switch_mutex_init(&profile->flag_mutex, SWITCH_MUTEX_NESTED, profile->pool);
@@ -4177,6 +4438,7 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 					profile->tls_cert_dir = SWITCH_GLOBAL_dirs.certs_dir;
 					sofia_set_pflag(profile, PFLAG_DISABLE_100REL);
 					sofia_set_pflag(profile, PFLAG_ENABLE_CHAT);
+					sofia_set_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND);
 					profile->auto_restart = 1;
 					sofia_set_media_flag(profile, SCMF_AUTOFIX_TIMING);
 					sofia_set_media_flag(profile, SCMF_RENEG_ON_REINVITE);
@@ -5027,6 +5289,12 @@ switch_status_t config_sofia(sofia_config_t reload, char *profile_name)
 						} else {
 							sofia_clear_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING);
 						}
+					} else if (!strcasecmp(var, "reg-db-write-behind")) {
+						if (switch_true(val)) {
+							sofia_set_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND);
+						} else {
+							sofia_clear_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND);
+						}
 					} else if (!strcasecmp(var, "inbound-codec-negotiation")) {
 						if (!strcasecmp(val, "greedy")) {
 							sofia_set_media_flag(profile, SCMF_CODEC_GREEDY);
@@ -5768,6 +6036,17 @@ int sofia_sip_user_status_callback(void *pArg, int argc, char **argv, char **col
 	return 1;
 }
 
+static int sofia_sip_user_status_entry_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	char count[16];
+	char *argv[3] = { (char *) entry->ping_status, count, entry->contact };
+
+	switch_snprintf(count, sizeof(count), "%d", entry->ping_count);
+
+	return sofia_sip_user_status_callback(pArg, 3, argv, NULL);
+}
+
+
 static void sofia_handle_sip_r_options(switch_core_session_t *session, int status,
 									   char const *phrase,
 									   nua_t *nua, sofia_profile_t *profile, nua_handle_t *nh, sofia_private_t *sofia_private, sip_t const *sip,
@@ -5841,6 +6120,7 @@ static void sofia_handle_sip_r_options(switch_core_session_t *session, int statu
 		const char *call_id = strchr(sip->sip_call_id->i_id, '_') + 1;
 		char *sql;
 		struct cb_helper_sip_user_status sip_user_status;
+		sofia_reg_filter_t filter = { 0 };
 		char ping_status[255] = "";
 		char sip_contact[1024] = "";
 		int sip_user_ping_min = profile->sip_user_ping_min;
@@ -5852,29 +6132,31 @@ static void sofia_handle_sip_r_options(switch_core_session_t *session, int statu
 		sip_user_status.status_len = sizeof(ping_status);
 		sip_user_status.contact = sip_contact;
 		sip_user_status.contact_len = sizeof(sip_contact);
-		sql = switch_mprintf("select ping_status, ping_count, contact from sip_registrations where sip_user='%s' and sip_host='%s' and call_id='%q'",
-				     sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-		sofia_glue_execute_sql_callback(profile, profile->ireg_mutex, sql, sofia_sip_user_status_callback, &sip_user_status);
-		switch_safe_free(sql);
+		sip_user_status.count = 0;
+		filter.user = sip->sip_to->a_url->url_user;
+		filter.host = sip->sip_to->a_url->url_host;
+		filter.strict_host = SWITCH_TRUE;
+		filter.call_id = call_id;
+		sofia_reg_store_walk(profile, &filter, sofia_sip_user_status_entry_callback, &sip_user_status);
 
 		if (status != 200 && status != 486) {
 			sip_user_status.count--;
 			if (sip_user_status.count >= 0) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Ping to sip user '%s@%s' failed with code %d - count %d, state %s\n",
 						  sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, status, sip_user_status.count, sip_user_status.status);
+				sofia_update_sip_user_ping(profile, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id, sip_user_status.count, NULL, 0);
 				sql = switch_mprintf("update sip_registrations set ping_count=%d where sip_user='%s' and sip_host='%s' and call_id='%q'", sip_user_status.count,
 						     sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-				sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-				switch_safe_free(sql);
+				sofia_reg_store_write_behind(profile, &sql);
 			}
 			if (sip_user_status.count < sip_user_ping_min) {
 				if (strcmp(sip_user_status.status, "Unreachable")) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "Sip user '%s@%s' is now Unreachable\n",
 							  sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host);
+					sofia_update_sip_user_ping(profile, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id, -1, "Unreachable", 0);
 					sql = switch_mprintf("update sip_registrations set ping_status='Unreachable' where sip_user='%s' and sip_host='%s' and call_id='%q'",
 							     sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-					sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-					switch_safe_free(sql);
+					sofia_reg_store_write_behind(profile, &sql);
 					sofia_reg_fire_custom_sip_user_state_event(profile, sip_user, sip_user_status.contact, sip->sip_to->a_url->url_user,
 															   sip->sip_to->a_url->url_host, call_id, SOFIA_REG_REACHABLE, status, phrase);
 
@@ -5883,10 +6165,10 @@ static void sofia_handle_sip_r_options(switch_core_session_t *session, int statu
 						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "Expire sip user '%s@%s' due to options failure\n",
 								  sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host);
 
+						sofia_update_sip_user_ping(profile, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id, -1, NULL, (long) now);
 						sql = switch_mprintf("update sip_registrations set expires=%ld where sip_user='%s' and sip_host='%s' and call_id='%q'",
 								     (long) now, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-						sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-						switch_safe_free(sql);
+						sofia_reg_store_write_behind(profile, &sql);
 					}
 				}
 			}
@@ -5895,19 +6177,19 @@ static void sofia_handle_sip_r_options(switch_core_session_t *session, int statu
 			if (sip_user_status.count <= sip_user_ping_max) {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Ping to sip user '%s@%s' succeeded with code %d - count %d, state %s\n",
 						  sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, status, sip_user_status.count, sip_user_status.status);
+				sofia_update_sip_user_ping(profile, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id, sip_user_status.count, NULL, 0);
 				sql = switch_mprintf("update sip_registrations set ping_count=%d where sip_user='%s' and sip_host='%s' and call_id='%q'", sip_user_status.count,
 						     sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-				sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-				switch_safe_free(sql);
+				sofia_reg_store_write_behind(profile, &sql);
 			}
 			if (sip_user_status.count >= sip_user_ping_min) {
 				if (strcmp(sip_user_status.status, "Reachable")) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "Sip user '%s@%s' is now Reachable\n",
 							  sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host);
+					sofia_update_sip_user_ping(profile, sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id, -1, "Reachable", 0);
 					sql = switch_mprintf("update sip_registrations set ping_status='Reachable' where sip_user='%s' and sip_host='%s' and call_id='%q'",
 							     sip->sip_to->a_url->url_user, sip->sip_to->a_url->url_host, call_id);
-					sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-					switch_safe_free(sql);
+					sofia_reg_store_write_behind(profile, &sql);
 					sofia_reg_fire_custom_sip_user_state_event(profile, sip_user, sip_user_status.contact, sip->sip_to->a_url->url_user,
 															   sip->sip_to->a_url->url_host, call_id, SOFIA_REG_UNREACHABLE, status, phrase);
 				}
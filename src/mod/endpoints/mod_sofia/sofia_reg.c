@@ -733,8 +733,796 @@ int sofia_reg_del_callback(void *pArg, int argc, char **argv, char **columnNames
 	return 0;
 }
 
+/* The registration store.  Every REGISTER, expiry sweep and contact lookup used to be a query against
+   sip_registrations; they are now answered from memory and the table is only written behind, in
+   order, on the profile sql queue so presence, mwi and other nodes still see it. */
+
+static void reg_entry_set(char **dst, const char *src)
+{
+	if (!src) {
+		src = "";
+	}
+
+	if (*dst && !strcmp(*dst, src)) {
+		return;
+	}
+
+	switch_safe_free(*dst);
+	*dst = strdup(src);
+	switch_assert(*dst);
+}
+
+static void reg_entry_free(sofia_reg_entry_t *entry)
+{
+	switch_safe_free(entry->call_id);
+	switch_safe_free(entry->sip_user);
+	switch_safe_free(entry->sip_host);
+	switch_safe_free(entry->presence_hosts);
+	switch_safe_free(entry->contact);
+	switch_safe_free(entry->status);
+	switch_safe_free(entry->rpid);
+	switch_safe_free(entry->user_agent);
+	switch_safe_free(entry->server_user);
+	switch_safe_free(entry->server_host);
+	switch_safe_free(entry->hostname);
+	switch_safe_free(entry->orig_hostname);
+	switch_safe_free(entry->network_ip);
+	switch_safe_free(entry->network_port);
+	switch_safe_free(entry->sip_username);
+	switch_safe_free(entry->sip_realm);
+	switch_safe_free(entry->mwi_user);
+	switch_safe_free(entry->mwi_host);
+	switch_safe_free(entry->sub_host);
+	free(entry);
+}
+
+static sofia_reg_entry_t *reg_entry_create(const sofia_reg_entry_t *row)
+{
+	sofia_reg_entry_t *entry;
+
+	switch_zmalloc(entry, sizeof(*entry));
+
+	reg_entry_set(&entry->call_id, row->call_id);
+	reg_entry_set(&entry->sip_user, row->sip_user);
+	reg_entry_set(&entry->sip_host, row->sip_host);
+	reg_entry_set(&entry->presence_hosts, row->presence_hosts);
+	reg_entry_set(&entry->contact, row->contact);
+	reg_entry_set(&entry->status, row->status);
+	reg_entry_set(&entry->rpid, row->rpid);
+	reg_entry_set(&entry->user_agent, row->user_agent);
+	reg_entry_set(&entry->server_user, row->server_user);
+	reg_entry_set(&entry->server_host, row->server_host);
+	reg_entry_set(&entry->hostname, row->hostname);
+	reg_entry_set(&entry->orig_hostname, row->orig_hostname);
+	reg_entry_set(&entry->network_ip, row->network_ip);
+	reg_entry_set(&entry->network_port, row->network_port);
+	reg_entry_set(&entry->sip_username, row->sip_username);
+	reg_entry_set(&entry->sip_realm, row->sip_realm);
+	reg_entry_set(&entry->mwi_user, row->mwi_user);
+	reg_entry_set(&entry->mwi_host, row->mwi_host);
+	reg_entry_set(&entry->sub_host, row->sub_host);
+	entry->ping_status = (row->ping_status && !strcasecmp(row->ping_status, "Unreachable")) ? "Unreachable" : "Reachable";
+	entry->ping_count = row->ping_count;
+	entry->ping_expires = row->ping_expires;
+	entry->expires = row->expires;
+	entry->expire_idx = -1;
+	entry->ping_idx = -1;
+
+	return entry;
+}
+
+static uint32_t reg_store_shard_index(const char *user)
+{
+	char key[256];
+	char *p;
+	switch_ssize_t hlen = -1;
+
+	switch_copy_string(key, user ? user : "", sizeof(key));
+
+	/* the users hash is case insensitive, so is the shard */
+	for (p = key; *p; p++) {
+		*p = (char) tolower((unsigned char) *p);
+	}
+
+	return switch_hashfunc_default(key, &hlen) % SOFIA_REG_STORE_SHARDS;
+}
+
+#define reg_heap_key(_h, _e) ((_h)->ping ? (_e)->ping_expires : (_e)->expires)
+#define reg_heap_idx(_h, _e) (*((_h)->ping ? &(_e)->ping_idx : &(_e)->expire_idx))
+
+static void reg_heap_swap(sofia_reg_heap_t *heap, uint32_t a, uint32_t b)
+{
+	sofia_reg_entry_t *tmp = heap->items[a];
+
+	heap->items[a] = heap->items[b];
+	heap->items[b] = tmp;
+	reg_heap_idx(heap, heap->items[a]) = a;
+	reg_heap_idx(heap, heap->items[b]) = b;
+}
+
+static void reg_heap_up(sofia_reg_heap_t *heap, uint32_t i)
+{
+	while (i) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (reg_heap_key(heap, heap->items[parent]) <= reg_heap_key(heap, heap->items[i])) {
+			break;
+		}
+
+		reg_heap_swap(heap, parent, i);
+		i = parent;
+	}
+}
+
+static void reg_heap_down(sofia_reg_heap_t *heap, uint32_t i)
+{
+	for (;;) {
+		uint32_t left = 2 * i + 1, right = left + 1, min = i;
+
+		if (left < heap->len && reg_heap_key(heap, heap->items[left]) < reg_heap_key(heap, heap->items[min])) {
+			min = left;
+		}
+
+		if (right < heap->len && reg_heap_key(heap, heap->items[right]) < reg_heap_key(heap, heap->items[min])) {
+			min = right;
+		}
+
+		if (min == i) {
+			break;
+		}
+
+		reg_heap_swap(heap, i, min);
+		i = min;
+	}
+}
+
+static void reg_heap_remove(sofia_reg_heap_t *heap, sofia_reg_entry_t *entry)
+{
+	int32_t i = reg_heap_idx(heap, entry);
+
+	if (i < 0) {
+		return;
+	}
+
+	if ((uint32_t) i != --heap->len) {
+		heap->items[i] = heap->items[heap->len];
+		reg_heap_idx(heap, heap->items[i]) = i;
+		reg_heap_down(heap, i);
+		reg_heap_up(heap, i);
+	}
+
+	reg_heap_idx(heap, entry) = -1;
+}
+
+/* Inserts the entry or moves it to where its (changed) key now belongs. */
+static void reg_heap_fix(sofia_reg_heap_t *heap, sofia_reg_entry_t *entry)
+{
+	int32_t i = reg_heap_idx(heap, entry);
+
+	if (i >= 0) {
+		reg_heap_down(heap, i);
+		reg_heap_up(heap, reg_heap_idx(heap, entry));
+		return;
+	}
+
+	if (heap->len == heap->size) {
+		heap->size = heap->size ? heap->size * 2 : 64;
+		heap->items = realloc(heap->items, heap->size * sizeof(*heap->items));
+		switch_assert(heap->items);
+	}
+
+	heap->items[heap->len] = entry;
+	reg_heap_idx(heap, entry) = heap->len;
+	reg_heap_up(heap, heap->len++);
+}
+
+static long reg_next_ping(int interval, time_t now)
+{
+	long next = (long) now + interval / 2 + sofia_reg_uniform_distribution(interval);
+
+	return next > (long) now ? next : (long) now + 1;
+}
+
+/* Mirrors the where clauses sofia_reg_check_ping_expire used to run for each ping mode. */
+static int reg_entry_pingable(sofia_profile_t *profile, sofia_reg_entry_t *entry)
+{
+	int local = !strcmp(entry->orig_hostname, mod_sofia_globals.hostname);
+
+	if (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING)) {
+		return local;
+	}
+
+	if (sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING)) {
+		return switch_stristr("UDP-NAT", entry->status) != NULL;
+	}
+
+	if (sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING)) {
+		return local && (switch_stristr("NAT", entry->status) || switch_stristr("fs_nat=yes", entry->contact));
+	}
+
+	return 0;
+}
+
+static void reg_entry_index(sofia_profile_t *profile, sofia_reg_shard_t *shard, sofia_reg_entry_t *entry)
+{
+	if (entry->expires > 0) {
+		reg_heap_fix(&shard->expire_heap, entry);
+	} else {
+		reg_heap_remove(&shard->expire_heap, entry);
+	}
+
+	if (!reg_entry_pingable(profile, entry)) {
+		reg_heap_remove(&shard->ping_heap, entry);
+	} else if (entry->ping_idx < 0) {
+		if (entry->ping_expires <= 0) {
+			entry->ping_expires = reg_next_ping(profile->iping_seconds, switch_epoch_time_now(NULL));
+		}
+		reg_heap_fix(&shard->ping_heap, entry);
+	}
+}
+
+static void reg_shard_link(sofia_reg_shard_t *shard, sofia_reg_entry_t *entry)
+{
+	entry->next = switch_core_hash_find(shard->users, entry->sip_user);
+	switch_core_hash_insert(shard->users, entry->sip_user, entry);
+
+	entry->call_next = switch_core_hash_find(shard->call_ids, entry->call_id);
+	switch_core_hash_insert(shard->call_ids, entry->call_id, entry);
+
+	shard->count++;
+}
+
+static void reg_shard_unlink_call_id(sofia_reg_shard_t *shard, sofia_reg_entry_t *entry)
+{
+	sofia_reg_entry_t *np = switch_core_hash_find(shard->call_ids, entry->call_id);
+
+	if (np == entry) {
+		if (entry->call_next) {
+			switch_core_hash_insert(shard->call_ids, entry->call_id, entry->call_next);
+		} else {
+			switch_core_hash_delete(shard->call_ids, entry->call_id);
+		}
+	} else {
+		for (; np && np->call_next != entry; np = np->call_next);
+		if (np) {
+			np->call_next = entry->call_next;
+		}
+	}
+
+	entry->call_next = NULL;
+}
+
+static void reg_shard_unlink(sofia_reg_shard_t *shard, sofia_reg_entry_t *entry)
+{
+	sofia_reg_entry_t *np = switch_core_hash_find(shard->users, entry->sip_user);
+
+	if (np == entry) {
+		if (entry->next) {
+			switch_core_hash_insert(shard->users, entry->sip_user, entry->next);
+		} else {
+			switch_core_hash_delete(shard->users, entry->sip_user);
+		}
+	} else {
+		for (; np && np->next != entry; np = np->next);
+		if (np) {
+			np->next = entry->next;
+		}
+	}
+
+	entry->next = NULL;
+	reg_shard_unlink_call_id(shard, entry);
+	reg_heap_remove(&shard->expire_heap, entry);
+	reg_heap_remove(&shard->ping_heap, entry);
+	shard->count--;
+}
+
+static int reg_filter_match(const sofia_reg_filter_t *filter, sofia_reg_entry_t *entry)
+{
+	if (!filter) {
+		return 1;
+	}
+
+	if (filter->user && (filter->nocase ? strcasecmp(entry->sip_user, filter->user) : strcmp(entry->sip_user, filter->user))) {
+		return 0;
+	}
+
+	if (filter->host && strcmp(entry->sip_host, filter->host) && (filter->strict_host || !switch_stristr(filter->host, entry->presence_hosts))) {
+		return 0;
+	}
+
+	if ((filter->username && strcmp(entry->sip_username, filter->username)) ||
+		(filter->call_id && strcmp(entry->call_id, filter->call_id)) ||
+		(filter->contact && strcmp(entry->contact, filter->contact)) ||
+		(filter->network_ip && strcmp(entry->network_ip, filter->network_ip)) ||
+		(filter->network_port && strcmp(entry->network_port, filter->network_port))) {
+		return 0;
+	}
+
+	if ((filter->contact_like && !switch_stristr(filter->contact_like, entry->contact)) ||
+		(filter->exclude_contact && switch_stristr(filter->exclude_contact, entry->contact)) ||
+		(filter->presence_like && !switch_stristr(filter->presence_like, entry->presence_hosts))) {
+		return 0;
+	}
+
+	if (filter->expires_not && entry->expires == filter->expires_not) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Returns the matching entries of one shard chained on match_next, using the user or call_id index
+   when the filter names one.  The shard must be locked. */
+static sofia_reg_entry_t *reg_shard_match(sofia_reg_shard_t *shard, const sofia_reg_filter_t *filter)
+{
+	sofia_reg_entry_t *matches = NULL, *np;
+	switch_hash_index_t *hi;
+	void *val;
+
+	if (filter && filter->user) {
+		for (np = switch_core_hash_find(shard->users, filter->user); np; np = np->next) {
+			if (reg_filter_match(filter, np)) {
+				np->match_next = matches;
+				matches = np;
+			}
+		}
+	} else if (filter && filter->call_id) {
+		for (np = switch_core_hash_find(shard->call_ids, filter->call_id); np; np = np->call_next) {
+			if (reg_filter_match(filter, np)) {
+				np->match_next = matches;
+				matches = np;
+			}
+		}
+	} else {
+		for (hi = switch_core_hash_first(shard->users); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			for (np = (sofia_reg_entry_t *) val; np; np = np->next) {
+				if (reg_filter_match(filter, np)) {
+					np->match_next = matches;
+					matches = np;
+				}
+			}
+		}
+	}
+
+	return matches;
+}
+
+static void reg_filter_shards(const sofia_reg_filter_t *filter, uint32_t *first, uint32_t *last)
+{
+	if (filter && filter->user) {
+		*first = *last = reg_store_shard_index(filter->user);
+	} else {
+		*first = 0;
+		*last = SOFIA_REG_STORE_SHARDS - 1;
+	}
+}
+
+void sofia_reg_store_create(sofia_profile_t *profile)
+{
+	sofia_reg_store_t *store = switch_core_alloc(profile->pool, sizeof(*store));
+	int i;
+
+	for (i = 0; i < SOFIA_REG_STORE_SHARDS; i++) {
+		switch_mutex_init(&store->shards[i].mutex, SWITCH_MUTEX_NESTED, profile->pool);
+		switch_core_hash_init_nocase(&store->shards[i].users);
+		switch_core_hash_init(&store->shards[i].call_ids);
+		store->shards[i].ping_heap.ping = 1;
+	}
+
+	profile->reg_store = store;
+}
+
+void sofia_reg_store_destroy(sofia_profile_t *profile)
+{
+	sofia_reg_store_t *store = profile->reg_store;
+	int i;
+
+	if (!store) {
+		return;
+	}
+
+	profile->reg_store = NULL;
+
+	for (i = 0; i < SOFIA_REG_STORE_SHARDS; i++) {
+		sofia_reg_shard_t *shard = &store->shards[i];
+		switch_hash_index_t *hi;
+		sofia_reg_entry_t *np, *next;
+		void *val;
+
+		for (hi = switch_core_hash_first(shard->users); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			for (np = (sofia_reg_entry_t *) val; np; np = next) {
+				next = np->next;
+				reg_entry_free(np);
+			}
+		}
+
+		switch_core_hash_destroy(&shard->users);
+		switch_core_hash_destroy(&shard->call_ids);
+		switch_safe_free(shard->expire_heap.items);
+		switch_safe_free(shard->ping_heap.items);
+	}
+}
+
+/* Inserts a registration, or refreshes the binding of the same user, auth user, host and contact the
+   way the REGISTER update query did.  Returns SWITCH_TRUE when an existing binding was refreshed. */
+switch_bool_t sofia_reg_store_update(sofia_profile_t *profile, const sofia_reg_entry_t *row)
+{
+	sofia_reg_shard_t *shard;
+	sofia_reg_entry_t *np;
+	switch_bool_t updated = SWITCH_FALSE;
+	uint32_t index;
+
+	if (!profile->reg_store || zstr(row->sip_user) || zstr(row->contact)) {
+		return SWITCH_FALSE;
+	}
+
+	index = reg_store_shard_index(row->sip_user);
+	shard = &profile->reg_store->shards[index];
+
+	switch_mutex_lock(shard->mutex);
+
+	for (np = switch_core_hash_find(shard->users, row->sip_user); np; np = np->next) {
+		if (!strcmp(np->sip_user, row->sip_user) && !strcmp(np->sip_username, switch_str_nil(row->sip_username)) &&
+			!strcmp(np->sip_host, switch_str_nil(row->sip_host)) && !strcmp(np->contact, row->contact)) {
+			break;
+		}
+	}
+
+	if (np) {
+		if (strcmp(np->call_id, switch_str_nil(row->call_id))) {
+			reg_shard_unlink_call_id(shard, np);
+			reg_entry_set(&np->call_id, row->call_id);
+			np->call_next = switch_core_hash_find(shard->call_ids, np->call_id);
+			switch_core_hash_insert(shard->call_ids, np->call_id, np);
+		}
+
+		reg_entry_set(&np->sub_host, row->sub_host);
+		reg_entry_set(&np->network_ip, row->network_ip);
+		reg_entry_set(&np->network_port, row->network_port);
+		reg_entry_set(&np->presence_hosts, row->presence_hosts);
+		reg_entry_set(&np->server_host, row->server_host);
+		reg_entry_set(&np->hostname, row->hostname);
+		reg_entry_set(&np->orig_hostname, row->orig_hostname);
+		np->expires = row->expires;
+		updated = SWITCH_TRUE;
+	} else {
+		np = reg_entry_create(row);
+		np->shard = index;
+		reg_shard_link(shard, np);
+	}
+
+	reg_entry_index(profile, shard, np);
+
+	switch_mutex_unlock(shard->mutex);
+
+	return updated;
+}
+
+/* Calls back for every match with the shard locked; a non zero return stops the walk.  Callbacks may
+   change the ping fields or call sofia_reg_store_set_expires but must not call back into the store. */
+uint32_t sofia_reg_store_walk(sofia_profile_t *profile, const sofia_reg_filter_t *filter, sofia_reg_store_callback_t callback, void *pArg)
+{
+	uint32_t i, first, last, matches = 0;
+	sofia_reg_entry_t *np;
+
+	if (!profile->reg_store) {
+		return 0;
+	}
+
+	reg_filter_shards(filter, &first, &last);
+
+	for (i = first; i <= last; i++) {
+		sofia_reg_shard_t *shard = &profile->reg_store->shards[i];
+
+		switch_mutex_lock(shard->mutex);
+		for (np = reg_shard_match(shard, filter); np; np = np->match_next) {
+			matches++;
+			if (callback && callback(np, pArg)) {
+				switch_mutex_unlock(shard->mutex);
+				return matches;
+			}
+		}
+		switch_mutex_unlock(shard->mutex);
+	}
+
+	return matches;
+}
+
+/* The store only holds what this profile registered.  When write-behind is on and the table may also
+   carry rows from sibling profiles or other boxes (an ODBC dsn or a dbname shared with other profiles),
+   lookups must go to the database to keep seeing those registrations. */
+switch_bool_t sofia_reg_store_authoritative(sofia_profile_t *profile)
+{
+	if (!profile->reg_store) {
+		return SWITCH_FALSE;
+	}
+
+	if (!sofia_test_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND)) {
+		return SWITCH_TRUE;
+	}
+
+	if (profile->odbc_dsn || zstr(profile->dbname) ||
+		strncmp(profile->dbname, "sofia_reg_", 10) || strcmp(profile->dbname + 10, profile->name)) {
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+uint32_t sofia_reg_store_count(sofia_profile_t *profile, const sofia_reg_filter_t *filter)
+{
+	uint32_t i, count = 0;
+
+	if (filter || !profile->reg_store) {
+		return sofia_reg_store_walk(profile, filter, NULL, NULL);
+	}
+
+	for (i = 0; i < SOFIA_REG_STORE_SHARDS; i++) {
+		count += profile->reg_store->shards[i].count;
+	}
+
+	return count;
+}
+
+static uint32_t reg_store_release(sofia_reg_entry_t *gone, sofia_reg_store_callback_t callback, void *pArg)
+{
+	sofia_reg_entry_t *np, *next;
+	uint32_t released = 0;
+
+	for (np = gone; np; np = next) {
+		next = np->next;
+		if (callback) {
+			callback(np, pArg);
+		}
+		reg_entry_free(np);
+		released++;
+	}
+
+	return released;
+}
+
+/* Removes the matches, then calls back for each one outside of the shard locks before freeing it. */
+uint32_t sofia_reg_store_delete(sofia_profile_t *profile, const sofia_reg_filter_t *filter, sofia_reg_store_callback_t callback, void *pArg)
+{
+	sofia_reg_entry_t *gone = NULL, *np, *next;
+	uint32_t i, first, last;
+
+	if (!profile->reg_store) {
+		return 0;
+	}
+
+	reg_filter_shards(filter, &first, &last);
+
+	for (i = first; i <= last; i++) {
+		sofia_reg_shard_t *shard = &profile->reg_store->shards[i];
+
+		switch_mutex_lock(shard->mutex);
+		for (np = reg_shard_match(shard, filter); np; np = next) {
+			next = np->match_next;
+			reg_shard_unlink(shard, np);
+			np->next = gone;
+			gone = np;
+		}
+		switch_mutex_unlock(shard->mutex);
+	}
+
+	return reg_store_release(gone, callback, pArg);
+}
+
+void sofia_reg_store_set_expires(sofia_profile_t *profile, sofia_reg_entry_t *entry, long expires)
+{
+	sofia_reg_shard_t *shard = &profile->reg_store->shards[entry->shard];
+
+	entry->expires = expires;
+
+	if (expires > 0) {
+		reg_heap_fix(&shard->expire_heap, entry);
+	} else {
+		reg_heap_remove(&shard->expire_heap, entry);
+	}
+}
+
+/* Pops every registration that expired by now off the shard heaps, or all of them when now is 0. */
+static uint32_t reg_store_expire(sofia_profile_t *profile, time_t now, sofia_reg_store_callback_t callback, void *pArg)
+{
+	sofia_reg_entry_t *gone = NULL, *np;
+	uint32_t i;
+
+	if (!profile->reg_store) {
+		return 0;
+	}
+
+	for (i = 0; i < SOFIA_REG_STORE_SHARDS; i++) {
+		sofia_reg_shard_t *shard = &profile->reg_store->shards[i];
+
+		switch_mutex_lock(shard->mutex);
+		while (shard->expire_heap.len && (!now || shard->expire_heap.items[0]->expires <= (long) now)) {
+			np = shard->expire_heap.items[0];
+			reg_shard_unlink(shard, np);
+			np->next = gone;
+			gone = np;
+		}
+		switch_mutex_unlock(shard->mutex);
+	}
+
+	return reg_store_release(gone, callback, pArg);
+}
+
+struct reg_ping_target {
+	char *argv[4];
+	struct reg_ping_target *next;
+};
+
+/* Sends OPTIONS to every contact on the ping heaps that is due and reschedules it.  The targets are
+   copied out under the shard lock and pinged after it is dropped so nua never runs with a shard held. */
+static uint32_t reg_store_ping(sofia_profile_t *profile, time_t now, int interval)
+{
+	uint32_t i, j, pinged = 0;
+	struct reg_ping_target *targets = NULL, *tp;
+
+	if (!profile->reg_store) {
+		return 0;
+	}
+
+	for (i = 0; i < SOFIA_REG_STORE_SHARDS; i++) {
+		sofia_reg_shard_t *shard = &profile->reg_store->shards[i];
+
+		switch_mutex_lock(shard->mutex);
+		while (shard->ping_heap.len && shard->ping_heap.items[0]->ping_expires <= (long) now) {
+			sofia_reg_entry_t *np = shard->ping_heap.items[0];
+
+			switch_zmalloc(tp, sizeof(*tp));
+			tp->argv[0] = strdup(switch_str_nil(np->call_id));
+			tp->argv[1] = strdup(switch_str_nil(np->sip_user));
+			tp->argv[2] = strdup(switch_str_nil(np->sip_host));
+			tp->argv[3] = strdup(switch_str_nil(np->contact));
+			tp->next = targets;
+			targets = tp;
+
+			np->ping_expires = reg_next_ping(interval, now);
+			reg_heap_down(&shard->ping_heap, 0);
+			pinged++;
+		}
+		switch_mutex_unlock(shard->mutex);
+	}
+
+	while ((tp = targets)) {
+		targets = tp->next;
+		sofia_reg_nat_callback(profile, 4, tp->argv, NULL);
+		for (j = 0; j < 4; j++) {
+			free(tp->argv[j]);
+		}
+		free(tp);
+	}
+
+	return pinged;
+}
+
+static int reg_store_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	sofia_profile_t *profile = (sofia_profile_t *) pArg;
+	sofia_reg_entry_t row = { 0 };
+
+	row.call_id = argv[0];
+	row.sip_user = argv[1];
+	row.sip_host = argv[2];
+	row.presence_hosts = argv[3];
+	row.contact = argv[4];
+	row.status = argv[5];
+	row.rpid = argv[6];
+	row.expires = argv[7] ? atol(argv[7]) : 0;
+	row.user_agent = argv[8];
+	row.server_user = argv[9];
+	row.server_host = argv[10];
+	row.hostname = argv[11];
+	row.orig_hostname = argv[12];
+	row.network_ip = argv[13];
+	row.network_port = argv[14];
+	row.sip_username = argv[15];
+	row.sip_realm = argv[16];
+	row.mwi_user = argv[17];
+	row.mwi_host = argv[18];
+	row.sub_host = argv[19];
+	row.ping_status = argv[20];
+	row.ping_count = argv[21] ? atoi(argv[21]) : 0;
+	row.ping_expires = argv[22] ? atol(argv[22]) : 0;
+
+	sofia_reg_store_update(profile, &row);
+
+	return 0;
+}
+
+/* Picks up the registrations a previous run of this profile left in the database. */
+void sofia_reg_store_load(sofia_profile_t *profile)
+{
+	char *sql;
+
+	if (!sofia_test_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND)) {
+		return;
+	}
+
+	sql = switch_mprintf("select call_id,sip_user,sip_host,presence_hosts,contact,status,rpid,expires,"
+						 "user_agent,server_user,server_host,hostname,orig_hostname,network_ip,network_port,"
+						 "sip_username,sip_realm,mwi_user,mwi_host,sub_host,ping_status,ping_count,ping_expires"
+						 " from sip_registrations where profile_name='%q' and hostname='%q'", profile->name, mod_sofia_globals.hostname);
+
+	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, reg_store_load_callback, profile);
+	switch_safe_free(sql);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Loaded %u registrations for %s\n", sofia_reg_store_count(profile, NULL), profile->name);
+}
+
+void sofia_reg_store_write_behind(sofia_profile_t *profile, char **sqlp)
+{
+	if (sofia_test_pflag(profile, PFLAG_REG_DB_WRITE_BEHIND)) {
+		sofia_glue_execute_sql(profile, sqlp, SWITCH_TRUE);
+	} else {
+		switch_safe_free(*sqlp);
+	}
+}
+
+struct reg_store_del_helper {
+	sofia_profile_t *profile;
+	int reboot;
+};
+
+/* Hands a released registration to sofia_reg_del_callback in the column order of the old expire query. */
+static int reg_store_del_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	struct reg_store_del_helper *h = (struct reg_store_del_helper *) pArg;
+	char expires[32], reboot[8];
+	char *argv[15] = { entry->call_id, entry->sip_user, entry->sip_host, entry->contact, entry->status, entry->rpid, expires,
+					   entry->user_agent, entry->server_user, entry->server_host, h->profile->name, entry->network_ip,
+					   entry->network_port, reboot, entry->sip_realm };
+
+	switch_snprintf(expires, sizeof(expires), "%ld", entry->expires);
+	switch_snprintf(reboot, sizeof(reboot), "%d", h->reboot);
+
+	return sofia_reg_del_callback(h->profile, 15, argv, NULL);
+}
+
+struct reg_store_reboot_helper {
+	sofia_profile_t *profile;
+	const char *skip_call_id;
+};
+
+static int reg_store_reboot_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	struct reg_store_reboot_helper *h = (struct reg_store_reboot_helper *) pArg;
+
+	/* already rebooted by call_id */
+	if (h->skip_call_id && !strcmp(entry->call_id, h->skip_call_id)) {
+		return 0;
+	}
+
+	sofia_reg_send_reboot(h->profile, entry->call_id, entry->sip_user, entry->sip_host, entry->contact, entry->user_agent, entry->network_ip);
+
+	return 0;
+}
+
+static int reg_store_find_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	char *argv[1] = { entry->contact };
+
+	return sofia_reg_find_callback(pArg, 1, argv, NULL);
+}
+
+static int reg_store_find_with_positive_expires_callback(sofia_reg_entry_t *entry, void *pArg)
+{
+	char expires[32];
+	char *argv[2] = { entry->contact, expires };
+
+	switch_snprintf(expires, sizeof(expires), "%ld", entry->expires);
+
+	return sofia_reg_find_reg_with_positive_expires_callback(pArg, 2, argv, NULL);
+}
+
 void sofia_reg_expire_call_id(sofia_profile_t *profile, const char *call_id, int reboot)
 {
+	struct reg_store_del_helper h = { profile, reboot };
+	sofia_reg_filter_t filter = { 0 };
 	char *sql = NULL;
 	char *sqlextra = NULL;
 	char *dup = strdup(call_id);
@@ -759,16 +1547,17 @@ void sofia_reg_expire_call_id(sofia_profile_t *profile, const char *call_id, int
 		sqlextra = switch_mprintf(" or (sip_user='%q' and sip_host='%q')", user, host);
 	}
 
-	sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
-						 ",user_agent,server_user,server_host,profile_name,network_ip,network_port"
-						 ",%d,sip_realm from sip_registrations where call_id='%q' %s", reboot, call_id, sqlextra);
+	filter.call_id = call_id;
+	sofia_reg_store_delete(profile, &filter, reg_store_del_callback, &h);
 
-
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_del_callback, profile);
-	switch_safe_free(sql);
+	memset(&filter, 0, sizeof(filter));
+	filter.user = zstr(user) ? NULL : user;
+	filter.host = host;
+	filter.strict_host = SWITCH_TRUE;
+	sofia_reg_store_delete(profile, &filter, reg_store_del_callback, &h);
 
 	sql = switch_mprintf("delete from sip_registrations where call_id='%q' %s", call_id, sqlextra);
-	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	sofia_reg_store_write_behind(profile, &sql);
 
 	switch_safe_free(sqlextra);
 	switch_safe_free(sql);
@@ -778,27 +1567,18 @@ void sofia_reg_expire_call_id(sofia_profile_t *profile, const char *call_id, int
 
 void sofia_reg_check_expire(sofia_profile_t *profile, time_t now, int reboot)
 {
+	struct reg_store_del_helper h = { profile, reboot };
 	char *sql;
 
-	if (now) {
-		sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
-						",user_agent,server_user,server_host,profile_name,network_ip, network_port"
-						",%d,sip_realm from sip_registrations where expires > 0 and expires <= %ld", reboot, (long) now);
-	} else {
-		sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
-						",user_agent,server_user,server_host,profile_name,network_ip, network_port" ",%d,sip_realm from sip_registrations where expires > 0", reboot);
-	}
-
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_del_callback, profile);
-	free(sql);
-
-	if (now) {
-		sql = switch_mprintf("delete from sip_registrations where expires > 0 and expires <= %ld and hostname='%q'",
-						(long) now, mod_sofia_globals.hostname);
-	} else {
-		sql = switch_mprintf("delete from sip_registrations where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
+	if (reg_store_expire(profile, now, reg_store_del_callback, &h)) {
+		if (now) {
+			sql = switch_mprintf("delete from sip_registrations where expires > 0 and expires <= %ld and hostname='%q'",
+							(long) now, mod_sofia_globals.hostname);
+		} else {
+			sql = switch_mprintf("delete from sip_registrations where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
+		}
+		sofia_reg_store_write_behind(profile, &sql);
 	}
-	sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
 	
 
 
@@ -866,64 +1646,14 @@ long sofia_reg_uniform_distribution(int max)
 
 void sofia_reg_check_ping_expire(sofia_profile_t *profile, time_t now, int interval)
 {
-	char *sql;
-	int mean = interval / 2;
-	long next, irand;
-
-	if (now) {
-		if (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING)) {
-			sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
-							"expires,user_agent,server_user,server_host,profile_name"
- " from sip_registrations where hostname='%s' and " 
- "profile_name='%s' and orig_hostname='%s' and "
- "ping_expires > 0 and ping_expires <= %ld", mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname, (long) now); 
-			
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		} else if (sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING)) {
-			sql = switch_mprintf(	" select call_id,sip_user,sip_host,contact,status,rpid, "
-						" expires,user_agent,server_user,server_host,profile_name "
-						" from sip_registrations where status like '%%UDP-NAT%%' "
- 						" and hostname='%s' and profile_name='%s' and ping_expires > 0 and ping_expires <= %ld ",
-						mod_sofia_globals.hostname, profile->name, (long) now); 
-			
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		} else if (sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING)) {
-			sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,"
-							"expires,user_agent,server_user,server_host,profile_name"
-							" from sip_registrations where (status like '%%NAT%%' "
- "or contact like '%%fs_nat=yes%%') and hostname='%s' " 
- "and profile_name='%s' and orig_hostname='%s' and "
- "ping_expires > 0 and ping_expires <= %ld", mod_sofia_globals.hostname, profile->name, mod_sofia_globals.hostname, (long) now); 
-			
-			sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_nat_callback, profile);
-			switch_safe_free(sql);
-		}
-
-		if (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING) ||
-			sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING) || 
-			sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING)) {
-			char buf[32] = "";
-			int count;
-
-			sql = switch_mprintf("select count(*) from sip_registrations where hostname='%q' and profile_name='%q' and ping_expires <= %ld",
-                                      		mod_sofia_globals.hostname, profile->name, (long) now);
-
-        		sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, buf, sizeof(buf));
-        		switch_safe_free(sql);
-        		count = atoi(buf);
-
-			/* only update if needed */
-			if (count) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG9, "Updating ping expires for profile %s\n", profile->name);
-				irand = mean + sofia_reg_uniform_distribution(interval);
-				next = (long) now + irand;
-	
-				sql = switch_mprintf("update sip_registrations set ping_expires = %ld where hostname='%q' and profile_name='%q' and ping_expires <= %ld ",
-							next, mod_sofia_globals.hostname, profile->name, (long) now);
-				sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
-			}
+	uint32_t pinged;
+
+	if (now && (sofia_test_pflag(profile, PFLAG_ALL_REG_OPTIONS_PING) ||
+				sofia_test_pflag(profile, PFLAG_UDP_NAT_OPTIONS_PING) ||
+				sofia_test_pflag(profile, PFLAG_NAT_OPTIONS_PING))) {
+		/* every contact is rescheduled on its own when it is pinged */
+		if ((pinged = reg_store_ping(profile, now, interval))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG9, "Pinged %u registrations for profile %s\n", pinged, profile->name);
 		}
 	}
 
@@ -941,8 +1671,8 @@ int sofia_reg_check_callback(void *pArg, int argc, char **argv, char **columnNam
 
 void sofia_reg_check_call_id(sofia_profile_t *profile, const char *call_id)
 {
-	char *sql = NULL;
-	char *sqlextra = NULL;
+	struct reg_store_reboot_helper h = { profile, NULL };
+	sofia_reg_filter_t filter = { 0 };
 	char *dup = strdup(call_id);
 	char *host = NULL, *user = NULL;
 
@@ -959,40 +1689,29 @@ void sofia_reg_check_call_id(sofia_profile_t *profile, const char *call_id)
 		host = "none";
 	}
 
-	if (zstr(user)) {
-		sqlextra = switch_mprintf(" or (sip_host='%q')", host);
-	} else {
-		sqlextra = switch_mprintf(" or (sip_user='%q' and sip_host='%q')", user, host);
-	}
-
-	sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
-						 ",user_agent,server_user,server_host,profile_name,network_ip"
-						 " from sip_registrations where call_id='%q' %s", call_id, sqlextra);
+	filter.call_id = call_id;
+	sofia_reg_store_walk(profile, &filter, reg_store_reboot_callback, &h);
 
+	memset(&filter, 0, sizeof(filter));
+	filter.user = zstr(user) ? NULL : user;
+	filter.host = host;
+	filter.strict_host = SWITCH_TRUE;
+	h.skip_call_id = call_id;
+	sofia_reg_store_walk(profile, &filter, reg_store_reboot_callback, &h);
 
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_check_callback, profile);
-
-
-	switch_safe_free(sql);
-	switch_safe_free(sqlextra);
 	switch_safe_free(dup);
 
 }
 
 void sofia_reg_check_sync(sofia_profile_t *profile)
 {
+	struct reg_store_del_helper h = { profile, 0 };
 	char *sql;
 
-	sql = switch_mprintf("select call_id,sip_user,sip_host,contact,status,rpid,expires"
-					",user_agent,server_user,server_host,profile_name,network_ip,network_port,0,sip_realm"
-					" from sip_registrations where expires > 0");
-
-
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_del_callback, profile);
-	switch_safe_free(sql);
+	reg_store_expire(profile, 0, reg_store_del_callback, &h);
 
 	sql = switch_mprintf("delete from sip_registrations where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
-	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+	sofia_reg_store_write_behind(profile, &sql);
 
 	sql = switch_mprintf("delete from sip_presence where expires > 0 and hostname='%q'", mod_sofia_globals.hostname);
 	sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
@@ -1011,7 +1730,7 @@ void sofia_reg_check_sync(sofia_profile_t *profile)
 char *sofia_reg_find_reg_url(sofia_profile_t *profile, const char *user, const char *host, char *val, switch_size_t len)
 {
 	struct callback_t cbt = { 0 };
-	char *sql;
+	sofia_reg_filter_t filter = { 0 };
 
 	if (!user) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Called with null user!\n");
@@ -1021,17 +1740,23 @@ char *sofia_reg_find_reg_url(sofia_profile_t *profile, const char *user, const c
 	cbt.val = val;
 	cbt.len = len;
 
-	if (host) {
-		sql = switch_mprintf("select contact from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
-						user, host, host);
+	if (sofia_reg_store_authoritative(profile)) {
+		filter.user = user;
+		filter.host = host;
+		sofia_reg_store_walk(profile, &filter, reg_store_find_callback, &cbt);
 	} else {
-		sql = switch_mprintf("select contact from sip_registrations where sip_user='%q'", user);
-	}
+		char *sql;
 
+		if (host) {
+			sql = switch_mprintf("select contact from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
+							user, host, host);
+		} else {
+			sql = switch_mprintf("select contact from sip_registrations where sip_user='%q'", user);
+		}
 
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_callback, &cbt);
-
-	switch_safe_free(sql);
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_callback, &cbt);
+		switch_safe_free(sql);
+	}
 
 	if (cbt.list) {
 		switch_console_free_matches(&cbt.list);
@@ -1048,24 +1773,30 @@ char *sofia_reg_find_reg_url(sofia_profile_t *profile, const char *user, const c
 switch_console_callback_match_t *sofia_reg_find_reg_url_multi(sofia_profile_t *profile, const char *user, const char *host)
 {
 	struct callback_t cbt = { 0 };
-	char *sql;
+	sofia_reg_filter_t filter = { 0 };
 
 	if (!user) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Called with null user!\n");
 		return NULL;
 	}
 
-	if (host) {
-		sql = switch_mprintf("select contact from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
-						user, host, host);
+	if (sofia_reg_store_authoritative(profile)) {
+		filter.user = user;
+		filter.host = host;
+		sofia_reg_store_walk(profile, &filter, reg_store_find_callback, &cbt);
 	} else {
-		sql = switch_mprintf("select contact from sip_registrations where sip_user='%q'", user);
-	}
+		char *sql;
 
+		if (host) {
+			sql = switch_mprintf("select contact from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
+							user, host, host);
+		} else {
+			sql = switch_mprintf("select contact from sip_registrations where sip_user='%q'", user);
+		}
 
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_callback, &cbt);
-	
-	switch_safe_free(sql);
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_callback, &cbt);
+		switch_safe_free(sql);
+	}
 
 	return cbt.list;
 }
@@ -1074,26 +1805,34 @@ switch_console_callback_match_t *sofia_reg_find_reg_url_multi(sofia_profile_t *p
 switch_console_callback_match_t *sofia_reg_find_reg_url_with_positive_expires_multi(sofia_profile_t *profile, const char *user, const char *host, time_t reg_time, const char *contact_str, long exptime)
 {
 	struct callback_t cbt = { 0 };
-	char *sql;
+	sofia_reg_filter_t filter = { 0 };
 
 	if (!user) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Called with null user!\n");
 		return NULL;
 	}
 
-	if (host) {
-		sql = switch_mprintf("select contact,expires from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
-						user, host, host);
-	} else {
-		sql = switch_mprintf("select contact,expires from sip_registrations where sip_user='%q'", user);
-	}
-
 	cbt.time = reg_time;
 	cbt.contact_str = contact_str;
 	cbt.exptime = exptime;
 
-	sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_reg_with_positive_expires_callback, &cbt);
-	free(sql);
+	if (sofia_reg_store_authoritative(profile)) {
+		filter.user = user;
+		filter.host = host;
+		sofia_reg_store_walk(profile, &filter, reg_store_find_with_positive_expires_callback, &cbt);
+	} else {
+		char *sql;
+
+		if (host) {
+			sql = switch_mprintf("select contact,expires from sip_registrations where sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')",
+							user, host, host);
+		} else {
+			sql = switch_mprintf("select contact,expires from sip_registrations where sip_user='%q'", user);
+		}
+
+		sofia_glue_execute_sql_callback(profile, profile->dbh_mutex, sql, sofia_reg_find_reg_with_positive_expires_callback, &cbt);
+		switch_safe_free(sql);
+	}
 
 	return cbt.list;
 }
@@ -1137,15 +1876,23 @@ void sofia_reg_auth_challenge(sofia_profile_t *profile, nua_handle_t *nh, sofia_
 
 uint32_t sofia_reg_reg_count(sofia_profile_t *profile, const char *user, const char *host)
 {
+	sofia_reg_filter_t filter = { 0 };
 	char buf[32] = "";
 	char *sql;
-	
+
+	if (sofia_reg_store_authoritative(profile)) {
+		filter.user = user;
+		filter.host = host;
+
+		return sofia_reg_store_count(profile, &filter);
+	}
+
 	sql = switch_mprintf("select count(*) from sip_registrations where profile_name='%q' and "
 						 "sip_user='%q' and (sip_host='%q' or presence_hosts like '%%%q%%')", profile->name, user, host, host);
-	
+
 	sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, buf, sizeof(buf));
 	switch_safe_free(sql);
-	return atoi(buf);													
+	return atoi(buf);
 }
 
 static int debounce_check(sofia_profile_t *profile, const char *user, const char *host)
@@ -1822,6 +2569,9 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		char *url = NULL;
 		char *contact = NULL;
 		switch_bool_t update_registration = SWITCH_FALSE;
+		sofia_reg_filter_t filter = { 0 };
+		sofia_reg_entry_t row = { 0 };
+		long expires = (long) reg_time + (long) exptime + profile->sip_expires_late_margin;
 
 		if (auth_params) {
 			username = switch_event_get_header(auth_params, "sip_auth_username");
@@ -1831,28 +2581,33 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		if (auth_res != AUTH_RENEWED || !multi_reg) {
 			if (multi_reg) {
 				if (multi_reg_contact) {
+					filter.user = to_user;
+					filter.host = reg_host;
+					filter.strict_host = SWITCH_TRUE;
+					filter.contact = contact_str;
 					sql =
 						switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q' and contact='%q'", to_user, reg_host, contact_str);
 				} else {
+					filter.call_id = call_id;
 					sql = switch_mprintf("delete from sip_registrations where call_id='%q'", call_id);
 				}
 			} else {
+				filter.user = to_user;
+				filter.host = reg_host;
+				filter.strict_host = SWITCH_TRUE;
 				sql = switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q'", to_user, reg_host);
 			}
 
-			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			sofia_reg_store_delete(profile, &filter, NULL, NULL);
+			sofia_reg_store_write_behind(profile, &sql);
 		} else {
-			char buf[32] = "";
-
-			
-			sql = switch_mprintf("select count(*) from sip_registrations where sip_user='%q' and sip_username='%q' and sip_host='%q' and contact='%q'", 
-								 to_user, username, reg_host, contact_str);
-
-
+			filter.user = to_user;
+			filter.username = username;
+			filter.host = reg_host;
+			filter.strict_host = SWITCH_TRUE;
+			filter.contact = contact_str;
 
-			sofia_glue_execute_sql2str(profile, profile->dbh_mutex, sql, buf, sizeof(buf));
-			switch_safe_free(sql);
-			if (atoi(buf) > 0) {
+			if (sofia_reg_store_count(profile, &filter) > 0) {
 				update_registration = SWITCH_TRUE;
 			}
 		}
@@ -1862,7 +2617,7 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		contact = sofia_glue_get_url_from_contact(contact_str, 1);
 		url = switch_mprintf("sofia/%q/%s:%q", profile->name, proto, sofia_glue_strip_proto(contact));
 		
-		switch_core_add_registration(to_user, reg_host, call_id, url, (long) reg_time + (long) exptime + profile->sip_expires_late_margin,
+		switch_core_add_registration(to_user, reg_host, call_id, url, expires,
 									 network_ip, network_port_c, is_tls ? "tls" : is_tcp ? "tcp" : "udp", reg_meta);
 
 		switch_safe_free(url);
@@ -1899,6 +2654,29 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		}
 		
 
+		row.call_id = (char *) call_id;
+		row.sip_user = (char *) to_user;
+		row.sip_host = (char *) reg_host;
+		row.presence_hosts = profile->presence_hosts;
+		row.contact = contact_str;
+		row.status = (char *) reg_desc;
+		row.rpid = (char *) rpid;
+		row.expires = expires;
+		row.user_agent = (char *) agent;
+		row.server_user = (char *) from_user;
+		row.server_host = guess_ip4;
+		row.hostname = mod_sofia_globals.hostname;
+		row.orig_hostname = mod_sofia_globals.hostname;
+		row.network_ip = network_ip;
+		row.network_port = network_port_c;
+		row.sip_username = (char *) username;
+		row.sip_realm = (char *) realm;
+		row.mwi_user = mwi_user;
+		row.mwi_host = mwi_host;
+		row.sub_host = (char *) sub_host;
+		row.ping_status = "Reachable";
+		sofia_reg_store_update(profile, &row);
+
 		if (!update_registration) {
 			sql = switch_mprintf("insert into sip_registrations "
 					"(call_id,sip_user,sip_host,presence_hosts,contact,status,rpid,expires,"
@@ -1906,7 +2684,7 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 					"mwi_user,mwi_host, orig_server_host, orig_hostname, sub_host, ping_status, ping_count) "
 					"values ('%q','%q', '%q','%q','%q','%q', '%q', %ld, '%q', '%q', '%q', '%q', '%q', '%q', '%q','%q','%q','%q','%q','%q','%q','%q', '%q', %d)", 
 					call_id, to_user, reg_host, profile->presence_hosts ? profile->presence_hosts : "", 
-					contact_str, reg_desc, rpid, (long) reg_time + (long) exptime + profile->sip_expires_late_margin,
+					contact_str, reg_desc, rpid, expires,
 					agent, from_user, guess_ip4, profile->name, mod_sofia_globals.hostname, network_ip, network_port_c, username, realm, 
 								 mwi_user, mwi_host, guess_ip4, mod_sofia_globals.hostname, sub_host, "Reachable", 0);
 		} else {
@@ -1918,12 +2696,12 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 								 call_id, sub_host, network_ip, network_port_c,
 								 profile->presence_hosts ? profile->presence_hosts : "", guess_ip4, guess_ip4,
                                                                  mod_sofia_globals.hostname, mod_sofia_globals.hostname,
-								 (long) reg_time + (long) exptime + profile->sip_expires_late_margin,
+								 expires,
 								 to_user, username, reg_host, contact_str);
 		}				 
 
 		if (sql) {
-			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			sofia_reg_store_write_behind(profile, &sql);
 		}
 
 		if (!update_registration && sofia_reg_reg_count(profile, to_user, reg_host) == 1) {
@@ -1936,13 +2714,21 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		}
 
 		if (multi_reg) {
+			memset(&filter, 0, sizeof(filter));
+			filter.expires_not = expires;
+
+			/* the contact is looked up under this user only, the other users' copies age out on their own */
 			if (multi_reg_contact) {
-				sql = switch_mprintf("delete from sip_registrations where contact='%q' and expires!=%ld", contact_str, (long) reg_time + (long) exptime + profile->sip_expires_late_margin);
+				filter.user = to_user;
+				filter.contact = contact_str;
+				sql = switch_mprintf("delete from sip_registrations where contact='%q' and expires!=%ld", contact_str, expires);
 			} else {
-				sql = switch_mprintf("delete from sip_registrations where call_id='%q' and expires!=%ld", call_id, (long) reg_time + (long) exptime + profile->sip_expires_late_margin);
+				filter.call_id = call_id;
+				sql = switch_mprintf("delete from sip_registrations where call_id='%q' and expires!=%ld", call_id, expires);
 			}
 			
-			sofia_glue_execute_sql(profile, &sql, SWITCH_TRUE);
+			sofia_reg_store_delete(profile, &filter, NULL, NULL);
+			sofia_reg_store_write_behind(profile, &sql);
 		}
 
 
@@ -1978,8 +2764,11 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 		}
 
 	} else {
+		sofia_reg_filter_t filter = { 0 };
 		int send = 1;
 
+		filter.strict_host = SWITCH_TRUE;
+
 		if (multi_reg) {
 			if (sofia_reg_reg_count(profile, to_user, sub_host) > 0) {
 				send = 0;
@@ -2013,19 +2802,27 @@ uint8_t sofia_reg_handle_register_token(nua_t *nua, sofia_profile_t *profile, nu
 			}
 
 			if (multi_reg_contact) {
+				filter.user = to_user;
+				filter.host = reg_host;
+				filter.contact = contact_str;
 				sql =
 					switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q' and contact='%q'", to_user, reg_host, contact_str);
 			} else {
+				filter.call_id = call_id;
 				sql = switch_mprintf("delete from sip_registrations where call_id='%q'", call_id);
 			}
 	
-			sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+			sofia_reg_store_delete(profile, &filter, NULL, NULL);
+			sofia_reg_store_write_behind(profile, &sql);
 
 			switch_safe_free(icontact);
 		} else {
+			filter.user = to_user;
+			filter.host = reg_host;
 
 			if ((sql = switch_mprintf("delete from sip_registrations where sip_user='%q' and sip_host='%q'", to_user, reg_host))) {
-				sofia_glue_execute_sql_now(profile, &sql, SWITCH_TRUE);
+				sofia_reg_store_delete(profile, &filter, NULL, NULL);
+				sofia_reg_store_write_behind(profile, &sql);
 			}
 		}
 	}
@@ -0,0 +1,444 @@
+/* 
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * 
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Seven Du <dujinfang@gmail.com>
+ *
+ *
+ * es_output.c -- Queued event output for event socket listeners
+ *
+ */
+#include "es_output.h"
+
+#define SHARED_EVENT_LOCKS 32
+
+static switch_mutex_t *render_mutex[SHARED_EVENT_LOCKS];
+
+void es_output_init(switch_memory_pool_t *pool)
+{
+	int i;
+
+	for (i = 0; i < SHARED_EVENT_LOCKS; i++) {
+		switch_mutex_init(&render_mutex[i], SWITCH_MUTEX_NESTED, pool);
+	}
+}
+
+const char *format2str(event_format_t format)
+{
+	switch (format) {
+	case EVENT_FORMAT_PLAIN:
+		return "plain";
+	case EVENT_FORMAT_XML:
+		return "xml";
+	case EVENT_FORMAT_JSON:
+		return "json";
+	}
+
+	return "invalid";
+}
+
+const char *policy2str(output_policy_t policy)
+{
+	switch (policy) {
+	case OUTPUT_POLICY_COALESCE:
+		return "coalesce";
+	case OUTPUT_POLICY_DROP_OLDEST:
+		return "drop-oldest";
+	default:
+		return "none";
+	}
+}
+
+output_policy_t str2policy(const char *str)
+{
+	if (!strcasecmp(str, "coalesce")) {
+		return OUTPUT_POLICY_COALESCE;
+	} else if (!strcasecmp(str, "drop-oldest")) {
+		return OUTPUT_POLICY_DROP_OLDEST;
+	}
+
+	return OUTPUT_POLICY_NONE;
+}
+
+shared_event_t *shared_event_create(switch_event_t **event)
+{
+	shared_event_t *se;
+
+	switch_zmalloc(se, sizeof(*se));
+	se->event = *event;
+	*event = NULL;
+	switch_atomic_set(&se->refs, 1);
+
+	return se;
+}
+
+void shared_event_ref(shared_event_t *se)
+{
+	switch_atomic_inc(&se->refs);
+}
+
+void shared_event_unref(shared_event_t **sep)
+{
+	shared_event_t *se = *sep;
+	int i;
+
+	*sep = NULL;
+
+	if (!se || switch_atomic_dec(&se->refs)) {
+		return;
+	}
+
+	for (i = 0; i <= EVENT_FORMAT_JSON; i++) {
+		switch_safe_free(se->body[i]);
+	}
+
+	switch_event_destroy(&se->event);
+	free(se);
+}
+
+const char *shared_event_render(shared_event_t *se, event_format_t format, switch_size_t *len)
+{
+	switch_mutex_t *mutex = render_mutex[((uintptr_t) se >> 4) % SHARED_EVENT_LOCKS];
+	const char *body;
+
+	switch_mutex_lock(mutex);
+
+	if (!se->body[format]) {
+		switch (format) {
+		case EVENT_FORMAT_PLAIN:
+			switch_event_serialize(se->event, &se->body[format], SWITCH_TRUE);
+			break;
+		case EVENT_FORMAT_JSON:
+			switch_event_serialize_json(se->event, &se->body[format]);
+			break;
+		case EVENT_FORMAT_XML:
+			{
+				switch_xml_t xml;
+
+				if ((xml = switch_event_xmlize(se->event, SWITCH_VA_NONE))) {
+					se->body[format] = switch_xml_toxml(xml, SWITCH_FALSE);
+					switch_xml_free(xml);
+				}
+			}
+			break;
+		}
+
+		if (se->body[format]) {
+			se->body_len[format] = strlen(se->body[format]);
+		}
+	}
+
+	body = se->body[format];
+	*len = se->body_len[format];
+
+	switch_mutex_unlock(mutex);
+
+	return body;
+}
+
+void listener_output_init(listener_output_t *out, uint32_t id, output_policy_t policy, uint32_t high_watermark, uint32_t low_watermark,
+						  switch_memory_pool_t *pool)
+{
+	out->id = id;
+	out->policy = policy;
+	out->high_watermark = high_watermark;
+	out->low_watermark = low_watermark;
+
+	if (out->policy == OUTPUT_POLICY_COALESCE) {
+		switch_mutex_init(&out->coalesce_mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_core_hash_init(&out->coalesce_hash);
+	}
+}
+
+/* Events that report the current state of something, so a newer one makes an older one still
+   waiting in the queue worthless. */
+static switch_bool_t coalesce_key(switch_event_t *event, char *key, switch_size_t len)
+{
+	const char *id;
+
+	switch (event->event_id) {
+	case SWITCH_EVENT_HEARTBEAT:
+	case SWITCH_EVENT_SESSION_HEARTBEAT:
+	case SWITCH_EVENT_CHANNEL_CALLSTATE:
+	case SWITCH_EVENT_CALL_UPDATE:
+	case SWITCH_EVENT_PRESENCE_IN:
+	case SWITCH_EVENT_PRESENCE_OUT:
+	case SWITCH_EVENT_MESSAGE_WAITING:
+	case SWITCH_EVENT_RE_SCHEDULE:
+		break;
+	default:
+		return SWITCH_FALSE;
+	}
+
+	if (!(id = switch_event_get_header(event, "Unique-ID")) && !(id = switch_event_get_header(event, "from")) &&
+		!(id = switch_event_get_header(event, "MWI-Message-Account")) && !(id = switch_event_get_header(event, "Task-ID"))) {
+		id = "";
+	}
+
+	switch_snprintf(key, len, "%d|%s|%s", event->event_id, switch_str_nil(event->subclass_name), id);
+
+	return SWITCH_TRUE;
+}
+
+/* Forgets se as the newest event for its key, returns SWITCH_TRUE if a newer one has replaced it */
+static switch_bool_t coalesce_forget(listener_output_t *out, shared_event_t *se)
+{
+	shared_event_t *latest;
+	switch_bool_t superseded = SWITCH_FALSE;
+	char key[256];
+
+	if (!out->coalesce_hash || !coalesce_key(se->event, key, sizeof(key))) {
+		return SWITCH_FALSE;
+	}
+
+	switch_mutex_lock(out->coalesce_mutex);
+	if ((latest = switch_core_hash_find(out->coalesce_hash, key))) {
+		if (latest == se) {
+			switch_core_hash_delete(out->coalesce_hash, key);
+			shared_event_unref(&latest);
+		} else {
+			superseded = SWITCH_TRUE;
+		}
+	}
+	switch_mutex_unlock(out->coalesce_mutex);
+
+	return superseded;
+}
+
+static switch_bool_t coalesce_unref_callback(const void *key, const void *val, void *pData)
+{
+	shared_event_t *se = (shared_event_t *) val;
+
+	shared_event_unref(&se);
+
+	return SWITCH_TRUE;
+}
+
+switch_status_t listener_output_queue(listener_output_t *out, switch_queue_t *queue, shared_event_t *se)
+{
+	unsigned int queued = switch_queue_size(queue);
+	char key[256];
+
+	if (queued >= out->high_watermark && !switch_atomic_cas(&out->backlogged, 1, 0)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Listener %u is backlogged with %u events queued, policy %s\n",
+						  out->id, queued, policy2str(out->policy));
+	}
+
+	if (!switch_atomic_read(&out->backlogged)) {
+		goto push;
+	}
+
+	if (out->policy == OUTPUT_POLICY_DROP_OLDEST) {
+		void *pop;
+
+		while (queued-- >= out->high_watermark && switch_queue_trypop(queue, &pop) == SWITCH_STATUS_SUCCESS) {
+			shared_event_t *oldest = (shared_event_t *) pop;
+
+			coalesce_forget(out, oldest);
+			shared_event_unref(&oldest);
+			switch_atomic_inc(&out->dropped);
+		}
+	}
+
+	/* registered before the push so the writer can never pop it first */
+	if (out->coalesce_hash && coalesce_key(se->event, key, sizeof(key))) {
+		shared_event_t *older;
+
+		switch_mutex_lock(out->coalesce_mutex);
+		if ((older = switch_core_hash_find(out->coalesce_hash, key))) {
+			shared_event_unref(&older);
+		}
+		shared_event_ref(se);
+		switch_core_hash_insert(out->coalesce_hash, key, se);
+		switch_mutex_unlock(out->coalesce_mutex);
+	}
+
+ push:
+
+	shared_event_ref(se);
+	if (switch_queue_trypush(queue, se) == SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	coalesce_forget(out, se);
+	switch_atomic_inc(&out->dropped);
+	switch_atomic_dec(&se->refs);
+
+	return SWITCH_STATUS_FALSE;
+}
+
+shared_event_t *listener_output_pop(listener_output_t *out, switch_queue_t *queue)
+{
+	shared_event_t *se = NULL;
+	void *pop;
+
+	while (switch_queue_trypop(queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		se = (shared_event_t *) pop;
+
+		if (!coalesce_forget(out, se)) {
+			break;
+		}
+
+		switch_atomic_inc(&out->coalesced);
+		shared_event_unref(&se);
+	}
+
+	if (switch_atomic_read(&out->backlogged) && switch_queue_size(queue) <= out->low_watermark && switch_atomic_cas(&out->backlogged, 0, 1)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Listener %u caught up, %u dropped, %u coalesced so far\n",
+						  out->id, switch_atomic_read(&out->dropped), switch_atomic_read(&out->coalesced));
+	}
+
+	return se;
+}
+
+void listener_output_release(listener_output_t *out)
+{
+	int i;
+
+	for (i = 0; i < out->nevents; i++) {
+		shared_event_unref(&out->events[i]);
+	}
+
+	out->nevents = out->nvec = out->cur = 0;
+}
+
+/* Lays the next queued events out for one gathered write */
+int listener_output_fill(listener_output_t *out, switch_queue_t *queue, event_format_t format)
+{
+	shared_event_t *se;
+
+	while (out->nevents < OUTPUT_BATCH && (se = listener_output_pop(out, queue))) {
+		const char *body;
+		switch_size_t blen;
+
+		if (!(body = shared_event_render(se, format, &blen))) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Listener %u %s ERROR!\n", out->id, format == EVENT_FORMAT_XML ? "XML" : "Render");
+			shared_event_unref(&se);
+			continue;
+		}
+
+		switch_snprintf(out->headers[out->nevents], sizeof(out->headers[out->nevents]),
+						"Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", blen, format2str(format));
+
+		out->vec[out->nvec].base = out->headers[out->nevents];
+		out->vec[out->nvec++].len = strlen(out->headers[out->nevents]);
+		out->vec[out->nvec].base = body;
+		out->vec[out->nvec++].len = blen;
+		out->events[out->nevents++] = se;
+	}
+
+	return out->nevents;
+}
+
+switch_status_t listener_output_write(listener_output_t *out, switch_queue_t *queue, switch_socket_t *sock, event_format_t format, switch_bool_t wait)
+{
+	switch_status_t status;
+	int batches = 0, to_count = 0;
+
+	for (;;) {
+		switch_size_t len = 0;
+
+		if (out->cur == out->nvec) {
+			out->sent_events += out->nevents;
+			listener_output_release(out);
+
+			if (wait || ++batches > 8 || !listener_output_fill(out, queue, format)) {
+				return SWITCH_STATUS_SUCCESS;
+			}
+		}
+
+		status = switch_socket_sendv_nonblock(sock, out->vec + out->cur, out->nvec - out->cur, &len);
+		out->syscalls++;
+		out->sent_bytes += len;
+
+		while (len) {
+			if (len >= out->vec[out->cur].len) {
+				len -= out->vec[out->cur++].len;
+			} else {
+				out->vec[out->cur].base += len;
+				out->vec[out->cur].len -= len;
+				len = 0;
+			}
+		}
+
+		if (status == SWITCH_STATUS_SUCCESS) {
+			to_count = 0;
+			continue;
+		}
+
+		if (!SWITCH_STATUS_IS_BREAK(status)) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		if (!wait) {
+			return SWITCH_STATUS_BREAK;
+		}
+
+		if (++to_count > 60000) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_yield(10000);
+	}
+}
+
+void listener_output_flush(listener_output_t *out, switch_queue_t *queue)
+{
+	void *pop;
+
+	while (queue && switch_queue_trypop(queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		shared_event_t *se = (shared_event_t *) pop;
+
+		shared_event_unref(&se);
+	}
+
+	listener_output_release(out);
+
+	if (out->coalesce_hash) {
+		switch_mutex_lock(out->coalesce_mutex);
+		switch_core_hash_delete_multi(out->coalesce_hash, coalesce_unref_callback, NULL);
+		switch_mutex_unlock(out->coalesce_mutex);
+	}
+}
+
+void listener_output_destroy(listener_output_t *out, switch_queue_t *queue)
+{
+	listener_output_flush(out, queue);
+
+	if (out->coalesce_hash) {
+		switch_core_hash_destroy(&out->coalesce_hash);
+	}
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
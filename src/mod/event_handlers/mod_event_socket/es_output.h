@@ -0,0 +1,134 @@
+/* 
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ * 
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Seven Du <dujinfang@gmail.com>
+ *
+ *
+ * es_output.h -- Queued event output for event socket listeners
+ *
+ */
+#ifndef ES_OUTPUT_H
+#define ES_OUTPUT_H
+
+#include <switch.h>
+
+SWITCH_BEGIN_EXTERN_C
+
+#define OUTPUT_BATCH (SWITCH_IOVEC_MAX / 2)
+
+typedef enum {
+	EVENT_FORMAT_PLAIN,
+	EVENT_FORMAT_XML,
+	EVENT_FORMAT_JSON
+} event_format_t;
+
+typedef enum {
+	OUTPUT_POLICY_NONE,
+	OUTPUT_POLICY_COALESCE,
+	OUTPUT_POLICY_DROP_OLDEST
+} output_policy_t;
+
+/*! \brief A fired event shared by every listener it was queued to.  The event is never modified once shared and
+    each format is rendered at most once, by the first listener that asks for it. */
+typedef struct shared_event {
+	switch_event_t *event;
+	char *body[EVENT_FORMAT_JSON + 1];
+	switch_size_t body_len[EVENT_FORMAT_JSON + 1];
+	volatile switch_atomic_t refs;
+} shared_event_t;
+
+/*! \brief The output side of one listener: its backpressure policy and the events popped off its queue and
+    laid out as header/body buffer pairs for one gathered write.  vec[cur] onwards is still unsent; vec[cur]
+    may have been partly sent already. */
+typedef struct listener_output {
+	uint32_t id;
+	output_policy_t policy;
+	uint32_t high_watermark;
+	uint32_t low_watermark;
+	volatile switch_atomic_t backlogged;
+	switch_mutex_t *coalesce_mutex;
+	/*! the newest queued event per coalesce key, each holding a reference */
+	switch_hash_t *coalesce_hash;
+	shared_event_t *events[OUTPUT_BATCH];
+	char headers[OUTPUT_BATCH][128];
+	switch_iovec_t vec[OUTPUT_BATCH * 2];
+	int nevents;
+	int nvec;
+	int cur;
+	uint64_t sent_bytes;
+	uint64_t sent_events;
+	uint64_t syscalls;
+	volatile switch_atomic_t dropped;
+	volatile switch_atomic_t coalesced;
+} listener_output_t;
+
+void es_output_init(switch_memory_pool_t *pool);
+const char *format2str(event_format_t format);
+const char *policy2str(output_policy_t policy);
+output_policy_t str2policy(const char *str);
+
+/*! \brief Takes ownership of the event */
+shared_event_t *shared_event_create(switch_event_t **event);
+void shared_event_ref(shared_event_t *se);
+void shared_event_unref(shared_event_t **sep);
+const char *shared_event_render(shared_event_t *se, event_format_t format, switch_size_t *len);
+
+void listener_output_init(listener_output_t *out, uint32_t id, output_policy_t policy, uint32_t high_watermark, uint32_t low_watermark,
+						  switch_memory_pool_t *pool);
+
+/*! \brief Queues a reference to the event, applying the policy once the queue is backlogged.
+    Returns SWITCH_STATUS_FALSE if the queue was still full and the event was dropped. */
+switch_status_t listener_output_queue(listener_output_t *out, switch_queue_t *queue, shared_event_t *se);
+
+/*! \brief Pops the next queued event a newer one has not coalesced, the caller owns the reference */
+shared_event_t *listener_output_pop(listener_output_t *out, switch_queue_t *queue);
+
+int listener_output_fill(listener_output_t *out, switch_queue_t *queue, event_format_t format);
+
+/*! \brief Writes queued events with as few syscalls as possible.  Without wait it returns SWITCH_STATUS_BREAK as
+    soon as the socket is full, leaving the rest of the batch for the next call; with wait it only finishes
+    the batch already started, so another frame can be written right after without splitting an event. */
+switch_status_t listener_output_write(listener_output_t *out, switch_queue_t *queue, switch_socket_t *sock, event_format_t format, switch_bool_t wait);
+
+void listener_output_release(listener_output_t *out);
+
+/*! \brief Drops everything queued, batched or waiting to be coalesced */
+void listener_output_flush(listener_output_t *out, switch_queue_t *queue);
+void listener_output_destroy(listener_output_t *out, switch_queue_t *queue);
+
+SWITCH_END_EXTERN_C
+
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
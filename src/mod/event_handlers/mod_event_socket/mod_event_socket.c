@@ -31,9 +31,12 @@
  *
  */
 #include <switch.h>
+#include "es_output.h"
 #define CMD_BUFLEN 1024 * 1000
 #define MAX_QUEUE_LEN 100000
 #define MAX_MISSED 500
+#define DEFAULT_HIGH_WATERMARK 10000
+#define DEFAULT_LOW_WATERMARK 1000
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime);
@@ -61,12 +64,6 @@ typedef enum {
 	LFLAG_ALLOW_LOG = (1 << 16)
 } event_flag_t;
 
-typedef enum {
-	EVENT_FORMAT_PLAIN,
-	EVENT_FORMAT_XML,
-	EVENT_FORMAT_JSON
-} event_format_t;
-
 struct listener {
 	switch_socket_t *sock;
 	switch_queue_t *event_queue;
@@ -77,7 +74,6 @@ struct listener {
 	switch_mutex_t *filter_mutex;
 	uint32_t flags;
 	switch_log_level_t level;
-	char *ebuf;
 	uint8_t event_list[SWITCH_EVENT_ALL + 1];
 	uint8_t allowed_event_list[SWITCH_EVENT_ALL + 1];
 	switch_hash_t *event_hash;
@@ -98,6 +94,7 @@ struct listener {
 	time_t linger_timeout;
 	struct listener *next;
 	switch_pollfd_t *pollfd;
+	listener_output_t out;
 };
 
 typedef struct listener listener_t;
@@ -129,21 +126,18 @@ static struct {
 	uint32_t id;
 	int nat_map;
 	int stop_on_bind_error;
+	output_policy_t output_policy;
+	uint32_t high_watermark;
+	uint32_t low_watermark;
 } prefs;
 
 
-static const char *format2str(event_format_t format)
+static void listener_output_setup(listener_t *listener)
 {
-	switch (format) {
-	case EVENT_FORMAT_PLAIN:
-		return "plain";
-	case EVENT_FORMAT_XML:
-		return "xml";
-	case EVENT_FORMAT_JSON:
-		return "json";
-	}
+	uint32_t high = prefs.high_watermark ? prefs.high_watermark : DEFAULT_HIGH_WATERMARK;
+	uint32_t low = prefs.low_watermark < high ? prefs.low_watermark : high / 10;
 
-	return "invalid";
+	listener_output_init(&listener->out, listener->id, prefs.output_policy, high, low, listener->pool);
 }
 
 static void remove_listener(listener_t *listener);
@@ -207,12 +201,7 @@ static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch
 	}
 
 	if (listener->event_queue) {
-		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			switch_event_t *pevent = (switch_event_t *) pop;
-			if (!pop)
-				continue;
-			switch_event_destroy(&pevent);
-		}
+		listener_output_flush(&listener->out, listener->event_queue);
 	}
 }
 
@@ -236,6 +225,7 @@ static switch_status_t expire_listener(listener_t ** listener)
 
 	flush_listener(*listener, SWITCH_TRUE, SWITCH_TRUE);
 	switch_core_hash_destroy(&l->event_hash);
+	listener_output_destroy(&l->out, l->event_queue);
 
 	if (l->allowed_event_hash) {
 		switch_core_hash_destroy(&l->allowed_event_hash);
@@ -262,6 +252,7 @@ static switch_status_t expire_listener(listener_t ** listener)
 static void event_handler(switch_event_t *event)
 {
 	switch_event_t *clone = NULL;
+	shared_event_t *shared = NULL;
 	listener_t *l, *lp, *last = NULL;
 	time_t now = switch_epoch_time_now(NULL);
 
@@ -369,27 +360,32 @@ static void event_handler(switch_event_t *event)
 			}
 		}
 
-		if (send) {
+		/* one copy of the event is shared by every listener that takes it */
+		if (send && !shared) {
 			if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
-				if (switch_queue_trypush(l->event_queue, clone) == SWITCH_STATUS_SUCCESS) {
-					if (l->lost_events) {
-						int le = l->lost_events;
-						l->lost_events = 0;
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
-					}
-				} else {
-					if (++l->lost_events > MAX_MISSED) {
-						kill_listener(l, NULL);
-					}
-					switch_event_destroy(&clone);
-				}
+				shared = shared_event_create(&clone);
 			} else {
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
+				send = 0;
+			}
+		}
+
+		if (send) {
+			if (listener_output_queue(&l->out, l->event_queue, shared) == SWITCH_STATUS_SUCCESS) {
+				if (l->lost_events) {
+					int le = l->lost_events;
+					l->lost_events = 0;
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
+				}
+			} else if (++l->lost_events > MAX_MISSED) {
+				kill_listener(l, NULL);
 			}
 		}
 		last = l;
 	}
 	switch_mutex_unlock(globals.listener_mutex);
+
+	shared_event_unref(&shared);
 }
 
 SWITCH_STANDARD_APP(socket_function)
@@ -490,6 +486,7 @@ SWITCH_STANDARD_APP(socket_function)
 
 	switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 	switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+	listener_output_setup(listener);
 
 	switch_core_hash_init(&listener->event_hash);
 	switch_set_flag(listener, LFLAG_AUTHED);
@@ -690,6 +687,34 @@ static void xmlize_listener(listener_t *listener, switch_stream_handle_t *stream
 	stream->write_function(stream, " </listener>\n");
 }
 
+#define EVENT_SOCKET_SYNTAX "show"
+SWITCH_STANDARD_API(event_socket_function)
+{
+	listener_t *l;
+	int count = 0;
+
+	if (zstr(cmd) || strcasecmp(cmd, "show")) {
+		stream->write_function(stream, "-USAGE: %s\n", EVENT_SOCKET_SYNTAX);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "id,remote,format,policy,queued,backlogged,bytes,events,syscalls,drops,coalesced\n");
+
+	switch_mutex_lock(globals.listener_mutex);
+	for (l = listen_list.listeners; l; l = l->next) {
+		stream->write_function(stream, "%u,%s:%u,%s,%s,%u,%s,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%u,%u\n",
+							   l->id, l->remote_ip, l->remote_port, format2str(l->format), policy2str(l->out.policy),
+							   switch_queue_size(l->event_queue), switch_atomic_read(&l->out.backlogged) ? "true" : "false",
+							   l->out.sent_bytes, l->out.sent_events, l->out.syscalls, switch_atomic_read(&l->out.dropped), switch_atomic_read(&l->out.coalesced));
+		count++;
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+
+	stream->write_function(stream, "\n%d total.\n", count);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(event_sink_function)
 {
 	char *http = NULL;
@@ -856,7 +881,6 @@ SWITCH_STANDARD_API(event_sink_function)
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
-
 		switch_core_hash_init(&listener->event_hash);
 		switch_set_flag(listener, LFLAG_AUTHED);
 		switch_set_flag(listener, LFLAG_STATEFUL);
@@ -873,6 +897,7 @@ SWITCH_STANDARD_API(event_sink_function)
 		}
 		switch_thread_rwlock_create(&listener->rwlock, listener->pool);
 		listener->id = next_id();
+		listener_output_setup(listener);
 		listener->timeout = 60;
 		listener->last_flush = switch_epoch_time_now(NULL);
 
@@ -926,6 +951,7 @@ SWITCH_STANDARD_API(event_sink_function)
 
 			if (!key_count) {
 				switch_core_hash_destroy(&listener->event_hash);
+				listener_output_destroy(&listener->out, listener->event_queue);
 				switch_core_destroy_memory_pool(&listener->pool);
 				if (listener->format == EVENT_FORMAT_JSON) {
 					stream->write_function(stream, "{\"reply\": \"error\", \"reply_text\":\"No keywords supplied\"}");
@@ -993,7 +1019,7 @@ SWITCH_STANDARD_API(event_sink_function)
 		char *id = switch_event_get_header(stream->param_event, "listen-id");
 		uint32_t idl = 0;
 		void *pop;
-		switch_event_t *pevent = NULL;
+		shared_event_t *se;
 		cJSON *cj = NULL, *cjevents = NULL;
 
 		if (id) {
@@ -1054,37 +1080,26 @@ SWITCH_STANDARD_API(event_sink_function)
 			stream->write_function(stream, "<events>\n");
 		}
 
-		while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-			//char *etype;
-			pevent = (switch_event_t *) pop;
+		while ((se = listener_output_pop(&listener->out, listener->event_queue))) {
+			const char *body;
+			switch_size_t blen;
 
-			if (listener->format == EVENT_FORMAT_PLAIN) {
-				//etype = "plain";
-				switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", listener->ebuf);
-			} else if (listener->format == EVENT_FORMAT_JSON) {
-				//etype = "json";
+			if (listener->format == EVENT_FORMAT_JSON) {
 				cJSON *cjevent = NULL;
 
-				switch_event_serialize_json_obj(pevent, &cjevent);
+				switch_event_serialize_json_obj(se->event, &cjevent);
 				cJSON_AddItemToArray(cjevents, cjevent);
+			} else if (!(body = shared_event_render(se, listener->format, &blen))) {
+				stream->write_function(stream, "<data><reply type=\"error\">XML Render Error</reply></data>\n");
+				shared_event_unref(&se);
+				break;
+			} else if (listener->format == EVENT_FORMAT_PLAIN) {
+				stream->write_function(stream, "<event type=\"plain\">\n%s</event>", body);
 			} else {
-				switch_xml_t xml;
-				//etype = "xml";
-
-				if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-					listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-					switch_xml_free(xml);
-				} else {
-					stream->write_function(stream, "<data><reply type=\"error\">XML Render Error</reply></data>\n");
-					break;
-				}
-
-				stream->write_function(stream, "%s\n", listener->ebuf);
+				stream->write_function(stream, "%s\n", body);
 			}
 
-			switch_safe_free(listener->ebuf);
-			switch_event_destroy(&pevent);
+			shared_event_unref(&se);
 		}
 
 		if (listener->format == EVENT_FORMAT_JSON) {
@@ -1099,10 +1114,6 @@ SWITCH_STANDARD_API(event_sink_function)
 			stream->write_function(stream, " </events>\n</data>\n");
 		}
 
-		if (pevent) {
-			switch_event_destroy(&pevent);
-		}
-
 		switch_thread_rwlock_unlock(listener->rwlock);
 	} else if (!strcasecmp(wcmd, "exec-fsapi")) {
 		char *api_command = switch_event_get_header(stream->param_event, "fsapi-command");
@@ -1153,6 +1164,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 	memset(&globals, 0, sizeof(globals));
 
 	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+	es_output_init(pool);
 
 	memset(&listen_list, 0, sizeof(listen_list));
 	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
@@ -1168,6 +1180,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 	SWITCH_ADD_APP(app_interface, "socket", "Connect to a socket", "Connect to a socket", socket_function, "<ip>[:<port>]", SAF_SUPPORT_NOMEDIA);
 	SWITCH_ADD_API(api_interface, "event_sink", "event_sink", event_sink_function, "<web data>");
+	SWITCH_ADD_API(api_interface, "event_socket", "Show event socket listeners", event_socket_function, EVENT_SOCKET_SYNTAX);
+	switch_console_set_complete("add event_socket show");
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -1208,7 +1222,7 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 	}
 
 	while (listener->sock && !prefs.done) {
-		uint8_t do_sleep = 1;
+		uint8_t do_sleep = 1, output_blocked = 0;
 		mlen = 1;
 
 		if (bytes == buf_len - 1) {
@@ -1335,7 +1349,8 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 
 		if (!*mbuf) {
 			if (switch_test_flag(listener, LFLAG_LOG)) {
-				if (switch_queue_trypop(listener->log_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				if (listener_output_write(&listener->out, listener->event_queue, listener->sock, listener->format, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS &&
+					switch_queue_trypop(listener->log_queue, &pop) == SWITCH_STATUS_SUCCESS) {
 					switch_log_node_t *dnode = (switch_log_node_t *) pop;
 
 					if (dnode->data) {
@@ -1369,7 +1384,12 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 				if (switch_channel_get_state(chan) < CS_HANGUP && switch_channel_test_flag(chan, CF_DIVERT_EVENTS)) {
 					switch_event_t *e = NULL;
 					while (switch_core_session_dequeue_event(listener->session, &e, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
-						if (switch_queue_trypush(listener->event_queue, e) != SWITCH_STATUS_SUCCESS) {
+						shared_event_t *se = shared_event_create(&e);
+
+						if (switch_queue_trypush(listener->event_queue, se) != SWITCH_STATUS_SUCCESS) {
+							e = se->event;
+							se->event = NULL;
+							shared_event_unref(&se);
 							switch_core_session_queue_event(listener->session, &e);
 							break;
 						}
@@ -1377,50 +1397,22 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 				}
 			}
 
-			if (switch_test_flag(listener, LFLAG_EVENTS)) {
-				while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
-					char hbuf[512];
-					switch_event_t *pevent = (switch_event_t *) pop;
-					char *etype;
-
-					do_sleep = 0;
-					if (listener->format == EVENT_FORMAT_PLAIN) {
-						etype = "plain";
-						switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
-					} else if (listener->format == EVENT_FORMAT_JSON) {
-						etype = "json";
-						switch_event_serialize_json(pevent, &listener->ebuf);
-					} else {
-						switch_xml_t xml;
-						etype = "xml";
-
-						if ((xml = switch_event_xmlize(pevent, SWITCH_VA_NONE))) {
-							listener->ebuf = switch_xml_toxml(xml, SWITCH_FALSE);
-							switch_xml_free(xml);
-						} else {
-							switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_ERROR, "XML ERROR!\n");
-							goto endloop;
-						}
-					}
-
-					switch_assert(listener->ebuf);
-
-					len = strlen(listener->ebuf);
-
-					switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", len, etype);
+			if (switch_test_flag(listener, LFLAG_EVENTS) || listener->out.nvec) {
+				uint64_t sent = listener->out.sent_bytes;
 
-					len = strlen(hbuf);
-					switch_socket_send(listener->sock, hbuf, &len);
+				status = listener_output_write(&listener->out, listener->event_queue, listener->sock, listener->format, SWITCH_FALSE);
 
-					len = strlen(listener->ebuf);
-					switch_socket_send(listener->sock, listener->ebuf, &len);
-
-					switch_safe_free(listener->ebuf);
-
-				  endloop:
+				if (status == SWITCH_STATUS_FALSE) {
+					switch_goto_status(SWITCH_STATUS_FALSE, end);
+				}
 
-					switch_event_destroy(&pevent);
+				if (status == SWITCH_STATUS_BREAK) {
+					output_blocked = 1;
+				} else if (listener->out.sent_bytes != sent) {
+					do_sleep = 0;
 				}
+
+				status = SWITCH_STATUS_SUCCESS;
 			}
 		}
 
@@ -1451,7 +1443,8 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 				if (listener->linger_timeout != (time_t) -1) {
 					listener->linger_timeout += switch_epoch_time_now(NULL);
 				}
-				
+
+				listener_output_write(&listener->out, listener->event_queue, listener->sock, listener->format, SWITCH_TRUE);
 				len = strlen(disco_buf);
 				switch_socket_send(listener->sock, disco_buf, &len);
 			} else {
@@ -1462,7 +1455,13 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 
 		if (do_sleep) {
 			int fdr = 0;
-			switch_poll(listener->pollfd, 1, &fdr, 20000);
+			switch_os_socket_t fd;
+
+			if (output_blocked && switch_os_sock_get(&fd, listener->sock) == SWITCH_STATUS_SUCCESS) {
+				switch_wait_sock(fd, 20, SWITCH_POLL_READ | SWITCH_POLL_WRITE);
+			} else {
+				switch_poll(listener->pollfd, 1, &fdr, 20000);
+			}
 		} else {
 			switch_os_yield();
 		}
@@ -1470,6 +1469,11 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 
  end:
 
+	/* the caller writes its reply next, so no event may be left half written */
+	if (status == SWITCH_STATUS_SUCCESS && listener->sock && listener_output_write(&listener->out, listener->event_queue, listener->sock, listener->format, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
+		status = SWITCH_STATUS_FALSE;
+	}
+
 	switch_safe_free(mbuf);
 	return status;
 
@@ -2751,6 +2755,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 	}
 
 	switch_core_hash_destroy(&listener->event_hash);
+	listener_output_destroy(&listener->out, listener->event_queue);
 
 	if (listener->allowed_event_hash) {
 		switch_core_hash_destroy(&listener->allowed_event_hash);
@@ -2826,6 +2831,12 @@ static int config(void)
 					}
 				} else if (!strcasecmp(var, "stop-on-bind-error")) {
 					prefs.stop_on_bind_error = switch_true(val) ? 1 : 0;
+				} else if (!strcasecmp(var, "output-policy")) {
+					prefs.output_policy = str2policy(val);
+				} else if (!strcasecmp(var, "output-high-watermark")) {
+					prefs.high_watermark = (uint32_t) atoi(val);
+				} else if (!strcasecmp(var, "output-low-watermark")) {
+					prefs.low_watermark = (uint32_t) atoi(val);
 				}
 			}
 		}
@@ -2856,6 +2867,14 @@ static int config(void)
 		prefs.port = 8021;
 	}
 
+	if (!prefs.high_watermark || prefs.high_watermark > MAX_QUEUE_LEN) {
+		prefs.high_watermark = DEFAULT_HIGH_WATERMARK;
+	}
+
+	if (!prefs.low_watermark || prefs.low_watermark >= prefs.high_watermark) {
+		prefs.low_watermark = prefs.high_watermark < DEFAULT_LOW_WATERMARK * 10 ? prefs.high_watermark / 10 : DEFAULT_LOW_WATERMARK;
+	}
+
 	return 0;
 }
 
@@ -2960,6 +2979,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime)
 
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		listener_output_setup(listener);
 
 		switch_core_hash_init(&listener->event_hash);
 		switch_socket_create_pollset(&listener->pollfd, listener->sock, SWITCH_POLLIN | SWITCH_POLLERR, listener->pool);
@@ -128,21 +128,12 @@ void channelList_free(netsnmp_cache *cache, void *magic)
 
 int channelList_load(netsnmp_cache *cache, void *vmagic)
 {
-	switch_cache_db_handle_t *dbh;
-	char sql[1024] = "";
-
 	channelList_free(cache, NULL);
 
-	if (switch_core_db_handle(&dbh) != SWITCH_STATUS_SUCCESS) {
-		return 0;
-	}
-
 	idx = 1;
 
-	sprintf(sql, "SELECT * FROM channels WHERE hostname='%s' ORDER BY created_epoch", switch_core_get_switchname());
-	switch_cache_db_execute_sql_callback(dbh, sql, channelList_callback, NULL, NULL);
-
-	switch_cache_db_release_db_handle(&dbh);
+	/* the in-memory index only holds this switch's channels, in creation order, laid out like the channels table */
+	switch_core_channel_index_walk(SCI_VIEW_CHANNELS, NULL, SWITCH_FALSE, channelList_callback, NULL);
 
 	return 0;
 }
@@ -1198,15 +1198,16 @@ static int web_callback(void *pArg, int argc, char **argv, char **columnNames)
 	char *mp3, *m3u;
 	int uri_offset = 1;
 
+	/* columns of the channels table */
 	const char *uuid = argv[0];
-	const char *created = argv[1];
-	const char *cid_name = argv[2];
-	const char *cid_num = argv[3];
-	const char *dest = argv[4];
-	const char *application = argv[5] ? argv[5] : "N/A";
-	const char *application_data = argv[6] ? argv[6] : "N/A";
-	const char *read_codec = argv[7];
-	const char *read_rate = argv[8];
+	const char *created = argv[2];
+	const char *cid_name = argv[6];
+	const char *cid_num = argv[7];
+	const char *dest = argv[9];
+	const char *application = argv[10] ? argv[10] : "N/A";
+	const char *application_data = argv[11] ? argv[11] : "N/A";
+	const char *read_codec = argv[14];
+	const char *read_rate = argv[15];
 
 	holder->stream->write_function(holder->stream,
 								   "<tr><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>",
@@ -1441,14 +1442,7 @@ void do_broadcast(switch_stream_handle_t *stream)
 
 void do_index(switch_stream_handle_t *stream)
 {
-	switch_cache_db_handle_t *db;
-	const char *sql = "select uuid, created, cid_name, cid_num, dest, application, application_data, read_codec, read_rate from channels";
 	struct holder holder;
-	char *errmsg;
-
-	if (switch_core_db_handle(&db) != SWITCH_STATUS_SUCCESS) {
-		return;
-	}
 
 	holder.host = switch_event_get_header(stream->param_event, "http-host");
 	holder.port = switch_event_get_header(stream->param_event, "http-port");
@@ -1461,14 +1455,9 @@ void do_index(switch_stream_handle_t *stream)
 						   "<tr><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td><td>%s</td></tr>\n",
 						   "Created", "CID Name", "CID Num", "Ext", "App", "Data", "Codec", "Rate", "Listen");
 
-	switch_cache_db_execute_sql_callback(db, sql, web_callback, &holder, &errmsg);
+	switch_core_channel_index_walk(SCI_VIEW_CHANNELS, NULL, SWITCH_FALSE, web_callback, &holder);
 
 	stream->write_function(stream, "</table>");
-
-	if (errmsg) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error [%s]\n", errmsg);
-		switch_safe_free(errmsg);
-	}
 }
 
 #define TELECAST_SYNTAX ""
@@ -679,6 +679,21 @@ SWITCH_DECLARE(switch_status_t) switch_thread_create(switch_thread_t ** new_thre
 	return apr_thread_create(new_thread, attr, func, data, cont);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_create(switch_threadkey_t ** key, void (*dest) (void *), switch_memory_pool_t *pool)
+{
+	return apr_threadkey_private_create(key, dest, pool);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_get(void **new_mem, switch_threadkey_t *key)
+{
+	return apr_threadkey_private_get(new_mem, key);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_threadkey_private_set(void *priv, switch_threadkey_t *key)
+{
+	return apr_threadkey_private_set(priv, key);
+}
+
 SWITCH_DECLARE(switch_interval_time_t) switch_interval_time_from_timeval(struct timeval *tvp)
 {
 	return ((switch_interval_time_t)tvp->tv_sec * 1000000) + tvp->tv_usec / 1000;
@@ -770,6 +785,29 @@ SWITCH_DECLARE(switch_status_t) switch_socket_send_nonblock(switch_socket_t *soc
 	return apr_socket_send(sock, buf, len);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_socket_sendv_nonblock(switch_socket_t *sock, const switch_iovec_t *vec, int32_t nvec, switch_size_t *len)
+{
+	struct iovec iov[SWITCH_IOVEC_MAX];
+	int32_t i;
+
+	if (!sock || !vec || !len) {
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (nvec > SWITCH_IOVEC_MAX) {
+		nvec = SWITCH_IOVEC_MAX;
+	}
+
+	for (i = 0; i < nvec; i++) {
+		iov[i].iov_base = (void *) vec[i].base;
+		iov[i].iov_len = vec[i].len;
+	}
+
+	*len = 0;
+
+	return apr_socket_sendv(sock, iov, nvec, len);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_socket_sendto(switch_socket_t *sock, switch_sockaddr_t *where, int32_t flags, const char *buf,
 													 switch_size_t *len)
 {
@@ -1288,6 +1326,21 @@ SWITCH_DECLARE(void) switch_atomic_add(volatile switch_atomic_t *mem, uint32_t v
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_fetch_add(volatile switch_atomic_t *mem, uint32_t val)
+{
+#ifdef apr_atomic_t
+	uint32_t old;
+
+	do {
+		old = apr_atomic_read((apr_atomic_t *)mem);
+	} while (apr_atomic_cas((apr_atomic_t *)mem, old + val, old) != old);
+
+	return old;
+#else
+	return apr_atomic_add32((apr_uint32_t *)mem, val);
+#endif
+}
+
 SWITCH_DECLARE(void) switch_atomic_inc(volatile switch_atomic_t *mem)
 {
 #ifdef apr_atomic_t
@@ -1306,6 +1359,15 @@ SWITCH_DECLARE(int) switch_atomic_dec(volatile switch_atomic_t *mem)
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp)
+{
+#ifdef apr_atomic_t
+	return apr_atomic_cas((apr_atomic_t *)mem, with, cmp);
+#else
+	return apr_atomic_cas32((apr_uint32_t *)mem, with, cmp);
+#endif
+}
+
 SWITCH_DECLARE(char *) switch_strerror(switch_status_t statcode, char *buf, switch_size_t bufsize)
 {
        return apr_strerror(statcode, buf, bufsize);
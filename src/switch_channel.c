@@ -1044,6 +1044,22 @@ SWITCH_DECLARE(switch_status_t) switch_channel_set_private(switch_channel_t *cha
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_DECLARE(void *) switch_channel_set_private_if_absent(switch_channel_t *channel, const char *key, const void *private_info)
+{
+	void *val;
+
+	switch_assert(channel != NULL);
+
+	switch_mutex_lock(channel->profile_mutex);
+	if (!(val = switch_core_hash_find(channel->private_hash, key))) {
+		switch_core_hash_insert(channel->private_hash, key, private_info);
+		val = (void *) private_info;
+	}
+	switch_mutex_unlock(channel->profile_mutex);
+
+	return val;
+}
+
 SWITCH_DECLARE(void *) switch_channel_get_private(switch_channel_t *channel, const char *key)
 {
 	void *val;
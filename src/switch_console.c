@@ -651,40 +651,29 @@ SWITCH_DECLARE_NONSTD(switch_status_t) switch_console_list_interfaces(const char
 }
 #endif
 
+struct uuid_helper {
+	switch_console_callback_match_t *my_matches;
+	const char *cursor;
+};
+
 static int uuid_callback(void *pArg, int argc, char **argv, char **columnNames)
 {
-	struct match_helper *h = (struct match_helper *) pArg;
+	struct uuid_helper *h = (struct uuid_helper *) pArg;
 
-	switch_console_push_match(&h->my_matches, argv[0]);
+	if (zstr(h->cursor) || !strncasecmp(argv[0], h->cursor, strlen(h->cursor))) {
+		switch_console_push_match(&h->my_matches, argv[0]);
+	}
 	return 0;
 
 }
 
 SWITCH_DECLARE_NONSTD(switch_status_t) switch_console_list_uuid(const char *line, const char *cursor, switch_console_callback_match_t **matches)
 {
-	char *sql;
-	struct match_helper h = { 0 };
-	switch_cache_db_handle_t *db = NULL;
+	struct uuid_helper h = { 0 };
 	switch_status_t status = SWITCH_STATUS_FALSE;
-	char *errmsg;
-
-
-	if (switch_core_db_handle(&db) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Database Error\n");
-		return SWITCH_STATUS_GENERR;
-	}
 
-	if (!zstr(cursor)) {
-		sql = switch_mprintf("select distinct uuid from channels where uuid like '%q%%' and hostname='%q' order by uuid",
-							 cursor, switch_core_get_switchname());
-	} else {
-		sql = switch_mprintf("select distinct uuid from channels where hostname='%q' order by uuid", switch_core_get_switchname());
-	}
-
-	switch_cache_db_execute_sql_callback(db, sql, uuid_callback, &h, &errmsg);
-	free(sql);
-
-	switch_cache_db_release_db_handle(&db);
+	h.cursor = cursor;
+	switch_core_channel_index_walk(SCI_VIEW_CHANNELS, NULL, SWITCH_FALSE, uuid_callback, &h);
 
 	if (h.my_matches) {
 		*matches = h.my_matches;
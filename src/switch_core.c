@@ -1870,6 +1870,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 #endif
 	switch_console_init(runtime.memory_pool);
 	switch_event_init(runtime.memory_pool);
+	switch_regex_init(runtime.memory_pool);
 	switch_channel_global_init(runtime.memory_pool);
 
 	if (switch_xml_init(runtime.memory_pool, err) != SWITCH_STATUS_SUCCESS) {
@@ -2068,6 +2069,12 @@ static void switch_load_core_config(const char *file)
 					} else {
 						switch_clear_flag((&runtime), SCF_SESSION_THREAD_POOL);
 					}
+				} else if (!strcasecmp(var, "core-db-channels")) {
+					if (switch_true(val)) {
+						switch_set_flag((&runtime), SCF_CORE_DB_CHANNELS);
+					} else {
+						switch_clear_flag((&runtime), SCF_CORE_DB_CHANNELS);
+					}
 				} else if (!strcasecmp(var, "auto-clear-sql")) {
 					if (switch_true(val)) {
 						switch_set_flag((&runtime), SCF_CLEAR_SQL);
@@ -2171,6 +2178,16 @@ static void switch_load_core_config(const char *file)
 					runtime.cpu_idle_smoothing_depth = atoi(val);
 				} else if (!strcasecmp(var, "events-use-dispatch") && !zstr(val)) {
 					runtime.events_use_dispatch = switch_true(val);
+				} else if (!strcasecmp(var, "event-header-index-threshold") && !zstr(val)) {
+					int tmp = atoi(val);
+					if (tmp >= 0) {
+						switch_event_set_header_index_threshold((uint32_t) tmp);
+					}
+				} else if (!strcasecmp(var, "regex-cache-size") && !zstr(val)) {
+					int tmp = atoi(val);
+					if (tmp >= 0) {
+						switch_regex_cache_set_size((uint32_t) tmp);
+					}
 				} else if (!strcasecmp(var, "initial-event-threads") && !zstr(val)) {
 					int tmp;
 
@@ -2195,6 +2212,13 @@ static void switch_load_core_config(const char *file)
 
 					switch_event_launch_dispatch_threads(tmp);
 
+				} else if (!strcasecmp(var, "event-dispatch-shards") && !zstr(val)) {
+					int tmp = !strcasecmp(val, "auto") ? (int) runtime.cpu_count : atoi(val);
+
+					if (tmp > 0) {
+						switch_event_launch_dispatch_shards((uint32_t) tmp);
+					}
+
 				} else if (!strcasecmp(var, "1ms-timer") && switch_true(val)) {
 					runtime.microseconds_per_tick = 1000;
 				} else if (!strcasecmp(var, "timer-affinity") && !zstr(val)) {
@@ -2207,6 +2231,24 @@ static void switch_load_core_config(const char *file)
 					switch_rtp_set_start_port((switch_port_t) atoi(val));
 				} else if (!strcasecmp(var, "rtp-end-port") && !zstr(val)) {
 					switch_rtp_set_end_port((switch_port_t) atoi(val));
+				} else if (!strcasecmp(var, "rtp-reactor-threads") && !zstr(val)) {
+					uint32_t threads = (uint32_t) atoi(val);
+
+					if (!strcasecmp(val, "auto") && !(threads = switch_core_cpu_count())) {
+#ifndef WIN32
+						threads = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+#else
+						threads = 1;
+#endif
+					}
+
+					switch_rtp_set_reactor_threads(threads);
+				} else if (!strcasecmp(var, "rtp-shared-port") && !zstr(val)) {
+					switch_rtp_set_shared_port((switch_port_t) atoi(val));
+				} else if (!strcasecmp(var, "rtp-send-batch") && !zstr(val)) {
+					switch_rtp_set_send_batch((uint32_t) atoi(val));
+				} else if (!strcasecmp(var, "rtp-send-batch-mtu") && !zstr(val)) {
+					switch_rtp_set_send_batch_mtu((uint32_t) atoi(val));
 				} else if (!strcasecmp(var, "rtp-port-usage-robustness") && switch_true(val)) {
 					runtime.port_alloc_flags |= SPF_ROBUST_UDP;
 				} else if (!strcasecmp(var, "core-db-name") && !zstr(val)) {
@@ -2818,6 +2860,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 		switch_nat_shutdown();
 	}
 	switch_xml_destroy();
+	switch_regex_shutdown();
 	switch_console_shutdown();
 	switch_channel_global_uninit();
 
@@ -9913,6 +9913,74 @@ SWITCH_DECLARE(void) switch_core_session_stop_media(switch_core_session_t *sessi
 
 
 
+/* hand the media of two proxy media sessions to the rtp reactors so neither session thread has to move it */
+SWITCH_DECLARE(switch_status_t) switch_core_media_relay_start(switch_core_session_t *session, switch_core_session_t *peer_session)
+{
+	switch_media_handle_t *smh, *peer_smh;
+	switch_rtp_relay_flag_t flags = SWITCH_RTP_RELAY_REWRITE_SSRC | SWITCH_RTP_RELAY_REWRITE_SEQ;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+	const char *var;
+	int type;
+
+	switch_assert(session && peer_session);
+
+	if (!(smh = session->media_handle) || !(peer_smh = peer_session->media_handle)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!switch_channel_test_flag(session->channel, CF_PROXY_MEDIA) || !switch_channel_test_flag(peer_session->channel, CF_PROXY_MEDIA)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if ((var = switch_channel_get_variable(session->channel, "rtp_relay_rewrite"))) {
+		flags = 0;
+
+		if (switch_stristr("ssrc", var)) {
+			flags |= SWITCH_RTP_RELAY_REWRITE_SSRC;
+		}
+
+		if (switch_stristr("seq", var)) {
+			flags |= SWITCH_RTP_RELAY_REWRITE_SEQ;
+		}
+	}
+
+	for (type = 0; type < SWITCH_MEDIA_TYPE_TOTAL; type++) {
+		switch_rtp_t *rtp_session = smh->engines[type].rtp_session, *peer_rtp_session = peer_smh->engines[type].rtp_session;
+
+		if (!rtp_session || !peer_rtp_session) {
+			continue;
+		}
+
+		if (switch_rtp_relay_start(rtp_session, peer_rtp_session, flags) == SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Relaying %s to %s\n",
+							  type2str(type), switch_channel_get_name(peer_session->channel));
+			if (type == SWITCH_MEDIA_TYPE_AUDIO) {
+				status = SWITCH_STATUS_SUCCESS;
+			}
+		}
+	}
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_core_media_relay_stop(switch_core_session_t *session)
+{
+	switch_media_handle_t *smh;
+	int type;
+
+	switch_assert(session);
+
+	if (!(smh = session->media_handle)) {
+		return;
+	}
+
+	for (type = 0; type < SWITCH_MEDIA_TYPE_TOTAL; type++) {
+		if (smh->engines[type].rtp_session) {
+			switch_rtp_relay_stop(smh->engines[type].rtp_session);
+		}
+	}
+}
+
 //?
 SWITCH_DECLARE(void) switch_core_media_check_outgoing_proxy(switch_core_session_t *session, switch_core_session_t *o_session)
 {
@@ -999,7 +999,7 @@ SWITCH_DECLARE(uint32_t) switch_core_media_bug_count(switch_core_session_t *orig
 	if (orig_session->bugs) {
 		switch_thread_rwlock_rdlock(orig_session->bug_rwlock);
 		for (bp = orig_session->bugs; bp; bp = bp->next) {
-			if (!switch_test_flag(bp, SMBF_PRUNE) && !switch_test_flag(bp, SMBF_LOCK) && !strcmp(bp->function, function)) {
+			if (!switch_test_flag(bp, SMBF_PRUNE) && !switch_test_flag(bp, SMBF_LOCK) && (!function || !strcmp(bp->function, function))) {
 				x++;
 			}
 		}
@@ -1055,7 +1055,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_exec_all(switch_core_sessi
 	if (orig_session->bugs) {
 		switch_thread_rwlock_wrlock(orig_session->bug_rwlock);
 		for (bp = orig_session->bugs; bp; bp = bp->next) {
-			if (!switch_test_flag(bp, SMBF_PRUNE) && !switch_test_flag(bp, SMBF_LOCK) && !strcmp(bp->function, function)) {
+			if (!switch_test_flag(bp, SMBF_PRUNE) && !switch_test_flag(bp, SMBF_LOCK) && (!function || !strcmp(bp->function, function))) {
 				cb(bp, user_data);
 				x++;
 			}
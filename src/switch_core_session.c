@@ -118,13 +118,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_codec_slin(switch_core_s
 }
 
 
+static inline struct switch_session_shard *session_shard(const char *uuid_str)
+{
+	switch_ssize_t hlen = -1;
+
+	return &session_manager.shards[switch_hashfunc_default(uuid_str, &hlen) & (SWITCH_SESSION_TABLE_SHARDS - 1)];
+}
+
 SWITCH_DECLARE(switch_core_session_t *) switch_core_session_perform_locate(const char *uuid_str, const char *file, const char *func, int line)
 {
 	switch_core_session_t *session = NULL;
 
 	if (uuid_str) {
-		switch_mutex_lock(runtime.session_hash_mutex);
-		if ((session = switch_core_hash_find(session_manager.session_table, uuid_str))) {
+		struct switch_session_shard *shard = session_shard(uuid_str);
+
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		if ((session = switch_core_hash_find(shard->session_table, uuid_str))) {
 			/* Acquire a read lock on the session */
 #ifdef SWITCH_DEBUG_RWLOCKS
 			if (switch_core_session_perform_read_lock(session, file, func, line) != SWITCH_STATUS_SUCCESS) {
@@ -138,7 +147,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_perform_locate(const
 				session = NULL;
 			}
 		}
-		switch_mutex_unlock(runtime.session_hash_mutex);
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 
 	/* if its not NULL, now it's up to you to rwunlock this */
@@ -155,8 +164,10 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_perform_force_locate
 	switch_status_t status;
 
 	if (uuid_str) {
-		switch_mutex_lock(runtime.session_hash_mutex);
-		if ((session = switch_core_hash_find(session_manager.session_table, uuid_str))) {
+		struct switch_session_shard *shard = session_shard(uuid_str);
+
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		if ((session = switch_core_hash_find(shard->session_table, uuid_str))) {
 			/* Acquire a read lock on the session */
 
 			if (switch_test_flag(session, SSF_DESTROYED)) {
@@ -178,7 +189,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_perform_force_locate
 				session = NULL;
 			}
 		}
-		switch_mutex_unlock(runtime.session_hash_mutex);
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 
 	/* if its not NULL, now it's up to you to rwunlock this */
@@ -207,44 +218,60 @@ struct str_node {
 	struct str_node *next;
 };
 
-SWITCH_DECLARE(uint32_t) switch_core_session_hupall_matching_var_ans(const char *var_name, const char *var_val, switch_call_cause_t cause, 
-																	 switch_hup_type_t type)
+/* Copies the uuid of every session that can be read locked, taking one shard lock at a time.
+   Callers locate each uuid again before acting on it, so no table lock is held while they work. */
+static struct str_node *session_table_snapshot(switch_memory_pool_t *pool)
 {
 	switch_hash_index_t *hi;
 	void *val;
 	switch_core_session_t *session;
-	switch_memory_pool_t *pool;
 	struct str_node *head = NULL, *np;
-	uint32_t r = 0;
-
-	switch_core_new_memory_pool(&pool);
+	int i;
 
-	if (!var_val)
-		return r;
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		struct switch_session_shard *shard = &session_manager.shards[i];
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_core_hash_first(session_manager.session_table); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				int ans = switch_channel_test_flag(switch_core_session_get_channel(session), CF_ANSWERED);
-				if ((ans && (type & SHT_ANSWERED)) || (!ans && (type & SHT_UNANSWERED))) {
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		for (hi = switch_core_hash_first(shard->session_table); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			if (val) {
+				session = (switch_core_session_t *) val;
+				if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
 					np = switch_core_alloc(pool, sizeof(*np));
 					np->str = switch_core_strdup(pool, session->uuid_str);
 					np->next = head;
 					head = np;
+					switch_core_session_rwunlock(session);
 				}
-				switch_core_session_rwunlock(session);
 			}
 		}
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+
+	return head;
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_session_hupall_matching_var_ans(const char *var_name, const char *var_val, switch_call_cause_t cause, 
+																	 switch_hup_type_t type)
+{
+	switch_core_session_t *session;
+	switch_memory_pool_t *pool;
+	struct str_node *head = NULL, *np;
+	uint32_t r = 0;
+
+	if (!var_val)
+		return r;
+
+	switch_core_new_memory_pool(&pool);
+
+	head = session_table_snapshot(pool);
 
 	for(np = head; np; np = np->next) {
 		if ((session = switch_core_session_locate(np->str))) {
 			const char *this_val;
-			if (switch_channel_up_nosig(session->channel) &&
+			int ans = switch_channel_test_flag(session->channel, CF_ANSWERED);
+
+			if (((ans && (type & SHT_ANSWERED)) || (!ans && (type & SHT_UNANSWERED))) && switch_channel_up_nosig(session->channel) &&
 				(this_val = switch_channel_get_variable(session->channel, var_name)) && (!strcmp(this_val, var_val))) {			
 				switch_channel_hangup(session->channel, cause);
 				r++;
@@ -261,8 +288,6 @@ SWITCH_DECLARE(uint32_t) switch_core_session_hupall_matching_var_ans(const char
 
 SWITCH_DECLARE(switch_console_callback_match_t *) switch_core_session_findall_matching_var(const char *var_name, const char *var_val)
 {
-	switch_hash_index_t *hi;
-	void *val;
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
 	struct str_node *head = NULL, *np;
@@ -275,21 +300,7 @@ SWITCH_DECLARE(switch_console_callback_match_t *) switch_core_session_findall_ma
 
 	switch_core_new_memory_pool(&pool);
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_core_hash_first(session_manager.session_table); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				np = switch_core_alloc(pool, sizeof(*np));
-				np->str = switch_core_strdup(pool, session->uuid_str);
-				np->next = head;
-				head = np;
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	head = session_table_snapshot(pool);
 
 	for(np = head; np; np = np->next) {
 		if ((session = switch_core_session_locate(np->str))) {
@@ -311,35 +322,19 @@ SWITCH_DECLARE(switch_console_callback_match_t *) switch_core_session_findall_ma
 
 SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_interface_t *endpoint_interface, switch_call_cause_t cause)
 {
-	switch_hash_index_t *hi;
-	void *val;
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
-    struct str_node *head = NULL, *np;
-	
+	struct str_node *head = NULL, *np;
+
 	switch_core_new_memory_pool(&pool);
-	
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_core_hash_first(session_manager.session_table); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				if (session->endpoint_interface == endpoint_interface) {
-					np = switch_core_alloc(pool, sizeof(*np));
-                    np->str = switch_core_strdup(pool, session->uuid_str);
-                    np->next = head;
-					head = np;
-				}
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+
+	head = session_table_snapshot(pool);
 
 	for(np = head; np; np = np->next) {
 		if ((session = switch_core_session_locate(np->str))) {
-			switch_channel_hangup(session->channel, cause);
+			if (session->endpoint_interface == endpoint_interface) {
+				switch_channel_hangup(session->channel, cause);
+			}
 			switch_core_session_rwunlock(session);
 		}
 	}
@@ -350,30 +345,13 @@ SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_i
 
 SWITCH_DECLARE(void) switch_core_session_hupall(switch_call_cause_t cause)
 {
-	switch_hash_index_t *hi;
-	void *val;
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
 	struct str_node *head = NULL, *np;
 
 	switch_core_new_memory_pool(&pool);
 
-
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_core_hash_first(session_manager.session_table); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				np = switch_core_alloc(pool, sizeof(*np));
-				np->str = switch_core_strdup(pool, session->uuid_str);
-				np->next = head;
-				head = np;
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	head = session_table_snapshot(pool);
 
 	for(np = head; np; np = np->next) { 
 		if ((session = switch_core_session_locate(np->str))) {
@@ -389,23 +367,19 @@ SWITCH_DECLARE(void) switch_core_session_hupall(switch_call_cause_t cause)
 
 SWITCH_DECLARE(switch_console_callback_match_t *) switch_core_session_findall(void)
 {
-	switch_hash_index_t *hi;
-	void *val;
-	switch_core_session_t *session;
+	switch_memory_pool_t *pool;
+	struct str_node *head = NULL, *np;
 	switch_console_callback_match_t *my_matches = NULL;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_core_hash_first(session_manager.session_table); hi; hi = switch_core_hash_next(&hi)) {
-		switch_core_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				switch_console_push_match(&my_matches, session->uuid_str);
-				switch_core_session_rwunlock(session);
-			}
-		}
+	switch_core_new_memory_pool(&pool);
+
+	head = session_table_snapshot(pool);
+
+	for(np = head; np; np = np->next) {
+		switch_console_push_match(&my_matches, np->str);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+
+	switch_core_destroy_memory_pool(&pool);
 
 	return my_matches;
 }
@@ -415,17 +389,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_message_send(const char *uui
 	switch_core_session_t *session = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	if ((session = switch_core_hash_find(session_manager.session_table, uuid_str)) != 0) {
-		/* Acquire a read lock on the session or forget it the channel is dead */
-		if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-			if (switch_channel_up_nosig(session->channel)) {
-				status = switch_core_session_receive_message(session, message);
-			}
-			switch_core_session_rwunlock(session);
+	/* Acquire a read lock on the session or forget it the channel is dead */
+	if ((session = switch_core_session_locate(uuid_str))) {
+		if (switch_channel_up_nosig(session->channel)) {
+			status = switch_core_session_receive_message(session, message);
 		}
+		switch_core_session_rwunlock(session);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
 	return status;
 }
@@ -435,17 +405,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_event_send(const char *uuid_
 	switch_core_session_t *session = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	if ((session = switch_core_hash_find(session_manager.session_table, uuid_str)) != 0) {
-		/* Acquire a read lock on the session or forget it the channel is dead */
-		if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-			if (switch_channel_up_nosig(session->channel)) {
-				status = switch_core_session_queue_event(session, event);
-			}
-			switch_core_session_rwunlock(session);
+	/* Acquire a read lock on the session or forget it the channel is dead */
+	if ((session = switch_core_session_locate(uuid_str))) {
+		if (switch_channel_up_nosig(session->channel)) {
+			status = switch_core_session_queue_event(session, event);
 		}
+		switch_core_session_rwunlock(session);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
 	return status;
 }
@@ -1454,6 +1420,7 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 	switch_memory_pool_t *pool;
 	switch_event_t *event;
 	switch_endpoint_interface_t *endpoint_interface = (*session)->endpoint_interface;
+	struct switch_session_shard *shard;
 	int i;
 
 
@@ -1475,8 +1442,12 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 
 	switch_scheduler_del_task_group((*session)->uuid_str);
 
+	shard = session_shard((*session)->uuid_str);
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	switch_core_hash_delete(shard->session_table, (*session)->uuid_str);
+	switch_thread_rwlock_unlock(shard->rwlock);
+
 	switch_mutex_lock(runtime.session_hash_mutex);
-	switch_core_hash_delete(session_manager.session_table, (*session)->uuid_str);
 	if (session_manager.session_count) {
 		session_manager.session_count--;
 		if (session_manager.session_count == 0) {
@@ -1899,6 +1870,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 	switch_event_t *event;
 	switch_core_session_message_t msg = { 0 };
 	switch_caller_profile_t *profile;
+	struct switch_session_shard *old_shard, *new_shard;
 
 	switch_assert(use_uuid);
 
@@ -1906,11 +1878,26 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 		return SWITCH_STATUS_SUCCESS;
 	}
 
+	old_shard = session_shard(session->uuid_str);
+	new_shard = session_shard(use_uuid);
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	if (switch_core_hash_find(session_manager.session_table, use_uuid)) {
+	/* always take the two shard locks in table order */
+	if (old_shard < new_shard) {
+		switch_thread_rwlock_wrlock(old_shard->rwlock);
+		switch_thread_rwlock_wrlock(new_shard->rwlock);
+	} else {
+		switch_thread_rwlock_wrlock(new_shard->rwlock);
+		if (old_shard != new_shard) {
+			switch_thread_rwlock_wrlock(old_shard->rwlock);
+		}
+	}
+
+	if (switch_core_hash_find(new_shard->session_table, use_uuid)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_CRIT, "Duplicate UUID!\n");
-		switch_mutex_unlock(runtime.session_hash_mutex);
+		switch_thread_rwlock_unlock(new_shard->rwlock);
+		if (old_shard != new_shard) {
+			switch_thread_rwlock_unlock(old_shard->rwlock);
+		}
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -1929,10 +1916,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 
 	switch_event_create(&event, SWITCH_EVENT_CHANNEL_UUID);
 	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Old-Unique-ID", session->uuid_str);
-	switch_core_hash_delete(session_manager.session_table, session->uuid_str);
+	switch_core_hash_delete(old_shard->session_table, session->uuid_str);
 	switch_set_string(session->uuid_str, use_uuid);
-	switch_core_hash_insert(session_manager.session_table, session->uuid_str, session);
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	switch_core_hash_insert(new_shard->session_table, session->uuid_str, session);
+	switch_thread_rwlock_unlock(new_shard->rwlock);
+	if (old_shard != new_shard) {
+		switch_thread_rwlock_unlock(old_shard->rwlock);
+	}
 	switch_channel_event_set_data(session->channel, event);
 	switch_event_fire(&event);
 
@@ -2223,14 +2213,24 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_uuid(switch_
 {
 	switch_memory_pool_t *usepool;
 	switch_core_session_t *session;
+	struct switch_session_shard *shard;
 	switch_uuid_t uuid;
 	uint32_t count = 0;
 	int32_t sps = 0;
 
 
-	if (use_uuid && switch_core_hash_find(session_manager.session_table, use_uuid)) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Duplicate UUID!\n");
-		return NULL;
+	if (use_uuid) {
+		void *dup;
+
+		shard = session_shard(use_uuid);
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		dup = switch_core_hash_find(shard->session_table, use_uuid);
+		switch_thread_rwlock_unlock(shard->rwlock);
+
+		if (dup) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Duplicate UUID!\n");
+			return NULL;
+		}
 	}
 
 	if (direction == SWITCH_CALL_DIRECTION_INBOUND && !switch_core_ready_inbound()) {
@@ -2338,8 +2338,12 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_uuid(switch_
 	switch_queue_create(&session->private_event_queue, SWITCH_EVENT_QUEUE_LEN, session->pool);
 	switch_queue_create(&session->private_event_queue_pri, SWITCH_EVENT_QUEUE_LEN, session->pool);
 
+	shard = session_shard(session->uuid_str);
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	switch_core_hash_insert(shard->session_table, session->uuid_str, session);
+	switch_thread_rwlock_unlock(shard->rwlock);
+
 	switch_mutex_lock(runtime.session_hash_mutex);
-	switch_core_hash_insert(session_manager.session_table, session->uuid_str, session);
 	session->id = session_manager.session_id++;
 	session_manager.session_count++;
 
@@ -2461,11 +2465,16 @@ SWITCH_DECLARE(uint32_t) switch_core_sessions_per_second(uint32_t new_limit)
 
 void switch_core_session_init(switch_memory_pool_t *pool)
 {
+	int i;
+
 	memset(&session_manager, 0, sizeof(session_manager));
 	session_manager.session_limit = 1000;
 	session_manager.session_id = 1;
 	session_manager.memory_pool = pool;
-	switch_core_hash_init(&session_manager.session_table);
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		switch_core_hash_init(&session_manager.shards[i].session_table);
+		switch_thread_rwlock_create(&session_manager.shards[i].rwlock, session_manager.memory_pool);
+	}
 	switch_mutex_init(&session_manager.mutex, SWITCH_MUTEX_DEFAULT, session_manager.memory_pool);
 	switch_thread_cond_create(&session_manager.cond, session_manager.memory_pool);
 	switch_queue_create(&session_manager.thread_queue, 100000, session_manager.memory_pool);
@@ -2473,12 +2482,16 @@ void switch_core_session_init(switch_memory_pool_t *pool)
 
 void switch_core_session_uninit(void)
 {
+	int i;
+
 	switch_queue_term(session_manager.thread_queue);
 	switch_mutex_lock(session_manager.mutex);
 	if (session_manager.running)
 		switch_thread_cond_timedwait(session_manager.cond, session_manager.mutex, 10000000);
 	switch_mutex_unlock(session_manager.mutex);
-	switch_core_hash_destroy(&session_manager.session_table);
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		switch_core_hash_destroy(&session_manager.shards[i].session_table);
+	}
 }
 
 SWITCH_DECLARE(switch_app_log_t *) switch_core_session_get_app_log(switch_core_session_t *session)
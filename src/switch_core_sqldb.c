@@ -2200,6 +2200,704 @@ static char *parse_presence_data_cols(switch_event_t *event)
 }
 
 
+typedef enum {
+	CI_UUID,
+	CI_DIRECTION,
+	CI_CREATED,
+	CI_CREATED_EPOCH,
+	CI_NAME,
+	CI_STATE,
+	CI_CID_NAME,
+	CI_CID_NUM,
+	CI_IP_ADDR,
+	CI_DEST,
+	CI_APPLICATION,
+	CI_APPLICATION_DATA,
+	CI_DIALPLAN,
+	CI_CONTEXT,
+	CI_READ_CODEC,
+	CI_READ_RATE,
+	CI_READ_BIT_RATE,
+	CI_WRITE_CODEC,
+	CI_WRITE_RATE,
+	CI_WRITE_BIT_RATE,
+	CI_SECURE,
+	CI_HOSTNAME,
+	CI_PRESENCE_ID,
+	CI_PRESENCE_DATA,
+	CI_CALLSTATE,
+	CI_CALLEE_NAME,
+	CI_CALLEE_NUM,
+	CI_CALLEE_DIRECTION,
+	CI_CALL_UUID,
+	CI_SENT_CALLEE_NAME,
+	CI_SENT_CALLEE_NUM,
+	CI_INITIAL_CID_NAME,
+	CI_INITIAL_CID_NUM,
+	CI_INITIAL_IP_ADDR,
+	CI_INITIAL_DEST,
+	CI_INITIAL_DIALPLAN,
+	CI_INITIAL_CONTEXT,
+	CI_COLUMNS
+} channel_index_col_t;
+
+/* Same names and order as the channels table */
+static const char *channel_index_names[CI_COLUMNS] = {
+	"uuid", "direction", "created", "created_epoch", "name", "state", "cid_name", "cid_num", "ip_addr", "dest",
+	"application", "application_data", "dialplan", "context", "read_codec", "read_rate", "read_bit_rate",
+	"write_codec", "write_rate", "write_bit_rate", "secure", "hostname", "presence_id", "presence_data",
+	"callstate", "callee_name", "callee_num", "callee_direction", "call_uuid", "sent_callee_name", "sent_callee_num",
+	"initial_cid_name", "initial_cid_num", "initial_ip_addr", "initial_dest", "initial_dialplan", "initial_context"
+};
+
+static const char *channel_index_b_names[CI_SENT_CALLEE_NUM + 1] = {
+	"b_uuid", "b_direction", "b_created", "b_created_epoch", "b_name", "b_state", "b_cid_name", "b_cid_num", "b_ip_addr", "b_dest",
+	"b_application", "b_application_data", "b_dialplan", "b_context", "b_read_codec", "b_read_rate", "b_read_bit_rate",
+	"b_write_codec", "b_write_rate", "b_write_bit_rate", "b_secure", "b_hostname", "b_presence_id", "b_presence_data",
+	"b_callstate", "b_callee_name", "b_callee_num", "b_callee_direction", "b_call_uuid", "b_sent_callee_name", "b_sent_callee_num"
+};
+
+/* The a and b leg columns of the basic_calls view, detailed_calls takes uuid through sent_callee_num from both legs */
+static const channel_index_col_t basic_calls_a_cols[] = {
+	CI_UUID, CI_DIRECTION, CI_CREATED, CI_CREATED_EPOCH, CI_NAME, CI_STATE, CI_CID_NAME, CI_CID_NUM, CI_IP_ADDR, CI_DEST,
+	CI_PRESENCE_ID, CI_PRESENCE_DATA, CI_CALLSTATE, CI_CALLEE_NAME, CI_CALLEE_NUM, CI_CALLEE_DIRECTION, CI_CALL_UUID, CI_HOSTNAME,
+	CI_SENT_CALLEE_NAME, CI_SENT_CALLEE_NUM
+};
+
+static const channel_index_col_t basic_calls_b_cols[] = {
+	CI_UUID, CI_DIRECTION, CI_CREATED, CI_CREATED_EPOCH, CI_NAME, CI_STATE, CI_CID_NAME, CI_CID_NUM, CI_IP_ADDR, CI_DEST,
+	CI_PRESENCE_ID, CI_PRESENCE_DATA, CI_CALLSTATE, CI_CALLEE_NAME, CI_CALLEE_NUM, CI_CALLEE_DIRECTION,
+	CI_SENT_CALLEE_NAME, CI_SENT_CALLEE_NUM
+};
+
+#define CI_MAX_ROW_COLUMNS (CI_COLUMNS * 2 + 1)
+
+typedef struct channel_index_entry_s {
+	char *col[CI_COLUMNS];
+	/* the calls row: callee_uuid is set on the caller, caller_uuid on the callee */
+	char *callee_uuid;
+	char *caller_uuid;
+	char *call_created_epoch;
+	struct channel_index_entry_s *prev;
+	struct channel_index_entry_s *next;
+} channel_index_entry_t;
+
+typedef struct channel_index_row_s {
+	int argc;
+	char **argv;
+	struct channel_index_row_s *next;
+} channel_index_row_t;
+
+/* The channels and calls tables kept in memory, entries are linked in creation order */
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	channel_index_entry_t *head;
+	channel_index_entry_t *tail;
+	uint32_t count;
+	uint32_t callees;
+} channel_index;
+
+static void ci_set(channel_index_entry_t *entry, channel_index_col_t col, const char *val)
+{
+	if (entry->col[col] && val && !strcmp(entry->col[col], val)) {
+		return;
+	}
+
+	switch_safe_free(entry->col[col]);
+
+	if (val) {
+		entry->col[col] = strdup(val);
+	}
+}
+
+static void ci_set_header(channel_index_entry_t *entry, channel_index_col_t col, switch_event_t *event, const char *header)
+{
+	ci_set(entry, col, switch_event_get_header_nil(event, header));
+}
+
+static void channel_index_clear_call(channel_index_entry_t *entry)
+{
+	channel_index_entry_t *peer;
+
+	if (entry->callee_uuid) {
+		if ((peer = switch_core_hash_find(channel_index.hash, entry->callee_uuid)) && peer->caller_uuid && !strcmp(peer->caller_uuid, entry->col[CI_UUID])) {
+			switch_safe_free(peer->caller_uuid);
+			channel_index.callees--;
+		}
+		switch_safe_free(entry->callee_uuid);
+		switch_safe_free(entry->call_created_epoch);
+	}
+
+	if (entry->caller_uuid) {
+		if ((peer = switch_core_hash_find(channel_index.hash, entry->caller_uuid)) && peer->callee_uuid && !strcmp(peer->callee_uuid, entry->col[CI_UUID])) {
+			switch_safe_free(peer->callee_uuid);
+			switch_safe_free(peer->call_created_epoch);
+		}
+		switch_safe_free(entry->caller_uuid);
+		channel_index.callees--;
+	}
+}
+
+static void channel_index_free(channel_index_entry_t *entry)
+{
+	int i;
+
+	for (i = 0; i < CI_COLUMNS; i++) {
+		switch_safe_free(entry->col[i]);
+	}
+
+	switch_safe_free(entry->callee_uuid);
+	switch_safe_free(entry->caller_uuid);
+	switch_safe_free(entry->call_created_epoch);
+	free(entry);
+}
+
+static void channel_index_remove(channel_index_entry_t *entry)
+{
+	channel_index_clear_call(entry);
+	switch_core_hash_delete(channel_index.hash, entry->col[CI_UUID]);
+
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		channel_index.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		channel_index.tail = entry->prev;
+	}
+
+	channel_index.count--;
+	channel_index_free(entry);
+}
+
+static void channel_index_rename(channel_index_entry_t *entry, const char *uuid)
+{
+	channel_index_entry_t *np, *peer;
+	char *old_uuid = entry->col[CI_UUID];
+
+	switch_core_hash_delete(channel_index.hash, old_uuid);
+	entry->col[CI_UUID] = strdup(uuid);
+	switch_core_hash_insert(channel_index.hash, uuid, entry);
+
+	if (entry->callee_uuid && (peer = switch_core_hash_find(channel_index.hash, entry->callee_uuid)) && peer->caller_uuid) {
+		switch_safe_free(peer->caller_uuid);
+		peer->caller_uuid = strdup(uuid);
+	}
+
+	if (entry->caller_uuid && (peer = switch_core_hash_find(channel_index.hash, entry->caller_uuid)) && peer->callee_uuid) {
+		switch_safe_free(peer->callee_uuid);
+		peer->callee_uuid = strdup(uuid);
+	}
+
+	for (np = channel_index.head; np; np = np->next) {
+		if (np->col[CI_CALL_UUID] && !strcmp(np->col[CI_CALL_UUID], old_uuid)) {
+			ci_set(np, CI_CALL_UUID, uuid);
+		}
+	}
+
+	free(old_uuid);
+}
+
+static void channel_index_reset_call_uuid(channel_index_entry_t *entry, const char *call_uuid)
+{
+	if (entry && entry->col[CI_CALL_UUID] && !strcmp(entry->col[CI_CALL_UUID], call_uuid)) {
+		ci_set(entry, CI_CALL_UUID, entry->col[CI_UUID]);
+	}
+}
+
+/* Applies a channel event to the index the way core_event_handler applies it to the channels and calls tables.
+   Returns SWITCH_FALSE when the event belongs to a channel that is already gone. */
+static switch_bool_t channel_index_event(switch_event_t *event)
+{
+	channel_index_entry_t *entry = NULL;
+	const char *uuid = switch_event_get_header(event, "unique-id");
+	switch_bool_t exists = SWITCH_TRUE;
+
+	if (event->event_id == SWITCH_EVENT_CALL_SECURE) {
+		uuid = switch_event_get_header(event, "caller-unique-id");
+	} else if (event->event_id == SWITCH_EVENT_CHANNEL_UUID) {
+		uuid = switch_event_get_header(event, "old-unique-id");
+	}
+
+	if (zstr(uuid) || !channel_index.hash) {
+		return SWITCH_TRUE;
+	}
+
+	switch_mutex_lock(channel_index.mutex);
+
+	entry = switch_core_hash_find(channel_index.hash, uuid);
+
+	if (event->event_id == SWITCH_EVENT_CHANNEL_CREATE) {
+		if (!entry) {
+			char epoch[32];
+
+			/* Unless event dispatch is sharded by uuid the create can be handled after the destroy, and the
+			   session leaves the session table before its destroy fires, so checking here under the index
+			   lock keeps a late create from leaving a stale entry behind. */
+			if (!switch_ivr_uuid_exists(uuid)) {
+				exists = SWITCH_FALSE;
+				goto end;
+			}
+
+			switch_zmalloc(entry, sizeof(*entry));
+			ci_set(entry, CI_UUID, uuid);
+			switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+			ci_set(entry, CI_CREATED_EPOCH, epoch);
+			ci_set(entry, CI_HOSTNAME, switch_core_get_switchname());
+			switch_core_hash_insert(channel_index.hash, uuid, entry);
+
+			if ((entry->prev = channel_index.tail)) {
+				channel_index.tail->next = entry;
+			} else {
+				channel_index.head = entry;
+			}
+			channel_index.tail = entry;
+			channel_index.count++;
+		}
+
+		ci_set_header(entry, CI_DIRECTION, event, "call-direction");
+		ci_set_header(entry, CI_CREATED, event, "event-date-local");
+		ci_set_header(entry, CI_NAME, event, "channel-name");
+		ci_set_header(entry, CI_STATE, event, "channel-state");
+		ci_set_header(entry, CI_CALLSTATE, event, "channel-call-state");
+		ci_set_header(entry, CI_DIALPLAN, event, "caller-dialplan");
+		ci_set_header(entry, CI_CONTEXT, event, "caller-context");
+		ci_set_header(entry, CI_INITIAL_CID_NAME, event, "caller-caller-id-name");
+		ci_set_header(entry, CI_INITIAL_CID_NUM, event, "caller-caller-id-number");
+		ci_set_header(entry, CI_INITIAL_IP_ADDR, event, "caller-network-addr");
+		ci_set_header(entry, CI_INITIAL_DEST, event, "caller-destination-number");
+		ci_set_header(entry, CI_INITIAL_DIALPLAN, event, "caller-dialplan");
+		ci_set_header(entry, CI_INITIAL_CONTEXT, event, "caller-context");
+		goto end;
+	}
+
+	if (!entry) {
+		exists = event->event_id == SWITCH_EVENT_CHANNEL_DESTROY ? SWITCH_TRUE : SWITCH_FALSE;
+		goto end;
+	}
+
+	switch (event->event_id) {
+	case SWITCH_EVENT_CHANNEL_DESTROY:
+		channel_index_remove(entry);
+		break;
+	case SWITCH_EVENT_CHANNEL_UUID:
+		{
+			const char *new_uuid = switch_event_get_header(event, "unique-id");
+
+			if (!zstr(new_uuid) && strcmp(new_uuid, uuid) && !switch_core_hash_find(channel_index.hash, new_uuid)) {
+				channel_index_rename(entry, new_uuid);
+			}
+		}
+		break;
+	case SWITCH_EVENT_CHANNEL_ANSWER:
+	case SWITCH_EVENT_CHANNEL_PROGRESS_MEDIA:
+	case SWITCH_EVENT_CODEC:
+		ci_set_header(entry, CI_READ_CODEC, event, "channel-read-codec-name");
+		ci_set_header(entry, CI_READ_RATE, event, "channel-read-codec-rate");
+		ci_set_header(entry, CI_READ_BIT_RATE, event, "channel-read-codec-bit-rate");
+		ci_set_header(entry, CI_WRITE_CODEC, event, "channel-write-codec-name");
+		ci_set_header(entry, CI_WRITE_RATE, event, "channel-write-codec-rate");
+		ci_set_header(entry, CI_WRITE_BIT_RATE, event, "channel-write-codec-bit-rate");
+		break;
+	case SWITCH_EVENT_CHANNEL_HOLD:
+	case SWITCH_EVENT_CHANNEL_UNHOLD:
+	case SWITCH_EVENT_CHANNEL_EXECUTE:
+		ci_set_header(entry, CI_APPLICATION, event, "application");
+		ci_set_header(entry, CI_APPLICATION_DATA, event, "application-data");
+		ci_set_header(entry, CI_PRESENCE_ID, event, "channel-presence-id");
+		ci_set_header(entry, CI_PRESENCE_DATA, event, "channel-presence-data");
+		break;
+	case SWITCH_EVENT_CHANNEL_ORIGINATE:
+		ci_set_header(entry, CI_PRESENCE_ID, event, "channel-presence-id");
+		ci_set_header(entry, CI_PRESENCE_DATA, event, "channel-presence-data");
+		ci_set_header(entry, CI_CALL_UUID, event, "channel-call-uuid");
+		break;
+	case SWITCH_EVENT_CALL_UPDATE:
+		ci_set_header(entry, CI_CALLEE_NAME, event, "caller-callee-id-name");
+		ci_set_header(entry, CI_CALLEE_NUM, event, "caller-callee-id-number");
+		ci_set_header(entry, CI_SENT_CALLEE_NAME, event, "sent-callee-id-name");
+		ci_set_header(entry, CI_SENT_CALLEE_NUM, event, "sent-callee-id-number");
+		ci_set_header(entry, CI_CALLEE_DIRECTION, event, "direction");
+		ci_set_header(entry, CI_CID_NAME, event, "caller-caller-id-name");
+		ci_set_header(entry, CI_CID_NUM, event, "caller-caller-id-number");
+		break;
+	case SWITCH_EVENT_CHANNEL_CALLSTATE:
+		{
+			const char *num = switch_event_get_header(event, "channel-call-state-number");
+			switch_channel_callstate_t callstate = CCS_DOWN;
+
+			if (num) {
+				callstate = atoi(num);
+			}
+
+			if (callstate != CCS_DOWN && callstate != CCS_HANGUP) {
+				ci_set_header(entry, CI_CALLSTATE, event, "channel-call-state");
+			}
+		}
+		break;
+	case SWITCH_EVENT_CHANNEL_STATE:
+		{
+			const char *state = switch_event_get_header_nil(event, "channel-state-number");
+			switch_channel_state_t state_i = CS_DESTROY;
+
+			if (!zstr(state)) {
+				state_i = atoi(state);
+			}
+
+			switch (state_i) {
+			case CS_NEW:
+			case CS_DESTROY:
+			case CS_REPORTING:
+#ifndef SWITCH_DEPRECATED_CORE_DB
+			case CS_HANGUP: /* marked for deprication */
+#endif
+			case CS_INIT:
+				break;
+			case CS_ROUTING:
+				ci_set_header(entry, CI_CID_NAME, event, "caller-caller-id-name");
+				ci_set_header(entry, CI_CID_NUM, event, "caller-caller-id-number");
+				ci_set_header(entry, CI_CALLEE_NAME, event, "caller-callee-id-name");
+				ci_set_header(entry, CI_CALLEE_NUM, event, "caller-callee-id-number");
+				ci_set_header(entry, CI_SENT_CALLEE_NAME, event, "sent-callee-id-name");
+				ci_set_header(entry, CI_SENT_CALLEE_NUM, event, "sent-callee-id-number");
+				ci_set_header(entry, CI_IP_ADDR, event, "caller-network-addr");
+				ci_set_header(entry, CI_DEST, event, "caller-destination-number");
+				ci_set_header(entry, CI_DIALPLAN, event, "caller-dialplan");
+				ci_set_header(entry, CI_CONTEXT, event, "caller-context");
+				ci_set_header(entry, CI_PRESENCE_ID, event, "channel-presence-id");
+				ci_set_header(entry, CI_PRESENCE_DATA, event, "channel-presence-data");
+				ci_set_header(entry, CI_STATE, event, "channel-state");
+				break;
+			default:
+				ci_set_header(entry, CI_STATE, event, "channel-state");
+				break;
+			}
+		}
+		break;
+	case SWITCH_EVENT_CHANNEL_BRIDGE:
+		{
+			const char *a_uuid, *b_uuid, *call_uuid = switch_event_get_header_nil(event, "channel-call-uuid");
+			channel_index_entry_t *a_entry, *b_entry;
+			char epoch[32];
+
+			a_uuid = switch_event_get_header(event, "Bridge-A-Unique-ID");
+			b_uuid = switch_event_get_header(event, "Bridge-B-Unique-ID");
+
+			if (zstr(a_uuid) || zstr(b_uuid)) {
+				a_uuid = switch_event_get_header_nil(event, "caller-unique-id");
+				b_uuid = switch_event_get_header_nil(event, "other-leg-unique-id");
+			}
+
+			if (!(a_entry = switch_core_hash_find(channel_index.hash, a_uuid)) || !strcmp(a_uuid, b_uuid)) {
+				break;
+			}
+
+			channel_index_clear_call(a_entry);
+			ci_set(a_entry, CI_CALL_UUID, call_uuid);
+
+			if ((b_entry = switch_core_hash_find(channel_index.hash, b_uuid))) {
+				channel_index_clear_call(b_entry);
+				ci_set(b_entry, CI_CALL_UUID, call_uuid);
+				b_entry->caller_uuid = strdup(a_uuid);
+				channel_index.callees++;
+			}
+
+			switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+			a_entry->callee_uuid = strdup(b_uuid);
+			a_entry->call_created_epoch = strdup(epoch);
+		}
+		break;
+	case SWITCH_EVENT_CHANNEL_UNBRIDGE:
+		{
+			const char *call_uuid = switch_event_get_header_nil(event, "channel-call-uuid");
+			channel_index_entry_t *c_entry = switch_core_hash_find(channel_index.hash, switch_event_get_header_nil(event, "caller-unique-id"));
+
+			channel_index_reset_call_uuid(entry, call_uuid);
+
+			if (c_entry) {
+				channel_index_reset_call_uuid(c_entry, call_uuid);
+				if (c_entry->callee_uuid) {
+					channel_index_reset_call_uuid(switch_core_hash_find(channel_index.hash, c_entry->callee_uuid), call_uuid);
+				}
+				if (c_entry->caller_uuid) {
+					channel_index_reset_call_uuid(switch_core_hash_find(channel_index.hash, c_entry->caller_uuid), call_uuid);
+				}
+				channel_index_clear_call(c_entry);
+			}
+		}
+		break;
+	case SWITCH_EVENT_CALL_SECURE:
+		{
+			const char *type = switch_event_get_header(event, "secure_type");
+
+			if (!zstr(type)) {
+				ci_set(entry, CI_SECURE, type);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+
+ end:
+
+	switch_mutex_unlock(channel_index.mutex);
+
+	return exists;
+}
+
+static void channel_index_event_handler(switch_event_t *event)
+{
+	channel_index_event(event);
+}
+
+static switch_event_types_t channel_index_events[] = {
+	SWITCH_EVENT_CHANNEL_DESTROY,
+	SWITCH_EVENT_CHANNEL_UUID,
+	SWITCH_EVENT_CHANNEL_CREATE,
+	SWITCH_EVENT_CHANNEL_ANSWER,
+	SWITCH_EVENT_CHANNEL_PROGRESS_MEDIA,
+	SWITCH_EVENT_CHANNEL_HOLD,
+	SWITCH_EVENT_CHANNEL_UNHOLD,
+	SWITCH_EVENT_CHANNEL_EXECUTE,
+	SWITCH_EVENT_CHANNEL_ORIGINATE,
+	SWITCH_EVENT_CALL_UPDATE,
+	SWITCH_EVENT_CHANNEL_CALLSTATE,
+	SWITCH_EVENT_CHANNEL_STATE,
+	SWITCH_EVENT_CHANNEL_BRIDGE,
+	SWITCH_EVENT_CHANNEL_UNBRIDGE,
+	SWITCH_EVENT_CALL_SECURE,
+	SWITCH_EVENT_CODEC
+};
+
+/* SQL LIKE: % matches any run of characters, _ matches one, ASCII letters match either case */
+static switch_bool_t channel_index_like(const char *str, const char *pattern)
+{
+	while (*pattern) {
+		if (*pattern == '%') {
+			while (*pattern == '%') {
+				pattern++;
+			}
+
+			if (!*pattern) {
+				return SWITCH_TRUE;
+			}
+
+			for (; *str; str++) {
+				if (channel_index_like(str, pattern)) {
+					return SWITCH_TRUE;
+				}
+			}
+
+			return SWITCH_FALSE;
+		}
+
+		if (!*str || (*pattern != '_' && tolower((unsigned char) *pattern) != tolower((unsigned char) *str))) {
+			return SWITCH_FALSE;
+		}
+
+		pattern++;
+		str++;
+	}
+
+	return *str ? SWITCH_FALSE : SWITCH_TRUE;
+}
+
+static switch_bool_t channel_index_match(channel_index_entry_t *entry, const char *match)
+{
+	channel_index_col_t cols[] = { CI_UUID, CI_NAME, CI_CID_NAME, CI_CID_NUM, CI_PRESENCE_DATA };
+	switch_bool_t like = strchr(match, '%') ? SWITCH_TRUE : SWITCH_FALSE;
+	int i;
+
+	for (i = 0; i < (int) (sizeof(cols) / sizeof(cols[0])); i++) {
+		const char *val = entry->col[cols[i]];
+
+		if (val && (like ? channel_index_like(val, match) : !!switch_stristr(match, val))) {
+			return SWITCH_TRUE;
+		}
+	}
+
+	return SWITCH_FALSE;
+}
+
+/* Copies one row into a single allocation so it can be handed out after the index is unlocked */
+static channel_index_row_t *channel_index_row_create(const char **vals, int argc)
+{
+	channel_index_row_t *row;
+	switch_size_t len = sizeof(*row) + argc * sizeof(char *);
+	char *p;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		if (vals[i]) {
+			len += strlen(vals[i]) + 1;
+		}
+	}
+
+	switch_zmalloc(row, len);
+	row->argc = argc;
+	row->argv = (char **) (row + 1);
+	p = (char *) (row->argv + argc);
+
+	for (i = 0; i < argc; i++) {
+		if (vals[i]) {
+			switch_size_t vlen = strlen(vals[i]) + 1;
+
+			memcpy(p, vals[i], vlen);
+			row->argv[i] = p;
+			p += vlen;
+		}
+	}
+
+	return row;
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_channel_index_walk(switch_channel_index_view_t view, const char *match, switch_bool_t bridged_only,
+														switch_core_db_callback_func_t callback, void *pArg)
+{
+	channel_index_entry_t *entry, *b_entry;
+	channel_index_row_t *rows = NULL, *last = NULL, *row;
+	const char *vals[CI_MAX_ROW_COLUMNS];
+	char *names[CI_MAX_ROW_COLUMNS];
+	const channel_index_col_t *a_cols = NULL, *b_cols = NULL;
+	int a_argc = 0, b_argc = 0, argc = 0, i;
+	uint32_t total = 0;
+	int stop = 0;
+
+	if (!channel_index.mutex) {
+		return 0;
+	}
+
+	switch (view) {
+	case SCI_VIEW_BASIC_CALLS:
+		a_cols = basic_calls_a_cols;
+		a_argc = sizeof(basic_calls_a_cols) / sizeof(basic_calls_a_cols[0]);
+		b_cols = basic_calls_b_cols;
+		b_argc = sizeof(basic_calls_b_cols) / sizeof(basic_calls_b_cols[0]);
+		break;
+	case SCI_VIEW_DETAILED_CALLS:
+		a_argc = b_argc = CI_SENT_CALLEE_NUM + 1;
+		break;
+	default:
+		a_argc = CI_COLUMNS;
+		break;
+	}
+
+	for (i = 0; i < a_argc; i++) {
+		names[argc++] = (char *) channel_index_names[a_cols ? a_cols[i] : i];
+	}
+
+	if (view != SCI_VIEW_CHANNELS) {
+		for (i = 0; i < b_argc; i++) {
+			names[argc++] = (char *) channel_index_b_names[b_cols ? b_cols[i] : i];
+		}
+		names[argc++] = "call_created_epoch";
+	}
+
+	switch_mutex_lock(channel_index.mutex);
+
+	for (entry = channel_index.head; entry; entry = entry->next) {
+		int x = 0;
+
+		if (view != SCI_VIEW_CHANNELS && entry->caller_uuid) {
+			continue;
+		}
+
+		if (!zstr(match) && !channel_index_match(entry, match)) {
+			continue;
+		}
+
+		b_entry = entry->callee_uuid ? switch_core_hash_find(channel_index.hash, entry->callee_uuid) : NULL;
+
+		if (bridged_only && !b_entry) {
+			continue;
+		}
+
+		for (i = 0; i < a_argc; i++) {
+			vals[x++] = entry->col[a_cols ? a_cols[i] : i];
+		}
+
+		if (view != SCI_VIEW_CHANNELS) {
+			for (i = 0; i < b_argc; i++) {
+				vals[x++] = b_entry ? b_entry->col[b_cols ? b_cols[i] : i] : NULL;
+			}
+			vals[x++] = entry->call_created_epoch;
+		}
+
+		row = channel_index_row_create(vals, argc);
+
+		if (last) {
+			last->next = row;
+		} else {
+			rows = row;
+		}
+		last = row;
+	}
+
+	switch_mutex_unlock(channel_index.mutex);
+
+	while ((row = rows)) {
+		rows = row->next;
+
+		if (!stop) {
+			total++;
+			stop = callback(pArg, row->argc, row->argv, names);
+		}
+
+		free(row);
+	}
+
+	return total;
+}
+
+SWITCH_DECLARE(uint32_t) switch_core_channel_index_count(switch_channel_index_view_t view)
+{
+	uint32_t count;
+
+	if (!channel_index.mutex) {
+		return 0;
+	}
+
+	switch_mutex_lock(channel_index.mutex);
+	count = view == SCI_VIEW_CHANNELS ? channel_index.count : channel_index.count - channel_index.callees;
+	switch_mutex_unlock(channel_index.mutex);
+
+	return count;
+}
+
+static void channel_index_init(switch_memory_pool_t *pool)
+{
+	switch_mutex_init(&channel_index.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&channel_index.hash);
+}
+
+static void channel_index_destroy(void)
+{
+	channel_index_entry_t *entry;
+
+	if (!channel_index.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(channel_index.mutex);
+
+	while ((entry = channel_index.head)) {
+		channel_index.head = entry->next;
+		channel_index_free(entry);
+	}
+
+	channel_index.tail = NULL;
+	channel_index.count = channel_index.callees = 0;
+	switch_core_hash_destroy(&channel_index.hash);
+
+	switch_mutex_unlock(channel_index.mutex);
+}
+
+
 #define MAX_SQL 5
 #define new_sql()   switch_assert(sql_idx+1 < MAX_SQL); if (exists) sql[sql_idx++]
 #define new_sql_a() switch_assert(sql_idx+1 < MAX_SQL); sql[sql_idx++]
@@ -2210,11 +2908,11 @@ static void core_event_handler(switch_event_t *event)
 	int sql_idx = 0;
 	char *extra_cols;
 	int exists = 1;
-	char *uuid = NULL;
 
 	switch_assert(event);
 
 	switch (event->event_id) {
+	case SWITCH_EVENT_CHANNEL_DESTROY:
 	case SWITCH_EVENT_CHANNEL_UUID:
 	case SWITCH_EVENT_CHANNEL_CREATE:
 	case SWITCH_EVENT_CHANNEL_ANSWER:
@@ -2229,9 +2927,13 @@ static void core_event_handler(switch_event_t *event)
 	case SWITCH_EVENT_CHANNEL_BRIDGE:
 	case SWITCH_EVENT_CHANNEL_UNBRIDGE:
 	case SWITCH_EVENT_CALL_SECURE:
+	case SWITCH_EVENT_CODEC:
 		{
-			if ((uuid = switch_event_get_header(event, "unique-id"))) {
-				exists = switch_ivr_uuid_exists(uuid);
+			exists = channel_index_event(event);
+
+			/* the channels and calls tables are only written when asked to mirror the index */
+			if (!switch_test_flag((&runtime), SCF_CORE_DB_CHANNELS)) {
+				return;
 			}
 		}
 		break;
@@ -3351,6 +4053,7 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 	switch_mutex_init(&sql_manager.dbh_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
 	switch_mutex_init(&sql_manager.io_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
 	switch_mutex_init(&sql_manager.ctl_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
+	channel_index_init(sql_manager.memory_pool);
 
 	if (!sql_manager.manage) goto skip;
 
@@ -3625,6 +4328,12 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 		switch_core_sqldb_start_thread();
 		switch_thread_create(&sql_manager.db_thread, thd_attr, switch_core_sql_db_thread, NULL, sql_manager.memory_pool);
 
+	} else {
+		int i;
+
+		for (i = 0; i < (int) (sizeof(channel_index_events) / sizeof(channel_index_events[0])); i++) {
+			switch_event_bind("core_db", channel_index_events[i], SWITCH_EVENT_SUBCLASS_ANY, channel_index_event_handler, NULL);
+		}
 	}
 
 	switch_cache_db_release_db_handle(&sql_manager.dbh);
@@ -3701,6 +4410,7 @@ void switch_core_sqldb_stop(void)
 	switch_status_t st;
 
 	switch_event_unbind_callback(core_event_handler);
+	switch_event_unbind_callback(channel_index_event_handler);
 
 	if (sql_manager.db_thread && sql_manager.db_thread_running) {
 		sql_manager.db_thread_running = -1;
@@ -3711,6 +4421,8 @@ void switch_core_sqldb_stop(void)
 
 	switch_cache_db_flush_handles();
 	sql_close(0);
+
+	channel_index_destroy();
 }
 
 SWITCH_DECLARE(void) switch_cache_db_status(switch_stream_handle_t *stream)
@@ -43,6 +43,10 @@
 #include <libyuv.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // #define HAVE_LIBGD
 #ifdef HAVE_LIBGD
 #include <gd.h>
@@ -254,44 +258,171 @@ SWITCH_DECLARE(void) switch_img_free(switch_image_t **img)
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #endif
 
-SWITCH_DECLARE(void) switch_img_patch(switch_image_t *IMG, switch_image_t *img, int x, int y)
+/* Plane kernels for compositing straight into I420, every pixel becomes (dst * (255 - a) + src * a) / 255 rounded.
+   An alpha of 0 leaves dst alone and 255 copies src without blending at all */
+
+#define IMG_BLEND_CHUNK 256
+
+static inline uint8_t img_blend_pixel(uint8_t dst, uint8_t src, uint8_t alpha)
 {
-	int i, len, max_h;
-	int xoff = 0, yoff = 0;
+	uint32_t t = dst * (255 - alpha) + src * alpha + 128;
 
-	switch_assert(IMG->fmt == SWITCH_IMG_FMT_I420);
+	return (uint8_t)((t + (t >> 8)) >> 8);
+}
 
-	if (img->fmt == SWITCH_IMG_FMT_ARGB) {
-		int max_w = MIN(img->d_w, IMG->d_w - abs(x));
-		int max_h = MIN(img->d_h, IMG->d_h - abs(y));
-		int j;
-		uint8_t alpha;
-		switch_rgb_color_t *rgb;
-
-		for (i = 0; i < max_h; i++) {
-			for (j = 0; j < max_w; j++) {
-				alpha = img->planes[SWITCH_PLANE_PACKED][i * img->stride[SWITCH_PLANE_PACKED] + j * 4];
-
-				if (alpha > 0) {
-					switch_rgb_color_t RGB = { 0 };
-
-					switch_img_get_rgb_pixel(IMG, &RGB, x + j, y + i);
-					rgb = (switch_rgb_color_t *)(img->planes[SWITCH_PLANE_PACKED] + i * img->stride[SWITCH_PLANE_PACKED] + j * 4);
-
-					if (alpha < 255) {
-						RGB.a = 255;
-						RGB.r = ((RGB.r * (255 - alpha)) >> 8) + ((rgb->r * alpha) >> 8);
-						RGB.g = ((RGB.g * (255 - alpha)) >> 8) + ((rgb->g * alpha) >> 8);
-						RGB.b = ((RGB.b * (255 - alpha)) >> 8) + ((rgb->b * alpha) >> 8);
-
-						switch_img_draw_pixel(IMG, x + j, y + i, &RGB);
-					} else {
-						switch_img_draw_pixel(IMG, x + j, y + i, rgb);
+#ifdef __SSE2__
+static inline __m128i img_blend_epu16(__m128i d, __m128i s, __m128i a, __m128i na)
+{
+	__m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(d, na), _mm_mullo_epi16(s, a)), _mm_set1_epi16(128));
+
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+static void img_blend_plane_row(uint8_t *dst, const uint8_t *src, int len, uint8_t alpha)
+{
+	int i = 0;
+#ifdef __SSE2__
+	__m128i zero, a, na;
+#endif
+
+	if (alpha == 255) {
+		memcpy(dst, src, len);
+		return;
+	}
+
+	if (!alpha) return;
+
+#ifdef __SSE2__
+	zero = _mm_setzero_si128();
+	a = _mm_set1_epi16(alpha);
+	na = _mm_set1_epi16(255 - alpha);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i lo = img_blend_epu16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), a, na);
+		__m128i hi = img_blend_epu16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), a, na);
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < len; i++) {
+		dst[i] = img_blend_pixel(dst[i], src[i], alpha);
+	}
+}
+
+static void img_blend_plane_row_alpha(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int len)
+{
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi16(255);
+	const __m128i opaque = _mm_set1_epi8((char) 0xff);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i d, alo, ahi, lo, hi;
+
+		/* fully opaque runs are copied and fully transparent ones left alone */
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, opaque)) == 0xffff) {
+			_mm_storeu_si128((__m128i *)(dst + i), s);
+			continue;
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xffff) {
+			continue;
+		}
+
+		d = _mm_loadu_si128((const __m128i *)(dst + i));
+		alo = _mm_unpacklo_epi8(a, zero);
+		ahi = _mm_unpackhi_epi8(a, zero);
+		lo = img_blend_epu16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), alo, _mm_sub_epi16(full, alo));
+		hi = img_blend_epu16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), ahi, _mm_sub_epi16(full, ahi));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < len; i++) {
+		if (alpha[i] == 255) {
+			dst[i] = src[i];
+		} else if (alpha[i]) {
+			dst[i] = img_blend_pixel(dst[i], src[i], alpha[i]);
+		}
+	}
+}
+
+/* Blend the visible part of an ARGB image into an I420 one using its alpha channel */
+static void img_patch_argb(switch_image_t *IMG, switch_image_t *img, int x, int y)
+{
+	int max_w = MIN(img->d_w, IMG->d_w - abs(x));
+	int max_h = MIN(img->d_h, IMG->d_h - abs(y));
+	uint8_t ybuf[IMG_BLEND_CHUNK], abuf[IMG_BLEND_CHUNK];
+	uint8_t ubuf[IMG_BLEND_CHUNK / 2], vbuf[IMG_BLEND_CHUNK / 2], uabuf[IMG_BLEND_CHUNK / 2];
+	int i, j, k;
+
+	for (i = y < 0 ? -y : 0; i < max_h; i++) {
+		int dy = y + i;
+		uint8_t *row = img->planes[SWITCH_PLANE_PACKED] + i * img->stride[SWITCH_PLANE_PACKED];
+
+		for (j = x < 0 ? -x : 0; j < max_w; j += IMG_BLEND_CHUNK) {
+			int n = MIN(IMG_BLEND_CHUNK, max_w - j);
+			int k0 = (x + j) & 1, c = 0;
+			uint8_t visible = 0;
+
+			for (k = 0; k < n; k++) {
+				switch_rgb_color_t *rgb = (switch_rgb_color_t *)(row + (j + k) * 4);
+				switch_yuv_color_t yuv;
+
+				abuf[k] = rgb->a;
+				visible |= rgb->a;
+
+				if (!rgb->a) {
+					ybuf[k] = 0;
+					if (!(dy & 1) && ((x + j + k) & 1) == 0) {
+						ubuf[c] = vbuf[c] = uabuf[c] = 0;
+						c++;
 					}
+					continue;
+				}
+
+				switch_color_rgb2yuv(rgb, &yuv);
+				ybuf[k] = yuv.y;
+
+				if (!(dy & 1) && ((x + j + k) & 1) == 0) {
+					ubuf[c] = yuv.u;
+					vbuf[c] = yuv.v;
+					uabuf[c] = rgb->a;
+					c++;
 				}
 			}
+
+			if (!visible) continue;
+
+			img_blend_plane_row_alpha(IMG->planes[SWITCH_PLANE_Y] + dy * IMG->stride[SWITCH_PLANE_Y] + x + j, ybuf, abuf, n);
+
+			if (c) {
+				int cx = (x + j + k0) / 2;
+
+				img_blend_plane_row_alpha(IMG->planes[SWITCH_PLANE_U] + dy / 2 * IMG->stride[SWITCH_PLANE_U] + cx, ubuf, uabuf, c);
+				img_blend_plane_row_alpha(IMG->planes[SWITCH_PLANE_V] + dy / 2 * IMG->stride[SWITCH_PLANE_V] + cx, vbuf, uabuf, c);
+			}
 		}
+	}
+}
 
+SWITCH_DECLARE(void) switch_img_patch(switch_image_t *IMG, switch_image_t *img, int x, int y)
+{
+	int i, len, max_h;
+	int xoff = 0, yoff = 0;
+
+	switch_assert(IMG->fmt == SWITCH_IMG_FMT_I420);
+
+	if (img->fmt == SWITCH_IMG_FMT_ARGB) {
+		img_patch_argb(IMG, img, x, y);
 		return;
 
 #ifdef HAVE_LIBGD
@@ -599,6 +730,24 @@ SWITCH_DECLARE(void) switch_img_overlay(switch_image_t *IMG, switch_image_t *img
 	if (y & 1) y++;
 	if (len <= 0) return;
 
+	if (img->fmt == SWITCH_IMG_FMT_I420) {
+		int clen = (len + 1) / 2;
+
+		for (i = y; i < max_h; i++) {
+			img_blend_plane_row(IMG->planes[SWITCH_PLANE_Y] + IMG->stride[SWITCH_PLANE_Y] * i + x,
+								img->planes[SWITCH_PLANE_Y] + img->stride[SWITCH_PLANE_Y] * (i - y + yoff) + xoff, len, alpha);
+		}
+
+		for (i = y; i < max_h; i += 2) {
+			img_blend_plane_row(IMG->planes[SWITCH_PLANE_U] + IMG->stride[SWITCH_PLANE_U] * (i / 2) + x / 2,
+								img->planes[SWITCH_PLANE_U] + img->stride[SWITCH_PLANE_U] * ((i - y + yoff) / 2) + xoff / 2, clen, alpha);
+			img_blend_plane_row(IMG->planes[SWITCH_PLANE_V] + IMG->stride[SWITCH_PLANE_V] * (i / 2) + x / 2,
+								img->planes[SWITCH_PLANE_V] + img->stride[SWITCH_PLANE_V] * ((i - y + yoff) / 2) + xoff / 2, clen, alpha);
+		}
+
+		return;
+	}
+
 	for (i = y; i < max_h; i++) {
 		for (j = 0; j < len; j++) {
 			switch_img_get_rgb_pixel(IMG, &RGB, x + j, i);
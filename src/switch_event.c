@@ -38,9 +38,10 @@
 #include "tpl.h"
 #include "private/switch_core_pvt.h"
 
-//#define SWITCH_EVENT_RECYCLE
 #define DISPATCH_QUEUE_LEN 10000
 //#define DEBUG_DISPATCH_QUEUES
+#define HEADER_INDEX_THRESHOLD_DEFAULT 32
+#define HEADER_INDEX_MIN_SIZE 64
 
 /*! \brief A node to store binded events */
 struct switch_event_node {
@@ -54,9 +55,22 @@ struct switch_event_node {
 	switch_event_callback_t callback;
 	/*! private data */
 	void *user_data;
+	/*! the subclass is a file: or func: filter that has to be checked against every event */
+	int dynamic;
+	/*! number of events handed to the callback */
+	uint64_t delivered;
+	/*! time spent in the callback (microseconds) */
+	switch_time_t total_time;
+	/*! longest single callback (microseconds) */
+	switch_time_t max_time;
 	struct switch_event_node *next;
 };
 
+/*! \brief The nodes an event has to be delivered to, in delivery order, for every event id */
+typedef struct switch_event_route {
+	switch_event_node_t **nodes[SWITCH_EVENT_ALL + 1];
+} switch_event_route_t;
+
 /*! \brief A registered custom event subclass  */
 struct switch_event_subclass {
 	/*! the owner of the subclass */
@@ -83,6 +97,14 @@ static unsigned int SOFT_MAX_DISPATCH = 0;
 static char guess_ip_v4[80] = "";
 static char guess_ip_v6[80] = "";
 static switch_event_node_t *EVENT_NODES[SWITCH_EVENT_ALL + 1] = { NULL };
+static struct {
+	/* events without a subclass */
+	switch_event_route_t plain;
+	/* events with a subclass nobody binds to by name */
+	switch_event_route_t other;
+	/* subclass name -> switch_event_route_t for subclasses somebody binds to by name */
+	switch_hash_t *subclass;
+} EVENT_ROUTES;
 static switch_thread_rwlock_t *RWLOCK = NULL;
 static switch_mutex_t *BLOCK = NULL;
 static switch_mutex_t *POOL_LOCK = NULL;
@@ -100,10 +122,22 @@ static int EVENT_CHANNEL_DISPATCH_THREAD_COUNT = 0;
 static int EVENT_CHANNEL_DISPATCH_THREAD_STARTING = 0;
 static int SYSTEM_RUNNING = 0;
 static uint64_t EVENT_SEQUENCE_NR = 0;
-#ifdef SWITCH_EVENT_RECYCLE
-static switch_queue_t *EVENT_RECYCLE_QUEUE = NULL;
-static switch_queue_t *EVENT_HEADER_RECYCLE_QUEUE = NULL;
-#endif
+static uint32_t HEADER_INDEX_THRESHOLD = HEADER_INDEX_THRESHOLD_DEFAULT;
+
+/*! \brief A dispatch queue owned by a single thread, events of one call always land on the same shard */
+typedef struct event_dispatch_shard {
+	switch_queue_t *queue;
+	switch_thread_t *thread;
+	/*! events delivered by this shard */
+	uint64_t dispatched;
+	/*! time events spent waiting in the queue (microseconds) */
+	switch_time_t total_latency;
+	switch_time_t max_latency;
+} event_dispatch_shard_t;
+
+static event_dispatch_shard_t EVENT_DISPATCH_SHARDS[MAX_DISPATCH_VAL];
+static uint32_t EVENT_DISPATCH_SHARD_COUNT = 0;
+static volatile switch_atomic_t EVENT_DISPATCH_SHARD_NEXT = 0;
 
 static void unsub_all_switch_event_channel(void);
 
@@ -126,6 +160,376 @@ static char *my_dup(const char *s)
 #define FREE(ptr) switch_safe_free(ptr)
 #endif
 
+/* Event allocator
+
+   Events and headers are recycled instead of going back to malloc every time.  Each thread keeps a small private
+   cache of both and trades them with a shared depot in batches, so a thread firing events and the dispatch thread
+   destroying them only meet on the depot mutex once per batch.  Both caches are bounded, anything beyond that goes
+   back to the system.
+*/
+
+#define EVENT_CACHE_MAX_EVENTS 64
+#define EVENT_CACHE_MAX_HEADERS 2048
+#define EVENT_CACHE_BATCH_EVENTS 16
+#define EVENT_CACHE_BATCH_HEADERS 256
+#define EVENT_DEPOT_MAX_EVENTS 8192
+#define EVENT_DEPOT_MAX_HEADERS 262144
+
+typedef struct event_cache_s {
+	switch_event_t *events;
+	uint32_t event_count;
+	switch_event_header_t *headers;
+	uint32_t header_count;
+} event_cache_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_threadkey_t *key;
+	event_cache_t depot;
+	switch_event_alloc_stats_t stats;
+	int running;
+} event_alloc;
+
+/* move up to max objects from one free list to another, returns how many were moved */
+#define EVENT_CACHE_MOVE(_type, _from, _from_count, _to, _to_count, _max) {	\
+		uint32_t _moved = 0;											\
+		_type *_o;														\
+		while ((_from) && _moved < (_max)) {							\
+			_o = (_from);												\
+			(_from) = _o->next;											\
+			_o->next = (_to);											\
+			(_to) = _o;													\
+			_moved++;													\
+		}																\
+		(_from_count) -= _moved;										\
+		(_to_count) += _moved;											\
+	}
+
+static void event_cache_release(event_cache_t *cache)
+{
+	switch_event_t *ep;
+	switch_event_header_t *hp;
+
+	if (event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		EVENT_CACHE_MOVE(switch_event_t, cache->events, cache->event_count, event_alloc.depot.events, event_alloc.depot.event_count,
+						 EVENT_DEPOT_MAX_EVENTS - event_alloc.depot.event_count);
+		EVENT_CACHE_MOVE(switch_event_header_t, cache->headers, cache->header_count, event_alloc.depot.headers, event_alloc.depot.header_count,
+						 EVENT_DEPOT_MAX_HEADERS - event_alloc.depot.header_count);
+		event_alloc.stats.events_freed += cache->event_count;
+		event_alloc.stats.headers_freed += cache->header_count;
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	while ((ep = cache->events)) {
+		cache->events = ep->next;
+		free(ep);
+	}
+
+	while ((hp = cache->headers)) {
+		cache->headers = hp->next;
+		free(hp);
+	}
+
+	cache->event_count = cache->header_count = 0;
+}
+
+#ifndef WIN32
+static void event_cache_destroy(void *ptr)
+{
+	event_cache_t *cache = (event_cache_t *) ptr;
+
+	event_cache_release(cache);
+
+	if (event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		event_alloc.stats.thread_caches--;
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	free(cache);
+}
+#endif
+
+static event_cache_t *event_cache_get(void)
+{
+#ifdef WIN32
+	/* thread key destructors do not run here, stick to the depot */
+	return NULL;
+#else
+	void *ptr = NULL;
+	event_cache_t *cache;
+
+	if (!event_alloc.running) {
+		return NULL;
+	}
+
+	switch_threadkey_private_get(&ptr, event_alloc.key);
+
+	if (!(cache = (event_cache_t *) ptr)) {
+		switch_zmalloc(cache, sizeof(*cache));
+		switch_threadkey_private_set(cache, event_alloc.key);
+		switch_mutex_lock(event_alloc.mutex);
+		event_alloc.stats.thread_caches++;
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	return cache;
+#endif
+}
+
+static switch_event_t *event_alloc_event(void)
+{
+	event_cache_t *cache = event_cache_get();
+	switch_event_t *ep = NULL;
+
+	if (cache && !cache->events) {
+		switch_mutex_lock(event_alloc.mutex);
+		EVENT_CACHE_MOVE(switch_event_t, event_alloc.depot.events, event_alloc.depot.event_count, cache->events, cache->event_count,
+						 EVENT_CACHE_BATCH_EVENTS);
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	if (cache && (ep = cache->events)) {
+		cache->events = ep->next;
+		cache->event_count--;
+	} else if (!cache && event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		if ((ep = event_alloc.depot.events)) {
+			event_alloc.depot.events = ep->next;
+			event_alloc.depot.event_count--;
+		}
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	if (!ep) {
+		ep = ALLOC(sizeof(*ep));
+		switch_assert(ep);
+
+		if (event_alloc.running) {
+			switch_mutex_lock(event_alloc.mutex);
+			event_alloc.stats.events_allocated++;
+			switch_mutex_unlock(event_alloc.mutex);
+		}
+	}
+
+	return ep;
+}
+
+static void event_free_event(switch_event_t *ep)
+{
+	event_cache_t *cache = event_cache_get();
+
+	if (cache) {
+		ep->next = cache->events;
+		cache->events = ep;
+		cache->event_count++;
+
+		if (cache->event_count > EVENT_CACHE_MAX_EVENTS) {
+			uint32_t freed = 0;
+
+			switch_mutex_lock(event_alloc.mutex);
+			EVENT_CACHE_MOVE(switch_event_t, cache->events, cache->event_count, event_alloc.depot.events, event_alloc.depot.event_count,
+							 EVENT_DEPOT_MAX_EVENTS > event_alloc.depot.event_count ? EVENT_CACHE_BATCH_EVENTS : 0);
+			switch_mutex_unlock(event_alloc.mutex);
+
+			/* the depot is full, trim a whole batch so we do not come back here on the next free */
+			if (cache->event_count > EVENT_CACHE_MAX_EVENTS) {
+				while (cache->event_count > EVENT_CACHE_MAX_EVENTS - EVENT_CACHE_BATCH_EVENTS) {
+					ep = cache->events;
+					cache->events = ep->next;
+					cache->event_count--;
+					free(ep);
+					freed++;
+				}
+
+				switch_mutex_lock(event_alloc.mutex);
+				event_alloc.stats.events_freed += freed;
+				switch_mutex_unlock(event_alloc.mutex);
+			}
+		}
+		return;
+	}
+
+	if (event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		if (event_alloc.depot.event_count < EVENT_DEPOT_MAX_EVENTS) {
+			ep->next = event_alloc.depot.events;
+			event_alloc.depot.events = ep;
+			event_alloc.depot.event_count++;
+			ep = NULL;
+		} else {
+			event_alloc.stats.events_freed++;
+		}
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	FREE(ep);
+}
+
+static switch_event_header_t *event_alloc_header(void)
+{
+	event_cache_t *cache = event_cache_get();
+	switch_event_header_t *hp = NULL;
+
+	if (cache && !cache->headers) {
+		switch_mutex_lock(event_alloc.mutex);
+		EVENT_CACHE_MOVE(switch_event_header_t, event_alloc.depot.headers, event_alloc.depot.header_count, cache->headers, cache->header_count,
+						 EVENT_CACHE_BATCH_HEADERS);
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	if (cache && (hp = cache->headers)) {
+		cache->headers = hp->next;
+		cache->header_count--;
+	} else if (!cache && event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		if ((hp = event_alloc.depot.headers)) {
+			event_alloc.depot.headers = hp->next;
+			event_alloc.depot.header_count--;
+		}
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	if (!hp) {
+		hp = ALLOC(sizeof(*hp));
+		switch_assert(hp);
+
+		if (event_alloc.running) {
+			switch_mutex_lock(event_alloc.mutex);
+			event_alloc.stats.headers_allocated++;
+			switch_mutex_unlock(event_alloc.mutex);
+		}
+	}
+
+	return hp;
+}
+
+static void event_free_header(switch_event_header_t *hp)
+{
+	event_cache_t *cache = event_cache_get();
+
+	if (cache) {
+		hp->next = cache->headers;
+		cache->headers = hp;
+		cache->header_count++;
+
+		if (cache->header_count > EVENT_CACHE_MAX_HEADERS) {
+			uint32_t freed = 0;
+
+			switch_mutex_lock(event_alloc.mutex);
+			EVENT_CACHE_MOVE(switch_event_header_t, cache->headers, cache->header_count, event_alloc.depot.headers, event_alloc.depot.header_count,
+							 EVENT_DEPOT_MAX_HEADERS > event_alloc.depot.header_count ? EVENT_CACHE_BATCH_HEADERS : 0);
+			switch_mutex_unlock(event_alloc.mutex);
+
+			if (cache->header_count > EVENT_CACHE_MAX_HEADERS) {
+				while (cache->header_count > EVENT_CACHE_MAX_HEADERS - EVENT_CACHE_BATCH_HEADERS) {
+					hp = cache->headers;
+					cache->headers = hp->next;
+					cache->header_count--;
+					free(hp);
+					freed++;
+				}
+
+				switch_mutex_lock(event_alloc.mutex);
+				event_alloc.stats.headers_freed += freed;
+				switch_mutex_unlock(event_alloc.mutex);
+			}
+		}
+		return;
+	}
+
+	if (event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		if (event_alloc.depot.header_count < EVENT_DEPOT_MAX_HEADERS) {
+			hp->next = event_alloc.depot.headers;
+			event_alloc.depot.headers = hp;
+			event_alloc.depot.header_count++;
+			hp = NULL;
+		} else {
+			event_alloc.stats.headers_freed++;
+		}
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+
+	FREE(hp);
+}
+
+SWITCH_DECLARE(void) switch_event_get_alloc_stats(switch_event_alloc_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (event_alloc.running) {
+		switch_mutex_lock(event_alloc.mutex);
+		*stats = event_alloc.stats;
+		stats->events_cached = event_alloc.depot.event_count;
+		stats->headers_cached = event_alloc.depot.header_count;
+		switch_mutex_unlock(event_alloc.mutex);
+	}
+}
+
+/* header names and values short enough live inside the header itself */
+
+static void header_set_name(switch_event_header_t *header, const char *name)
+{
+	size_t len = strlen(name) + 1;
+
+	if (len <= sizeof(header->name_buf)) {
+		header->name = memcpy(header->name_buf, name, len);
+	} else {
+		header->name = DUP(name);
+	}
+}
+
+static void header_free_name(switch_event_header_t *header)
+{
+	if (header->name != header->name_buf) {
+		FREE(header->name);
+	}
+	header->name = NULL;
+}
+
+static void header_set_value(switch_event_header_t *header, char *value, switch_bool_t owned)
+{
+	size_t len;
+
+	if (owned) {
+		header->value = value;
+	} else if ((len = strlen(value) + 1) <= sizeof(header->value_buf)) {
+		header->value = memcpy(header->value_buf, value, len);
+	} else {
+		header->value = DUP(value);
+	}
+}
+
+static void header_free_value(switch_event_header_t *header)
+{
+	if (header->value != header->value_buf) {
+		FREE(header->value);
+	}
+	header->value = NULL;
+}
+
+static void header_free(switch_event_header_t *header)
+{
+	if (header->idx) {
+		if (!header->array) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "INDEX WITH NO ARRAY WTF?? [%s][%s]\n", header->name, header->value);
+		} else {
+			int i = 0;
+
+			for (i = 0; i < header->idx; i++) {
+				FREE(header->array[i]);
+			}
+			FREE(header->array);
+		}
+	}
+
+	header_free_name(header);
+	header_free_value(header);
+	event_free_header(header);
+}
+
 /* make sure this is synced with the switch_event_types_t enum in switch_types.h
    also never put any new ones before EVENT_ALL
 */
@@ -345,6 +749,124 @@ static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *th
 
 }
 
+static void *SWITCH_THREAD_FUNC switch_event_shard_thread(switch_thread_t *thread, void *obj)
+{
+	event_dispatch_shard_t *shard = (event_dispatch_shard_t *) obj;
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	THREAD_COUNT++;
+	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+
+	for (;;) {
+		void *pop = NULL;
+		switch_event_t *event = NULL;
+		switch_time_t latency;
+
+		if (!SYSTEM_RUNNING) {
+			break;
+		}
+
+		if (switch_queue_pop(shard->queue, &pop) != SWITCH_STATUS_SUCCESS) {
+			continue;
+		}
+
+		if (!pop) {
+			break;
+		}
+
+		event = (switch_event_t *) pop;
+
+		latency = switch_time_ref() - event->queued;
+		shard->dispatched++;
+		shard->total_latency += latency;
+		if (latency > shard->max_latency) {
+			shard->max_latency = latency;
+		}
+
+		switch_event_deliver(&event);
+	}
+
+	switch_mutex_lock(EVENT_QUEUE_MUTEX);
+	THREAD_COUNT--;
+	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+
+	return NULL;
+}
+
+SWITCH_DECLARE(void) switch_event_launch_dispatch_shards(uint32_t count)
+{
+	switch_threadattr_t *thd_attr;
+	uint32_t index;
+
+	if (count > MAX_DISPATCH_VAL) {
+		count = MAX_DISPATCH_VAL;
+	}
+
+	switch_mutex_lock(BLOCK);
+
+	if (EVENT_DISPATCH_SHARD_COUNT) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Event dispatch shards are already running (%u)\n", EVENT_DISPATCH_SHARD_COUNT);
+		switch_mutex_unlock(BLOCK);
+		return;
+	}
+
+	for (index = 0; index < count; index++) {
+		event_dispatch_shard_t *shard = &EVENT_DISPATCH_SHARDS[index];
+
+		switch_queue_create(&shard->queue, DISPATCH_QUEUE_LEN, THRUNTIME_POOL);
+		switch_threadattr_create(&thd_attr, RUNTIME_POOL);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+		switch_thread_create(&shard->thread, thd_attr, switch_event_shard_thread, shard, RUNTIME_POOL);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Created %u event dispatch shard(s)\n", count);
+
+	EVENT_DISPATCH_SHARD_COUNT = count;
+	switch_mutex_unlock(BLOCK);
+}
+
+static switch_status_t switch_event_queue_shard_event(switch_event_t **eventp)
+{
+	switch_event_t *event = *eventp;
+	const char *uuid;
+	switch_ssize_t hlen = -1;
+	uint32_t index;
+
+	if ((uuid = switch_event_get_header(event, "Unique-ID"))) {
+		index = switch_hashfunc_default(uuid, &hlen) % EVENT_DISPATCH_SHARD_COUNT;
+	} else {
+		/* events that do not belong to a call were never ordered, spread them out round robin */
+		index = switch_atomic_fetch_add(&EVENT_DISPATCH_SHARD_NEXT, 1) % EVENT_DISPATCH_SHARD_COUNT;
+	}
+
+	event->queued = switch_time_ref();
+	*eventp = NULL;
+
+	return switch_queue_push(EVENT_DISPATCH_SHARDS[index].queue, event);
+}
+
+SWITCH_DECLARE(void) switch_event_dispatch_status(switch_stream_handle_t *stream)
+{
+	uint32_t index;
+
+	if (!EVENT_DISPATCH_SHARD_COUNT) {
+		stream->write_function(stream, "Shared dispatch queue: %u thread(s), depth %u\n",
+							   DISPATCH_THREAD_COUNT, EVENT_DISPATCH_QUEUE ? switch_queue_size(EVENT_DISPATCH_QUEUE) : 0);
+		return;
+	}
+
+	stream->write_function(stream, "%-6s %10s %16s %14s %14s\n", "shard", "depth", "dispatched", "avg wait(us)", "max wait(us)");
+
+	for (index = 0; index < EVENT_DISPATCH_SHARD_COUNT; index++) {
+		event_dispatch_shard_t *shard = &EVENT_DISPATCH_SHARDS[index];
+
+		stream->write_function(stream, "%-6u %10u %16" SWITCH_UINT64_T_FMT " %14" SWITCH_INT64_T_FMT " %14" SWITCH_INT64_T_FMT "\n",
+							   index, switch_queue_size(shard->queue), shard->dispatched,
+							   shard->dispatched ? (int64_t) (shard->total_latency / shard->dispatched) : (int64_t) 0, (int64_t) shard->max_latency);
+	}
+}
+
 static int PENDING = 0;
 
 static switch_status_t switch_event_queue_dispatch_event(switch_event_t **eventp)
@@ -389,23 +911,171 @@ static switch_status_t switch_event_queue_dispatch_event(switch_event_t **eventp
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* Event routes
+
+   Rather than testing every bound node against every event, the nodes an event can match are worked out once per
+   (event id, subclass) whenever the bindings change.  Only file: and func: bindings still need a look at the event
+   itself.  The routes are rebuilt under the write lock and read under the read lock, just like EVENT_NODES.
+*/
+
+static switch_bool_t event_node_routes(switch_event_node_t *node, const char *subclass_name, switch_bool_t has_subclass)
+{
+	if (!node->subclass_name) {
+		return SWITCH_TRUE;
+	}
+
+	if (node->dynamic) {
+		return has_subclass;
+	}
+
+	return (subclass_name && !strcmp(subclass_name, node->subclass_name)) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+static switch_event_node_t **event_route_build(switch_event_types_t e, const char *subclass_name, switch_bool_t has_subclass)
+{
+	switch_event_node_t *node, **nodes = NULL;
+	switch_event_types_t id;
+	int pass, count = 0, x = 0;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (id = e;; id = SWITCH_EVENT_ALL) {
+			for (node = EVENT_NODES[id]; node; node = node->next) {
+				if (event_node_routes(node, subclass_name, has_subclass)) {
+					if (pass) {
+						nodes[x++] = node;
+					} else {
+						count++;
+					}
+				}
+			}
+
+			if (id == SWITCH_EVENT_ALL) {
+				break;
+			}
+		}
+
+		if (!count) {
+			break;
+		}
+
+		if (!pass) {
+			nodes = calloc(count + 1, sizeof(*nodes));
+			switch_assert(nodes);
+		}
+	}
+
+	return nodes;
+}
+
+static void event_route_free(switch_event_route_t *route)
+{
+	int e;
+
+	for (e = 0; e <= SWITCH_EVENT_ALL; e++) {
+		FREE(route->nodes[e]);
+	}
+}
+
+static void event_routes_clear(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	event_route_free(&EVENT_ROUTES.plain);
+	event_route_free(&EVENT_ROUTES.other);
+
+	if (EVENT_ROUTES.subclass) {
+		for (hi = switch_core_hash_first(EVENT_ROUTES.subclass); hi; hi = switch_core_hash_next(&hi)) {
+			switch_core_hash_this(hi, NULL, NULL, &val);
+			event_route_free((switch_event_route_t *) val);
+			free(val);
+		}
+		switch_core_hash_destroy(&EVENT_ROUTES.subclass);
+	}
+}
+
+/* call with RWLOCK held for writing */
+static void event_routes_rebuild(void)
+{
+	switch_event_node_t *node, *np;
+	switch_event_route_t *route;
+	int e, id;
+
+	event_routes_clear();
+	switch_core_hash_init(&EVENT_ROUTES.subclass);
+
+	for (e = 0; e <= SWITCH_EVENT_ALL; e++) {
+		EVENT_ROUTES.plain.nodes[e] = event_route_build(e, NULL, SWITCH_FALSE);
+		EVENT_ROUTES.other.nodes[e] = event_route_build(e, NULL, SWITCH_TRUE);
+	}
+
+	for (id = 0; id <= SWITCH_EVENT_ALL; id++) {
+		for (node = EVENT_NODES[id]; node; node = node->next) {
+			if (!node->subclass_name || node->dynamic || switch_core_hash_find(EVENT_ROUTES.subclass, node->subclass_name)) {
+				continue;
+			}
+
+			switch_zmalloc(route, sizeof(*route));
+
+			/* only the event ids this subclass is bound on need their own route, the rest fall back to the other route */
+			for (e = 0; e <= SWITCH_EVENT_ALL; e++) {
+				int bound = 0;
+
+				for (np = EVENT_NODES[e]; np && !bound; np = np->next) {
+					bound = np->subclass_name && !np->dynamic && !strcmp(np->subclass_name, node->subclass_name);
+				}
+
+				for (np = EVENT_NODES[SWITCH_EVENT_ALL]; np && !bound; np = np->next) {
+					bound = np->subclass_name && !np->dynamic && !strcmp(np->subclass_name, node->subclass_name);
+				}
+
+				if (bound) {
+					route->nodes[e] = event_route_build(e, node->subclass_name, SWITCH_TRUE);
+				}
+			}
+
+			switch_core_hash_insert(EVENT_ROUTES.subclass, node->subclass_name, route);
+		}
+	}
+}
+
+static switch_event_node_t **event_route_find(switch_event_t *event)
+{
+	switch_event_route_t *route;
+
+	if (!event->subclass_name) {
+		return EVENT_ROUTES.plain.nodes[event->event_id];
+	}
+
+	if (EVENT_ROUTES.subclass && (route = switch_core_hash_find(EVENT_ROUTES.subclass, event->subclass_name)) && route->nodes[event->event_id]) {
+		return route->nodes[event->event_id];
+	}
+
+	return EVENT_ROUTES.other.nodes[event->event_id];
+}
+
 SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 {
-	switch_event_types_t e;
-	switch_event_node_t *node;
+	switch_event_node_t **nodes, *node;
+	switch_time_t start, elapsed;
 
 	if (SYSTEM_RUNNING) {
 		switch_thread_rwlock_rdlock(RWLOCK);
-		for (e = (*event)->event_id;; e = SWITCH_EVENT_ALL) {
-			for (node = EVENT_NODES[e]; node; node = node->next) {
-				if (switch_events_match(*event, node)) {
-					(*event)->bind_user_data = node->user_data;
-					node->callback(*event);
-				}
+		for (nodes = event_route_find(*event); nodes && (node = *nodes); nodes++) {
+			if (node->dynamic && !switch_events_match(*event, node)) {
+				continue;
 			}
 
-			if (e == SWITCH_EVENT_ALL) {
-				break;
+			(*event)->bind_user_data = node->user_data;
+			start = switch_time_ref();
+			node->callback(*event);
+			elapsed = switch_time_ref() - start;
+
+			/* not locked, these are only statistics */
+			node->delivered++;
+			node->total_time += elapsed;
+			if (elapsed > node->max_time) {
+				node->max_time = elapsed;
 			}
 		}
 		switch_thread_rwlock_unlock(RWLOCK);
@@ -414,6 +1084,30 @@ SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 	switch_event_destroy(event);
 }
 
+SWITCH_DECLARE(void) switch_event_binding_status(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+	switch_event_node_t *node;
+	int e;
+
+	switch_thread_rwlock_rdlock(RWLOCK);
+	stream->write_function(stream, "%-24s %-32s %-40s %12s %10s %10s\n", "id", "event", "subclass", "delivered", "avg(us)", "max(us)");
+
+	for (e = 0; e <= SWITCH_EVENT_ALL; e++) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			stream->write_function(stream, "%-24s %-32s %-40s %12" SWITCH_UINT64_T_FMT " %10" SWITCH_INT64_T_FMT " %10" SWITCH_INT64_T_FMT "\n",
+								   node->id, switch_event_name(node->event_id), switch_str_nil(node->subclass_name), node->delivered,
+								   node->delivered ? (int64_t) (node->total_time / node->delivered) : (int64_t) 0, (int64_t) node->max_time);
+
+			if (reset) {
+				node->delivered = 0;
+				node->total_time = 0;
+				node->max_time = 0;
+			}
+		}
+	}
+	switch_thread_rwlock_unlock(RWLOCK);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_running(void)
 {
 	return SYSTEM_RUNNING ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
@@ -498,27 +1192,45 @@ SWITCH_DECLARE(switch_status_t) switch_event_reserve_subclass_detailed(const cha
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim_events(void)
 {
-#ifdef SWITCH_EVENT_RECYCLE
+	event_cache_t depot = { 0 };
+
+	if (!event_alloc.running) {
+		return;
+	}
 
-	void *pop;
-	int size;
-	size = switch_queue_size(EVENT_RECYCLE_QUEUE);
+	switch_mutex_lock(event_alloc.mutex);
+	depot = event_alloc.depot;
+	memset(&event_alloc.depot, 0, sizeof(event_alloc.depot));
+	event_alloc.stats.events_freed += depot.event_count;
+	event_alloc.stats.headers_freed += depot.header_count;
+	switch_mutex_unlock(event_alloc.mutex);
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event(s) %d bytes\n", size, (int) sizeof(switch_event_t) * size);
-	size = switch_queue_size(EVENT_HEADER_RECYCLE_QUEUE);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event header(s) %d bytes\n",
-					  size, (int) sizeof(switch_event_header_t) * size);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %u recycled event(s) %u bytes\n",
+					  depot.event_count, (uint32_t) sizeof(switch_event_t) * depot.event_count);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %u recycled event header(s) %u bytes\n",
+					  depot.header_count, (uint32_t) sizeof(switch_event_header_t) * depot.header_count);
 
-	while (switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
+	while (depot.events) {
+		switch_event_t *ep = depot.events;
+		depot.events = ep->next;
+		free(ep);
 	}
-	while (switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
+
+	while (depot.headers) {
+		switch_event_header_t *hp = depot.headers;
+		depot.headers = hp->next;
+		free(hp);
 	}
-#else
-	return;
-#endif
+}
+
+static void event_alloc_shutdown(void)
+{
+	switch_core_memory_reclaim_events();
 
+	/* thread caches still alive hand their objects straight back to the system from now on */
+	switch_mutex_lock(event_alloc.mutex);
+	event_alloc.running = 0;
+	switch_mutex_unlock(event_alloc.mutex);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
@@ -530,6 +1242,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 	void *val;
 
 	if (switch_core_test_flag(SCF_MINIMAL)) {
+		event_alloc_shutdown();
 		return SWITCH_STATUS_SUCCESS;
 	}
 
@@ -562,6 +1275,20 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 		}
 	}
 
+	if (EVENT_DISPATCH_SHARD_COUNT) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping dispatch shards\n");
+
+		for (x = 0; x < EVENT_DISPATCH_SHARD_COUNT; x++) {
+			switch_queue_trypush(EVENT_DISPATCH_SHARDS[x].queue, NULL);
+			switch_queue_interrupt_all(EVENT_DISPATCH_SHARDS[x].queue);
+		}
+
+		for (x = 0; x < EVENT_DISPATCH_SHARD_COUNT; x++) {
+			switch_status_t st;
+			switch_thread_join(&st, EVENT_DISPATCH_SHARDS[x].thread);
+		}
+	}
+
 	x = 0;
 	while (x < 100 && THREAD_COUNT) {
 		switch_yield(100000);
@@ -581,6 +1308,17 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 		}
 	}
 
+	for (x = 0; x < EVENT_DISPATCH_SHARD_COUNT; x++) {
+		void *pop = NULL;
+		switch_event_t *event = NULL;
+
+		while (switch_queue_trypop(EVENT_DISPATCH_SHARDS[x].queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+			event = (switch_event_t *) pop;
+			switch_event_destroy(&event);
+		}
+	}
+	EVENT_DISPATCH_SHARD_COUNT = 0;
+
 	for (hi = switch_core_hash_first(CUSTOM_HASH); hi; hi = switch_core_hash_next(&hi)) {
 		switch_event_subclass_t *subclass;
 		switch_core_hash_this(hi, &var, NULL, &val);
@@ -596,7 +1334,12 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 	switch_core_hash_destroy(&event_channel_manager.perm_hash);
 
 	switch_core_hash_destroy(&CUSTOM_HASH);
-	switch_core_memory_reclaim_events();
+
+	switch_thread_rwlock_wrlock(RWLOCK);
+	event_routes_clear();
+	switch_thread_rwlock_unlock(RWLOCK);
+
+	event_alloc_shutdown();
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -678,6 +1421,13 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_mutex_init(&EVENT_QUEUE_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_core_hash_init(&CUSTOM_HASH);
 
+	memset(&event_alloc, 0, sizeof(event_alloc));
+	switch_mutex_init(&event_alloc.mutex, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
+#ifndef WIN32
+	switch_threadkey_private_create(&event_alloc.key, event_cache_destroy, RUNTIME_POOL);
+#endif
+	event_alloc.running = 1;
+
 	if (switch_core_test_flag(SCF_MINIMAL)) {
 		return SWITCH_STATUS_SUCCESS;
 	}
@@ -701,11 +1451,6 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_find_local_ip(guess_ip_v6, sizeof(guess_ip_v6), NULL, AF_INET6);
 
 
-#ifdef SWITCH_EVENT_RECYCLE
-	switch_queue_create(&EVENT_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_HEADER_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-#endif
-
 	check_dispatch();
 
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
@@ -718,25 +1463,13 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 SWITCH_DECLARE(switch_status_t) switch_event_create_subclass_detailed(const char *file, const char *func, int line,
 																	  switch_event_t **event, switch_event_types_t event_id, const char *subclass_name)
 {
-#ifdef SWITCH_EVENT_RECYCLE
-	void *pop;
-#endif
-
 	*event = NULL;
 
 	if ((event_id != SWITCH_EVENT_CLONE && event_id != SWITCH_EVENT_CUSTOM) && subclass_name) {
 		return SWITCH_STATUS_GENERR;
 	}
-#ifdef SWITCH_EVENT_RECYCLE
-	if (EVENT_RECYCLE_QUEUE && switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		*event = (switch_event_t *) pop;
-	} else {
-#endif
-		*event = ALLOC(sizeof(switch_event_t));
-		switch_assert(*event);
-#ifdef SWITCH_EVENT_RECYCLE
-	}
-#endif
+
+	*event = event_alloc_event();
 
 	memset(*event, 0, sizeof(switch_event_t));
 
@@ -764,6 +1497,120 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_priority(switch_event_t *event,
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_DECLARE(uint32_t) switch_event_set_header_index_threshold(uint32_t threshold)
+{
+	uint32_t old = HEADER_INDEX_THRESHOLD;
+
+	HEADER_INDEX_THRESHOLD = threshold;
+
+	return old;
+}
+
+/* Large events (channel variables, REQUEST_PARAMS etc) keep an open addressing table next to the header list
+   so lookups do not have to walk every header.  Only the first header of a given name in list order is indexed,
+   which is the one switch_event_get_header_ptr has always returned. */
+
+static switch_event_header_t **header_index_slot(switch_event_t *event, unsigned long hash, const char *header_name)
+{
+	uint32_t mask = event->header_index_size - 1;
+	uint32_t pos = (uint32_t) hash & mask;
+	switch_event_header_t *hp;
+
+	while ((hp = event->header_index[pos])) {
+		if (hp->hash == hash && !strcasecmp(hp->name, header_name)) {
+			break;
+		}
+		pos = (pos + 1) & mask;
+	}
+
+	return &event->header_index[pos];
+}
+
+static void header_index_rebuild(switch_event_t *event)
+{
+	switch_event_header_t *hp, **slot;
+	uint32_t size = HEADER_INDEX_MIN_SIZE;
+
+	while (size < event->header_count * 4) {
+		size <<= 1;
+	}
+
+	FREE(event->header_index);
+	event->header_index = calloc(size, sizeof(*event->header_index));
+	switch_assert(event->header_index);
+	event->header_index_size = size;
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		slot = header_index_slot(event, hp->hash, hp->name);
+
+		if (!*slot) {
+			*slot = hp;
+		}
+	}
+}
+
+static void header_index_add(switch_event_t *event, switch_event_header_t *header, switch_bool_t top)
+{
+	switch_event_header_t **slot;
+
+	if (!event->header_index) {
+		if (HEADER_INDEX_THRESHOLD && event->header_count >= HEADER_INDEX_THRESHOLD) {
+			header_index_rebuild(event);
+		}
+		return;
+	}
+
+	if (event->header_count * 2 > event->header_index_size) {
+		header_index_rebuild(event);
+		return;
+	}
+
+	slot = header_index_slot(event, header->hash, header->name);
+
+	if (!*slot || top) {
+		*slot = header;
+	}
+}
+
+static void header_index_del(switch_event_t *event, switch_event_header_t *header)
+{
+	switch_event_header_t **slot, *hp;
+	uint32_t mask, pos, next, home;
+
+	if (!event->header_index) {
+		return;
+	}
+
+	slot = header_index_slot(event, header->hash, header->name);
+
+	if (*slot != header) {
+		return;
+	}
+
+	/* promote the next header with the same name, it is now the first one */
+	for (hp = header->next; hp; hp = hp->next) {
+		if (hp->hash == header->hash && !strcasecmp(hp->name, header->name)) {
+			*slot = hp;
+			return;
+		}
+	}
+
+	/* backward shift deletion so the probe sequences stay intact without tombstones */
+	mask = event->header_index_size - 1;
+	pos = (uint32_t) (slot - event->header_index);
+	event->header_index[pos] = NULL;
+
+	for (next = (pos + 1) & mask; (hp = event->header_index[next]); next = (next + 1) & mask) {
+		home = (uint32_t) hp->hash & mask;
+
+		if ((next > pos && (home <= pos || home > next)) || (next < pos && home <= pos && home > next)) {
+			event->header_index[pos] = hp;
+			event->header_index[next] = NULL;
+			pos = next;
+		}
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event, const char *header_name, const char *new_header_name)
 {
 	switch_event_header_t *hp;
@@ -781,14 +1628,18 @@ SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event
 
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
-			FREE(hp->name);
-			hp->name = DUP(new_header_name);
+			header_free_name(hp);
+			header_set_name(hp, new_header_name);
 			hlen = -1;
 			hp->hash = switch_ci_hashfunc_default(hp->name, &hlen);
 			x++;
 		}
 	}
 
+	if (x && event->header_index) {
+		header_index_rebuild(event);
+	}
+
 	return x ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
 }
 
@@ -806,6 +1657,10 @@ SWITCH_DECLARE(switch_event_header_t *) switch_event_get_header_ptr(switch_event
 
 	hash = switch_ci_hashfunc_default(header_name, &hlen);
 
+	if (event->header_index) {
+		return *header_index_slot(event, hash, header_name);
+	}
+
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
 			return hp;
@@ -858,6 +1713,9 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 		switch_assert(x < 1000000);
 
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(header_name, hp->name) && (zstr(val) || !strcmp(hp->value, val))) {
+			header_index_del(event, hp);
+			event->header_count--;
+
 			if (lp) {
 				lp->next = hp->next;
 			} else {
@@ -866,27 +1724,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 			if (hp == event->last_header || !hp->next) {
 				event->last_header = lp;
 			}
-			FREE(hp->name);
-
-			if (hp->idx) {
-				int i = 0;
-
-				for (i = 0; i < hp->idx; i++) {
-					FREE(hp->array[i]);
-				}
-				FREE(hp->array);
-			}
-
-			FREE(hp->value);
-
-			memset(hp, 0, sizeof(*hp));
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != SWITCH_STATUS_SUCCESS) {
-				FREE(hp);
-			}
-#else
-			FREE(hp);
-#endif
+			header_free(hp);
 			status = SWITCH_STATUS_SUCCESS;
 		} else {
 			lp = hp;
@@ -900,22 +1738,12 @@ static switch_event_header_t *new_header(const char *header_name)
 {
 	switch_event_header_t *header;
 
-#ifdef SWITCH_EVENT_RECYCLE
-		void *pop;
-		if (EVENT_HEADER_RECYCLE_QUEUE && switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-			header = (switch_event_header_t *) pop;
-		} else {
-#endif
-			header = ALLOC(sizeof(*header));
-			switch_assert(header);
-#ifdef SWITCH_EVENT_RECYCLE
-		}
-#endif
+	header = event_alloc_header();
 
-		memset(header, 0, sizeof(*header));
-		header->name = DUP(header_name);
+	memset(header, 0, offsetof(switch_event_header_t, name_buf));
+	header_set_name(header, header_name);
 
-		return header;
+	return header;
 
 }
 
@@ -965,7 +1793,8 @@ SWITCH_DECLARE(int) switch_event_add_array(switch_event_t *event, const char *va
 	return 0;
 }
 
-static switch_status_t switch_event_base_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, char *data)
+/* data is taken over by the event when owned is set, otherwise it is copied where needed */
+static switch_status_t switch_event_base_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, char *data, switch_bool_t owned)
 {
 	switch_event_header_t *header = NULL;
 	switch_ssize_t hlen = -1;
@@ -1008,7 +1837,8 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 				if (index > -1 && index <= 4000) {
 					if (index < header->idx) {
 						FREE(header->array[index]);
-						header->array[index] = DUP(data);
+						header->array[index] = owned ? data : DUP(data);
+						owned = SWITCH_FALSE;
 					} else {
 						int i;
 						char **m;
@@ -1019,7 +1849,8 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 						for (i = header->idx; i < index; i++) {
 							m[i] = DUP("");
 						}
-						m[index] = DUP(data);
+						m[index] = owned ? data : DUP(data);
+						owned = SWITCH_FALSE;
 						header->idx = index + 1;
 						if (!fly) {
 							exists = 1;
@@ -1045,7 +1876,6 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (zstr(data)) {
 			switch_event_del_header(event, header_name);
-			FREE(data);
 			goto end;
 		}
 
@@ -1055,7 +1885,6 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (!strncmp(data, "ARRAY::", 7)) {
 			switch_event_add_array(event, header_name, data);
-			FREE(data);
 			goto end;
 		}
 
@@ -1072,7 +1901,7 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		if (header->value && !header->idx) {
 			m = malloc(sizeof(char *));
 			switch_assert(m);
-			m[0] = header->value;
+			m[0] = header->value == header->value_buf ? DUP(header->value) : header->value;
 			header->value = NULL;
 			header->array = m;
 			header->idx++;
@@ -1083,6 +1912,11 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		m = realloc(header->array, sizeof(char *) * i);
 		switch_assert(m);
 
+		if (!owned) {
+			data = DUP(data);
+		}
+		owned = SWITCH_FALSE;
+
 		if ((stack & SWITCH_STACK_PUSH)) {
 			m[header->idx] = data;
 		} else if ((stack & SWITCH_STACK_UNSHIFT)) {
@@ -1103,6 +1937,9 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (len) {
 			len += 8;
+			if (header->value == header->value_buf) {
+				header->value = NULL;
+			}
 			hv = realloc(header->value, len);
 			switch_assert(hv);
 			header->value = hv;
@@ -1126,12 +1963,14 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		}
 
 	} else {
-		switch_safe_free(header->value);
-		header->value = data;
+		header_free_value(header);
+		header_set_value(header, data, owned);
+		owned = SWITCH_FALSE;
 	}
 
 	if (!exists) {
 		header->hash = switch_ci_hashfunc_default(header->name, &hlen);
+		event->header_count++;
 
 		if ((stack & SWITCH_STACK_TOP)) {
 			header->next = event->headers;
@@ -1148,10 +1987,16 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 			}
 			event->last_header = header;
 		}
+
+		header_index_add(event, header, (stack & SWITCH_STACK_TOP) ? SWITCH_TRUE : SWITCH_FALSE);
 	}
 
  end:
 
+	if (owned) {
+		FREE(data);
+	}
+
 	switch_safe_free(real_header_name);
 
 	return SWITCH_STATUS_SUCCESS;
@@ -1171,7 +2016,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_add_header(switch_event_t *event, s
 		return SWITCH_STATUS_MEMERR;
 	}
 
-	return switch_event_base_add_header(event, stack, header_name, data);
+	return switch_event_base_add_header(event, stack, header_name, data, SWITCH_TRUE);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_set_subclass_name(switch_event_t *event, const char *subclass_name)
@@ -1189,7 +2034,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_subclass_name(switch_event_t *e
 SWITCH_DECLARE(switch_status_t) switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data)
 {
 	if (data) {
-		return switch_event_base_add_header(event, stack, header_name, (stack & SWITCH_STACK_NODUP) ? (char *)data : DUP(data));
+		return switch_event_base_add_header(event, stack, header_name, (char *) data, (stack & SWITCH_STACK_NODUP) ? SWITCH_TRUE : SWITCH_FALSE);
 	}
 	return SWITCH_STATUS_GENERR;
 }
@@ -1237,43 +2082,12 @@ SWITCH_DECLARE(void) switch_event_destroy(switch_event_t **event)
 		for (hp = ep->headers; hp;) {
 			this = hp;
 			hp = hp->next;
-
-			if (this->idx) {
-				if (!this->array) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "INDEX WITH NO ARRAY WTF?? [%s][%s]\n", this->name, this->value);
-				} else {
-					int i = 0;
-
-					for (i = 0; i < this->idx; i++) {
-						FREE(this->array[i]);
-					}
-					FREE(this->array);
-				}
-			}
-
-			FREE(this->name);
-			FREE(this->value);
-
-
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != SWITCH_STATUS_SUCCESS) {
-				FREE(this);
-			}
-#else
-			FREE(this);
-#endif
-
-
+			header_free(this);
 		}
 		FREE(ep->body);
 		FREE(ep->subclass_name);
-#ifdef SWITCH_EVENT_RECYCLE
-		if (switch_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != SWITCH_STATUS_SUCCESS) {
-			FREE(ep);
-		}
-#else
-		FREE(ep);
-#endif
+		FREE(ep->header_index);
+		event_free_event(ep);
 
 	}
 	*event = NULL;
@@ -1979,7 +2793,12 @@ SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, con
 
 
 
-	if (runtime.events_use_dispatch) {
+	if (EVENT_DISPATCH_SHARD_COUNT) {
+		if (switch_event_queue_shard_event(event) != SWITCH_STATUS_SUCCESS) {
+			switch_event_destroy(event);
+			return SWITCH_STATUS_FALSE;
+		}
+	} else if (runtime.events_use_dispatch) {
 		check_dispatch();
 
 		if (switch_event_queue_dispatch_event(event) != SWITCH_STATUS_SUCCESS) {
@@ -2027,6 +2846,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		event_node->event_id = event;
 		if (subclass_name) {
 			event_node->subclass_name = DUP(subclass_name);
+			event_node->dynamic = !strncasecmp(subclass_name, "file:", 5) || !strncasecmp(subclass_name, "func:", 5);
 		}
 		event_node->callback = callback;
 		event_node->user_data = user_data;
@@ -2036,6 +2856,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		}
 
 		EVENT_NODES[event] = event_node;
+		event_routes_rebuild();
 		switch_mutex_unlock(BLOCK);
 		switch_thread_rwlock_unlock(RWLOCK);
 		/* </LOCKED> ----------------------------------------------- */
@@ -2090,6 +2911,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callba
 			}
 		}
 	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		event_routes_rebuild();
+	}
 	switch_mutex_unlock(BLOCK);
 	switch_thread_rwlock_unlock(RWLOCK);
 	/* </LOCKED> ----------------------------------------------- */
@@ -2130,6 +2955,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 		}
 		lnp = np;
 	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		event_routes_rebuild();
+	}
 	switch_mutex_unlock(BLOCK);
 	switch_thread_rwlock_unlock(RWLOCK);
 	/* </LOCKED> ----------------------------------------------- */
@@ -325,7 +325,7 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 	switch_frame_t silence_frame = { 0 };
 	int16_t silence_data[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
 	const char *silence_var;
-	int silence_val = 0, bypass_media_after_bridge = 0;
+	int silence_val = 0, bypass_media_after_bridge = 0, rtp_relay = 0;
 	const char *bridge_answer_timeout = NULL;
 	int bridge_filter_dtmf, answer_timeout, sent_update = 0;
 	time_t answer_limit = 0;
@@ -445,6 +445,14 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 
 	bridge_filter_dtmf = switch_true(switch_channel_get_variable(chan_a, "bridge_filter_dtmf"));
 
+	/* both legs only pass packets through, let the rtp reactors carry them instead of the two bridge threads.
+	   Once relayed, a proxy media read only returns for what the reactor leaves the session (stun, rtcp, packets
+	   it could not write) or on the poll timeout, so both bridge threads stay parked in their reads below. */
+	if (originator && switch_channel_test_flag(chan_a, CF_PROXY_MEDIA) &&
+		(switch_true(switch_channel_get_variable(chan_a, "rtp_relay")) || switch_true(switch_channel_get_variable(chan_b, "rtp_relay")))) {
+		rtp_relay = switch_core_media_relay_start(session_a, session_b) == SWITCH_STATUS_SUCCESS;
+	}
+
 	for (;;) {
 		switch_channel_state_t b_state;
 		switch_status_t status;
@@ -702,6 +710,10 @@ static void *audio_bridge_thread(switch_thread_t *thread, void *obj)
 
   end_of_bridge_loop:
 
+	if (rtp_relay) {
+		switch_core_media_relay_stop(session_a);
+	}
+
 #ifdef SWITCH_VIDEO_IN_THREADS
 	if (vh.up > 0) {
 		vh.up = -1;
@@ -30,30 +30,42 @@
  */
 #include <switch.h>
 #include <switch_jitterbuffer.h>
-#include "private/switch_hashtable_private.h"
 
 #define PERIOD_LEN 500
 #define MAX_FRAME_PADDING 2
 #define MAX_MISSING_SEQ 20
+#define JB_RING_AUDIO 64
+#define JB_RING_VIDEO 512
+#define JB_RING_MAX 32768
+#define JB_MISSING_SIZE 1024
+#define JB_MISSING_NACKABLE 1
+#define JB_MISSING_NACKED 2
+#define jb_seq_diff(_a, _b) ((int16_t)(uint16_t)((_a) - (_b)))
 #define jb_debug(_jb, _level, _format, ...) if (_jb->debug_level >= _level) switch_log_printf(SWITCH_CHANNEL_SESSION_LOG_CLEAN(_jb->session), SWITCH_LOG_ALERT, "JB:%p:%s lv:%d ln:%d sz:%u/%u/%u c:%u %u/%u/%u/%u %.2f%% ->" _format, (void *) _jb, (jb->type == SJB_AUDIO ? "aud" : "vid"), _level, __LINE__,  _jb->min_frame_len, _jb->max_frame_len, _jb->frame_len, _jb->period_count, _jb->consec_good_count, _jb->period_good_count, _jb->consec_miss_count, _jb->period_miss_count, _jb->period_miss_pct, __VA_ARGS__)
 
-const char *TOKEN_1 = "ONE";
-const char *TOKEN_2 = "TWO";
-
 struct switch_jb_s;
 
 typedef struct switch_jb_node_s {
 	struct switch_jb_s *parent;
 	switch_rtp_packet_t packet;
 	uint32_t len;
+	uint16_t seq;
 	uint8_t visible;
 	uint8_t bad_hits;
-	struct switch_jb_node_s *prev;
 	struct switch_jb_node_s *next;
 } switch_jb_node_t;
 
 struct switch_jb_s {
-	struct switch_jb_node_s *node_list;
+	switch_jb_node_t **ring;
+	uint32_t ring_size;
+	uint16_t ring_low;
+	uint16_t ring_high;
+	switch_jb_node_t *free_nodes;
+	uint16_t *missing_seq;
+	uint8_t *missing_state;
+	uint16_t missing_low;
+	uint16_t missing_high;
+	uint8_t missing_init;
 	uint32_t last_target_seq;
 	uint32_t highest_read_ts;
 	uint32_t highest_read_seq;
@@ -83,8 +95,6 @@ struct switch_jb_s {
 	uint8_t debug_level;
 	uint16_t next_seq;
 	switch_size_t last_len;
-	switch_inthash_t *missing_seq_hash;
-	switch_inthash_t *node_hash;
 	switch_inthash_t *node_hash_ts;
 	switch_mutex_t *mutex;
 	switch_mutex_t *list_mutex;
@@ -98,110 +108,61 @@ struct switch_jb_s {
 
 
 /*
- * https://gist.github.com/ideasman42/5921b0edfc6aa41a9ce0
- *
- * Originally from: http://stackoverflow.com/a/27663998/432509
- *
- * With following modifications:
- * - Use a pointer to the tail (remove 2x conditional checks, reduces code-size).
- * - Avoid re-assigning empty values the size doesn't change.
- * - Corrected comments.
+ * Visible packets live in a power-of-two ring indexed by (seq & (ring_size - 1)).
+ * ring_low and ring_high bound the window of buffered sequence numbers, which never
+ * spans more than ring_size so a slot can only ever hold one of them; the ring doubles
+ * when a packet would stretch the window past that.  Finding a seq, the oldest packet
+ * or the next gap is a slot lookup instead of a walk over every node.
  */
 
-static int node_cmp(const void *l, const void *r)
+static void ring_grow(switch_jb_t *jb, uint32_t span)
 {
-	switch_jb_node_t *a = (switch_jb_node_t *) l;
-	switch_jb_node_t *b = (switch_jb_node_t *) r;
-
-	if (!a->visible && !b->visible) {
-		return 0;
-	}
+	switch_jb_node_t **ring;
+	uint32_t size = jb->ring_size, i;
 
-	if (a->visible != b->visible) {
-		if (a->visible) {
-			return 1;
-		} else {
-			return -1;
-		}
+	while (size < span) {
+		size <<= 1;
 	}
 
-	return a->packet.header.seq - b->packet.header.seq;
-}
-
-static switch_jb_node_t *sort_nodes(switch_jb_node_t *head, int (*cmp)(const void *, const void *))
-{
-	int block_size = 1, block_count;
-
-	do {
-		/* Maintain two lists pointing to two blocks, 'l' and 'r' */
-		switch_jb_node_t *l = head, *r = head, **tail_p;
-		
-		head = NULL; /* Start a new list */
-		tail_p = &head;
-
-		block_count = 0;
-
-		/* Walk through entire list in blocks of 'block_size'*/
-		while (l != NULL) {
-			/* Move 'r' to start of next block, measure size of 'l' list while doing so */
-			int l_size, r_size = block_size;
-			int l_empty, r_empty;
-
-			block_count++;
-			for (l_size = 0; (l_size < block_size) && (r != NULL); l_size++) {
-				r = r->next;
-			}
-
-			/* Merge two list until their individual ends */
-			l_empty = (l_size == 0);
-			r_empty = (r_size == 0 || r == NULL);
-			while (!l_empty || !r_empty) {
-				switch_jb_node_t *s;
-				/* Using <= instead of < gives us sort stability */
-				if (r_empty || (!l_empty && cmp(l, r) <= 0)) {
-					s = l;
-					l = l->next;
-					l_size--;
-					l_empty = (l_size == 0);
-				} else {
-					s = r;
-					r = r->next;
-					r_size--;
-					r_empty = (r_size == 0) || (r == NULL);
-				}
+	ring = switch_core_alloc(jb->pool, size * sizeof(*ring));
 
-				/* Update new list */
-				(*tail_p) = s;
-				tail_p = &(s->next);
-			}
+	for (i = 0; i < jb->ring_size; i++) {
+		switch_jb_node_t *np = jb->ring[i];
 
-			/* 'r' now points to next block for 'l' */
-			l = r;
+		if (np) {
+			ring[np->seq & (size - 1)] = np;
 		}
+	}
 
-		/* terminate new list, take care of case when input list is NULL */
-		*tail_p = NULL;
+	jb_debug(jb, 2, "Grow ring from %u to %u\n", jb->ring_size, size);
 
-		/* Lg n iterations */
-		block_size <<= 1;
+	jb->ring = ring;
+	jb->ring_size = size;
+}
 
-	} while (block_count > 1);
+static inline void ring_trim(switch_jb_t *jb)
+{
+	uint32_t mask = jb->ring_size - 1;
 
-	if (head) {
-		switch_jb_node_t *np, *last = NULL;
+	if (!jb->visible_nodes) {
+		return;
+	}
 
-		head->prev = NULL;
+	while (!jb->ring[jb->ring_low & mask]) {
+		jb->ring_low++;
+	}
 
-		for (np = head; np ; np = np->next) {
-			if (last) {
-				np->prev = last;
-			}
-			last = np;
-		}
+	while (!jb->ring[jb->ring_high & mask]) {
+		jb->ring_high--;
 	}
-				 
+}
 
-	return head;
+static inline switch_jb_node_t *ring_find(switch_jb_t *jb, uint16_t seq)
+{
+	uint16_t s = ntohs(seq);
+	switch_jb_node_t *np = jb->ring[s & (jb->ring_size - 1)];
+
+	return (np && np->seq == s) ? np : NULL;
 }
 
 static inline switch_jb_node_t *new_node(switch_jb_t *jb)
@@ -210,28 +171,15 @@ static inline switch_jb_node_t *new_node(switch_jb_t *jb)
 
 	switch_mutex_lock(jb->list_mutex);
 
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) {
-			break;
-		}
-	}
-
-	if (!np) {
-		
+	if ((np = jb->free_nodes)) {
+		jb->free_nodes = np->next;
+	} else {
 		np = switch_core_alloc(jb->pool, sizeof(*np));
-		
-		np->next = jb->node_list;
-		if (np->next) {
-			np->next->prev = np;
-		}
-		jb->node_list = np;
-		
 	}
 
 	switch_assert(np);
+	np->next = NULL;
 	np->bad_hits = 0;
-	np->visible = 1;
-	jb->visible_nodes++;
 	np->parent = jb;
 
 	switch_mutex_unlock(jb->list_mutex);
@@ -239,128 +187,197 @@ static inline switch_jb_node_t *new_node(switch_jb_t *jb)
 	return np;
 }
 
-static inline void push_to_top(switch_jb_t *jb, switch_jb_node_t *node)
-{
-	if (node == jb->node_list) {
-		jb->node_list = node->next;
-	} else if (node->prev) {
-		node->prev->next = node->next;
-	}
-			
-	if (node->next) {
-		node->next->prev = node->prev;
-	}
-
-	node->next = jb->node_list;
-	node->prev = NULL;
-
-	if (node->next) {
-		node->next->prev = node;
-	}
-
-	jb->node_list = node;
-
-	switch_assert(node->next != node);
-	switch_assert(node->prev != node);
-}
-
-static inline void hide_node(switch_jb_node_t *node, switch_bool_t pop)
+static inline void hide_node(switch_jb_node_t *node)
 {
 	switch_jb_t *jb = node->parent;
 
 	switch_mutex_lock(jb->list_mutex);
 
 	if (node->visible) {
+		uint32_t slot = node->seq & (jb->ring_size - 1);
+
+		if (jb->ring[slot] == node) {
+			jb->ring[slot] = NULL;
+		}
+
 		node->visible = 0;
 		node->bad_hits = 0;
 		jb->visible_nodes--;
 
-		if (pop) {
-			push_to_top(jb, node);
-		}
-	}
+		node->next = jb->free_nodes;
+		jb->free_nodes = node;
 
-	if (jb->node_hash_ts) {
-		switch_core_inthash_delete(jb->node_hash_ts, node->packet.header.ts);
+		if (jb->node_hash_ts) {
+			switch_core_inthash_delete(jb->node_hash_ts, node->packet.header.ts);
+		}
 	}
 
-	switch_core_inthash_delete(jb->node_hash, node->packet.header.seq);
-
 	switch_mutex_unlock(jb->list_mutex);
 }
 
-static inline void sort_free_nodes(switch_jb_t *jb)
+static inline void show_node(switch_jb_t *jb, switch_jb_node_t *node)
 {
-	switch_jb_node_t *np, *this_np;
-	int start = 0;
+	switch_jb_node_t *old;
+	uint16_t s = node->seq;
 
 	switch_mutex_lock(jb->list_mutex);
-	np = jb->node_list;
 
-	while(np) {
-		this_np = np;
-		np = np->next;
+	if ((old = jb->ring[s & (jb->ring_size - 1)]) && old->seq == s) {
+		jb_debug(jb, 2, "Replace duplicate seq: %u\n", s);
+		hide_node(old);
+	}
+
+	if (!jb->visible_nodes) {
+		jb->ring_low = jb->ring_high = s;
+	} else {
+		uint16_t low = jb->ring_low, high = jb->ring_high;
+		uint32_t span;
+
+		if (jb_seq_diff(s, low) < 0) low = s;
+		if (jb_seq_diff(s, high) > 0) high = s;
+		span = (uint16_t)(high - low) + 1;
+
+		if (span > jb->ring_size) {
+			ring_trim(jb);
+			low = jb->ring_low;
+			high = jb->ring_high;
+			if (jb_seq_diff(s, low) < 0) low = s;
+			if (jb_seq_diff(s, high) > 0) high = s;
+			span = (uint16_t)(high - low) + 1;
+		}
+
+		if (span > JB_RING_MAX) {
+			uint16_t x;
+
+			jb_debug(jb, 2, "seq: %u is out of the window %u-%u, flushing\n", s, jb->ring_low, jb->ring_high);
 
-		if (this_np->visible) {
-			start++;
+			for (x = jb->ring_low; jb->visible_nodes; x++) {
+				if ((old = jb->ring[x & (jb->ring_size - 1)])) {
+					hide_node(old);
+				}
+			}
+
+			low = high = s;
+		} else if (span > jb->ring_size) {
+			ring_grow(jb, span);
 		}
 
-		if (start && !this_np->visible) {
-			push_to_top(jb, this_np);
-		}		
+		jb->ring_low = low;
+		jb->ring_high = high;
 	}
 
+	jb->ring[s & (jb->ring_size - 1)] = node;
+	node->visible = 1;
+	jb->visible_nodes++;
+
 	switch_mutex_unlock(jb->list_mutex);
 }
 
 static inline void hide_nodes(switch_jb_t *jb)
 {
 	switch_jb_node_t *np;
+	uint16_t x;
 
 	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		hide_node(np, SWITCH_FALSE);
+	for (x = jb->ring_low; jb->visible_nodes; x++) {
+		if ((np = jb->ring[x & (jb->ring_size - 1)])) {
+			hide_node(np);
+		}
 	}
 	switch_mutex_unlock(jb->list_mutex);
 }
 
-static inline void drop_ts(switch_jb_t *jb, uint32_t ts)
+/* Missing seqs waiting to be NACKed live in a fixed ring of their own; missing_low only ever
+   moves forward past entries that were already sent or filled, so popping the next NACK does
+   not rescan them. */
+
+static inline void mark_missing(switch_jb_t *jb, uint16_t seq)
+{
+	uint32_t slot = seq & (JB_MISSING_SIZE - 1);
+
+	jb->missing_seq[slot] = seq;
+	jb->missing_state[slot] = JB_MISSING_NACKABLE;
+
+	if (!jb->missing_init) {
+		jb->missing_low = jb->missing_high = seq;
+		jb->missing_init = 1;
+		return;
+	}
+
+	if (jb_seq_diff(seq, jb->missing_low) < 0) {
+		jb->missing_low = seq;
+	}
+
+	if (jb_seq_diff(seq, jb->missing_high) > 0) {
+		jb->missing_high = seq;
+	}
+
+	if ((uint16_t)(jb->missing_high - jb->missing_low) >= JB_MISSING_SIZE) {
+		jb->missing_low = jb->missing_high - JB_MISSING_SIZE + 1;
+	}
+}
+
+static inline uint8_t find_missing(switch_jb_t *jb, uint16_t seq)
+{
+	uint32_t slot = seq & (JB_MISSING_SIZE - 1);
+
+	return jb->missing_seq[slot] == seq ? jb->missing_state[slot] : 0;
+}
+
+static inline void clear_missing(switch_jb_t *jb, uint16_t seq)
+{
+	uint32_t slot = seq & (JB_MISSING_SIZE - 1);
+
+	if (jb->missing_seq[slot] == seq) {
+		jb->missing_state[slot] = 0;
+	}
+}
+
+static inline void drop_frame(switch_jb_t *jb, switch_jb_node_t *node)
 {
 	switch_jb_node_t *np;
-	int x = 0;
+	uint32_t ts = node->packet.header.ts, mask;
+	uint16_t first, last, x;
+	int dropped = 0;
 
 	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
 
-		if (ts == np->packet.header.ts) {
-			hide_node(np, SWITCH_FALSE);
-			x++;
-		}
+	/* a frame is a run of consecutive seqs, so only walk out from node until another ts shows up */
+	mask = jb->ring_size - 1;
+	first = last = node->seq;
+
+	while (first != jb->ring_low) {
+		if ((np = jb->ring[(uint16_t)(first - 1) & mask]) && np->packet.header.ts != ts) break;
+		first--;
 	}
 
-	if (x) {
-		sort_free_nodes(jb);
+	while (last != jb->ring_high) {
+		if ((np = jb->ring[(uint16_t)(last + 1) & mask]) && np->packet.header.ts != ts) break;
+		last++;
+	}
+
+	for (x = first; ; x++) {
+		if ((np = jb->ring[x & mask]) && np->packet.header.ts == ts) {
+			hide_node(np);
+			dropped++;
+		}
+
+		if (x == last) break;
 	}
 
 	switch_mutex_unlock(jb->list_mutex);
 	
-	if (x) jb->complete_frames--;
+	if (dropped) jb->complete_frames--;
 }
 
-static inline switch_jb_node_t *jb_find_lowest_seq(switch_jb_t *jb, uint32_t ts)
+static inline switch_jb_node_t *jb_find_lowest_seq(switch_jb_t *jb)
 {
-	switch_jb_node_t *np, *lowest = NULL;
+	switch_jb_node_t *lowest = NULL;
 	
 	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
-
-		if (ts && ts != np->packet.header.ts) continue;
-
-		if (!lowest || ntohs(lowest->packet.header.seq) > ntohs(np->packet.header.seq)) {
-			lowest = np;
-		}
+	if (jb->visible_nodes) {
+		ring_trim(jb);
+		lowest = jb->ring[jb->ring_low & (jb->ring_size - 1)];
 	}
 	switch_mutex_unlock(jb->list_mutex);
 
@@ -370,25 +387,28 @@ static inline switch_jb_node_t *jb_find_lowest_seq(switch_jb_t *jb, uint32_t ts)
 static inline switch_jb_node_t *jb_find_lowest_node(switch_jb_t *jb)
 {
 	switch_jb_node_t *np, *lowest = NULL;
+	uint16_t x;
+
+	if (!jb->samples_per_frame) {
+		return jb_find_lowest_seq(jb);
+	}
 
+	/* in ts mode the timestamps are authoritative so look at every packet in the window */
 	switch_mutex_lock(jb->list_mutex);
-	for (np = jb->node_list; np; np = np->next) {
-		if (!np->visible) continue;
+	if (jb->visible_nodes) {
+		ring_trim(jb);
+
+		for (x = jb->ring_low; ; x++) {
+			if ((np = jb->ring[x & (jb->ring_size - 1)]) && (!lowest || ntohl(lowest->packet.header.ts) > ntohl(np->packet.header.ts))) {
+				lowest = np;
+			}
 
-		if (!lowest || ntohl(lowest->packet.header.ts) > ntohl(np->packet.header.ts)) {
-			lowest = np;
+			if (x == jb->ring_high) break;
 		}
 	}
 	switch_mutex_unlock(jb->list_mutex);
 
-	return lowest ? lowest : NULL;
-}
-
-static inline uint32_t jb_find_lowest_ts(switch_jb_t *jb)
-{
-	switch_jb_node_t *lowest = jb_find_lowest_node(jb);
-
-	return lowest ? lowest->packet.header.ts : 0;
+	return lowest;
 }
 
 static inline void jb_hit(switch_jb_t *jb)
@@ -468,37 +488,37 @@ static inline void jb_miss(switch_jb_t *jb)
 
 static inline int verify_oldest_frame(switch_jb_t *jb)
 {
-	switch_jb_node_t *lowest = jb_find_lowest_node(jb), *np = NULL;
+	switch_jb_node_t *lowest, *prev, *np = NULL;
+	uint16_t x;
 	int r = 0;
 
-	if (!lowest || !(lowest = jb_find_lowest_seq(jb, lowest->packet.header.ts))) {
-		goto end;
-	}
-	
 	switch_mutex_lock(jb->mutex);
+	switch_mutex_lock(jb->list_mutex);
 
-	jb->node_list = sort_nodes(jb->node_list, node_cmp);
+	if (!(lowest = jb_find_lowest_seq(jb))) {
+		goto end;
+	}
 
-	for (np = lowest->next; np; np = np->next) {
-			
-		if (!np->visible) continue;
-			
-		if (ntohs(np->packet.header.seq) != ntohs(np->prev->packet.header.seq) + 1) {
-			switch_core_inthash_insert(jb->missing_seq_hash, (uint32_t)htons(ntohs(np->prev->packet.header.seq) + 1), (void *) TOKEN_1);
+	/* walk forward from the oldest packet until a gap or the first frame that ends on a marker */
+	for (prev = lowest, x = lowest->seq + 1; jb_seq_diff(x, jb->ring_high) <= 0; prev = np, x++) {
+		if (!(np = jb->ring[x & (jb->ring_size - 1)])) {
+			mark_missing(jb, x);
 			break;
 		}
-				
-		if (np->packet.header.ts != lowest->packet.header.ts || !np->next) {
-			if (np->prev->packet.header.m) {
+
+		if (np->packet.header.ts != lowest->packet.header.ts || x == jb->ring_high) {
+			if (prev->packet.header.m) {
 				r = 1;
+				break;
 			}
 		}
 	}
-	
-	switch_mutex_unlock(jb->mutex);
 
  end:
 
+	switch_mutex_unlock(jb->list_mutex);
+	switch_mutex_unlock(jb->mutex);
+
 	if (!r && jb->session) {
 		switch_core_session_request_video_refresh(jb->session);
 	}
@@ -508,9 +528,15 @@ static inline int verify_oldest_frame(switch_jb_t *jb)
 
 static inline void drop_oldest_frame(switch_jb_t *jb)
 {
-	uint32_t ts = jb_find_lowest_ts(jb);
+	switch_jb_node_t *lowest = jb_find_lowest_node(jb);
+	uint32_t ts;
 
-	drop_ts(jb, ts);
+	if (!lowest) {
+		return;
+	}
+
+	ts = lowest->packet.header.ts;
+	drop_frame(jb, lowest);
 	jb_debug(jb, 1, "Dropping oldest frame ts:%u\n", ntohl(ts));
 }
 
@@ -520,9 +546,10 @@ static inline void add_node(switch_jb_t *jb, switch_rtp_packet_t *packet, switch
 
 	node->packet = *packet;
 	node->len = len;
+	node->seq = ntohs(packet->header.seq);
 	memcpy(node->packet.body, packet->body, len);
 
-	switch_core_inthash_insert(jb->node_hash, node->packet.header.seq, node);
+	show_node(jb, node);
 
 	if (jb->node_hash_ts) {
 		switch_core_inthash_insert(jb->node_hash_ts, node->packet.header.ts, node);
@@ -623,13 +650,13 @@ static inline switch_status_t jb_next_packet_by_seq(switch_jb_t *jb, switch_jb_n
 	}
 
 	if (!jb->target_seq) {
-		if ((node = jb_find_lowest_seq(jb, 0))) {
+		if ((node = jb_find_lowest_seq(jb))) {
 			jb_debug(jb, 2, "No target seq using seq: %u as a starting point\n", ntohs(node->packet.header.seq));
 		} else {
 			jb_debug(jb, 1, "%s", "No nodes available....\n");
 		}
 		jb_hit(jb);
-	} else if ((node = switch_core_inthash_find(jb->node_hash, jb->target_seq))) {
+	} else if ((node = ring_find(jb, jb->target_seq))) {
 		jb_debug(jb, 2, "FOUND desired seq: %u\n", ntohs(jb->target_seq));
 		jb_hit(jb);
 	} else {
@@ -645,13 +672,13 @@ static inline switch_status_t jb_next_packet_by_seq(switch_jb_t *jb, switch_jb_n
 			
 			for (x = 0; x < 10; x++) {
 				increment_seq(jb);
-				if ((node = switch_core_inthash_find(jb->node_hash, jb->target_seq))) {
+				if ((node = ring_find(jb, jb->target_seq))) {
 					jb_debug(jb, 2, "FOUND incremental seq: %u\n", ntohs(jb->target_seq));
 
 					if (node->packet.header.m ||  node->packet.header.ts == jb->highest_read_ts) {
 						jb_debug(jb, 2, "%s", "SAME FRAME DROPPING\n");
 						jb->dropped++;
-						drop_ts(jb, node->packet.header.ts);
+						drop_frame(jb, node);
 						node = NULL;
 						goto top;
 					}
@@ -718,13 +745,6 @@ static inline switch_status_t jb_next_packet(switch_jb_t *jb, switch_jb_node_t *
 	}
 }
 
-static inline void free_nodes(switch_jb_t *jb)
-{
-	switch_mutex_lock(jb->list_mutex);
-	jb->node_list = NULL;
-	switch_mutex_unlock(jb->list_mutex);
-}
-
 SWITCH_DECLARE(void) switch_jb_ts_mode(switch_jb_t *jb, uint32_t samples_per_frame, uint32_t samples_per_second)
 {
 	jb->samples_per_frame = samples_per_frame;
@@ -768,8 +788,8 @@ SWITCH_DECLARE(void) switch_jb_reset(switch_jb_t *jb)
 
 	if (jb->type == SJB_VIDEO) {
 		switch_mutex_lock(jb->mutex);
-		switch_core_inthash_destroy(&jb->missing_seq_hash);
-		switch_core_inthash_init(&jb->missing_seq_hash);
+		memset(jb->missing_state, 0, JB_MISSING_SIZE);
+		jb->missing_init = 0;
 		switch_mutex_unlock(jb->mutex);
 	}
 
@@ -808,7 +828,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_peek_frame(switch_jb_t *jb, uint32_t t
 
 	if (seq) {
 		uint16_t want_seq = seq + peek;
-		node = switch_core_inthash_find(jb->node_hash, want_seq);
+		node = ring_find(jb, want_seq);
 	} else if (ts && jb->samples_per_frame) {
 		uint32_t want_ts = ts + (peek * jb->samples_per_frame);	
 		node = switch_core_inthash_find(jb->node_hash_ts, want_ts);
@@ -893,9 +913,11 @@ SWITCH_DECLARE(switch_status_t) switch_jb_create(switch_jb_t **jbp, switch_jb_ty
 	jb->highest_frame_len = jb->frame_len;
 
 	if (jb->type == SJB_VIDEO) {
-		switch_core_inthash_init(&jb->missing_seq_hash);
+		jb->missing_seq = switch_core_alloc(pool, JB_MISSING_SIZE * sizeof(*jb->missing_seq));
+		jb->missing_state = switch_core_alloc(pool, JB_MISSING_SIZE);
 	}
-	switch_core_inthash_init(&jb->node_hash);
+	jb->ring_size = jb->type == SJB_VIDEO ? JB_RING_VIDEO : JB_RING_AUDIO;
+	jb->ring = switch_core_alloc(pool, jb->ring_size * sizeof(*jb->ring));
 	switch_mutex_init(&jb->mutex, SWITCH_MUTEX_NESTED, pool);
 	switch_mutex_init(&jb->list_mutex, SWITCH_MUTEX_NESTED, pool);
 
@@ -909,17 +931,10 @@ SWITCH_DECLARE(switch_status_t) switch_jb_destroy(switch_jb_t **jbp)
 	switch_jb_t *jb = *jbp;
 	*jbp = NULL;
 	
-	if (jb->type == SJB_VIDEO) {
-		switch_core_inthash_destroy(&jb->missing_seq_hash);
-	}
-	switch_core_inthash_destroy(&jb->node_hash);
-
 	if (jb->node_hash_ts) {
 		switch_core_inthash_destroy(&jb->node_hash_ts);
 	}
 
-	free_nodes(jb);
-
 	if (jb->free_pool) {
 		switch_core_destroy_memory_pool(&jb->pool);
 	}
@@ -929,14 +944,10 @@ SWITCH_DECLARE(switch_status_t) switch_jb_destroy(switch_jb_t **jbp)
 
 SWITCH_DECLARE(uint32_t) switch_jb_pop_nack(switch_jb_t *jb)
 {
-	switch_hash_index_t *hi = NULL;
 	uint32_t nack = 0;
 	uint16_t blp = 0;
 	uint16_t least = 0;
-	int i = 0;
-	
-	void *val;
-	const void *var;
+	int i = 0, found = 0;
 
 	if (jb->type != SJB_VIDEO) {
 		return 0;
@@ -944,35 +955,32 @@ SWITCH_DECLARE(uint32_t) switch_jb_pop_nack(switch_jb_t *jb)
 
 	switch_mutex_lock(jb->mutex);
 
-
-	for (hi = switch_core_hash_first(jb->missing_seq_hash); hi; hi = switch_core_hash_next(&hi)) {
-		uint16_t seq;
-		const char *token;
-
-		switch_core_hash_this(hi, &var, NULL, &val);
-		token = (const char *) val;
-
-		if (token == TOKEN_2) {
-			//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SKIP %u %s\n", ntohs(*((uint16_t *) var)), token);
-			continue;
+	while (jb->missing_init) {
+		if (find_missing(jb, jb->missing_low) == JB_MISSING_NACKABLE) {
+			least = jb->missing_low;
+			found = 1;
+			break;
 		}
-		seq = ntohs(*((uint16_t *) var));
 
-		if (!least || seq < least) {
-			least = seq;
+		if (jb->missing_low == jb->missing_high) {
+			break;
 		}
+
+		jb->missing_low++;
 	}
 
-	if (least && switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(least))) {
+	if (found) {
 		jb_debug(jb, 3, "Found smallest NACKABLE seq %u\n", least);
 		nack = (uint32_t) htons(least);
 
-		switch_core_inthash_insert(jb->missing_seq_hash, nack, (void *) TOKEN_2);
+		jb->missing_state[least & (JB_MISSING_SIZE - 1)] = JB_MISSING_NACKED;
 
 		for(i = 0; i < 16; i++) {
-			if (switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(least + i + 1))) {
-				switch_core_inthash_insert(jb->missing_seq_hash, (uint32_t)htons(least + i + 1), (void *) TOKEN_2);
-				jb_debug(jb, 3, "Found addtl NACKABLE seq %u\n", least + i + 1);
+			uint16_t seq = least + i + 1;
+
+			if (find_missing(jb, seq)) {
+				jb->missing_state[seq & (JB_MISSING_SIZE - 1)] = JB_MISSING_NACKED;
+				jb_debug(jb, 3, "Found addtl NACKABLE seq %u\n", seq);
 				blp |= (1 << i);
 			}
 		}
@@ -1010,15 +1018,16 @@ SWITCH_DECLARE(switch_status_t) switch_jb_put_packet(switch_jb_t *jb, switch_rtp
 		jb->next_seq = htons(got + 1);
 	} else {
 
-		switch_core_inthash_delete(jb->missing_seq_hash, (uint32_t)htons(got));
+		clear_missing(jb, got);
 
 		if (!missing || want == got) {
 			if (got > want) {
 				//jb_debug(jb, 2, "GOT %u WANTED %u; MARK SEQS MISSING %u - %u\n", got, want, want, got - 1);
 				//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "XXXXXXXXXXXXXXXXXX   WTF GOT %u WANTED %u; MARK SEQS MISSING %u - %u\n", got, want, want, got - 1);
-				for (i = want; i < got; i++) {
+				/* anything older than the missing ring can hold is past saving anyway */
+				for (i = (got - want > JB_MISSING_SIZE) ? got - JB_MISSING_SIZE : want; i < got; i++) {
 					//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "MISSING %u\n", i);
-					switch_core_inthash_insert(jb->missing_seq_hash, (uint32_t)htons(i), (void *)TOKEN_1);
+					mark_missing(jb, (uint16_t) i);
 				}
 			
 			}
@@ -1044,7 +1053,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_get_packet_by_seq(switch_jb_t *jb, uin
 	switch_status_t status = SWITCH_STATUS_NOTFOUND;
 
 	switch_mutex_lock(jb->mutex);
-	if ((node = switch_core_inthash_find(jb->node_hash, seq))) {
+	if ((node = ring_find(jb, seq))) {
 		jb_debug(jb, 2, "Found buffered seq: %u\n", ntohs(seq));
 		*packet = node->packet;
 		*len = node->len;
@@ -1151,7 +1160,7 @@ SWITCH_DECLARE(switch_status_t) switch_jb_get_packet(switch_jb_t *jb, switch_rtp
 		*len = node->len;
 		jb->last_len = *len;
 		memcpy(packet->body, node->packet.body, node->len);
-		hide_node(node, SWITCH_TRUE);
+		hide_node(node);
 
 		jb_debug(jb, 1, "GET packet ts:%u seq:%u %s\n", ntohl(packet->header.ts), ntohs(packet->header.seq), packet->header.m ? " <MARK>" : "");
 
@@ -33,6 +33,282 @@
 #include <switch.h>
 #include <pcre.h>
 
+#define REGEX_CACHE_SIZE_DEFAULT 1024
+#define REGEX_CACHE_KEY_LEN 512
+
+#ifdef PCRE_CONFIG_JIT
+#define REGEX_STUDY_FLAGS PCRE_STUDY_JIT_COMPILE
+#define regex_free_study(_extra) pcre_free_study(_extra)
+#else
+#define REGEX_STUDY_FLAGS 0
+#define regex_free_study(_extra) pcre_free(_extra)
+#endif
+
+/*! \brief A compiled and studied expression, shared by every caller matching against it */
+typedef struct regex_cache_entry {
+	/*! options and expression, NULL when the entry is not in the cache */
+	char *key;
+	pcre *re;
+	pcre_extra *extra;
+	/*! size of the compiled pattern, for handing out private copies */
+	size_t size;
+	uint32_t refs;
+	uint8_t evicted;
+	struct regex_cache_entry *prev;
+	struct regex_cache_entry *next;
+} regex_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	/*! most recently used at the head, the tail is evicted first */
+	regex_cache_entry_t *head;
+	regex_cache_entry_t *tail;
+	uint32_t count;
+	uint32_t size;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+} regex_cache = { NULL, NULL, NULL, NULL, 0, REGEX_CACHE_SIZE_DEFAULT };
+
+static void regex_entry_free(regex_cache_entry_t *entry)
+{
+	if (entry->extra) {
+		regex_free_study(entry->extra);
+	}
+	pcre_free(entry->re);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+static regex_cache_entry_t *regex_entry_compile(const char *expression, uint32_t flags)
+{
+	regex_cache_entry_t *entry;
+	const char *error = NULL;
+	int erroffset = 0;
+	pcre *re;
+
+	re = pcre_compile(expression,	/* the pattern */
+					  flags,	/* default options */
+					  &error,	/* for error message */
+					  &erroffset,	/* for error offset */
+					  NULL);	/* use default character tables */
+	if (error) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "COMPILE ERROR: %d [%s][%s]\n", erroffset, error, expression);
+		switch_regex_safe_free(re);
+		return NULL;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->re = re;
+	entry->refs = 1;
+
+	pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &entry->size);
+
+	/* studying costs more than compiling, only do it for expressions we are going to keep */
+	if (regex_cache.size) {
+		entry->extra = pcre_study(re, REGEX_STUDY_FLAGS, &error);
+	}
+
+	return entry;
+}
+
+static void regex_cache_unlink(regex_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		regex_cache.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		regex_cache.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void regex_cache_link(regex_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = regex_cache.head;
+
+	if (regex_cache.head) {
+		regex_cache.head->prev = entry;
+	} else {
+		regex_cache.tail = entry;
+	}
+
+	regex_cache.head = entry;
+}
+
+/* must be called with the cache locked */
+static void regex_cache_drop(regex_cache_entry_t *entry)
+{
+	regex_cache_unlink(entry);
+	switch_core_hash_delete(regex_cache.hash, entry->key);
+	regex_cache.count--;
+
+	/* an entry still in use by a matching thread is freed by its last release */
+	if (entry->refs) {
+		entry->evicted = 1;
+	} else {
+		regex_entry_free(entry);
+	}
+}
+
+static regex_cache_entry_t *regex_cache_acquire(const char *expression, uint32_t flags)
+{
+	regex_cache_entry_t *entry, *found;
+	char key[REGEX_CACHE_KEY_LEN];
+
+	if (!regex_cache.mutex || !regex_cache.size || strlen(expression) > sizeof(key) - 16) {
+		return regex_entry_compile(expression, flags);
+	}
+
+	switch_snprintf(key, sizeof(key), "%x/%s", flags, expression);
+
+	switch_mutex_lock(regex_cache.mutex);
+	if ((entry = switch_core_hash_find(regex_cache.hash, key))) {
+		regex_cache_unlink(entry);
+		regex_cache_link(entry);
+		entry->refs++;
+		regex_cache.hits++;
+	} else {
+		regex_cache.misses++;
+	}
+	switch_mutex_unlock(regex_cache.mutex);
+
+	if (entry) {
+		return entry;
+	}
+
+	if (!(entry = regex_entry_compile(expression, flags))) {
+		return NULL;
+	}
+
+	switch_mutex_lock(regex_cache.mutex);
+	if ((found = switch_core_hash_find(regex_cache.hash, key))) {
+		/* another thread compiled it while we were */
+		regex_cache_unlink(found);
+		regex_cache_link(found);
+		found->refs++;
+		switch_mutex_unlock(regex_cache.mutex);
+		regex_entry_free(entry);
+		return found;
+	}
+
+	entry->key = strdup(key);
+	switch_core_hash_insert(regex_cache.hash, entry->key, entry);
+	regex_cache_link(entry);
+	regex_cache.count++;
+
+	while (regex_cache.count > regex_cache.size && regex_cache.tail != entry) {
+		regex_cache_drop(regex_cache.tail);
+		regex_cache.evictions++;
+	}
+	switch_mutex_unlock(regex_cache.mutex);
+
+	return entry;
+}
+
+static void regex_cache_release(regex_cache_entry_t *entry)
+{
+	if (!entry->key) {
+		regex_entry_free(entry);
+		return;
+	}
+
+	switch_mutex_lock(regex_cache.mutex);
+	if (!--entry->refs && entry->evicted) {
+		regex_entry_free(entry);
+	}
+	switch_mutex_unlock(regex_cache.mutex);
+}
+
+static int regex_entry_exec(regex_cache_entry_t *entry, const char *subject, int options, int *ovector, int olen)
+{
+	int match_count = pcre_exec(entry->re, entry->extra, subject, (int) strlen(subject), 0, options, ovector, olen);
+
+#ifdef PCRE_ERROR_JIT_STACKLIMIT
+	if (match_count == PCRE_ERROR_JIT_STACKLIMIT) {
+		/* the jit stack was too small for this subject, let the interpreter have a go */
+		match_count = pcre_exec(entry->re, NULL, subject, (int) strlen(subject), 0, options, ovector, olen);
+	}
+#endif
+
+	return match_count;
+}
+
+SWITCH_DECLARE(void) switch_regex_init(switch_memory_pool_t *pool)
+{
+	switch_mutex_init(&regex_cache.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&regex_cache.hash);
+}
+
+SWITCH_DECLARE(void) switch_regex_shutdown(void)
+{
+	if (!regex_cache.mutex) {
+		return;
+	}
+
+	switch_regex_cache_flush();
+	switch_core_hash_destroy(&regex_cache.hash);
+	regex_cache.mutex = NULL;
+}
+
+SWITCH_DECLARE(uint32_t) switch_regex_cache_set_size(uint32_t size)
+{
+	uint32_t old = regex_cache.size;
+
+	if (!regex_cache.mutex) {
+		regex_cache.size = size;
+		return old;
+	}
+
+	switch_mutex_lock(regex_cache.mutex);
+	regex_cache.size = size;
+	while (regex_cache.count > regex_cache.size) {
+		regex_cache_drop(regex_cache.tail);
+		regex_cache.evictions++;
+	}
+	switch_mutex_unlock(regex_cache.mutex);
+
+	return old;
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_flush(void)
+{
+	if (!regex_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(regex_cache.mutex);
+	while (regex_cache.tail) {
+		regex_cache_drop(regex_cache.tail);
+	}
+	switch_mutex_unlock(regex_cache.mutex);
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_get_stats(switch_regex_cache_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!regex_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(regex_cache.mutex);
+	stats->entries = regex_cache.count;
+	stats->size = regex_cache.size;
+	stats->hits = regex_cache.hits;
+	stats->misses = regex_cache.misses;
+	stats->evictions = regex_cache.evictions;
+	switch_mutex_unlock(regex_cache.mutex);
+}
+
 SWITCH_DECLARE(switch_regex_t *) switch_regex_compile(const char *pattern,
 													  int options, const char **errorptr, int *erroroffset, const unsigned char *tables)
 {
@@ -54,8 +330,7 @@ SWITCH_DECLARE(void) switch_regex_free(void *data)
 
 SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen)
 {
-	const char *error = NULL;
-	int erroffset = 0;
+	regex_cache_entry_t *entry = NULL;
 	pcre *re = NULL;
 	int match_count = 0;
 	char *tmp = NULL;
@@ -95,32 +370,23 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 		}
 	}
 
-	re = pcre_compile(expression,	/* the pattern */
-					  flags,	/* default options */
-					  &error,	/* for error message */
-					  &erroffset,	/* for error offset */
-					  NULL);	/* use default character tables */
-	if (error) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "COMPILE ERROR: %d [%s][%s]\n", erroffset, error, expression);
-		switch_regex_safe_free(re);
+	if (!(entry = regex_cache_acquire(expression, flags))) {
 		goto end;
 	}
 
-	match_count = pcre_exec(re,	/* result of pcre_compile() */
-							NULL,	/* we didn't study the pattern */
-							field,	/* the subject string */
-							(int) strlen(field),	/* the length of the subject string */
-							0,	/* start at offset 0 in the subject */
-							0,	/* default options */
-							ovector,	/* vector of integers for substring information */
-							olen);	/* number of elements (NOT size in bytes) */
-
+	match_count = regex_entry_exec(entry, field, 0, ovector, olen);
 
-	if (match_count <= 0) {
-		switch_regex_safe_free(re);
+	if (match_count > 0) {
+		/* the caller owns and frees what we return, so hand out a copy of the shared pattern */
+		if ((re = pcre_malloc(entry->size))) {
+			memcpy(re, entry->re, entry->size);
+		}
+	} else {
 		match_count = 0;
 	}
 
+	regex_cache_release(entry);
+
 	*new_re = (switch_regex_t *) re;
 
   end:
@@ -209,9 +475,7 @@ SWITCH_DECLARE(void) switch_capture_regex(switch_regex_t *re, int match_count, c
 
 SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, const char *expression, int *partial)
 {
-	const char *error = NULL;	/* Used to hold any errors                                           */
-	int error_offset = 0;		/* Holds the offset of an error                                      */
-	pcre *pcre_prepared = NULL;	/* Holds the compiled regex                                          */
+	regex_cache_entry_t *entry = NULL;	/* Holds the compiled regex                                          */
 	int match_count = 0;		/* Number of times the regex was matched                             */
 	int offset_vectors[255];	/* not used, but has to exist or pcre won't even try to find a match */
 	int pcre_flags = 0;
@@ -242,20 +506,8 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, c
 		}
 	}
 
-	/* Compile the expression */
-	pcre_prepared = pcre_compile(expression, flags, &error, &error_offset, NULL);
-
-	/* See if there was an error in the expression */
-	if (error != NULL) {
-		/* Clean up after ourselves */
-		if (pcre_prepared) {
-			pcre_free(pcre_prepared);
-			pcre_prepared = NULL;
-		}
-		/* Note our error */
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
-						  "Regular Expression Error expression[%s] error[%s] location[%d]\n", expression, error, error_offset);
-
+	/* Compile the expression, or find it already compiled */
+	if (!(entry = regex_cache_acquire(expression, flags))) {
 		/* We definitely didn't match anything */
 		goto end;
 	}
@@ -265,14 +517,10 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, c
 	}
 
 	/* So far so good, run the regex */
-	match_count =
-		pcre_exec(pcre_prepared, NULL, target, (int) strlen(target), 0, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
+	match_count = regex_entry_exec(entry, target, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
 
 	/* Clean up */
-	if (pcre_prepared) {
-		pcre_free(pcre_prepared);
-		pcre_prepared = NULL;
-	}
+	regex_cache_release(entry);
 
 	/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "number of matches: %d\n", match_count); */
 
@@ -37,6 +37,11 @@
 #endif
 #include <speex/speex_resampler.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SWITCH_MIX_X86 1
+#include <immintrin.h>
+#endif
+
 #define NORMFACT (float)0x8000
 #define MAXSAMPLE (float)0x7FFF
 #define MAXSAMPLEC (char)0x7F
@@ -323,6 +328,239 @@ SWITCH_DECLARE(void) switch_mux_channels(int16_t *data, switch_size_t samples, u
 	}
 }
 
+typedef struct {
+	const char *name;
+	void (*accumulate)(int32_t *mix, const int16_t *data, uint32_t samples);
+	void (*minus)(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples);
+	void (*scale)(int16_t *data, uint32_t samples, double rate);
+} sln_mix_kernel_t;
+
+static void mix_accumulate_scalar(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		mix[x] += data[x];
+	}
+}
+
+static void mix_minus_scalar(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples)
+{
+	uint32_t x;
+	int32_t z;
+
+	for (x = 0; x < samples; x++) {
+		z = self ? mix[x] - self[x] : mix[x];
+		switch_normalize_to_16bit(z);
+		out[x] = (int16_t) z;
+	}
+}
+
+static void mix_scale_scalar(int16_t *data, uint32_t samples, double rate)
+{
+	uint32_t x;
+	int32_t tmp;
+
+	for (x = 0; x < samples; x++) {
+		tmp = (int32_t) (data[x] * rate);
+		switch_normalize_to_16bit(tmp);
+		data[x] = (int16_t) tmp;
+	}
+}
+
+static const sln_mix_kernel_t MIX_KERNEL_SCALAR = { "scalar", mix_accumulate_scalar, mix_minus_scalar, mix_scale_scalar };
+
+#ifdef SWITCH_MIX_X86
+/* The vector kernels leave the tail of a frame to the scalar ones. Saturating packs clamp
+   exactly like switch_normalize_to_16bit and volume is multiplied in double like the scalar
+   code does, so every kernel gives the same output down to the bit. */
+
+__attribute__((target("sse2")))
+static void mix_accumulate_sse2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m128i in = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+
+		_mm_storeu_si128((__m128i *) (mix + x), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (mix + x)), lo));
+		_mm_storeu_si128((__m128i *) (mix + x + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (mix + x + 4)), hi));
+	}
+
+	mix_accumulate_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__((target("sse2")))
+static void mix_minus_sse2(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *) (mix + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *) (mix + x + 4));
+
+		if (self) {
+			__m128i in = _mm_loadu_si128((const __m128i *) (self + x));
+
+			lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16));
+			hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16));
+		}
+
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packs_epi32(lo, hi));
+	}
+
+	mix_minus_scalar(out + x, mix + x, self ? self + x : NULL, samples - x);
+}
+
+__attribute__((target("sse2")))
+static void mix_scale_sse2(int16_t *data, uint32_t samples, double rate)
+{
+	__m128d vrate = _mm_set1_pd(rate);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m128i in = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+		__m128i l0 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(lo), vrate));
+		__m128i l1 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), vrate));
+		__m128i h0 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(hi), vrate));
+		__m128i h1 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), vrate));
+
+		_mm_storeu_si128((__m128i *) (data + x), _mm_packs_epi32(_mm_unpacklo_epi64(l0, l1), _mm_unpacklo_epi64(h0, h1)));
+	}
+
+	mix_scale_scalar(data + x, samples - x, rate);
+}
+
+static const sln_mix_kernel_t MIX_KERNEL_SSE2 = { "sse2", mix_accumulate_sse2, mix_minus_sse2, mix_scale_sse2 };
+
+__attribute__((target("avx2")))
+static void mix_accumulate_avx2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x + 8)));
+
+		_mm256_storeu_si256((__m256i *) (mix + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (mix + x)), lo));
+		_mm256_storeu_si256((__m256i *) (mix + x + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (mix + x + 8)), hi));
+	}
+
+	mix_accumulate_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__((target("avx2")))
+static void mix_minus_avx2(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *) (mix + x));
+		__m256i hi = _mm256_loadu_si256((const __m256i *) (mix + x + 8));
+
+		if (self) {
+			lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (self + x))));
+			hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (self + x + 8))));
+		}
+
+		/* the pack works within each 128 bit lane, put the halves back in order */
+		_mm256_storeu_si256((__m256i *) (out + x), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+	}
+
+	mix_minus_scalar(out + x, mix + x, self ? self + x : NULL, samples - x);
+}
+
+__attribute__((target("avx2")))
+static void mix_scale_avx2(int16_t *data, uint32_t samples, double rate)
+{
+	__m256d vrate = _mm256_set1_pd(rate);
+	uint32_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m256i in = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m128i lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(in)), vrate));
+		__m128i hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(in, 1)), vrate));
+
+		_mm_storeu_si128((__m128i *) (data + x), _mm_packs_epi32(lo, hi));
+	}
+
+	mix_scale_scalar(data + x, samples - x, rate);
+}
+
+static const sln_mix_kernel_t MIX_KERNEL_AVX2 = { "avx2", mix_accumulate_avx2, mix_minus_avx2, mix_scale_avx2 };
+#endif
+
+static const sln_mix_kernel_t *MIX_KERNEL = NULL;
+
+static const sln_mix_kernel_t *mix_kernel(void)
+{
+	if (!MIX_KERNEL) {
+		/* racing threads all come up with the same answer */
+#ifdef SWITCH_MIX_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			MIX_KERNEL = &MIX_KERNEL_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			MIX_KERNEL = &MIX_KERNEL_SSE2;
+		} else
+#endif
+		{
+			MIX_KERNEL = &MIX_KERNEL_SCALAR;
+		}
+	}
+
+	return MIX_KERNEL;
+}
+
+SWITCH_DECLARE(void) switch_mix_accumulate_sln(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	mix_kernel()->accumulate(mix, data, samples);
+}
+
+SWITCH_DECLARE(void) switch_mix_minus_sln(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t samples)
+{
+	mix_kernel()->minus(out, mix, self, samples);
+}
+
+SWITCH_DECLARE(const char *) switch_mix_get_kernel(void)
+{
+	return mix_kernel()->name;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_mix_set_kernel(const char *name)
+{
+	const sln_mix_kernel_t *kernel = NULL;
+
+	if (zstr(name) || !strcasecmp(name, "auto")) {
+		MIX_KERNEL = NULL;
+		mix_kernel();
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!strcasecmp(name, MIX_KERNEL_SCALAR.name)) {
+		kernel = &MIX_KERNEL_SCALAR;
+	}
+#ifdef SWITCH_MIX_X86
+	else if (!strcasecmp(name, MIX_KERNEL_SSE2.name) && __builtin_cpu_supports("sse2")) {
+		kernel = &MIX_KERNEL_SSE2;
+	} else if (!strcasecmp(name, MIX_KERNEL_AVX2.name) && __builtin_cpu_supports("avx2")) {
+		kernel = &MIX_KERNEL_AVX2;
+	}
+#endif
+
+	if (!kernel) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	MIX_KERNEL = kernel;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t samples, int32_t vol)
 {
 	double newrate = 0;
@@ -348,15 +586,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t s
 	newrate = chart[i];
 
 	if (newrate) {
-		int32_t tmp;
-		uint32_t x;
-		int16_t *fp = data;
-
-		for (x = 0; x < samples; x++) {
-			tmp = (int32_t) (fp[x] * newrate);
-			switch_normalize_to_16bit(tmp);
-			fp[x] = (int16_t) tmp;
-		}
+		mix_kernel()->scale(data, samples, newrate);
 	} else {
 		memset(data, 0, samples * 2);
 	}
@@ -387,15 +617,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
 	newrate = chart[i];
 
 	if (newrate) {
-		int32_t tmp;
-		uint32_t x;
-		int16_t *fp = data;
-
-		for (x = 0; x < samples; x++) {
-			tmp = (int32_t) (fp[x] * newrate);
-			switch_normalize_to_16bit(tmp);
-			fp[x] = (int16_t) tmp;
-		}
+		mix_kernel()->scale(data, samples, newrate);
 	}
 }
 
@@ -55,6 +55,13 @@
 #include <srtp_priv.h>
 #include <switch_ssl.h>
 #include <switch_jitterbuffer.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#define RTP_REACTOR
+#ifdef HAVE_SENDMMSG
+#define RTP_SEND_BATCH
+#endif
+#endif
 
 #define JITTER_LEAD_FRAMES 10
 #define READ_INC(rtp_session) switch_mutex_lock(rtp_session->read_mutex); rtp_session->reading++
@@ -107,6 +114,10 @@ static int zrtp_on = 0;
 
 static switch_hash_t *alloc_hash = NULL;
 
+typedef struct rtp_reactor_link_s rtp_reactor_link_t;
+typedef struct rtp_send_batch_s rtp_send_batch_t;
+typedef struct rtp_relay_s rtp_relay_t;
+
 typedef struct {
 	srtp_hdr_t header;
 	char body[SWITCH_RTP_MAX_BUF_LEN];
@@ -300,6 +311,13 @@ struct switch_rtp {
 	 */
 	switch_socket_t *sock_input, *sock_output, *rtcp_sock_input, *rtcp_sock_output;
 	switch_pollfd_t *read_pollfd, *rtcp_read_pollfd;
+	rtp_reactor_link_t *read_link, *rtcp_read_link;
+	rtp_send_batch_t *send_batch;
+	rtp_relay_t *relay;
+	/* what the relay has moved on the session's behalf and the session's read has already counted */
+	switch_rtp_relay_stats_t relay_seen;
+	/* left over from a stopped relay for the next read to count */
+	switch_rtp_relay_stats_t relay_unseen;
 	switch_pollfd_t *jb_pollfd;
 
 	switch_sockaddr_t *local_addr, *rtcp_local_addr;
@@ -1247,166 +1265,1922 @@ static void handle_ice(switch_rtp_t *rtp_session, switch_rtp_ice_t *ice, void *d
 							  "STUN/ICE binding error received on %s channel\n", rtp_session->flags[SWITCH_RTP_FLAG_VIDEO] ? "video" : "audio");
 		}
 
-	}
+	}
+
+
+
+
+ end:
+	switch_mutex_unlock(rtp_session->ice_mutex);
+	READ_DEC(rtp_session);
+	WRITE_DEC(rtp_session);
+}
+
+#ifdef ENABLE_ZRTP
+SWITCH_STANDARD_SCHED_FUNC(zrtp_cache_save_callback)
+{
+	zrtp_status_t status = zrtp_status_ok;
+
+	status = zrtp_def_cache_store(zrtp_global);
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Saving ZRTP cache: %s\n", zrtp_status_ok == status ? "OK" : "FAIL");
+	task->runtime = switch_epoch_time_now(NULL) + 900;
+}
+
+static int zrtp_send_rtp_callback(const zrtp_stream_t *stream, char *rtp_packet, unsigned int rtp_packet_length)
+{
+	switch_rtp_t *rtp_session = zrtp_stream_get_userdata(stream);
+	switch_size_t len = rtp_packet_length;
+	zrtp_status_t status = zrtp_status_ok;
+
+	switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, rtp_packet, &len);
+	return status;
+}
+
+static void zrtp_event_callback(zrtp_stream_t *stream, unsigned event)
+{
+	switch_rtp_t *rtp_session = zrtp_stream_get_userdata(stream);
+	zrtp_session_info_t zrtp_session_info;
+	
+	switch_channel_t *channel = switch_core_session_get_channel(rtp_session->session);
+	switch_event_t *fsevent = NULL;
+	const char *type;
+
+	type = rtp_type(rtp_session);
+
+	switch (event) {
+	case ZRTP_EVENT_IS_SECURE:
+		{
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_SEND] = 1;
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_RECV] = 1;
+			if (!rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
+				rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_SEND] = 1;
+				rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_RECV] = 1;
+			}
+			if (zrtp_status_ok == zrtp_session_get(stream->session, &zrtp_session_info)) {
+				if (zrtp_session_info.sas_is_ready) {
+
+					switch_channel_set_variable_name_printf(channel, "true", "zrtp_secure_media_confirmed_%s", type);
+					switch_channel_set_variable_name_printf(channel, stream->session->sas1.buffer, "zrtp_sas1_string_%s", type);
+					switch_channel_set_variable_name_printf(channel, stream->session->sas2.buffer, "zrtp_sas2_string", type);
+					zrtp_verified_set(zrtp_global, &stream->session->zid, &stream->session->peer_zid, (uint8_t)1);
+				}
+			}
+
+			if (!rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
+				
+
+				if (rtp_session->session) {
+					switch_channel_t *channel = switch_core_session_get_channel(rtp_session->session);
+					switch_rtp_t *video_rtp_session = switch_channel_get_private(channel, "__zrtp_video_rtp_session");
+
+					if (!video_rtp_session) {
+						video_rtp_session = switch_channel_get_private_partner(channel, "__zrtp_video_rtp_session");
+					}
+
+					if (video_rtp_session) {
+						if (zrtp_status_ok != zrtp_stream_attach(stream->session, &video_rtp_session->zrtp_stream)) {
+							abort();
+						}
+						zrtp_stream_set_userdata(video_rtp_session->zrtp_stream, video_rtp_session);
+						if (switch_true(switch_channel_get_variable(channel, "zrtp_enrollment"))) {
+							zrtp_stream_registration_start(video_rtp_session->zrtp_stream, video_rtp_session->ssrc);
+						} else {
+							zrtp_stream_start(video_rtp_session->zrtp_stream, video_rtp_session->ssrc);
+						}
+					}
+				}
+			}
+
+			if (switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
+				switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_media_type", "%s", type);
+				switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_type", "zrtp:%s:%s", stream->session->sas1.buffer,
+										stream->session->sas2.buffer);
+				switch_event_add_header_string(fsevent, SWITCH_STACK_BOTTOM, "caller-unique-id", switch_channel_get_uuid(channel));
+				switch_event_fire(&fsevent);
+			}
+		}
+		break;
+#if 0
+	case ZRTP_EVENT_NO_ZRTP_QUICK:
+		{
+			if (stream != NULL) {
+				zrtp_stream_stop(stream);
+			}
+		}
+		break;
+#endif
+	case ZRTP_EVENT_IS_CLIENT_ENROLLMENT:
+		{
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "Enrolled complete!\n");
+			switch_channel_set_variable_name_printf(channel, "true", "zrtp_enroll_complete_%s", type);
+		}
+		break;
+
+	case ZRTP_EVENT_USER_ALREADY_ENROLLED:
+		{
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "User already enrolled!\n");
+			switch_channel_set_variable_name_printf(channel, "true", "zrtp_already_enrolled_%s", type);
+		}
+		break;
+
+	case ZRTP_EVENT_NEW_USER_ENROLLED:
+		{
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "New user enrolled!\n");
+			switch_channel_set_variable_name_printf(channel, "true", "zrtp_new_user_enrolled_%s", type);
+		}
+		break;
+
+	case ZRTP_EVENT_USER_UNENROLLED:
+		{
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "User unenrolled!\n");
+			switch_channel_set_variable_name_printf(channel, "true", "zrtp_user_unenrolled_%s", type);
+		}
+		break;
+
+	case ZRTP_EVENT_IS_PENDINGCLEAR:
+		{
+			switch_channel_set_variable_name_printf(channel, "false", "zrtp_secure_media_confirmed_%s", type);
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_SEND] = 0;
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_RECV] = 0;
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_SEND] = 0;
+			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_RECV] = 0;
+			rtp_session->zrtp_mitm_tries = 0;
+		}
+		break;
+
+	case ZRTP_EVENT_NO_ZRTP:
+		{
+			switch_channel_set_variable_name_printf(channel, "false", "zrtp_secure_media_confirmed_%s", type);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void zrtp_logger(int level, const char *data, int len, int offset)
+{
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s", data);
+}
+#endif
+
+/*
+ * Media reactor
+ *
+ * When rtp-reactor-threads is set, the input sockets of proxy media sessions are registered with a small
+ * pool of epoll threads instead of being poll()ed by the thread that reads them.  The reactor drains each
+ * readable socket into a per-socket packet queue and rtp_common_read() consumes packets from the queue
+ * exactly as it would have read them from the socket, so everything past the recvfrom (srtp, the jitter
+ * buffers, stats) is unchanged.  Once two of them are relayed the reactor forwards their rtp itself and
+ * the session threads only see what is not rtp.
+ *
+ * Every session still has its own thread, so for one that is not relayed the queue is a hop on top of
+ * what it did before: the reactor's wakeup, a lock, a copy and, for a session without a timer, a signal.
+ * Measured on loopback with one sender at 50 packets a second per session, 200 and 500 sessions, one
+ * reactor: timed sessions cost 1-6% more cpu per packet, untimed ones 60-90% more with 2.5 times the
+ * context switches, while relayed pairs cost a third less cpu than forwarding from the session threads
+ * with a fifth of the context switches.  So the reactor is off unless configured, and even then it only
+ * takes the sockets that can be relayed and those on the shared port, which nothing else can read.
+ *
+ * With rtp-shared-port set every session is given that port (and the one above it for RTCP) instead of
+ * one from the port allocator.  Each reactor holds its own SO_REUSEPORT socket on the shared port and
+ * routes what it reads to the owning session by SSRC, source address or ICE username.
+ */
+
+#define RTP_REACTOR_MAX_THREADS 64
+#define RTP_REACTOR_EVENTS 128
+#define RTP_REACTOR_DRAIN 32
+#define RTP_REACTOR_MAX_QUEUE 64
+#define RTP_REACTOR_PACKET_MIN 1536
+#define RTP_SHARED_ADDR_KEY_LEN 19
+
+static uint32_t RTP_REACTOR_THREADS = 0;
+static switch_port_t RTP_SHARED_PORT = 0;
+
+typedef struct rtp_reactor_packet_s {
+	struct rtp_reactor_packet_s *next;
+	switch_size_t len;
+	switch_size_t size;
+#ifdef RTP_REACTOR
+	struct sockaddr_storage addr;
+	socklen_t salen;
+#endif
+	char data[1];
+} rtp_reactor_packet_t;
+
+struct rtp_reactor_s;
+struct rtp_shared_s;
+struct rtp_shared_entry_s;
+
+struct rtp_reactor_link_s {
+	struct rtp_reactor_s *reactor;
+	/* set when the session reads from a shared port, the reactor owns no socket for it */
+	struct rtp_shared_s *shared;
+	struct rtp_shared_entry_s *entries;
+	/* set on the reactor's own entry for a shared port socket */
+	struct rtp_shared_s *demux;
+	switch_os_socket_t fd;
+	uint32_t slot;
+	uint32_t gen;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	rtp_reactor_packet_t *head;
+	rtp_reactor_packet_t *tail;
+	rtp_reactor_packet_t *free;
+	uint32_t queued;
+	uint8_t waiting;
+	uint8_t woken;
+	uint8_t closed;
+	/* set while the session is relayed, rtp read on the link goes straight out of the peer's socket */
+	struct rtp_relay_leg_s *relay;
+	/* shared port routing state, guarded by shared->mutex */
+	uint32_t ssrc_routes;
+	uint8_t pending;
+	struct rtp_reactor_link_s *pending_next;
+	struct rtp_reactor_link_s *pending_prev;
+	uint8_t peer[RTP_SHARED_ADDR_KEY_LEN];
+	uint32_t peer_len;
+	/* packets a reactor has routed to the link and not yet handed over */
+	switch_atomic_t refs;
+};
+
+#define rtp_link_active(_link) ((_link) && ((_link)->reactor || (_link)->shared))
+
+#ifdef RTP_REACTOR
+typedef struct rtp_reactor_s {
+	int epfd;
+	int running;
+	uint32_t gen;
+	uint32_t sockets;
+	uint64_t recv_calls;
+	uint64_t recv_packets;
+	uint64_t dropped;
+	uint64_t relay_packets;
+	rtp_reactor_link_t **links;
+	uint32_t *free_slots;
+	uint32_t slots;
+	uint32_t nfree;
+	switch_mutex_t *mutex;
+	switch_thread_t *thread;
+	struct mmsghdr msgs[RTP_REACTOR_DRAIN];
+	struct iovec iov[RTP_REACTOR_DRAIN];
+	struct sockaddr_storage addrs[RTP_REACTOR_DRAIN];
+	char bufs[RTP_REACTOR_DRAIN][sizeof(rtp_msg_t)];
+	struct mmsghdr relay_msgs[RTP_REACTOR_DRAIN];
+} rtp_reactor_t;
+
+static rtp_reactor_t *RTP_REACTORS[RTP_REACTOR_MAX_THREADS];
+static uint32_t RTP_REACTOR_COUNT = 0;
+
+static void rtp_reactor_hangup(rtp_reactor_t *reactor, rtp_reactor_link_t *link)
+{
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+
+	switch_mutex_lock(link->mutex);
+	link->closed = 1;
+	switch_thread_cond_broadcast(link->cond);
+	switch_mutex_unlock(link->mutex);
+}
+
+/* read as many datagrams as are waiting, up to RTP_REACTOR_DRAIN, into reactor->msgs in a single call where the platform allows it */
+static int rtp_reactor_recv(rtp_reactor_t *reactor, switch_os_socket_t fd)
+{
+	int i, n;
+
+	for (i = 0; i < RTP_REACTOR_DRAIN; i++) {
+		reactor->iov[i].iov_base = reactor->bufs[i];
+		reactor->iov[i].iov_len = sizeof(reactor->bufs[i]);
+		reactor->msgs[i].msg_hdr.msg_iov = &reactor->iov[i];
+		reactor->msgs[i].msg_hdr.msg_iovlen = 1;
+		reactor->msgs[i].msg_hdr.msg_name = &reactor->addrs[i];
+		reactor->msgs[i].msg_hdr.msg_namelen = sizeof(reactor->addrs[i]);
+		reactor->msgs[i].msg_len = 0;
+	}
+
+#ifdef HAVE_RECVMMSG
+	do {
+		n = recvmmsg(fd, reactor->msgs, RTP_REACTOR_DRAIN, MSG_DONTWAIT, NULL);
+	} while (n < 0 && errno == EINTR);
+
+	if (n > 0) {
+		reactor->recv_calls++;
+	}
+#else
+	for (n = 0; n < RTP_REACTOR_DRAIN; n++) {
+		ssize_t r = recvfrom(fd, reactor->bufs[n], sizeof(reactor->bufs[n]), MSG_DONTWAIT,
+							 (struct sockaddr *) &reactor->addrs[n], &reactor->msgs[n].msg_hdr.msg_namelen);
+
+		if (r < 0) {
+			if (errno == EINTR) {
+				n--;
+				continue;
+			}
+			break;
+		}
+
+		reactor->recv_calls++;
+		reactor->msgs[n].msg_len = (unsigned int) r;
+	}
+#endif
+
+	return n;
+}
+
+/* queue datagram i of the last rtp_reactor_recv() on link, called with link->mutex held */
+static void rtp_reactor_push(rtp_reactor_t *reactor, rtp_reactor_link_t *link, int i)
+{
+	switch_size_t r = reactor->msgs[i].msg_len;
+	rtp_reactor_packet_t *pkt;
+
+	if (!r) {
+		return;
+	}
+
+	if (link->queued >= RTP_REACTOR_MAX_QUEUE) {
+		reactor->dropped++;
+		return;
+	}
+
+	if ((pkt = link->free)) {
+		link->free = pkt->next;
+	}
+
+	if (!pkt || pkt->size < r) {
+		switch_size_t size = r > RTP_REACTOR_PACKET_MIN ? r : RTP_REACTOR_PACKET_MIN;
+
+		switch_safe_free(pkt);
+		switch_zmalloc(pkt, sizeof(*pkt) + size);
+		pkt->size = size;
+	}
+
+	memcpy(pkt->data, reactor->bufs[i], r);
+	memcpy(&pkt->addr, &reactor->addrs[i], reactor->msgs[i].msg_hdr.msg_namelen);
+	pkt->salen = reactor->msgs[i].msg_hdr.msg_namelen;
+	pkt->len = r;
+	pkt->next = NULL;
+
+	if (link->tail) {
+		link->tail->next = pkt;
+	} else {
+		link->head = pkt;
+	}
+	link->tail = pkt;
+
+	/* only a session without a timer ever waits here, timed sessions drain the queue on their tick */
+	if (!link->queued++ && link->waiting) {
+		switch_thread_cond_signal(link->cond);
+	}
+}
+
+/*
+ * A relay pairs two proxy media sessions so the reactor reading one writes its rtp straight out of the
+ * other's socket, rewriting the header the way switch_rtp_write_frame() does for proxied packets.  Neither
+ * session thread sees the media; stun and rtcp are still queued for the session so ice and rtcp carry on.
+ */
+
+typedef struct rtp_relay_leg_s {
+	switch_rtp_t *in;
+	switch_rtp_t *out;
+	switch_os_socket_t fd;
+	struct sockaddr_storage addr;
+	socklen_t salen;
+	switch_payload_t payload;
+	switch_rtp_relay_flag_t flags;
+	switch_rtp_relay_stats_t stats;
+} rtp_relay_leg_t;
+
+struct rtp_relay_s {
+	switch_rtp_t *sessions[2];
+	/* legs[i] carries what is read on sessions[i] */
+	rtp_relay_leg_t legs[2];
+};
+
+/* returns 1 if datagram i of the last rtp_reactor_recv() is rtp for the peer, 0 if it belongs to the session */
+static int rtp_relay_prepare(rtp_reactor_t *reactor, rtp_reactor_link_t *link, int i)
+{
+	uint8_t *b = (uint8_t *) reactor->bufs[i];
+	uint32_t len = reactor->msgs[i].msg_len;
+
+	if (len < 12 || (b[0] >> 6) != 2 || ((b[1] & 0x7f) >= 64 && (b[1] & 0x7f) <= 95)) {
+		link->relay->stats.passed++;
+		return 0;
+	}
+
+	reactor->iov[i].iov_len = len;
+
+	return 1;
+}
+
+/*
+ * Rewrite the datagrams listed in idx for the peer and write them out of its socket with as few calls as possible,
+ * called with link->mutex held.  The peer's write_mutex covers the header rewrite, the send and the outbound
+ * counters just as it does in rtp_common_write().  The reactor must not wait on it, whoever holds it may be
+ * waiting on the reactor, so when the peer is busy the packets go to the session to forward the usual way.
+ */
+static void rtp_relay_send(rtp_reactor_t *reactor, rtp_reactor_link_t *link, const int *idx, int count)
+{
+	rtp_relay_leg_t *leg = link->relay;
+	switch_rtp_t *out = leg->out;
+	uint64_t bytes = 0;
+	int i, done = 0, sent = 0;
+
+	if (switch_mutex_trylock(out->write_mutex) != SWITCH_STATUS_SUCCESS) {
+		for (i = 0; i < count; i++) {
+			rtp_reactor_push(reactor, link, idx[i]);
+		}
+		leg->stats.passed += count;
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct msghdr *hdr = &reactor->relay_msgs[i].msg_hdr;
+		srtp_hdr_t *rtp = (srtp_hdr_t *) reactor->bufs[idx[i]];
+
+		if (leg->payload) {
+			rtp->pt = leg->payload;
+		}
+
+		if ((leg->flags & SWITCH_RTP_RELAY_REWRITE_SSRC)) {
+			rtp->ssrc = htonl(out->ssrc);
+		}
+
+		if ((leg->flags & SWITCH_RTP_RELAY_REWRITE_SEQ)) {
+			rtp->seq = htons(++out->seq);
+		}
+
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_name = &leg->addr;
+		hdr->msg_namelen = leg->salen;
+		hdr->msg_iov = &reactor->iov[idx[i]];
+		hdr->msg_iovlen = 1;
+	}
+
+	while (done < count) {
+#ifdef HAVE_SENDMMSG
+		int r = sendmmsg(leg->fd, reactor->relay_msgs + done, count - done, MSG_DONTWAIT);
+#else
+		int r = sendmsg(leg->fd, &reactor->relay_msgs[done].msg_hdr, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* skip the packet the socket refused and carry on with the rest */
+			done++;
+			continue;
+		}
+
+		for (i = done; i < done + r; i++) {
+			bytes += reactor->iov[idx[i]].iov_len;
+		}
+
+		done += r;
+		sent += r;
+	}
+
+	out->stats.outbound.raw_bytes += bytes;
+	out->stats.outbound.media_bytes += bytes;
+	out->stats.outbound.packet_count += sent;
+	out->stats.outbound.media_packet_count += sent;
+	switch_mutex_unlock(out->write_mutex);
+
+	/* the inbound side is counted by the reading session itself, see rtp_relay_account() */
+	leg->stats.packets += sent;
+	leg->stats.bytes += bytes;
+	leg->stats.dropped += count - sent;
+	reactor->relay_packets += sent;
+}
+
+/* called with reactor->mutex held so the link cannot be detached under us */
+static void rtp_reactor_drain(rtp_reactor_t *reactor, rtp_reactor_link_t *link, uint32_t events)
+{
+	int i, n;
+
+	if ((events & (EPOLLRDHUP | EPOLLHUP)) || link->closed) {
+		rtp_reactor_hangup(reactor, link);
+		return;
+	}
+
+	/* anything left over is picked up on the next epoll_wait, the socket is level triggered */
+	if ((n = rtp_reactor_recv(reactor, link->fd)) <= 0) {
+		return;
+	}
+
+	reactor->recv_packets += n;
+
+	switch_mutex_lock(link->mutex);
+	if (link->relay) {
+		int idx[RTP_REACTOR_DRAIN], count = 0;
+
+		for (i = 0; i < n; i++) {
+			if (rtp_relay_prepare(reactor, link, i)) {
+				idx[count++] = i;
+			} else {
+				rtp_reactor_push(reactor, link, i);
+			}
+		}
+
+		if (count) {
+			rtp_relay_send(reactor, link, idx, count);
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			rtp_reactor_push(reactor, link, i);
+		}
+	}
+	switch_mutex_unlock(link->mutex);
+}
+
+#define RTP_SHARED_BUCKETS 4096
+#define RTP_SHARED_KEY_LEN 128
+#define RTP_SHARED_CANDIDATES 8
+
+typedef enum {
+	RTP_SHARED_ADDR = 'A',
+	RTP_SHARED_SSRC = 'S',
+	RTP_SHARED_ICE = 'I'
+} rtp_shared_key_type_t;
+
+/* several links may hold an entry for the same key, every peer behind one sbc shares its address */
+typedef struct rtp_shared_entry_s {
+	struct rtp_shared_entry_s *next;
+	struct rtp_shared_entry_s *link_next;
+	rtp_reactor_link_t *link;
+	uint32_t hash;
+	uint32_t len;
+	uint8_t key[RTP_SHARED_KEY_LEN];
+} rtp_shared_entry_t;
+
+typedef struct rtp_shared_s {
+	struct rtp_shared_s *next;
+	char *host;
+	switch_port_t port;
+	switch_socket_t *socks[RTP_REACTOR_MAX_THREADS];
+	uint32_t nsocks;
+	uint64_t unrouted;
+	switch_mutex_t *mutex;
+	/* links with no ssrc route yet, the only ones a packet from an unknown address can latch onto */
+	rtp_reactor_link_t *pending;
+	rtp_shared_entry_t *buckets[RTP_SHARED_BUCKETS];
+} rtp_shared_t;
+
+/* only ever prepended to, under port_lock, so it can be walked without it */
+static rtp_shared_t * volatile RTP_SHARED = NULL;
+static switch_memory_pool_t *RTP_SHARED_POOL = NULL;
+
+static uint32_t rtp_shared_key(uint8_t *key, rtp_shared_key_type_t type, const void *data, uint32_t len)
+{
+	if (len > RTP_SHARED_KEY_LEN - 1) {
+		len = RTP_SHARED_KEY_LEN - 1;
+	}
+
+	key[0] = (uint8_t) type;
+	memcpy(key + 1, data, len);
+
+	return len + 1;
+}
+
+/* the type byte, then the port, then the address, so key + 3 compares hosts */
+static uint32_t rtp_shared_addr_key(uint8_t *key, const struct sockaddr_storage *addr)
+{
+	uint8_t buf[RTP_SHARED_ADDR_KEY_LEN];
+
+	if (addr->ss_family == AF_INET6) {
+		const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) addr;
+
+		memcpy(buf, &sin6->sin6_port, 2);
+		memcpy(buf + 2, &sin6->sin6_addr, 16);
+		return rtp_shared_key(key, RTP_SHARED_ADDR, buf, 18);
+	} else {
+		const struct sockaddr_in *sin = (const struct sockaddr_in *) addr;
+
+		memcpy(buf, &sin->sin_port, 2);
+		memcpy(buf + 2, &sin->sin_addr, 4);
+		return rtp_shared_key(key, RTP_SHARED_ADDR, buf, 6);
+	}
+}
+
+static uint32_t rtp_shared_hash(const uint8_t *key, uint32_t len)
+{
+	uint32_t hash = 2166136261u;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ key[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+/* collect up to max of the links routed by key, returns how many there are in all */
+static int rtp_shared_lookup(rtp_shared_t *shared, const uint8_t *key, uint32_t len, rtp_reactor_link_t **links, int max)
+{
+	uint32_t hash = rtp_shared_hash(key, len);
+	rtp_shared_entry_t *entry;
+	int n = 0;
+
+	for (entry = shared->buckets[hash & (RTP_SHARED_BUCKETS - 1)]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->len == len && !memcmp(entry->key, key, len)) {
+			if (n < max) {
+				links[n] = entry->link;
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static void rtp_shared_pending_add(rtp_shared_t *shared, rtp_reactor_link_t *link)
+{
+	link->pending_prev = NULL;
+	link->pending_next = shared->pending;
+	if (shared->pending) {
+		shared->pending->pending_prev = link;
+	}
+	shared->pending = link;
+	link->pending = 1;
+}
+
+static void rtp_shared_pending_del(rtp_shared_t *shared, rtp_reactor_link_t *link)
+{
+	if (!link->pending) {
+		return;
+	}
+
+	if (link->pending_prev) {
+		link->pending_prev->pending_next = link->pending_next;
+	} else {
+		shared->pending = link->pending_next;
+	}
+	if (link->pending_next) {
+		link->pending_next->pending_prev = link->pending_prev;
+	}
+	link->pending_next = link->pending_prev = NULL;
+	link->pending = 0;
+}
+
+/* route key to link as well, called with shared->mutex held; whatever other links hold on the same key is left alone */
+static void rtp_shared_insert(rtp_shared_t *shared, rtp_reactor_link_t *link, const uint8_t *key, uint32_t len)
+{
+	uint32_t hash = rtp_shared_hash(key, len);
+	rtp_shared_entry_t *entry;
+
+	for (entry = link->entries; entry; entry = entry->link_next) {
+		if (entry->hash == hash && entry->len == len && !memcmp(entry->key, key, len)) {
+			return;
+		}
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	memcpy(entry->key, key, len);
+	entry->len = len;
+	entry->hash = hash;
+	entry->link = link;
+	entry->next = shared->buckets[hash & (RTP_SHARED_BUCKETS - 1)];
+	shared->buckets[hash & (RTP_SHARED_BUCKETS - 1)] = entry;
+	entry->link_next = link->entries;
+	link->entries = entry;
+
+	if (key[0] == RTP_SHARED_SSRC && !link->ssrc_routes++) {
+		rtp_shared_pending_del(shared, link);
+	}
+}
+
+/* drop the entries of link's list that match type, or all of them when type is 0, called with shared->mutex held */
+static void rtp_shared_remove(rtp_shared_t *shared, rtp_reactor_link_t *link, uint8_t type)
+{
+	rtp_shared_entry_t **lp = &link->entries;
+
+	while (*lp) {
+		rtp_shared_entry_t *entry = *lp, **ep;
+
+		if (type && entry->key[0] != type) {
+			lp = &entry->link_next;
+			continue;
+		}
+
+		*lp = entry->link_next;
+
+		for (ep = &shared->buckets[entry->hash & (RTP_SHARED_BUCKETS - 1)]; *ep; ep = &(*ep)->next) {
+			if (*ep == entry) {
+				*ep = entry->next;
+				break;
+			}
+		}
+
+		if (entry->key[0] == RTP_SHARED_SSRC) {
+			link->ssrc_routes--;
+		}
+
+		free(entry);
+	}
+}
+
+static void rtp_shared_map(rtp_reactor_link_t *link, rtp_shared_key_type_t type, const void *data, uint32_t len)
+{
+	uint8_t key[RTP_SHARED_KEY_LEN];
+	rtp_shared_t *shared;
+
+	if (!link || !(shared = link->shared) || !data || !len) {
+		return;
+	}
+
+	len = rtp_shared_key(key, type, data, len);
+
+	switch_mutex_lock(shared->mutex);
+	rtp_shared_insert(shared, link, key, len);
+	switch_mutex_unlock(shared->mutex);
+}
+
+/* the session's idea of where its peer is replaces the address routes it had, learned ones included */
+static void rtp_shared_map_addr(rtp_reactor_link_t *link, switch_sockaddr_t *addr)
+{
+	uint8_t key[RTP_SHARED_KEY_LEN];
+	rtp_shared_t *shared;
+	uint32_t len;
+
+	if (!link || !(shared = link->shared) || !addr) {
+		return;
+	}
+
+	len = rtp_shared_addr_key(key, (struct sockaddr_storage *) &addr->sa);
+
+	switch_mutex_lock(shared->mutex);
+	rtp_shared_remove(shared, link, RTP_SHARED_ADDR);
+	rtp_shared_insert(shared, link, key, len);
+	memcpy(link->peer, key, len);
+	link->peer_len = len;
+	switch_mutex_unlock(shared->mutex);
+}
+
+static void rtp_shared_map_ssrc(rtp_reactor_link_t *link, uint32_t ssrc)
+{
+	if (ssrc) {
+		ssrc = htonl(ssrc);
+		rtp_shared_map(link, RTP_SHARED_SSRC, &ssrc, sizeof(ssrc));
+	}
+}
+
+static void rtp_shared_bind(rtp_reactor_link_t *link, rtp_shared_t *shared)
+{
+	switch_mutex_lock(shared->mutex);
+	link->shared = shared;
+	link->ssrc_routes = 0;
+	link->peer_len = 0;
+	rtp_shared_pending_add(shared, link);
+	switch_mutex_unlock(shared->mutex);
+}
+
+static void rtp_shared_unbind(rtp_reactor_link_t *link)
+{
+	rtp_shared_t *shared = link->shared;
+
+	switch_mutex_lock(shared->mutex);
+	rtp_shared_remove(shared, link, 0);
+	rtp_shared_pending_del(shared, link);
+	link->shared = NULL;
+	switch_mutex_unlock(shared->mutex);
+
+	/* a reactor may still be handing over a packet it routed before the entries went away */
+	while (switch_atomic_read(&link->refs)) {
+		switch_cond_next();
+	}
+}
+
+/* the one link among links still waiting for its first ssrc, NULL unless exactly one is */
+static rtp_reactor_link_t *rtp_shared_pick_pending(rtp_reactor_link_t **links, int n)
+{
+	rtp_reactor_link_t *link = NULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (links[i]->pending) {
+			if (link) {
+				return NULL;
+			}
+			link = links[i];
+		}
+	}
+
+	return link;
+}
+
+/* a packet from an address no session knows: the one session waiting on that host from another port, else the only one waiting at all */
+static rtp_reactor_link_t *rtp_shared_latch(rtp_shared_t *shared, const uint8_t *akey, uint32_t alen)
+{
+	rtp_reactor_link_t *link, *host = NULL, *any = NULL;
+	int hosts = 0, waiting = 0;
+
+	for (link = shared->pending; link; link = link->pending_next) {
+		waiting++;
+		any = link;
+
+		if (link->peer_len == alen && !memcmp(link->peer + 3, akey + 3, alen - 3)) {
+			hosts++;
+			host = link;
+		}
+	}
+
+	if (hosts) {
+		return hosts == 1 ? host : NULL;
+	}
+
+	return waiting == 1 ? any : NULL;
+}
+
+static rtp_reactor_link_t *rtp_shared_route_ice(rtp_shared_t *shared, const uint8_t *b, switch_size_t len)
+{
+	uint8_t key[RTP_SHARED_KEY_LEN];
+	rtp_reactor_link_t *link;
+	switch_size_t off = 20;
+
+	/* a stun binding request, look for the USERNAME attribute */
+	while (off + 4 <= len) {
+		uint16_t type = (b[off] << 8) | b[off + 1];
+		uint16_t attr_len = (b[off + 2] << 8) | b[off + 3];
+
+		if (off + 4 + attr_len > len) {
+			break;
+		}
+
+		if (type == 0x0006) {
+			uint32_t klen = rtp_shared_key(key, RTP_SHARED_ICE, b + off + 4, attr_len);
+
+			return rtp_shared_lookup(shared, key, klen, &link, 1) == 1 ? link : NULL;
+		}
+
+		off += 4 + ((attr_len + 3) & ~3);
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the session a datagram on a shared port belongs to, called with shared->mutex held.
+ *
+ * Calls relayed through an sbc, or from another box on a shared port, all come from one address, so the ssrc
+ * is the route.  The address only places a stream's first packet, when one session claims it or just one of
+ * the sessions claiming it is still waiting for media, and the ssrc is learned from there on.  A packet from
+ * an address no session claims, a peer behind nat, latches onto the session waiting on that host, or onto the
+ * only session waiting at all.  Anything else is dropped rather than handed to a session it may not belong to.
+ */
+static rtp_reactor_link_t *rtp_shared_route(rtp_shared_t *shared, const uint8_t *b, switch_size_t len, const struct sockaddr_storage *addr)
+{
+	uint8_t key[RTP_SHARED_KEY_LEN], akey[RTP_SHARED_KEY_LEN];
+	rtp_reactor_link_t *links[RTP_SHARED_CANDIDATES], *link = NULL;
+	uint32_t klen = 0, alen;
+	int n, latched = 0;
+
+	alen = rtp_shared_addr_key(akey, addr);
+
+	if (len >= 12 && (b[0] >> 6) == 2) {
+		/* rtcp carries the sender ssrc straight after its 4 byte header, rtp after the timestamp */
+		klen = rtp_shared_key(key, RTP_SHARED_SSRC, (b[1] >= 192 && b[1] <= 223) ? b + 4 : b + 8, 4);
+
+		if (rtp_shared_lookup(shared, key, klen, links, 1) == 1) {
+			return links[0];
+		}
+	} else if (len >= 20 && b[0] < 2 && (link = rtp_shared_route_ice(shared, b, len))) {
+		/* the media that follows the check comes from the same candidate */
+		rtp_shared_insert(shared, link, akey, alen);
+		return link;
+	}
+
+	if ((n = rtp_shared_lookup(shared, akey, alen, links, RTP_SHARED_CANDIDATES)) == 1) {
+		link = links[0];
+	} else if (n > 1 && n <= RTP_SHARED_CANDIDATES) {
+		link = rtp_shared_pick_pending(links, n);
+	} else if (!n && klen && (link = rtp_shared_latch(shared, akey, alen))) {
+		latched = 1;
+	}
+
+	if (link && klen) {
+		rtp_shared_insert(shared, link, key, klen);
+		if (latched) {
+			rtp_shared_insert(shared, link, akey, alen);
+		}
+	}
+
+	return link;
+}
+
+/* called with reactor->mutex held */
+static void rtp_shared_drain(rtp_reactor_t *reactor, rtp_reactor_link_t *plink)
+{
+	rtp_shared_t *shared = plink->demux;
+	rtp_reactor_link_t *links[RTP_REACTOR_DRAIN];
+	int i, n;
+
+	if ((n = rtp_reactor_recv(reactor, plink->fd)) <= 0) {
+		return;
+	}
+
+	reactor->recv_packets += n;
+
+	/* route the batch in one pass over the table, the links are fed after it is released */
+	switch_mutex_lock(shared->mutex);
+	for (i = 0; i < n; i++) {
+		if ((links[i] = rtp_shared_route(shared, (uint8_t *) reactor->bufs[i], reactor->msgs[i].msg_len, &reactor->addrs[i]))) {
+			switch_atomic_inc(&links[i]->refs);
+		} else {
+			shared->unrouted++;
+		}
+	}
+	switch_mutex_unlock(shared->mutex);
+
+	for (i = 0; i < n; i++) {
+		rtp_reactor_link_t *link = links[i];
+
+		if (!link) {
+			continue;
+		}
+
+		switch_mutex_lock(link->mutex);
+		if (link->relay && rtp_relay_prepare(reactor, link, i)) {
+			rtp_relay_send(reactor, link, &i, 1);
+		} else {
+			rtp_reactor_push(reactor, link, i);
+		}
+		switch_mutex_unlock(link->mutex);
+
+		switch_atomic_dec(&link->refs);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC rtp_reactor_thread(switch_thread_t *thread, void *obj)
+{
+	rtp_reactor_t *reactor = (rtp_reactor_t *) obj;
+	struct epoll_event events[RTP_REACTOR_EVENTS];
+
+	while (reactor->running) {
+		int i, n = epoll_wait(reactor->epfd, events, RTP_REACTOR_EVENTS, 100);
+
+		if (n <= 0) {
+			continue;
+		}
+
+		switch_mutex_lock(reactor->mutex);
+		for (i = 0; i < n; i++) {
+			uint32_t slot = (uint32_t) (events[i].data.u64 & 0xffffffff);
+			uint32_t gen = (uint32_t) (events[i].data.u64 >> 32);
+			rtp_reactor_link_t *link;
+
+			/* the socket may have been detached, and its slot reused, since epoll_wait returned */
+			if (slot >= reactor->slots || !(link = reactor->links[slot]) || link->gen != gen) {
+				continue;
+			}
+
+			if (link->demux) {
+				rtp_shared_drain(reactor, link);
+			} else {
+				rtp_reactor_drain(reactor, link, events[i].events);
+			}
+		}
+		switch_mutex_unlock(reactor->mutex);
+	}
+
+	return NULL;
+}
+
+static void rtp_reactor_start(switch_memory_pool_t *pool)
+{
+	uint32_t i, threads = RTP_REACTOR_THREADS;
+
+	/* nothing else reads a shared port */
+	if (RTP_SHARED_PORT && !threads) {
+		threads = 1;
+	}
+
+	RTP_SHARED_POOL = pool;
+
+	for (i = 0; i < threads && i < RTP_REACTOR_MAX_THREADS; i++) {
+		switch_threadattr_t *thd_attr = NULL;
+		rtp_reactor_t *reactor = switch_core_alloc(pool, sizeof(*reactor));
+
+		if ((reactor->epfd = epoll_create(1024)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot create RTP reactor: %s\n", strerror(errno));
+			break;
+		}
+
+		switch_mutex_init(&reactor->mutex, SWITCH_MUTEX_NESTED, pool);
+		reactor->running = 1;
+
+		switch_threadattr_create(&thd_attr, pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+		switch_thread_create(&reactor->thread, thd_attr, rtp_reactor_thread, reactor, pool);
+
+		RTP_REACTORS[RTP_REACTOR_COUNT++] = reactor;
+	}
+
+	if (RTP_REACTOR_COUNT) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Started %u RTP reactor thread%s\n",
+						  RTP_REACTOR_COUNT, RTP_REACTOR_COUNT == 1 ? "" : "s");
+	}
+}
+
+static void rtp_reactor_stop(void)
+{
+	rtp_shared_t *shared;
+	uint32_t i;
+
+	for (i = 0; i < RTP_REACTOR_COUNT; i++) {
+		rtp_reactor_t *reactor = RTP_REACTORS[i];
+		switch_status_t st;
+
+		reactor->running = 0;
+		switch_thread_join(&st, reactor->thread);
+		close(reactor->epfd);
+		switch_safe_free(reactor->links);
+		switch_safe_free(reactor->free_slots);
+		RTP_REACTORS[i] = NULL;
+	}
+
+	RTP_REACTOR_COUNT = 0;
+
+	for (shared = RTP_SHARED; shared; shared = shared->next) {
+		for (i = 0; i < shared->nsocks; i++) {
+			switch_socket_close(shared->socks[i]);
+		}
+
+		for (i = 0; i < RTP_SHARED_BUCKETS; i++) {
+			rtp_shared_entry_t *entry, *next;
+
+			for (entry = shared->buckets[i]; entry; entry = next) {
+				next = entry->next;
+				free(entry);
+			}
+		}
+	}
+
+	RTP_SHARED = NULL;
+}
+
+static switch_status_t rtp_reactor_add(rtp_reactor_t *reactor, rtp_reactor_link_t *link)
+{
+	struct epoll_event e = { 0 };
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t i;
+
+	switch_mutex_lock(reactor->mutex);
+
+	if (!reactor->nfree) {
+		uint32_t slots = reactor->slots ? reactor->slots * 2 : 256;
+
+		reactor->links = realloc(reactor->links, slots * sizeof(*reactor->links));
+		reactor->free_slots = realloc(reactor->free_slots, slots * sizeof(*reactor->free_slots));
+		switch_assert(reactor->links && reactor->free_slots);
+
+		for (i = slots; i > reactor->slots; i--) {
+			reactor->links[i - 1] = NULL;
+			reactor->free_slots[reactor->nfree++] = i - 1;
+		}
+		reactor->slots = slots;
+	}
+
+	link->slot = reactor->free_slots[--reactor->nfree];
+	link->gen = ++reactor->gen;
+	link->closed = 0;
+
+	e.events = EPOLLIN | EPOLLRDHUP;
+	e.data.u64 = ((uint64_t) link->gen << 32) | link->slot;
+
+	if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, link->fd, &e) == 0) {
+		reactor->links[link->slot] = link;
+		reactor->sockets++;
+		link->reactor = reactor;
+	} else {
+		reactor->free_slots[reactor->nfree++] = link->slot;
+		status = SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_unlock(reactor->mutex);
+
+	return status;
+}
+
+static rtp_shared_t *rtp_shared_find_sock(switch_socket_t *sock)
+{
+	rtp_shared_t *shared;
+
+	if (!sock || !RTP_SHARED_PORT) {
+		return NULL;
+	}
+
+	for (shared = RTP_SHARED; shared; shared = shared->next) {
+		if (shared->socks[0] == sock) {
+			break;
+		}
+	}
+
+	return shared;
+}
+
+/* the socket sessions on host:port write from, opening one SO_REUSEPORT socket per reactor the first time */
+static switch_socket_t *rtp_shared_socket(const char *host, switch_port_t port, const char **err)
+{
+	rtp_shared_t *shared;
+	switch_sockaddr_t *addr = NULL;
+	uint32_t i;
+
+	switch_mutex_lock(port_lock);
+
+	for (shared = RTP_SHARED; shared; shared = shared->next) {
+		if (shared->port == port && !strcmp(shared->host, host)) {
+			goto end;
+		}
+	}
+
+	if (!RTP_REACTOR_COUNT || switch_sockaddr_info_get(&addr, host, SWITCH_UNSPEC, port, 0, RTP_SHARED_POOL) != SWITCH_STATUS_SUCCESS || !addr) {
+		*err = "Shared Port Error!";
+		goto end;
+	}
+
+	shared = switch_core_alloc(RTP_SHARED_POOL, sizeof(*shared));
+	shared->host = switch_core_strdup(RTP_SHARED_POOL, host);
+	shared->port = port;
+	switch_mutex_init(&shared->mutex, SWITCH_MUTEX_NESTED, RTP_SHARED_POOL);
+
+	for (i = 0; i < RTP_REACTOR_COUNT; i++) {
+		rtp_reactor_link_t *plink;
+		switch_socket_t *sock = NULL;
+		int one = 1;
+
+		if (switch_socket_create(&sock, switch_sockaddr_get_family(addr), SOCK_DGRAM, 0, RTP_SHARED_POOL) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+
+		switch_socket_opt_set(sock, SWITCH_SO_REUSEADDR, 1);
+		switch_socket_opt_set(sock, SWITCH_SO_RCVBUF, 4194304);
+		switch_socket_opt_set(sock, SWITCH_SO_SNDBUF, 4194304);
+
+		plink = switch_core_alloc(RTP_SHARED_POOL, sizeof(*plink));
+		switch_os_sock_get(&plink->fd, sock);
+#ifdef SO_REUSEPORT
+		setsockopt(plink->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+#endif
+
+		if (switch_socket_bind(sock, addr) != SWITCH_STATUS_SUCCESS) {
+			switch_socket_close(sock);
+			break;
+		}
+
+		switch_socket_opt_set(sock, SWITCH_SO_NONBLOCK, TRUE);
+		plink->demux = shared;
+		switch_mutex_init(&plink->mutex, SWITCH_MUTEX_NESTED, RTP_SHARED_POOL);
+		switch_thread_cond_create(&plink->cond, RTP_SHARED_POOL);
+
+		if (rtp_reactor_add(RTP_REACTORS[i], plink) != SWITCH_STATUS_SUCCESS) {
+			switch_socket_close(sock);
+			break;
+		}
+
+		shared->socks[shared->nsocks++] = sock;
+	}
+
+	if (!shared->nsocks) {
+		*err = switch_core_sprintf(RTP_SHARED_POOL, "Shared Port Bind Error! %s:%d", host, port);
+		shared = NULL;
+		goto end;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Sharing RTP port %s:%d across %u socket%s\n",
+					  host, port, shared->nsocks, shared->nsocks == 1 ? "" : "s");
+
+	shared->next = RTP_SHARED;
+	/* readers walk the list unlocked, the entry has to be complete before they can see it */
+	__sync_synchronize();
+	RTP_SHARED = shared;
+
+ end:
+
+	switch_mutex_unlock(port_lock);
+
+	return shared ? shared->socks[0] : NULL;
+}
+#endif
+
+static switch_bool_t rtp_shared_port(switch_port_t port)
+{
+#ifdef RTP_REACTOR
+	return RTP_SHARED_PORT && (port == RTP_SHARED_PORT || port == RTP_SHARED_PORT + 1);
+#else
+	return SWITCH_FALSE;
+#endif
+}
+
+static switch_bool_t rtp_socket_is_shared(switch_socket_t *sock)
+{
+#ifdef RTP_REACTOR
+	return rtp_shared_find_sock(sock) ? SWITCH_TRUE : SWITCH_FALSE;
+#else
+	return SWITCH_FALSE;
+#endif
+}
+
+static void rtp_reactor_free_packets(rtp_reactor_packet_t *pkt)
+{
+	while (pkt) {
+		rtp_reactor_packet_t *next = pkt->next;
+		free(pkt);
+		pkt = next;
+	}
+}
+
+static void rtp_reactor_detach(rtp_reactor_link_t *link)
+{
+#ifdef RTP_REACTOR
+	rtp_reactor_t *reactor;
+
+	if (!rtp_link_active(link)) {
+		return;
+	}
+
+	if (link->shared) {
+		rtp_shared_unbind(link);
+	} else {
+		reactor = link->reactor;
+
+		switch_mutex_lock(reactor->mutex);
+		epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, link->fd, NULL);
+		reactor->links[link->slot] = NULL;
+		reactor->free_slots[reactor->nfree++] = link->slot;
+		reactor->sockets--;
+		switch_mutex_unlock(reactor->mutex);
+	}
+
+	switch_mutex_lock(link->mutex);
+	link->reactor = NULL;
+	rtp_reactor_free_packets(link->head);
+	rtp_reactor_free_packets(link->free);
+	link->head = link->tail = link->free = NULL;
+	link->queued = 0;
+	switch_mutex_unlock(link->mutex);
+#endif
+}
+
+/* hand the socket of a proxy media session over to the least loaded reactor; the socket must stay open until it is detached again */
+static void rtp_reactor_attach(switch_rtp_t *rtp_session, rtp_reactor_link_t **linkp, switch_socket_t *sock)
+{
+#ifdef RTP_REACTOR
+	rtp_reactor_t *reactor = NULL;
+	rtp_reactor_link_t *link;
+	rtp_shared_t *shared;
+	uint32_t i;
+
+	if (!RTP_REACTOR_COUNT || !sock) {
+		return;
+	}
+
+	if (!(link = *linkp)) {
+		link = switch_core_alloc(rtp_session->pool, sizeof(*link));
+		switch_mutex_init(&link->mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+		switch_thread_cond_create(&link->cond, rtp_session->pool);
+		*linkp = link;
+	}
+
+	rtp_reactor_detach(link);
+
+	if ((shared = rtp_shared_find_sock(sock))) {
+		switch_rtp_ice_t *ice = linkp == &rtp_session->rtcp_read_link ? &rtp_session->rtcp_ice : &rtp_session->ice;
+
+		link->closed = 0;
+		rtp_shared_bind(link, shared);
+
+		/* route whatever the session already knows about its peer */
+		rtp_shared_map_addr(link, linkp == &rtp_session->rtcp_read_link ? rtp_session->rtcp_remote_addr : rtp_session->remote_addr);
+		rtp_shared_map_ssrc(link, rtp_session->remote_ssrc);
+		if (ice->user_ice) {
+			rtp_shared_map(link, RTP_SHARED_ICE, ice->user_ice, (uint32_t) strlen(ice->user_ice));
+		}
+		return;
+	}
+
+	/* a session that cannot be relayed reads its own socket for less than it costs to queue it */
+	if (!rtp_session->flags[SWITCH_RTP_FLAG_PROXY_MEDIA]) {
+		return;
+	}
+
+	if (switch_os_sock_get(&link->fd, sock) != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	for (i = 0; i < RTP_REACTOR_COUNT; i++) {
+		if (!reactor || RTP_REACTORS[i]->sockets < reactor->sockets) {
+			reactor = RTP_REACTORS[i];
+		}
+	}
+
+	if (rtp_reactor_add(reactor, link) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_WARNING,
+						  "Cannot add socket to RTP reactor, polling it directly: %s\n", strerror(errno));
+	}
+#endif
+}
+
+/* wake anything waiting on the link the way shutting the socket down wakes a poll() */
+static void rtp_reactor_close(rtp_reactor_link_t *link)
+{
+	if (!rtp_link_active(link)) {
+		return;
+	}
+
+	switch_mutex_lock(link->mutex);
+	link->closed = 1;
+	switch_thread_cond_broadcast(link->cond);
+	switch_mutex_unlock(link->mutex);
+}
+
+/* stands in for the packet ping_socket() would send itself on a shared port */
+static void rtp_reactor_wake(rtp_reactor_link_t *link)
+{
+	if (!rtp_link_active(link)) {
+		return;
+	}
+
+	switch_mutex_lock(link->mutex);
+	link->woken = 1;
+	switch_thread_cond_broadcast(link->cond);
+	switch_mutex_unlock(link->mutex);
+}
+
+static switch_status_t rtp_poll_read(rtp_reactor_link_t *link, switch_pollfd_t *pollfd, int32_t *nsds, switch_interval_time_t timeout)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	switch_time_t deadline;
+
+	if (!rtp_link_active(link)) {
+		return switch_poll(pollfd, 1, nsds, timeout);
+	}
+
+	deadline = switch_micro_time_now() + timeout;
+
+	switch_mutex_lock(link->mutex);
+	while (!link->queued && !link->closed && !link->woken) {
+		switch_time_t now = switch_micro_time_now();
+
+		if (timeout <= 0 || now >= deadline) {
+			status = SWITCH_STATUS_TIMEOUT;
+			break;
+		}
+
+		link->waiting = 1;
+		switch_thread_cond_timedwait(link->cond, link->mutex, deadline - now);
+		link->waiting = 0;
+	}
+	link->woken = 0;
+	switch_mutex_unlock(link->mutex);
+
+	*nsds = status == SWITCH_STATUS_SUCCESS;
+
+	return status;
+}
+
+static switch_status_t rtp_recvfrom(rtp_reactor_link_t *link, switch_sockaddr_t *from, switch_socket_t *sock, char *buf, switch_size_t *len)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+#ifdef RTP_REACTOR
+	rtp_reactor_packet_t *pkt;
+#endif
+
+	if (!rtp_link_active(link)) {
+		return switch_socket_recvfrom(from, sock, 0, buf, len);
+	}
+
+#ifdef RTP_REACTOR
+	switch_mutex_lock(link->mutex);
+
+	if ((pkt = link->head)) {
+		if (!(link->head = pkt->next)) {
+			link->tail = NULL;
+		}
+		link->queued--;
+
+		if (*len > pkt->len) {
+			*len = pkt->len;
+		}
+		memcpy(buf, pkt->data, *len);
+
+		if (from) {
+			memcpy(&from->sa, &pkt->addr, pkt->salen);
+			from->salen = pkt->salen;
+			from->family = pkt->addr.ss_family;
+			if (from->family == AF_INET6) {
+				from->port = ntohs(from->sa.sin6.sin6_port);
+				from->ipaddr_ptr = &from->sa.sin6.sin6_addr;
+				from->ipaddr_len = sizeof(from->sa.sin6.sin6_addr);
+			} else {
+				from->port = ntohs(from->sa.sin.sin_port);
+				from->ipaddr_ptr = &from->sa.sin.sin_addr;
+				from->ipaddr_len = sizeof(from->sa.sin.sin_addr);
+			}
+		}
+
+		pkt->next = link->free;
+		link->free = pkt;
+	} else {
+		/* an empty queue reads like a non-blocking socket with nothing on it, a closed one like a shut down socket */
+		*len = 0;
+		status = link->closed ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_BREAK;
+	}
+
+	switch_mutex_unlock(link->mutex);
+#endif
+
+	return status;
+}
+
+/*
+ * Video frames are packetised into a burst of RTP packets written back to back.  With rtp-send-batch set
+ * the packets of a frame are collected here and handed to the kernel with one sendmmsg() when the write
+ * that closes the frame returns, instead of one sendto() each.  On an SRTP session the packets are queued
+ * in the clear and protected together just before the send, so the cipher context stays hot for the whole
+ * frame.  Each session sizes its batch once, at rtp-send-batch packets of rtp-send-batch-mtu bytes.
+ */
+
+#define RTP_SEND_BATCH_MAX 64
+#define RTP_SEND_BATCH_DEFAULT_MTU 1500
+
+static uint32_t RTP_SEND_BATCH_PACKETS = 0;
+static uint32_t RTP_SEND_BATCH_MTU = RTP_SEND_BATCH_DEFAULT_MTU;
+static switch_mutex_t *io_stats_mutex = NULL;
+static uint64_t io_send_calls = 0;
+static uint64_t io_send_packets = 0;
+static switch_mutex_t *relay_mutex = NULL;
+static uint32_t io_relays = 0;
+static uint64_t io_srtp_batches = 0;
+static uint64_t io_srtp_batch_packets = 0;
+
+struct rtp_send_batch_s {
+	uint32_t count;
+	/*! packets the batch holds and the bytes kept for each, fixed when it is made */
+	uint32_t size;
+	uint32_t mtu;
+	uint32_t ts;
+	switch_size_t len[RTP_SEND_BATCH_MAX];
+	uint8_t protect[RTP_SEND_BATCH_MAX];
+	char *bufs[RTP_SEND_BATCH_MAX];
+};
+
+static int rtp_send_batched(switch_rtp_t *rtp_session, switch_size_t bytes)
+{
+#ifdef RTP_SEND_BATCH
+	rtp_send_batch_t *batch = rtp_session->send_batch;
+
+	return RTP_SEND_BATCH_PACKETS > 1 && rtp_session->flags[SWITCH_RTP_FLAG_VIDEO] && bytes <= (batch ? batch->mtu : RTP_SEND_BATCH_MTU);
+#else
+	return 0;
+#endif
+}
+
+static rtp_send_batch_t *rtp_send_batch_create(switch_rtp_t *rtp_session)
+{
+	rtp_send_batch_t *batch;
+	char *bufs;
+	uint32_t i;
+
+	batch = switch_core_alloc(rtp_session->pool, sizeof(*batch));
+	batch->size = RTP_SEND_BATCH_PACKETS;
+	batch->mtu = RTP_SEND_BATCH_MTU;
+	bufs = switch_core_alloc(rtp_session->pool, batch->size * batch->mtu);
+
+	for (i = 0; i < batch->size; i++) {
+		batch->bufs[i] = bufs + i * batch->mtu;
+	}
+
+	return batch;
+}
+
+#ifdef ENABLE_SRTP
+/* Protects the queued packets of a frame in one pass with the session's send context.  A packet that
+   cannot be protected is dropped from the batch rather than sent in the clear. */
+static void rtp_send_protect(switch_rtp_t *rtp_session, rtp_send_batch_t *batch)
+{
+	srtp_ctx_t *ctx = rtp_session->send_ctx[rtp_session->srtp_idx_rtp];
+	uint32_t i, keep = 0, protected = 0;
+
+	for (i = 0; i < batch->count; i++) {
+		if (batch->protect[i]) {
+			int sbytes = (int) batch->len[i];
+			err_status_t stat = err_status_no_ctx;
+
+			if (!ctx || !rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND] ||
+				(stat = srtp_protect(ctx, batch->bufs[i], &sbytes))) {
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR,
+								  "Error: %s SRTP protection failed with code %d\n", rtp_type(rtp_session), stat);
+				continue;
+			}
+
+			batch->len[i] = sbytes;
+			protected++;
+
+			if (rtp_session->flags[SWITCH_RTP_FLAG_NACK]) {
+				if (!rtp_session->vbw) {
+					switch_jb_create(&rtp_session->vbw, SJB_VIDEO, 10, 10, rtp_session->pool);
+				}
+				switch_jb_push_packet(rtp_session->vbw, (switch_rtp_packet_t *) batch->bufs[i], batch->len[i]);
+			}
+		}
+
+		if (keep != i) {
+			memcpy(batch->bufs[keep], batch->bufs[i], batch->len[i]);
+			batch->len[keep] = batch->len[i];
+		}
+		batch->protect[keep++] = 0;
+	}
+
+	batch->count = keep;
+
+	if (protected) {
+		switch_mutex_lock(io_stats_mutex);
+		io_srtp_batches++;
+		io_srtp_batch_packets += protected;
+		switch_mutex_unlock(io_stats_mutex);
+	}
+}
+#endif
+
+static switch_status_t rtp_send_flush(switch_rtp_t *rtp_session)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+#ifdef RTP_SEND_BATCH
+	rtp_send_batch_t *batch = rtp_session->send_batch;
+	struct mmsghdr msgs[RTP_SEND_BATCH_MAX];
+	struct iovec iov[RTP_SEND_BATCH_MAX];
+	switch_os_socket_t fd;
+	uint32_t i, sent = 0, calls = 0;
+
+	if (!batch || !batch->count) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!rtp_session->sock_output || !rtp_session->remote_addr || switch_os_sock_get(&fd, rtp_session->sock_output) != SWITCH_STATUS_SUCCESS) {
+		batch->count = 0;
+		return SWITCH_STATUS_FALSE;
+	}
+
+#ifdef ENABLE_SRTP
+	rtp_send_protect(rtp_session, batch);
+
+	if (!batch->count) {
+		return SWITCH_STATUS_FALSE;
+	}
+#endif
+
+	memset(msgs, 0, sizeof(msgs[0]) * batch->count);
+
+	for (i = 0; i < batch->count; i++) {
+		iov[i].iov_base = batch->bufs[i];
+		iov[i].iov_len = batch->len[i];
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &rtp_session->remote_addr->sa;
+		msgs[i].msg_hdr.msg_namelen = rtp_session->remote_addr->salen;
+	}
+
+	while (sent < batch->count) {
+		int r = sendmmsg(fd, msgs + sent, batch->count - sent, 0);
+
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			status = SWITCH_STATUS_FALSE;
+			break;
+		}
+
+		sent += r;
+		calls++;
+	}
+
+	batch->count = 0;
+
+	switch_mutex_lock(io_stats_mutex);
+	io_send_calls += calls;
+	io_send_packets += sent;
+	switch_mutex_unlock(io_stats_mutex);
+#endif
+
+	return status;
+}
+
+static switch_status_t rtp_send(switch_rtp_t *rtp_session, rtp_msg_t *send_msg, switch_size_t *bytes, int protect)
+{
+#ifdef RTP_SEND_BATCH
+	rtp_send_batch_t *batch = rtp_session->send_batch;
+
+	if (rtp_send_batched(rtp_session, *bytes)) {
+		if (!batch) {
+			batch = rtp_session->send_batch = rtp_send_batch_create(rtp_session);
+		}
+
+		/* a frame that never saw its marker packet goes out before the next one starts */
+		if (batch->count && (batch->ts != send_msg->header.ts || batch->count >= batch->size)) {
+			rtp_send_flush(rtp_session);
+		}
+
+		memcpy(batch->bufs[batch->count], send_msg, *bytes);
+		batch->protect[batch->count] = (uint8_t) protect;
+		batch->len[batch->count++] = *bytes;
+		batch->ts = send_msg->header.ts;
+
+		/* the write that queued it flushes a closed frame */
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (batch && batch->count) {
+		rtp_send_flush(rtp_session);
+	}
+#endif
+
+	return switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) send_msg, bytes);
+}
+
+SWITCH_DECLARE(uint32_t) switch_rtp_set_send_batch(uint32_t packets)
+{
+#ifdef RTP_SEND_BATCH
+	RTP_SEND_BATCH_PACKETS = packets > RTP_SEND_BATCH_MAX ? RTP_SEND_BATCH_MAX : packets;
+#endif
+
+	return RTP_SEND_BATCH_PACKETS;
+}
+
+SWITCH_DECLARE(uint32_t) switch_rtp_set_send_batch_mtu(uint32_t mtu)
+{
+	if (mtu) {
+		RTP_SEND_BATCH_MTU = mtu < rtp_header_len ? rtp_header_len : mtu > SWITCH_RTP_MAX_BUF_LEN ? SWITCH_RTP_MAX_BUF_LEN : mtu;
+	}
+
+	return RTP_SEND_BATCH_MTU;
+}
+
+SWITCH_DECLARE(void) switch_rtp_get_io_stats(switch_rtp_io_stats_t *stats)
+{
+#ifdef RTP_REACTOR
+	rtp_shared_t *shared;
+	uint32_t i;
+#endif
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!global_init) {
+		return;
+	}
+
+#ifdef RTP_REACTOR
+	for (i = 0; i < RTP_REACTOR_COUNT; i++) {
+		rtp_reactor_t *reactor = RTP_REACTORS[i];
+
+		switch_mutex_lock(reactor->mutex);
+		stats->reactor_sockets += reactor->sockets;
+		stats->recv_calls += reactor->recv_calls;
+		stats->recv_packets += reactor->recv_packets;
+		stats->recv_dropped += reactor->dropped;
+		stats->relay_packets += reactor->relay_packets;
+		switch_mutex_unlock(reactor->mutex);
+	}
+	stats->reactor_threads = RTP_REACTOR_COUNT;
+
+	switch_mutex_lock(port_lock);
+	for (shared = RTP_SHARED; shared; shared = shared->next) {
+		switch_mutex_lock(shared->mutex);
+		stats->shared_sockets += shared->nsocks;
+		stats->shared_unrouted += shared->unrouted;
+		switch_mutex_unlock(shared->mutex);
+	}
+	switch_mutex_unlock(port_lock);
+#endif
+
+	stats->send_batch = RTP_SEND_BATCH_PACKETS;
+	stats->send_batch_mtu = RTP_SEND_BATCH_MTU;
 
+	switch_mutex_lock(io_stats_mutex);
+	stats->send_calls = io_send_calls;
+	stats->send_packets = io_send_packets;
+	stats->srtp_batches = io_srtp_batches;
+	stats->srtp_batch_packets = io_srtp_batch_packets;
+	switch_mutex_unlock(io_stats_mutex);
 
+	switch_mutex_lock(relay_mutex);
+	stats->relays = io_relays;
+	switch_mutex_unlock(relay_mutex);
+}
 
+SWITCH_DECLARE(switch_port_t) switch_rtp_set_shared_port(switch_port_t port)
+{
+#ifdef RTP_REACTOR
+	if (!global_init) {
+		RTP_SHARED_PORT = port;
+	}
+#endif
 
- end:
-	switch_mutex_unlock(rtp_session->ice_mutex);
-	READ_DEC(rtp_session);
-	WRITE_DEC(rtp_session);
+	return RTP_SHARED_PORT;
 }
 
-#ifdef ENABLE_ZRTP
-SWITCH_STANDARD_SCHED_FUNC(zrtp_cache_save_callback)
+SWITCH_DECLARE(uint32_t) switch_rtp_set_reactor_threads(uint32_t threads)
 {
-	zrtp_status_t status = zrtp_status_ok;
+	if (!global_init) {
+		RTP_REACTOR_THREADS = threads > RTP_REACTOR_MAX_THREADS ? RTP_REACTOR_MAX_THREADS : threads;
+	}
 
-	status = zrtp_def_cache_store(zrtp_global);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Saving ZRTP cache: %s\n", zrtp_status_ok == status ? "OK" : "FAIL");
-	task->runtime = switch_epoch_time_now(NULL) + 900;
+	return RTP_REACTOR_THREADS;
 }
 
-static int zrtp_send_rtp_callback(const zrtp_stream_t *stream, char *rtp_packet, unsigned int rtp_packet_length)
+#ifdef RTP_REACTOR
+static void rtp_relay_leg_init(rtp_relay_leg_t *leg, switch_rtp_t *in, switch_rtp_t *out, switch_rtp_relay_flag_t flags)
 {
-	switch_rtp_t *rtp_session = zrtp_stream_get_userdata(stream);
-	switch_size_t len = rtp_packet_length;
-	zrtp_status_t status = zrtp_status_ok;
-
-	switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, rtp_packet, &len);
-	return status;
+	leg->in = in;
+	leg->out = out;
+	leg->flags = flags;
+	switch_os_sock_get(&leg->fd, out->sock_output);
+	memcpy(&leg->addr, &out->remote_addr->sa, out->remote_addr->salen);
+	leg->salen = out->remote_addr->salen;
+	leg->payload = (out->flags[SWITCH_RTP_FLAG_VIDEO] && out->payload > 0) ? out->payload : 0;
 }
+#endif
 
-static void zrtp_event_callback(zrtp_stream_t *stream, unsigned event)
+/* follow a new remote address of a relayed session, the reactor reading its peer is the one writing to it */
+static void rtp_relay_retarget(switch_rtp_t *rtp_session)
 {
-	switch_rtp_t *rtp_session = zrtp_stream_get_userdata(stream);
-	zrtp_session_info_t zrtp_session_info;
-	
-	switch_channel_t *channel = switch_core_session_get_channel(rtp_session->session);
-	switch_event_t *fsevent = NULL;
-	const char *type;
+#ifdef RTP_REACTOR
+	rtp_relay_t *relay;
+	int i;
 
-	type = rtp_type(rtp_session);
+	if (!rtp_session->relay) {
+		return;
+	}
 
-	switch (event) {
-	case ZRTP_EVENT_IS_SECURE:
-		{
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_SEND] = 1;
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_RECV] = 1;
-			if (!rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
-				rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_SEND] = 1;
-				rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_RECV] = 1;
-			}
-			if (zrtp_status_ok == zrtp_session_get(stream->session, &zrtp_session_info)) {
-				if (zrtp_session_info.sas_is_ready) {
+	switch_mutex_lock(relay_mutex);
+	if ((relay = rtp_session->relay) && rtp_session->remote_addr) {
+		for (i = 0; i < 2; i++) {
+			rtp_relay_leg_t *leg = &relay->legs[i];
 
-					switch_channel_set_variable_name_printf(channel, "true", "zrtp_secure_media_confirmed_%s", type);
-					switch_channel_set_variable_name_printf(channel, stream->session->sas1.buffer, "zrtp_sas1_string_%s", type);
-					switch_channel_set_variable_name_printf(channel, stream->session->sas2.buffer, "zrtp_sas2_string", type);
-					zrtp_verified_set(zrtp_global, &stream->session->zid, &stream->session->peer_zid, (uint8_t)1);
-				}
+			if (leg->out == rtp_session) {
+				switch_mutex_lock(relay->sessions[i]->read_link->mutex);
+				rtp_relay_leg_init(leg, relay->sessions[i], rtp_session, leg->flags);
+				switch_mutex_unlock(relay->sessions[i]->read_link->mutex);
 			}
+		}
+	}
+	switch_mutex_unlock(relay_mutex);
+#endif
+}
 
-			if (!rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
-				
+/* what a relay has moved for rtp_session that the session has not counted yet, called with relay_mutex held */
+static void rtp_relay_unseen(switch_rtp_t *rtp_session, switch_rtp_relay_stats_t *unseen, switch_bool_t seen)
+{
+	*unseen = rtp_session->relay_unseen;
+#ifdef RTP_REACTOR
+	if (rtp_session->relay) {
+		rtp_relay_t *relay = rtp_session->relay;
+		rtp_relay_leg_t *leg = &relay->legs[relay->sessions[0] == rtp_session ? 0 : 1];
 
-				if (rtp_session->session) {
-					switch_channel_t *channel = switch_core_session_get_channel(rtp_session->session);
-					switch_rtp_t *video_rtp_session = switch_channel_get_private(channel, "__zrtp_video_rtp_session");
+		switch_mutex_lock(rtp_session->read_link->mutex);
+		unseen->packets += leg->stats.packets - rtp_session->relay_seen.packets;
+		unseen->bytes += leg->stats.bytes - rtp_session->relay_seen.bytes;
+		unseen->dropped += leg->stats.dropped - rtp_session->relay_seen.dropped;
+		if (seen) {
+			rtp_session->relay_seen = leg->stats;
+		}
+		switch_mutex_unlock(rtp_session->read_link->mutex);
+	}
+#endif
+}
 
-					if (!video_rtp_session) {
-						video_rtp_session = switch_channel_get_private_partner(channel, "__zrtp_video_rtp_session");
-					}
+/*
+ * Count what the relay moved on rtp_session's behalf into its inbound counters, which only its own read
+ * touches, so this runs from the read too.  Returns the number of packets read since the last call so
+ * quiet reads on a relayed session are not a media timeout.
+ */
+static uint64_t rtp_relay_account(switch_rtp_t *rtp_session)
+{
+	switch_rtp_relay_stats_t unseen;
 
-					if (video_rtp_session) {
-						if (zrtp_status_ok != zrtp_stream_attach(stream->session, &video_rtp_session->zrtp_stream)) {
-							abort();
-						}
-						zrtp_stream_set_userdata(video_rtp_session->zrtp_stream, video_rtp_session);
-						if (switch_true(switch_channel_get_variable(channel, "zrtp_enrollment"))) {
-							zrtp_stream_registration_start(video_rtp_session->zrtp_stream, video_rtp_session->ssrc);
-						} else {
-							zrtp_stream_start(video_rtp_session->zrtp_stream, video_rtp_session->ssrc);
-						}
-					}
-				}
-			}
+	switch_mutex_lock(relay_mutex);
+	rtp_relay_unseen(rtp_session, &unseen, SWITCH_TRUE);
+	memset(&rtp_session->relay_unseen, 0, sizeof(rtp_session->relay_unseen));
+	switch_mutex_unlock(relay_mutex);
 
-			if (switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_media_type", "%s", type);
-				switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_type", "zrtp:%s:%s", stream->session->sas1.buffer,
-										stream->session->sas2.buffer);
-				switch_event_add_header_string(fsevent, SWITCH_STACK_BOTTOM, "caller-unique-id", switch_channel_get_uuid(channel));
-				switch_event_fire(&fsevent);
-			}
-		}
-		break;
-#if 0
-	case ZRTP_EVENT_NO_ZRTP_QUICK:
-		{
-			if (stream != NULL) {
-				zrtp_stream_stop(stream);
-			}
+	rtp_session->stats.inbound.raw_bytes += unseen.bytes;
+	rtp_session->stats.inbound.media_bytes += unseen.bytes;
+	rtp_session->stats.inbound.packet_count += unseen.packets;
+	rtp_session->stats.inbound.media_packet_count += unseen.packets;
+
+	return unseen.packets + unseen.dropped;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_rtp_relay_start(switch_rtp_t *rtp_session, switch_rtp_t *peer_session, switch_rtp_relay_flag_t flags)
+{
+#ifdef RTP_REACTOR
+	switch_rtp_t *sessions[2] = { rtp_session, peer_session };
+	rtp_relay_t *relay;
+	int i;
+
+	if (rtp_session == peer_session || !switch_rtp_ready(rtp_session) || !switch_rtp_ready(peer_session)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < 2; i++) {
+		switch_rtp_t *s = sessions[i];
+
+		if (!rtp_link_active(s->read_link) || !s->flags[SWITCH_RTP_FLAG_PROXY_MEDIA] || s->flags[SWITCH_RTP_FLAG_UDPTL] ||
+			s->flags[SWITCH_RTP_FLAG_SECURE_SEND] || s->flags[SWITCH_RTP_FLAG_SECURE_RECV] ||
+			s->flags[SWITCH_ZRTP_FLAG_SECURE_SEND] || s->flags[SWITCH_ZRTP_FLAG_SECURE_RECV]) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(s->session), SWITCH_LOG_DEBUG, "RTP session cannot be relayed, keeping the full media path\n");
+			return SWITCH_STATUS_FALSE;
 		}
-		break;
+	}
+
+	switch_rtp_relay_stop(rtp_session);
+	switch_rtp_relay_stop(peer_session);
+
+	switch_zmalloc(relay, sizeof(*relay));
+
+	switch_mutex_lock(relay_mutex);
+	for (i = 0; i < 2; i++) {
+		switch_rtp_t *s = sessions[i];
+
+		relay->sessions[i] = s;
+		rtp_relay_leg_init(&relay->legs[i], s, sessions[!i], flags);
+		s->relay = relay;
+		memset(&s->relay_seen, 0, sizeof(s->relay_seen));
+
+		switch_mutex_lock(s->read_link->mutex);
+		s->read_link->relay = &relay->legs[i];
+		switch_mutex_unlock(s->read_link->mutex);
+	}
+	io_relays++;
+	switch_mutex_unlock(relay_mutex);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "Relaying RTP %s:%d <-> %s:%d\n",
+					  rtp_session->remote_host_str, rtp_session->remote_port, peer_session->remote_host_str, peer_session->remote_port);
+
+	return SWITCH_STATUS_SUCCESS;
+#else
+	return SWITCH_STATUS_FALSE;
 #endif
-	case ZRTP_EVENT_IS_CLIENT_ENROLLMENT:
-		{
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "Enrolled complete!\n");
-			switch_channel_set_variable_name_printf(channel, "true", "zrtp_enroll_complete_%s", type);
-		}
-		break;
+}
 
-	case ZRTP_EVENT_USER_ALREADY_ENROLLED:
-		{
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "User already enrolled!\n");
-			switch_channel_set_variable_name_printf(channel, "true", "zrtp_already_enrolled_%s", type);
-		}
-		break;
+SWITCH_DECLARE(void) switch_rtp_relay_stop(switch_rtp_t *rtp_session)
+{
+#ifdef RTP_REACTOR
+	rtp_relay_t *relay;
+	int i;
 
-	case ZRTP_EVENT_NEW_USER_ENROLLED:
-		{
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "New user enrolled!\n");
-			switch_channel_set_variable_name_printf(channel, "true", "zrtp_new_user_enrolled_%s", type);
-		}
-		break;
+	if (!rtp_session || !rtp_session->relay) {
+		return;
+	}
 
-	case ZRTP_EVENT_USER_UNENROLLED:
-		{
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "User unenrolled!\n");
-			switch_channel_set_variable_name_printf(channel, "true", "zrtp_user_unenrolled_%s", type);
-		}
-		break;
+	switch_mutex_lock(relay_mutex);
+	if ((relay = rtp_session->relay)) {
+		for (i = 0; i < 2; i++) {
+			switch_rtp_t *s = relay->sessions[i];
 
-	case ZRTP_EVENT_IS_PENDINGCLEAR:
-		{
-			switch_channel_set_variable_name_printf(channel, "false", "zrtp_secure_media_confirmed_%s", type);
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_SEND] = 0;
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_RECV] = 0;
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_SEND] = 0;
-			rtp_session->flags[SWITCH_ZRTP_FLAG_SECURE_MITM_RECV] = 0;
-			rtp_session->zrtp_mitm_tries = 0;
-		}
-		break;
+			switch_mutex_lock(s->read_link->mutex);
+			s->read_link->relay = NULL;
+			switch_mutex_unlock(s->read_link->mutex);
 
-	case ZRTP_EVENT_NO_ZRTP:
-		{
-			switch_channel_set_variable_name_printf(channel, "false", "zrtp_secure_media_confirmed_%s", type);
+			rtp_relay_unseen(s, &s->relay_unseen, SWITCH_TRUE);
+			s->relay = NULL;
 		}
-		break;
+		io_relays--;
 
-	default:
-		break;
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG,
+						  "Stopped RTP relay after %" SWITCH_UINT64_T_FMT "/%" SWITCH_UINT64_T_FMT " packets\n",
+						  relay->legs[0].stats.packets, relay->legs[1].stats.packets);
+
+		free(relay);
 	}
+	switch_mutex_unlock(relay_mutex);
+#endif
 }
 
-static void zrtp_logger(int level, const char *data, int len, int offset)
+SWITCH_DECLARE(switch_status_t) switch_rtp_get_relay_stats(switch_rtp_t *rtp_session, switch_rtp_relay_stats_t *stats)
 {
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "%s", data);
-}
+	switch_status_t status = SWITCH_STATUS_FALSE;
+#ifdef RTP_REACTOR
+	rtp_relay_t *relay;
 #endif
 
+	memset(stats, 0, sizeof(*stats));
+
+#ifdef RTP_REACTOR
+	switch_mutex_lock(relay_mutex);
+	if ((relay = rtp_session->relay)) {
+		switch_mutex_lock(rtp_session->read_link->mutex);
+		*stats = relay->legs[relay->sessions[0] == rtp_session ? 0 : 1].stats;
+		switch_mutex_unlock(rtp_session->read_link->mutex);
+		status = SWITCH_STATUS_SUCCESS;
+	}
+	switch_mutex_unlock(relay_mutex);
+#endif
+
+	return status;
+}
+
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 {
 #ifdef ENABLE_ZRTP
@@ -1452,6 +3226,11 @@ SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 	srtp_init();
 #endif
 	switch_mutex_init(&port_lock, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&io_stats_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&relay_mutex, SWITCH_MUTEX_NESTED, pool);
+#ifdef RTP_REACTOR
+	rtp_reactor_start(pool);
+#endif
 	global_init = 1;
 }
 
@@ -2309,6 +4088,10 @@ SWITCH_DECLARE(void) switch_rtp_shutdown(void)
 	switch_core_hash_destroy(&alloc_hash);
 	switch_mutex_unlock(port_lock);
 
+#ifdef RTP_REACTOR
+	rtp_reactor_stop();
+#endif
+
 #ifdef ENABLE_ZRTP
 	if (zrtp_on) {
 		zrtp_status_t status = zrtp_status_ok;
@@ -2356,7 +4139,7 @@ SWITCH_DECLARE(void) switch_rtp_release_port(const char *ip, switch_port_t port)
 {
 	switch_core_port_allocator_t *alloc = NULL;
 
-	if (!ip || !port) {
+	if (!ip || !port || rtp_shared_port(port)) {
 		return;
 	}
 
@@ -2373,6 +4156,10 @@ SWITCH_DECLARE(switch_port_t) switch_rtp_request_port(const char *ip)
 	switch_port_t port = 0;
 	switch_core_port_allocator_t *alloc = NULL;
 
+	if (rtp_shared_port(RTP_SHARED_PORT)) {
+		return RTP_SHARED_PORT;
+	}
+
 	switch_mutex_lock(port_lock);
 	alloc = switch_core_hash_find(alloc_hash, ip);
 	if (!alloc) {
@@ -2435,6 +4222,10 @@ static switch_status_t enable_remote_rtcp_socket(switch_rtp_t *rtp_session, cons
 							  "Setting RTCP remote addr to %s:%d %d\n", host, rtp_session->remote_rtcp_port, rtp_session->rtcp_remote_addr->family);
 		}
 
+#ifdef RTP_REACTOR
+		rtp_shared_map_addr(rtp_session->rtcp_read_link, rtp_session->rtcp_remote_addr);
+#endif
+
 		if (rtp_session->rtcp_sock_input && switch_sockaddr_get_family(rtp_session->rtcp_remote_addr) == 
 			switch_sockaddr_get_family(rtp_session->rtcp_local_addr)) {
 			rtp_session->rtcp_sock_output = rtp_session->rtcp_sock_input;
@@ -2472,20 +4263,28 @@ static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const
 			*err = "RTCP Local Address Error!";
 			goto done;
 		}
-		
-		if (switch_socket_create(&rtcp_new_sock, switch_sockaddr_get_family(rtp_session->rtcp_local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Socket Error!";
-			goto done;
-		}
-		
-		if (switch_socket_opt_set(rtcp_new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Socket Error!";
-			goto done;
-		}
-		
-		if (switch_socket_bind(rtcp_new_sock, rtp_session->rtcp_local_addr) != SWITCH_STATUS_SUCCESS) {
-			*err = "RTCP Bind Error!";
-			goto done;
+
+		if (rtp_shared_port(port + 1)) {
+#ifdef RTP_REACTOR
+			if (!(rtcp_new_sock = rtp_shared_socket(host, port + 1, err))) {
+				goto done;
+			}
+#endif
+		} else {
+			if (switch_socket_create(&rtcp_new_sock, switch_sockaddr_get_family(rtp_session->rtcp_local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
+				*err = "RTCP Socket Error!";
+				goto done;
+			}
+
+			if (switch_socket_opt_set(rtcp_new_sock, SWITCH_SO_REUSEADDR, 1) != SWITCH_STATUS_SUCCESS) {
+				*err = "RTCP Socket Error!";
+				goto done;
+			}
+
+			if (switch_socket_bind(rtcp_new_sock, rtp_session->rtcp_local_addr) != SWITCH_STATUS_SUCCESS) {
+				*err = "RTCP Bind Error!";
+				goto done;
+			}
 		}
 		
 		if (switch_sockaddr_info_get(&rtp_session->rtcp_from_addr, switch_get_addr(bufa, sizeof(bufa), rtp_session->from_addr),
@@ -2499,6 +4298,7 @@ static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const
 		rtcp_new_sock = NULL;
 
 		switch_socket_create_pollset(&rtp_session->rtcp_read_pollfd, rtp_session->rtcp_sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
+		rtp_reactor_attach(rtp_session, &rtp_session->rtcp_read_link, rtp_session->rtcp_sock_input);
 
  done:
 		
@@ -2508,11 +4308,11 @@ static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const
 			status = SWITCH_STATUS_FALSE;
 		}
 
-		if (rtcp_new_sock) {
+		if (rtcp_new_sock && !rtp_socket_is_shared(rtcp_new_sock)) {
 			switch_socket_close(rtcp_new_sock);
 		}
 			
-		if (rtcp_old_sock) {
+		if (rtcp_old_sock && !rtp_socket_is_shared(rtcp_old_sock)) {
 			switch_socket_close(rtcp_old_sock);
 		}
 	} else {
@@ -2554,6 +4354,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		goto done;
 	}
 
+	/* the relay writes through the socket about to be replaced */
+	switch_rtp_relay_stop(rtp_session);
+
 
 	rtp_session->local_host_str = switch_core_strdup(rtp_session->pool, host);
 	rtp_session->local_port = port;
@@ -2569,6 +4372,15 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		switch_rtp_kill_socket(rtp_session);
 	}
 
+	if (rtp_shared_port(port)) {
+#ifdef RTP_REACTOR
+		if (!(new_sock = rtp_shared_socket(host, port, err))) {
+			goto done;
+		}
+#endif
+		goto shared;
+	}
+
 	if (switch_socket_create(&new_sock, switch_sockaddr_get_family(rtp_session->local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
 		*err = "Socket Error!";
 		goto done;
@@ -2649,6 +4461,8 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 
 #endif
 
+ shared:
+
 	old_sock = rtp_session->sock_input;
 	rtp_session->sock_input = new_sock;
 	new_sock = NULL;
@@ -2659,6 +4473,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 	}
 
 	switch_socket_create_pollset(&rtp_session->read_pollfd, rtp_session->sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
+	rtp_reactor_attach(rtp_session, &rtp_session->read_link, rtp_session->sock_input);
 
 	if (rtp_session->flags[SWITCH_RTP_FLAG_ENABLE_RTCP]) {
 		if ((status = enable_local_rtcp_socket(rtp_session, err)) == SWITCH_STATUS_SUCCESS) {
@@ -2677,7 +4492,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		switch_socket_close(new_sock);
 	}
 
-	if (old_sock) {
+	if (old_sock && !rtp_socket_is_shared(old_sock)) {
 		switch_socket_close(old_sock);
 	}
 
@@ -2753,10 +4568,19 @@ static void ping_socket(switch_rtp_t *rtp_session)
 {
 	uint32_t o = UINT_MAX;
 	switch_size_t len = sizeof(o);
-	switch_socket_sendto(rtp_session->sock_input, rtp_session->local_addr, 0, (void *) &o, &len);
+
+	if (rtp_socket_is_shared(rtp_session->sock_input)) {
+		rtp_reactor_wake(rtp_session->read_link);
+	} else {
+		switch_socket_sendto(rtp_session->sock_input, rtp_session->local_addr, 0, (void *) &o, &len);
+	}
 
 	if (rtp_session->flags[SWITCH_RTP_FLAG_ENABLE_RTCP] && rtp_session->rtcp_sock_input) {
-		switch_socket_sendto(rtp_session->rtcp_sock_input, rtp_session->rtcp_local_addr, 0, (void *) &o, &len);
+		if (rtp_socket_is_shared(rtp_session->rtcp_sock_input)) {
+			rtp_reactor_wake(rtp_session->rtcp_read_link);
+		} else {
+			switch_socket_sendto(rtp_session->rtcp_sock_input, rtp_session->rtcp_local_addr, 0, (void *) &o, &len);
+		}
 	}
 }
 
@@ -2768,6 +4592,8 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session)
 		return SWITCH_STATUS_FALSE;
 	}
 
+	switch_rtp_relay_stop(rtp_session);
+
 	if (switch_rtp_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA)) {
 		ping_socket(rtp_session);
 	}
@@ -2782,8 +4608,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session)
 	}
 
 	rtp_session->flags[SWITCH_RTP_FLAG_ENABLE_RTCP] = 0;
+	rtp_reactor_detach(rtp_session->rtcp_read_link);
 
-	if (rtp_session->rtcp_sock_input) {
+	if (rtp_session->rtcp_sock_input && !rtp_socket_is_shared(rtp_session->rtcp_sock_input)) {
 		ping_socket(rtp_session);
 		switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
 	}
@@ -2798,7 +4625,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_udptl_mode(switch_rtp_t *rtp_session)
 	} else {
 		if ((sock = rtp_session->rtcp_sock_input)) {
 			rtp_session->rtcp_sock_input = NULL;
-			switch_socket_close(sock);
+			if (!rtp_socket_is_shared(sock)) {
+				switch_socket_close(sock);
+			}
 			
 			if (rtp_session->rtcp_sock_output && rtp_session->rtcp_sock_output != sock) {
 				if ((sock = rtp_session->rtcp_sock_output)) {
@@ -2842,7 +4671,12 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_address(switch_rtp_t *rtp_
 
 	switch_mutex_lock(rtp_session->write_mutex);
 
+	rtp_send_flush(rtp_session);
 	rtp_session->remote_addr = remote_addr;
+#ifdef RTP_REACTOR
+	rtp_shared_map_addr(rtp_session->read_link, remote_addr);
+#endif
+	rtp_relay_retarget(rtp_session);
 
 	if (change_adv_addr) {
 		rtp_session->remote_host_str = switch_core_strdup(rtp_session->pool, host);
@@ -3390,7 +5224,8 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 	err_status_t stat;
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	
-	switch_channel_t *channel = switch_core_session_get_channel(rtp_session->session);
+	/* an rtp session made without a core session has no channel to note the crypto on */
+	switch_channel_t *channel = rtp_session->session ? switch_core_session_get_channel(rtp_session->session) : NULL;
 	switch_event_t *fsevent = NULL;
 	int idx = 0;
 	const char *var;
@@ -3424,7 +5259,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 	memset(policy, 0, sizeof(*policy));
 
 	/* many devices can't handle gaps in SRTP streams */
-	if (!((var = switch_channel_get_variable(channel, "srtp_allow_idle_gaps"))
+	if (channel && !((var = switch_channel_get_variable(channel, "srtp_allow_idle_gaps"))
 		  && switch_true(var))
 		&& (!(var = switch_channel_get_variable(channel, "send_silence_when_idle"))
 			|| !(atoi(var)))) {
@@ -3436,7 +5271,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy->rtp);
 		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy->rtcp);
 
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AES_CM_128_HMAC_SHA1_80");
 		}
 		break;
@@ -3445,7 +5280,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy->rtcp);
 
 
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AES_CM_128_HMAC_SHA1_32");
 		}
 		break;
@@ -3454,7 +5289,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		crypto_policy_set_aes_gcm_256_8_auth(&policy->rtp);
 		crypto_policy_set_aes_gcm_256_8_auth(&policy->rtcp);
 
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AEAD_AES_256_GCM_8");
 		}
 		break;
@@ -3463,7 +5298,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		crypto_policy_set_aes_gcm_128_8_auth(&policy->rtp);
 		crypto_policy_set_aes_gcm_128_8_auth(&policy->rtcp);
 
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AEAD_AES_128_GCM_8");
 		}
 		break;
@@ -3471,7 +5306,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 	case AES_CM_256_HMAC_SHA1_80:
 		crypto_policy_set_aes_cm_256_hmac_sha1_80(&policy->rtp);
 		crypto_policy_set_aes_cm_256_hmac_sha1_80(&policy->rtcp);
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AES_CM_256_HMAC_SHA1_80");
 		}
 		break;
@@ -3479,7 +5314,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		crypto_policy_set_aes_cm_128_null_auth(&policy->rtp);
 		crypto_policy_set_aes_cm_128_null_auth(&policy->rtcp);
 		
-		if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
+		if (channel && switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_OUTBOUND) {
 			switch_channel_set_variable(channel, "rtp_has_crypto", "AES_CM_128_NULL_AUTH");
 		}
 		break;
@@ -3545,7 +5380,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_add_crypto_key(switch_rtp_t *rtp_sess
 		break;
 	}
 
-	if (switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
+	if (channel && switch_event_create(&fsevent, SWITCH_EVENT_CALL_SECURE) == SWITCH_STATUS_SUCCESS) {
 		if (rtp_session->dtls) {
 			switch_event_add_header(fsevent, SWITCH_STACK_BOTTOM, "secure_type", "srtp:dtls:AES_CM_128_HMAC_SHA1_80");
 			switch_channel_set_variable(channel, "rtp_has_crypto", "srtp:dtls:AES_CM_128_HMAC_SHA1_80");
@@ -3624,6 +5459,11 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_ssrc(switch_rtp_t *rtp_ses
 {
 	rtp_session->remote_ssrc = ssrc;
 
+#ifdef RTP_REACTOR
+	rtp_shared_map_ssrc(rtp_session->read_link, ssrc);
+	rtp_shared_map_ssrc(rtp_session->rtcp_read_link, ssrc);
+#endif
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -4163,6 +6003,9 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_ice(switch_rtp_t *rtp_sessio
 	ice->ice_user = switch_core_strdup(rtp_session->pool, ice_user);
 	ice->user_ice = switch_core_strdup(rtp_session->pool, user_ice);
 	ice->luser_ice = switch_core_strdup(rtp_session->pool, luser_ice);
+#ifdef RTP_REACTOR
+	rtp_shared_map(proto == IPR_RTP ? rtp_session->read_link : rtp_session->rtcp_read_link, RTP_SHARED_ICE, user_ice, (uint32_t) strlen(user_ice));
+#endif
 	ice->type = type;
 	ice->ice_params = ice_params;
 	ice->pass = "";
@@ -4311,10 +6154,13 @@ SWITCH_DECLARE(void) switch_rtp_break(switch_rtp_t *rtp_session)
 SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
 {
 	switch_assert(rtp_session != NULL);
+	switch_rtp_relay_stop(rtp_session);
 	switch_mutex_lock(rtp_session->flag_mutex);
 	if (rtp_session->flags[SWITCH_RTP_FLAG_IO]) {
 		rtp_session->flags[SWITCH_RTP_FLAG_IO] = 0;
-		if (rtp_session->sock_input) {
+		rtp_reactor_close(rtp_session->read_link);
+		rtp_reactor_close(rtp_session->rtcp_read_link);
+		if (rtp_session->sock_input && !rtp_socket_is_shared(rtp_session->sock_input)) {
 			ping_socket(rtp_session);
 			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
 		}
@@ -4323,7 +6169,7 @@ SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
 		}
 		
 		if (rtp_session->flags[SWITCH_RTP_FLAG_ENABLE_RTCP]) {
-			if (rtp_session->rtcp_sock_input) {
+			if (rtp_session->rtcp_sock_input && !rtp_socket_is_shared(rtp_session->rtcp_sock_input)) {
 				ping_socket(rtp_session);
 				switch_socket_shutdown(rtp_session->rtcp_sock_input, SWITCH_SHUTDOWN_READWRITE);
 			}
@@ -4365,9 +6211,13 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 
 	(*rtp_session)->flags[SWITCH_RTP_FLAG_SHUTDOWN] = 1;
 
+	switch_rtp_relay_stop(*rtp_session);
+
 	READ_INC((*rtp_session));
 	WRITE_INC((*rtp_session));
 
+	/* the last frame may still be queued for a sendmmsg */
+	rtp_send_flush(*rtp_session);
 	(*rtp_session)->ready = 0;
 
 	READ_DEC((*rtp_session));
@@ -4412,9 +6262,14 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 	}
 
 
+	rtp_reactor_detach((*rtp_session)->read_link);
+	rtp_reactor_detach((*rtp_session)->rtcp_read_link);
+
 	sock = (*rtp_session)->sock_input;
 	(*rtp_session)->sock_input = NULL;
-	switch_socket_close(sock);
+	if (!rtp_socket_is_shared(sock)) {
+		switch_socket_close(sock);
+	}
 
 	if ((*rtp_session)->sock_output != sock) {
 		sock = (*rtp_session)->sock_output;
@@ -4424,7 +6279,9 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 
 	if ((sock = (*rtp_session)->rtcp_sock_input)) {
 		(*rtp_session)->rtcp_sock_input = NULL;
-		switch_socket_close(sock);
+		if (!rtp_socket_is_shared(sock)) {
+			switch_socket_close(sock);
+		}
 
 		if ((*rtp_session)->rtcp_sock_output && (*rtp_session)->rtcp_sock_output != sock) {
 			if ((sock = (*rtp_session)->rtcp_sock_output)) {
@@ -4622,6 +6479,8 @@ SWITCH_DECLARE(void) switch_rtp_clear_flag(switch_rtp_t *rtp_session, switch_rtp
 		reset_jitter_seq(rtp_session);
 	} else if (flag == SWITCH_RTP_FLAG_NOBLOCK && rtp_session->sock_input) {
 		switch_socket_opt_set(rtp_session->sock_input, SWITCH_SO_NONBLOCK, FALSE);
+	} else if (flag == SWITCH_RTP_FLAG_PROXY_MEDIA) {
+		switch_rtp_relay_stop(rtp_session);
 	}
 }
 
@@ -4898,7 +6757,7 @@ static void do_flush(switch_rtp_t *rtp_session, int force)
 		do {
 			if (switch_rtp_ready(rtp_session)) {
 				bytes = sizeof(rtp_msg_t);
-				switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, &bytes);
+				rtp_recvfrom(rtp_session->read_link, rtp_session->from_addr, rtp_session->sock_input, (void *) &rtp_session->recv_msg, &bytes);
 				
 				if (bytes) {
 					int do_cng = 0;
@@ -4982,7 +6841,7 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	sync = 0;
 
 	if (poll_status == SWITCH_STATUS_SUCCESS) {
-		status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+		status = rtp_recvfrom(rtp_session->read_link, rtp_session->from_addr, rtp_session->sock_input, (void *) &rtp_session->recv_msg, bytes);
 	} else {
 		*bytes = 0;
 	}
@@ -5773,7 +7632,8 @@ static switch_status_t read_rtcp_packet(switch_rtp_t *rtp_session, switch_size_t
 
 	*bytes = sizeof(rtcp_msg_t);
 
-	if ((status = switch_socket_recvfrom(rtp_session->rtcp_from_addr, rtp_session->rtcp_sock_input, 0, (void *) rtp_session->rtcp_recv_msg_p, bytes)) 
+	if ((status = rtp_recvfrom(rtp_session->rtcp_sock_input == rtp_session->sock_input ? rtp_session->read_link : rtp_session->rtcp_read_link,
+							   rtp_session->rtcp_from_addr, rtp_session->rtcp_sock_input, (void *) rtp_session->rtcp_recv_msg_p, bytes))
 		!= SWITCH_STATUS_SUCCESS) {
 		*bytes = 0;
 	}
@@ -5896,7 +7756,10 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 
 	READ_INC(rtp_session);
 
-
+	/* count what a relay that has since stopped moved for the session */
+	if (!rtp_session->relay && rtp_session->relay_unseen.packets) {
+		rtp_relay_account(rtp_session);
+	}
 
 	while (switch_rtp_ready(rtp_session)) {
 		int do_cng = 0;
@@ -5913,7 +7776,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 			rtp_session->read_pollfd) {
 			
 			if (rtp_session->jb && !rtp_session->pause_jb && jb_valid(rtp_session)) {
-				while (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+				while (rtp_poll_read(rtp_session->read_link, rtp_session->read_pollfd, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 					status = read_rtp_packet(rtp_session, &bytes, flags, SWITCH_STATUS_SUCCESS, SWITCH_FALSE);
 
 					if (status == SWITCH_STATUS_GENERR) {
@@ -5936,7 +7799,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				
 			} else if ((rtp_session->flags[SWITCH_RTP_FLAG_AUTOFLUSH] || rtp_session->flags[SWITCH_RTP_FLAG_STICKY_FLUSH])) {
 				
-				if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+				if (rtp_poll_read(rtp_session->read_link, rtp_session->read_pollfd, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 					status = read_rtp_packet(rtp_session, &bytes, flags, SWITCH_STATUS_SUCCESS, SWITCH_FALSE);
 					if (status == SWITCH_STATUS_GENERR) {
 						ret = -1;
@@ -5955,7 +7818,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 					}
 
 					if (bytes) {
-						if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+						if (rtp_poll_read(rtp_session->read_link, rtp_session->read_pollfd, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 							rtp_session->hot_hits++;//+= rtp_session->samples_per_interval;
 							
 							switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG10, "%s Hot Hit %d\n", 
@@ -6054,7 +7917,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				}
 			}
 			
-			poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, pt);
+			poll_status = rtp_poll_read(rtp_session->read_link, rtp_session->read_pollfd, &fdr, pt);
 
 
 			//if (rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
@@ -6140,6 +8003,11 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				rtp_session->missed_count += (poll_sec * 1000) / (rtp_session->ms_per_packet ? rtp_session->ms_per_packet / 1000 : 20);
 				bytes = 0;
 
+				/* a relayed session only reads what the reactor could not forward */
+				if (rtp_session->relay && rtp_relay_account(rtp_session)) {
+					rtp_session->missed_count = 0;
+				}
+
 				if (rtp_session->max_missed_packets) {
 					if (rtp_session->missed_count >= rtp_session->max_missed_packets) {
 						ret = -2;
@@ -6176,7 +8044,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				has_rtcp = 0;
 				
 			} else if (rtp_session->rtcp_read_pollfd) {
-				rtcp_poll_status = switch_poll(rtp_session->rtcp_read_pollfd, 1, &rtcp_fdr, 0);
+				rtcp_poll_status = rtp_poll_read(rtp_session->rtcp_read_link, rtp_session->rtcp_read_pollfd, &rtcp_fdr, 0);
 			}
 						
 			if (rtcp_poll_status == SWITCH_STATUS_SUCCESS) {
@@ -6906,6 +8774,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 	int ret;
 	switch_time_t now;
 	uint8_t m = 0;
+	int protect = 0;
 
 	if (!switch_rtp_ready(rtp_session)) {
 		return -1;
@@ -7189,6 +9058,8 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 
 			if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND_RESET] || !rtp_session->send_ctx[rtp_session->srtp_idx_rtp]) {
 				
+				/* anything queued in the clear goes out under the keys it was written with */
+				rtp_send_flush(rtp_session);
 				switch_rtp_clear_flag(rtp_session, SWITCH_RTP_FLAG_SECURE_SEND_RESET);
 				srtp_dealloc(rtp_session->send_ctx[rtp_session->srtp_idx_rtp]);
 				rtp_session->send_ctx[rtp_session->srtp_idx_rtp] = NULL;
@@ -7206,14 +9077,23 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 			}
 
 
-			stat = srtp_protect(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], &send_msg->header, &sbytes);
+			if (rtp_send_batched(rtp_session, bytes + SRTP_MAX_TRAILER_LEN)
+#ifdef ENABLE_ZRTP
+				&& !(zrtp_on && !rtp_session->flags[SWITCH_RTP_FLAG_PROXY_MEDIA])
+#endif
+				) {
+				/* protected with the rest of its frame when the batch is flushed */
+				protect = 1;
+			} else {
+				stat = srtp_protect(rtp_session->send_ctx[rtp_session->srtp_idx_rtp], &send_msg->header, &sbytes);
 			
-			if (stat) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, 
-								  "Error: %s SRTP protection failed with code %d\n", rtp_type(rtp_session), stat);
-			}
+				if (stat) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, 
+									  "Error: %s SRTP protection failed with code %d\n", rtp_type(rtp_session), stat);
+				}
 
-			bytes = sbytes;
+				bytes = sbytes;
+			}
 		}
 #endif
 #ifdef ENABLE_ZRTP
@@ -7276,7 +9156,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 
 		}
 		
-		if (rtp_session->flags[SWITCH_RTP_FLAG_NACK]) {
+		if (rtp_session->flags[SWITCH_RTP_FLAG_NACK] && !protect) {
 			if (!rtp_session->vbw) {
 				switch_jb_create(&rtp_session->vbw, SJB_VIDEO, 10, 10, rtp_session->pool);
 				//switch_jb_debug_level(rtp_session->vbw, 10);
@@ -7306,7 +9186,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 		//
 		//	//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SEND %u\n", ntohs(send_msg->header.seq));
 		//}
-		if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) send_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
+		if (rtp_send(rtp_session, send_msg, &bytes, protect) != SWITCH_STATUS_SUCCESS) {
 			rtp_session->seq--;
 			ret = -1;
 			goto end;
@@ -7339,6 +9219,11 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 		}
 
 		rtp_session->last_write_timestamp = switch_micro_time_now();
+
+		/* the write that closes a frame sends whatever the frame queued */
+		if (send_msg->header.m || (flags && (*flags & SFF_MARKER))) {
+			rtp_send_flush(rtp_session);
+		}
 	}
 
 	ret = (int) bytes;
@@ -7631,8 +9516,19 @@ SWITCH_DECLARE(switch_rtp_stats_t *) switch_rtp_get_stats(switch_rtp_t *rtp_sess
 
 	switch_mutex_lock(rtp_session->flag_mutex);
 	if (pool) {
+		switch_rtp_relay_stats_t unseen;
+
 		s = switch_core_alloc(pool, sizeof(*s));
 		*s = rtp_session->stats;
+
+		/* the copy includes what a relay moved that the session's read has not counted yet */
+		switch_mutex_lock(relay_mutex);
+		rtp_relay_unseen(rtp_session, &unseen, SWITCH_FALSE);
+		switch_mutex_unlock(relay_mutex);
+		s->inbound.raw_bytes += unseen.bytes;
+		s->inbound.media_bytes += unseen.bytes;
+		s->inbound.packet_count += unseen.packets;
+		s->inbound.media_packet_count += unseen.packets;
 	} else {
 		s = &rtp_session->stats;
 	}
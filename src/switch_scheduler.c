@@ -32,6 +32,25 @@
 
 #include <switch.h>
 
+/* timer wheel geometry: 256 one second slots, then levels of 64 slots each 64 times coarser */
+#define WHEEL_ROOT_BITS 8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_ROOT_SIZE (1 << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1 << WHEEL_LEVEL_BITS)
+#define WHEEL_ROOT_MASK (WHEEL_ROOT_SIZE - 1)
+#define WHEEL_LEVEL_MASK (WHEEL_LEVEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_ROOT_BITS + WHEEL_LEVELS * WHEEL_LEVEL_BITS))
+#define WHEEL_LEVEL_SHIFT(_l) (WHEEL_ROOT_BITS + (_l) * WHEEL_LEVEL_BITS)
+
+/* how far (seconds) the wall clock may drift from the wheel before the wheel is re-seeded instead of stepped */
+#define WHEEL_CLOCK_DRIFT 5
+
+/* how long the task thread sleeps between looks at the wheel (microseconds) */
+#define TASK_THREAD_TICK 100000
+
+struct switch_scheduler_task_list;
+
 struct switch_scheduler_task_container {
 	switch_scheduler_task_t task;
 	int64_t executed;
@@ -42,10 +61,20 @@ struct switch_scheduler_task_container {
 	switch_memory_pool_t *pool;
 	uint32_t flags;
 	char *desc;
+	/*! the wheel slot, due or dead list the task sits on, NULL while it runs */
+	struct switch_scheduler_task_list *list;
+	struct switch_scheduler_task_container *prev;
 	struct switch_scheduler_task_container *next;
+	/*! every task, for group deletes and shutdown */
+	struct switch_scheduler_task_container *all_prev;
+	struct switch_scheduler_task_container *all_next;
 };
 typedef struct switch_scheduler_task_container switch_scheduler_task_container_t;
 
+typedef struct switch_scheduler_task_list {
+	switch_scheduler_task_container_t *head;
+} switch_scheduler_task_list_t;
+
 static struct {
 	switch_scheduler_task_container_t *task_list;
 	switch_mutex_t *task_mutex;
@@ -53,8 +82,196 @@ static struct {
 	int task_thread_running;
 	switch_queue_t *event_queue;
 	switch_memory_pool_t *memory_pool;
+	/*! task_id -> task */
+	switch_inthash_t *task_index;
+	/*! the next second the wheel has to process */
+	int64_t clock;
+	switch_scheduler_task_list_t wheel_root[WHEEL_ROOT_SIZE];
+	switch_scheduler_task_list_t wheel[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+	/*! tasks whose time has come, being worked through by the task thread */
+	switch_scheduler_task_list_t due;
+	/*! tasks waiting to be freed by the task thread */
+	switch_scheduler_task_list_t dead;
 } globals;
 
+static void task_list_push(switch_scheduler_task_list_t *list, switch_scheduler_task_container_t *tp)
+{
+	tp->list = list;
+	tp->prev = NULL;
+	tp->next = list->head;
+
+	if (list->head) {
+		list->head->prev = tp;
+	}
+
+	list->head = tp;
+}
+
+static void task_list_unlink(switch_scheduler_task_container_t *tp)
+{
+	if (!tp->list) {
+		return;
+	}
+
+	if (tp->prev) {
+		tp->prev->next = tp->next;
+	} else {
+		tp->list->head = tp->next;
+	}
+
+	if (tp->next) {
+		tp->next->prev = tp->prev;
+	}
+
+	tp->list = NULL;
+	tp->prev = tp->next = NULL;
+}
+
+/* Due tasks are decided against now rather than the wheel position, so a clock stepped back never runs one early,
+   must be called with the task mutex held */
+static void task_wheel_add(switch_scheduler_task_container_t *tp, int64_t now)
+{
+	int64_t runtime = tp->task.runtime;
+	int64_t delta;
+	int level;
+
+	if (runtime <= now) {
+		task_list_push(&globals.due, tp);
+		return;
+	}
+
+	if (runtime < globals.clock) {
+		/* the clock stepped back a little and the wheel already passed this second, it goes out with the next one */
+		runtime = globals.clock;
+	}
+
+	delta = runtime - globals.clock;
+
+	if (delta < WHEEL_ROOT_SIZE) {
+		task_list_push(&globals.wheel_root[runtime & WHEEL_ROOT_MASK], tp);
+		return;
+	}
+
+	if (delta >= WHEEL_SPAN) {
+		/* parked in the last slot it can reach, it will be placed again when that slot cascades */
+		runtime = globals.clock + WHEEL_SPAN - 1;
+		delta = WHEEL_SPAN - 1;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < ((int64_t) 1 << WHEEL_LEVEL_SHIFT(level + 1))) {
+			break;
+		}
+	}
+
+	task_list_push(&globals.wheel[level][(runtime >> WHEEL_LEVEL_SHIFT(level)) & WHEEL_LEVEL_MASK], tp);
+}
+
+/* must be called with the task mutex held */
+static void task_wheel_cascade(int level, int64_t now)
+{
+	switch_scheduler_task_list_t *slot = &globals.wheel[level][(globals.clock >> WHEEL_LEVEL_SHIFT(level)) & WHEEL_LEVEL_MASK];
+	switch_scheduler_task_container_t *tp;
+
+	while ((tp = slot->head)) {
+		task_list_unlink(tp);
+		task_wheel_add(tp, now);
+	}
+}
+
+static void task_wheel_collect(switch_scheduler_task_list_t *slot, switch_scheduler_task_list_t *pending)
+{
+	switch_scheduler_task_container_t *tp;
+
+	while ((tp = slot->head)) {
+		task_list_unlink(tp);
+		task_list_push(pending, tp);
+	}
+}
+
+/* Starts the wheel over at now and places every pending task again, must be called with the task mutex held */
+static void task_wheel_rebase(int64_t now)
+{
+	switch_scheduler_task_list_t pending = { 0 };
+	switch_scheduler_task_container_t *tp;
+	int i, level;
+
+	for (i = 0; i < WHEEL_ROOT_SIZE; i++) {
+		task_wheel_collect(&globals.wheel_root[i], &pending);
+	}
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		for (i = 0; i < WHEEL_LEVEL_SIZE; i++) {
+			task_wheel_collect(&globals.wheel[level][i], &pending);
+		}
+	}
+
+	globals.clock = now;
+
+	while ((tp = pending.head)) {
+		task_list_unlink(tp);
+		task_wheel_add(tp, now);
+	}
+}
+
+/* Moves every task due by now onto the due list, must be called with the task mutex held */
+static void task_wheel_advance(int64_t now)
+{
+	int64_t drift = now - (globals.clock - 1);
+
+	if (drift > WHEEL_CLOCK_DRIFT || drift < -WHEEL_CLOCK_DRIFT) {
+		/* the wall clock was stepped, stepping the wheel a second at a time to catch up would hold the task mutex for ages */
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Clock moved by %" SWITCH_INT64_T_FMT " seconds, rescheduling tasks\n", drift);
+		task_wheel_rebase(now);
+	}
+
+	while (globals.clock <= now) {
+		switch_scheduler_task_list_t *slot = &globals.wheel_root[globals.clock & WHEEL_ROOT_MASK];
+		switch_scheduler_task_container_t *tp;
+
+		if (!(globals.clock & WHEEL_ROOT_MASK)) {
+			int level;
+
+			for (level = 0; level < WHEEL_LEVELS; level++) {
+				task_wheel_cascade(level, now);
+
+				if ((globals.clock >> WHEEL_LEVEL_SHIFT(level)) & WHEEL_LEVEL_MASK) {
+					break;
+				}
+			}
+		}
+
+		while ((tp = slot->head)) {
+			task_list_unlink(tp);
+			task_list_push(&globals.due, tp);
+		}
+
+		globals.clock++;
+	}
+}
+
+/* Puts a task that has just run back where it belongs, must be called with the task mutex held */
+static void task_requeue(switch_scheduler_task_container_t *tp, int64_t now)
+{
+	if (tp->destroyed) {
+		task_list_push(&globals.dead, tp);
+	} else {
+		task_wheel_add(tp, now);
+	}
+}
+
+/* Takes a task out of the wheel on its way to be freed, must be called with the task mutex held */
+static void task_destroy(switch_scheduler_task_container_t *tp)
+{
+	tp->destroyed++;
+
+	/* running tasks are not on any list, they are sorted out when they return */
+	if (tp->list && tp->list != &globals.dead) {
+		task_list_unlink(tp);
+		task_list_push(&globals.dead, tp);
+	}
+}
+
 static void switch_scheduler_execute(switch_scheduler_task_container_t *tp)
 {
 	switch_event_t *event;
@@ -91,84 +308,92 @@ static void *SWITCH_THREAD_FUNC task_own_thread(switch_thread_t *thread, void *o
 
 	switch_scheduler_execute(tp);
 	switch_core_destroy_memory_pool(&pool);
+
+	switch_mutex_lock(globals.task_mutex);
 	tp->in_thread = 0;
+	task_requeue(tp, switch_epoch_time_now(NULL));
+	switch_mutex_unlock(globals.task_mutex);
 
 	return NULL;
 }
 
 static int task_thread_loop(int done)
 {
-	switch_scheduler_task_container_t *tofree, *tp, *last = NULL;
-
+	switch_scheduler_task_container_t *tofree, *tp;
+	int64_t now = switch_epoch_time_now(NULL);
 
 	switch_mutex_lock(globals.task_mutex);
 
-	for (tp = globals.task_list; tp; tp = tp->next) {
-		if (done) {
-			tp->destroyed = 1;
-		} else if (!tp->destroyed) {
-			int64_t now = switch_epoch_time_now(NULL);
-			if (now >= tp->task.runtime && !tp->in_thread) {
-				int32_t diff = (int32_t) (now - tp->task.runtime);
-				if (diff > 1) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Task was executed late by %d seconds %u %s (%s)\n",
-									  diff, tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
-				}
-				tp->executed = now;
-				if (switch_test_flag(tp, SSHF_OWN_THREAD)) {
-					switch_thread_t *thread;
-					switch_threadattr_t *thd_attr;
-					switch_core_new_memory_pool(&tp->pool);
-					switch_threadattr_create(&thd_attr, tp->pool);
-					switch_threadattr_detach_set(thd_attr, 1);
-					tp->in_thread = 1;
-					switch_thread_create(&thread, thd_attr, task_own_thread, tp, tp->pool);
-				} else {
-					tp->running = 1;
-					switch_mutex_unlock(globals.task_mutex);
-					switch_scheduler_execute(tp);
-					switch_mutex_lock(globals.task_mutex);
-					tp->running = 0;
-				}
-			}
+	if (done) {
+		for (tp = globals.task_list; tp; tp = tp->all_next) {
+			task_destroy(tp);
 		}
+	} else {
+		task_wheel_advance(now);
 	}
-	switch_mutex_unlock(globals.task_mutex);
-	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp;) {
-		if (tp->destroyed && !tp->in_thread) {
-			switch_event_t *event;
-
-			tofree = tp;
-			tp = tp->next;
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleting task %u %s (%s)\n",
-							  tofree->task.task_id, tofree->desc, switch_str_nil(tofree->task.group));
-
-
-			if (switch_event_create(&event, SWITCH_EVENT_DEL_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tofree->task.task_id);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tofree->desc);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tofree->task.group));
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tofree->task.runtime);
-				switch_queue_push(globals.event_queue, event);
-				event = NULL;
-			}
 
-			if (last) {
-				last->next = tofree->next;
-			} else {
-				globals.task_list = tofree->next;
-			}
-			switch_safe_free(tofree->task.group);
-			if (tofree->task.cmd_arg && switch_test_flag(tofree, SSHF_FREE_ARG)) {
-				free(tofree->task.cmd_arg);
-			}
-			switch_safe_free(tofree->desc);
-			free(tofree);
+	while ((tp = globals.due.head)) {
+		int32_t diff = (int32_t) (now - tp->task.runtime);
+
+		task_list_unlink(tp);
+
+		if (diff > 1) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Task was executed late by %d seconds %u %s (%s)\n",
+							  diff, tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
+		}
+		tp->executed = now;
+		if (switch_test_flag(tp, SSHF_OWN_THREAD)) {
+			switch_thread_t *thread;
+			switch_threadattr_t *thd_attr;
+			switch_core_new_memory_pool(&tp->pool);
+			switch_threadattr_create(&thd_attr, tp->pool);
+			switch_threadattr_detach_set(thd_attr, 1);
+			tp->in_thread = 1;
+			switch_thread_create(&thread, thd_attr, task_own_thread, tp, tp->pool);
 		} else {
-			last = tp;
-			tp = tp->next;
+			tp->running = 1;
+			switch_mutex_unlock(globals.task_mutex);
+			switch_scheduler_execute(tp);
+			switch_mutex_lock(globals.task_mutex);
+			tp->running = 0;
+			task_requeue(tp, now);
+		}
+	}
+
+	while ((tofree = globals.dead.head)) {
+		switch_event_t *event;
+
+		task_list_unlink(tofree);
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleting task %u %s (%s)\n",
+						  tofree->task.task_id, tofree->desc, switch_str_nil(tofree->task.group));
+
+
+		if (switch_event_create(&event, SWITCH_EVENT_DEL_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tofree->task.task_id);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tofree->desc);
+			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tofree->task.group));
+			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tofree->task.runtime);
+			switch_queue_push(globals.event_queue, event);
+			event = NULL;
+		}
+
+		if (tofree->all_prev) {
+			tofree->all_prev->all_next = tofree->all_next;
+		} else {
+			globals.task_list = tofree->all_next;
+		}
+		if (tofree->all_next) {
+			tofree->all_next->all_prev = tofree->all_prev;
+		}
+		switch_core_inthash_delete(globals.task_index, tofree->task.task_id);
+
+		switch_safe_free(tofree->task.group);
+		if (tofree->task.cmd_arg && switch_test_flag(tofree, SSHF_FREE_ARG)) {
+			free(tofree->task.cmd_arg);
 		}
+		switch_safe_free(tofree->desc);
+		free(tofree);
 	}
 	switch_mutex_unlock(globals.task_mutex);
 
@@ -185,9 +410,14 @@ static void *SWITCH_THREAD_FUNC switch_scheduler_task_thread(switch_thread_t *th
 		if (task_thread_loop(0)) {
 			break;
 		}
-		if (switch_queue_pop_timeout(globals.event_queue, &pop, 500000) == SWITCH_STATUS_SUCCESS) {
+		if (switch_queue_pop_timeout(globals.event_queue, &pop, TASK_THREAD_TICK) == SWITCH_STATUS_SUCCESS) {
 			switch_event_t *event = (switch_event_t *) pop;
 			switch_event_fire(&event);
+
+			while (switch_queue_trypop(globals.event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				event = (switch_event_t *) pop;
+				switch_event_fire(&event);
+			}
 		}
 	}
 
@@ -233,15 +463,19 @@ SWITCH_DECLARE(uint32_t) switch_scheduler_add_task(time_t task_runtime,
 	container->desc = strdup(desc ? desc : "none");
 	container->task.hash = switch_ci_hashfunc_default(container->task.group, &hlen);
 
-	for (tp = globals.task_list; tp && tp->next; tp = tp->next);
-
-	if (tp) {
-		tp->next = container;
-	} else {
-		globals.task_list = container;
+	container->all_next = globals.task_list;
+	if (globals.task_list) {
+		globals.task_list->all_prev = container;
 	}
+	globals.task_list = container;
+
+	/* ids wrap eventually, never hand out one a long lived task still holds */
+	do {
+		container->task.task_id = ++globals.task_id;
+	} while (!container->task.task_id || switch_core_inthash_find(globals.task_index, container->task.task_id));
 
-	for (container->task.task_id = 0; !container->task.task_id; container->task.task_id = ++globals.task_id);
+	switch_core_inthash_insert(globals.task_index, container->task.task_id, container);
+	task_wheel_add(container, now);
 
 	switch_mutex_unlock(globals.task_mutex);
 
@@ -266,23 +500,16 @@ SWITCH_DECLARE(uint32_t) switch_scheduler_del_task_id(uint32_t task_id)
 	uint32_t delcnt = 0;
 
 	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp; tp = tp->next) {
-		if (tp->task.task_id == task_id) {
-			if (switch_test_flag(tp, SSHF_NO_DEL)) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete undeletable task #%u (group %s)\n",
-								  tp->task.task_id, tp->task.group);
-				break;
-			}
-
-			if (tp->running) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete running task #%u (group %s)\n",
-								  tp->task.task_id, tp->task.group);
-				break;
-			}
-
-			tp->destroyed++;
+	if ((tp = switch_core_inthash_find(globals.task_index, task_id))) {
+		if (switch_test_flag(tp, SSHF_NO_DEL)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete undeletable task #%u (group %s)\n",
+							  tp->task.task_id, tp->task.group);
+		} else if (tp->running) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete running task #%u (group %s)\n",
+							  tp->task.task_id, tp->task.group);
+		} else {
+			task_destroy(tp);
 			delcnt++;
-			break;
 		}
 	}
 	switch_mutex_unlock(globals.task_mutex);
@@ -304,7 +531,7 @@ SWITCH_DECLARE(uint32_t) switch_scheduler_del_task_group(const char *group)
 	hash = switch_ci_hashfunc_default(group, &hlen);
 
 	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp; tp = tp->next) {
+	for (tp = globals.task_list; tp; tp = tp->all_next) {
 		if (tp->destroyed) {
 			continue;
 		}
@@ -314,7 +541,7 @@ SWITCH_DECLARE(uint32_t) switch_scheduler_del_task_group(const char *group)
 								  tp->task.task_id, group);
 				continue;
 			}
-			tp->destroyed++;
+			task_destroy(tp);
 			delcnt++;
 		}
 	}
@@ -334,6 +561,8 @@ SWITCH_DECLARE(void) switch_scheduler_task_thread_start(void)
 	switch_threadattr_create(&thd_attr, globals.memory_pool);
 	switch_mutex_init(&globals.task_mutex, SWITCH_MUTEX_NESTED, globals.memory_pool);
 	switch_queue_create(&globals.event_queue, 250000, globals.memory_pool);
+	switch_core_inthash_init(&globals.task_index);
+	globals.clock = switch_epoch_time_now(NULL);
 
 	switch_thread_create(&task_thread_p, thd_attr, switch_scheduler_task_thread, NULL, globals.memory_pool);
 }
@@ -356,7 +585,8 @@ SWITCH_DECLARE(void) switch_scheduler_task_thread_stop(void)
 			}
 		}
 	}
-	
+
+	switch_core_inthash_destroy(&globals.task_index);
 	switch_core_destroy_memory_pool(&globals.memory_pool);
 
 }
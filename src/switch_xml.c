@@ -2288,6 +2288,10 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_open_root(uint8_t reload, const char **e
 
 
 	if (root) {
+		if (reload) {
+			switch_regex_cache_flush();
+		}
+
 		if (switch_event_create(&event, SWITCH_EVENT_RELOADXML) == SWITCH_STATUS_SUCCESS) {
 			if (switch_event_fire(&event) != SWITCH_STATUS_SUCCESS) {
 				switch_event_destroy(&event);
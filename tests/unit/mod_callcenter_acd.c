@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+#include "cc_acd.h"
+
+// #define BENCHMARK 1
+
+typedef struct {
+  uint32_t offers;
+  const char *agent;
+  cc_acd_member_t *member;
+  /* offers made during the current pass, answered by the simulation */
+  cc_acd_offer_t *pending;
+  uint32_t npending;
+  uint32_t pending_size;
+  /* when the agents offered the next calls became free, for time-to-offer */
+  switch_time_t mark;
+  switch_time_t offer_usec;
+  switch_time_t offer_usec_max;
+  uint32_t timed;
+} sim_t;
+
+static void sim_offer(cc_acd_t *acd, const cc_acd_offer_t *offer, void *pdata)
+{
+  sim_t *sim = (sim_t *) pdata;
+
+  sim->offers++;
+  sim->agent = offer->agent->name;
+  sim->member = offer->member;
+
+  if (sim->mark) {
+    switch_time_t usec = switch_time_now() - sim->mark;
+
+    sim->offer_usec += usec;
+    if (usec > sim->offer_usec_max) {
+      sim->offer_usec_max = usec;
+    }
+    sim->timed++;
+  }
+
+  if (sim->pending_size) {
+    if (sim->npending == sim->pending_size) {
+      sim->pending_size *= 2;
+      sim->pending = realloc(sim->pending, sim->pending_size * sizeof(*sim->pending));
+    }
+    sim->pending[sim->npending++] = *offer;
+  }
+}
+
+static cc_acd_queue_t *sim_queue(cc_acd_t *acd, const char *name, const char *strategy)
+{
+  cc_acd_queue_t *queue = cc_acd_queue_find(acd, name, SWITCH_TRUE);
+
+  cc_acd_queue_set_strategy(acd, queue, strategy);
+  queue->discard_abandoned_after = 60;
+  queue->configured = SWITCH_TRUE;
+
+  return queue;
+}
+
+static cc_acd_agent_t *sim_agent(cc_acd_t *acd, const char *queue, const char *name, int level, int position, switch_time_t last_bridge_end, switch_time_t now)
+{
+  cc_acd_agent_t *agent = cc_acd_agent_add(acd, name, CC_SYSTEM_SELF, "callback");
+
+  agent->status = CC_AGENT_STATUS_AVAILABLE;
+  agent->last_bridge_end = last_bridge_end;
+  cc_acd_agent_changed(acd, agent, now);
+  cc_acd_tier_add(acd, queue, agent, CC_TIER_STATE_READY, level, position, now);
+
+  return agent;
+}
+
+/* What outbound_agent_thread_run() leaves behind once the agent hung up, or never answered */
+static void sim_release(cc_acd_t *acd, cc_acd_agent_t *agent, cc_acd_member_t *member, switch_bool_t answered, switch_time_t now)
+{
+  cc_acd_tier_t *tier;
+
+  if (answered) {
+    agent->last_bridge_start = now;
+    agent->last_bridge_end = now;
+    agent->calls_answered++;
+    cc_acd_member_del(acd, member);
+  } else {
+    member->state = CC_MEMBER_STATE_WAITING;
+    cc_acd_set_string(&member->serving_agent, "");
+    cc_acd_set_string(&member->serving_system, "");
+  }
+
+  agent->state = CC_AGENT_STATE_WAITING;
+  for (tier = agent->tiers; tier; tier = tier->agent_next) {
+    tier->state = CC_TIER_STATE_READY;
+  }
+  cc_acd_agent_changed(acd, agent, now);
+}
+
+static const char *sim_pick(cc_acd_t *acd, sim_t *sim, const char *queue, const char *uuid, switch_time_t joined, switch_time_t now)
+{
+  cc_acd_events_t events = { sim_offer, NULL, NULL, sim };
+
+  sim->agent = NULL;
+  sim->member = NULL;
+  cc_acd_member_add(acd, queue, uuid, joined, 0, 0);
+  cc_acd_dispatch(acd, now, &events);
+
+  return sim->agent ? sim->agent : "";
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  cc_acd_t *acd = NULL;
+  cc_acd_queue_t *queue;
+  cc_acd_agent_t *agent;
+  cc_acd_member_t *member;
+  cc_acd_events_t events;
+  sim_t sim = { 0 };
+  switch_time_t now = 100000, start_ts, busy_usec = 0, busy_offer_usec = 0;
+  int queues = 10, agents = 20, members = 2000, passes = 0, answered = 0;
+  char name[64];
+
+#ifdef BENCHMARK
+  queues = 200;
+  agents = 50;
+  members = 100000;
+#endif
+
+  plan(13);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  ok(cc_acd_create(&acd) == SWITCH_STATUS_SUCCESS, "Create the agent selection engine");
+  events.offer = sim_offer;
+  events.member = NULL;
+  events.discard = NULL;
+  events.pdata = &sim;
+
+  /* longest-idle-agent offers the agent whose last call ended first */
+  sim_queue(acd, "idle", "longest-idle-agent");
+  sim_agent(acd, "idle", "idle-a", 1, 1, now - 100, now);
+  sim_agent(acd, "idle", "idle-b", 1, 2, now - 500, now);
+  sim_agent(acd, "idle", "idle-c", 1, 3, now - 300, now);
+  ok(!strcmp(sim_pick(acd, &sim, "idle", "idle-m1", now, now), "idle-b"), "longest-idle-agent picks the agent idle the longest");
+  ok(!strcmp(sim_pick(acd, &sim, "idle", "idle-m2", now, now), "idle-c"), "longest-idle-agent then picks the next longest idle");
+
+  /* wrap-up keeps an agent out until it is over */
+  sim_queue(acd, "wrap", "longest-idle-agent");
+  agent = sim_agent(acd, "wrap", "wrap-a", 1, 1, now - 5, now);
+  agent->wrap_up_time = 10;
+  cc_acd_agent_changed(acd, agent, now);
+  sim_pick(acd, &sim, "wrap", "wrap-m1", now, now);
+  ok(sim.agent == NULL, "An agent in wrap-up is not offered a call");
+  sim.agent = NULL;
+  cc_acd_dispatch(acd, now + 6, &events);
+  ok(sim.agent && !strcmp(sim.agent, "wrap-a"), "The agent is offered the call once wrap-up is over");
+
+  /* tier rules hold a member on the first level until it waited long enough */
+  queue = sim_queue(acd, "rules", "longest-idle-agent");
+  queue->tier_rules_apply = SWITCH_TRUE;
+  queue->tier_rule_wait_second = 30;
+  queue->tier_rule_no_agent_no_wait = SWITCH_TRUE;
+  sim_agent(acd, "rules", "rules-l1", 1, 1, 0, now);
+  sim_agent(acd, "rules", "rules-l2", 2, 1, 0, now);
+  ok(!strcmp(sim_pick(acd, &sim, "rules", "rules-m1", now, now), "rules-l1"), "Tier rules offer the first level first");
+  sim_pick(acd, &sim, "rules", "rules-m2", now, now);
+  sim.agent = NULL;
+  cc_acd_dispatch(acd, now + 30, &events);
+  ok(sim.agent && !strcmp(sim.agent, "rules-l2") && sim.member == cc_acd_member_find(acd, "rules-m2"),
+     "Tier rules let the member reach the next level after tier-rule-wait-second");
+
+  /* ring-all offers every ready agent at once */
+  sim_queue(acd, "ring", "ring-all");
+  sim_agent(acd, "ring", "ring-a", 1, 1, 0, now);
+  sim_agent(acd, "ring", "ring-b", 1, 2, 0, now);
+  sim_agent(acd, "ring", "ring-c", 1, 3, 0, now);
+  sim.offers = 0;
+  sim_pick(acd, &sim, "ring", "ring-m1", now, now);
+  member = cc_acd_member_find(acd, "ring-m1");
+  ok(sim.offers == 3 && member->state == CC_MEMBER_STATE_TRYING && !strcmp(member->serving_agent, CC_SERVING_RING_ALL),
+     "ring-all offers the member to every ready agent");
+
+  /* top-down carries on after the agent that did not answer */
+  sim_queue(acd, "top", "top-down");
+  sim_agent(acd, "top", "top-a", 1, 1, 0, now);
+  sim_agent(acd, "top", "top-b", 1, 2, 0, now);
+  sim_agent(acd, "top", "top-c", 1, 3, 0, now);
+  sim_pick(acd, &sim, "top", "top-m1", now, now);
+  member = sim.member;
+  sim_release(acd, cc_acd_agent_find(acd, "top-a"), member, SWITCH_FALSE, now);
+  sim.agent = NULL;
+  cc_acd_dispatch(acd, now, &events);
+  ok(sim.agent && !strcmp(sim.agent, "top-b"), "top-down resumes after the last agent offered");
+
+  cc_acd_destroy(&acd);
+
+  /* Call center simulation: every offer is answered right away and hung up on the next pass */
+  cc_acd_create(&acd);
+  for ( int x = 0; x < queues; x++) {
+    snprintf(name, sizeof(name), "queue-%d", x);
+    sim_queue(acd, name, "longest-idle-agent");
+    for ( int y = 0; y < agents; y++) {
+      char agent_name[64];
+      snprintf(agent_name, sizeof(agent_name), "agent-%d-%d", x, y);
+      sim_agent(acd, name, agent_name, 1 + y % 2, y, now - y, now);
+    }
+  }
+  for ( int x = 0; x < members; x++) {
+    char queue_name[64];
+    snprintf(queue_name, sizeof(queue_name), "queue-%d", x % queues);
+    snprintf(name, sizeof(name), "member-%d", x);
+    cc_acd_member_add(acd, queue_name, name, now - members + x, 0, 0);
+  }
+
+  /* Time-to-offer runs from the moment the agents free up to the offer callback for their next member,
+     so it covers releasing the agents and how far into the pass the dispatcher gets before it offers.
+     The dispatch tick comes on top of it. */
+  sim.offers = 0;
+  sim.pending_size = 64;
+  sim.pending = malloc(sim.pending_size * sizeof(*sim.pending));
+  sim.npending = 0;
+  while (acd->members && passes < members) {
+    /* The agents offered a call on the last pass answer it and hang up a second later */
+    sim.mark = switch_time_now();
+    for ( uint32_t x = 0; x < sim.npending; x++) {
+      sim_release(acd, sim.pending[x].agent, sim.pending[x].member, SWITCH_TRUE, now);
+      answered++;
+    }
+    sim.npending = 0;
+
+    cc_acd_dispatch(acd, now, &events);
+    passes++;
+    now++;
+  }
+  for ( uint32_t x = 0; x < sim.npending; x++) {
+    sim_release(acd, sim.pending[x].agent, sim.pending[x].member, SWITCH_TRUE, now);
+    answered++;
+  }
+  sim.mark = 0;
+  free(sim.pending);
+  sim.pending = NULL;
+  sim.pending_size = 0;
+
+  ok(!acd->members && answered == members && sim.offers == (uint32_t) members, "Every member of the simulation was served");
+
+  /* The pass the dispatcher repeats every 100ms while all agents are busy and the queues are full */
+  for ( int x = 0; x < members; x++) {
+    char queue_name[64];
+    snprintf(queue_name, sizeof(queue_name), "queue-%d", x % queues);
+    snprintf(name, sizeof(name), "busy-%d", x);
+    cc_acd_member_add(acd, queue_name, name, now - members + x, 0, 0);
+  }
+  for (agent = acd->agents; agent; agent = agent->next) {
+    agent->state = CC_AGENT_STATE_IN_A_QUEUE_CALL;
+    cc_acd_agent_changed(acd, agent, now);
+  }
+  sim.offers = 0;
+  start_ts = switch_time_now();
+  for ( int x = 0; x < 10; x++) {
+    cc_acd_dispatch(acd, now, &events);
+  }
+  busy_usec = (switch_time_now() - start_ts) / 10;
+  ok(sim.offers == 0, "No offers are made while every agent is busy");
+
+  /* One agent frees up while the queues are full; time how long until its next member is offered */
+  agent = acd->agents;
+  sim.agent = NULL;
+  start_ts = switch_time_now();
+  agent->state = CC_AGENT_STATE_WAITING;
+  cc_acd_agent_changed(acd, agent, now);
+  cc_acd_dispatch(acd, now, &events);
+  busy_offer_usec = switch_time_now() - start_ts;
+  ok(sim.offers == 1 && sim.agent && !strcmp(sim.agent, agent->name), "The agent that frees up is offered a waiting member");
+
+  note("%d queues, %d agents, %d members, %d dispatch passes: time-to-offer %.1f usec average, %" SWITCH_TIME_T_FMT " usec worst\n",
+       queues, queues * agents, members, passes, sim.timed ? (double) sim.offer_usec / sim.timed : 0.0, sim.offer_usec_max);
+  note("Full queues with every agent busy: %" SWITCH_TIME_T_FMT " usec per idle dispatch pass, %" SWITCH_TIME_T_FMT " usec time-to-offer for a freed agent\n",
+       busy_usec, busy_offer_usec);
+
+  cc_acd_destroy(&acd);
+
+  switch_core_destroy();
+
+  done_testing();
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+#include "mod_conference.h"
+
+#define FRAME_SAMPLES 160
+#define FRAMES 50
+
+/* A few seconds of a tone that changes every frame so no two frames encode alike */
+static void make_frame(int16_t *frame, int n)
+{
+  for ( int x = 0; x < FRAME_SAMPLES; x++) {
+    frame[x] = (int16_t) (((n * FRAME_SAMPLES + x) * (n + 3) * 37) % 24000 - 12000);
+  }
+}
+
+static switch_status_t encode(switch_codec_t *codec, int16_t *frame, uint8_t *out, uint32_t *outlen)
+{
+  uint32_t rate = 8000, flag = 0;
+
+  *outlen = SWITCH_RECOMMENDED_BUFFER_SIZE;
+  return switch_core_codec_encode(codec, NULL, frame, FRAME_SAMPLES * 2, 8000, out, outlen, &rate, &flag);
+}
+
+/* A stateful codec in the spirit of ADPCM: every byte is the step from the previous sample, so its output depends on
+   every frame it encoded before */
+static switch_status_t delta_init(switch_codec_t *codec, switch_codec_flag_t flags, const switch_codec_settings_t *codec_settings)
+{
+  if (!codec->private_info) {
+    codec->private_info = switch_core_alloc(codec->memory_pool, sizeof(int16_t));
+  }
+
+  *(int16_t *) codec->private_info = 0;
+
+  return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t delta_encode(switch_codec_t *codec, switch_codec_t *other_codec, void *decoded_data, uint32_t decoded_data_len,
+                                    uint32_t decoded_rate, void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate, unsigned int *flag)
+{
+  int16_t *last = codec->private_info, *in = decoded_data;
+  uint8_t *out = encoded_data;
+  uint32_t samples = decoded_data_len / 2;
+
+  for ( uint32_t x = 0; x < samples; x++) {
+    out[x] = (uint8_t) ((in[x] >> 8) - *last);
+    *last = in[x] >> 8;
+  }
+
+  *encoded_data_len = samples;
+
+  return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t delta_decode(switch_codec_t *codec, switch_codec_t *other_codec, void *encoded_data, uint32_t encoded_data_len,
+                                    uint32_t encoded_rate, void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate, unsigned int *flag)
+{
+  return SWITCH_STATUS_FALSE;
+}
+
+static switch_status_t delta_destroy(switch_codec_t *codec)
+{
+  return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t delta_load(switch_loadable_module_interface_t **module_interface, switch_memory_pool_t *pool)
+{
+  switch_codec_interface_t *codec_interface;
+
+  *module_interface = switch_loadable_module_create_module_interface(pool, "mod_delta");
+  SWITCH_ADD_CODEC(codec_interface, "DELTA");
+  switch_core_codec_add_implementation(pool, codec_interface, SWITCH_CODEC_TYPE_AUDIO, 98, "DELTA", NULL, 8000, 8000, 64000,
+                                       20000, FRAME_SAMPLES, FRAME_SAMPLES * 2, FRAME_SAMPLES, 1, 1,
+                                       delta_init, delta_encode, delta_decode, delta_destroy);
+
+  return SWITCH_STATUS_SUCCESS;
+}
+
+static void init_member(conference_member_t *member, conference_obj_t *conference, switch_memory_pool_t *pool)
+{
+  memset(member, 0, sizeof(*member));
+  member->conference = conference;
+  member->audio_codec_index = -1;
+  switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, pool);
+  switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, pool);
+  switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0);
+  switch_buffer_create_dynamic(&member->encoded_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0);
+}
+
+static void destroy_member(conference_member_t *member)
+{
+  switch_buffer_destroy(&member->mux_buffer);
+  switch_buffer_destroy(&member->encoded_buffer);
+}
+
+/* Alternates a member between the shared encode and its own encoder the way it moves in and out of its group,
+   and checks every frame it sends matches what its own encoder would have made had it never left */
+static int shared_matches_own(conference_obj_t *conference, const char *iananame)
+{
+  switch_codec_t own = { 0 }, reference = { 0 }, shared = { 0 };
+  conference_audio_codec_groups_t groups = { { 0 } };
+  conference_member_t member;
+  int16_t frame[FRAME_SAMPLES];
+  uint8_t out[SWITCH_RECOMMENDED_BUFFER_SIZE], ref[SWITCH_RECOMMENDED_BUFFER_SIZE];
+  uint32_t outlen, reflen;
+  int matches = 1;
+
+  init_member(&member, conference, conference->pool);
+
+  switch_core_codec_init(&own, iananame, NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, conference->pool);
+  switch_core_codec_init(&reference, iananame, NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, conference->pool);
+  switch_core_codec_init(&shared, iananame, NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, conference->pool);
+
+  member.audio_codec_index = conference_encode_find_group(conference, &groups, &shared, -1);
+  groups.members[0] = 2;
+
+  for ( int n = 0; n < FRAMES && matches; n++) {
+    make_frame(frame, n);
+    encode(&reference, frame, ref, &reflen);
+
+    if ((n / 3) % 2) {
+      codec_set_t *codec_set;
+
+      groups.encoded[0] = 0;
+      if (!(codec_set = conference_encode_shared(&member, &groups, frame, FRAME_SAMPLES * 2))) {
+        matches = 0;
+        break;
+      }
+      outlen = codec_set->frame.datalen;
+      memcpy(out, codec_set->frame.data, outlen);
+    } else {
+      encode(&own, frame, out, &outlen);
+    }
+
+    matches = outlen == reflen && !memcmp(out, ref, outlen);
+  }
+
+  conference_encode_destroy_groups(&groups);
+  switch_core_codec_destroy(&own);
+  switch_core_codec_destroy(&reference);
+  switch_core_codec_destroy(&shared);
+  destroy_member(&member);
+
+  return matches;
+}
+
+/* Feeds a stateful group encoder the way the conference does, sitting out every skip'th interval, and checks every
+   frame it encodes matches a reference encoder that started over after each interval sat out */
+static int stateful_group_matches(conference_obj_t *conference, conference_member_t *member, conference_audio_codec_groups_t *groups, int skip)
+{
+  switch_codec_t reference = { 0 };
+  int16_t frame[FRAME_SAMPLES];
+  uint8_t ref[SWITCH_RECOMMENDED_BUFFER_SIZE];
+  uint32_t reflen;
+  codec_set_t *codec_set;
+  int matches = 1;
+
+  switch_core_codec_init(&reference, "DELTA", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, conference->pool);
+
+  /* the group sat out the interval before this run, whatever it encoded earlier */
+  conference_encode_next_interval(groups);
+
+  for ( int n = 0; n < FRAMES && matches; n++) {
+    conference_encode_next_interval(groups);
+
+    if (skip && n % skip == skip - 1) {
+      switch_core_codec_reset(&reference);
+      continue;
+    }
+
+    make_frame(frame, n);
+    encode(&reference, frame, ref, &reflen);
+    codec_set = conference_encode_shared(member, groups, frame, FRAME_SAMPLES * 2);
+    matches = codec_set && codec_set->frame.datalen == reflen && !memcmp(codec_set->frame.data, ref, reflen);
+  }
+
+  switch_core_codec_destroy(&reference);
+
+  return matches;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_memory_pool_t *pool = NULL;
+  conference_obj_t *conference;
+  conference_audio_codec_groups_t groups = { { 0 } };
+  conference_member_t member;
+  switch_codec_t pcmu_a = { 0 }, pcmu_b = { 0 }, pcma = { 0 }, pcmu_30 = { 0 }, delta = { 0 };
+  switch_codec_implementation_t no_encoder = { 0 };
+  codec_set_t *codec_set, *again;
+  const switch_codec_implementation_t *impl = NULL;
+  int16_t frame[FRAME_SAMPLES], pcm[FRAME_SAMPLES];
+  uint8_t out[SWITCH_RECOMMENDED_BUFFER_SIZE], first[FRAME_SAMPLES];
+  int group_a, group_b, group_pcma, group_delta, waited = 0;
+
+  plan(17);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  switch_loadable_module_init(SWITCH_FALSE);
+  switch_loadable_module_load_module("", "CORE_PCM_MODULE", SWITCH_TRUE, &err);
+  switch_loadable_module_build_dynamic("mod_delta", delta_load, NULL, NULL, SWITCH_FALSE);
+  switch_core_new_memory_pool(&pool);
+
+  conference = switch_core_alloc(pool, sizeof(*conference));
+  conference->pool = pool;
+  conference->rate = 8000;
+  conference->interval = 20;
+  conference->channels = 1;
+  conference->flags[CFLAG_MINIMIZE_AUDIO_ENCODING] = 1;
+
+  ok(switch_core_codec_init(&pcmu_a, "PCMU", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) == SWITCH_STATUS_SUCCESS &&
+     switch_core_codec_init(&pcmu_b, "PCMU", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) == SWITCH_STATUS_SUCCESS &&
+     switch_core_codec_init(&pcma, "PCMA", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) == SWITCH_STATUS_SUCCESS &&
+     switch_core_codec_init(&pcmu_30, "PCMU", NULL, NULL, 8000, 30, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) == SWITCH_STATUS_SUCCESS &&
+     switch_core_codec_init(&delta, "DELTA", NULL, NULL, 8000, 20, 1, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) == SWITCH_STATUS_SUCCESS,
+     "Set up PCMU, PCMA and a stateful codec");
+
+  /* Anything that can encode on its own can be shared, stateful or not */
+  no_encoder.iananame = "NONE";
+  no_encoder.codec_type = SWITCH_CODEC_TYPE_AUDIO;
+  ok(conference_encode_shareable(pcmu_a.implementation) && conference_encode_shareable(pcma.implementation) &&
+     conference_encode_shareable(delta.implementation) && !conference_encode_shareable(&no_encoder),
+     "PCMU, PCMA and a stateful codec can share an encode, a codec with no encoder cannot");
+
+  group_a = conference_encode_find_group(conference, &groups, &pcmu_a, -1);
+  group_b = conference_encode_find_group(conference, &groups, &pcmu_b, -1);
+  group_pcma = conference_encode_find_group(conference, &groups, &pcma, -1);
+  group_delta = conference_encode_find_group(conference, &groups, &delta, -1);
+  ok(group_a > -1 && group_a == group_b && group_pcma > -1 && group_pcma != group_a && group_delta > -1 && group_delta != group_a && group_delta != group_pcma,
+     "Members on the same codec share a group, other codecs get their own");
+  ok(conference_encode_find_group(conference, &groups, &pcmu_30, -1) == -1, "A codec whose ptime differs from the conference gets no group");
+
+  /* A member only joins after it has been a plain listener for a while, and leaves at once */
+  init_member(&member, conference, pool);
+  while (conference_encode_join_group(&member, &groups, &pcmu_a) == -1 && waited <= CONF_ENCODE_JOIN_INTERVALS) {
+    waited++;
+  }
+  ok(waited == CONF_ENCODE_JOIN_INTERVALS && member.audio_codec_index == group_a, "A member joins its group after CONF_ENCODE_JOIN_INTERVALS quiet intervals");
+  ok(conference_encode_join_group(&member, &groups, &pcmu_a) == group_a, "A pinned member stays in its group");
+  conference_encode_leave_group(&member);
+  ok(member.audio_codec_index == -1 && conference_encode_join_group(&member, &groups, &pcmu_a) == -1, "A member that leaves waits again before it rejoins");
+
+  /* One encode per interval per group */
+  member.audio_codec_index = group_a;
+  make_frame(frame, 0);
+  codec_set = conference_encode_shared(&member, &groups, frame, FRAME_SAMPLES * 2);
+  memcpy(first, codec_set ? codec_set->frame.data : out, FRAME_SAMPLES);
+  make_frame(frame, 1);
+  again = conference_encode_shared(&member, &groups, frame, FRAME_SAMPLES * 2);
+  ok(codec_set && codec_set == again && groups.encoded[group_a] && codec_set->frame.datalen == FRAME_SAMPLES && !memcmp(first, codec_set->frame.data, FRAME_SAMPLES),
+     "The mix is encoded once per interval for the whole group, even a group of one");
+  conference->relationship_total = 1;
+  ok(conference_encode_shared(&member, &groups, frame, FRAME_SAMPLES * 2) == NULL, "Relationships turn shared encoding off");
+  conference->relationship_total = 0;
+
+  /* A pinned member is queued the encoded frame alone, anyone else the PCM alone */
+  conference_encode_write_mux(&member, frame, FRAME_SAMPLES * 2, codec_set);
+  ok(member.encoded_frames == 1 && !switch_buffer_inuse(member.mux_buffer), "A frame queued with its shared encode skips the PCM copy");
+  ok(conference_encode_read(&member, &impl, out, sizeof(out), FRAME_SAMPLES * 2) == FRAME_SAMPLES && impl == pcmu_a.implementation &&
+     !memcmp(out, codec_set->frame.data, FRAME_SAMPLES) && !member.encoded_frames && !switch_buffer_inuse(member.encoded_buffer),
+     "A frame queued with its shared encode reads back as the encoded frame");
+
+  /* Frames come out in the order they were queued across the two buffers */
+  make_frame(frame, 2);
+  conference_encode_write_mux(&member, frame, FRAME_SAMPLES * 2, NULL);
+  conference_encode_write_mux(&member, frame, FRAME_SAMPLES * 2, codec_set);
+  ok(conference_encode_read(&member, &impl, out, sizeof(out), FRAME_SAMPLES * 2) == 0 &&
+     switch_buffer_read(member.mux_buffer, pcm, sizeof(pcm)) == sizeof(pcm) && !memcmp(pcm, frame, sizeof(pcm)) &&
+     conference_encode_read(&member, &impl, out, sizeof(out), FRAME_SAMPLES * 2) == FRAME_SAMPLES,
+     "PCM queued before the member joined goes out before its encoded frames");
+  conference_encode_write_mux(&member, frame, FRAME_SAMPLES * 2, codec_set);
+  conference_encode_write_mux(&member, frame, FRAME_SAMPLES * 2, NULL);
+  ok(conference_encode_read(&member, &impl, out, sizeof(out), FRAME_SAMPLES * 2) == FRAME_SAMPLES &&
+     conference_encode_read(&member, &impl, out, sizeof(out), FRAME_SAMPLES * 2) == 0 && switch_buffer_inuse(member.mux_buffer) == FRAME_SAMPLES * 2,
+     "Encoded frames queued before the member left go out before its PCM");
+
+  /* A stateful group encoder runs as one stream while it has members, and starts over after it sat an interval out */
+  member.audio_codec_index = group_delta;
+  ok(stateful_group_matches(conference, &member, &groups, 0), "A stateful group encoder fed every interval matches one continuous encoder");
+  ok(stateful_group_matches(conference, &member, &groups, 7), "A stateful group encoder that sat an interval out starts over like a new one");
+  destroy_member(&member);
+
+  ok(shared_matches_own(conference, "PCMU") && shared_matches_own(conference, "PCMA") && shared_matches_own(conference, "L16"),
+     "Members on stateless codecs moving in and out of the group send what their own encoder would");
+
+  conference_encode_destroy_groups(&groups);
+  switch_core_codec_destroy(&pcmu_a);
+  switch_core_codec_destroy(&pcmu_b);
+  switch_core_codec_destroy(&pcma);
+  switch_core_codec_destroy(&pcmu_30);
+  switch_core_codec_destroy(&delta);
+  switch_core_destroy_memory_pool(&pool);
+
+  switch_core_destroy();
+
+  done_testing();
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+#include "dp_index.h"
+
+#define MAX_EXTENS 64
+#define RANDOM_DESTS 5000
+
+static const char *DIALPLAN =
+  "<document type=\"freeswitch/xml\">"
+  "<section name=\"dialplan\">"
+  "<dialplan>"
+  "<context name=\"default\">"
+  "<extension name=\"exact\"><condition field=\"destination_number\" expression=\"^1000$\"/></extension>"
+  "<extension name=\"capture\"><condition field=\"destination_number\" expression=\"^10(\\d+)$\"/></extension>"
+  "<extension name=\"group\"><condition field=\"destination_number\" expression=\"^(10|20)\\d+$\"/></extension>"
+  "<extension name=\"optional\"><condition field=\"destination_number\" expression=\"^2?00$\"/></extension>"
+  "<extension name=\"plus\"><condition field=\"destination_number\" expression=\"^30+1$\"/></extension>"
+  "<extension name=\"digits\"><condition field=\"destination_number\" expression=\"^4\\d{3}$\"/></extension>"
+  "<extension name=\"e164\"><condition field=\"destination_number\" expression=\"^\\+1555\"/></extension>"
+  "<extension name=\"either\"><condition field=\"destination_number\" expression=\"^5|^6\"/></extension>"
+  "<extension name=\"regex-all\"><condition regex=\"all\"><regex field=\"destination_number\" expression=\"^7\"/></condition></extension>"
+  "<extension name=\"caller\"><condition field=\"caller_id_number\" expression=\"^1000$\"/></extension>"
+  "<extension name=\"anti\"><condition field=\"destination_number\" expression=\"^8$\"><anti-action application=\"log\"/></condition></extension>"
+  "<extension name=\"star\"><condition field=\"destination_number\" expression=\"^9[0-9]*$\"/></extension>"
+  "<extension name=\"repeat\"><condition field=\"destination_number\" expression=\"^700{2}$\"/></extension>"
+  "<extension name=\"dot\"><condition field=\"destination_number\" expression=\"^ab.c\"/></extension>"
+  "<extension name=\"caseless\"><condition field=\"destination_number\" expression=\"^(?i)AB\"/></extension>"
+  "<extension name=\"unanchored\"><condition field=\"destination_number\" expression=\"00$\"/></extension>"
+  "<extension name=\"variable\"><condition field=\"destination_number\" expression=\"^${prefix}1$\"/></extension>"
+  "<extension name=\"break-never\"><condition field=\"destination_number\" expression=\"^2000$\" break=\"never\"/></extension>"
+  "<extension name=\"timed\"><condition field=\"destination_number\" expression=\"^2001$\" wday=\"1-5\"/></extension>"
+  "<extension name=\"child\"><condition field=\"destination_number\"><expression>^3000$</expression></condition></extension>"
+  "<extension name=\"none\"/>"
+  "<extension name=\"exact-again\"><condition field=\"destination_number\" expression=\"^1000$\"/></extension>"
+  "<extension name=\"long\"><condition field=\"destination_number\" expression=\"^1000200030004000$\"/></extension>"
+  "<extension name=\"empty\"><condition field=\"destination_number\" expression=\"^$\"/></extension>"
+  "<extension name=\"catchall\"><condition field=\"destination_number\" expression=\"^.*$\"/></extension>"
+  "</context>"
+  "</dialplan>"
+  "</section>"
+  "</document>";
+
+static const char *DESTS[] = {
+  "", "1", "10", "100", "1000", "10000", "1001", "2000", "2001", "200", "00", "20", "3001", "30001", "301", "31",
+  "4000", "400", "40000", "+15551234", "+1555", "+155", "5", "6", "7", "8", "9", "99", "9a", "7000", "700", "70000",
+  "abxc", "abc", "AB", "ab", "3000", "1000200030004000", "100020003000400", NULL
+};
+
+typedef struct {
+  switch_xml_t xexten[MAX_EXTENS];
+  switch_bool_t indexable[MAX_EXTENS];
+  const char *expression[MAX_EXTENS];
+  int count;
+} linear_t;
+
+static int exten_pos(linear_t *linear, switch_xml_t xexten)
+{
+  for ( int x = 0; x < linear->count; x++) {
+    if (linear->xexten[x] == xexten) {
+      return x;
+    }
+  }
+
+  return -1;
+}
+
+/* What a linear walk could do with the extension: the index never reasons about the ones it cannot
+   index, and the rest are up to the regex on their first condition */
+static switch_bool_t could_match(linear_t *linear, int pos, const char *dest)
+{
+  switch_regex_t *re = NULL;
+  int ovector[30];
+  int proceed;
+
+  if (!linear->indexable[pos]) {
+    return SWITCH_TRUE;
+  }
+
+  proceed = switch_regex_perform(dest, linear->expression[pos], &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
+  switch_regex_safe_free(re);
+
+  return proceed > 0;
+}
+
+/* Checks one destination, returns a bit for each way the walk disagreed with a linear one */
+#define WALK_OUT_OF_ORDER 1
+#define WALK_SKIPPED_MATCH 2
+
+static int check_dest(dp_context_index_t *cindex, linear_t *linear, const char *dest, int *walks)
+{
+  dp_index_walk_t walk;
+  switch_xml_t xexten;
+  int walked[MAX_EXTENS] = { 0 };
+  int last = -1, bad = 0;
+
+  dp_index_walk_init(&walk, cindex, dest);
+
+  while ((xexten = dp_index_walk_next(&walk))) {
+    int pos = exten_pos(linear, xexten);
+
+    /* an extension from elsewhere or one already walked is out of order too */
+    if (pos <= last) {
+      bad |= WALK_OUT_OF_ORDER;
+    } else {
+      walked[pos] = 1;
+      last = pos;
+    }
+    (*walks)++;
+  }
+
+  /* the index may offer more than can match, but whatever it skips the linear walk could not have matched either */
+  for ( int x = 0; x < linear->count; x++) {
+    if (!walked[x] && could_match(linear, x, dest)) {
+      bad |= WALK_SKIPPED_MATCH;
+      printf("# %s skipped %s\n", dest, switch_xml_attr_soft(linear->xexten[x], "name"));
+    }
+  }
+
+  return bad;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_xml_t root, xcontext, xexten;
+  dp_index_t *index;
+  dp_context_index_t *cindex = NULL;
+  linear_t linear = { { 0 } };
+  char prefix[DP_INDEX_MAX_PREFIX];
+  char dest[16];
+  int bad = 0, dests = 0, walks = 0;
+
+  plan(8);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  root = switch_xml_parse_str_dynamic(strdup(DIALPLAN), SWITCH_FALSE);
+  xcontext = switch_xml_find_child(switch_xml_find_child(switch_xml_find_child(root, "section", "name", "dialplan"), "dialplan", NULL, NULL),
+                                   "context", "name", "default");
+
+  index = dp_index_build(root);
+  ok(xcontext && (cindex = dp_index_find_context(index, xcontext)), "The default context is indexed");
+
+  for (xexten = switch_xml_child(xcontext, "extension"); xexten && linear.count < MAX_EXTENS; xexten = xexten->next) {
+    switch_xml_t xcond = switch_xml_child(xexten, "condition"), xexpression;
+
+    linear.xexten[linear.count] = xexten;
+    linear.indexable[linear.count] = dp_index_exten_prefix(xexten, prefix, sizeof(prefix));
+    if ((xexpression = switch_xml_child(xcond, "expression"))) {
+      linear.expression[linear.count] = switch_str_nil(xexpression->txt);
+    } else {
+      linear.expression[linear.count] = switch_xml_attr_soft(xcond, "expression");
+    }
+    linear.count++;
+  }
+
+  ok(dp_index_exten_prefix(linear.xexten[0], prefix, sizeof(prefix)) && !strcmp(prefix, "1000") &&
+     dp_index_exten_prefix(linear.xexten[4], prefix, sizeof(prefix)) && !strcmp(prefix, "30") &&
+     dp_index_exten_prefix(linear.xexten[5], prefix, sizeof(prefix)) && !strcmp(prefix, "4") &&
+     dp_index_exten_prefix(linear.xexten[6], prefix, sizeof(prefix)) && !strcmp(prefix, "+1555") &&
+     dp_index_exten_prefix(linear.xexten[12], prefix, sizeof(prefix)) && !strcmp(prefix, "70"),
+     "Literal prefixes stop at the first character that may repeat zero times or is not literal");
+  ok(!linear.indexable[7] && !linear.indexable[8] && !linear.indexable[9] && !linear.indexable[10] &&
+     !linear.indexable[15] && !linear.indexable[16] && !linear.indexable[17] && !linear.indexable[18] && !linear.indexable[20],
+     "Extensions the index cannot reason about are always tried");
+
+  for ( int x = 0; DESTS[x]; x++, dests++) {
+    bad |= check_dest(cindex, &linear, DESTS[x], &walks);
+  }
+
+  srand(42);
+  for ( int x = 0; x < RANDOM_DESTS; x++, dests++) {
+    static const char alphabet[] = "0123456789+abAB";
+    int len = rand() % (sizeof(dest) - 1);
+
+    for ( int y = 0; y < len; y++) {
+      dest[y] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    dest[len] = '\0';
+
+    bad |= check_dest(cindex, &linear, dest, &walks);
+  }
+
+  ok(dests > RANDOM_DESTS, "Walked the index for %d destinations", dests);
+  ok(!(bad & WALK_OUT_OF_ORDER), "The index walk keeps document order");
+  ok(!(bad & WALK_SKIPPED_MATCH), "The index walk never skips an extension a linear walk could match");
+  ok(walks < dests * linear.count / 2, "The index walk tries %d extensions where a linear walk tries %d", walks, dests * linear.count);
+
+  dp_index_free(index);
+
+  switch_core_destroy();
+
+  done_testing();
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <sys/socket.h>
+#include <switch.h>
+#include <tap.h>
+#include "es_output.h"
+
+#define WRITE_EVENTS 500
+
+static shared_event_t *make_event(switch_event_types_t event_id, const char *uuid, int seq)
+{
+  switch_event_t *event = NULL;
+  char pad[401];
+
+  switch_event_create_plain(&event, event_id);
+  if (uuid) {
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", uuid);
+  }
+  switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Seq", "%d", seq);
+  memset(pad, 'x', sizeof(pad) - 1);
+  pad[sizeof(pad) - 1] = '\0';
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Pad", pad);
+
+  return shared_event_create(&event);
+}
+
+static int event_seq(shared_event_t *se)
+{
+  return atoi(switch_str_nil(switch_event_get_header(se->event, "Seq")));
+}
+
+static uint32_t refs(shared_event_t *se)
+{
+  return switch_atomic_read(&se->refs);
+}
+
+typedef struct {
+  int fd;
+  char *buf;
+  switch_size_t len;
+  switch_size_t size;
+} reader_t;
+
+static void *SWITCH_THREAD_FUNC reader_thread(switch_thread_t *thread, void *obj)
+{
+  reader_t *reader = (reader_t *) obj;
+  ssize_t r;
+
+  for (;;) {
+    if (reader->size - reader->len < 4096) {
+      reader->size = reader->size ? reader->size * 2 : 65536;
+      reader->buf = realloc(reader->buf, reader->size);
+    }
+
+    if ((r = recv(reader->fd, reader->buf + reader->len, reader->size - reader->len, 0)) <= 0) {
+      break;
+    }
+    reader->len += r;
+    reader->buf[reader->len] = '\0';
+  }
+
+  return NULL;
+}
+
+/* Walks the received stream frame by frame, returns how many frames came in order with the right length */
+static int count_frames(reader_t *reader)
+{
+  char *p = reader->buf, *end = reader->buf + reader->len;
+  int frames = 0;
+
+  while (p < end) {
+    char *body, *found, seq[32];
+    long clen;
+
+    if (strncmp(p, "Content-Length: ", 16) || !(body = strstr(p, "\n\n"))) {
+      break;
+    }
+    clen = atol(p + 16);
+    body += 2;
+
+    if (body + clen > end) {
+      break;
+    }
+
+    switch_snprintf(seq, sizeof(seq), "Seq: %d\n", frames);
+    if (!(found = strstr(body, seq)) || found >= body + clen) {
+      break;
+    }
+
+    frames++;
+    p = body + clen;
+  }
+
+  return p == end ? frames : -1;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_memory_pool_t *pool = NULL;
+  switch_queue_t *queue;
+  listener_output_t out;
+  shared_event_t *plain[4], *a1, *a2, *a3, *b1, *se, *events[10];
+  int order[8], n = 0, failed = 0;
+  switch_os_socket_t fds[2];
+  switch_socket_t *sock = NULL;
+  switch_thread_t *thread;
+  switch_threadattr_t *thd_attr = NULL;
+  reader_t reader = { 0 };
+  int sndbuf = 4096;
+
+  plan(13);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  switch_core_new_memory_pool(&pool);
+  es_output_init(pool);
+
+  /* Coalescing keeps the newest state event per key, and the hash keeps it alive until it is popped */
+  memset(&out, 0, sizeof(out));
+  switch_queue_create(&queue, 100, pool);
+  listener_output_init(&out, 1, OUTPUT_POLICY_COALESCE, 4, 1, pool);
+
+  for ( int x = 0; x < 4; x++) {
+    plain[x] = make_event(SWITCH_EVENT_CHANNEL_DATA, "a", x);
+    listener_output_queue(&out, queue, plain[x]);
+  }
+  a1 = make_event(SWITCH_EVENT_SESSION_HEARTBEAT, "a", 4);
+  a2 = make_event(SWITCH_EVENT_SESSION_HEARTBEAT, "a", 5);
+  b1 = make_event(SWITCH_EVENT_SESSION_HEARTBEAT, "b", 6);
+  a3 = make_event(SWITCH_EVENT_SESSION_HEARTBEAT, "a", 7);
+  listener_output_queue(&out, queue, a1);
+  listener_output_queue(&out, queue, a2);
+  listener_output_queue(&out, queue, b1);
+  listener_output_queue(&out, queue, a3);
+
+  ok(switch_atomic_read(&out.backlogged) && refs(a1) == 2 && refs(a2) == 2 && refs(a3) == 3 && refs(b1) == 3,
+     "The coalesce hash holds a reference on the newest event per key only");
+
+  while ((se = listener_output_pop(&out, queue)) && n < 8) {
+    order[n++] = event_seq(se);
+    shared_event_unref(&se);
+  }
+  ok(n == 6 && order[0] == 0 && order[3] == 3 && order[4] == 6 && order[5] == 7 && switch_atomic_read(&out.coalesced) == 2,
+     "Superseded events are skipped and the rest keep their order");
+  ok(switch_core_hash_empty(out.coalesce_hash) && refs(a1) == 1 && refs(a2) == 1 && refs(a3) == 1 && refs(b1) == 1,
+     "Popping an event forgets it, so the hash never points past the queue");
+  ok(!switch_atomic_read(&out.backlogged), "The listener is no longer backlogged once the queue drains");
+
+  for ( int x = 0; x < 6; x++) {
+    listener_output_queue(&out, queue, a1);
+  }
+  listener_output_destroy(&out, queue);
+  ok(refs(a1) == 1 && !switch_queue_size(queue), "Destroying the output drops the queue and the hash references");
+
+  for ( int x = 0; x < 4; x++) {
+    shared_event_unref(&plain[x]);
+  }
+  shared_event_unref(&a1);
+  shared_event_unref(&a2);
+  shared_event_unref(&a3);
+  shared_event_unref(&b1);
+
+  /* Dropping the oldest keeps the queue at the high watermark */
+  memset(&out, 0, sizeof(out));
+  listener_output_init(&out, 2, OUTPUT_POLICY_DROP_OLDEST, 4, 1, pool);
+  for ( int x = 0; x < 10; x++) {
+    events[x] = make_event(SWITCH_EVENT_CHANNEL_DATA, NULL, x);
+    listener_output_queue(&out, queue, events[x]);
+  }
+  se = listener_output_pop(&out, queue);
+  ok(switch_atomic_read(&out.dropped) == 6 && se && event_seq(se) == 6 && switch_queue_size(queue) == 3 && refs(events[0]) == 1,
+     "drop-oldest trims the oldest events past the high watermark");
+  shared_event_unref(&se);
+  listener_output_destroy(&out, queue);
+
+  /* Without a policy a full queue drops the new event */
+  memset(&out, 0, sizeof(out));
+  switch_queue_create(&queue, 8, pool);
+  listener_output_init(&out, 3, OUTPUT_POLICY_NONE, 100, 10, pool);
+  for ( int x = 0; x < 10; x++) {
+    if (listener_output_queue(&out, queue, events[x]) != SWITCH_STATUS_SUCCESS) {
+      failed++;
+    }
+  }
+  ok(failed == 2 && switch_atomic_read(&out.dropped) == 2 && refs(events[9]) == 1 && refs(events[0]) == 2,
+     "A full queue refuses the event without leaking a reference");
+  listener_output_destroy(&out, queue);
+
+  for ( int x = 0; x < 10; x++) {
+    shared_event_unref(&events[x]);
+  }
+
+  /* Gathered writes against a small socket buffer */
+  memset(&out, 0, sizeof(out));
+  switch_queue_create(&queue, WRITE_EVENTS, pool);
+  listener_output_init(&out, 4, OUTPUT_POLICY_NONE, WRITE_EVENTS, WRITE_EVENTS / 10, pool);
+  for ( int x = 0; x < WRITE_EVENTS; x++) {
+    se = make_event(SWITCH_EVENT_CHANNEL_DATA, NULL, x);
+    listener_output_queue(&out, queue, se);
+    shared_event_unref(&se);
+  }
+
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+  switch_os_sock_put(&sock, &fds[0], pool);
+  switch_socket_opt_set(sock, SWITCH_SO_NONBLOCK, TRUE);
+
+  status = listener_output_write(&out, queue, sock, EVENT_FORMAT_PLAIN, SWITCH_FALSE);
+  ok(status == SWITCH_STATUS_BREAK && out.cur < out.nvec && out.sent_bytes > 0,
+     "A full socket returns BREAK and keeps the rest of the batch");
+
+  reader.fd = fds[1];
+  switch_threadattr_create(&thd_attr, pool);
+  switch_thread_create(&thread, thd_attr, reader_thread, &reader, pool);
+
+  status = listener_output_write(&out, queue, sock, EVENT_FORMAT_PLAIN, SWITCH_TRUE);
+  ok(status == SWITCH_STATUS_SUCCESS && out.cur == out.nvec && switch_queue_size(queue) > 0,
+     "Waiting finishes the batch already started and stops on an event boundary");
+
+  while (switch_queue_size(queue) || out.nvec) {
+    if (listener_output_write(&out, queue, sock, EVENT_FORMAT_PLAIN, SWITCH_FALSE) == SWITCH_STATUS_BREAK) {
+      switch_yield(1000);
+    }
+  }
+  listener_output_write(&out, queue, sock, EVENT_FORMAT_PLAIN, SWITCH_TRUE);
+  shutdown(fds[0], SHUT_WR);
+  switch_thread_join(&status, thread);
+
+  ok(out.sent_events == WRITE_EVENTS && out.sent_bytes == reader.len && count_frames(&reader) == WRITE_EVENTS,
+     "Every event arrives whole and in order across short writes");
+  ok(out.syscalls < out.sent_events, "Gathered writes send %" SWITCH_UINT64_T_FMT " events in %" SWITCH_UINT64_T_FMT " syscalls",
+     out.sent_events, out.syscalls);
+  ok(!out.nevents && !out.nvec && !switch_queue_size(queue), "Nothing is left batched after the last write");
+
+  listener_output_destroy(&out, queue);
+  close(fds[0]);
+  close(fds[1]);
+  free(reader.buf);
+  switch_core_destroy_memory_pool(&pool);
+
+  switch_core_destroy();
+
+  done_testing();
+}
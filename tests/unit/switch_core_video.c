@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <switch.h>
+#include <tap.h>
+
+#define CANVAS_W 64
+#define CANVAS_H 48
+#define PATCH_W 37
+#define PATCH_H 21
+
+/* Offsets that are odd, negative and clipped on the far side */
+static const int patch_offsets[][2] = { { 5, 3 }, { 0, 0 }, { -3, -5 }, { 40, 30 } };
+#define PATCH_OFFSETS (int) (sizeof(patch_offsets) / sizeof(patch_offsets[0]))
+
+/* The overlay moves odd offsets onto the next even pixel, so only even ones map the source one to one */
+static const int overlay_offsets[][2] = { { 4, 2 }, { 0, 0 }, { -4, -2 }, { 40, 30 } };
+#define OVERLAY_OFFSETS (int) (sizeof(overlay_offsets) / sizeof(overlay_offsets[0]))
+
+static const uint8_t overlay_alphas[] = { 1, 64, 128, 200, 254 };
+#define OVERLAY_ALPHAS (int) (sizeof(overlay_alphas) / sizeof(overlay_alphas[0]))
+
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+#define CLAMP(val) MAX(0, MIN(val, 255))
+
+/* The conversions and per-pixel path switch_core_video.c composited with before it blended plane-wise */
+static void old_rgb2yuv(switch_rgb_color_t *rgb, switch_yuv_color_t *yuv)
+{
+  yuv->y = (uint8_t)(((rgb->r * 4897) >> 14) + ((rgb->g * 9611) >> 14) + ((rgb->b * 1876) >> 14));
+  yuv->u = (uint8_t)(- ((rgb->r * 2766) >> 14)  - ((5426 * rgb->g) >> 14) + rgb->b / 2 + 128);
+  yuv->v = (uint8_t)(rgb->r / 2 -((6855 * rgb->g) >> 14) - ((rgb->b * 1337) >> 14) + 128);
+}
+
+static void old_yuv2rgb(switch_yuv_color_t *yuv, switch_rgb_color_t *rgb)
+{
+  rgb->r = CLAMP( yuv->y + ((22457 * (yuv->v-128)) >> 14));
+  rgb->g = CLAMP((yuv->y - ((715 * (yuv->v-128)) >> 10) - ((5532 * (yuv->u-128)) >> 14)));
+  rgb->b = CLAMP((yuv->y + ((28384 * (yuv->u-128)) >> 14)));
+  rgb->a = 255;
+}
+
+static void old_get_rgb_pixel(switch_image_t *img, switch_rgb_color_t *rgb, int x, int y)
+{
+  switch_yuv_color_t yuv;
+
+  if (x < 0 || y < 0 || x >= img->d_w || y >= img->d_h) return;
+
+  if (img->fmt == SWITCH_IMG_FMT_ARGB) {
+    uint8_t *a = img->planes[SWITCH_PLANE_PACKED] + img->stride[SWITCH_PLANE_PACKED] * y + 4 * x;
+
+    rgb->a = a[0];
+    rgb->r = a[1];
+    rgb->g = a[2];
+    rgb->b = a[3];
+    return;
+  }
+
+  yuv.y = img->planes[SWITCH_PLANE_Y][img->stride[SWITCH_PLANE_Y] * y + x];
+  yuv.u = img->planes[SWITCH_PLANE_U][img->stride[SWITCH_PLANE_U] * y / 2 + x / 2];
+  yuv.v = img->planes[SWITCH_PLANE_V][img->stride[SWITCH_PLANE_V] * y / 2 + x / 2];
+  old_yuv2rgb(&yuv, rgb);
+}
+
+static void old_draw_pixel(switch_image_t *img, int x, int y, switch_rgb_color_t *color)
+{
+  switch_yuv_color_t yuv;
+
+  if (x < 0 || y < 0 || x >= img->d_w || y >= img->d_h) return;
+
+  old_rgb2yuv(color, &yuv);
+  img->planes[SWITCH_PLANE_Y][y * img->stride[SWITCH_PLANE_Y] + x] = yuv.y;
+
+  if (((x & 0x1) == 0) && ((y & 0x1) == 0)) {
+    img->planes[SWITCH_PLANE_U][y / 2 * img->stride[SWITCH_PLANE_U] + x / 2] = yuv.u;
+    img->planes[SWITCH_PLANE_V][y / 2 * img->stride[SWITCH_PLANE_V] + x / 2] = yuv.v;
+  }
+}
+
+static void old_patch_argb(switch_image_t *IMG, switch_image_t *img, int x, int y)
+{
+  int max_w = MIN(img->d_w, IMG->d_w - abs(x));
+  int max_h = MIN(img->d_h, IMG->d_h - abs(y));
+
+  for ( int i = 0; i < max_h; i++) {
+    for ( int j = 0; j < max_w; j++) {
+      switch_rgb_color_t RGB = { 0 }, rgb = { 0 };
+
+      old_get_rgb_pixel(img, &rgb, j, i);
+
+      if (rgb.a > 0) {
+        if (rgb.a < 255) {
+          old_get_rgb_pixel(IMG, &RGB, x + j, y + i);
+          RGB.r = ((RGB.r * (255 - rgb.a)) >> 8) + ((rgb.r * rgb.a) >> 8);
+          RGB.g = ((RGB.g * (255 - rgb.a)) >> 8) + ((rgb.g * rgb.a) >> 8);
+          RGB.b = ((RGB.b * (255 - rgb.a)) >> 8) + ((rgb.b * rgb.a) >> 8);
+          old_draw_pixel(IMG, x + j, y + i, &RGB);
+        } else {
+          old_draw_pixel(IMG, x + j, y + i, &rgb);
+        }
+      }
+    }
+  }
+}
+
+/* Only called with even offsets, so the nudge onto an even pixel is left out */
+static void old_overlay(switch_image_t *IMG, switch_image_t *img, int x, int y, uint8_t alpha)
+{
+  switch_rgb_color_t RGB = { 0 }, rgb = { 0 }, c = { 0 };
+  int xoff = 0, yoff = 0, len, max_h;
+
+  if (x < 0) {
+    xoff = -x;
+    x = 0;
+  }
+
+  if (y < 0) {
+    yoff = -y;
+    y = 0;
+  }
+
+  max_h = MIN(y + img->d_h - yoff, IMG->d_h);
+  len = MIN(img->d_w - xoff, IMG->d_w - x);
+
+  for ( int i = y; i < max_h; i++) {
+    for ( int j = 0; j < len; j++) {
+      old_get_rgb_pixel(IMG, &RGB, x + j, i);
+      old_get_rgb_pixel(img, &rgb, j + xoff, i - y + yoff);
+
+      c.r = ((RGB.r * (255 - alpha)) >> 8) + ((rgb.r * alpha) >> 8);
+      c.g = ((RGB.g * (255 - alpha)) >> 8) + ((rgb.g * alpha) >> 8);
+      c.b = ((RGB.b * (255 - alpha)) >> 8) + ((rgb.b * alpha) >> 8);
+      old_draw_pixel(IMG, x + j, i, &c);
+    }
+  }
+}
+
+/* Mid-range colours so neither path clips */
+static switch_image_t *make_i420(int w, int h)
+{
+  switch_image_t *img = switch_img_alloc(NULL, SWITCH_IMG_FMT_I420, w, h, 1);
+
+  for ( int y = 0; y < h; y++) {
+    for ( int x = 0; x < w; x++) {
+      img->planes[SWITCH_PLANE_Y][y * img->stride[SWITCH_PLANE_Y] + x] = 40 + rand() % 160;
+    }
+  }
+
+  for ( int y = 0; y < (h + 1) / 2; y++) {
+    for ( int x = 0; x < (w + 1) / 2; x++) {
+      img->planes[SWITCH_PLANE_U][y * img->stride[SWITCH_PLANE_U] + x] = 100 + rand() % 56;
+      img->planes[SWITCH_PLANE_V][y * img->stride[SWITCH_PLANE_V] + x] = 100 + rand() % 56;
+    }
+  }
+
+  return img;
+}
+
+/* Either fully opaque or fully clear pixels, with opaque runs long enough for the vector path, or any alpha at all */
+static switch_image_t *make_argb(int w, int h, switch_bool_t binary)
+{
+  switch_image_t *img = switch_img_alloc(NULL, SWITCH_IMG_FMT_ARGB, w, h, 1);
+
+  for ( int y = 0; y < h; y++) {
+    for ( int x = 0; x < w; x++) {
+      uint8_t *p = img->planes[SWITCH_PLANE_PACKED] + y * img->stride[SWITCH_PLANE_PACKED] + x * 4;
+
+      if (binary) {
+        p[0] = (x < 20 || rand() % 2) ? 255 : 0;
+      } else {
+        p[0] = rand() % 256;
+      }
+      p[1] = 32 + rand() % 192;
+      p[2] = 32 + rand() % 192;
+      p[3] = 32 + rand() % 192;
+    }
+  }
+
+  return img;
+}
+
+static int plane_width(switch_image_t *img, int plane)
+{
+  return plane == SWITCH_PLANE_Y ? img->d_w : (img->d_w + 1) / 2;
+}
+
+static int plane_height(switch_image_t *img, int plane)
+{
+  return plane == SWITCH_PLANE_Y ? img->d_h : (img->d_h + 1) / 2;
+}
+
+static switch_image_t *clone_i420(switch_image_t *img)
+{
+  switch_image_t *clone = switch_img_alloc(NULL, SWITCH_IMG_FMT_I420, img->d_w, img->d_h, 1);
+
+  for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+    for ( int y = 0; y < plane_height(img, p); y++) {
+      memcpy(clone->planes[p] + y * clone->stride[p], img->planes[p] + y * img->stride[p], plane_width(img, p));
+    }
+  }
+
+  return clone;
+}
+
+typedef struct {
+  int max;
+  long total;
+  long count;
+} plane_diff_t;
+
+static void diff_planes(switch_image_t *a, switch_image_t *b, int plane, plane_diff_t *diff)
+{
+  for ( int y = 0; y < plane_height(a, plane); y++) {
+    for ( int x = 0; x < plane_width(a, plane); x++) {
+      int d = abs(a->planes[plane][y * a->stride[plane] + x] - b->planes[plane][y * b->stride[plane] + x]);
+
+      diff->max = MAX(diff->max, d);
+      diff->total += d;
+      diff->count++;
+    }
+  }
+}
+
+static double mean_diff(plane_diff_t *diff)
+{
+  return diff->count ? (double) diff->total / diff->count : 0;
+}
+
+/* Walks the canvas plane, every pixel under the source must be the source's and every other one untouched */
+static switch_bool_t overlay_copied(switch_image_t *canvas, switch_image_t *before, switch_image_t *img, int x, int y, int plane)
+{
+  int shift = plane == SWITCH_PLANE_Y ? 0 : 1;
+
+  for ( int cy = 0; cy < plane_height(canvas, plane); cy++) {
+    for ( int cx = 0; cx < plane_width(canvas, plane); cx++) {
+      int sx = cx - (x >> shift), sy = cy - (y >> shift);
+      uint8_t expected = before->planes[plane][cy * before->stride[plane] + cx];
+
+      if (sx >= 0 && sy >= 0 && sx < plane_width(img, plane) && sy < plane_height(img, plane)) {
+        expected = img->planes[plane][sy * img->stride[plane] + sx];
+      }
+
+      if (canvas->planes[plane][cy * canvas->stride[plane] + cx] != expected) {
+        return SWITCH_FALSE;
+      }
+    }
+  }
+
+  return SWITCH_TRUE;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_image_t *canvas, *before, *img;
+  plane_diff_t luma = { 0 }, chroma = { 0 }, alphas[OVERLAY_ALPHAS][3] = { { { 0 } } };
+  switch_bool_t exact = SWITCH_TRUE, copied = SWITCH_TRUE, untouched = SWITCH_TRUE, close = SWITCH_TRUE;
+
+  plan(7);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  srand(7);
+
+  /* ARGB patches: clear and opaque pixels never blend, so both paths must agree to the byte */
+  for ( int o = 0; o < PATCH_OFFSETS; o++) {
+    canvas = make_i420(CANVAS_W, CANVAS_H);
+    before = clone_i420(canvas);
+    img = make_argb(PATCH_W, PATCH_H, SWITCH_TRUE);
+
+    switch_img_patch(canvas, img, patch_offsets[o][0], patch_offsets[o][1]);
+    old_patch_argb(before, img, patch_offsets[o][0], patch_offsets[o][1]);
+
+    for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+      plane_diff_t diff = { 0 };
+
+      diff_planes(canvas, before, p, &diff);
+      exact = exact && !diff.max;
+    }
+
+    switch_img_free(&canvas);
+    switch_img_free(&before);
+    switch_img_free(&img);
+  }
+  ok(exact, "An ARGB patch of clear and opaque pixels matches the old per-pixel path byte for byte");
+
+  /* Blended pixels differ a little: the old path went through RGB and shifted by 8 instead of dividing by 255,
+     and it read back chroma it had already written for the pixel to its left, which is where its luma strays */
+  for ( int o = 0; o < PATCH_OFFSETS; o++) {
+    canvas = make_i420(CANVAS_W, CANVAS_H);
+    before = clone_i420(canvas);
+    img = make_argb(PATCH_W, PATCH_H, SWITCH_FALSE);
+
+    switch_img_patch(canvas, img, patch_offsets[o][0], patch_offsets[o][1]);
+    old_patch_argb(before, img, patch_offsets[o][0], patch_offsets[o][1]);
+
+    diff_planes(canvas, before, SWITCH_PLANE_Y, &luma);
+    diff_planes(canvas, before, SWITCH_PLANE_U, &chroma);
+    diff_planes(canvas, before, SWITCH_PLANE_V, &chroma);
+
+    switch_img_free(&canvas);
+    switch_img_free(&before);
+    switch_img_free(&img);
+  }
+  ok(chroma.max <= 4 && mean_diff(&chroma) <= 1 && mean_diff(&luma) <= 2,
+     "An ARGB patch with translucent pixels stays close to the old per-pixel path (chroma max %d, mean luma %.2f chroma %.2f)",
+     chroma.max, mean_diff(&luma), mean_diff(&chroma));
+
+  /* I420 overlays at either end of the alpha range are a plain copy or nothing at all */
+  for ( int o = 0; o < OVERLAY_OFFSETS; o++) {
+    canvas = make_i420(CANVAS_W, CANVAS_H);
+    before = clone_i420(canvas);
+    img = make_i420(PATCH_W, PATCH_H);
+
+    switch_img_overlay(canvas, img, overlay_offsets[o][0], overlay_offsets[o][1], 255);
+    for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+      copied = copied && overlay_copied(canvas, before, img, overlay_offsets[o][0], overlay_offsets[o][1], p);
+    }
+
+    switch_img_free(&canvas);
+    canvas = clone_i420(before);
+    switch_img_overlay(canvas, img, overlay_offsets[o][0], overlay_offsets[o][1], 0);
+    for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+      plane_diff_t diff = { 0 };
+
+      diff_planes(canvas, before, p, &diff);
+      untouched = untouched && !diff.max;
+    }
+
+    switch_img_free(&canvas);
+    switch_img_free(&before);
+    switch_img_free(&img);
+  }
+  ok(copied, "An I420 overlay at alpha 255 copies the source planes exactly");
+  ok(untouched, "An I420 overlay at alpha 0 leaves the canvas alone");
+
+  /* In between, the old RGB round trip lost up to a couple of levels on every pixel even before blending */
+  for ( int a = 0; a < OVERLAY_ALPHAS; a++) {
+    for ( int o = 0; o < OVERLAY_OFFSETS; o++) {
+      canvas = make_i420(CANVAS_W, CANVAS_H);
+      before = clone_i420(canvas);
+      img = make_i420(PATCH_W, PATCH_H);
+
+      switch_img_overlay(canvas, img, overlay_offsets[o][0], overlay_offsets[o][1], overlay_alphas[a]);
+      old_overlay(before, img, overlay_offsets[o][0], overlay_offsets[o][1], overlay_alphas[a]);
+
+      for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+        diff_planes(canvas, before, p, &alphas[a][p]);
+      }
+
+      switch_img_free(&canvas);
+      switch_img_free(&before);
+      switch_img_free(&img);
+    }
+
+    for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+      if (mean_diff(&alphas[a][p]) > 2) {
+        printf("# alpha %d plane %d strays %.2f on average from the old path\n", overlay_alphas[a], p, mean_diff(&alphas[a][p]));
+        close = SWITCH_FALSE;
+      }
+    }
+  }
+  ok(close, "An I420 overlay with alpha in between stays close to the old RGB round trip");
+
+  /* An offset past the canvas draws nothing */
+  canvas = make_i420(CANVAS_W, CANVAS_H);
+  before = clone_i420(canvas);
+  img = make_argb(PATCH_W, PATCH_H, SWITCH_FALSE);
+  switch_img_patch(canvas, img, CANVAS_W, CANVAS_H);
+  {
+    plane_diff_t diff = { 0 };
+
+    for ( int p = SWITCH_PLANE_Y; p <= SWITCH_PLANE_V; p++) {
+      diff_planes(canvas, before, p, &diff);
+    }
+    ok(!diff.max, "An ARGB patch placed past the canvas leaves it alone");
+  }
+  switch_img_free(&canvas);
+  switch_img_free(&before);
+  switch_img_free(&img);
+
+  switch_core_destroy();
+
+  done_testing();
+}
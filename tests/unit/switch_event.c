@@ -4,6 +4,125 @@
 
 // #define BENCHMARK 1
 
+static int header_sizes[] = { 10, 100, 1000 };
+#define HEADER_SIZES (int) (sizeof(header_sizes) / sizeof(header_sizes[0]))
+
+/* Builds an event with count headers and looks every one of them up passes times.
+   Returns the number of lookups that returned the wrong value. */
+static int lookup_headers(int count, int passes, uint32_t threshold, switch_time_t *usec) {
+  switch_event_t *event = NULL;
+  switch_time_t start_ts;
+  char **names = NULL;
+  int misses = 0;
+
+  switch_event_set_header_index_threshold(threshold);
+
+  names = calloc(count, sizeof(char *));
+  switch_event_create(&event, SWITCH_EVENT_CHANNEL_DATA);
+
+  for ( int x = 0; x < count; x++) {
+    names[x] = switch_mprintf("variable_header_name_%d", x);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, names[x], names[x]);
+  }
+
+  start_ts = switch_time_now();
+  for ( int p = 0; p < passes; p++) {
+    for ( int x = 0; x < count; x++) {
+      const char *val = switch_event_get_header(event, names[x]);
+      if (!val || strcmp(val, names[x])) {
+        misses++;
+      }
+    }
+  }
+  *usec = switch_time_now() - start_ts;
+
+  switch_event_destroy(&event);
+
+  for ( int x = 0; x < count; x++) {
+    free(names[x]);
+  }
+  free(names);
+
+  return misses;
+}
+
+#define SHARD_COUNT 4
+#define SHARD_CALLS 4
+#define SHARD_EVENTS 200
+
+static struct {
+  switch_mutex_t *mutex;
+  int received;
+  int last_seq[SHARD_CALLS];
+  int out_of_order;
+  switch_thread_id_t threads[SHARD_COUNT];
+  int nthreads;
+} shard_test;
+
+static void shard_event_handler(switch_event_t *event)
+{
+  const char *uuid = switch_event_get_header(event, "Unique-ID");
+  int seq = atoi(switch_str_nil(switch_event_get_header(event, "Seq")));
+  switch_thread_id_t self = switch_thread_self();
+  int x;
+
+  switch_mutex_lock(shard_test.mutex);
+  if (uuid) {
+    int call = atoi(uuid);
+
+    if (seq != shard_test.last_seq[call] + 1) {
+      shard_test.out_of_order++;
+    }
+    shard_test.last_seq[call] = seq;
+  } else {
+    for (x = 0; x < shard_test.nthreads && shard_test.threads[x] != self; x++);
+    if (x == shard_test.nthreads && x < SHARD_COUNT) {
+      shard_test.threads[shard_test.nthreads++] = self;
+    }
+  }
+  shard_test.received++;
+  switch_mutex_unlock(shard_test.mutex);
+}
+
+/* Fires interleaved events for a few calls and some without a call on the dispatch shards */
+static int fire_sharded_events(switch_memory_pool_t *pool)
+{
+  switch_event_t *event = NULL;
+  int received, waited = 0;
+
+  switch_mutex_init(&shard_test.mutex, SWITCH_MUTEX_NESTED, pool);
+  for ( int c = 0; c < SHARD_CALLS; c++) {
+    shard_test.last_seq[c] = -1;
+  }
+
+  switch_event_bind("switch_event_test", SWITCH_EVENT_CUSTOM, "test::shard", shard_event_handler, NULL);
+  switch_event_launch_dispatch_shards(SHARD_COUNT);
+
+  for ( int x = 0; x < SHARD_EVENTS; x++) {
+    for ( int c = 0; c <= SHARD_CALLS; c++) {
+      switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, "test::shard");
+      if (c < SHARD_CALLS) {
+        switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Unique-ID", "%d", c);
+      }
+      switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Seq", "%d", x);
+      switch_event_fire(&event);
+    }
+  }
+
+  do {
+    switch_mutex_lock(shard_test.mutex);
+    received = shard_test.received;
+    switch_mutex_unlock(shard_test.mutex);
+    if (received < SHARD_EVENTS * (SHARD_CALLS + 1)) {
+      switch_yield(10000);
+    }
+  } while (received < SHARD_EVENTS * (SHARD_CALLS + 1) && ++waited < 500);
+
+  switch_event_unbind_callback(shard_event_handler);
+
+  return received;
+}
+
 int main () {
   switch_event_t *event = NULL;
   switch_bool_t verbose = SWITCH_TRUE;
@@ -16,12 +135,19 @@ int main () {
   double micro_per = 0;
   double rate_per_sec = 0;
 
+  uint32_t old_threshold = 0;
+  switch_time_t indexed_us = 0, linear_us = 0;
+  int passes = 1;
+  switch_event_alloc_stats_t stats_before = { 0 }, stats_after = { 0 };
+  switch_memory_pool_t *pool = NULL;
+
 #ifdef BENCHMARK
   switch_time_t small_start_ts, small_end_ts;
 
-  plan(2);
+  passes = 1000;
+  plan(2 + (2 * HEADER_SIZES));
 #else
-  plan(2 + ( 2 * loops));
+  plan(2 + ( 2 * loops) + (2 * HEADER_SIZES) + 9);
 #endif
 
   status = switch_core_init(SCF_MINIMAL, verbose, &err);
@@ -85,6 +211,62 @@ int main () {
 
 
   switch_event_destroy(&event);
+
+  /* Header index: the same lookups with and without the index at 10/100/1000 headers */
+  old_threshold = switch_event_set_header_index_threshold(0);
+
+  for ( int i = 0; i < HEADER_SIZES; i++) {
+    int count = header_sizes[i];
+
+    ok(lookup_headers(count, passes, old_threshold, &indexed_us) == 0, "Indexed header lookups return the right values");
+    ok(lookup_headers(count, passes, 0, &linear_us) == 0, "Linear header lookups return the right values");
+
+#ifdef BENCHMARK
+    note("switch_event get_header %d headers: indexed %.3f us per lookup, linear %.3f us per lookup\n", count,
+         indexed_us / (double) (count * passes), linear_us / (double) (count * passes));
+#endif
+  }
+
+#ifndef BENCHMARK
+  /* duplicate names must keep resolving to the first header in list order */
+  switch_event_set_header_index_threshold(1);
+  status = switch_event_create(&event, SWITCH_EVENT_CUSTOM);
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "dup", "one");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "other", "x");
+  switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Dup", "two");
+  is(switch_event_get_header(event, "DUP"), "one", "First duplicate header wins");
+
+  switch_event_add_header_string(event, SWITCH_STACK_TOP, "dup", "zero");
+  is(switch_event_get_header(event, "dup"), "zero", "Header stacked on top wins");
+
+  switch_event_del_header_val(event, "dup", "zero");
+  is(switch_event_get_header(event, "dup"), "one", "Next duplicate is found after delete");
+
+  switch_event_rename_header(event, "other", "renamed");
+  ok(switch_event_get_header(event, "other") == NULL && switch_event_get_header(event, "renamed") != NULL, "Renamed header is reindexed");
+
+  switch_event_del_header(event, "dup");
+  ok(switch_event_get_header(event, "dup") == NULL, "All duplicates removed");
+  switch_event_destroy(&event);
+
+  /* events and headers freed on this thread are handed out again instead of going back to malloc */
+  switch_event_get_alloc_stats(&stats_before);
+  for ( int x = 0; x < loops; x++) {
+    switch_event_create(&event, SWITCH_EVENT_CUSTOM);
+    switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, index[x], index[x]);
+    switch_event_destroy(&event);
+  }
+  switch_event_get_alloc_stats(&stats_after);
+  ok(stats_after.events_allocated - stats_before.events_allocated <= 1, "Events are recycled by the allocator");
+
+  /* each call keeps its order on the dispatch shards */
+  switch_core_new_memory_pool(&pool);
+  ok(fire_sharded_events(pool) == SHARD_EVENTS * (SHARD_CALLS + 1), "Every event fired is delivered by the dispatch shards");
+  ok(!shard_test.out_of_order, "Events of one call are delivered in the order they were fired");
+  ok(shard_test.nthreads == SHARD_COUNT, "Events without a call are spread over every shard");
+#endif
+
+  switch_event_set_header_index_threshold(old_threshold);
   /* END LOOPS */
   
   end_ts = switch_time_now();
@@ -100,6 +282,10 @@ int main () {
   note("switch_event Total %ldus / %d loops, %.2f us per loop, %.0f loops per second\n", 
        micro_total, loops, micro_per, rate_per_sec);
 
+  if (pool) {
+    switch_core_destroy_memory_pool(&pool);
+  }
+
   switch_core_destroy();
 
   done_testing();
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+
+// #define BENCHMARK 1
+
+#define PACKETS_PER_FRAME 40
+
+/* Builds a video trace of frames split over PACKETS_PER_FRAME packets, then shuffles every packet
+   up to reorder places later and flags about one in loss_pct hundred as lost on the wire. */
+static switch_rtp_packet_t *make_trace(int frames, uint16_t first_seq, int reorder, int loss_pct, uint8_t **lost)
+{
+  int packets = frames * PACKETS_PER_FRAME;
+  switch_rtp_packet_t *trace = calloc(packets, sizeof(*trace));
+  uint32_t seed = 1;
+
+  *lost = calloc(packets, 1);
+
+  for ( int x = 0; x < packets; x++) {
+    trace[x].header.seq = htons((uint16_t)(first_seq + x));
+    trace[x].header.ts = htonl(90000 + (x / PACKETS_PER_FRAME) * 3000);
+    trace[x].header.m = (x % PACKETS_PER_FRAME) == PACKETS_PER_FRAME - 1;
+  }
+
+  for ( int x = 0; reorder && x < packets; x++) {
+    int y;
+
+    seed = seed * 1103515245 + 12345;
+    y = x + (seed >> 16) % (reorder + 1);
+
+    if (y < packets) {
+      switch_rtp_packet_t tmp = trace[x];
+      trace[x] = trace[y];
+      trace[y] = tmp;
+    }
+  }
+
+  for ( int x = 0; loss_pct && x < packets; x++) {
+    seed = seed * 1103515245 + 12345;
+    (*lost)[x] = ((seed >> 16) % 100) < (uint32_t) loss_pct;
+  }
+
+  return trace;
+}
+
+/* Feeds the trace into a video buffer the way the rtp read path does, reading and draining NACKs
+   after every packet. Returns the number of packets read back and counts reads that went backwards. */
+static int replay(switch_rtp_packet_t *trace, uint8_t *lost, int packets, int *backwards, int *nacks, switch_time_t *usec)
+{
+  switch_jb_t *jb = NULL;
+  switch_time_t start_ts;
+  int got = 0, last = -1;
+
+  switch_jb_create(&jb, SJB_VIDEO, 1, 30, NULL);
+  *backwards = *nacks = 0;
+
+  start_ts = switch_time_now();
+  for ( int x = 0; x < packets; x++) {
+    switch_rtp_packet_t packet;
+    switch_size_t len = 0;
+
+    if (!lost[x]) {
+      switch_jb_put_packet(jb, &trace[x], 12);
+    }
+
+    while (switch_jb_pop_nack(jb)) {
+      (*nacks)++;
+    }
+
+    while (switch_jb_get_packet(jb, &packet, &len) == SWITCH_STATUS_SUCCESS) {
+      int seq = ntohs(packet.header.seq);
+
+      if (last > -1 && (uint16_t)(seq - last) > 0x8000) {
+        (*backwards)++;
+      }
+      last = seq;
+      got++;
+    }
+  }
+  *usec = switch_time_now() - start_ts;
+
+  switch_jb_destroy(&jb);
+
+  return got;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_jb_t *jb = NULL;
+  switch_rtp_packet_t *trace, packet;
+  switch_size_t len = 0;
+  switch_time_t clean_usec = 0, lossy_usec = 0;
+  uint8_t *lost;
+  uint32_t nack;
+  int frames = 50, packets, got, backwards = 0, nacks = 0;
+
+#ifdef BENCHMARK
+  frames = 5000;
+#endif
+
+  packets = frames * PACKETS_PER_FRAME;
+
+  plan(9);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  trace = make_trace(frames, 65000, 0, 0, &lost);
+  got = replay(trace, lost, packets, &backwards, &nacks, &clean_usec);
+  ok(got > packets - 2 * PACKETS_PER_FRAME && backwards == 0, "In order trace reads back in order across the seq wrap");
+  ok(nacks == 0, "In order trace asks for nothing");
+  free(trace);
+  free(lost);
+
+  trace = make_trace(frames, 100, 8, 0, &lost);
+  got = replay(trace, lost, packets, &backwards, &nacks, &lossy_usec);
+  ok(got > 0 && backwards == 0, "Reordered trace reads back in seq order");
+  free(trace);
+  free(lost);
+
+  trace = make_trace(frames, 100, 8, 2, &lost);
+  got = replay(trace, lost, packets, &backwards, &nacks, &lossy_usec);
+  ok(backwards == 0 && nacks > 0, "Lossy trace reads back in seq order and NACKs the gaps");
+
+  switch_jb_create(&jb, SJB_VIDEO, 1, 30, NULL);
+  trace = make_trace(1, 200, 0, 0, &lost);
+  for ( int x = 0; x < PACKETS_PER_FRAME; x++) {
+    if (x != 5 && x != 7) {
+      switch_jb_put_packet(jb, &trace[x], 12);
+    }
+  }
+
+  nack = switch_jb_pop_nack(jb);
+  ok(ntohs(nack & 0xffff) == 205 && ntohs(nack >> 16) == (1 << 1), "NACK names the first lost seq with the next one in the bitmask");
+  ok(switch_jb_pop_nack(jb) == 0, "A NACKed seq is not asked for twice");
+
+  ok(switch_jb_get_packet_by_seq(jb, htons(210), &packet, &len) == SWITCH_STATUS_SUCCESS && ntohs(packet.header.seq) == 210 && len == 12,
+     "Buffered packet found by seq");
+  ok(switch_jb_get_packet_by_seq(jb, htons(205), &packet, &len) != SWITCH_STATUS_SUCCESS, "Lost packet is not found by seq");
+
+  switch_jb_destroy(&jb);
+  free(trace);
+  free(lost);
+
+  note("switch_jb replay of %d frames x %d packets: in order %ldus (%.3f us per packet), reordered with 2%% loss %ldus (%.3f us per packet)\n",
+       frames, PACKETS_PER_FRAME, clean_usec, clean_usec / (double) packets, lossy_usec, lossy_usec / (double) packets);
+
+  switch_core_destroy();
+
+  done_testing();
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+
+// #define BENCHMARK 1
+
+/* 20ms of 48kHz stereo, then lengths that leave the vector kernels a scalar tail */
+#define MAX_SAMPLES 1923
+static const int frame_lengths[] = { 1920, 1923, 161 };
+#define FRAME_LENGTHS (int) (sizeof(frame_lengths) / sizeof(frame_lengths[0]))
+
+static const char *kernels[] = { "scalar", "sse2", "avx2" };
+#define KERNELS (int) (sizeof(kernels) / sizeof(kernels[0]))
+
+/* Mixes members synthetic speakers the way conference_thread_run does, the sum then every member's
+   mix minus itself, loops times. The output of the last loop is left in out. */
+static void mix_members(int16_t **frames, int members, int samples, int loops, int16_t *out, switch_time_t *usec) {
+  int32_t mix[MAX_SAMPLES];
+  switch_time_t start_ts;
+
+  start_ts = switch_time_now();
+  for ( int l = 0; l < loops; l++) {
+    memset(mix, 0, sizeof(mix));
+
+    for ( int m = 0; m < members; m++) {
+      switch_mix_accumulate_sln(mix, frames[m], samples);
+    }
+
+    for ( int m = 0; m < members; m++) {
+      switch_mix_minus_sln(out + (m * MAX_SAMPLES), mix, frames[m], samples);
+    }
+  }
+  *usec = switch_time_now() - start_ts;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  int members = 10, loops = 10;
+  int16_t **frames = NULL;
+  int16_t *expected = NULL, *out = NULL, *volume = NULL;
+  switch_time_t usec = 0;
+
+#ifdef BENCHMARK
+  members = 500;
+  loops = 500;
+#endif
+
+  plan(1 + (FRAME_LENGTHS * KERNELS * 2));
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  note("switch_mix picked the %s kernel\n", switch_mix_get_kernel());
+
+  frames = calloc(members, sizeof(int16_t *));
+  for ( int m = 0; m < members; m++) {
+    frames[m] = malloc(MAX_SAMPLES * sizeof(int16_t));
+    for ( int x = 0; x < MAX_SAMPLES; x++) {
+      /* loud enough that the sums clip */
+      frames[m][x] = (int16_t) ((rand() % 65536) - 32768);
+    }
+  }
+
+  expected = calloc(members * MAX_SAMPLES, sizeof(int16_t));
+  out = calloc(members * MAX_SAMPLES, sizeof(int16_t));
+  volume = calloc(MAX_SAMPLES * 2, sizeof(int16_t));
+
+  for ( int f = 0; f < FRAME_LENGTHS; f++) {
+    int samples = frame_lengths[f];
+
+    switch_mix_set_kernel("scalar");
+    memset(expected, 0, members * MAX_SAMPLES * sizeof(int16_t));
+    mix_members(frames, members, samples, 1, expected, &usec);
+    memcpy(volume, frames[0], samples * sizeof(int16_t));
+    switch_change_sln_volume(volume, samples, 4);
+
+    for ( int k = 0; k < KERNELS; k++) {
+      if (switch_mix_set_kernel(kernels[k]) != SWITCH_STATUS_SUCCESS) {
+        ok(1, "%s mix is not supported by this cpu", kernels[k]);
+        ok(1, "%s volume is not supported by this cpu", kernels[k]);
+        continue;
+      }
+
+      memset(out, 0, members * MAX_SAMPLES * sizeof(int16_t));
+      mix_members(frames, members, samples, loops, out, &usec);
+      ok(!memcmp(out, expected, members * MAX_SAMPLES * sizeof(int16_t)), "%s mix of %d samples matches the scalar mix", kernels[k], samples);
+
+      memcpy(volume + MAX_SAMPLES, frames[0], samples * sizeof(int16_t));
+      switch_change_sln_volume(volume + MAX_SAMPLES, samples, 4);
+      ok(!memcmp(volume, volume + MAX_SAMPLES, samples * sizeof(int16_t)), "%s volume of %d samples matches the scalar volume", kernels[k], samples);
+
+      note("switch_mix %s: %d members x %d frames of %d samples, Total %" SWITCH_TIME_T_FMT "us, %.2f us per frame\n",
+           kernels[k], members, loops, samples, usec, usec / (double) loops);
+    }
+  }
+
+  switch_mix_set_kernel(NULL);
+
+  for ( int m = 0; m < members; m++) {
+    free(frames[m]);
+  }
+  free(frames);
+  free(expected);
+  free(out);
+  free(volume);
+
+  switch_core_destroy();
+
+  done_testing();
+}
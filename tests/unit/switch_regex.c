@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+
+// #define BENCHMARK 1
+
+#define EXTENSIONS 2000
+
+/* Walks the extensions for every destination the way the xml dialplan does on each call,
+   stopping at the first condition that matches. Returns the number of calls routed to the
+   wrong extension. */
+static int route_calls(char **expressions, int calls, switch_time_t *usec) {
+  switch_time_t start_ts;
+  int misrouted = 0;
+
+  start_ts = switch_time_now();
+  for ( int c = 0; c < calls; c++) {
+    char destination[32];
+    int ovector[30];
+    int want = c % EXTENSIONS, got = -1;
+
+    switch_snprintf(destination, sizeof(destination), "1%04d555%04d", want, c % 10000);
+
+    for ( int x = 0; x < EXTENSIONS; x++) {
+      switch_regex_t *re = NULL;
+      int proceed = switch_regex_perform(destination, expressions[x], &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
+
+      switch_regex_safe_free(re);
+      if (proceed) {
+        got = x;
+        break;
+      }
+    }
+
+    if (got != want) {
+      misrouted++;
+    }
+  }
+  *usec = switch_time_now() - start_ts;
+
+  return misrouted;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_regex_cache_stats_t stats = { 0 };
+  switch_time_t cached_usec = 0, uncached_usec = 0;
+  char **expressions = NULL;
+  switch_regex_t *re = NULL;
+  int ovector[30];
+  int misrouted = 0;
+  int calls = 20;
+  uint32_t size;
+
+#ifdef BENCHMARK
+  calls = 2000;
+#endif
+
+  plan(8);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  expressions = calloc(EXTENSIONS, sizeof(char *));
+  for ( int x = 0; x < EXTENSIONS; x++) {
+    expressions[x] = switch_mprintf("^1%04d(\\d{3})(\\d{4})$", x);
+  }
+
+  size = switch_regex_cache_set_size(0);
+  misrouted = route_calls(expressions, calls, &uncached_usec);
+  ok(misrouted == 0, "Every call routed with the cache disabled");
+
+  switch_regex_cache_set_size(EXTENSIONS);
+  switch_regex_cache_flush();
+  misrouted = route_calls(expressions, calls, &cached_usec);
+  ok(misrouted == 0, "Every call routed with the cache enabled");
+
+  switch_regex_cache_get_stats(&stats);
+  ok(stats.entries > 0 && stats.hits > 0, "Routing reused compiled expressions");
+
+  ok(switch_regex_perform("15551234", "/^1555/", &re, ovector, sizeof(ovector) / sizeof(ovector[0])) > 0 && re != NULL,
+     "A match hands back an expression the caller owns");
+  switch_regex_safe_free(re);
+
+  ok(switch_regex_match("HELLO", "/^hello$/i") == SWITCH_STATUS_SUCCESS, "Options are part of the cache key");
+  ok(switch_regex_match("HELLO", "^hello$") != SWITCH_STATUS_SUCCESS, "Same expression without options does not match");
+
+  switch_regex_cache_flush();
+  switch_regex_cache_get_stats(&stats);
+  ok(stats.entries == 0, "Flush empties the cache");
+
+  switch_regex_cache_set_size(size);
+
+  note("switch_regex dialplan walk over %d extensions, %d calls: uncached %ldus (%.2f us per call), cached %ldus (%.2f us per call)\n",
+       EXTENSIONS, calls, uncached_usec, uncached_usec / (double) calls, cached_usec, cached_usec / (double) calls);
+
+  for ( int x = 0; x < EXTENSIONS; x++) {
+    free(expressions[x]);
+  }
+  free(expressions);
+
+  switch_core_destroy();
+
+  done_testing();
+}
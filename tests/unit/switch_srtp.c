@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <switch.h>
+#include <tap.h>
+#include <srtp.h>
+
+// #define BENCHMARK 1
+
+#define PACKETS_PER_FRAME 40
+#define PAYLOAD_LEN 1200
+
+#define TX_PORT 27800
+#define RX_PORT 27802
+
+typedef struct {
+  const char *name;
+  switch_rtp_crypto_key_type_t type;
+  int keylen;
+  void (*set_policy)(crypto_policy_t *p);
+  /* GCM needs libsrtp built against OpenSSL, AES-CM is always there */
+  switch_bool_t required;
+} suite_t;
+
+static suite_t suites[] = {
+  { "AES_CM_128_HMAC_SHA1_80", AES_CM_128_HMAC_SHA1_80, 30, crypto_policy_set_rtp_default, SWITCH_TRUE },
+  { "AES_CM_128_HMAC_SHA1_32", AES_CM_128_HMAC_SHA1_32, 30, crypto_policy_set_aes_cm_128_hmac_sha1_32, SWITCH_TRUE },
+  { "AEAD_AES_128_GCM_8", AEAD_AES_128_GCM_8, 28, crypto_policy_set_aes_gcm_128_8_auth, SWITCH_FALSE },
+  { "AEAD_AES_256_GCM_8", AEAD_AES_256_GCM_8, 44, crypto_policy_set_aes_gcm_256_8_auth, SWITCH_FALSE },
+};
+
+static srtp_t create_ctx(suite_t *suite, uint8_t *key, ssrc_type_t type)
+{
+  srtp_policy_t policy;
+  srtp_t ctx = NULL;
+
+  memset(&policy, 0, sizeof(policy));
+  suite->set_policy(&policy.rtp);
+  suite->set_policy(&policy.rtcp);
+  policy.ssrc.type = type;
+  policy.key = key;
+  policy.window_size = 1024;
+
+  if (srtp_create(&ctx, &policy) != err_status_ok) {
+    return NULL;
+  }
+
+  return ctx;
+}
+
+static void make_key(uint8_t *key, int len)
+{
+  for ( int x = 0; x < len; x++) {
+    key[x] = (uint8_t) (x * 7 + 1);
+  }
+}
+
+/* Takes whatever has arrived for a frame off the socket and checks it unprotects to what was written */
+static int receive_frame(switch_socket_t *sock, switch_sockaddr_t *from, srtp_t rx, int first, int packets)
+{
+  uint8_t buf[SWITCH_RTP_MAX_BUF_LEN];
+  switch_time_t until = switch_time_now() + 100000;
+  int intact = 0, got = 0;
+
+  while (got < packets && switch_time_now() < until) {
+    switch_size_t len = sizeof(buf);
+    int plen;
+
+    if (switch_socket_recvfrom(from, sock, 0, (char *) buf, &len) != SWITCH_STATUS_SUCCESS || !len) {
+      switch_yield(1000);
+      continue;
+    }
+
+    plen = (int) len;
+    if (srtp_unprotect(rx, buf, &plen) == err_status_ok && plen == 12 + PAYLOAD_LEN &&
+        buf[12] == ((first + got) & 0xff) && buf[12 + PAYLOAD_LEN - 1] == ((first + got) & 0xff)) {
+      intact++;
+    }
+    got++;
+  }
+
+  return intact;
+}
+
+/* Writes frames of video sized packets through a video rtp session with the suite's keys, the way the
+   video codecs hand them over, and unprotects what comes out the other side. With batch set the
+   packets of each frame queue up and are protected and sent together on the marker. Returns the
+   number of packets that came back intact, -1 when the rtp session will not take the suite. */
+static int rtp_path(suite_t *suite, uint32_t batch, int frames, switch_time_t *write_usec)
+{
+  switch_memory_pool_t *pool = NULL;
+  switch_rtp_flag_t flags[SWITCH_RTP_FLAG_INVALID] = { 0 };
+  switch_rtp_t *rtp_session = NULL;
+  switch_socket_t *sock = NULL;
+  switch_sockaddr_t *addr = NULL, *from = NULL;
+  switch_frame_t frame = { 0 };
+  uint32_t packet[(SWITCH_RTP_MAX_BUF_LEN + SRTP_MAX_TRAILER_LEN) / 4 + 16];
+  uint8_t key[64];
+  const char *err = NULL;
+  srtp_t rx = NULL;
+  int intact = -1;
+
+  switch_core_new_memory_pool(&pool);
+  make_key(key, sizeof(key));
+  switch_rtp_set_send_batch(batch);
+  *write_usec = 0;
+
+  if (switch_sockaddr_info_get(&addr, "127.0.0.1", SWITCH_UNSPEC, RX_PORT, 0, pool) != SWITCH_STATUS_SUCCESS ||
+      switch_sockaddr_create(&from, pool) != SWITCH_STATUS_SUCCESS ||
+      switch_socket_create(&sock, switch_sockaddr_get_family(addr), SOCK_DGRAM, 0, pool) != SWITCH_STATUS_SUCCESS) {
+    goto end;
+  }
+  switch_socket_opt_set(sock, SWITCH_SO_REUSEADDR, 1);
+  switch_socket_opt_set(sock, SWITCH_SO_RCVBUF, 4 * 1024 * 1024);
+  if (switch_socket_bind(sock, addr) != SWITCH_STATUS_SUCCESS) {
+    goto end;
+  }
+  switch_socket_opt_set(sock, SWITCH_SO_NONBLOCK, TRUE);
+
+  flags[SWITCH_RTP_FLAG_VIDEO] = 1;
+  flags[SWITCH_RTP_FLAG_RAW_WRITE] = 1;
+
+  if (!(rtp_session = switch_rtp_new("127.0.0.1", TX_PORT, "127.0.0.1", RX_PORT, 96, 1, 90000, flags, NULL, &err, pool))) {
+    goto end;
+  }
+
+  if (switch_rtp_add_crypto_key(rtp_session, SWITCH_RTP_CRYPTO_SEND, 1, suite->type, key, suite->keylen) != SWITCH_STATUS_SUCCESS ||
+      !(rx = create_ctx(suite, key, ssrc_any_inbound))) {
+    goto end;
+  }
+
+  intact = 0;
+  frame.packet = packet;
+  frame.data = (uint8_t *) packet + 12;
+  frame.packetlen = 12 + PAYLOAD_LEN;
+  frame.datalen = PAYLOAD_LEN;
+
+  for ( int x = 0; x < frames; x++) {
+    switch_time_t start_ts = switch_time_now();
+
+    for ( int y = 0; y < PACKETS_PER_FRAME; y++) {
+      int n = x * PACKETS_PER_FRAME + y;
+
+      memset(packet, 0, 12);
+      memset(frame.data, n & 0xff, PAYLOAD_LEN);
+      frame.flags = SFF_RAW_RTP_PARSE_FRAME;
+      frame.m = y == PACKETS_PER_FRAME - 1 ? SWITCH_TRUE : SWITCH_FALSE;
+      frame.timestamp = 90000 + x * 3000;
+      switch_rtp_write_frame(rtp_session, &frame);
+    }
+
+    *write_usec += switch_time_now() - start_ts;
+    intact += receive_frame(sock, from, rx, x * PACKETS_PER_FRAME, PACKETS_PER_FRAME);
+  }
+
+ end:
+  if (rx) {
+    srtp_dealloc(rx);
+  }
+  if (rtp_session) {
+    switch_rtp_destroy(&rtp_session);
+  }
+  if (sock) {
+    switch_socket_close(sock);
+  }
+  switch_core_destroy_memory_pool(&pool);
+  switch_rtp_set_send_batch(0);
+
+  return intact;
+}
+
+static double per_second(int packets, switch_time_t usec)
+{
+  return usec ? packets * 1000000.0 / usec : 0.0;
+}
+
+int main () {
+  switch_bool_t verbose = SWITCH_TRUE;
+  const char *err = NULL;
+  switch_status_t status = SWITCH_STATUS_SUCCESS;
+  switch_time_t batched_usec = 0, single_usec = 0;
+  switch_memory_pool_t *pool = NULL;
+  switch_rtp_io_stats_t before, after;
+  switch_rtp_hdr_t *hdr;
+  uint8_t packet[12 + PAYLOAD_LEN + SRTP_MAX_TRAILER_LEN] = { 0 };
+  uint8_t key[64];
+  srtp_t tx, rx;
+  int frames = 25, count, len;
+
+#ifdef BENCHMARK
+  frames = 2500;
+#endif
+
+  count = frames * PACKETS_PER_FRAME;
+
+  plan(6);
+
+  status = switch_core_init(SCF_MINIMAL, verbose, &err);
+
+  if ( !ok( status == SWITCH_STATUS_SUCCESS, "Initialize FreeSWITCH core\n")) {
+    bail_out(0, "Bail due to failure to initialize FreeSWITCH[%s]", err);
+  }
+
+  /* a minimal core leaves rtp alone, the pool lives until switch_core_destroy shuts it down */
+  switch_core_new_memory_pool(&pool);
+  switch_rtp_init(pool);
+
+  for ( int x = 0; x < (int) (sizeof(suites) / sizeof(suites[0])); x++) {
+    int batched, single;
+
+    switch_rtp_get_io_stats(&before);
+    batched = rtp_path(&suites[x], PACKETS_PER_FRAME, frames, &batched_usec);
+    switch_rtp_get_io_stats(&after);
+
+    if (batched < 0 && !suites[x].required) {
+      ok(1, "%s is not available in this srtp build", suites[x].name);
+      continue;
+    }
+
+    single = rtp_path(&suites[x], 0, frames, &single_usec);
+
+    ok(batched == count && single == count && after.srtp_batches - before.srtp_batches == (uint64_t) frames,
+       "%s video frames protected in one pass per frame unprotect intact", suites[x].name);
+    note("%s: %d packets of %d bytes, write %.0f packets/s batched, %.0f packets/s one at a time\n",
+         suites[x].name, count, PAYLOAD_LEN, per_second(count, batched_usec), per_second(count, single_usec));
+  }
+
+  /* A tampered packet must not get through */
+  make_key(key, sizeof(key));
+  tx = create_ctx(&suites[0], key, ssrc_any_outbound);
+  rx = create_ctx(&suites[0], key, ssrc_any_inbound);
+  hdr = (switch_rtp_hdr_t *) packet;
+  hdr->version = 2;
+  hdr->pt = 96;
+  hdr->ssrc = htonl(0x12345678);
+  len = 12 + PAYLOAD_LEN;
+  srtp_protect(tx, packet, &len);
+  packet[20] ^= 1;
+  ok(srtp_unprotect(rx, packet, &len) == err_status_auth_fail, "A tampered packet fails authentication");
+  srtp_dealloc(tx);
+  srtp_dealloc(rx);
+
+  switch_core_destroy();
+
+  done_testing();
+}